@@ -25,6 +25,7 @@
 #include <isc/buffer.h>
 #include <isc/log.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/netdb.h>
 #include <isc/net.h>
 #include <isc/print.h>
@@ -32,6 +33,8 @@
 #include <isc/stdio.h>
 #include <isc/string.h>
 #include <isc/symtab.h>
+#include <isc/thread.h>
+#include <isc/time.h>
 #include <isc/types.h>
 #include <isc/util.h>
 
@@ -44,6 +47,7 @@
 #include <dns/rdataclass.h>
 #include <dns/rdataset.h>
 #include <dns/rdatasetiter.h>
+#include <dns/rdatastruct.h>
 #include <dns/rdatatype.h>
 #include <dns/result.h>
 #include <dns/types.h>
@@ -111,6 +115,7 @@ unsigned int zone_options = DNS_ZONEOPT_CHECKNS |
 			    DNS_ZONEOPT_WARNMXCNAME |
 			    DNS_ZONEOPT_WARNSRVCNAME;
 unsigned int zone_options2 = 0;
+unsigned int nthreads = 1;
 
 /*
  * This needs to match the list in bin/named/log.c.
@@ -124,6 +129,33 @@ static isc_logcategory_t categories[] = {
 static isc_symtab_t *symtab = NULL;
 static isc_mem_t *sym_mctx;
 
+/*%
+ * When the zone loads, the host names that checkns(), checkmx() and
+ * checksrv() will look up are collected and looked up in parallel
+ * before the integrity checks run.
+ */
+typedef struct {
+	char			*name;
+	int			result;
+	struct addrinfo		*ai;
+} hostentry_t;
+
+static isc_symtab_t *hosttab = NULL;
+static isc_mem_t *host_mctx = NULL;
+static hostentry_t *hosts = NULL;
+static unsigned int nhosts = 0;
+static unsigned int hostsize = 0;
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_mutex_t hostlock;
+#endif
+static unsigned int hostnext = 0;
+
+/*%
+ * Phase timings reported with -d.
+ */
+static isc_time_t loadstart, checkstart, resolvedone;
+static isc_boolean_t checkstarted = ISC_FALSE;
+
 static void
 freekey(char *key, unsigned int type, isc_symvalue_t value, void *userarg) {
 	UNUSED(type);
@@ -173,6 +205,356 @@ logged(char *key, int value) {
 	return (ISC_FALSE);
 }
 
+static void
+report_time(const char *phase, isc_time_t *start, isc_time_t *end,
+	    const char *detail)
+{
+	isc_uint64_t usecs;
+
+	if (!debug)
+		return;
+
+	usecs = isc_time_microdiff(end, start);
+	fprintf(stderr, "%s: %u.%03u seconds%s\n", phase,
+		(unsigned int)(usecs / 1000000),
+		(unsigned int)((usecs % 1000000) / 1000),
+		detail != NULL ? detail : "");
+}
+
+#ifdef USE_GETADDRINFO
+/*%
+ * Format 'name' for getaddrinfo() with search turned off.
+ */
+static void
+hostname(const dns_name_t *name, char *namebuf, size_t size) {
+	dns_name_format(name, namebuf, size - 1);
+	if (dns_name_countlabels(name) > 1U)
+		strlcat(namebuf, ".", size);
+}
+
+static void
+sethints(struct addrinfo *hints) {
+	memset(hints, 0, sizeof(*hints));
+	hints->ai_flags = AI_CANONNAME;
+	hints->ai_family = PF_UNSPEC;
+	hints->ai_socktype = SOCK_STREAM;
+	hints->ai_protocol = IPPROTO_TCP;
+}
+
+/*%
+ * getaddrinfo() with the answers looked up in advance.  '*cachedp' is
+ * set if '*aip' belongs to the cache and must not be freed.
+ */
+static int
+gethost(const char *namebuf, const struct addrinfo *hints,
+	struct addrinfo **aip, isc_boolean_t *cachedp)
+{
+	isc_symvalue_t value;
+	hostentry_t *host;
+
+	if (hosttab != NULL &&
+	    isc_symtab_lookup(hosttab, namebuf, 1, &value) == ISC_R_SUCCESS)
+	{
+		host = &hosts[value.as_uinteger];
+		*aip = host->ai;
+		*cachedp = ISC_TRUE;
+		return (host->result);
+	}
+
+	*cachedp = ISC_FALSE;
+	return (getaddrinfo(namebuf, NULL, hints, aip));
+}
+
+/*%
+ * Remember that 'target' will need looking up, unless the zone itself
+ * has the answer.  checkns() only looks up glue, so with 'glueonly'
+ * out-of-zone names are skipped too.
+ */
+static isc_result_t
+wanthost(dns_zone_t *zone, dns_db_t *db, const dns_name_t *target,
+	 isc_boolean_t glueonly)
+{
+	char namebuf[DNS_NAME_FORMATSIZE + 1];
+	dns_fixedname_t fixed;
+	isc_symvalue_t value;
+	hostentry_t *newhosts;
+	unsigned int newsize;
+	isc_result_t result;
+	char *key;
+
+	if (dns_name_equal(target, dns_rootname))
+		return (ISC_R_SUCCESS);
+
+	/*
+	 * In-zone names are only looked up when they are at or below
+	 * a delegation.
+	 */
+	if (dns_name_issubdomain(target, dns_zone_getorigin(zone))) {
+		dns_fixedname_init(&fixed);
+		result = dns_db_find(db, target, NULL, dns_rdatatype_a,
+				     0, 0, NULL, dns_fixedname_name(&fixed),
+				     NULL, NULL);
+		if (result != DNS_R_DELEGATION)
+			return (ISC_R_SUCCESS);
+	} else if (glueonly)
+		return (ISC_R_SUCCESS);
+
+	hostname(target, namebuf, sizeof(namebuf));
+	if (isc_symtab_lookup(hosttab, namebuf, 1, NULL) == ISC_R_SUCCESS)
+		return (ISC_R_SUCCESS);
+
+	if (nhosts == hostsize) {
+		newsize = (hostsize == 0) ? 256 : hostsize * 2;
+		newhosts = isc_mem_get(host_mctx, newsize * sizeof(*newhosts));
+		if (newhosts == NULL)
+			return (ISC_R_NOMEMORY);
+		if (hosts != NULL) {
+			memmove(newhosts, hosts, nhosts * sizeof(*hosts));
+			isc_mem_put(host_mctx, hosts,
+				    hostsize * sizeof(*hosts));
+		}
+		hosts = newhosts;
+		hostsize = newsize;
+	}
+
+	key = isc_mem_strdup(host_mctx, namebuf);
+	if (key == NULL)
+		return (ISC_R_NOMEMORY);
+	value.as_uinteger = nhosts;
+	result = isc_symtab_define(hosttab, key, 1, value,
+				   isc_symexists_reject);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_free(host_mctx, key);
+		return (result);
+	}
+	hosts[nhosts].name = key;
+	hosts[nhosts].result = EAI_FAIL;
+	hosts[nhosts].ai = NULL;
+	nhosts++;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Collect the targets of the 'type' records at 'node' if 'collect' is
+ * set.  Returns ISC_FALSE if there are no such records.
+ */
+static isc_boolean_t
+wanttargets(dns_zone_t *zone, dns_db_t *db, dns_dbnode_t *node,
+	    dns_rdatatype_t type, isc_boolean_t collect, isc_result_t *resultp)
+{
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdata_ns_t ns;
+	dns_rdata_mx_t mx;
+	dns_rdata_in_srv_t srv;
+	isc_result_t result;
+
+	dns_rdataset_init(&rdataset);
+	result = dns_db_findrdataset(db, node, NULL, type, 0, 0,
+				     &rdataset, NULL);
+	if (result != ISC_R_SUCCESS)
+		return (ISC_FALSE);
+
+	for (result = dns_rdataset_first(&rdataset);
+	     collect && result == ISC_R_SUCCESS && *resultp == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(&rdataset))
+	{
+		dns_rdataset_current(&rdataset, &rdata);
+		switch (type) {
+		case dns_rdatatype_ns:
+			result = dns_rdata_tostruct(&rdata, &ns, NULL);
+			RUNTIME_CHECK(result == ISC_R_SUCCESS);
+			*resultp = wanthost(zone, db, &ns.name, ISC_TRUE);
+			break;
+		case dns_rdatatype_mx:
+			result = dns_rdata_tostruct(&rdata, &mx, NULL);
+			RUNTIME_CHECK(result == ISC_R_SUCCESS);
+			*resultp = wanthost(zone, db, &mx.mx, ISC_FALSE);
+			break;
+		case dns_rdatatype_srv:
+			result = dns_rdata_tostruct(&rdata, &srv, NULL);
+			RUNTIME_CHECK(result == ISC_R_SUCCESS);
+			*resultp = wanthost(zone, db, &srv.target,
+					    ISC_FALSE);
+			break;
+		default:
+			INSIST(0);
+		}
+		dns_rdata_reset(&rdata);
+	}
+	dns_rdataset_disassociate(&rdataset);
+	return (ISC_TRUE);
+}
+
+/*%
+ * Look up the collected names, taking the next one until none are left.
+ */
+static void
+resolvehosts(void) {
+	struct addrinfo hints;
+	hostentry_t *host;
+	unsigned int i;
+
+	sethints(&hints);
+	for (;;) {
+#ifdef ISC_PLATFORM_USETHREADS
+		LOCK(&hostlock);
+#endif
+		i = hostnext++;
+#ifdef ISC_PLATFORM_USETHREADS
+		UNLOCK(&hostlock);
+#endif
+		if (i >= nhosts)
+			break;
+		host = &hosts[i];
+		host->result = getaddrinfo(host->name, NULL, &hints,
+					   &host->ai);
+	}
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+resolve_run(isc_threadarg_t arg) {
+	UNUSED(arg);
+
+	resolvehosts();
+	return ((isc_threadresult_t)0);
+}
+#endif
+
+/*%
+ * Walk the newly loaded zone the way integrity_checks() in
+ * lib/dns/zone.c does, collect every name that checkns(), checkmx()
+ * and checksrv() would pass to getaddrinfo(), and look them up on
+ * 'nthreads' threads.  Failures only mean that the checks do their
+ * own lookups.
+ */
+static void
+prefetch(dns_zone_t *zone, dns_db_t *db) {
+	dns_dbiterator_t *dbiter = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_fixedname_t fixed, fixedbottom;
+	dns_name_t *name, *bottom;
+	const dns_name_t *origin;
+	isc_boolean_t dosrv;
+	isc_result_t result, tresult = ISC_R_SUCCESS;
+#ifdef ISC_PLATFORM_USETHREADS
+	isc_thread_t *threads = NULL;
+	unsigned int i, running = 0;
+#endif
+
+	INSIST(hosttab == NULL);
+
+	isc_mem_attach(dns_zone_getmctx(zone), &host_mctx);
+	result = isc_symtab_create(host_mctx, 1021, freekey, host_mctx,
+				   ISC_FALSE, &hosttab);
+	if (result != ISC_R_SUCCESS)
+		return;
+
+	dns_fixedname_init(&fixed);
+	name = dns_fixedname_name(&fixed);
+	dns_fixedname_init(&fixedbottom);
+	bottom = dns_fixedname_name(&fixedbottom);
+	origin = dns_zone_getorigin(zone);
+	dosrv = ISC_TF(dochecksrv &&
+		       dns_zone_getclass(zone) == dns_rdataclass_in);
+
+	result = dns_db_createiterator(db, 0, &dbiter);
+	if (result != ISC_R_SUCCESS)
+		return;
+
+	for (result = dns_dbiterator_first(dbiter);
+	     result == ISC_R_SUCCESS && tresult == ISC_R_SUCCESS;
+	     result = dns_dbiterator_next(dbiter))
+	{
+		result = dns_dbiterator_current(dbiter, &node, name);
+		if (result != ISC_R_SUCCESS)
+			break;
+
+		if (!dns_name_issubdomain(name, origin) ||
+		    (dns_name_countlabels(bottom) > 0 &&
+		     dns_name_issubdomain(name, bottom)))
+			goto next;
+
+		if (!dns_name_equal(name, origin) &&
+		    wanttargets(zone, db, node, dns_rdatatype_ns,
+				docheckns, &tresult))
+		{
+			dns_name_copy(name, bottom, NULL);
+			goto next;
+		}
+		if (wanttargets(zone, db, node, dns_rdatatype_dname,
+				ISC_FALSE, &tresult))
+			dns_name_copy(name, bottom, NULL);
+		if (docheckmx)
+			(void)wanttargets(zone, db, node, dns_rdatatype_mx,
+					  ISC_TRUE, &tresult);
+		if (dosrv)
+			(void)wanttargets(zone, db, node, dns_rdatatype_srv,
+					  ISC_TRUE, &tresult);
+ next:
+		dns_db_detachnode(db, &node);
+	}
+	if (node != NULL)
+		dns_db_detachnode(db, &node);
+	dns_dbiterator_destroy(&dbiter);
+
+	hostnext = 0;
+#ifdef ISC_PLATFORM_USETHREADS
+	if (nthreads > 1 && nhosts > 1 &&
+	    isc_mutex_init(&hostlock) == ISC_R_SUCCESS)
+	{
+		/*
+		 * This thread takes its share too.
+		 */
+		threads = isc_mem_get(host_mctx, nthreads * sizeof(*threads));
+		for (i = 1; threads != NULL && i < nthreads; i++) {
+			if (isc_thread_create(resolve_run, NULL,
+					      &threads[running]) !=
+			    ISC_R_SUCCESS)
+				break;
+			running++;
+		}
+		resolvehosts();
+		for (i = 0; i < running; i++)
+			(void)isc_thread_join(threads[i], NULL);
+		if (threads != NULL)
+			isc_mem_put(host_mctx, threads,
+				    nthreads * sizeof(*threads));
+		DESTROYLOCK(&hostlock);
+		return;
+	}
+#endif
+	resolvehosts();
+}
+
+/*%
+ * Free the answers looked up by prefetch().
+ */
+static void
+freehosts(void) {
+	unsigned int i;
+
+	if (host_mctx == NULL)
+		return;
+
+	for (i = 0; i < nhosts; i++)
+		if (hosts[i].result == 0)
+			freeaddrinfo(hosts[i].ai);
+	if (hosts != NULL)
+		isc_mem_put(host_mctx, hosts, hostsize * sizeof(*hosts));
+	hosts = NULL;
+	nhosts = hostsize = 0;
+	if (hosttab != NULL)
+		isc_symtab_destroy(&hosttab);
+	isc_mem_detach(&host_mctx);
+}
+#endif /* USE_GETADDRINFO */
+
 static isc_boolean_t
 checkns(dns_zone_t *zone, const dns_name_t *name, const dns_name_t *owner,
 	dns_rdataset_t *a, dns_rdataset_t *aaaa)
@@ -185,7 +567,7 @@ checkns(dns_zone_t *zone, const dns_name_t *name, const dns_name_t *owner,
 	char ownerbuf[DNS_NAME_FORMATSIZE];
 	char addrbuf[sizeof("xxxx:xxxx:xxxx:xxxx:xxxx:xxxx:123.123.123.123")];
 	isc_boolean_t answer = ISC_TRUE;
-	isc_boolean_t match;
+	isc_boolean_t match, cached;
 	const char *type;
 	void *ptr = NULL;
 	int result;
@@ -198,22 +580,15 @@ checkns(dns_zone_t *zone, const dns_name_t *name, const dns_name_t *owner,
 	if (a == NULL || aaaa == NULL)
 		return (answer);
 
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_flags = AI_CANONNAME;
-	hints.ai_family = PF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
+	sethints(&hints);
 
-	dns_name_format(name, namebuf, sizeof(namebuf) - 1);
 	/*
 	 * Turn off search.
 	 */
-	if (dns_name_countlabels(name) > 1U) {
-		strlcat(namebuf, ".", sizeof(namebuf));
-	}
+	hostname(name, namebuf, sizeof(namebuf));
 	dns_name_format(owner, ownerbuf, sizeof(ownerbuf));
 
-	result = getaddrinfo(namebuf, NULL, &hints, &ai);
+	result = gethost(namebuf, &hints, &ai, &cached);
 	dns_name_format(name, namebuf, sizeof(namebuf) - 1);
 	switch (result) {
 	case 0:
@@ -371,7 +746,8 @@ checkns(dns_zone_t *zone, const dns_name_t *name, const dns_name_t *owner,
 		if (missing_glue)
 			add(namebuf, ERR_MISSING_GLUE);
 	}
-	freeaddrinfo(ai);
+	if (!cached)
+		freeaddrinfo(ai);
 	return (answer);
 #else
 	return (ISC_TRUE);
@@ -387,23 +763,17 @@ checkmx(dns_zone_t *zone, const dns_name_t *name, const dns_name_t *owner) {
 	int result;
 	int level = ISC_LOG_ERROR;
 	isc_boolean_t answer = ISC_TRUE;
+	isc_boolean_t cached;
 
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_flags = AI_CANONNAME;
-	hints.ai_family = PF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
+	sethints(&hints);
 
-	dns_name_format(name, namebuf, sizeof(namebuf) - 1);
 	/*
 	 * Turn off search.
 	 */
-	if (dns_name_countlabels(name) > 1U) {
-		strlcat(namebuf, ".", sizeof(namebuf));
-	}
+	hostname(name, namebuf, sizeof(namebuf));
 	dns_name_format(owner, ownerbuf, sizeof(ownerbuf));
 
-	result = getaddrinfo(namebuf, NULL, &hints, &ai);
+	result = gethost(namebuf, &hints, &ai, &cached);
 	dns_name_format(name, namebuf, sizeof(namebuf) - 1);
 	switch (result) {
 	case 0:
@@ -433,7 +803,8 @@ checkmx(dns_zone_t *zone, const dns_name_t *name, const dns_name_t *owner) {
 					answer = ISC_FALSE;
 			}
 		}
-		freeaddrinfo(ai);
+		if (!cached)
+			freeaddrinfo(ai);
 		return (answer);
 
 	case EAI_NONAME:
@@ -473,23 +844,17 @@ checksrv(dns_zone_t *zone, const dns_name_t *name, const dns_name_t *owner) {
 	int result;
 	int level = ISC_LOG_ERROR;
 	isc_boolean_t answer = ISC_TRUE;
+	isc_boolean_t cached;
 
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_flags = AI_CANONNAME;
-	hints.ai_family = PF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
+	sethints(&hints);
 
-	dns_name_format(name, namebuf, sizeof(namebuf) - 1);
 	/*
 	 * Turn off search.
 	 */
-	if (dns_name_countlabels(name) > 1U) {
-		strlcat(namebuf, ".", sizeof(namebuf));
-	}
+	hostname(name, namebuf, sizeof(namebuf));
 	dns_name_format(owner, ownerbuf, sizeof(ownerbuf));
 
-	result = getaddrinfo(namebuf, NULL, &hints, &ai);
+	result = gethost(namebuf, &hints, &ai, &cached);
 	dns_name_format(name, namebuf, sizeof(namebuf) - 1);
 	switch (result) {
 	case 0:
@@ -518,7 +883,8 @@ checksrv(dns_zone_t *zone, const dns_name_t *name, const dns_name_t *owner) {
 					answer = ISC_FALSE;
 			}
 		}
-		freeaddrinfo(ai);
+		if (!cached)
+			freeaddrinfo(ai);
 		return (answer);
 
 	case EAI_NONAME:
@@ -660,6 +1026,23 @@ check_ttls(dns_zone_t *zone, dns_ttl_t maxttl) {
 	return (result);
 }
 
+/*%
+ * Called with the loaded database just before the integrity checks.
+ */
+static void
+startchecks(dns_zone_t *zone, dns_db_t *db) {
+	isc_time_now(&checkstart);
+	checkstarted = ISC_TRUE;
+#ifdef USE_GETADDRINFO
+	if (docheckmx || docheckns || dochecksrv)
+		prefetch(zone, db);
+#else
+	UNUSED(zone);
+	UNUSED(db);
+#endif
+	isc_time_now(&resolvedone);
+}
+
 /*% load the zone */
 isc_result_t
 load_zone(isc_mem_t *mctx, const char *zonename, const char *filename,
@@ -673,6 +1056,8 @@ load_zone(isc_mem_t *mctx, const char *zonename, const char *filename,
 	dns_fixedname_t fixorigin;
 	dns_name_t *origin;
 	dns_zone_t *zone = NULL;
+	isc_time_t loadend;
+	char detail[64];
 
 	REQUIRE(zonep == NULL || *zonep == NULL);
 
@@ -705,6 +1090,8 @@ load_zone(isc_mem_t *mctx, const char *zonename, const char *filename,
 	dns_zone_setoption(zone, DNS_ZONEOPT_NOMERGE, nomerge);
 
 	dns_zone_setmaxttl(zone, maxttl);
+	dns_zone_setthreads(zone, nthreads);
+	dns_zone_setcheckstart(zone, startchecks);
 
 	if (docheckmx)
 		dns_zone_setcheckmx(zone, checkmx);
@@ -713,7 +1100,24 @@ load_zone(isc_mem_t *mctx, const char *zonename, const char *filename,
 	if (dochecksrv)
 		dns_zone_setchecksrv(zone, checksrv);
 
-	CHECK(dns_zone_load(zone));
+	isc_time_now(&loadstart);
+	checkstarted = ISC_FALSE;
+	result = dns_zone_load(zone);
+	isc_time_now(&loadend);
+#ifdef USE_GETADDRINFO
+	snprintf(detail, sizeof(detail), " (%u names, %u threads)",
+		 nhosts, nthreads);
+	freehosts();
+#else
+	detail[0] = '\0';
+#endif
+	if (checkstarted) {
+		report_time("load", &loadstart, &checkstart, NULL);
+		report_time("resolve", &checkstart, &resolvedone, detail);
+		report_time("check", &resolvedone, &loadend, NULL);
+	} else
+		report_time("load", &loadstart, &loadend, NULL);
+	CHECK(result);
 
 	/*
 	 * When loading map files we can't catch oversize TTLs during
@@ -743,6 +1147,7 @@ dump_zone(const char *zonename, dns_zone_t *zone, const char *filename,
 	isc_result_t result;
 	FILE *output = stdout;
 	const char *flags;
+	isc_time_t start, end;
 
 	flags = (fileformat == dns_masterformat_text) ? "w+" : "wb+";
 
@@ -764,10 +1169,13 @@ dump_zone(const char *zonename, dns_zone_t *zone, const char *filename,
 		}
 	}
 
+	isc_time_now(&start);
 	result = dns_zone_dumptostream3(zone, output, fileformat, style,
 					rawversion);
 	if (output != stdout)
 		(void)isc_stdio_close(output);
+	isc_time_now(&end);
+	report_time("dump", &start, &end, NULL);
 
 	return (result);
 }
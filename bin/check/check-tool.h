@@ -51,6 +51,7 @@ extern isc_boolean_t docheckns;
 extern isc_boolean_t dochecksrv;
 extern unsigned int zone_options;
 extern unsigned int zone_options2;
+extern unsigned int nthreads;
 
 ISC_LANG_ENDDECLS
 
@@ -24,6 +24,7 @@
 #include <isc/hash.h>
 #include <isc/log.h>
 #include <isc/mem.h>
+#include <isc/os.h>
 #include <isc/print.h>
 #include <isc/socket.h>
 #include <isc/string.h>
@@ -79,7 +80,7 @@ usage(void) {
 		"[-r (ignore|warn|fail)] "
 		"[-i (full|full-sibling|local|local-sibling|none)] "
 		"[-M (ignore|warn|fail)] [-S (ignore|warn|fail)] "
-		"[-W (ignore|warn)] "
+		"[-W (ignore|warn)] [-P ncpus] "
 		"%s zonename filename\n",
 		prog_name,
 		progmode == progmode_check ? "[-o filename]" : "-o filename");
@@ -164,8 +165,10 @@ main(int argc, char **argv) {
 
 	isc_commandline_errprint = ISC_FALSE;
 
+	nthreads = isc_os_ncpus();
+
 	while ((c = isc_commandline_parse(argc, argv,
-			       "c:df:hi:jJ:k:L:l:m:n:qr:s:t:o:vw:DF:M:S:T:W:"))
+			       "c:df:hi:jJ:k:L:l:m:n:qr:s:t:o:vw:DF:M:P:S:T:W:"))
 	       != EOF) {
 		switch (c) {
 		case 'c':
@@ -382,6 +385,17 @@ main(int argc, char **argv) {
 			}
 			break;
 
+		case 'P':
+			endp = NULL;
+			nthreads = strtol(isc_commandline_argument, &endp, 0);
+			if (*endp != '\0' || nthreads == 0 ||
+			    nthreads > 1024) {
+				fprintf(stderr, "number of cpus must be "
+						"between 1 and 1024\n");
+				exit(1);
+			}
+			break;
+
 		case 'S':
 			if (ARGCMP("fail")) {
 				zone_options &= ~DNS_ZONEOPT_WARNSRVCNAME;
@@ -201,7 +201,9 @@ help(void) {
 "                 +[no]nssearch       (Search all authoritative nameservers)\n"
 "                 +[no]onesoa         (AXFR prints only one soa record)\n"
 "                 +[no]opcode=###     (Set the opcode of the request)\n"
+"                 +[no]ordered        (With +parallel, print in input order)\n"
 "                 +padding=###        (Set padding block size [0])\n"
+"                 +parallel=###       (Number of lookups to run at once [1])\n"
 "                 +[no]qr             (Print question before sending)\n"
 "                 +[no]question       (Control display of question section)\n"
 "                 +[no]rdflag         (Recursive mode (+[no]recurse))\n"
@@ -224,6 +226,7 @@ help(void) {
 "                 +[no]ttlunits       (Display TTLs in human-readable units)\n"
 "                 +[no]unknownformat  (Print RDATA in RFC 3597 \"unknown\" format)\n"
 "                 +[no]vc             (TCP mode (+[no]tcp))\n"
+"                 +[no]yaml           (Present the results as YAML)\n"
 "                 +[no]zflag          (Set Z flag in query)\n"
 "        global d-opts and servers (before host name) affect all queries.\n"
 "        local d-opts and servers (after host name) affect only that lookup.\n"
@@ -246,16 +249,23 @@ received(unsigned int bytes, isc_sockaddr_t *from, dig_query_t *query) {
 	char time_str[100];
 #endif
 	char fromtext[ISC_SOCKADDR_FORMATSIZE];
+	dig_lookup_t *l = query->lookup;
+
+	if (yaml)
+		return;
 
 	isc_sockaddr_format(from, fromtext, sizeof(fromtext));
 
 	if (query->lookup->stats && !short_form) {
 		diff = isc_time_microdiff(&query->time_recv, &query->time_sent);
 		if (query->lookup->use_usec)
-			printf(";; Query time: %ld usec\n", (long) diff);
+			lookup_printf(l, ";; Query time: %ld usec\n",
+				      (long) diff);
 		else
-			printf(";; Query time: %ld msec\n", (long) diff / 1000);
-		printf(";; SERVER: %s(%s)\n", fromtext, query->servname);
+			lookup_printf(l, ";; Query time: %ld msec\n",
+				      (long) diff / 1000);
+		lookup_printf(l, ";; SERVER: %s(%s)\n",
+			      fromtext, query->servname);
 		time(&tnow);
 #if defined(ISC_PLATFORM_USETHREADS) && !defined(WIN32)
 		(void)localtime_r(&tnow, &tmnow);
@@ -270,45 +280,50 @@ received(unsigned int bytes, isc_sockaddr_t *from, dig_query_t *query) {
 		 */
 		if (wcsftime(time_str, sizeof(time_str)/sizeof(time_str[0]),
 			     L"%a %b %d %H:%M:%S %Z %Y", &tmnow) > 0U)
-			printf(";; WHEN: %ls\n", time_str);
+			lookup_printf(l, ";; WHEN: %ls\n", time_str);
 #else
 		if (strftime(time_str, sizeof(time_str),
 			     "%a %b %d %H:%M:%S %Z %Y", &tmnow) > 0U)
-			printf(";; WHEN: %s\n", time_str);
+			lookup_printf(l, ";; WHEN: %s\n", time_str);
 #endif
 		if (query->lookup->doing_xfr) {
-			printf(";; XFR size: %u records (messages %u, "
-			       "bytes %" ISC_PRINT_QUADFORMAT "u)\n",
-			       query->rr_count, query->msg_count,
-			       query->byte_count);
+			lookup_printf(l, ";; XFR size: %u records "
+				      "(messages %u, "
+				      "bytes %" ISC_PRINT_QUADFORMAT "u)\n",
+				      query->rr_count, query->msg_count,
+				      query->byte_count);
 		} else {
-			printf(";; MSG SIZE  rcvd: %u\n", bytes);
+			lookup_printf(l, ";; MSG SIZE  rcvd: %u\n", bytes);
 		}
 		if (key != NULL) {
 			if (!validated)
-				puts(";; WARNING -- Some TSIG could not "
-				     "be validated");
+				lookup_printf(l, ";; WARNING -- Some TSIG "
+					      "could not be validated\n");
 		}
 		if ((key == NULL) && (keysecret[0] != 0)) {
-			puts(";; WARNING -- TSIG key was not used.");
+			lookup_printf(l, ";; WARNING -- TSIG key was "
+				      "not used.\n");
 		}
-		puts("");
+		lookup_printf(l, "\n");
 	} else if (query->lookup->identify && !short_form) {
 		diff = isc_time_microdiff(&query->time_recv, &query->time_sent);
 		if (query->lookup->use_usec)
-			printf(";; Received %" ISC_PRINT_QUADFORMAT "u bytes "
-			       "from %s(%s) in %ld us\n\n",
-			       query->lookup->doing_xfr
-				 ? query->byte_count
-				 : (isc_uint64_t)bytes,
-			       fromtext, query->userarg, (long) diff);
+			lookup_printf(l, ";; Received %"
+				      ISC_PRINT_QUADFORMAT "u bytes "
+				      "from %s(%s) in %ld us\n\n",
+				      query->lookup->doing_xfr
+					? query->byte_count
+					: (isc_uint64_t)bytes,
+				      fromtext, query->userarg, (long) diff);
 		else
-			printf(";; Received %" ISC_PRINT_QUADFORMAT "u bytes "
-			       "from %s(%s) in %ld ms\n\n",
-			       query->lookup->doing_xfr
-				 ?  query->byte_count
-				 : (isc_uint64_t)bytes,
-			       fromtext, query->userarg, (long) diff / 1000);
+			lookup_printf(l, ";; Received %"
+				      ISC_PRINT_QUADFORMAT "u bytes "
+				      "from %s(%s) in %ld ms\n\n",
+				      query->lookup->doing_xfr
+					?  query->byte_count
+					: (isc_uint64_t)bytes,
+				      fromtext, query->userarg,
+				      (long) diff / 1000);
 	}
 }
 
@@ -438,6 +453,141 @@ isdotlocal(dns_message_t *msg) {
 	return (ISC_FALSE);
 }
 
+/*%
+ * Print the records of 'section' as a YAML list of strings, one per
+ * record in master file format (without the ';' that marks question
+ * entries as comments).
+ */
+static isc_result_t
+yaml_section(dig_lookup_t *l, dns_message_t *msg, dns_section_t section,
+	     const char *title, dns_master_style_t *style)
+{
+	isc_result_t result;
+	isc_buffer_t *buf = NULL;
+	unsigned int len = OUTPUTBUF;
+	char *line, *end, *next, *p;
+	isc_boolean_t first = ISC_TRUE;
+
+	if (msg->counts[section] == 0)
+		return (ISC_R_SUCCESS);
+
+	for (;;) {
+		result = isc_buffer_allocate(mctx, &buf, len);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+		result = dns_message_sectiontotext(msg, section, style,
+						   DNS_MESSAGETEXTFLAG_NOHEADERS |
+						   DNS_MESSAGETEXTFLAG_NOCOMMENTS,
+						   buf);
+		if (result != ISC_R_NOSPACE)
+			break;
+		isc_buffer_free(&buf);
+		len += OUTPUTBUF;
+	}
+	if (result != ISC_R_SUCCESS) {
+		isc_buffer_free(&buf);
+		return (result);
+	}
+
+	line = isc_buffer_base(buf);
+	end = line + isc_buffer_usedlength(buf);
+	for (; line < end; line = next + 1) {
+		next = memchr(line, '\n', end - line);
+		if (next == NULL)
+			next = end;
+		*next = '\0';
+		if (section == DNS_SECTION_QUESTION && *line == ';')
+			line++;
+		if (*line == '\0')
+			continue;
+		for (p = line; p < next; p++)
+			if (*p == '\t')
+				*p = ' ';
+		if (first) {
+			lookup_printf(l, "      %s:\n", title);
+			first = ISC_FALSE;
+		}
+		lookup_printf(l, "        - ");
+		lookup_yamlstr(l, line);
+		lookup_printf(l, "\n");
+	}
+	isc_buffer_free(&buf);
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * +yaml message print handler: each message is an entry in a YAML
+ * list, so that the output of a batch can be read back as one
+ * document.
+ */
+static isc_result_t
+yaml_message(dig_query_t *query, dns_message_t *msg) {
+	isc_result_t result;
+	dig_lookup_t *l = query->lookup;
+	dns_master_style_t *style = NULL;
+	unsigned int styleflags = 0;
+	isc_boolean_t sent = ISC_TF(msg == l->sendmsg);
+	char addrstr[ISC_NETADDR_FORMATSIZE];
+	isc_netaddr_t netaddr;
+
+	if (l->print_unknown_format)
+		styleflags |= DNS_STYLEFLAG_UNKNOWNFORMAT;
+	if (l->nocrypto)
+		styleflags |= DNS_STYLEFLAG_NOCRYPTO;
+	result = dns_master_stylecreate2(&style, styleflags,
+					 0, 0, 0, 0, 0, 8, 0xffffffff, mctx);
+	check_result(result, "dns_master_stylecreate");
+
+	lookup_printf(l, "-\n  type: MESSAGE\n  message:\n");
+	if (!sent) {
+		isc_netaddr_fromsockaddr(&netaddr, &query->sockaddr);
+		isc_netaddr_format(&netaddr, addrstr, sizeof(addrstr));
+		lookup_printf(l, "    response_address: ");
+		lookup_yamlstr(l, addrstr);
+		lookup_printf(l, "\n    response_port: %u\n",
+			      isc_sockaddr_getport(&query->sockaddr));
+		lookup_printf(l, "    query_time_usec: %" ISC_PRINT_QUADFORMAT
+			      "u\n", isc_time_microdiff(&query->time_recv,
+							&query->time_sent));
+	}
+	lookup_printf(l, "    %s_message_data:\n",
+		      sent ? "query" : "response");
+	lookup_printf(l, "      opcode: %s\n", opcodetext[msg->opcode]);
+	lookup_printf(l, "      status: %s\n", rcode_totext(msg->rcode));
+	lookup_printf(l, "      id: %u\n", msg->id);
+	lookup_printf(l, "      flags:%s%s%s%s%s%s%s\n",
+		      (msg->flags & DNS_MESSAGEFLAG_QR) != 0 ? " qr" : "",
+		      (msg->flags & DNS_MESSAGEFLAG_AA) != 0 ? " aa" : "",
+		      (msg->flags & DNS_MESSAGEFLAG_TC) != 0 ? " tc" : "",
+		      (msg->flags & DNS_MESSAGEFLAG_RD) != 0 ? " rd" : "",
+		      (msg->flags & DNS_MESSAGEFLAG_RA) != 0 ? " ra" : "",
+		      (msg->flags & DNS_MESSAGEFLAG_AD) != 0 ? " ad" : "",
+		      (msg->flags & DNS_MESSAGEFLAG_CD) != 0 ? " cd" : "");
+	lookup_printf(l, "      QUERY: %u\n      ANSWER: %u\n"
+		      "      AUTHORITY: %u\n      ADDITIONAL: %u\n",
+		      msg->counts[DNS_SECTION_QUESTION],
+		      msg->counts[DNS_SECTION_ANSWER],
+		      msg->counts[DNS_SECTION_AUTHORITY],
+		      msg->counts[DNS_SECTION_ADDITIONAL]);
+
+	result = ISC_R_SUCCESS;
+	if (l->section_question)
+		result = yaml_section(l, msg, DNS_SECTION_QUESTION,
+				      "QUESTION_SECTION", style);
+	if (result == ISC_R_SUCCESS && l->section_answer)
+		result = yaml_section(l, msg, DNS_SECTION_ANSWER,
+				      "ANSWER_SECTION", style);
+	if (result == ISC_R_SUCCESS && l->section_authority)
+		result = yaml_section(l, msg, DNS_SECTION_AUTHORITY,
+				      "AUTHORITY_SECTION", style);
+	if (result == ISC_R_SUCCESS && l->section_additional)
+		result = yaml_section(l, msg, DNS_SECTION_ADDITIONAL,
+				      "ADDITIONAL_SECTION", style);
+
+	dns_master_styledestroy(&style, mctx);
+	return (result);
+}
+
 /*
  * Callback from dighost.c to print the reply from a server
  */
@@ -449,6 +599,10 @@ printmessage(dig_query_t *query, dns_message_t *msg, isc_boolean_t headers) {
 	unsigned int len = OUTPUTBUF;
 	dns_master_style_t *style = NULL;
 	unsigned int styleflags = 0;
+	dig_lookup_t *l = query->lookup;
+
+	if (yaml)
+		return (yaml_message(query, msg));
 
 	styleflags |= DNS_STYLEFLAG_REL_OWNER;
 	if (query->lookup->comments)
@@ -494,7 +648,7 @@ printmessage(dig_query_t *query, dns_message_t *msg, isc_boolean_t headers) {
 
 	if (query->lookup->cmdline[0] != 0) {
 		if (!short_form)
-			fputs(query->lookup->cmdline, stdout);
+			lookup_printf(l, "%s", query->lookup->cmdline);
 		query->lookup->cmdline[0]=0;
 	}
 	debug("printmessage(%s %s %s)", headers ? "headers" : "noheaders",
@@ -518,66 +672,69 @@ printmessage(dig_query_t *query, dns_message_t *msg, isc_boolean_t headers) {
 
 	if (query->lookup->comments && !short_form) {
 		if (query->lookup->cmdline[0] != 0)
-			printf("; %s\n", query->lookup->cmdline);
+			lookup_printf(l, "; %s\n", query->lookup->cmdline);
 		if (msg == query->lookup->sendmsg)
-			printf(";; Sending:\n");
+			lookup_printf(l, ";; Sending:\n");
 		else
-			printf(";; Got answer:\n");
+			lookup_printf(l, ";; Got answer:\n");
 
 		if (headers) {
 			if (isdotlocal(msg)) {
-				printf(";; WARNING: .local is reserved for "
-				       "Multicast DNS\n;; You are currently "
-				       "testing what happens when an mDNS "
-				       "query is leaked to DNS\n");
+				lookup_printf(l, ";; WARNING: .local is "
+					      "reserved for Multicast DNS\n"
+					      ";; You are currently "
+					      "testing what happens when an "
+					      "mDNS query is leaked to DNS\n");
 			}
-			printf(";; ->>HEADER<<- opcode: %s, status: %s, "
-			       "id: %u\n",
-			       opcodetext[msg->opcode],
-			       rcode_totext(msg->rcode),
-			       msg->id);
-			printf(";; flags:");
+			lookup_printf(l, ";; ->>HEADER<<- opcode: %s, "
+				      "status: %s, id: %u\n",
+				      opcodetext[msg->opcode],
+				      rcode_totext(msg->rcode),
+				      msg->id);
+			lookup_printf(l, ";; flags:");
 			if ((msg->flags & DNS_MESSAGEFLAG_QR) != 0)
-				printf(" qr");
+				lookup_printf(l, " qr");
 			if ((msg->flags & DNS_MESSAGEFLAG_AA) != 0)
-				printf(" aa");
+				lookup_printf(l, " aa");
 			if ((msg->flags & DNS_MESSAGEFLAG_TC) != 0)
-				printf(" tc");
+				lookup_printf(l, " tc");
 			if ((msg->flags & DNS_MESSAGEFLAG_RD) != 0)
-				printf(" rd");
+				lookup_printf(l, " rd");
 			if ((msg->flags & DNS_MESSAGEFLAG_RA) != 0)
-				printf(" ra");
+				lookup_printf(l, " ra");
 			if ((msg->flags & DNS_MESSAGEFLAG_AD) != 0)
-				printf(" ad");
+				lookup_printf(l, " ad");
 			if ((msg->flags & DNS_MESSAGEFLAG_CD) != 0)
-				printf(" cd");
+				lookup_printf(l, " cd");
 			if ((msg->flags & 0x0040U) != 0)
-				printf("; MBZ: 0x4");
+				lookup_printf(l, "; MBZ: 0x4");
 
-			printf("; QUERY: %u, ANSWER: %u, "
-			       "AUTHORITY: %u, ADDITIONAL: %u\n",
-			       msg->counts[DNS_SECTION_QUESTION],
-			       msg->counts[DNS_SECTION_ANSWER],
-			       msg->counts[DNS_SECTION_AUTHORITY],
-			       msg->counts[DNS_SECTION_ADDITIONAL]);
+			lookup_printf(l, "; QUERY: %u, ANSWER: %u, "
+				      "AUTHORITY: %u, ADDITIONAL: %u\n",
+				      msg->counts[DNS_SECTION_QUESTION],
+				      msg->counts[DNS_SECTION_ANSWER],
+				      msg->counts[DNS_SECTION_AUTHORITY],
+				      msg->counts[DNS_SECTION_ADDITIONAL]);
 
 			if (msg != query->lookup->sendmsg &&
 			    (msg->flags & DNS_MESSAGEFLAG_RD) != 0 &&
 			    (msg->flags & DNS_MESSAGEFLAG_RA) == 0)
-				printf(";; WARNING: recursion requested "
-				       "but not available\n");
+				lookup_printf(l, ";; WARNING: recursion "
+					      "requested but not available\n");
 		}
 		if (msg != query->lookup->sendmsg &&
 		    query->lookup->edns != -1 && msg->opt == NULL &&
 		    (msg->rcode == dns_rcode_formerr ||
 		     msg->rcode == dns_rcode_notimp))
-			printf("\n;; WARNING: EDNS query returned status "
-			       "%s - retry with '%s+noedns'\n",
-			       rcode_totext(msg->rcode),
-			       query->lookup->dnssec ? "+nodnssec ": "");
+			lookup_printf(l, "\n;; WARNING: EDNS query returned "
+				      "status %s - retry with '%s+noedns'\n",
+				      rcode_totext(msg->rcode),
+				      query->lookup->dnssec ?
+					"+nodnssec ": "");
 		if (msg != query->lookup->sendmsg && extrabytes != 0U)
-			printf(";; WARNING: Message has %u extra byte%s at "
-			       "end\n", extrabytes, extrabytes != 0 ? "s" : "");
+			lookup_printf(l, ";; WARNING: Message has %u extra "
+				      "byte%s at end\n", extrabytes,
+				      extrabytes != 0 ? "s" : "");
 	}
 
 repopulate_buffer:
@@ -668,10 +825,10 @@ buftoosmall:
 	}
 
 	if (headers && query->lookup->comments && !short_form)
-		printf("\n");
+		lookup_printf(l, "\n");
 
-	printf("%.*s", (int)isc_buffer_usedlength(buf),
-	       (char *)isc_buffer_base(buf));
+	lookup_printf(l, "%.*s", (int)isc_buffer_usedlength(buf),
+		      (char *)isc_buffer_base(buf));
 	isc_buffer_free(&buf);
 
 cleanup:
@@ -1190,22 +1347,46 @@ plus_option(const char *option, isc_boolean_t is_batchfile,
 			}
 			lookup->opcode = (dns_opcode_t)num;
 			break;
+		case 'r':
+			FULLCHECK("ordered");
+			ordered_output = state;
+			break;
 		default:
 			goto invalid_option;
 		}
 		break;
 	case 'p':
-		FULLCHECK("padding");
-		if (state && lookup->edns == -1)
-			lookup->edns = 0;
-		if (value == NULL)
-			goto need_value;
-		result = parse_uint(&num, value, 512, "padding");
-		if (result != ISC_R_SUCCESS) {
-			warn("Couldn't parse padding");
-			goto exit_or_usage;
+		switch (cmd[1] != '\0' ? cmd[2] : '\0') {
+		case 'r': /* parallel */
+			FULLCHECK("parallel");
+			if (!state) {
+				maxlookups = 1;
+				break;
+			}
+			if (value == NULL)
+				goto need_value;
+			result = parse_uint(&num, value, MAXPARALLEL,
+					    "parallel");
+			if (result != ISC_R_SUCCESS) {
+				warn("Couldn't parse parallel");
+				goto exit_or_usage;
+			}
+			maxlookups = (num == 0) ? 1 : num;
+			break;
+		default:
+			FULLCHECK("padding");
+			if (state && lookup->edns == -1)
+				lookup->edns = 0;
+			if (value == NULL)
+				goto need_value;
+			result = parse_uint(&num, value, 512, "padding");
+			if (result != ISC_R_SUCCESS) {
+				warn("Couldn't parse padding");
+				goto exit_or_usage;
+			}
+			lookup->padding = (isc_uint16_t)num;
+			break;
 		}
-		lookup->padding = (isc_uint16_t)num;
 		break;
 	case 'q':
 		switch (cmd[1]) {
@@ -1474,6 +1655,10 @@ plus_option(const char *option, isc_boolean_t is_batchfile,
 			lookup->tcp_mode_set = ISC_TRUE;
 		}
 		break;
+	case 'y': /* yaml */
+		FULLCHECK("yaml");
+		yaml = state;
+		break;
 	case 'z': /* zflag */
 		FULLCHECK("zflag");
 		lookup->zflag = state;
@@ -2124,19 +2309,58 @@ parse_args(isc_boolean_t is_batchfile, isc_boolean_t config_only,
 		destroy_lookup(lookup);
 }
 
-/*
- * Callback from dighost.c to allow program-specific shutdown code.
- * Here, we're possibly reading from a batch file, then shutting down
- * for real if there's nothing in the batch file to read.
+/*%
+ * Read the next line of the batch file and queue its lookups.  Returns
+ * ISC_FALSE when there is nothing left to read.
  */
-static void
-query_finished(void) {
+static isc_boolean_t
+batch_line(void) {
 	char batchline[MXNAME];
 	int bargc;
 	char *bargv[16];
 	char *input;
 	int i;
 
+	if (fgets(batchline, sizeof(batchline), batchfp) == 0)
+		return (ISC_FALSE);
+
+	debug("batch line %s", batchline);
+	bargc = 1;
+	input = batchline;
+	bargv[bargc] = next_token(&input, " \t\r\n");
+	while ((bargc < 14) && (bargv[bargc] != NULL)) {
+		bargc++;
+		bargv[bargc] = next_token(&input, " \t\r\n");
+	}
+
+	bargv[0] = argv0;
+
+	for(i = 0; i < bargc; i++)
+		debug("batch argv %d: %s", i, bargv[i]);
+	parse_args(ISC_TRUE, ISC_FALSE, bargc, (char **)bargv);
+	return (ISC_TRUE);
+}
+
+/*
+ * Callback from dighost.c when it could run more lookups (+parallel):
+ * queue the next line of the batch file, if any.
+ */
+static void
+batch_refill(void) {
+	if (batchname == NULL)
+		return;
+
+	while (ISC_LIST_EMPTY(lookup_list) && batch_line())
+		;
+}
+
+/*
+ * Callback from dighost.c to allow program-specific shutdown code.
+ * Here, we're possibly reading from a batch file, then shutting down
+ * for real if there's nothing in the batch file to read.
+ */
+static void
+query_finished(void) {
 	if (batchname == NULL) {
 		isc_app_shutdown();
 		return;
@@ -2151,21 +2375,7 @@ query_finished(void) {
 		return;
 	}
 
-	if (fgets(batchline, sizeof(batchline), batchfp) != 0) {
-		debug("batch line %s", batchline);
-		bargc = 1;
-		input = batchline;
-		bargv[bargc] = next_token(&input, " \t\r\n");
-		while ((bargc < 14) && (bargv[bargc] != NULL)) {
-			bargc++;
-			bargv[bargc] = next_token(&input, " \t\r\n");
-		}
-
-		bargv[0] = argv0;
-
-		for(i = 0; i < bargc; i++)
-			debug("batch argv %d: %s", i, bargv[i]);
-		parse_args(ISC_TRUE, ISC_FALSE, bargc, (char **)bargv);
+	if (batch_line()) {
 		start_lookup();
 	} else {
 		batchname = NULL;
@@ -2191,6 +2401,7 @@ void dig_setup(int argc, char **argv)
 	dighost_received = received;
 	dighost_trying = trying;
 	dighost_shutdown = query_finished;
+	dighost_refill = batch_refill;
 
 	progname = argv[0];
 	preparse_args(argc, argv);
@@ -2208,6 +2419,8 @@ void dig_query_setup(isc_boolean_t is_batchfile, isc_boolean_t config_only,
 	debug("dig_query_setup");
 
 	parse_args(is_batchfile, config_only, argc, argv);
+	if (maxlookups > 1)
+		setup_quietlog();
 	if (keyfile[0] != 0)
 		setup_file_key();
 	else if (keysecret[0] != 0)
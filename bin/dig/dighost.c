@@ -113,9 +113,12 @@ isc_boolean_t
 	showsearch = ISC_FALSE,
 	is_dst_up = ISC_FALSE,
 	keep_open = ISC_FALSE,
-	verbose = ISC_FALSE;
+	verbose = ISC_FALSE,
+	ordered_output = ISC_TRUE,
+	yaml = ISC_FALSE;
 in_port_t port = 53;
 unsigned int timeout = 0;
+unsigned int maxlookups = 1;
 unsigned int extrabytes;
 isc_mem_t *mctx = NULL;
 isc_log_t *lctx = NULL;
@@ -179,7 +182,16 @@ isc_boolean_t debugtiming = ISC_FALSE;
 isc_boolean_t memdebugging = ISC_FALSE;
 char *progname = NULL;
 isc_mutex_t lookup_lock;
-dig_lookup_t *current_lookup = NULL;
+
+/*%
+ * Lookups that have been taken off the lookup list and are in progress;
+ * there are at most 'maxlookups' of them.  'output_list' holds the
+ * ordered output of those lookups and of the ones that have finished
+ * but are waiting to print.
+ */
+static dig_lookuplist_t running_list;
+static unsigned int running_count = 0;
+static ISC_LIST(dig_output_t) output_list;
 
 #define DIG_MAX_ADDRESSES 20
 
@@ -380,6 +392,8 @@ get_reverse(char *reverse, size_t len, char *value, isc_boolean_t ip6_int,
 
 void (*dighost_pre_exit_hook)(void) = NULL;
 
+void (*dighost_refill)(void) = NULL;
+
 #if TARGET_OS_IPHONE
 void
 warn(const char *format, ...) {
@@ -457,6 +471,145 @@ check_result(isc_result_t result, const char *msg) {
 	}
 }
 
+void
+lookup_printf(dig_lookup_t *lookup, const char *format, ...) {
+	isc_buffer_t *b;
+	isc_region_t r;
+	va_list args;
+	int n;
+
+	if (lookup == NULL || lookup->output == NULL) {
+		va_start(args, format);
+		vprintf(format, args);
+		va_end(args);
+		return;
+	}
+
+	b = lookup->output->buffer;
+	va_start(args, format);
+	n = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (n <= 0)
+		return;
+	check_result(isc_buffer_reserve(&b, n + 1), "isc_buffer_reserve");
+	lookup->output->buffer = b;
+	isc_buffer_availableregion(b, &r);
+	va_start(args, format);
+	vsnprintf((char *)r.base, r.length, format, args);
+	va_end(args);
+	isc_buffer_add(b, n);
+}
+
+/*%
+ * Print 'str' as a single-quoted YAML scalar.
+ */
+void
+lookup_yamlstr(dig_lookup_t *lookup, const char *str) {
+	const char *quote;
+
+	lookup_printf(lookup, "'");
+	while ((quote = strchr(str, '\'')) != NULL) {
+		lookup_printf(lookup, "%.*s''", (int)(quote - str), str);
+		str = quote + 1;
+	}
+	lookup_printf(lookup, "%s'", str);
+}
+
+/*%
+ * Print a diagnostic about 'lookup'.  With +yaml it is turned into
+ * YAML comments so that the output stays parseable.
+ */
+static void
+diag(dig_lookup_t *lookup, const char *format, ...)
+	ISC_FORMAT_PRINTF(2, 3);
+
+static void
+diag(dig_lookup_t *lookup, const char *format, ...) {
+	char *text, *line, *next;
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	n = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (n <= 0)
+		return;
+	text = isc_mem_allocate(mctx, n + 1);
+	if (text == NULL)
+		fatal("memory allocation failure");
+	va_start(args, format);
+	vsnprintf(text, n + 1, format, args);
+	va_end(args);
+
+	if (!yaml) {
+		lookup_printf(lookup, "%s", text);
+		isc_mem_free(mctx, text);
+		return;
+	}
+
+	for (line = text; *line != '\0'; line = next) {
+		next = strchr(line, '\n');
+		next = (next != NULL) ? next + 1 : line + strlen(line);
+		lookup_printf(lookup, "#%s%.*s", (*line == '\n') ? "" : " ",
+			      (int)(next - line), line);
+	}
+	isc_mem_free(mctx, text);
+}
+
+/*%
+ * Give 'lookup' a slot in the ordered output, unless it shares one
+ * with the lookup it was cloned from.
+ */
+static void
+output_attach(dig_lookup_t *lookup) {
+	dig_output_t *output;
+	isc_result_t result;
+
+	if (lookup->output != NULL)
+		return;
+
+	output = isc_mem_allocate(mctx, sizeof(*output));
+	if (output == NULL)
+		fatal("memory allocation failure in %s:%d",
+		      __FILE__, __LINE__);
+	output->references = 1;
+	output->done = ISC_FALSE;
+	output->buffer = NULL;
+	result = isc_buffer_allocate(mctx, &output->buffer, BUFSIZE);
+	check_result(result, "isc_buffer_allocate");
+	ISC_LINK_INIT(output, link);
+	ISC_LIST_APPEND(output_list, output, link);
+	lookup->output = output;
+}
+
+/*%
+ * Drop 'lookup's reference to its output.  Once no lookup refers to it
+ * any longer, print it and any finished output queued behind it.
+ */
+static void
+output_detach(dig_lookup_t *lookup) {
+	dig_output_t *output = lookup->output;
+
+	if (output == NULL)
+		return;
+	lookup->output = NULL;
+
+	INSIST(output->references > 0);
+	if (--output->references > 0)
+		return;
+	output->done = ISC_TRUE;
+
+	while ((output = ISC_LIST_HEAD(output_list)) != NULL &&
+	       output->done)
+	{
+		ISC_LIST_UNLINK(output_list, output, link);
+		fwrite(isc_buffer_base(output->buffer), 1,
+		       isc_buffer_usedlength(output->buffer), stdout);
+		isc_buffer_free(&output->buffer);
+		isc_mem_free(mctx, output);
+	}
+}
+
 /*%
  * Create a server structure, which is part of the lookup structure.
  * This is little more than a linked list of servers to query in hopes
@@ -686,6 +839,7 @@ make_empty_lookup(void) {
 	looknew->dscp = -1;
 	looknew->rrcomments = 0;
 	looknew->eoferr = 0;
+	looknew->output = NULL;
 	dns_fixedname_init(&looknew->fdomain);
 	ISC_LINK_INIT(looknew, link);
 	ISC_LIST_INIT(looknew->q);
@@ -817,6 +971,9 @@ clone_lookup(dig_lookup_t *lookold, isc_boolean_t servers) {
 	looknew->dscp = lookold->dscp;
 	looknew->rrcomments = lookold->rrcomments;
 	looknew->eoferr = lookold->eoferr;
+	looknew->output = lookold->output;
+	if (looknew->output != NULL)
+		looknew->output->references++;
 
 	if (lookold->ecs_addr != NULL) {
 		size_t len = sizeof(isc_sockaddr_t);
@@ -1349,6 +1506,9 @@ setup_libs(void) {
 	check_result(result, "isc_mem_create");
 	isc_mem_setname(mctx, "dig", NULL);
 
+	ISC_LIST_INIT(running_list);
+	ISC_LIST_INIT(output_list);
+
 	result = isc_log_create(mctx, &lctx, &logconfig);
 	check_result(result, "isc_log_create");
 
@@ -1395,6 +1555,39 @@ setup_libs(void) {
 	check_result(result, "isc_mutex_init");
 }
 
+void
+setup_quietlog(void) {
+	static isc_boolean_t done = ISC_FALSE;
+	isc_logconfig_t *logconfig = NULL;
+	isc_logdestination_t destination;
+	isc_result_t result;
+
+	debug("setup_quietlog()");
+
+	if (done)
+		return;
+	done = ISC_TRUE;
+
+	/*
+	 * With many lookups in flight the socket manager's
+	 * informational messages would be noise.
+	 */
+	result = isc_logconfig_create(lctx, &logconfig);
+	check_result(result, "isc_logconfig_create");
+	destination.file.stream = stderr;
+	destination.file.name = NULL;
+	destination.file.versions = ISC_LOG_ROLLNEVER;
+	destination.file.maximum_size = 0;
+	result = isc_log_createchannel(logconfig, "dig_stderr",
+				       ISC_LOG_TOFILEDESC, ISC_LOG_WARNING,
+				       &destination, ISC_LOG_PRINTTIME);
+	check_result(result, "isc_log_createchannel");
+	result = isc_log_usechannel(logconfig, "dig_stderr", NULL, NULL);
+	check_result(result, "isc_log_usechannel");
+	result = isc_logconfig_use(lctx, logconfig);
+	check_result(result, "isc_logconfig_use");
+}
+
 typedef struct dig_ednsoptname {
 	isc_uint32_t code;
 	const char  *name;
@@ -1522,7 +1715,7 @@ static void
 check_if_done(void) {
 	debug("check_if_done()");
 	debug("list %s", ISC_LIST_EMPTY(lookup_list) ? "empty" : "full");
-	if (ISC_LIST_EMPTY(lookup_list) && current_lookup == NULL &&
+	if (ISC_LIST_EMPTY(lookup_list) && ISC_LIST_EMPTY(running_list) &&
 	    sendcount == 0) {
 		INSIST(sockcount == 0);
 		INSIST(recvcount == 0);
@@ -1611,8 +1804,15 @@ try_clear_lookup(dig_lookup_t *lookup) {
 
 	/*
 	 * At this point, we know there are no queries on the lookup,
-	 * so can make it go away also.
+	 * so can make it go away also.  Callers take lookups that have
+	 * not started off the lookup list themselves, so if it is still
+	 * linked it is running.
 	 */
+	if (ISC_LINK_LINKED(lookup, link)) {
+		ISC_LIST_UNLINK(running_list, lookup, link);
+		INSIST(running_count > 0);
+		running_count--;
+	}
 	destroy_lookup(lookup);
 	return (ISC_TRUE);
 }
@@ -1656,40 +1856,63 @@ destroy_lookup(dig_lookup_t *lookup) {
 		isc_mem_free(mctx, lookup->ednsopts);
 	}
 
+	output_detach(lookup);
 	isc_mem_free(mctx, lookup);
 }
 
 /*%
- * If we can, start the next lookup in the queue running.
- * This assumes that the lookup on the head of the queue hasn't been
- * started yet.  It also removes the lookup from the head of the queue,
- * setting the current_lookup pointer pointing to it.
+ * Lookups that queue followups of their own (+trace, +nssearch) or
+ * share the +keepopen socket have to run on their own.
+ */
+static isc_boolean_t
+exclusive_lookup(dig_lookup_t *lookup) {
+	return (ISC_TF(lookup->trace || lookup->ns_search_only ||
+		       keep_open));
+}
+
+/*%
+ * If we can, start the next lookups in the queue running, until
+ * 'maxlookups' are running.  This assumes that the lookups on the head
+ * of the queue haven't been started yet.  It removes them from the
+ * queue and puts them on the running list, where cancel_all can find
+ * them.
  */
 void
 start_lookup(void) {
+	dig_lookup_t *lookup, *running;
+	isc_boolean_t started = ISC_FALSE;
+
 	debug("start_lookup()");
 	if (cancel_now)
 		return;
 
-	/*
-	 * If there's a current lookup running, we really shouldn't get
-	 * here.
-	 */
-	INSIST(current_lookup == NULL);
+	while (running_count < maxlookups) {
+		running = ISC_LIST_HEAD(running_list);
+		if (running != NULL && exclusive_lookup(running))
+			break;
+		if (ISC_LIST_EMPTY(lookup_list) && maxlookups > 1 &&
+		    dighost_refill != NULL)
+			dighost_refill();
+		lookup = ISC_LIST_HEAD(lookup_list);
+		if (lookup == NULL)
+			break;
+		if (running != NULL && exclusive_lookup(lookup))
+			break;
 
-	current_lookup = ISC_LIST_HEAD(lookup_list);
-	/*
-	 * Put the current lookup somewhere so cancel_all can find it
-	 */
-	if (current_lookup != NULL) {
-		ISC_LIST_DEQUEUE(lookup_list, current_lookup, link);
-		if (setup_lookup(current_lookup))
-			do_lookup(current_lookup);
-		else if (next_origin(current_lookup))
-			check_next_lookup(current_lookup);
-	} else {
-		check_if_done();
+		ISC_LIST_DEQUEUE(lookup_list, lookup, link);
+		ISC_LIST_APPEND(running_list, lookup, link);
+		running_count++;
+		started = ISC_TRUE;
+		if (maxlookups > 1 && ordered_output)
+			output_attach(lookup);
+		if (setup_lookup(lookup))
+			do_lookup(lookup);
+		else if (next_origin(lookup))
+			check_next_lookup(lookup);
 	}
+
+	if (!started && ISC_LIST_EMPTY(running_list))
+		check_if_done();
 }
 
 /*%
@@ -1707,10 +1930,8 @@ check_next_lookup(dig_lookup_t *lookup) {
 		debug("still have a worker");
 		return;
 	}
-	if (try_clear_lookup(lookup)) {
-		current_lookup = NULL;
+	if (try_clear_lookup(lookup))
 		start_lookup();
-	}
 }
 
 /*%
@@ -1773,11 +1994,13 @@ followup_lookup(dns_message_t *msg, dig_query_t *query, dns_section_t section)
 							&order, &nlabels);
 			if (namereln == dns_namereln_equal) {
 				if (!horizontal)
-					printf(";; BAD (HORIZONTAL) REFERRAL\n");
+					diag(query->lookup,
+					     ";; BAD (HORIZONTAL) REFERRAL\n");
 				horizontal = ISC_TRUE;
 			} else if (namereln != dns_namereln_subdomain) {
 				if (!bad)
-					printf(";; BAD REFERRAL\n");
+					diag(query->lookup,
+					     ";; BAD REFERRAL\n");
 				bad = ISC_TRUE;
 				continue;
 			}
@@ -1826,8 +2049,9 @@ followup_lookup(dns_message_t *msg, dig_query_t *query, dns_section_t section)
 			debug("adding server %s", namestr);
 			num = getaddresses(lookup, namestr, &lresult);
 			if (lresult != ISC_R_SUCCESS) {
-				printf("couldn't get address for '%s': %s\n",
-				       namestr, isc_result_totext(lresult));
+				diag(query->lookup,
+				     "couldn't get address for '%s': %s\n",
+				     namestr, isc_result_totext(lresult));
 				if (addresses_result == ISC_R_SUCCESS) {
 					addresses_result = lresult;
 					strlcpy(bad_namestr, namestr,
@@ -2204,7 +2428,7 @@ setup_lookup(dig_lookup_t *lookup) {
 			      "(%s)", lookup->textname,
 			      isc_result_totext(result));
 #if TARGET_OS_IPHONE
-			check_next_lookup(current_lookup);
+			check_next_lookup(lookup);
 			return (ISC_FALSE);
 #else
 			digexit();
@@ -2551,7 +2775,7 @@ setup_lookup(dig_lookup_t *lookup) {
 		dighost_printmessage(ISC_LIST_HEAD(lookup->q),
 				     lookup->sendmsg, ISC_TRUE);
 		if (lookup->stats)
-			printf(";; QUERY SIZE: %u\n\n",
+			diag(lookup, ";; QUERY SIZE: %u\n\n",
 			       isc_buffer_usedlength(&lookup->renderbuf));
 	}
 	return (ISC_TRUE);
@@ -2725,7 +2949,7 @@ send_tcp_connect(dig_query_t *query) {
 
 		isc_netaddr_fromsockaddr(&netaddr, &query->sockaddr);
 		isc_netaddr_format(&netaddr, buf, sizeof(buf));
-		printf(";; Skipping mapped address '%s'\n", buf);
+		diag(l, ";; Skipping mapped address '%s'\n", buf);
 
 		query->waiting_connect = ISC_FALSE;
 		if (ISC_LINK_LINKED(query, link))
@@ -2735,7 +2959,7 @@ send_tcp_connect(dig_query_t *query) {
 		l = query->lookup;
 		clear_query(query);
 		if (next == NULL) {
-			printf(";; No acceptable nameservers\n");
+			diag(l, ";; No acceptable nameservers\n");
 			check_next_lookup(l);
 			return;
 		}
@@ -2746,7 +2970,7 @@ send_tcp_connect(dig_query_t *query) {
 	if (specified_source &&
 	    (isc_sockaddr_pf(&query->sockaddr) !=
 	     isc_sockaddr_pf(&bind_address))) {
-		printf(";; Skipping server %s, incompatible "
+		diag(l, ";; Skipping server %s, incompatible "
 		       "address family\n", query->servname);
 		query->waiting_connect = ISC_FALSE;
 		if (ISC_LINK_LINKED(query, link))
@@ -2756,7 +2980,7 @@ send_tcp_connect(dig_query_t *query) {
 		l = query->lookup;
 		clear_query(query);
 		if (next == NULL) {
-			printf(";; No acceptable nameservers\n");
+			diag(l, ";; No acceptable nameservers\n");
 			check_next_lookup(l);
 			return;
 		}
@@ -2864,13 +3088,13 @@ send_udp(dig_query_t *query) {
 
 			isc_netaddr_fromsockaddr(&netaddr, &query->sockaddr);
 			isc_netaddr_format(&netaddr, buf, sizeof(buf));
-			printf(";; Skipping mapped address '%s'\n", buf);
+			diag(l, ";; Skipping mapped address '%s'\n", buf);
 
 			next = ISC_LIST_NEXT(query, link);
 			l = query->lookup;
 			clear_query(query);
 			if (next == NULL) {
-				printf(";; No acceptable nameservers\n");
+				diag(l, ";; No acceptable nameservers\n");
 				check_next_lookup(l);
 			} else {
 				send_udp(next);
@@ -2990,10 +3214,16 @@ connect_timeout(isc_task_t *task, isc_event_t *event) {
 			isc_netaddr_fromsockaddr(&netaddr, &query->sockaddr);
 			isc_netaddr_format(&netaddr, buf, sizeof(buf));
 
-			printf(";; no response from %s\n", buf);
+			diag(l, ";; no response from %s\n", buf);
+		} else if (yaml) {
+			lookup_printf(l, "-\n  type: DIG_ERROR\n"
+				      "  query_name: ");
+			lookup_yamlstr(l, l->textname);
+			lookup_printf(l, "\n  message: 'connection timed out; "
+				      "no servers could be reached'\n");
 		} else {
-			fputs(l->cmdline, stdout);
-			printf(";; connection timed out; no servers could be "
+			diag(l, "%s", l->cmdline);
+			diag(l, ";; connection timed out; no servers could be "
 			       "reached\n");
 		}
 		cancel_lookup(l);
@@ -3047,7 +3277,7 @@ tcp_length_done(isc_task_t *task, isc_event_t *event) {
 		char sockstr[ISC_SOCKADDR_FORMATSIZE];
 		isc_sockaddr_format(&query->sockaddr, sockstr,
 				    sizeof(sockstr));
-		printf(";; communications error to %s: %s\n",
+		diag(query->lookup, ";; communications error to %s: %s\n",
 		       sockstr, isc_result_totext(sevent->result));
 		if (keep != NULL)
 			isc_socket_detach(&keep);
@@ -3192,7 +3422,8 @@ connect_done(isc_task_t *task, isc_event_t *event) {
 		debug("in cancel handler");
 		isc_sockaddr_format(&query->sockaddr, sockstr, sizeof(sockstr));
 		if (query->timedout)
-			printf(";; Connection to %s(%s) for %s failed: %s.\n",
+			diag(query->lookup,
+			     ";; Connection to %s(%s) for %s failed: %s.\n",
 			       sockstr, query->servname,
 			       query->lookup->textname,
 			       isc_result_totext(ISC_R_TIMEDOUT));
@@ -3214,7 +3445,8 @@ connect_done(isc_task_t *task, isc_event_t *event) {
 		      isc_result_totext(sevent->result));
 		isc_sockaddr_format(&query->sockaddr, sockstr, sizeof(sockstr));
 		if (sevent->result != ISC_R_CANCELED)
-			printf(";; Connection to %s(%s) for %s failed: "
+			diag(query->lookup,
+			     ";; Connection to %s(%s) for %s failed: "
 			       "%s.\n", sockstr,
 			       query->servname, query->lookup->textname,
 			       isc_result_totext(sevent->result));
@@ -3289,7 +3521,7 @@ check_for_more_data(dig_query_t *query, dns_message_t *msg,
 	query->byte_count += sevent->n;
 	result = dns_message_firstname(msg, DNS_SECTION_ANSWER);
 	if (result != ISC_R_SUCCESS) {
-		puts("; Transfer failed.");
+		diag(query->lookup, "; Transfer failed.\n");
 		return (ISC_TRUE);
 	}
 	do {
@@ -3313,8 +3545,9 @@ check_for_more_data(dig_query_t *query, dns_message_t *msg,
 				 */
 				if ((!query->first_soa_rcvd) &&
 				    (rdata.type != dns_rdatatype_soa)) {
-					puts("; Transfer failed.  "
-					     "Didn't start with SOA answer.");
+					diag(query->lookup,
+					     "; Transfer failed.  "
+					     "Didn't start with SOA answer.\n");
 					return (ISC_TRUE);
 				}
 				if ((!query->second_rr_rcvd) &&
@@ -3424,12 +3657,12 @@ process_cookie(dig_lookup_t *l, dns_message_t *msg,
 		if (isc_safe_memequal(isc_buffer_current(optbuf), sent, 8)) {
 			msg->cc_ok = 1;
 		} else {
-			printf(";; Warning: Client COOKIE mismatch\n");
+			diag(l, ";; Warning: Client COOKIE mismatch\n");
 			msg->cc_bad = 1;
 			copy = ISC_FALSE;
 		}
 	} else {
-		printf(";; Warning: COOKIE bad token (too short)\n");
+		diag(l, ";; Warning: COOKIE bad token (too short)\n");
 		msg->cc_bad = 1;
 		copy = ISC_FALSE;
 	}
@@ -3553,7 +3786,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 			debug("in recv cancel handler");
 			query->waiting_connect = ISC_FALSE;
 		} else {
-			printf(";; communications error: %s\n",
+			diag(l, ";; communications error: %s\n",
 			       isc_result_totext(sevent->result));
 			if (keep != NULL)
 				isc_socket_detach(&keep);
@@ -3602,7 +3835,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 			sizeof(buf1));
 			isc_sockaddr_format(&query->sockaddr, buf2,
 			sizeof(buf2));
-			printf(";; reply from unexpected source: %s,"
+			diag(l, ";; reply from unexpected source: %s,"
 			" expected %s\n", buf1, buf2);
 			match = ISC_FALSE;
 		}
@@ -3616,7 +3849,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 			if (result == ISC_R_SUCCESS) {
 				if (!query->first_soa_rcvd ||
 				     query->warn_id)
-					printf(";; %s: ID mismatch: "
+					diag(l, ";; %s: ID mismatch: "
 					       "expected ID %u, got %u\n",
 					       query->first_soa_rcvd ?
 					       "WARNING" : "ERROR",
@@ -3625,7 +3858,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 					fail = ISC_FALSE;
 				query->warn_id = ISC_FALSE;
 			} else
-				printf(";; ERROR: short "
+				diag(l, ";; ERROR: short "
 				       "(< header size) message\n");
 			if (fail) {
 				isc_event_free(&event);
@@ -3637,15 +3870,15 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 			}
 			match = ISC_TRUE;
 		} else if (result == ISC_R_SUCCESS)
-			printf(";; Warning: ID mismatch: "
+			diag(l, ";; Warning: ID mismatch: "
 			       "expected ID %u, got %u\n", l->sendmsg->id, id);
 		else
-			printf(";; Warning: short "
+			diag(l, ";; Warning: short "
 			       "(< header size) message received\n");
 	}
 
 	if (result == ISC_R_SUCCESS && (msgflags & DNS_MESSAGEFLAG_QR) == 0)
-		printf(";; Warning: query response not set\n");
+		diag(l, ";; Warning: query response not set\n");
 
 	if (!match)
 		goto udp_mismatch;
@@ -3679,12 +3912,12 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 	}
 	result = dns_message_parse(msg, b, parseflags);
 	if (result == DNS_R_RECOVERABLE) {
-		printf(";; Warning: Message parser reports malformed "
+		diag(l, ";; Warning: Message parser reports malformed "
 		       "message packet.\n");
 		result = ISC_R_SUCCESS;
 	}
 	if (result != ISC_R_SUCCESS) {
-		printf(";; Got bad packet: %s\n", isc_result_totext(result));
+		diag(l, ";; Got bad packet: %s\n", isc_result_totext(result));
 		hex_dump(b);
 		query->waiting_connect = ISC_FALSE;
 		dns_message_destroy(&msg);
@@ -3722,8 +3955,8 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 					dns_rdataclass_format(rdataset->rdclass,
 							      classbuf,
 							      sizeof(classbuf));
-					printf(";; Question section mismatch: "
-					       "got %s/%s/%s\n",
+					diag(l, ";; Question section "
+					     "mismatch: got %s/%s/%s\n",
 					       namestr, typebuf, classbuf);
 					match = ISC_FALSE;
 				}
@@ -3748,7 +3981,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 		 * Add minimum EDNS version required checks here if needed.
 		 */
 		if (l->comments)
-			printf(";; BADVERS, retrying with EDNS version %u.\n",
+			diag(l, ";; BADVERS, retrying with EDNS version %u.\n",
 			       (unsigned int)newedns);
 		l->edns = newedns;
 		n = requeue_lookup(l, ISC_TRUE);
@@ -3767,7 +4000,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 		if (l->cookie == NULL && l->sendcookie && msg->opt != NULL)
 			process_opt(l, msg);
 		if (l->comments)
-			printf(";; Truncated, retrying in TCP mode.\n");
+			diag(l, ";; Truncated, retrying in TCP mode.\n");
 		n = requeue_lookup(l, ISC_TRUE);
 		n->tcp_mode = ISC_TRUE;
 		if (l->trace && l->trace_root)
@@ -3785,7 +4018,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 		process_opt(l, msg);
 		if (msg->cc_ok) {
 			if (l->comments)
-				printf(";; BADCOOKIE, retrying%s.\n",
+				diag(l, ";; BADCOOKIE, retrying%s.\n",
 				       l->seenbadcookie ? " in TCP mode" : "");
 			n = requeue_lookup(l, ISC_TRUE);
 			if (l->seenbadcookie)
@@ -3823,7 +4056,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 		if ((ISC_LIST_HEAD(l->q) != query) ||
 		    (ISC_LIST_NEXT(query, link) != NULL)) {
 			if (l->comments)
-				printf(";; Got %s from %s, "
+				diag(l, ";; Got %s from %s, "
 				       "trying next server\n",
 				       msg->rcode == dns_rcode_servfail ?
 				       "SERVFAIL reply" :
@@ -3841,7 +4074,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 	if (key != NULL) {
 		result = dns_tsig_verify(&query->recvbuf, msg, NULL, NULL);
 		if (result != ISC_R_SUCCESS) {
-			printf(";; Couldn't verify signature: %s\n",
+			diag(l, ";; Couldn't verify signature: %s\n",
 			       isc_result_totext(result));
 			validated = ISC_FALSE;
 		}
@@ -3892,7 +4125,7 @@ recv_done(isc_task_t *task, isc_event_t *event) {
 
 	if (l->cookie != NULL) {
 		if (msg->opt == NULL)
-			printf(";; expected opt record in response\n");
+			diag(l, ";; expected opt record in response\n");
 		else
 			process_opt(l, msg);
 	} else if (l->sendcookie && msg->opt != NULL)
@@ -4109,27 +4342,28 @@ cancel_all(void) {
 		return;
 	}
 	cancel_now = ISC_TRUE;
-	if (current_lookup != NULL) {
-		for (q = ISC_LIST_HEAD(current_lookup->q);
+	for (l = ISC_LIST_HEAD(running_list); l != NULL; l = n) {
+		n = ISC_LIST_NEXT(l, link);
+		for (q = ISC_LIST_HEAD(l->q);
 		     q != NULL;
 		     q = nq)
 		{
 			nq = ISC_LIST_NEXT(q, link);
 			debug("canceling pending query %p, belonging to %p",
-			      q, current_lookup);
+			      q, l);
 			if (q->sock != NULL)
 				isc_socket_cancel(q->sock, NULL,
 						  ISC_SOCKCANCEL_ALL);
 			else
 				clear_query(q);
 		}
-		for (q = ISC_LIST_HEAD(current_lookup->connecting);
+		for (q = ISC_LIST_HEAD(l->connecting);
 		     q != NULL;
 		     q = nq)
 		{
 			nq = ISC_LIST_NEXT(q, clink);
 			debug("canceling connecting query %p, belonging to %p",
-			      q, current_lookup);
+			      q, l);
 			if (q->sock != NULL)
 				isc_socket_cancel(q->sock, NULL,
 						  ISC_SOCKCANCEL_ALL);
@@ -4178,7 +4412,8 @@ destroy_libs(void) {
 	REQUIRE(sendcount == 0);
 
 	INSIST(ISC_LIST_HEAD(lookup_list) == NULL);
-	INSIST(current_lookup == NULL);
+	INSIST(ISC_LIST_EMPTY(running_list));
+	INSIST(ISC_LIST_EMPTY(output_list));
 	INSIST(!free_now);
 
 	free_now = ISC_TRUE;
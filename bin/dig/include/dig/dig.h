@@ -52,6 +52,8 @@
 #define MAXTRIES 0xffffffff
 /*% Max number of dots */
 #define MAXNDOTS 0xffff
+/*% Max number of lookups in flight */
+#define MAXPARALLEL 1024
 /*% Max number of ports */
 #define MAXPORT 0xffff
 /*% Max serial number */
@@ -78,6 +80,7 @@ typedef struct dig_query dig_query_t;
 typedef struct dig_server dig_server_t;
 typedef ISC_LIST(dig_server_t) dig_serverlist_t;
 typedef struct dig_searchlist dig_searchlist_t;
+typedef struct dig_output dig_output_t;
 
 /*% The dig_lookup structure */
 struct dig_lookup {
@@ -176,6 +179,7 @@ struct dig_lookup {
 	dns_opcode_t opcode;
 	int rrcomments;
 	unsigned int eoferr;
+	dig_output_t *output;
 };
 
 /*% The dig_query structure */
@@ -229,6 +233,19 @@ struct dig_searchlist {
 	ISC_LINK(dig_searchlist_t) link;
 };
 
+/*%
+ * Output of a lookup that is held back until the lookups started
+ * before it have printed theirs, so that concurrent lookups print
+ * in input order.  Lookups cloned from it (retries, search list
+ * origins) share it.
+ */
+struct dig_output {
+	unsigned int references;
+	isc_boolean_t done;
+	isc_buffer_t *buffer;
+	ISC_LINK(dig_output_t) link;
+};
+
 typedef ISC_LIST(dig_searchlist_t) dig_searchlistlist_t;
 typedef ISC_LIST(dig_lookup_t) dig_lookuplist_t;
 
@@ -242,9 +259,10 @@ extern dig_searchlistlist_t search_list;
 extern unsigned int extrabytes;
 
 extern isc_boolean_t check_ra, have_ipv4, have_ipv6, specified_source,
-	usesearch, showsearch;
+	usesearch, showsearch, ordered_output, yaml;
 extern in_port_t port;
 extern unsigned int timeout;
+extern unsigned int maxlookups;
 extern isc_mem_t *mctx;
 extern int sendcount;
 extern int ndots;
@@ -302,6 +320,20 @@ debug(const char *format, ...) ISC_FORMAT_PRINTF(1, 2);
 void
 check_result(isc_result_t result, const char *msg);
 
+void
+lookup_printf(dig_lookup_t *lookup, const char *format, ...)
+ISC_FORMAT_PRINTF(2, 3);
+/*%<
+ * Print output belonging to 'lookup'.  If it is held back by
+ * ordered output, it is buffered until its turn.
+ */
+
+void
+lookup_yamlstr(dig_lookup_t *lookup, const char *str);
+/*%<
+ * Print 'str' for 'lookup' as a single-quoted YAML scalar.
+ */
+
 isc_boolean_t
 setup_lookup(dig_lookup_t *lookup);
 
@@ -326,6 +358,13 @@ setup_libs(void);
 void
 setup_system(isc_boolean_t ipv4only, isc_boolean_t ipv6only);
 
+void
+setup_quietlog(void);
+/*%<
+ * Log only warnings and errors from the libraries, for when many
+ * lookups run at once (+parallel).
+ */
+
 isc_result_t
 parse_uint(isc_uint32_t *uip, const char *value, isc_uint32_t max,
 	   const char *desc);
@@ -401,6 +440,13 @@ extern void
 extern void
 (*dighost_pre_exit_hook)(void);
 
+extern void
+(*dighost_refill)(void);
+/*%<
+ * Optional: called when more lookups could run concurrently but the
+ * lookup list is empty, to queue more (e.g. from a batch file).
+ */
+
 void save_opt(dig_lookup_t *lookup, char *code, char *value);
 
 void setup_file_key(void);
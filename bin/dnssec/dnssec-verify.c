@@ -81,6 +81,7 @@ static dns_rdataclass_t gclass;		/* The class */
 static dns_name_t *gorigin;		/* The database origin */
 static isc_boolean_t ignore_kskflag = ISC_FALSE;
 static isc_boolean_t keyset_kskonly = ISC_FALSE;
+static unsigned int ntasks = 0;
 
 /*%
  * Load the zone file from disk
@@ -151,6 +152,7 @@ usage(void) {
 	fprintf(stderr, "\t-I format:\n");
 	fprintf(stderr, "\t\tfile format of input zonefile (text)\n");
 	fprintf(stderr, "\t-c class (IN)\n");
+	fprintf(stderr, "\t-n ncpus (number of cpus present)\n");
 	fprintf(stderr, "\t-E engine:\n");
 #if defined(PKCS11CRYPTO)
 	fprintf(stderr, "\t\tpath to PKCS#11 provider library "
@@ -184,7 +186,7 @@ main(int argc, char *argv[]) {
 	int ch;
 
 #define CMDLINE_FLAGS \
-	"hm:o:I:c:E:v:Vxz"
+	"hm:n:o:I:c:E:v:Vxz"
 
 	/*
 	 * Process memory debugging argument first.
@@ -238,6 +240,13 @@ main(int argc, char *argv[]) {
 		case 'm':
 			break;
 
+		case 'n':
+			endp = NULL;
+			ntasks = strtol(isc_commandline_argument, &endp, 0);
+			if (*endp != '\0' || ntasks > ISC_INT32_MAX)
+				fatal("number of cpus must be numeric");
+			break;
+
 		case 'o':
 			origin = isc_commandline_argument;
 			break;
@@ -333,7 +342,7 @@ main(int argc, char *argv[]) {
 	check_result(result, "dns_db_newversion()");
 
 	verifyzone(gdb, gversion, gorigin, mctx,
-		   ignore_kskflag, keyset_kskonly);
+		   ignore_kskflag, keyset_kskonly, ntasks);
 
 	dns_db_closeversion(gdb, &gversion, ISC_FALSE);
 	dns_db_detach(&gdb);
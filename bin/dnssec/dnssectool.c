@@ -26,15 +26,21 @@
 #include <isc/base32.h>
 #include <isc/buffer.h>
 #include <isc/commandline.h>
+#include <isc/condition.h>
 #include <isc/dir.h>
 #include <isc/entropy.h>
+#include <isc/event.h>
+#include <isc/eventclass.h>
 #include <isc/file.h>
 #include <isc/heap.h>
 #include <isc/list.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/string.h>
+#include <isc/task.h>
 #include <isc/time.h>
 #include <isc/util.h>
 
@@ -70,6 +76,73 @@ struct nsec3_chain_fixed {
 	/* unsigned char next[0]; */
 };
 
+/*%
+ * verifyzone() hands runs of consecutive nodes, in database iterator
+ * order, to worker tasks.  Each batch collects its own messages, bad
+ * algorithms and NSEC3 chain elements; these are merged in the order
+ * the batches were handed out, so the output does not depend on the
+ * number of tasks.
+ */
+#define VERIFY_BATCHSIZE	64
+
+#define VERIFY_EVENTCLASS	ISC_EVENTCLASS(0x4456)
+#define VERIFY_EVENT_WORK	(VERIFY_EVENTCLASS + 0)
+
+typedef struct verifier verifier_t;
+typedef struct vbatch vbatch_t;
+
+typedef struct vnode {
+	dns_fixedname_t		fname;
+	dns_dbnode_t		*node;
+	isc_boolean_t		delegation;
+} vnode_t;
+
+struct vbatch {
+	verifier_t		*verifier;
+	isc_boolean_t		nsec3;		/* NSEC3 nodes */
+	isc_boolean_t		done;		/* Locked by verifier */
+	unsigned int		count;
+	vnode_t			nodes[VERIFY_BATCHSIZE];
+	dns_fixedname_t		fprevname;
+	dns_name_t		*prevname;	/* Node before nodes[0] */
+	dns_fixedname_t		fnextname;	/* Node after the last one */
+	dns_rdataset_t		keyset;
+	dns_rdataset_t		nsecset;
+	dns_rdataset_t		nsec3paramset;
+	isc_result_t		result;
+	unsigned char		bad_algorithms[256];
+	isc_heap_t		*expected_chains;
+	isc_heap_t		*found_chains;
+	unsigned int		rrsets;
+	char			*text;
+	size_t			textlen;
+	size_t			textsize;
+	ISC_LINK(vbatch_t)	link;
+};
+
+struct verifier {
+	isc_mem_t		*mctx;
+	dns_db_t		*db;
+	dns_dbversion_t		*ver;
+	dns_name_t		*origin;
+	dns_rdataset_t		*keyset;
+	dns_rdataset_t		*nsecset;
+	dns_rdataset_t		*nsec3paramset;
+	unsigned char		*act_algorithms;
+	unsigned char		*bad_algorithms;
+	isc_result_t		result;
+	isc_uint64_t		nodes;
+	isc_uint64_t		rrsets;
+	unsigned int		ntasks;
+	isc_taskmgr_t		*taskmgr;
+	isc_task_t		**tasks;
+	unsigned int		nexttask;
+	isc_mutex_t		lock;
+	isc_condition_t		cond;
+	ISC_LIST(vbatch_t)	batches;	/* Locked */
+	unsigned int		nbatches;	/* Locked */
+};
+
 extern int verbose;
 extern const char *program;
 
@@ -594,6 +667,47 @@ is_delegation(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 	return (ISC_TF(result == ISC_R_SUCCESS));
 }
 
+/*%
+ * Append a message to the batch's output, which is written out when
+ * the batch is merged.
+ */
+static void
+report(vbatch_t *vb, const char *format, ...) ISC_FORMAT_PRINTF(2, 3);
+
+static void
+report(vbatch_t *vb, const char *format, ...) {
+	isc_mem_t *mctx = vb->verifier->mctx;
+	va_list args;
+	size_t size;
+	char *text;
+	int n;
+
+	for (;;) {
+		va_start(args, format);
+		n = vsnprintf(vb->text + vb->textlen,
+			      vb->textsize - vb->textlen, format, args);
+		va_end(args);
+		if (n < 0)
+			fatal("failed to format message");
+		if (vb->textlen + n < vb->textsize) {
+			vb->textlen += n;
+			return;
+		}
+		size = (vb->textsize == 0) ? 1024 : vb->textsize;
+		while (size <= vb->textlen + n)
+			size *= 2;
+		text = isc_mem_get(mctx, size);
+		if (text == NULL)
+			fatal("out of memory");
+		if (vb->text != NULL) {
+			memmove(text, vb->text, vb->textlen);
+			isc_mem_put(mctx, vb->text, vb->textsize);
+		}
+		vb->text = text;
+		vb->textsize = size;
+	}
+}
+
 static isc_boolean_t
 goodsig(dns_name_t *origin, dns_rdata_t *sigrdata, dns_name_t *name,
 	dns_rdataset_t *keyrdataset, dns_rdataset_t *rdataset, isc_mem_t *mctx)
@@ -633,8 +747,8 @@ goodsig(dns_name_t *origin, dns_rdata_t *sigrdata, dns_name_t *name,
 }
 
 static isc_result_t
-verifynsec(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *name,
-	   dns_dbnode_t *node, dns_name_t *nextname)
+verifynsec(vbatch_t *vb, dns_db_t *db, dns_dbversion_t *ver,
+	   dns_name_t *name, dns_dbnode_t *node, dns_name_t *nextname)
 {
 	unsigned char buffer[DNS_NSEC_BUFFERSIZE];
 	char namebuf[DNS_NAME_FORMATSIZE];
@@ -651,7 +765,7 @@ verifynsec(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *name,
 				     0, 0, &rdataset, NULL);
 	if (result != ISC_R_SUCCESS) {
 		dns_name_format(name, namebuf, sizeof(namebuf));
-		fprintf(stderr, "Missing NSEC record for %s\n", namebuf);
+		report(vb, "Missing NSEC record for %s\n", namebuf);
 		goto failure;
 	}
 
@@ -666,7 +780,7 @@ verifynsec(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *name,
 		dns_name_format(name, namebuf, sizeof(namebuf));
 		dns_name_format(nextname, nextbuf, sizeof(nextbuf));
 		dns_name_format(&nsec.next, found, sizeof(found));
-		fprintf(stderr, "Bad NSEC record for %s, next name "
+		report(vb, "Bad NSEC record for %s, next name "
 				"mismatch (expected:%s, found:%s)\n", namebuf,
 				nextbuf, found);
 		goto failure;
@@ -677,14 +791,14 @@ verifynsec(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *name,
 	check_result(result, "dns_nsec_buildrdata()");
 	if (dns_rdata_compare(&rdata, &tmprdata) != 0) {
 		dns_name_format(name, namebuf, sizeof(namebuf));
-		fprintf(stderr, "Bad NSEC record for %s, bit map "
+		report(vb, "Bad NSEC record for %s, bit map "
 				"mismatch\n", namebuf);
 		goto failure;
 	}
 	result = dns_rdataset_next(&rdataset);
 	if (result != ISC_R_NOMORE) {
 		dns_name_format(name, namebuf, sizeof(namebuf));
-		fprintf(stderr, "Multipe NSEC records for %s\n", namebuf);
+		report(vb, "Multipe NSEC records for %s\n", namebuf);
 		goto failure;
 
 	}
@@ -697,8 +811,8 @@ verifynsec(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *name,
 }
 
 static void
-check_no_rrsig(dns_db_t *db, dns_dbversion_t *ver, dns_rdataset_t *rdataset,
-	       dns_name_t *name, dns_dbnode_t *node)
+check_no_rrsig(vbatch_t *vb, dns_db_t *db, dns_dbversion_t *ver,
+	       dns_rdataset_t *rdataset, dns_name_t *name, dns_dbnode_t *node)
 {
 	char namebuf[DNS_NAME_FORMATSIZE];
 	char typebuf[80];
@@ -721,7 +835,7 @@ check_no_rrsig(dns_db_t *db, dns_dbversion_t *ver, dns_rdataset_t *rdataset,
 	if (result == ISC_R_SUCCESS) {
 		dns_name_format(name, namebuf, sizeof(namebuf));
 		type_format(rdataset->type, typebuf, sizeof(typebuf));
-		fprintf(stderr, "Warning: Found unexpected signatures for "
+		report(vb, "Warning: Found unexpected signatures for "
 			"%s/%s\n", namebuf, typebuf);
 	}
 	if (dns_rdataset_isassociated(&sigrdataset))
@@ -812,7 +926,7 @@ record_nsec3(const unsigned char *rawhash, const dns_rdata_nsec3_t *nsec3,
 }
 
 static isc_result_t
-match_nsec3(dns_name_t *name, isc_mem_t *mctx,
+match_nsec3(vbatch_t *vb, dns_name_t *name, isc_mem_t *mctx,
 	    dns_rdata_nsec3param_t *nsec3param, dns_rdataset_t *rdataset,
 	    unsigned char types[8192], unsigned int maxtype,
 	    unsigned char *rawhash, size_t rhsize)
@@ -843,7 +957,7 @@ match_nsec3(dns_name_t *name, isc_mem_t *mctx,
 	}
 	if (result != ISC_R_SUCCESS) {
 		dns_name_format(name, namebuf, sizeof(namebuf));
-		fprintf(stderr, "Missing NSEC3 record for %s\n", namebuf);
+		report(vb, "Missing NSEC3 record for %s\n", namebuf);
 		return (result);
 	}
 
@@ -853,7 +967,7 @@ match_nsec3(dns_name_t *name, isc_mem_t *mctx,
 	len = dns_nsec_compressbitmap(cbm, types, maxtype);
 	if (nsec3.len != len || memcmp(cbm, nsec3.typebits, len) != 0) {
 		dns_name_format(name, namebuf, sizeof(namebuf));
-		fprintf(stderr, "Bad NSEC3 record for %s, bit map "
+		report(vb, "Bad NSEC3 record for %s, bit map "
 				"mismatch\n", namebuf);
 		return (ISC_R_FAILURE);
 	}
@@ -861,7 +975,8 @@ match_nsec3(dns_name_t *name, isc_mem_t *mctx,
 	/*
 	 * Record chain.
 	 */
-	result = record_nsec3(rawhash, &nsec3, mctx, expected_chains);
+	result = record_nsec3(rawhash, &nsec3, mctx,
+			      vb->expected_chains);
 	check_result(result, "record_nsec3()");
 
 	/*
@@ -881,7 +996,7 @@ match_nsec3(dns_name_t *name, isc_mem_t *mctx,
 		    memcmp(nsec3.salt, nsec3param->salt,
 			   nsec3.salt_length) == 0) {
 			dns_name_format(name, namebuf, sizeof(namebuf));
-			fprintf(stderr, "Multiple NSEC3 records with the "
+			report(vb, "Multiple NSEC3 records with the "
 				"same parameter set for %s", namebuf);
 			result = DNS_R_DUPLICATE;
 			break;
@@ -919,8 +1034,8 @@ innsec3params(dns_rdata_nsec3_t *nsec3, dns_rdataset_t *nsec3paramset) {
 }
 
 static isc_result_t
-record_found(dns_db_t *db, dns_dbversion_t *ver, isc_mem_t *mctx,
-	     dns_name_t *name, dns_dbnode_t *node,
+record_found(vbatch_t *vb, dns_db_t *db, dns_dbversion_t *ver,
+	     isc_mem_t *mctx, dns_name_t *name, dns_dbnode_t *node,
 	     dns_rdataset_t *nsec3paramset)
 {
 	unsigned char owner[NSEC3_MAX_HASH_LENGTH];
@@ -965,7 +1080,8 @@ record_found(dns_db_t *db, dns_dbversion_t *ver, isc_mem_t *mctx,
 		/*
 		 * Record chain.
 		 */
-		result = record_nsec3(owner, &nsec3, mctx, found_chains);
+		result = record_nsec3(owner, &nsec3, mctx,
+				      vb->found_chains);
 		check_result(result, "record_nsec3()");
 	}
 
@@ -1028,9 +1144,9 @@ isoptout(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 }
 
 static isc_result_t
-verifynsec3(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
-	    isc_mem_t *mctx, dns_name_t *name, dns_rdata_t *rdata,
-	    isc_boolean_t delegation, isc_boolean_t empty,
+verifynsec3(vbatch_t *vb, dns_db_t *db, dns_dbversion_t *ver,
+	    dns_name_t *origin, isc_mem_t *mctx, dns_name_t *name,
+	    dns_rdata_t *rdata, isc_boolean_t delegation, isc_boolean_t empty,
 	    unsigned char types[8192], unsigned int maxtype)
 {
 	char namebuf[DNS_NAME_FORMATSIZE];
@@ -1080,14 +1196,14 @@ verifynsec3(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 	{
 		dns_name_format(name, namebuf, sizeof(namebuf));
 		dns_name_format(hashname, hashbuf, sizeof(hashbuf));
-		fprintf(stderr, "Missing NSEC3 record for %s (%s)\n",
+		report(vb, "Missing NSEC3 record for %s (%s)\n",
 			namebuf, hashbuf);
 	} else if (result == ISC_R_NOTFOUND &&
 		   delegation && (!empty || optout))
 	{
 		result = ISC_R_SUCCESS;
 	} else if (result == ISC_R_SUCCESS) {
-		result = match_nsec3(name, mctx, &nsec3param, &rdataset,
+		result = match_nsec3(vb, name, mctx, &nsec3param, &rdataset,
 				     types, maxtype, rawhash, rhsize);
 	}
 
@@ -1100,10 +1216,11 @@ verifynsec3(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 }
 
 static isc_result_t
-verifynsec3s(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
-	     isc_mem_t *mctx, dns_name_t *name, dns_rdataset_t *nsec3paramset,
-	     isc_boolean_t delegation, isc_boolean_t empty,
-	     unsigned char types[8192], unsigned int maxtype)
+verifynsec3s(vbatch_t *vb, dns_db_t *db, dns_dbversion_t *ver,
+	     dns_name_t *origin, isc_mem_t *mctx, dns_name_t *name,
+	     dns_rdataset_t *nsec3paramset, isc_boolean_t delegation,
+	     isc_boolean_t empty, unsigned char types[8192],
+	     unsigned int maxtype)
 {
 	isc_result_t result;
 
@@ -1113,7 +1230,7 @@ verifynsec3s(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 		dns_rdata_t rdata = DNS_RDATA_INIT;
 
 		dns_rdataset_current(nsec3paramset, &rdata);
-		result = verifynsec3(db, ver, origin, mctx, name, &rdata,
+		result = verifynsec3(vb, db, ver, origin, mctx, name, &rdata,
 				     delegation, empty, types, maxtype);
 		if (result != ISC_R_SUCCESS)
 			break;
@@ -1124,9 +1241,9 @@ verifynsec3s(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 }
 
 static void
-verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
-	  isc_mem_t *mctx, dns_rdataset_t *rdataset, dns_name_t *name,
-	  dns_dbnode_t *node, dns_rdataset_t *keyrdataset,
+verifyset(vbatch_t *vb, dns_db_t *db, dns_dbversion_t *ver,
+	  dns_name_t *origin, isc_mem_t *mctx, dns_rdataset_t *rdataset,
+	  dns_name_t *name, dns_dbnode_t *node, dns_rdataset_t *keyrdataset,
 	  unsigned char *act_algorithms, unsigned char *bad_algorithms)
 {
 	unsigned char set_algorithms[256];
@@ -1138,6 +1255,8 @@ verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 	isc_result_t result;
 	int i;
 
+	vb->rrsets++;
+
 	dns_rdataset_init(&sigrdataset);
 	result = dns_db_allrdatasets(db, node, ver, 0, &rdsiter);
 	check_result(result, "dns_db_allrdatasets()");
@@ -1153,7 +1272,7 @@ verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 	if (result != ISC_R_SUCCESS) {
 		dns_name_format(name, namebuf, sizeof(namebuf));
 		type_format(rdataset->type, typebuf, sizeof(typebuf));
-		fprintf(stderr, "No signatures for %s/%s\n", namebuf, typebuf);
+		report(vb, "No signatures for %s/%s\n", namebuf, typebuf);
 		for (i = 0; i < 256; i++)
 			if (act_algorithms[i] != 0)
 				bad_algorithms[i] = 1;
@@ -1174,7 +1293,7 @@ verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 		if (rdataset->ttl != sig.originalttl) {
 			dns_name_format(name, namebuf, sizeof(namebuf));
 			type_format(rdataset->type, typebuf, sizeof(typebuf));
-			fprintf(stderr, "TTL mismatch for %s %s keytag %u\n",
+			report(vb, "TTL mismatch for %s %s keytag %u\n",
 				namebuf, typebuf, sig.keyid);
 			continue;
 		}
@@ -1192,7 +1311,7 @@ verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 			if ((act_algorithms[i] != 0) &&
 			    (set_algorithms[i] == 0)) {
 				dns_secalg_format(i, algbuf, sizeof(algbuf));
-				fprintf(stderr, "No correct %s signature for "
+				report(vb, "No correct %s signature for "
 					"%s %s\n", algbuf, namebuf, typebuf);
 				bad_algorithms[i] = 1;
 			}
@@ -1201,9 +1320,10 @@ verifyset(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 }
 
 static isc_result_t
-verifynode(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
-	   isc_mem_t *mctx, dns_name_t *name, dns_dbnode_t *node,
-	   isc_boolean_t delegation, dns_rdataset_t *keyrdataset,
+verifynode(vbatch_t *vb, dns_db_t *db, dns_dbversion_t *ver,
+	   dns_name_t *origin, isc_mem_t *mctx, dns_name_t *name,
+	   dns_dbnode_t *node, isc_boolean_t delegation,
+	   dns_rdataset_t *keyrdataset,
 	   unsigned char *act_algorithms, unsigned char *bad_algorithms,
 	   dns_rdataset_t *nsecset, dns_rdataset_t *nsec3paramset,
 	   dns_name_t *nextname)
@@ -1231,7 +1351,7 @@ verifynode(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 		    rdataset.type != dns_rdatatype_dnskey &&
 		    (!delegation || rdataset.type == dns_rdatatype_ds ||
 		     rdataset.type == dns_rdatatype_nsec)) {
-			verifyset(db, ver, origin, mctx, &rdataset,
+			verifyset(vb, db, ver, origin, mctx, &rdataset,
 				  name, node, keyrdataset,
 				  act_algorithms, bad_algorithms);
 			dns_nsec_setbit(types, rdataset.type, 1);
@@ -1241,7 +1361,7 @@ verifynode(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 			   rdataset.type != dns_rdatatype_dnskey) {
 			if (rdataset.type == dns_rdatatype_ns)
 				dns_nsec_setbit(types, rdataset.type, 1);
-			check_no_rrsig(db, ver, &rdataset, name, node);
+			check_no_rrsig(vb, db, ver, &rdataset, name, node);
 		} else
 			dns_nsec_setbit(types, rdataset.type, 1);
 		dns_rdataset_disassociate(&rdataset);
@@ -1255,10 +1375,10 @@ verifynode(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 	result = ISC_R_SUCCESS;
 
 	if (nsecset != NULL && dns_rdataset_isassociated(nsecset))
-		result = verifynsec(db, ver, name, node, nextname);
+		result = verifynsec(vb, db, ver, name, node, nextname);
 
 	if (nsec3paramset != NULL && dns_rdataset_isassociated(nsec3paramset)) {
-		tresult = verifynsec3s(db, ver, origin, mctx, name,
+		tresult = verifynsec3s(vb, db, ver, origin, mctx, name,
 				       nsec3paramset, delegation, ISC_FALSE,
 				       types, maxtype);
 		if (result == ISC_R_SUCCESS && tresult != ISC_R_SUCCESS)
@@ -1448,9 +1568,10 @@ verify_nsec3_chains(isc_mem_t *mctx) {
 }
 
 static isc_result_t
-verifyemptynodes(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
-		 isc_mem_t *mctx, dns_name_t *name, dns_name_t *prevname,
-		 isc_boolean_t isdelegation, dns_rdataset_t *nsec3paramset)
+verifyemptynodes(vbatch_t *vb, dns_db_t *db, dns_dbversion_t *ver,
+		 dns_name_t *origin, isc_mem_t *mctx, dns_name_t *name,
+		 dns_name_t *prevname, isc_boolean_t isdelegation,
+		 dns_rdataset_t *nsec3paramset)
 {
 	dns_namereln_t reln;
 	int order;
@@ -1472,8 +1593,9 @@ verifyemptynodes(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 						  &suffix);
 			if (nsec3paramset != NULL &&
 			     dns_rdataset_isassociated(nsec3paramset)) {
-				tresult = verifynsec3s(db, ver, origin, mctx,
-						       &suffix, nsec3paramset,
+				tresult = verifynsec3s(vb, db, ver, origin,
+						       mctx, &suffix,
+						       nsec3paramset,
 						       isdelegation, ISC_TRUE,
 						       NULL, 0);
 				if (result == ISC_R_SUCCESS &&
@@ -1485,6 +1607,241 @@ verifyemptynodes(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 	return (result);
 }
 
+static vbatch_t *
+newbatch(verifier_t *v, isc_boolean_t nsec3, dns_name_t *prevname) {
+	vbatch_t *vb;
+	isc_result_t result;
+
+	vb = isc_mem_get(v->mctx, sizeof(*vb));
+	if (vb == NULL)
+		fatal("out of memory");
+	vb->verifier = v;
+	vb->nsec3 = nsec3;
+	vb->done = ISC_FALSE;
+	vb->count = 0;
+	dns_fixedname_init(&vb->fprevname);
+	vb->prevname = NULL;
+	if (prevname != NULL) {
+		vb->prevname = dns_fixedname_name(&vb->fprevname);
+		dns_name_copy(prevname, vb->prevname, NULL);
+	}
+	dns_fixedname_init(&vb->fnextname);
+
+	/*
+	 * Iterating over an rdataset is not thread safe, so each batch
+	 * works on its own copies.
+	 */
+	dns_rdataset_init(&vb->keyset);
+	dns_rdataset_init(&vb->nsecset);
+	dns_rdataset_init(&vb->nsec3paramset);
+	dns_rdataset_clone(v->keyset, &vb->keyset);
+	if (dns_rdataset_isassociated(v->nsecset))
+		dns_rdataset_clone(v->nsecset, &vb->nsecset);
+	if (dns_rdataset_isassociated(v->nsec3paramset))
+		dns_rdataset_clone(v->nsec3paramset, &vb->nsec3paramset);
+
+	vb->result = ISC_R_SUCCESS;
+	memset(vb->bad_algorithms, 0, sizeof(vb->bad_algorithms));
+	vb->expected_chains = NULL;
+	result = isc_heap_create(v->mctx, chain_compare, NULL, 1024,
+				 &vb->expected_chains);
+	check_result(result, "isc_heap_create()");
+	vb->found_chains = NULL;
+	result = isc_heap_create(v->mctx, chain_compare, NULL, 1024,
+				 &vb->found_chains);
+	check_result(result, "isc_heap_create()");
+	vb->rrsets = 0;
+	vb->text = NULL;
+	vb->textlen = 0;
+	vb->textsize = 0;
+	ISC_LINK_INIT(vb, link);
+	return (vb);
+}
+
+static void
+addnode(vbatch_t *vb, dns_name_t *name, dns_dbnode_t **nodep,
+	isc_boolean_t delegation)
+{
+	vnode_t *vn;
+
+	INSIST(vb->count < VERIFY_BATCHSIZE);
+	vn = &vb->nodes[vb->count++];
+	dns_fixedname_init(&vn->fname);
+	dns_name_copy(name, dns_fixedname_name(&vn->fname), NULL);
+	vn->node = *nodep;
+	*nodep = NULL;
+	vn->delegation = delegation;
+}
+
+/*%
+ * Verify the nodes of a batch.  This is the only part of the
+ * verification that runs in the worker tasks.
+ */
+static void
+verifybatch(vbatch_t *vb) {
+	verifier_t *v = vb->verifier;
+	dns_name_t *name, *nextname, *prevname = vb->prevname;
+	isc_result_t result;
+	unsigned int i;
+
+	for (i = 0; i < vb->count; i++) {
+		vnode_t *vn = &vb->nodes[i];
+
+		name = dns_fixedname_name(&vn->fname);
+		if (vb->nsec3) {
+			result = verifynode(vb, v->db, v->ver, v->origin,
+					    v->mctx, name, vn->node, ISC_FALSE,
+					    &vb->keyset, v->act_algorithms,
+					    vb->bad_algorithms, NULL, NULL,
+					    NULL);
+			check_result(result, "verifynode");
+			record_found(vb, v->db, v->ver, v->mctx, name,
+				     vn->node, &vb->nsec3paramset);
+			dns_db_detachnode(v->db, &vn->node);
+			continue;
+		}
+
+		if (i + 1 < vb->count)
+			nextname = dns_fixedname_name(&vb->nodes[i + 1].fname);
+		else
+			nextname = dns_fixedname_name(&vb->fnextname);
+		result = verifynode(vb, v->db, v->ver, v->origin, v->mctx,
+				    name, vn->node, vn->delegation,
+				    &vb->keyset, v->act_algorithms,
+				    vb->bad_algorithms, &vb->nsecset,
+				    &vb->nsec3paramset, nextname);
+		if (vb->result == ISC_R_SUCCESS && result != ISC_R_SUCCESS)
+			vb->result = result;
+		if (prevname != NULL) {
+			result = verifyemptynodes(vb, v->db, v->ver, v->origin,
+						  v->mctx, name, prevname,
+						  vn->delegation,
+						  &vb->nsec3paramset);
+			if (vb->result == ISC_R_SUCCESS &&
+			    result != ISC_R_SUCCESS)
+				vb->result = result;
+		}
+		prevname = name;
+		dns_db_detachnode(v->db, &vn->node);
+	}
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+static void
+verifywork(isc_task_t *task, isc_event_t *event) {
+	vbatch_t *vb = event->ev_arg;
+	verifier_t *v = vb->verifier;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	verifybatch(vb);
+
+	LOCK(&v->lock);
+	vb->done = ISC_TRUE;
+	SIGNAL(&v->cond);
+	UNLOCK(&v->lock);
+}
+#endif
+
+/*%
+ * Fold the results of a finished batch into the verifier and free it.
+ */
+static void
+mergebatch(verifier_t *v, vbatch_t *vb) {
+	struct nsec3_chain_fixed *e;
+	isc_result_t result;
+	unsigned int i;
+
+	if (vb->textlen != 0)
+		fwrite(vb->text, 1, vb->textlen, stderr);
+	for (i = 0; i < 256; i++)
+		if (vb->bad_algorithms[i] != 0)
+			v->bad_algorithms[i] = 1;
+	if (v->result == ISC_R_SUCCESS && vb->result != ISC_R_SUCCESS)
+		v->result = vb->result;
+	v->nodes += vb->count;
+	v->rrsets += vb->rrsets;
+
+	for (i = 1; (e = isc_heap_element(vb->expected_chains, i)) != NULL;
+	     i++)
+	{
+		result = isc_heap_insert(expected_chains, e);
+		check_result(result, "isc_heap_insert()");
+	}
+	for (i = 1; (e = isc_heap_element(vb->found_chains, i)) != NULL;
+	     i++)
+	{
+		result = isc_heap_insert(found_chains, e);
+		check_result(result, "isc_heap_insert()");
+	}
+	isc_heap_destroy(&vb->expected_chains);
+	isc_heap_destroy(&vb->found_chains);
+
+	dns_rdataset_disassociate(&vb->keyset);
+	if (dns_rdataset_isassociated(&vb->nsecset))
+		dns_rdataset_disassociate(&vb->nsecset);
+	if (dns_rdataset_isassociated(&vb->nsec3paramset))
+		dns_rdataset_disassociate(&vb->nsec3paramset);
+	if (vb->text != NULL)
+		isc_mem_put(v->mctx, vb->text, vb->textsize);
+	isc_mem_put(v->mctx, vb, sizeof(*vb));
+}
+
+/*%
+ * Merge finished batches in the order they were dispatched.  Unless
+ * 'all' is set, only wait for a batch to finish when too many are
+ * outstanding.
+ */
+static void
+mergebatches(verifier_t *v, isc_boolean_t all) {
+	vbatch_t *vb;
+
+	LOCK(&v->lock);
+	while ((vb = ISC_LIST_HEAD(v->batches)) != NULL) {
+		if (!vb->done) {
+			if (!all && v->nbatches < 2 * v->ntasks)
+				break;
+			WAIT(&v->cond, &v->lock);
+			continue;
+		}
+		ISC_LIST_UNLINK(v->batches, vb, link);
+		v->nbatches--;
+		UNLOCK(&v->lock);
+		mergebatch(v, vb);
+		LOCK(&v->lock);
+	}
+	UNLOCK(&v->lock);
+}
+
+static void
+dispatch(verifier_t *v, vbatch_t *vb) {
+#ifdef ISC_PLATFORM_USETHREADS
+	isc_event_t *event;
+	isc_task_t *task;
+
+	if (v->taskmgr != NULL) {
+		task = v->tasks[v->nexttask];
+		v->nexttask = (v->nexttask + 1) % v->ntasks;
+		event = isc_event_allocate(v->mctx, task, VERIFY_EVENT_WORK,
+					   verifywork, vb,
+					   sizeof(isc_event_t));
+		if (event == NULL)
+			fatal("out of memory");
+		LOCK(&v->lock);
+		ISC_LIST_APPEND(v->batches, vb, link);
+		v->nbatches++;
+		UNLOCK(&v->lock);
+		isc_task_send(task, &event);
+		mergebatches(v, ISC_FALSE);
+		return;
+	}
+#endif
+	verifybatch(vb);
+	vb->done = ISC_TRUE;
+	mergebatch(v, vb);
+}
+
 /*%
  * Verify that certain things are sane:
  *
@@ -1500,13 +1857,18 @@ verifyemptynodes(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *origin,
 void
 verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 	   dns_name_t *origin, isc_mem_t *mctx,
-	   isc_boolean_t ignore_kskflag, isc_boolean_t keyset_kskonly)
+	   isc_boolean_t ignore_kskflag, isc_boolean_t keyset_kskonly,
+	   unsigned int ntasks)
 {
 	char algbuf[80];
+	verifier_t v;
+	vbatch_t *vb;
+	isc_time_t start, finish;
+	isc_uint64_t time_us, time_ms;
 	dns_dbiterator_t *dbiter = NULL;
 	dns_dbnode_t *node = NULL, *nextnode = NULL;
-	dns_fixedname_t fname, fnextname, fprevname, fzonecut;
-	dns_name_t *name, *nextname, *prevname, *zonecut;
+	dns_fixedname_t fname, fnextname, fzonecut;
+	dns_name_t *name, *nextname, *zonecut;
 	dns_rdata_dnskey_t dnskey;
 	dns_rdata_t rdata = DNS_RDATA_INIT;
 	dns_rdataset_t keyset, soaset;
@@ -1518,7 +1880,8 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 	isc_boolean_t first = ISC_TRUE;
 	isc_boolean_t goodksk = ISC_FALSE;
 	isc_boolean_t goodzsk = ISC_FALSE;
-	isc_result_t result, vresult = ISC_R_UNSET;
+	isc_result_t result;
+	unsigned int n;
 	unsigned char revoked_ksk[256];
 	unsigned char revoked_zsk[256];
 	unsigned char standby_ksk[256];
@@ -1711,15 +2074,60 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 
 	/*
 	 * Check that all the other records were signed by keys that are
-	 * present in the DNSKEY RRSET.
+	 * present in the DNSKEY RRSET.  The iteration, which also works
+	 * out the delegations and the next name of each node, stays
+	 * here; the nodes are verified in batches by worker tasks.
 	 */
 
+	v.mctx = mctx;
+	v.db = db;
+	v.ver = ver;
+	v.origin = origin;
+	v.keyset = &keyset;
+	v.nsecset = &nsecset;
+	v.nsec3paramset = &nsec3paramset;
+	v.act_algorithms = act_algorithms;
+	v.bad_algorithms = bad_algorithms;
+	v.result = ISC_R_SUCCESS;
+	v.nodes = 0;
+	v.rrsets = 0;
+	v.taskmgr = NULL;
+	v.tasks = NULL;
+	v.nexttask = 0;
+	ISC_LIST_INIT(v.batches);
+	v.nbatches = 0;
+	RUNTIME_CHECK(isc_mutex_init(&v.lock) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_condition_init(&v.cond) == ISC_R_SUCCESS);
+
+	if (ntasks == 0)
+		ntasks = isc_os_ncpus();
+#ifndef ISC_PLATFORM_USETHREADS
+	ntasks = 1;
+#endif
+	v.ntasks = ntasks;
+	if (ntasks > 1) {
+		result = isc_taskmgr_create(mctx, ntasks, 0, &v.taskmgr);
+		if (result != ISC_R_SUCCESS)
+			fatal("failed to create task manager: %s",
+			      isc_result_totext(result));
+		v.tasks = isc_mem_get(mctx, ntasks * sizeof(isc_task_t *));
+		if (v.tasks == NULL)
+			fatal("out of memory");
+		for (n = 0; n < ntasks; n++) {
+			v.tasks[n] = NULL;
+			result = isc_task_create(v.taskmgr, 0, &v.tasks[n]);
+			if (result != ISC_R_SUCCESS)
+				fatal("failed to create task: %s",
+				      isc_result_totext(result));
+		}
+	}
+
+	TIME_NOW(&start);
+
 	dns_fixedname_init(&fname);
 	name = dns_fixedname_name(&fname);
 	dns_fixedname_init(&fnextname);
 	nextname = dns_fixedname_name(&fnextname);
-	dns_fixedname_init(&fprevname);
-	prevname = NULL;
 	dns_fixedname_init(&fzonecut);
 	zonecut = NULL;
 
@@ -1729,6 +2137,7 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 	result = dns_dbiterator_first(dbiter);
 	check_result(result, "dns_dbiterator_first()");
 
+	vb = newbatch(&v, ISC_FALSE, NULL);
 	while (!done) {
 		isc_boolean_t isdelegation = ISC_FALSE;
 
@@ -1778,44 +2187,63 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 		} else if (result != ISC_R_SUCCESS)
 			fatal("iterating through the database failed: %s",
 			      isc_result_totext(result));
-		result = verifynode(db, ver, origin, mctx, name, node,
-				    isdelegation, &keyset, act_algorithms,
-				    bad_algorithms, &nsecset, &nsec3paramset,
-				    nextname);
-		if (vresult == ISC_R_UNSET)
-			vresult = ISC_R_SUCCESS;
-		if (vresult == ISC_R_SUCCESS && result != ISC_R_SUCCESS)
-			vresult = result;
-		if (prevname != NULL) {
-			result = verifyemptynodes(db, ver, origin, mctx, name,
-						  prevname, isdelegation,
-						  &nsec3paramset);
-		} else
-			prevname = dns_fixedname_name(&fprevname);
-		dns_name_copy(name, prevname, NULL);
-		if (vresult == ISC_R_SUCCESS && result != ISC_R_SUCCESS)
-			vresult = result;
-		dns_db_detachnode(db, &node);
+		addnode(vb, name, &node, isdelegation);
+		if (done || vb->count == VERIFY_BATCHSIZE) {
+			dns_name_copy(nextname,
+				      dns_fixedname_name(&vb->fnextname),
+				      NULL);
+			result = dns_dbiterator_pause(dbiter);
+			check_result(result, "dns_dbiterator_pause()");
+			dispatch(&v, vb);
+			vb = newbatch(&v, ISC_FALSE, name);
+		}
 	}
-
 	dns_dbiterator_destroy(&dbiter);
+	dispatch(&v, vb);
 
 	result = dns_db_createiterator(db, DNS_DB_NSEC3ONLY, &dbiter);
 	check_result(result, "dns_db_createiterator()");
 
+	vb = newbatch(&v, ISC_TRUE, NULL);
 	for (result = dns_dbiterator_first(dbiter);
 	     result == ISC_R_SUCCESS;
 	     result = dns_dbiterator_next(dbiter) ) {
 		result = dns_dbiterator_current(dbiter, &node, name);
 		check_dns_dbiterator_current(result);
-		result = verifynode(db, ver, origin, mctx, name, node,
-				    ISC_FALSE, &keyset, act_algorithms,
-				    bad_algorithms, NULL, NULL, NULL);
-		check_result(result, "verifynode");
-		record_found(db, ver, mctx, name, node, &nsec3paramset);
-		dns_db_detachnode(db, &node);
+		addnode(vb, name, &node, ISC_FALSE);
+		if (vb->count == VERIFY_BATCHSIZE) {
+			result = dns_dbiterator_pause(dbiter);
+			check_result(result, "dns_dbiterator_pause()");
+			dispatch(&v, vb);
+			vb = newbatch(&v, ISC_TRUE, NULL);
+		}
 	}
 	dns_dbiterator_destroy(&dbiter);
+	dispatch(&v, vb);
+
+	mergebatches(&v, ISC_TRUE);
+	if (v.taskmgr != NULL) {
+		for (n = 0; n < ntasks; n++)
+			isc_task_detach(&v.tasks[n]);
+		isc_taskmgr_destroy(&v.taskmgr);
+		isc_mem_put(mctx, v.tasks, ntasks * sizeof(isc_task_t *));
+	}
+	DESTROYLOCK(&v.lock);
+	(void)isc_condition_destroy(&v.cond);
+
+	TIME_NOW(&finish);
+	time_us = isc_time_microdiff(&finish, &start);
+	time_ms = time_us / 1000;
+	fprintf(stderr, "Verified %" ISC_PRINT_QUADFORMAT "u nodes, "
+		"%" ISC_PRINT_QUADFORMAT "u RRsets in %u.%03u seconds "
+		"using %u %s",
+		v.nodes, v.rrsets, (unsigned int) (time_ms / 1000),
+		(unsigned int) (time_ms % 1000), ntasks,
+		ntasks == 1 ? "task" : "tasks");
+	if (time_us > 0)
+		fprintf(stderr, " (%" ISC_PRINT_QUADFORMAT "u RRsets/sec)",
+			(v.rrsets * 1000000) / time_us);
+	fprintf(stderr, ".\n");
 
 	dns_rdataset_disassociate(&keyset);
 	if (dns_rdataset_isassociated(&nsecset))
@@ -1824,10 +2252,8 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 		dns_rdataset_disassociate(&nsec3paramset);
 
 	result = verify_nsec3_chains(mctx);
-	if (vresult == ISC_R_UNSET)
-		vresult = ISC_R_SUCCESS;
-	if (result != ISC_R_SUCCESS && vresult == ISC_R_SUCCESS)
-		vresult = result;
+	if (result != ISC_R_SUCCESS && v.result == ISC_R_SUCCESS)
+		v.result = result;
 	isc_heap_destroy(&expected_chains);
 	isc_heap_destroy(&found_chains);
 
@@ -1850,9 +2276,9 @@ verifyzone(dns_db_t *db, dns_dbversion_t *ver,
 		fatal("DNSSEC completeness test failed.");
 	}
 
-	if (vresult != ISC_R_SUCCESS)
+	if (v.result != ISC_R_SUCCESS)
 		fatal("DNSSEC completeness test failed (%s).",
-		      dns_result_totext(vresult));
+		      dns_result_totext(v.result));
 
 	if (goodksk || ignore_kskflag) {
 		/*
@@ -88,7 +88,12 @@ options {\n\
 	nta-recheck 300;\n\
 #	pid-file \"" NAMED_LOCALSTATEDIR "/run/named/named.pid\"; \n\
 	port 53;\n\
-	prefetch 2 9;\n"
+	prefetch 2 9;\n\
+	prefetch-popular 0 10;\n\
+	querylog-async no;\n\
+	querylog-buffer-size 1M;\n\
+#	querylog-file <none>;\n\
+	querylog-format text;\n"
 #if defined(ISC_PLATFORM_CRYPTORANDOM)
 "	random-device none;\n"
 #elif defined(PATH_RANDOMDEV)
@@ -102,6 +107,7 @@ options {\n\
 	secroots-file \"named.secroots\";\n\
 	send-cookie true;\n\
 #	serial-queries <obsolete>;\n\
+	serial-query-batch 1;\n\
 	serial-query-rate 20;\n\
 	server-id none;\n\
 	session-keyalg hmac-sha256;\n\
@@ -123,6 +129,8 @@ options {\n\
 #	tkey-domain <none>\n\
 #	tkey-gssapi-credential <none>\n\
 	transfer-message-size 20480;\n\
+	transfer-render-max-size 64M;\n\
+	transfer-render-threads 0;\n\
 	transfers-in 10;\n\
 	transfers-out 10;\n\
 	transfers-per-ns 2;\n\
@@ -160,6 +168,7 @@ options {\n\
 	fetch-quota-params 100 0.1 0.3 0.7;\n\
 	fetches-per-server 0;\n\
 	fetches-per-zone 0;\n\
+	fetches-per-zone-queue 0;\n\
 	filter-aaaa-on-v4 no;\n\
 	filter-aaaa-on-v6 no;\n\
 	filter-aaaa { any; };\n"
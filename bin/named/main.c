@@ -109,6 +109,8 @@ LIBISC_EXTERNAL_DATA extern int isc_dscp_check_value;
 LIBDNS_EXTERNAL_DATA extern unsigned int dns_zone_mkey_hour;
 LIBDNS_EXTERNAL_DATA extern unsigned int dns_zone_mkey_day;
 LIBDNS_EXTERNAL_DATA extern unsigned int dns_zone_mkey_month;
+LIBDNS_EXTERNAL_DATA extern unsigned int dns_zone_compactdelay;
+LIBDNS_EXTERNAL_DATA extern unsigned int dns_xfrin_applydelay;
 
 static isc_boolean_t	want_stats = ISC_FALSE;
 static char		program_name[ISC_DIR_NAMEMAX] = "named";
@@ -322,7 +324,7 @@ library_unexpected_error(const char *file, int line, const char *format,
 static void
 usage(void) {
 	fprintf(stderr,
-		"usage: named [-4|-6] [-c conffile] [-d debuglevel] "
+		"usage: named [-4|-6] [-a] [-c conffile] [-d debuglevel] "
 		"[-E engine] [-f|-g]\n"
 		"             [-n number_of_cpus] [-p port] [-s] "
 		"[-S sockets] [-t chrootdir]\n"
@@ -502,6 +504,9 @@ parse_command_line(int argc, char *argv[]) {
 			isc_net_disableipv4();
 			disable4 = ISC_TRUE;
 			break;
+		case 'a':
+			isc_os_affinity = ISC_TRUE;
+			break;
 		case 'A':
 			parse_fuzz_arg();
 			break;
@@ -570,10 +575,15 @@ parse_command_line(int argc, char *argv[]) {
 			 *
 			 * clienttest: make clients single shot with their
 			 * 	       own memory context.
+			 * compactdelay=x: hold background journal
+			 *	       compactions for x seconds.
 			 * delay=xxxx: delay client responses by xxxx ms to
 			 *	       simulate remote servers.
 			 * dscp=x:     check that dscp values are as
 			 * 	       expected and assert otherwise.
+			 * xfrinapplydelay=x: report each batch of
+			 *	       incoming IXFR changes as applied x ms
+			 *	       late.
 			 */
 			if (!strcmp(isc_commandline_argument, "clienttest"))
 				clienttest = ISC_TRUE;
@@ -635,6 +645,16 @@ parse_command_line(int argc, char *argv[]) {
 				dns_zone_mkey_month = atoi(p);
 				if (dns_zone_mkey_month < dns_zone_mkey_day)
 					named_main_earlyfatal("bad mkeytimer");
+			} else if (!strncmp(isc_commandline_argument,
+					    "compactdelay=", 13))
+			{
+				dns_zone_compactdelay =
+					   atoi(isc_commandline_argument + 13);
+			} else if (!strncmp(isc_commandline_argument,
+					    "xfrinapplydelay=", 16))
+			{
+				dns_xfrin_applydelay =
+					   atoi(isc_commandline_argument + 16);
 			} else if (!strcmp(isc_commandline_argument, "notcp"))
 				notcp = ISC_TRUE;
 			else if (!strncmp(isc_commandline_argument, "tat=", 4))
@@ -789,6 +809,14 @@ create_managers(void) {
 		      named_g_cpus_detected,
 		      named_g_cpus_detected == 1 ? "" : "s",
 		      named_g_cpus, named_g_cpus == 1 ? "" : "s");
+	if (isc_os_affinity) {
+		unsigned int nodes = isc_os_numanodes();
+
+		isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
+			      NAMED_LOGMODULE_SERVER, ISC_LOG_INFO,
+			      "binding threads to CPUs on %u NUMA node%s",
+			      nodes, nodes == 1 ? "" : "s");
+	}
 #else
 	named_g_cpus = 1;
 #endif
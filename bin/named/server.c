@@ -104,6 +104,8 @@
 #include <ns/client.h>
 #include <ns/listenlist.h>
 #include <ns/interfacemgr.h>
+#include <ns/querylog.h>
+#include <ns/tls.h>
 
 #include <named/config.h>
 #include <named/control.h>
@@ -4938,6 +4940,12 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 					      dns_quotatype_zone, r);
 	}
 
+	obj = NULL;
+	result = named_config_get(maps, "fetches-per-zone-queue", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	dns_resolver_setfetchesperzonequeue(view->resolver,
+					    cfg_obj_asuint32(obj));
+
 	obj = NULL;
 	result = named_config_get(maps, "filter-aaaa-on-v4", &obj);
 	INSIST(result == ISC_R_SUCCESS);
@@ -5002,6 +5010,36 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 			view->prefetch_eligible = view->prefetch_trigger + 6;
 	}
 
+	obj = NULL;
+	result = named_config_get(maps, "prefetch-popular", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	if (cfg_obj_asuint32(cfg_tuple_get(obj, "names")) != 0) {
+		const cfg_obj_t *names, *rate;
+
+		names = cfg_tuple_get(obj, "names");
+		rate = cfg_tuple_get(obj, "rate");
+		if (cfg_obj_isvoid(rate)) {
+			int m;
+			for (m = 1; maps[m] != NULL; m++) {
+				obj = NULL;
+				result = named_config_get(&maps[m],
+						       "prefetch-popular",
+						       &obj);
+				INSIST(result == ISC_R_SUCCESS);
+				rate = cfg_tuple_get(obj, "rate");
+				if (cfg_obj_isuint32(rate))
+					break;
+			}
+			INSIST(cfg_obj_isuint32(rate));
+		}
+		if (cfg_obj_asuint32(rate) != 0)
+			CHECK(dns_view_inithotcache(view,
+						    cfg_obj_asuint32(names),
+						    cfg_obj_asuint32(rate),
+						    named_g_taskmgr,
+						    named_g_timermgr));
+	}
+
 	obj = NULL;
 	result = named_config_get(maps, "dnssec-enable", &obj);
 	INSIST(result == ISC_R_SUCCESS);
@@ -7736,12 +7774,14 @@ load_configuration(const char *filename, named_server_t *server,
 	isc_uint32_t reserved;
 	isc_uint32_t udpsize;
 	isc_uint32_t transfer_message_size;
+	isc_uint32_t transfer_render_threads;
 	named_cache_t *nsc;
 	named_cachelist_t cachelist, tmpcachelist;
 	ns_altsecret_t *altsecret;
 	ns_altsecretlist_t altsecrets, tmpaltsecrets;
 	unsigned int maxsocks;
 	isc_uint32_t softquota = 0;
+	int recursionmax;
 	unsigned int initial, idle, keepalive, advertised;
 	dns_aclenv_t *env =
 		ns_interfacemgr_getaclenv(named_g_server->interfacemgr);
@@ -7935,20 +7975,20 @@ load_configuration(const char *filename, named_server_t *server,
 	configure_server_quota(maps, "recursive-clients",
 			       &server->sctx->recursionquota);
 
-	if (server->sctx->recursionquota.max > 1000) {
+	recursionmax = isc_quota_getmax(&server->sctx->recursionquota);
+	if (recursionmax > 1000) {
 		int margin = ISC_MAX(100, named_g_cpus + 1);
-		if (margin > server->sctx->recursionquota.max - 100) {
+		if (margin > recursionmax - 100) {
 			isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
 				      NAMED_LOGMODULE_SERVER, ISC_LOG_ERROR,
 				      "'recursive-clients %d' too low when "
 				      "running with %d worker threads",
-				      server->sctx->recursionquota.max,
-				      named_g_cpus);
+				      recursionmax, named_g_cpus);
 			CHECK(ISC_R_RANGE);
 		}
-		softquota = server->sctx->recursionquota.max - margin;
+		softquota = recursionmax - margin;
 	} else {
-		softquota = (server->sctx->recursionquota.max * 90) / 100;
+		softquota = (recursionmax * 90) / 100;
 	}
 
 	isc_quota_soft(&server->sctx->recursionquota, softquota);
@@ -8139,6 +8179,27 @@ load_configuration(const char *filename, named_server_t *server,
 	server->sctx->transfer_tcp_message_size =
 		(isc_uint16_t) transfer_message_size;
 
+	/* Set the number of tasks rendering shared AXFR streams */
+	obj = NULL;
+	result = named_config_get(maps, "transfer-render-threads", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	transfer_render_threads = cfg_obj_asuint32(obj);
+	if (transfer_render_threads > 64) {
+		transfer_render_threads = 64;
+	}
+	server->sctx->transfer_render_threads = transfer_render_threads;
+
+	/* Set the largest zone whose transfers share a rendered stream */
+	obj = NULL;
+	result = named_config_get(maps, "transfer-render-max-size", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	if (cfg_obj_isstring(obj)) {
+		INSIST(strcasecmp(cfg_obj_asstring(obj), "unlimited") == 0);
+		server->sctx->transfer_render_maxsize = ISC_UINT64_MAX;
+	} else {
+		server->sctx->transfer_render_maxsize = cfg_obj_asuint64(obj);
+	}
+
 	/*
 	 * Configure the zone manager.
 	 */
@@ -8168,6 +8229,12 @@ load_configuration(const char *filename, named_server_t *server,
 	INSIST(result == ISC_R_SUCCESS);
 	dns_zonemgr_setserialqueryrate(server->zonemgr, cfg_obj_asuint32(obj));
 
+	obj = NULL;
+	result = named_config_get(maps, "serial-query-batch", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	dns_zonemgr_setserialquerybatch(server->zonemgr,
+					cfg_obj_asuint32(obj));
+
 	/*
 	 * Determine which port to use for listening for incoming connections.
 	 */
@@ -8749,6 +8816,51 @@ load_configuration(const char *filename, named_server_t *server,
 		}
 	}
 
+	/*
+	 * (Re)start the asynchronous query logger.  It is recreated
+	 * on every reconfiguration so that its file is reopened.
+	 */
+	if (server->sctx->querylog != NULL)
+		ns_querylog_destroy(&server->sctx->querylog);
+	obj = NULL;
+	result = named_config_get(maps, "querylog-async", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	if (cfg_obj_asboolean(obj)) {
+		ns_querylogformat_t qlformat = ns_querylogformat_text;
+		const char *qlfile = NULL;
+		isc_uint64_t qlsize;
+
+		obj = NULL;
+		if (named_config_get(maps, "querylog-file", &obj) ==
+		    ISC_R_SUCCESS)
+		{
+			qlfile = cfg_obj_asstring(obj);
+		}
+
+		obj = NULL;
+		result = named_config_get(maps, "querylog-format", &obj);
+		INSIST(result == ISC_R_SUCCESS);
+		if (strcasecmp(cfg_obj_asstring(obj), "compact") == 0)
+			qlformat = ns_querylogformat_compact;
+
+		obj = NULL;
+		result = named_config_get(maps, "querylog-buffer-size", &obj);
+		INSIST(result == ISC_R_SUCCESS);
+		qlsize = cfg_obj_asuint64(obj);
+
+		result = ns_querylog_create(named_g_mctx, qlfile, qlformat,
+					    (size_t)qlsize,
+					    &server->sctx->querylog);
+		if (result != ISC_R_SUCCESS) {
+			isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
+				      NAMED_LOGMODULE_SERVER, ISC_LOG_WARNING,
+				      "could not start asynchronous query "
+				      "logging: %s; logging queries "
+				      "synchronously",
+				      isc_result_totext(result));
+		}
+	}
+
 	obj = NULL;
 	if (options != NULL &&
 	    cfg_map_get(options, "memstatistics", &obj) == ISC_R_SUCCESS)
@@ -10255,6 +10367,57 @@ ns_listenlist_fromconfig(const cfg_obj_t *listenlist, const cfg_obj_t *config,
 	return (result);
 }
 
+/*
+ * Create a TLS context from the "tls" statement named by 'tlsobj'.
+ */
+static isc_result_t
+tlsctx_fromconfig(const cfg_obj_t *tlsobj, const cfg_obj_t *config,
+		  isc_mem_t *mctx, ns_tlsctx_t **ctxp)
+{
+	const cfg_obj_t *tlslist = NULL;
+	const cfg_obj_t *tls = NULL;
+	const cfg_obj_t *keyfile = NULL, *certfile = NULL, *tickets = NULL;
+	const cfg_listelt_t *element;
+	const char *name = cfg_obj_asstring(tlsobj);
+	isc_result_t result;
+
+	(void)cfg_map_get(config, "tls", &tlslist);
+	for (element = cfg_list_first(tlslist);
+	     element != NULL;
+	     element = cfg_list_next(element))
+	{
+		tls = cfg_listelt_value(element);
+		if (strcasecmp(cfg_obj_asstring(cfg_map_getname(tls)),
+			       name) == 0)
+			break;
+		tls = NULL;
+	}
+	if (tls == NULL) {
+		cfg_obj_log(tlsobj, named_g_lctx, ISC_LOG_ERROR,
+			    "tls '%s' is not defined", name);
+		return (ISC_R_NOTFOUND);
+	}
+
+	(void)cfg_map_get(tls, "key-file", &keyfile);
+	(void)cfg_map_get(tls, "cert-file", &certfile);
+	(void)cfg_map_get(tls, "session-tickets", &tickets);
+	if (keyfile == NULL || certfile == NULL) {
+		cfg_obj_log(tls, named_g_lctx, ISC_LOG_ERROR,
+			    "tls '%s': key-file and cert-file are required",
+			    name);
+		return (ISC_R_FAILURE);
+	}
+
+	result = ns_tlsctx_create(mctx, cfg_obj_asstring(keyfile),
+				  cfg_obj_asstring(certfile),
+				  tickets == NULL ? ISC_TRUE :
+				  cfg_obj_asboolean(tickets), ctxp);
+	if (result != ISC_R_SUCCESS)
+		cfg_obj_log(tls, named_g_lctx, ISC_LOG_ERROR,
+			    "tls '%s': %s", name, isc_result_totext(result));
+	return (result);
+}
+
 /*
  * Create a listen list from the corresponding configuration
  * data structure.
@@ -10265,15 +10428,19 @@ ns_listenelt_fromconfig(const cfg_obj_t *listener, const cfg_obj_t *config,
 			isc_uint16_t family, ns_listenelt_t **target)
 {
 	isc_result_t result;
-	const cfg_obj_t *portobj, *dscpobj;
+	const cfg_obj_t *portobj, *dscpobj, *tlsobj;
 	in_port_t port;
 	isc_dscp_t dscp = -1;
 	ns_listenelt_t *delt = NULL;
+	ns_tlsctx_t *tlsctx = NULL;
 	REQUIRE(target != NULL && *target == NULL);
 
+	tlsobj = cfg_tuple_get(listener, "tls");
 	portobj = cfg_tuple_get(listener, "port");
 	if (!cfg_obj_isuint32(portobj)) {
-		if (named_g_port != 0) {
+		if (cfg_obj_isstring(tlsobj)) {
+			port = 853;
+		} else if (named_g_port != 0) {
 			port = named_g_port;
 		} else {
 			result = named_config_getport(config, &port);
@@ -10303,9 +10470,19 @@ ns_listenelt_fromconfig(const cfg_obj_t *listener, const cfg_obj_t *config,
 		dscp = (isc_dscp_t)cfg_obj_asuint32(dscpobj);
 	}
 
+	if (cfg_obj_isstring(tlsobj)) {
+		result = tlsctx_fromconfig(tlsobj, config, mctx, &tlsctx);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+
 	result = ns_listenelt_create(mctx, port, dscp, NULL, &delt);
-	if (result != ISC_R_SUCCESS)
+	if (result != ISC_R_SUCCESS) {
+		if (tlsctx != NULL)
+			ns_tlsctx_detach(&tlsctx);
 		return (result);
+	}
+	delt->tlsctx = tlsctx;
 
 	result = cfg_acl_fromconfig2(cfg_tuple_get(listener, "acl"),
 				     config, named_g_lctx, actx, mctx, 0,
@@ -11144,7 +11321,7 @@ isc_result_t
 named_server_status(named_server_t *server, isc_buffer_t **text) {
 	isc_result_t result;
 	unsigned int zonecount, xferrunning, xferdeferred, soaqueries;
-	unsigned int automatic;
+	unsigned int automatic, soaqueued, soaprimaries;
 	const char *ob = "", *cb = "", *alt = "";
 	char boottime[ISC_FORMATHTTPTIMESTAMP_SIZE];
 	char configtime[ISC_FORMATHTTPTIMESTAMP_SIZE];
@@ -11167,6 +11344,8 @@ named_server_status(named_server_t *server, isc_buffer_t **text) {
 					  DNS_ZONESTATE_SOAQUERY);
 	automatic = dns_zonemgr_getcount(server->zonemgr,
 					 DNS_ZONESTATE_AUTOMATIC);
+	dns_zonemgr_getrefreshqueue(server->zonemgr, &soaqueued,
+				    &soaprimaries);
 
 	isc_time_formathttptimestamp(&named_g_boottime, boottime,
 				     sizeof(boottime));
@@ -11233,19 +11412,37 @@ named_server_status(named_server_t *server, isc_buffer_t **text) {
 		     soaqueries);
 	CHECK(putstr(text, line));
 
+	snprintf(line, sizeof(line), "soa queries queued: %u (%u masters)\n",
+		     soaqueued, soaprimaries);
+	CHECK(putstr(text, line));
+
 	snprintf(line, sizeof(line), "query logging is %s\n",
 		 ns_server_getoption(server->sctx, NS_SERVER_LOGQUERIES)
 		   ? "ON" : "OFF");
 	CHECK(putstr(text, line));
 
+	if (server->sctx->querylog != NULL) {
+		isc_uint64_t written, dropped;
+
+		ns_querylog_getcounters(server->sctx->querylog,
+					&written, &dropped);
+		snprintf(line, sizeof(line),
+			 "query log entries written/dropped: "
+			 "%" ISC_PRINT_QUADFORMAT "u/"
+			 "%" ISC_PRINT_QUADFORMAT "u\n",
+			 written, dropped);
+		CHECK(putstr(text, line));
+	}
+
 	snprintf(line, sizeof(line), "recursive clients: %d/%d/%d\n",
-		     server->sctx->recursionquota.used,
-		     server->sctx->recursionquota.soft,
-		     server->sctx->recursionquota.max);
+		     isc_quota_getused(&server->sctx->recursionquota),
+		     isc_quota_getsoft(&server->sctx->recursionquota),
+		     isc_quota_getmax(&server->sctx->recursionquota));
 	CHECK(putstr(text, line));
 
 	snprintf(line, sizeof(line), "tcp clients: %d/%d\n",
-		     server->sctx->tcpquota.used, server->sctx->tcpquota.max);
+		     isc_quota_getused(&server->sctx->tcpquota),
+		     isc_quota_getmax(&server->sctx->tcpquota));
 	CHECK(putstr(text, line));
 
 	CHECK(putstr(text, "server is up and running"));
@@ -311,6 +311,19 @@ init_desc(void) {
 		       "QryUsedStale");
 	SET_NSSTATDESC(prefetch, "queries triggered prefetch", "Prefetch");
 	SET_NSSTATDESC(keytagopt, "Keytag option received", "KeyTagOpt");
+	SET_NSSTATDESC(nsec3synth,
+		       "synthesized a negative response from NSEC3 records",
+		       "SynthNSEC3");
+	SET_NSSTATDESC(tlsconn, "TLS connections accepted", "TLSConn");
+	SET_NSSTATDESC(tlshandshake, "TLS handshakes completed",
+		       "TLSHandshake");
+	SET_NSSTATDESC(tlsresumed, "TLS sessions resumed", "TLSResumed");
+	SET_NSSTATDESC(tlshandshakefail, "TLS handshakes failed",
+		       "TLSHandshakeFail");
+	SET_NSSTATDESC(tlsrequest, "requests received over TLS", "TLSRequest");
+	SET_NSSTATDESC(tlsresponse, "responses sent over TLS", "TLSResponse");
+	SET_NSSTATDESC(remotenode, "requests handled on a remote NUMA node",
+		       "RemoteNode");
 	INSIST(i == ns_statscounter_max);
 
 	/* Initialize resolver statistics */
@@ -399,6 +412,27 @@ init_desc(void) {
 			"ServerQuota");
 	SET_RESSTATDESC(nextitem, "waited for next item", "NextItem");
 	SET_RESSTATDESC(priming, "priming queries", "Priming");
+	SET_RESSTATDESC(zonequeued, "queued due to zone quota", "ZoneQueued");
+	SET_RESSTATDESC(zonequeuedepth, "fetches waiting for zone quota",
+			"ZoneQueueDepth");
+	SET_RESSTATDESC(zonequeueexpired, "expired waiting for zone quota",
+			"ZoneQueueExpired");
+	SET_RESSTATDESC(zonequeuelat0, "zone quota waits < "
+			DNS_RESOLVER_QUEUELATCLASS0STR "ms",
+			"ZoneQueueWait" DNS_RESOLVER_QUEUELATCLASS0STR);
+	SET_RESSTATDESC(zonequeuelat1, "zone quota waits "
+			DNS_RESOLVER_QUEUELATCLASS0STR "-"
+			DNS_RESOLVER_QUEUELATCLASS1STR "ms",
+			"ZoneQueueWait" DNS_RESOLVER_QUEUELATCLASS1STR);
+	SET_RESSTATDESC(zonequeuelat2, "zone quota waits "
+			DNS_RESOLVER_QUEUELATCLASS1STR "-"
+			DNS_RESOLVER_QUEUELATCLASS2STR "ms",
+			"ZoneQueueWait" DNS_RESOLVER_QUEUELATCLASS2STR);
+	SET_RESSTATDESC(zonequeuelat3, "zone quota waits > "
+			DNS_RESOLVER_QUEUELATCLASS2STR "ms",
+			"ZoneQueueWait" DNS_RESOLVER_QUEUELATCLASS2STR "+");
+	SET_RESSTATDESC(hotrefresh, "popular names refreshed",
+			"HotRefresh");
 
 	INSIST(i == dns_resstatscounter_max);
 
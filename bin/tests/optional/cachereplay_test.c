@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * Replay a query stream against a size-limited cache database and report
+ * the hit rate.  This is used to measure the effect of changes to the
+ * cache eviction policy.
+ *
+ * The queries are read from a file of named query log lines ("query:
+ * <name> <class> <type> ...") or "<name> <type>" lines, or, if no file
+ * is given, generated from a Zipf distribution.  Every miss is answered
+ * by adding a synthetic RRset to the cache, as the resolver would.  The
+ * cost of each miss is weighted the way a refetch would be: delegation
+ * and DNSSEC key material count four times, secure data twice.
+ */
+
+#include <config.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <isc/buffer.h>
+#include <isc/commandline.h>
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/stats.h>
+#include <isc/string.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/rdatatype.h>
+#include <dns/result.h>
+#include <dns/stats.h>
+
+static isc_mem_t *mctx = NULL;
+static isc_mem_t *dbmctx = NULL;
+static dns_db_t *db = NULL;
+
+static unsigned int ttl = 300;
+static unsigned int qps = 1000;
+
+static isc_uint64_t queries, hits, misses;
+static isc_uint64_t misscost, totalcost;
+static isc_uint64_t evictlru, evictttl;
+
+static isc_uint32_t rndstate = 1;
+
+static isc_uint32_t
+rnd(void) {
+	/* xorshift32; reproducible for a given seed */
+	rndstate ^= rndstate << 13;
+	rndstate ^= rndstate >> 17;
+	rndstate ^= rndstate << 5;
+	return (rndstate);
+}
+
+static void
+water(void *arg, int mark) {
+	isc_boolean_t overmem = ISC_TF(mark == ISC_MEM_HIWATER);
+
+	UNUSED(arg);
+
+	dns_db_overmem(db, overmem);
+	isc_mem_waterack(dbmctx, mark);
+}
+
+static isc_boolean_t
+issecure(dns_rdatatype_t type) {
+	return (ISC_TF(type == dns_rdatatype_ds ||
+		       type == dns_rdatatype_dnskey));
+}
+
+static unsigned int
+cost(dns_rdatatype_t type, isc_boolean_t secure) {
+	unsigned int c = 1;
+
+	if (type == dns_rdatatype_ns || type == dns_rdatatype_ds ||
+	    type == dns_rdatatype_dnskey)
+		c = 4;
+	if (secure)
+		c *= 2;
+	return (c);
+}
+
+/*
+ * Add a synthetic answer for 'name'/'type' to the cache.
+ */
+static void
+answer(dns_name_t *name, dns_rdatatype_t type, isc_boolean_t secure,
+       isc_stdtime_t now)
+{
+	static unsigned char nsname[] = "\003ns1\007example\000";
+	unsigned char data[64];
+	dns_rdatalist_t rdatalist;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	isc_result_t result;
+
+	memset(data, 0x5a, sizeof(data));
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = type;
+	rdata.data = data;
+	switch (type) {
+	case dns_rdatatype_a:
+		rdata.length = 4;
+		break;
+	case dns_rdatatype_aaaa:
+		rdata.length = 16;
+		break;
+	case dns_rdatatype_ns:
+		rdata.data = nsname;
+		rdata.length = sizeof(nsname) - 1;
+		break;
+	case dns_rdatatype_ds:
+		rdata.length = 36;
+		break;
+	default:
+		rdata.length = 32;
+		break;
+	}
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = type;
+	rdatalist.ttl = ttl;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	RUNTIME_CHECK(dns_rdatalist_tordataset(&rdatalist, &rdataset)
+		      == ISC_R_SUCCESS);
+	rdataset.trust = secure ? dns_trust_secure : dns_trust_answer;
+
+	result = dns_db_findnode(db, name, ISC_TRUE, &node);
+	if (result == ISC_R_SUCCESS) {
+		(void)dns_db_addrdataset(db, node, NULL, now, &rdataset, 0,
+					 NULL);
+		dns_db_detachnode(db, &node);
+	}
+	dns_rdataset_disassociate(&rdataset);
+}
+
+static void
+query(dns_name_t *name, dns_rdatatype_t type, isc_stdtime_t now) {
+	dns_fixedname_t ffound;
+	dns_name_t *found;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	isc_boolean_t secure = issecure(type);
+	unsigned int c = cost(type, secure);
+	isc_result_t result;
+
+	dns_fixedname_init(&ffound);
+	found = dns_fixedname_name(&ffound);
+	dns_rdataset_init(&rdataset);
+
+	queries++;
+	totalcost += c;
+
+	result = dns_db_find(db, name, NULL, type, 0, now, &node, found,
+			     &rdataset, NULL);
+	if (result == DNS_R_DELEGATION && type == dns_rdatatype_ns &&
+	    dns_name_equal(name, found))
+		result = ISC_R_SUCCESS;
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	if (node != NULL)
+		dns_db_detachnode(db, &node);
+
+	if (result == ISC_R_SUCCESS) {
+		hits++;
+		return;
+	}
+
+	misses++;
+	misscost += c;
+	answer(name, type, secure, now);
+}
+
+/*
+ * Synthetic names: name 'rank' is queried for a type chosen so that the
+ * mix is roughly 70% A, 10% AAAA, 10% NS and 10% DS.
+ */
+static void
+synthetic(unsigned int rank, dns_name_t *name, dns_rdatatype_t *typep) {
+	char text[64];
+	isc_buffer_t b;
+
+	switch (rank % 10) {
+	case 7:
+		*typep = dns_rdatatype_aaaa;
+		break;
+	case 8:
+		*typep = dns_rdatatype_ns;
+		break;
+	case 9:
+		*typep = dns_rdatatype_ds;
+		break;
+	default:
+		*typep = dns_rdatatype_a;
+		break;
+	}
+	snprintf(text, sizeof(text), "n%u.d%u.example.", rank, rank % 997);
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	RUNTIME_CHECK(dns_name_fromtext(name, &b, dns_rootname, 0, NULL)
+		      == ISC_R_SUCCESS);
+}
+
+static isc_result_t
+parseline(char *line, dns_name_t *name, dns_rdatatype_t *typep) {
+	char *p, *qname, *tok, *last = NULL;
+	isc_textregion_t r;
+	isc_buffer_t b;
+	isc_result_t result;
+
+	p = strstr(line, "query: ");
+	if (p != NULL)
+		line = p + 7;
+
+	qname = strtok_r(line, " \t\r\n", &last);
+	if (qname == NULL)
+		return (ISC_R_NOTFOUND);
+	tok = strtok_r(NULL, " \t\r\n", &last);
+	if (tok != NULL && strcasecmp(tok, "IN") == 0)
+		tok = strtok_r(NULL, " \t\r\n", &last);
+	if (tok == NULL)
+		return (ISC_R_NOTFOUND);
+
+	r.base = tok;
+	r.length = strlen(tok);
+	result = dns_rdatatype_fromtext(typep, &r);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	isc_buffer_init(&b, qname, strlen(qname));
+	isc_buffer_add(&b, strlen(qname));
+	return (dns_name_fromtext(name, &b, dns_rootname, 0, NULL));
+}
+
+static void
+statsdump(isc_statscounter_t counter, isc_uint64_t value, void *arg) {
+	UNUSED(arg);
+
+	if (counter == dns_cachestatscounter_deletelru)
+		evictlru = value;
+	else if (counter == dns_cachestatscounter_deletettl)
+		evictttl = value;
+}
+
+static void
+usage(void) {
+	fprintf(stderr,
+		"usage: cachereplay_test [-m cachesize] [-t ttl] [-q qps] "
+		"[-n queries] [-u names] [-z exponent] [-r seed] "
+		"[querylog]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[]) {
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	dns_rdatatype_t type;
+	isc_stats_t *stats = NULL;
+	isc_stdtime_t start, now;
+	isc_time_t t0, t1;
+	size_t size = 4 * 1024 * 1024;
+	unsigned int nqueries = 1000000, nnames = 100000;
+	double exponent = 0.9;
+	double *cdf = NULL;
+	FILE *fp = NULL;
+	char line[1024];
+	unsigned int i;
+	int ch;
+
+	while ((ch = isc_commandline_parse(argc, argv, "m:n:q:r:t:u:z:"))
+	       != -1)
+	{
+		switch (ch) {
+		case 'm':
+			size = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'n':
+			nqueries = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'q':
+			qps = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'r':
+			rndstate = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 't':
+			ttl = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'u':
+			nnames = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'z':
+			exponent = strtod(isc_commandline_argument, NULL);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= isc_commandline_index;
+	argv += isc_commandline_index;
+	if (argc > 1 || qps == 0 || nnames == 0 || rndstate == 0)
+		usage();
+
+	if (argc == 1) {
+		fp = fopen(argv[0], "r");
+		if (fp == NULL) {
+			perror(argv[0]);
+			exit(1);
+		}
+	} else {
+		double sum = 0.0;
+
+		cdf = malloc(nnames * sizeof(double));
+		RUNTIME_CHECK(cdf != NULL);
+		for (i = 0; i < nnames; i++) {
+			sum += 1.0 / pow(i + 1, exponent);
+			cdf[i] = sum;
+		}
+		for (i = 0; i < nnames; i++)
+			cdf[i] /= sum;
+	}
+
+	dns_result_register();
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_mem_create(0, 0, &dbmctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_db_create(dbmctx, "rbt", dns_rootname,
+				    dns_dbtype_cache, dns_rdataclass_in,
+				    0, NULL, &db) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_stats_create(mctx, &stats,
+				       dns_cachestatscounter_max)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_db_setcachestats(db, stats) == ISC_R_SUCCESS);
+
+	/* The same watermarks as dns_cache_setcachesize(). */
+	if (size != 0)
+		isc_mem_setwater(dbmctx, water, NULL, size - (size >> 3),
+				 size - (size >> 2));
+
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	isc_stdtime_get(&start);
+	TIME_NOW(&t0);
+
+	for (i = 0; fp != NULL || i < nqueries; i++) {
+		now = start + i / qps;
+		if (fp != NULL) {
+			if (fgets(line, sizeof(line), fp) == NULL)
+				break;
+			if (parseline(line, name, &type) != ISC_R_SUCCESS)
+				continue;
+		} else {
+			double u = (double)rnd() / 4294967296.0;
+			unsigned int lo = 0, hi = nnames - 1;
+
+			while (lo < hi) {
+				unsigned int mid = (lo + hi) / 2;
+				if (cdf[mid] < u)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			synthetic(lo, name, &type);
+		}
+		query(name, type, now);
+	}
+
+	TIME_NOW(&t1);
+	isc_stats_dump(stats, statsdump, NULL, ISC_STATSDUMP_VERBOSE);
+
+	printf("queries:        %" ISC_PRINT_QUADFORMAT "u\n", queries);
+	printf("hits:           %" ISC_PRINT_QUADFORMAT "u (%.2f%%)\n",
+	       hits, queries != 0 ? 100.0 * hits / queries : 0.0);
+	printf("weighted miss:  %.2f%%\n",
+	       totalcost != 0 ? 100.0 * misscost / totalcost : 0.0);
+	printf("evicted (lru):  %" ISC_PRINT_QUADFORMAT "u\n", evictlru);
+	printf("evicted (ttl):  %" ISC_PRINT_QUADFORMAT "u\n", evictttl);
+	printf("memory:         %lu in use, %lu peak, %lu limit\n",
+	       (unsigned long)isc_mem_inuse(dbmctx),
+	       (unsigned long)isc_mem_maxinuse(dbmctx), (unsigned long)size);
+	printf("elapsed:        %.3fs\n",
+	       isc_time_microdiff(&t1, &t0) / 1000000.0);
+
+	if (fp != NULL)
+		fclose(fp);
+	free(cdf);
+	isc_mem_setwater(dbmctx, NULL, NULL, 0, 0);
+	dns_db_detach(&db);
+	isc_stats_detach(&stats);
+	isc_mem_destroy(&dbmctx);
+	isc_mem_destroy(&mctx);
+
+	return (0);
+}
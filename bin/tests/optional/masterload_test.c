@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * Time loading a large text zone file into a zone database with
+ * dns_master_loadfile6() using 1, 2, 4, ... up to -T threads, and
+ * report the speedup over a single thread.
+ *
+ * Unless a file is given with -f, a zone with -n delegations (each with
+ * NS, DS and glue records) plus an A and a TXT record per name is
+ * generated first.  With -p the records are only parsed and not added
+ * to a database, which shows how the parsing itself scales.
+ *
+ * When adding to a database the worker threads also build the
+ * database's copies of the rdatasets, but the calling thread links them
+ * into the tree one at a time.  The CPU time used by the calling thread
+ * is reported as well: it is the part of the load that does not get
+ * faster with more threads, and bounds the speedup that more CPUs could
+ * give.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <isc/commandline.h>
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/string.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/callbacks.h>
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/master.h>
+#include <dns/name.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+
+static isc_mem_t *mctx = NULL;
+static isc_uint64_t rdatasets;
+
+/*
+ * CPU seconds used by the calling thread so far, or a negative
+ * value if that cannot be measured here.
+ */
+static double
+threadcpu(void) {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		return (ts.tv_sec + ts.tv_nsec / 1000000000.0);
+#endif
+	return (-1.0);
+}
+
+static void
+generate(const char *file, unsigned int n) {
+	FILE *f;
+	unsigned int i;
+
+	f = fopen(file, "w");
+	if (f == NULL) {
+		perror(file);
+		exit(1);
+	}
+	fprintf(f, "$TTL 3600\n"
+		   "@\tIN SOA ns1 hostmaster (\n"
+		   "\t\t2018010100 ; serial\n"
+		   "\t\t3600 900 604800 300 )\n"
+		   "\tIN NS ns1\n"
+		   "ns1\tIN A 192.0.2.1\n");
+	for (i = 0; i < n; i++) {
+		fprintf(f, "name%u\tIN NS ns.name%u\n", i, i);
+		fprintf(f, "\tIN DS 12345 8 2 ( 49FD46E6C4B45C55D4AC69CBD3CD3440"
+			   "9FB9C6DD5E1F4DE2E6CE8D%010u )\n", i);
+		fprintf(f, "ns.name%u\tIN A 10.%u.%u.%u\n", i,
+			(i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+		fprintf(f, "www%u\t300 IN A 198.51.%u.%u\n", i,
+			(i >> 8) & 0xff, i & 0xff);
+		fprintf(f, "\tIN TXT \"v=spf1 ip4:198.51.100.0/24 -all\" "
+			   "; record %u\n", i);
+	}
+	if (fclose(f) != 0) {
+		perror(file);
+		exit(1);
+	}
+}
+
+static isc_result_t
+count_add(void *arg, const dns_name_t *owner, dns_rdataset_t *dataset) {
+	UNUSED(arg);
+	UNUSED(owner);
+	UNUSED(dataset);
+
+	rdatasets++;
+	return (ISC_R_SUCCESS);
+}
+
+static double
+load(const char *file, dns_name_t *origin, unsigned int threads,
+     isc_boolean_t parseonly, unsigned int *nodesp, double *serialp)
+{
+	dns_rdatacallbacks_t callbacks;
+	dns_db_t *db = NULL;
+	isc_time_t t0, t1;
+	isc_result_t result;
+	double cpu0;
+
+	dns_rdatacallbacks_init_stdio(&callbacks);
+	if (parseonly) {
+		callbacks.add = count_add;
+	} else {
+		RUNTIME_CHECK(dns_db_create(mctx, "rbt", origin,
+					    dns_dbtype_zone,
+					    dns_rdataclass_in, 0, NULL,
+					    &db) == ISC_R_SUCCESS);
+		RUNTIME_CHECK(dns_db_beginload(db, &callbacks)
+			      == ISC_R_SUCCESS);
+	}
+	rdatasets = 0;
+
+	cpu0 = threadcpu();
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	result = dns_master_loadfile6(file, origin, origin,
+				      dns_rdataclass_in, DNS_MASTER_ZONE, 0,
+				      &callbacks, NULL, NULL, mctx,
+				      dns_masterformat_text, 0, threads);
+	if (db != NULL && result == ISC_R_SUCCESS)
+		result = dns_db_endload(db, &callbacks);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	*serialp = (cpu0 < 0.0) ? -1.0 : threadcpu() - cpu0;
+	if (result != ISC_R_SUCCESS) {
+		fprintf(stderr, "loading %s: %s\n", file,
+			isc_result_totext(result));
+		exit(1);
+	}
+
+	if (db != NULL) {
+		*nodesp = dns_db_nodecount(db);
+		dns_db_detach(&db);
+	} else
+		*nodesp = (unsigned int)rdatasets;
+
+	return (isc_time_microdiff(&t1, &t0) / 1000000.0);
+}
+
+static void
+usage(void) {
+	fprintf(stderr,
+		"usage: masterload_test [-p] [-f file] [-n names] "
+		"[-o origin] [-T threads]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[]) {
+	dns_fixedname_t forigin;
+	dns_name_t *origin;
+	isc_buffer_t b;
+	const char *file = NULL, *origintext = "example.";
+	char tmpfile[] = "masterload.XXXXXX";
+	isc_boolean_t parseonly = ISC_FALSE;
+	unsigned int names = 200000, maxthreads = 8;
+	unsigned int threads, nodes, nodes1 = 0;
+	double secs, secs1 = 0.0, serial;
+	int ch, fd;
+
+	while ((ch = isc_commandline_parse(argc, argv, "f:n:o:pT:")) != -1) {
+		switch (ch) {
+		case 'f':
+			file = isc_commandline_argument;
+			break;
+		case 'n':
+			names = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'o':
+			origintext = isc_commandline_argument;
+			break;
+		case 'p':
+			parseonly = ISC_TRUE;
+			break;
+		case 'T':
+			maxthreads = strtoul(isc_commandline_argument,
+					     NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= isc_commandline_index;
+	if (argc != 0 || maxthreads == 0)
+		usage();
+
+	dns_result_register();
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+
+	dns_fixedname_init(&forigin);
+	origin = dns_fixedname_name(&forigin);
+	isc_buffer_constinit(&b, origintext, strlen(origintext));
+	isc_buffer_add(&b, strlen(origintext));
+	if (dns_name_fromtext(origin, &b, dns_rootname, 0, NULL)
+	    != ISC_R_SUCCESS)
+		usage();
+
+	if (file == NULL) {
+		fd = mkstemp(tmpfile);
+		if (fd < 0) {
+			perror(tmpfile);
+			exit(1);
+		}
+		close(fd);
+		generate(tmpfile, names);
+		file = tmpfile;
+	}
+
+	for (threads = 1; threads <= maxthreads; threads *= 2) {
+		secs = load(file, origin, threads, parseonly, &nodes,
+			    &serial);
+		if (threads == 1) {
+			secs1 = secs;
+			nodes1 = nodes;
+		}
+		printf("%u thread%s: %.3fs, %u %s, speedup %.2f\n", threads,
+		       (threads == 1) ? "" : "s", secs, nodes,
+		       parseonly ? "rdatasets" : "nodes", secs1 / secs);
+		if (threads > 1 && serial > 0.0)
+			printf("\tcalling thread: %.3fs CPU, "
+			       "speedup bound %.2f\n", serial, secs1 / serial);
+		if (nodes != nodes1) {
+			fprintf(stderr, "mismatch: %u != %u\n", nodes, nodes1);
+			exit(1);
+		}
+	}
+
+	if (file == tmpfile)
+		unlink(tmpfile);
+	isc_mem_destroy(&mctx);
+	return (0);
+}
@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * Replay a random-subdomain query stream for a synthetic NSEC3-signed
+ * zone against a cache database, and report how many of the queries
+ * still need an upstream fetch when negative answers are synthesized
+ * from the cached NSEC3 records (as with "synth-from-dnssec yes;").
+ *
+ * Most queries are for random labels directly below the zone apex or
+ * below one of its names; the rest (-x percent) ask for a type that an
+ * existing name does not have.  Every query that can't be answered by
+ * dns_nsec3_findproof() is counted as a fetch and answered by adding
+ * the NSEC3 records the authoritative server would have returned to the
+ * cache, as the resolver would after validating them.  With -S no
+ * synthesis is attempted, which is the behaviour for NSEC3 zones before
+ * aggressive negative caching supported them: every query is a fetch.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <isc/buffer.h>
+#include <isc/commandline.h>
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/string.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/nsec3.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/rdatastruct.h>
+#include <dns/result.h>
+
+typedef struct entry {
+	unsigned char		hash[NSEC3_MAX_HASH_LENGTH];
+	size_t			length;
+	isc_boolean_t		apex;
+	dns_fixedname_t		owner;
+} entry_t;
+
+static isc_mem_t *mctx = NULL;
+static dns_db_t *db = NULL;
+static dns_fixedname_t fzone;
+static dns_name_t *zone;
+static entry_t *entries = NULL;
+static unsigned int nentries;
+
+static unsigned char salt[] = { 0xaa, 0xbb, 0xcc, 0xdd };
+static unsigned int iterations = 10;
+static unsigned int ttl = 3600;
+static unsigned int qps = 1000;
+
+static isc_uint64_t queries, fetches, nxdomain, nodata;
+
+static isc_uint32_t rndstate = 1;
+
+static isc_uint32_t
+rnd(void) {
+	/* xorshift32; reproducible for a given seed */
+	rndstate ^= rndstate << 13;
+	rndstate ^= rndstate >> 17;
+	rndstate ^= rndstate << 5;
+	return (rndstate);
+}
+
+static void
+nolog(void *arg, int level, const char *fmt, ...) {
+	UNUSED(arg);
+	UNUSED(level);
+	UNUSED(fmt);
+}
+
+static void
+makename(const char *text, const dns_name_t *origin, dns_name_t *name) {
+	isc_buffer_t b;
+
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	RUNTIME_CHECK(dns_name_fromtext(name, &b, origin, 0, NULL)
+		      == ISC_R_SUCCESS);
+}
+
+static void
+hashname(const dns_name_t *name, unsigned char *hash, size_t *lengthp,
+	 dns_fixedname_t *owner)
+{
+	dns_fixedname_t fixed;
+
+	if (owner == NULL)
+		owner = &fixed;
+	RUNTIME_CHECK(dns_nsec3_hashname(owner, hash, lengthp, name, zone,
+					 dns_hash_sha1, iterations,
+					 salt, sizeof(salt)) == ISC_R_SUCCESS);
+}
+
+static int
+entrycmp(const void *a, const void *b) {
+	const entry_t *ea = a, *eb = b;
+
+	return (memcmp(ea->hash, eb->hash, ea->length));
+}
+
+/*
+ * Return the index of the NSEC3 record matching or covering 'hash'.
+ */
+static unsigned int
+lookup(const unsigned char *hash, size_t length) {
+	unsigned int lo = 0, hi = nentries;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (memcmp(entries[mid].hash, hash, length) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo == 0 ? nentries - 1 : lo - 1);
+}
+
+static void
+addrdata(const dns_name_t *owner, dns_rdata_t *rdata, isc_stdtime_t now) {
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = rdata->type;
+	if (rdata->type == dns_rdatatype_rrsig)
+		rdatalist.covers = dns_rdatatype_nsec3;
+	rdatalist.ttl = ttl;
+	ISC_LIST_APPEND(rdatalist.rdata, rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	RUNTIME_CHECK(dns_rdatalist_tordataset(&rdatalist, &rdataset)
+		      == ISC_R_SUCCESS);
+	rdataset.trust = dns_trust_secure;
+
+	RUNTIME_CHECK(dns_db_findnode(db, owner, ISC_TRUE, &node)
+		      == ISC_R_SUCCESS);
+	(void)dns_db_addrdataset(db, node, NULL, now, &rdataset, 0, NULL);
+	dns_db_detachnode(db, &node);
+	dns_rdataset_disassociate(&rdataset);
+}
+
+/*
+ * Add the signed NSEC3 record for entry 'i' to the cache.
+ */
+static void
+addnsec3(unsigned int i, isc_stdtime_t now) {
+	/* Window 0: A NS SOA | RRSIG | DNSKEY NSEC3PARAM */
+	static unsigned char apexbits[] = {
+		0, 7, 0x62, 0, 0, 0, 0, 0x02, 0x90
+	};
+	static unsigned char namebits[] = { 0, 6, 0x40, 0, 0, 0, 0, 0x02 };
+	unsigned char buf[DNS_NSEC3_BUFFERSIZE], sigbuf[512], sig[128];
+	dns_rdata_t rdata = DNS_RDATA_INIT, sigrdata = DNS_RDATA_INIT;
+	dns_rdata_nsec3_t nsec3;
+	dns_rdata_rrsig_t rrsig;
+	entry_t *e = &entries[i];
+	isc_buffer_t b;
+
+	nsec3.common.rdclass = dns_rdataclass_in;
+	nsec3.common.rdtype = dns_rdatatype_nsec3;
+	ISC_LINK_INIT(&nsec3.common, link);
+	nsec3.mctx = NULL;
+	nsec3.hash = dns_hash_sha1;
+	nsec3.flags = 0;
+	nsec3.iterations = iterations;
+	nsec3.salt_length = sizeof(salt);
+	nsec3.salt = salt;
+	nsec3.next_length = (unsigned char)e->length;
+	nsec3.next = entries[(i + 1) % nentries].hash;
+	nsec3.typebits = e->apex ? apexbits : namebits;
+	nsec3.len = e->apex ? sizeof(apexbits) : sizeof(namebits);
+	isc_buffer_init(&b, buf, sizeof(buf));
+	RUNTIME_CHECK(dns_rdata_fromstruct(&rdata, dns_rdataclass_in,
+					   dns_rdatatype_nsec3, &nsec3, &b)
+		      == ISC_R_SUCCESS);
+
+	memset(sig, 0x5a, sizeof(sig));
+	rrsig.common.rdclass = dns_rdataclass_in;
+	rrsig.common.rdtype = dns_rdatatype_rrsig;
+	ISC_LINK_INIT(&rrsig.common, link);
+	rrsig.mctx = NULL;
+	rrsig.covered = dns_rdatatype_nsec3;
+	rrsig.algorithm = 8;
+	rrsig.labels = dns_name_countlabels(zone);
+	rrsig.originalttl = ttl;
+	rrsig.timesigned = now;
+	rrsig.timeexpire = now + 30 * 86400;
+	rrsig.keyid = 12345;
+	dns_name_init(&rrsig.signer, NULL);
+	dns_name_clone(zone, &rrsig.signer);
+	rrsig.siglen = sizeof(sig);
+	rrsig.signature = sig;
+	isc_buffer_init(&b, sigbuf, sizeof(sigbuf));
+	RUNTIME_CHECK(dns_rdata_fromstruct(&sigrdata, dns_rdataclass_in,
+					   dns_rdatatype_rrsig, &rrsig, &b)
+		      == ISC_R_SUCCESS);
+
+	addrdata(dns_fixedname_name(&e->owner), &rdata, now);
+	addrdata(dns_fixedname_name(&e->owner), &sigrdata, now);
+}
+
+/*
+ * Answer a query for 'name' which was not synthesized, as an
+ * authoritative server would.  'encloser' is the closest existing
+ * ancestor of 'name', or 'name' itself if it exists.
+ */
+static void
+fetch(const dns_name_t *name, const dns_name_t *encloser, isc_stdtime_t now)
+{
+	unsigned char hash[NSEC3_MAX_HASH_LENGTH];
+	dns_fixedname_t fnext, fwild;
+	dns_name_t *next, *wild;
+	size_t length;
+	unsigned int labels;
+
+	fetches++;
+
+	hashname(encloser, hash, &length, NULL);
+	addnsec3(lookup(hash, length), now);
+	if (dns_name_equal(name, encloser))
+		return;
+
+	dns_fixedname_init(&fnext);
+	next = dns_fixedname_name(&fnext);
+	labels = dns_name_countlabels(encloser) + 1;
+	dns_name_split(name, labels, NULL, next);
+	hashname(next, hash, &length, NULL);
+	addnsec3(lookup(hash, length), now);
+
+	dns_fixedname_init(&fwild);
+	wild = dns_fixedname_name(&fwild);
+	RUNTIME_CHECK(dns_name_concatenate(dns_wildcardname, encloser, wild,
+					   NULL) == ISC_R_SUCCESS);
+	hashname(wild, hash, &length, NULL);
+	addnsec3(lookup(hash, length), now);
+}
+
+static void
+usage(void) {
+	fprintf(stderr,
+		"usage: nsec3synth_test [-S] [-i iterations] [-n queries] "
+		"[-q qps] [-r seed] [-t ttl] [-u names] [-x nodata%%]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[]) {
+	dns_fixedname_t fname, fencloser;
+	dns_name_t *name, *encloser;
+	dns_nsec3proof_t proof;
+	dns_rdatatype_t type;
+	isc_stdtime_t start, now;
+	isc_time_t t0, t1;
+	isc_boolean_t synth = ISC_TRUE;
+	unsigned int nqueries = 1000000, nnames = 10000, nodatapct = 10;
+	unsigned int i;
+	char text[64];
+	isc_result_t result;
+	int ch;
+
+	while ((ch = isc_commandline_parse(argc, argv, "Si:n:q:r:t:u:x:"))
+	       != -1)
+	{
+		switch (ch) {
+		case 'S':
+			synth = ISC_FALSE;
+			break;
+		case 'i':
+			iterations = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'n':
+			nqueries = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'q':
+			qps = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'r':
+			rndstate = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 't':
+			ttl = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'u':
+			nnames = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'x':
+			nodatapct = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= isc_commandline_index;
+	if (argc != 0 || qps == 0 || nnames == 0 || rndstate == 0 ||
+	    nodatapct > 100)
+		usage();
+
+	dns_result_register();
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_db_create(mctx, "rbt", dns_rootname,
+				    dns_dbtype_cache, dns_rdataclass_in,
+				    0, NULL, &db) == ISC_R_SUCCESS);
+
+	dns_fixedname_init(&fzone);
+	zone = dns_fixedname_name(&fzone);
+	makename("example.", dns_rootname, zone);
+
+	/*
+	 * The zone holds its apex and the names n0 ... n<nnames - 1>.
+	 */
+	nentries = nnames + 1;
+	entries = malloc(nentries * sizeof(*entries));
+	RUNTIME_CHECK(entries != NULL);
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	for (i = 0; i < nentries; i++) {
+		entry_t *e = &entries[i];
+
+		if (i == nnames) {
+			dns_name_copy(zone, name, NULL);
+		} else {
+			snprintf(text, sizeof(text), "n%u", i);
+			makename(text, zone, name);
+		}
+		e->apex = ISC_TF(i == nnames);
+		dns_fixedname_init(&e->owner);
+		hashname(name, e->hash, &e->length, &e->owner);
+	}
+	qsort(entries, nentries, sizeof(*entries), entrycmp);
+
+	dns_fixedname_init(&fencloser);
+	encloser = dns_fixedname_name(&fencloser);
+	isc_stdtime_get(&start);
+	TIME_NOW(&t0);
+
+	for (i = 0; i < nqueries; i++) {
+		isc_uint32_t r = rnd();
+		unsigned int n = rnd() % nnames;
+
+		now = start + i / qps;
+		type = dns_rdatatype_a;
+		snprintf(text, sizeof(text), "n%u", n);
+		makename(text, zone, encloser);
+		if (r % 100 < nodatapct) {
+			/* An existing name without TXT records. */
+			type = dns_rdatatype_txt;
+			dns_name_copy(encloser, name, NULL);
+		} else if (r % 100 < nodatapct + (100 - nodatapct) / 4) {
+			snprintf(text, sizeof(text), "r%08x", rnd());
+			makename(text, encloser, name);
+		} else {
+			dns_name_copy(zone, encloser, NULL);
+			snprintf(text, sizeof(text), "r%08x", rnd());
+			makename(text, zone, name);
+		}
+
+		queries++;
+		if (synth) {
+			dns_nsec3proof_init(&proof);
+			result = dns_nsec3_findproof(db, zone, name, type, now,
+						     &proof, nolog, NULL);
+			if (result == ISC_R_SUCCESS) {
+				if (proof.exists)
+					nodata++;
+				else
+					nxdomain++;
+				dns_nsec3proof_invalidate(&proof);
+				continue;
+			}
+		}
+		fetch(name, encloser, now);
+	}
+
+	TIME_NOW(&t1);
+
+	printf("queries:        %" ISC_PRINT_QUADFORMAT "u\n", queries);
+	printf("fetches:        %" ISC_PRINT_QUADFORMAT "u (%.2f%%)\n",
+	       fetches, queries != 0 ? 100.0 * fetches / queries : 0.0);
+	printf("synthesized:    %" ISC_PRINT_QUADFORMAT "u NXDOMAIN, %"
+	       ISC_PRINT_QUADFORMAT "u NODATA\n", nxdomain, nodata);
+	printf("memory:         %lu in use\n",
+	       (unsigned long)isc_mem_inuse(mctx));
+	printf("elapsed:        %.3fs (%.2fus/query)\n",
+	       isc_time_microdiff(&t1, &t0) / 1000000.0,
+	       queries != 0 ?
+	       (double)isc_time_microdiff(&t1, &t0) / queries : 0.0);
+
+	free(entries);
+	dns_db_detach(&db);
+	isc_mem_destroy(&mctx);
+
+	return (0);
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * Compare the red-black tree and the qp-trie: time inserting -n names
+ * and looking each of them up, and report the memory used per name,
+ * first for the bare dns_rbt_t and dns_qp_t structures and then for
+ * "rbt" and "qp" zone databases loaded from the same generated file.
+ * Lookups are done in a scattered order, -r times over.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/commandline.h>
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/string.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/qp.h>
+#include <dns/rbt.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+
+static isc_mem_t *mctx = NULL;
+static dns_fixedname_t *names = NULL;
+static dns_fixedname_t forigin;
+static unsigned int count;
+
+static void
+makename(char *buf, size_t size, unsigned int i, isc_boolean_t absent) {
+	snprintf(buf, size, "%s%u.sub%u.example.", absent ? "nx" : "host",
+		 i, i % 997);
+}
+
+static void
+fromtext(const char *text, dns_fixedname_t *fname) {
+	isc_buffer_t b;
+
+	dns_fixedname_init(fname);
+	isc_buffer_constinit(&b, text, strlen(text));
+	isc_buffer_add(&b, strlen(text));
+	RUNTIME_CHECK(dns_name_fromtext(dns_fixedname_name(fname), &b,
+					dns_rootname, 0, NULL)
+		      == ISC_R_SUCCESS);
+}
+
+static void
+makenames(unsigned int n) {
+	char text[DNS_NAME_FORMATSIZE];
+	unsigned int i;
+
+	names = malloc(n * sizeof(names[0]));
+	RUNTIME_CHECK(names != NULL);
+	for (i = 0; i < n; i++) {
+		makename(text, sizeof(text), i, ISC_FALSE);
+		fromtext(text, &names[i]);
+	}
+	count = n;
+}
+
+/*
+ * Visit the names in a scattered order so that successive lookups do
+ * not share cache lines.
+ */
+static unsigned int
+scatter(unsigned int i) {
+	return ((unsigned int)(((isc_uint64_t)i * 2654435761U) % count));
+}
+
+static void
+report(const char *what, const char *op, isc_time_t *t0, isc_time_t *t1,
+       unsigned int ops)
+{
+	isc_uint64_t usecs = isc_time_microdiff(t1, t0);
+
+	printf("%-4s %-8s %8.3fs %8.0f ns/op\n", what, op, usecs / 1000000.0,
+	       (usecs * 1000.0) / ops);
+}
+
+static unsigned int
+qp_makekey(dns_qpkey_t key, void *ctx, void *value) {
+	dns_fixedname_t *fname = value;
+
+	UNUSED(ctx);
+	return (dns_qpkey_fromname(key, dns_fixedname_name(fname)));
+}
+
+static dns_qpmethods_t qpmethods = { qp_makekey, NULL };
+
+static void
+bench_structs(unsigned int rounds) {
+	isc_mem_t *rbtmctx = NULL;
+	dns_rbt_t *rbt = NULL;
+	dns_qp_t *qp = NULL;
+	isc_time_t t0, t1;
+	unsigned int i, r;
+	void *data;
+
+	RUNTIME_CHECK(isc_mem_create(0, 0, &rbtmctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_rbt_create(rbtmctx, NULL, NULL, &rbt)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (i = 0; i < count; i++)
+		RUNTIME_CHECK(dns_rbt_addname(rbt,
+					      dns_fixedname_name(&names[i]),
+					      &names[i]) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	report("rbt", "insert", &t0, &t1, count);
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < count; i++) {
+			data = NULL;
+			RUNTIME_CHECK(dns_rbt_findname(rbt,
+				dns_fixedname_name(&names[scatter(i)]), 0,
+				NULL, &data) == ISC_R_SUCCESS);
+		}
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	report("rbt", "find", &t0, &t1, count * rounds);
+	printf("rbt  %.1f bytes/name\n",
+	       (double)isc_mem_inuse(rbtmctx) / count);
+	dns_rbt_destroy(&rbt);
+	isc_mem_destroy(&rbtmctx);
+
+	RUNTIME_CHECK(dns_qp_create(mctx, &qpmethods, NULL, &qp)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (i = 0; i < count; i++)
+		RUNTIME_CHECK(dns_qp_insert(qp, &names[i]) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	report("qp", "insert", &t0, &t1, count);
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < count; i++) {
+			data = NULL;
+			RUNTIME_CHECK(dns_qp_getname(qp,
+				dns_fixedname_name(&names[scatter(i)]),
+				&data) == ISC_R_SUCCESS);
+		}
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	report("qp", "find", &t0, &t1, count * rounds);
+
+	/*
+	 * Unlike the red-black tree, the trie does not store the names;
+	 * the database keeps them in its nodes.
+	 */
+	printf("qp   %.1f bytes/name, not counting the names\n",
+	       (double)dns_qp_memusage(qp) / count);
+	dns_qp_destroy(&qp);
+}
+
+static void
+generate(const char *file) {
+	char text[DNS_NAME_FORMATSIZE];
+	FILE *f;
+	unsigned int i;
+
+	f = fopen(file, "w");
+	if (f == NULL) {
+		perror(file);
+		exit(1);
+	}
+	fprintf(f, "$TTL 3600\n"
+		   "@\tIN SOA ns1 hostmaster 1 3600 900 604800 300\n"
+		   "\tIN NS ns1\n"
+		   "ns1\tIN A 192.0.2.1\n");
+	for (i = 0; i < count; i++) {
+		makename(text, sizeof(text), i, ISC_FALSE);
+		fprintf(f, "%s\tIN A 10.%u.%u.%u\n", text,
+			(i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+	}
+	if (fclose(f) != 0) {
+		perror(file);
+		exit(1);
+	}
+}
+
+static void
+bench_db(const char *dbtype, const char *file, unsigned int rounds) {
+	isc_mem_t *dbmctx = NULL;
+	dns_db_t *db = NULL;
+	dns_fixedname_t fnx, ffound;
+	dns_rdataset_t rdataset;
+	char text[DNS_NAME_FORMATSIZE];
+	isc_time_t t0, t1;
+	isc_result_t result;
+	unsigned int i, r;
+
+	RUNTIME_CHECK(isc_mem_create(0, 0, &dbmctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_db_create(dbmctx, dbtype,
+				    dns_fixedname_name(&forigin),
+				    dns_dbtype_zone, dns_rdataclass_in, 0,
+				    NULL, &db) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	result = dns_db_load(db, file);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	if (result != ISC_R_SUCCESS) {
+		fprintf(stderr, "loading %s: %s\n", file,
+			isc_result_totext(result));
+		exit(1);
+	}
+	report(dbtype, "load", &t0, &t1, count);
+
+	dns_fixedname_init(&ffound);
+	dns_rdataset_init(&rdataset);
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < count; i++) {
+			result = dns_db_find(db,
+					dns_fixedname_name(&names[scatter(i)]),
+					NULL, dns_rdatatype_a, 0, 0, NULL,
+					dns_fixedname_name(&ffound),
+					&rdataset, NULL);
+			RUNTIME_CHECK(result == ISC_R_SUCCESS);
+			dns_rdataset_disassociate(&rdataset);
+		}
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	report(dbtype, "find", &t0, &t1, count * rounds);
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (i = 0; i < count; i++) {
+		makename(text, sizeof(text), scatter(i), ISC_TRUE);
+		fromtext(text, &fnx);
+		result = dns_db_find(db, dns_fixedname_name(&fnx), NULL,
+				     dns_rdatatype_a, 0, 0, NULL,
+				     dns_fixedname_name(&ffound), NULL, NULL);
+		RUNTIME_CHECK(result == DNS_R_NXDOMAIN);
+	}
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	report(dbtype, "nxdomain", &t0, &t1, count);
+
+	printf("%-4s %.1f bytes/name\n", dbtype,
+	       (double)isc_mem_inuse(dbmctx) / count);
+	dns_db_detach(&db);
+	isc_mem_destroy(&dbmctx);
+}
+
+static void
+usage(void) {
+	fprintf(stderr, "usage: qpbench_test [-n names] [-r rounds]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[]) {
+	char tmpfile[] = "qpbench.XXXXXX";
+	unsigned int n = 500000, rounds = 4;
+	int ch, fd;
+
+	while ((ch = isc_commandline_parse(argc, argv, "n:r:")) != -1) {
+		switch (ch) {
+		case 'n':
+			n = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'r':
+			rounds = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= isc_commandline_index;
+	if (argc != 0 || n == 0 || rounds == 0)
+		usage();
+
+	dns_result_register();
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+
+	fromtext("example.", &forigin);
+	makenames(n);
+
+	bench_structs(rounds);
+
+	fd = mkstemp(tmpfile);
+	if (fd < 0) {
+		perror(tmpfile);
+		exit(1);
+	}
+	close(fd);
+	generate(tmpfile);
+	bench_db("rbt", tmpfile, rounds);
+	bench_db("qp", tmpfile, rounds);
+	unlink(tmpfile);
+
+	free(names);
+	isc_mem_destroy(&mctx);
+	return (0);
+}
@@ -0,0 +1,773 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * Replay a recorded query stream through the server's query processing
+ * and report throughput, latency and allocations per query.  This is
+ * used to measure changes to libns and the databases behind it without
+ * the noise of the network and a separate load generator.
+ *
+ * The view is built from the zones given with -z (origin=file, loaded
+ * with the database type given by -d) and, with -C, a cache dump as
+ * written by "rndc dumpdb -cache".  It has no resolver, so a query that
+ * cannot be answered from the zones or the cache gets a referral or
+ * REFUSED rather than triggering recursion.
+ *
+ * The queries are read from a file of named query log lines ("query:
+ * <name> <class> <type> ...") or "<name> <type>" lines, or, with -T and
+ * if BIND was built with dnstap, the client queries in a dnstap file.
+ * They are sent -n times in all, cycling through the file, with at most
+ * -c outstanding at once.  Each one is handed to a client object as if
+ * it had been received over UDP from 127.0.0.1, and processed by -t
+ * worker threads.  Every run over the same data sends the same
+ * messages in the same order.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <isc/buffer.h>
+#include <isc/commandline.h>
+#include <isc/condition.h>
+#include <isc/entropy.h>
+#include <isc/hash.h>
+#include <isc/log.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/netaddr.h>
+#include <isc/print.h>
+#include <isc/socket.h>
+#include <isc/sockaddr.h>
+#include <isc/string.h>
+#include <isc/task.h>
+#include <isc/time.h>
+#include <isc/timer.h>
+#include <isc/util.h>
+
+#include <dns/acl.h>
+#include <dns/cache.h>
+#include <dns/dispatch.h>
+#include <dns/fixedname.h>
+#include <dns/iptable.h>
+#include <dns/log.h>
+#include <dns/name.h>
+#include <dns/rcode.h>
+#include <dns/rdatatype.h>
+#include <dns/result.h>
+#include <dns/view.h>
+#include <dns/zone.h>
+#ifdef HAVE_DNSTAP
+#include <dns/dnstap.h>
+#endif
+
+#include <dst/dst.h>
+
+#include <ns/client.h>
+#include <ns/interfacemgr.h>
+#include <ns/listenlist.h>
+#include <ns/log.h>
+#include <ns/server.h>
+
+#define MAXZONES	64
+#define NBUCKETS	32
+
+typedef struct {
+	unsigned char *	data;
+	unsigned int	length;
+} wirequery_t;
+
+typedef struct {
+	isc_time_t	sent;
+	unsigned int	next;		/* next free slot */
+} slot_t;
+
+static isc_mem_t *mctx = NULL;
+static isc_entropy_t *ectx = NULL;
+static isc_log_t *lctx = NULL;
+static isc_taskmgr_t *taskmgr = NULL;
+static isc_task_t *maintask = NULL;
+static isc_timermgr_t *timermgr = NULL;
+static isc_socketmgr_t *socketmgr = NULL;
+static dns_dispatchmgr_t *dispatchmgr = NULL;
+static dns_zonemgr_t *zonemgr = NULL;
+static ns_interfacemgr_t *interfacemgr = NULL;
+static ns_server_t *sctx = NULL;
+static dns_view_t *view = NULL;
+
+static wirequery_t *wq = NULL;
+static unsigned int nwq = 0, wqsize = 0;
+
+static isc_mutex_t lock;
+static isc_condition_t cond;
+static isc_boolean_t ready = ISC_FALSE;
+static slot_t *slots = NULL;
+static unsigned int freeslot, outstanding;
+
+static isc_uint64_t responses, drops, truncated;
+static isc_uint64_t rcodes[16];
+static isc_uint64_t histogram[NBUCKETS];
+static isc_uint32_t *latency = NULL;
+static isc_uint64_t nlatency;
+
+static isc_result_t
+matchview(isc_netaddr_t *srcaddr, isc_netaddr_t *destaddr,
+	  dns_message_t *message, dns_aclenv_t *env, dns_ecs_t *ecs,
+	  isc_result_t *sigresultp, dns_view_t **viewp)
+{
+	UNUSED(srcaddr);
+	UNUSED(destaddr);
+	UNUSED(message);
+	UNUSED(env);
+	UNUSED(ecs);
+	UNUSED(sigresultp);
+
+	dns_view_attach(view, viewp);
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Append a query of 'length' octets to the list and return the buffer
+ * for it.
+ */
+static unsigned char *
+newquery(unsigned int length) {
+	if (nwq == wqsize) {
+		unsigned int newsize = wqsize == 0 ? 1024 : wqsize * 2;
+		wirequery_t *new;
+
+		new = isc_mem_get(mctx, newsize * sizeof(*new));
+		RUNTIME_CHECK(new != NULL);
+		if (wq != NULL) {
+			memmove(new, wq, nwq * sizeof(*new));
+			isc_mem_put(mctx, wq, wqsize * sizeof(*wq));
+		}
+		wq = new;
+		wqsize = newsize;
+	}
+	wq[nwq].data = isc_mem_get(mctx, length);
+	RUNTIME_CHECK(wq[nwq].data != NULL);
+	wq[nwq].length = length;
+	return (wq[nwq++].data);
+}
+
+/*
+ * Append a query for 'name'/'type' in wire format.  The message IDs
+ * count up from zero.
+ */
+static void
+addquery(dns_name_t *name, dns_rdatatype_t type, isc_boolean_t rd,
+	 isc_boolean_t edns)
+{
+	isc_region_t r;
+	isc_buffer_t b;
+	unsigned char *data;
+	unsigned int length;
+	isc_uint16_t id;
+
+	dns_name_toregion(name, &r);
+	length = 12 + r.length + 4 + (edns ? 11 : 0);
+	id = (isc_uint16_t)(nwq & 0xffff);
+	data = newquery(length);
+
+	isc_buffer_init(&b, data, length);
+	isc_buffer_putuint16(&b, id);
+	isc_buffer_putuint16(&b, rd ? 0x0100 : 0);
+	isc_buffer_putuint16(&b, 1);
+	isc_buffer_putuint16(&b, 0);
+	isc_buffer_putuint16(&b, 0);
+	isc_buffer_putuint16(&b, edns ? 1 : 0);
+	isc_buffer_putmem(&b, r.base, r.length);
+	isc_buffer_putuint16(&b, type);
+	isc_buffer_putuint16(&b, dns_rdataclass_in);
+	if (edns) {
+		isc_buffer_putuint8(&b, 0);
+		isc_buffer_putuint16(&b, dns_rdatatype_opt);
+		isc_buffer_putuint16(&b, 4096);
+		isc_buffer_putuint32(&b, 0);
+		isc_buffer_putuint16(&b, 0);
+	}
+	INSIST(isc_buffer_usedlength(&b) == length);
+}
+
+static isc_result_t
+parseline(char *line, dns_name_t *name, dns_rdatatype_t *typep) {
+	char *p, *qname, *tok, *last = NULL;
+	isc_textregion_t r;
+	isc_buffer_t b;
+	isc_result_t result;
+
+	p = strstr(line, "query: ");
+	if (p != NULL)
+		line = p + 7;
+
+	qname = strtok_r(line, " \t\r\n", &last);
+	if (qname == NULL)
+		return (ISC_R_NOTFOUND);
+	tok = strtok_r(NULL, " \t\r\n", &last);
+	if (tok != NULL && strcasecmp(tok, "IN") == 0)
+		tok = strtok_r(NULL, " \t\r\n", &last);
+	if (tok == NULL)
+		return (ISC_R_NOTFOUND);
+
+	r.base = tok;
+	r.length = strlen(tok);
+	result = dns_rdatatype_fromtext(typep, &r);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	isc_buffer_init(&b, qname, strlen(qname));
+	isc_buffer_add(&b, strlen(qname));
+	return (dns_name_fromtext(name, &b, dns_rootname, 0, NULL));
+}
+
+static void
+readlog(const char *file, isc_boolean_t rd, isc_boolean_t edns) {
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	dns_rdatatype_t type;
+	char line[1024];
+	FILE *fp;
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		perror(file);
+		exit(1);
+	}
+
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (parseline(line, name, &type) == ISC_R_SUCCESS)
+			addquery(name, type, rd, edns);
+	}
+	fclose(fp);
+}
+
+#ifdef HAVE_DNSTAP
+/*
+ * Take the client queries from a dnstap file as they were received.
+ */
+static void
+readdnstap(const char *file) {
+	dns_dthandle_t *handle = NULL;
+	isc_result_t result;
+
+	result = dns_dt_open(file, dns_dtmode_file, mctx, &handle);
+	if (result != ISC_R_SUCCESS) {
+		fprintf(stderr, "%s: %s\n", file, isc_result_totext(result));
+		exit(1);
+	}
+
+	for (;;) {
+		dns_dtdata_t *dt = NULL;
+		isc_region_t input;
+		isc_uint8_t *data;
+		size_t datalen;
+
+		result = dns_dt_getframe(handle, &data, &datalen);
+		if (result == ISC_R_NOMORE)
+			break;
+		RUNTIME_CHECK(result == ISC_R_SUCCESS);
+
+		input.base = data;
+		input.length = datalen;
+		if (dns_dt_parse(mctx, &input, &dt) != ISC_R_SUCCESS)
+			continue;
+
+		if (dt->query && dt->type == DNS_DTTYPE_CQ &&
+		    dt->msgdata.length >= 12)
+			memmove(newquery(dt->msgdata.length),
+				dt->msgdata.base, dt->msgdata.length);
+		dns_dtdata_free(&dt);
+	}
+
+	dns_dt_close(&handle);
+}
+#endif /* HAVE_DNSTAP */
+
+static void
+addzone(const char *arg, const char *dbtype) {
+	dns_fixedname_t fname;
+	dns_name_t *origin;
+	dns_zone_t *zone = NULL;
+	isc_buffer_t b;
+	const char *file;
+	isc_result_t result;
+
+	file = strchr(arg, '=');
+	if (file == NULL) {
+		fprintf(stderr, "%s: expected origin=file\n", arg);
+		exit(1);
+	}
+
+	dns_fixedname_init(&fname);
+	origin = dns_fixedname_name(&fname);
+	isc_buffer_constinit(&b, arg, file - arg);
+	isc_buffer_add(&b, file - arg);
+	result = dns_name_fromtext(origin, &b, dns_rootname, 0, NULL);
+	if (result != ISC_R_SUCCESS) {
+		fprintf(stderr, "%s: %s\n", arg, isc_result_totext(result));
+		exit(1);
+	}
+	file++;
+
+	RUNTIME_CHECK(dns_zone_create(&zone, mctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_zone_setorigin(zone, origin) == ISC_R_SUCCESS);
+	dns_zone_settype(zone, dns_zone_master);
+	dns_zone_setclass(zone, dns_rdataclass_in);
+	RUNTIME_CHECK(dns_zone_setdbtype(zone, 1, &dbtype) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_zone_setfile(zone, file) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_zonemgr_managezone(zonemgr, zone) == ISC_R_SUCCESS);
+	result = dns_zone_load(zone);
+	if (result != ISC_R_SUCCESS) {
+		fprintf(stderr, "%s: %s\n", file, isc_result_totext(result));
+		exit(1);
+	}
+	dns_zone_setview(zone, view);
+	RUNTIME_CHECK(dns_view_addzone(view, zone) == ISC_R_SUCCESS);
+	dns_zone_detach(&zone);
+}
+
+static void
+loadcache(const char *file) {
+	dns_cache_t *cache = NULL;
+	isc_result_t result;
+
+	RUNTIME_CHECK(dns_cache_create(mctx, taskmgr, timermgr,
+				       dns_rdataclass_in, "rbt", 0, NULL,
+				       &cache) == ISC_R_SUCCESS);
+	if (file != NULL) {
+		RUNTIME_CHECK(dns_cache_setfilename(cache, file)
+			      == ISC_R_SUCCESS);
+		result = dns_cache_load(cache);
+		if (result != ISC_R_SUCCESS) {
+			fprintf(stderr, "%s: %s\n", file,
+				isc_result_totext(result));
+			exit(1);
+		}
+	}
+	dns_view_setcache(view, cache);
+	dns_cache_detach(&cache);
+}
+
+static void
+scan_interfaces(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	ns_interfacemgr_scan(interfacemgr, ISC_TRUE);
+	isc_event_free(&event);
+
+	LOCK(&lock);
+	ready = ISC_TRUE;
+	SIGNAL(&cond);
+	UNLOCK(&lock);
+}
+
+static void
+shutdown_managers(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	ns_interfacemgr_shutdown(interfacemgr);
+	ns_interfacemgr_detach(&interfacemgr);
+	dns_dispatchmgr_destroy(&dispatchmgr);
+	isc_event_free(&event);
+}
+
+/*
+ * Listen on 127.0.0.1 only; the interface is needed to process the
+ * queries, but it is never sent anything.
+ */
+static void
+listen_loopback(in_port_t port) {
+	ns_listenlist_t *list = NULL;
+	ns_listenelt_t *elt = NULL;
+	dns_acl_t *acl = NULL;
+	isc_netaddr_t na;
+	struct in_addr in;
+	isc_event_t *event;
+
+	in.s_addr = htonl(INADDR_LOOPBACK);
+	isc_netaddr_fromin(&na, &in);
+	RUNTIME_CHECK(dns_acl_create(mctx, 0, &acl) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_iptable_addprefix(acl->iptable, &na, 32, ISC_TRUE)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(ns_listenelt_create(mctx, port, -1, acl, &elt)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(ns_listenlist_create(mctx, &list) == ISC_R_SUCCESS);
+	ISC_LIST_APPEND(list->elts, elt, link);
+	ns_interfacemgr_setlistenon4(interfacemgr, list);
+	ns_listenlist_detach(&list);
+
+	event = isc_event_allocate(mctx, maintask, ISC_TASKEVENT_TEST,
+				   scan_interfaces, NULL, sizeof(isc_event_t));
+	RUNTIME_CHECK(event != NULL);
+	isc_task_send(maintask, &event);
+
+	LOCK(&lock);
+	while (!ready)
+		WAIT(&cond, &lock);
+	UNLOCK(&lock);
+}
+
+/*
+ * Called from the client's task when it is done with a query.
+ */
+static void
+done(void *arg, isc_region_t *r) {
+	slot_t *slot = arg;
+	unsigned int i = (unsigned int)(slot - slots);
+	isc_time_t now;
+	isc_uint64_t us;
+	unsigned int b;
+
+	TIME_NOW(&now);
+
+	LOCK(&lock);
+	us = isc_time_microdiff(&now, &slot->sent);
+	if (r == NULL || r->length < 12) {
+		drops++;
+	} else {
+		responses++;
+		rcodes[r->base[3] & 0x0f]++;
+		if ((r->base[2] & 0x02) != 0)
+			truncated++;
+		for (b = 0; b < NBUCKETS - 1 && (us >> b) > 1; b++)
+			;
+		histogram[b]++;
+		latency[nlatency++] = (us > 0xffffffffU) ? 0xffffffffU
+							 : (isc_uint32_t)us;
+	}
+	slot->next = freeslot;
+	freeslot = i;
+	outstanding--;
+	SIGNAL(&cond);
+	UNLOCK(&lock);
+}
+
+static int
+compare(const void *a, const void *b) {
+	isc_uint32_t x = *(const isc_uint32_t *)a;
+	isc_uint32_t y = *(const isc_uint32_t *)b;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+static isc_uint32_t
+percentile(double p) {
+	isc_uint64_t i = (isc_uint64_t)(p * nlatency / 100.0);
+
+	if (i >= nlatency)
+		i = nlatency - 1;
+	return (latency[i]);
+}
+
+static void
+report(isc_uint64_t sent, isc_uint64_t elapsed, isc_uint64_t gets) {
+	char rcodebuf[64];
+	isc_uint64_t sum = 0, i;
+	unsigned int b;
+
+	printf("queries:        %" ISC_PRINT_QUADFORMAT "u\n", sent);
+	printf("responses:      %" ISC_PRINT_QUADFORMAT "u "
+	       "(%" ISC_PRINT_QUADFORMAT "u truncated)\n",
+	       responses, truncated);
+	printf("dropped:        %" ISC_PRINT_QUADFORMAT "u\n", drops);
+	for (b = 0; b < 16; b++) {
+		isc_buffer_t buf;
+
+		if (rcodes[b] == 0)
+			continue;
+		isc_buffer_init(&buf, rcodebuf, sizeof(rcodebuf) - 1);
+		RUNTIME_CHECK(dns_rcode_totext(b, &buf) == ISC_R_SUCCESS);
+		isc_buffer_putuint8(&buf, 0);
+		printf("  %-12s  %" ISC_PRINT_QUADFORMAT "u\n",
+		       rcodebuf, rcodes[b]);
+	}
+	printf("elapsed:        %.3fs\n", elapsed / 1000000.0);
+	printf("throughput:     %.0f qps\n",
+	       elapsed != 0 ? sent * 1000000.0 / elapsed : 0.0);
+	printf("allocations:    %.1f per query\n",
+	       sent != 0 ? (double)gets / sent : 0.0);
+
+	if (nlatency == 0)
+		return;
+
+	qsort(latency, (size_t)nlatency, sizeof(latency[0]), compare);
+	for (i = 0; i < nlatency; i++)
+		sum += latency[i];
+	printf("latency (us):   min %u avg %.1f max %u\n",
+	       latency[0], (double)sum / nlatency, latency[nlatency - 1]);
+	printf("                p50 %u p90 %u p99 %u p99.9 %u\n",
+	       percentile(50.0), percentile(90.0), percentile(99.0),
+	       percentile(99.9));
+	for (b = 0; b < NBUCKETS; b++) {
+		if (histogram[b] == 0)
+			continue;
+		printf("  < %10lu us  %10" ISC_PRINT_QUADFORMAT "u  %6.2f%%\n",
+		       2UL << b, histogram[b], 100.0 * histogram[b] / nlatency);
+	}
+}
+
+static void
+usage(void) {
+	fprintf(stderr,
+		"usage: queryreplay_test [-C cachefile] [-z origin=file ...] "
+		"[-d dbtype] [-n queries] [-c concurrency] [-t threads] "
+		"[-p port] [-r] [-e] [-T] [-v] querylog\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[]) {
+	const char *zonespec[MAXZONES];
+	const char *dbtype = "rbt", *cachefile = NULL;
+	unsigned int nzones = 0, nthreads = 1, concurrency = 100;
+	unsigned int nqueries = 0, port = 5300;
+	isc_boolean_t rd = ISC_FALSE, edns = ISC_FALSE, dnstap = ISC_FALSE;
+	isc_boolean_t verbose = ISC_FALSE;
+	ns_interface_t *ifp;
+	isc_sockaddr_t peer;
+	struct in_addr in;
+	isc_uint64_t sent, gets;
+	isc_time_t t0, t1;
+	unsigned int i;
+	int ch;
+
+	while ((ch = isc_commandline_parse(argc, argv, "C:c:d:en:p:rTt:vz:"))
+	       != -1)
+	{
+		switch (ch) {
+		case 'C':
+			cachefile = isc_commandline_argument;
+			break;
+		case 'c':
+			concurrency = strtoul(isc_commandline_argument,
+					      NULL, 0);
+			break;
+		case 'd':
+			dbtype = isc_commandline_argument;
+			break;
+		case 'e':
+			edns = ISC_TRUE;
+			break;
+		case 'n':
+			nqueries = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'p':
+			port = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'r':
+			rd = ISC_TRUE;
+			break;
+		case 'T':
+			dnstap = ISC_TRUE;
+			break;
+		case 't':
+			nthreads = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'v':
+			verbose = ISC_TRUE;
+			break;
+		case 'z':
+			if (nzones == MAXZONES) {
+				fprintf(stderr, "too many zones\n");
+				exit(1);
+			}
+			zonespec[nzones++] = isc_commandline_argument;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= isc_commandline_index;
+	argv += isc_commandline_index;
+	if (argc != 1 || concurrency == 0 || nthreads == 0 ||
+	    port == 0 || port > 65535)
+		usage();
+#ifndef ISC_PLATFORM_USETHREADS
+	fprintf(stderr, "queryreplay_test requires threads\n");
+	exit(1);
+#endif
+#ifndef HAVE_DNSTAP
+	if (dnstap) {
+		fprintf(stderr, "dnstap is not supported in this build\n");
+		exit(1);
+	}
+#endif
+
+	dns_result_register();
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_entropy_create(mctx, &ectx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dst_lib_init(mctx, ectx, ISC_ENTROPY_BLOCKING)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_hash_create(mctx, ectx, DNS_NAME_MAXWIRE)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_mutex_init(&lock) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_condition_init(&cond) == ISC_R_SUCCESS);
+
+	if (verbose) {
+		isc_logdestination_t destination;
+		isc_logconfig_t *logconfig = NULL;
+
+		RUNTIME_CHECK(isc_log_create(mctx, &lctx, &logconfig)
+			      == ISC_R_SUCCESS);
+		isc_log_setcontext(lctx);
+		dns_log_init(lctx);
+		dns_log_setcontext(lctx);
+		ns_log_init(lctx);
+		ns_log_setcontext(lctx);
+
+		destination.file.stream = stderr;
+		destination.file.name = NULL;
+		destination.file.versions = ISC_LOG_ROLLNEVER;
+		destination.file.maximum_size = 0;
+		RUNTIME_CHECK(isc_log_createchannel(logconfig, "stderr",
+						    ISC_LOG_TOFILEDESC,
+						    ISC_LOG_INFO,
+						    &destination, 0)
+			      == ISC_R_SUCCESS);
+		RUNTIME_CHECK(isc_log_usechannel(logconfig, "stderr",
+						 NULL, NULL)
+			      == ISC_R_SUCCESS);
+	}
+
+#ifdef HAVE_DNSTAP
+	if (dnstap)
+		readdnstap(argv[0]);
+	else
+#endif
+		readlog(argv[0], rd, edns);
+	if (nwq == 0) {
+		fprintf(stderr, "%s: no queries\n", argv[0]);
+		exit(1);
+	}
+	if (nqueries == 0)
+		nqueries = nwq;
+
+	RUNTIME_CHECK(isc_taskmgr_create(mctx, nthreads, 0, &taskmgr)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_task_create(taskmgr, 0, &maintask)
+		      == ISC_R_SUCCESS);
+	isc_taskmgr_setexcltask(taskmgr, maintask);
+	RUNTIME_CHECK(isc_task_onshutdown(maintask, shutdown_managers, NULL)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_timermgr_create(mctx, &timermgr) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_socketmgr_create(mctx, &socketmgr)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(ns_server_create(mctx, ectx, matchview, &sctx)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_dispatchmgr_create(mctx, ectx, &dispatchmgr)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(ns_interfacemgr_create(mctx, sctx, taskmgr, timermgr,
+					     socketmgr, dispatchmgr, maintask,
+					     1, NULL, &interfacemgr)
+		      == ISC_R_SUCCESS);
+
+	RUNTIME_CHECK(dns_view_create(mctx, dns_rdataclass_in, "_default",
+				      &view) == ISC_R_SUCCESS);
+	view->maxudp = 4096;
+	view->nocookieudp = 4096;
+	loadcache(cachefile);
+	RUNTIME_CHECK(dns_zonemgr_create(mctx, taskmgr, timermgr, socketmgr,
+					 &zonemgr) == ISC_R_SUCCESS);
+	if (nzones > 0)
+		RUNTIME_CHECK(dns_zonemgr_setsize(zonemgr, nzones)
+			      == ISC_R_SUCCESS);
+	for (i = 0; i < nzones; i++)
+		addzone(zonespec[i], dbtype);
+	dns_view_freeze(view);
+
+	listen_loopback((in_port_t)port);
+	ifp = ns__interfacemgr_getif(interfacemgr);
+	if (ifp == NULL) {
+		fprintf(stderr, "cannot listen on 127.0.0.1#%u\n", port);
+		exit(1);
+	}
+
+	slots = isc_mem_get(mctx, concurrency * sizeof(*slots));
+	latency = isc_mem_get(mctx, nqueries * sizeof(*latency));
+	RUNTIME_CHECK(slots != NULL && latency != NULL);
+	for (i = 0; i < concurrency; i++)
+		slots[i].next = i + 1;
+	freeslot = 0;
+
+	in.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&peer, &in, 53000);
+
+	gets = isc_mem_totalgets();
+	TIME_NOW(&t0);
+
+	LOCK(&lock);
+	for (sent = 0; sent < nqueries; sent++) {
+		wirequery_t *q = &wq[sent % nwq];
+		isc_region_t r;
+		isc_result_t result;
+
+		while (freeslot == concurrency)
+			WAIT(&cond, &lock);
+		i = freeslot;
+		freeslot = slots[i].next;
+		outstanding++;
+		TIME_NOW(&slots[i].sent);
+		UNLOCK(&lock);
+
+		r.base = q->data;
+		r.length = q->length;
+		result = ns__client_inject(ifp->clientmgr, ifp, &peer, &r,
+					   done, &slots[i]);
+
+		LOCK(&lock);
+		if (result != ISC_R_SUCCESS) {
+			fprintf(stderr, "query %" ISC_PRINT_QUADFORMAT "u: "
+				"%s\n", sent, isc_result_totext(result));
+			drops++;
+			slots[i].next = freeslot;
+			freeslot = i;
+			outstanding--;
+		}
+	}
+	while (outstanding > 0)
+		WAIT(&cond, &lock);
+	UNLOCK(&lock);
+
+	TIME_NOW(&t1);
+	gets = isc_mem_totalgets() - gets;
+
+	report(sent, isc_time_microdiff(&t1, &t0), gets);
+
+	dns_view_detach(&view);
+	dns_zonemgr_shutdown(zonemgr);
+	dns_zonemgr_detach(&zonemgr);
+	isc_task_shutdown(maintask);
+	isc_task_detach(&maintask);
+	ns_server_detach(&sctx);
+	isc_socketmgr_destroy(&socketmgr);
+	isc_taskmgr_destroy(&taskmgr);
+	isc_timermgr_destroy(&timermgr);
+
+	isc_mem_put(mctx, slots, concurrency * sizeof(*slots));
+	isc_mem_put(mctx, latency, nqueries * sizeof(*latency));
+	for (i = 0; i < nwq; i++)
+		isc_mem_put(mctx, wq[i].data, wq[i].length);
+	isc_mem_put(mctx, wq, wqsize * sizeof(*wq));
+
+	DESTROYLOCK(&lock);
+	(void)isc_condition_destroy(&cond);
+	dst_lib_destroy();
+	isc_hash_destroy();
+	isc_entropy_detach(&ectx);
+	if (lctx != NULL)
+		isc_log_destroy(&lctx);
+	isc_mem_destroy(&mctx);
+
+	return (0);
+}
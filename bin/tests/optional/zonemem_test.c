@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * Measure the memory and time it takes to host many small zones: -n
+ * master zones are created, each is loaded from the same generated
+ * file of -r records (owner names are relative, so every zone gets
+ * its own copy) and handed to a zone manager, the way named sets
+ * them up.  The memory in use per zone is reported after each step.
+ * -t selects the database type.
+ *
+ * The cost per zone does not change with the number of zones, so a run
+ * with -n 1000000 needs about as many gigabytes as the "total" line of
+ * a smaller run shows kilobytes per zone.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <isc/buffer.h>
+#include <isc/commandline.h>
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/socket.h>
+#include <isc/string.h>
+#include <isc/task.h>
+#include <isc/time.h>
+#include <isc/timer.h>
+#include <isc/util.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/result.h>
+#include <dns/zone.h>
+
+static isc_mem_t *mctx = NULL;
+
+static void
+generate(const char *file, unsigned int records) {
+	FILE *f;
+	unsigned int i;
+
+	f = fopen(file, "w");
+	if (f == NULL) {
+		perror(file);
+		exit(1);
+	}
+	fprintf(f, "$TTL 3600\n"
+		   "@\tIN SOA ns1 hostmaster 1 3600 900 604800 300\n"
+		   "\tIN NS ns1\n"
+		   "ns1\tIN A 192.0.2.1\n");
+	for (i = 3; i < records; i++)
+		fprintf(f, "host%u\tIN A 192.0.2.%u\n", i, i & 0xff);
+	if (fclose(f) != 0) {
+		perror(file);
+		exit(1);
+	}
+}
+
+static void
+report(const char *step, size_t before, size_t after, unsigned int count,
+       isc_time_t *t0, isc_time_t *t1)
+{
+	printf("%-8s %10.1f bytes/zone %8.3fs\n", step,
+	       ((double)after - (double)before) / count,
+	       isc_time_microdiff(t1, t0) / 1000000.0);
+}
+
+static void
+usage(void) {
+	fprintf(stderr,
+		"usage: zonemem_test [-n zones] [-r records] [-t dbtype]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[]) {
+	char tmpfile[] = "zonemem.XXXXXX";
+	char text[DNS_NAME_FORMATSIZE];
+	const char *dbtype = "rbt";
+	isc_taskmgr_t *taskmgr = NULL;
+	isc_timermgr_t *timermgr = NULL;
+	isc_socketmgr_t *socketmgr = NULL;
+	dns_zonemgr_t *zmgr = NULL;
+	dns_zone_t **zones;
+	dns_fixedname_t fname;
+	isc_buffer_t b;
+	isc_time_t t0, t1;
+	size_t base, mark;
+	unsigned int n = 100000, records = 10, i;
+	int ch, fd;
+
+	while ((ch = isc_commandline_parse(argc, argv, "n:r:t:")) != -1) {
+		switch (ch) {
+		case 'n':
+			n = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 'r':
+			records = strtoul(isc_commandline_argument, NULL, 0);
+			break;
+		case 't':
+			dbtype = isc_commandline_argument;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= isc_commandline_index;
+	if (argc != 0 || n == 0 || records < 3)
+		usage();
+
+	dns_result_register();
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_taskmgr_create(mctx, 1, 0, &taskmgr)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_timermgr_create(mctx, &timermgr) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_socketmgr_create(mctx, &socketmgr)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_zonemgr_create(mctx, taskmgr, timermgr, socketmgr,
+					 &zmgr) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_zonemgr_setsize(zmgr, n) == ISC_R_SUCCESS);
+
+	fd = mkstemp(tmpfile);
+	if (fd < 0) {
+		perror(tmpfile);
+		exit(1);
+	}
+	close(fd);
+	generate(tmpfile, records);
+
+	zones = malloc(n * sizeof(zones[0]));
+	RUNTIME_CHECK(zones != NULL);
+
+	base = isc_mem_inuse(mctx);
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (i = 0; i < n; i++) {
+		zones[i] = NULL;
+		RUNTIME_CHECK(dns_zone_create(&zones[i], mctx)
+			      == ISC_R_SUCCESS);
+		snprintf(text, sizeof(text), "zone%u.example.", i);
+		dns_fixedname_init(&fname);
+		isc_buffer_constinit(&b, text, strlen(text));
+		isc_buffer_add(&b, strlen(text));
+		RUNTIME_CHECK(dns_name_fromtext(dns_fixedname_name(&fname),
+						&b, dns_rootname, 0, NULL)
+			      == ISC_R_SUCCESS);
+		RUNTIME_CHECK(dns_zone_setorigin(zones[i],
+					dns_fixedname_name(&fname))
+			      == ISC_R_SUCCESS);
+		dns_zone_settype(zones[i], dns_zone_master);
+		dns_zone_setclass(zones[i], dns_rdataclass_in);
+		RUNTIME_CHECK(dns_zone_setdbtype(zones[i], 1, &dbtype)
+			      == ISC_R_SUCCESS);
+		RUNTIME_CHECK(dns_zone_setfile(zones[i], tmpfile)
+			      == ISC_R_SUCCESS);
+	}
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	mark = isc_mem_inuse(mctx);
+	report("create", base, mark, n, &t0, &t1);
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (i = 0; i < n; i++)
+		RUNTIME_CHECK(dns_zone_load(zones[i]) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	report("load", mark, isc_mem_inuse(mctx), n, &t0, &t1);
+	mark = isc_mem_inuse(mctx);
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (i = 0; i < n; i++)
+		RUNTIME_CHECK(dns_zonemgr_managezone(zmgr, zones[i])
+			      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	report("manage", mark, isc_mem_inuse(mctx), n, &t0, &t1);
+	printf("total    %10.1f bytes/zone\n",
+	       ((double)isc_mem_inuse(mctx) - (double)base) / n);
+
+	for (i = 0; i < n; i++) {
+		dns_zonemgr_releasezone(zmgr, zones[i]);
+		dns_zone_detach(&zones[i]);
+	}
+	free(zones);
+	unlink(tmpfile);
+
+	dns_zonemgr_shutdown(zmgr);
+	dns_zonemgr_detach(&zmgr);
+	isc_taskmgr_destroy(&taskmgr);
+	isc_timermgr_destroy(&timermgr);
+	isc_socketmgr_destroy(&socketmgr);
+	isc_mem_destroy(&mctx);
+	return (0);
+}
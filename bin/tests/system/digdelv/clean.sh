@@ -12,7 +12,9 @@
 rm -f */named.memstats
 rm -f */named.run
 rm -f */named.conf
+rm -f batch.parallel
 rm -f delv.out.test*
+rm -f dig.expect.test*
 rm -f dig.out.*test*
 rm -f dig.out.mm.*
 rm -f dig.out.mn.*
@@ -486,6 +486,70 @@ if [ -x ${DIG} ] ; then
   if [ $ret != 0 ]; then echo_i "failed"; fi
   status=`expr $status + $ret`
 
+  # Nothing answers on 10.53.0.9, so the first lookup of this batch
+  # finishes a second after the others.
+  cat > batch.parallel <<BATCH
+@10.53.0.9 +time=1 +tries=1 a.example a
+@10.53.0.3 a.example a
+@10.53.0.3 b.example a
+@10.53.0.3 c.example a
+BATCH
+
+  n=`expr $n + 1`
+  echo_i "checking dig +parallel +ordered prints in input order ($n)"
+  ret=0
+  $DIG $DIGOPTS +short +parallel=4 +ordered -f batch.parallel \
+	> dig.out.test$n 2>&1
+  cat > dig.expect.test$n <<EXPECT
+;; connection timed out; no servers could be reached
+10.0.0.1
+10.0.0.2
+10.0.0.3
+EXPECT
+  diff dig.expect.test$n dig.out.test$n > /dev/null || ret=1
+  if [ $ret != 0 ]; then echo_i "failed"; fi
+  status=`expr $status + $ret`
+
+  n=`expr $n + 1`
+  echo_i "checking dig +parallel +noordered prints lookups as they finish ($n)"
+  ret=0
+  $DIG $DIGOPTS +short +parallel=4 +noordered -f batch.parallel \
+	> dig.out.test$n 2>&1
+  tail -1 dig.out.test$n | grep "^;; connection timed out" > /dev/null || ret=1
+  sort dig.out.test$n | grep -c "^10\.0\.0\.[123]$" | grep "^3$" > /dev/null || ret=1
+  if [ $ret != 0 ]; then echo_i "failed"; fi
+  status=`expr $status + $ret`
+
+  n=`expr $n + 1`
+  echo_i "checking dig +yaml output ($n)"
+  ret=0
+  $DIG $DIGOPTS @10.53.0.3 +yaml a a.example > dig.out.test$n 2>&1 || ret=1
+  grep "^  type: MESSAGE$" dig.out.test$n > /dev/null || ret=1
+  grep "^      status: NOERROR$" dig.out.test$n > /dev/null || ret=1
+  grep "^      ANSWER: 1$" dig.out.test$n > /dev/null || ret=1
+  grep "^        - 'a.example. [0-9]* IN A 10.0.0.1'$" dig.out.test$n > /dev/null || ret=1
+  # Everything else is a YAML comment.
+  grep -v "^-$" dig.out.test$n | grep -v "^  " | grep -v "^#" | grep . > /dev/null && ret=1
+  if [ $ret != 0 ]; then echo_i "failed"; fi
+  status=`expr $status + $ret`
+
+  n=`expr $n + 1`
+  echo_i "checking dig +yaml output of a +parallel batch with an error ($n)"
+  ret=0
+  $DIG $DIGOPTS +yaml +parallel=4 +ordered -f batch.parallel \
+	> dig.out.test$n 2>&1
+  sed -n 2,4p dig.out.test$n > dig.out.head.test$n
+  cat > dig.expect.test$n <<EXPECT
+  type: DIG_ERROR
+  query_name: 'a.example'
+  message: 'connection timed out; no servers could be reached'
+EXPECT
+  diff dig.expect.test$n dig.out.head.test$n > /dev/null || ret=1
+  [ `grep -c "^  type: MESSAGE$" dig.out.test$n` -eq 3 ] || ret=1
+  grep -v "^-$" dig.out.test$n | grep -v "^  " | grep -v "^#" | grep . > /dev/null && ret=1
+  if [ $ret != 0 ]; then echo_i "failed"; fi
+  status=`expr $status + $ret`
+
 else
   echo_i "$DIG is needed, so skipping these dig tests"
 fi
@@ -0,0 +1,524 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*
+ * A load generator for DNS-over-TLS servers.
+ *
+ * It keeps a number of connections open at the same time.  Each one
+ * completes the TLS handshake, sends its queries with a bounded number
+ * of them outstanding, waits for all the responses and closes; then a
+ * new connection takes its place, until the requested number has been
+ * made.  With -r, new connections resume the session of an earlier one.
+ *
+ * Measuring the handshake rate calls for many connections with few
+ * queries each (-q 1); measuring query throughput calls for few
+ * connections with many pipelined queries each.
+ *
+ * With -x the queries ask for zone transfers instead of addresses; a
+ * transfer counts as answered when its closing SOA record arrives.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef HAVE_OPENSSL_SSL
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#define MAXCONNS	1000
+#define MAXDEPTH	64
+#define MAXNAMES	100
+#define MAXQUERY	(2 + 12 + 255 + 4)
+
+typedef enum {
+	conn_idle = 0,
+	conn_connecting,
+	conn_handshake,
+	conn_running
+} connstate_t;
+
+typedef struct {
+	connstate_t	state;
+	int		fd;
+	SSL *		ssl;
+	short		events;		/* to poll() for */
+	int		sent;		/* queries */
+	int		answered;
+	unsigned char	wbuf[MAXDEPTH * MAXQUERY];
+	int		wlen;		/* being written */
+	unsigned char	rbuf[65537];
+	int		rlen;
+	int		soas;		/* seen in the current transfer */
+} conn_t;
+
+static struct sockaddr_storage server;
+static socklen_t serverlen;
+static SSL_CTX *ctx;
+static SSL_SESSION *session;
+static const char *names[MAXNAMES];
+static int nnames;
+static int nextname;
+static unsigned short nextid;
+
+static int conncount = 10;	/* -c: open at the same time */
+static int nconns = 100;	/* -n: in all */
+static int nqueries = 1;	/* -q: per connection */
+static int depth = 1;		/* -d: outstanding per connection */
+static int resume = 0;		/* -r */
+static int axfr = 0;		/* -x */
+
+static int started, handshakes, resumed, failed;
+static long queries, answered, errors, records;
+
+static void
+usage(void) {
+	fprintf(stderr, "Usage: dotperf [-rx] [-a address] [-p port] "
+		"[-c concurrent] [-n connections]\n"
+		"               [-q queries] [-d depth] qname [qname ...]\n");
+	exit(1);
+}
+
+static double
+now(void) {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+/*
+ * Append a query for the next name, with its length prefix, to 'buf'.
+ */
+static int
+addquery(unsigned char *buf) {
+	const char *name = names[nextname++ % nnames];
+	const char *label, *dot;
+	unsigned char *p = buf + 2;
+	int len;
+
+	*p++ = nextid >> 8;
+	*p++ = nextid++ & 0xff;
+	memset(p, 0, 10);
+	p[3] = 1;			/* QDCOUNT */
+	p += 10;
+	for (label = name; *label != '\0'; label = dot + 1) {
+		dot = strchr(label, '.');
+		if (dot == NULL)
+			dot = label + strlen(label);
+		len = dot - label;
+		if (len == 0 || len > 63 || p - buf + len > MAXQUERY - 6)
+			break;
+		*p++ = len;
+		memcpy(p, label, len);
+		p += len;
+		if (*dot == '\0')
+			break;
+	}
+	*p++ = 0;
+	*p++ = 0; *p++ = axfr ? 252 : 1; /* AXFR or A */
+	*p++ = 0; *p++ = 1;		/* IN */
+
+	len = p - buf - 2;
+	buf[0] = len >> 8;
+	buf[1] = len & 0xff;
+	return (len + 2);
+}
+
+/*
+ * Return the offset just past the name at 'off' in the 'len' bytes
+ * of 'msg', or -1 if it runs past the end.
+ */
+static int
+skipname(const unsigned char *msg, int len, int off) {
+	while (off < len) {
+		if ((msg[off] & 0xc0) == 0xc0)
+			return (off + 2 <= len ? off + 2 : -1);
+		if (msg[off] == 0)
+			return (off + 1);
+		off += msg[off] + 1;
+	}
+	return (-1);
+}
+
+/*
+ * Count the answer records of the transfer message 'msg' and the SOA
+ * records among them.  Returns 0 if the message is malformed.
+ */
+static int
+countxfr(conn_t *conn, const unsigned char *msg, int len) {
+	int i, off = 12, count;
+
+	count = (msg[4] << 8) | msg[5];
+	for (i = 0; i < count; i++) {
+		off = skipname(msg, len, off);
+		if (off == -1 || off + 4 > len)
+			return (0);
+		off += 4;
+	}
+	count = (msg[6] << 8) | msg[7];
+	for (i = 0; i < count; i++) {
+		off = skipname(msg, len, off);
+		if (off == -1 || off + 10 > len)
+			return (0);
+		if (msg[off] == 0 && msg[off + 1] == 6)
+			conn->soas++;
+		off += 10 + ((msg[off + 8] << 8) | msg[off + 9]);
+		if (off > len)
+			return (0);
+		records++;
+	}
+	return (1);
+}
+
+static void
+conn_close(conn_t *conn, int ok) {
+	if (conn->ssl != NULL) {
+		if (ok)
+			(void)SSL_shutdown(conn->ssl);
+		SSL_free(conn->ssl);
+		conn->ssl = NULL;
+	}
+	if (conn->fd != -1)
+		close(conn->fd);
+	conn->fd = -1;
+	if (!ok)
+		failed++;
+	conn->state = conn_idle;
+	ERR_clear_error();
+}
+
+static void
+conn_start(conn_t *conn) {
+	int on = 1;
+
+	memset(conn, 0, offsetof(conn_t, wbuf));
+	conn->fd = socket(server.ss_family, SOCK_STREAM, 0);
+	if (conn->fd == -1) {
+		perror("socket");
+		exit(1);
+	}
+	(void)setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	(void)fcntl(conn->fd, F_SETFL, O_NONBLOCK);
+	started++;
+
+	if (connect(conn->fd, (struct sockaddr *)&server, serverlen) == -1 &&
+	    errno != EINPROGRESS)
+	{
+		conn->ssl = NULL;
+		conn_close(conn, 0);
+		return;
+	}
+	conn->state = conn_connecting;
+	conn->events = POLLOUT;
+}
+
+/*
+ * Set what to poll for after an SSL call returned 'n'.  Returns 0 if
+ * the connection failed.
+ */
+static int
+conn_wait(conn_t *conn, int n) {
+	switch (SSL_get_error(conn->ssl, n)) {
+	case SSL_ERROR_WANT_READ:
+		conn->events = POLLIN;
+		return (1);
+	case SSL_ERROR_WANT_WRITE:
+		conn->events = POLLOUT;
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Move the connection along as far as it goes without waiting.
+ */
+static void
+conn_run(conn_t *conn) {
+	unsigned char *p;
+	int n, len, err;
+	socklen_t errlen = sizeof(err);
+
+	switch (conn->state) {
+	case conn_connecting:
+		if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err,
+			       &errlen) == -1 || err != 0)
+		{
+			conn_close(conn, 0);
+			return;
+		}
+		conn->ssl = SSL_new(ctx);
+		if (conn->ssl == NULL ||
+		    SSL_set_fd(conn->ssl, conn->fd) != 1)
+		{
+			conn_close(conn, 0);
+			return;
+		}
+		if (resume && session != NULL)
+			(void)SSL_set_session(conn->ssl, session);
+		conn->state = conn_handshake;
+		/* FALLTHROUGH */
+
+	case conn_handshake:
+		n = SSL_connect(conn->ssl);
+		if (n <= 0) {
+			if (!conn_wait(conn, n))
+				conn_close(conn, 0);
+			return;
+		}
+		handshakes++;
+		if (SSL_session_reused(conn->ssl))
+			resumed++;
+		conn->state = conn_running;
+		/* FALLTHROUGH */
+
+	case conn_running:
+		break;
+
+	default:
+		return;
+	}
+
+	for (;;) {
+		/*
+		 * Send as many queries as may be outstanding; a write
+		 * that has to wait is repeated as it was.
+		 */
+		if (conn->wlen == 0) {
+			while (conn->sent < nqueries &&
+			       conn->sent - conn->answered < depth)
+			{
+				conn->wlen += addquery(conn->wbuf + conn->wlen);
+				conn->sent++;
+				queries++;
+			}
+		}
+		if (conn->wlen > 0) {
+			n = SSL_write(conn->ssl, conn->wbuf, conn->wlen);
+			if (n <= 0) {
+				if (!conn_wait(conn, n))
+					conn_close(conn, 0);
+				return;
+			}
+			conn->wlen = 0;
+		}
+
+		n = SSL_read(conn->ssl, conn->rbuf + conn->rlen,
+			     sizeof(conn->rbuf) - conn->rlen);
+		if (n <= 0) {
+			if (!conn_wait(conn, n))
+				conn_close(conn, 0);
+			return;
+		}
+		conn->rlen += n;
+
+		p = conn->rbuf;
+		while (conn->rlen - (p - conn->rbuf) >= 2) {
+			len = (p[0] << 8) | p[1];
+			if (conn->rlen - (p - conn->rbuf) < len + 2)
+				break;
+			if (len < 12 || (p[2 + 3] & 0x0f) != 0 ||
+			    (axfr && !countxfr(conn, p + 2, len)))
+			{
+				errors++;
+				conn->answered++;
+				conn->soas = 0;
+			} else if (!axfr || conn->soas >= 2) {
+				answered++;
+				conn->answered++;
+				conn->soas = 0;
+			}
+			p += len + 2;
+		}
+		conn->rlen -= p - conn->rbuf;
+		memmove(conn->rbuf, p, conn->rlen);
+
+		if (conn->answered == nqueries) {
+			if (resume) {
+				/*
+				 * TLS 1.3 tickets arrive after the
+				 * handshake; by now there is one.
+				 */
+				if (session != NULL)
+					SSL_SESSION_free(session);
+				session = SSL_get1_session(conn->ssl);
+			}
+			conn_close(conn, 1);
+			return;
+		}
+	}
+}
+
+static void
+getaddress(const char *addr, int port) {
+	struct sockaddr_in *sin = (struct sockaddr_in *)&server;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&server;
+
+	memset(&server, 0, sizeof(server));
+	if (inet_pton(AF_INET, addr, &sin->sin_addr) == 1) {
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		serverlen = sizeof(*sin);
+	} else if (inet_pton(AF_INET6, addr, &sin6->sin6_addr) == 1) {
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		serverlen = sizeof(*sin6);
+	} else {
+		fprintf(stderr, "bad address '%s'\n", addr);
+		exit(1);
+	}
+}
+
+int
+main(int argc, char **argv) {
+	static conn_t conns[MAXCONNS];
+	static struct pollfd pfds[MAXCONNS];
+	static int pidx[MAXCONNS];
+	const char *addr = "127.0.0.1";
+	int port = 853;
+	int ch, i, n, active;
+	double start, elapsed;
+
+	while ((ch = getopt(argc, argv, "a:c:d:n:p:q:rx")) != -1) {
+		switch (ch) {
+		case 'a':
+			addr = optarg;
+			break;
+		case 'c':
+			conncount = atoi(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'n':
+			nconns = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'q':
+			nqueries = atoi(optarg);
+			break;
+		case 'r':
+			resume = 1;
+			break;
+		case 'x':
+			axfr = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 1 || argc > MAXNAMES || conncount < 1 ||
+	    conncount > MAXCONNS || nconns < 1 || nqueries < 1 ||
+	    depth < 1 || depth > MAXDEPTH || port < 1 || port > 65535 ||
+	    (axfr && depth > 1))
+		usage();
+	for (i = 0; i < argc; i++)
+		names[nnames++] = argv[i];
+	if (conncount > nconns)
+		conncount = nconns;
+	getaddress(addr, port);
+
+	SSL_library_init();
+	SSL_load_error_strings();
+	ctx = SSL_CTX_new(TLS_client_method());
+	if (ctx == NULL) {
+		fprintf(stderr, "SSL_CTX_new failed\n");
+		exit(1);
+	}
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+
+	start = now();
+	for (i = 0; i < conncount; i++) {
+		conns[i].fd = -1;
+		conn_start(&conns[i]);
+	}
+
+	for (;;) {
+		active = 0;
+		for (i = 0; i < conncount; i++) {
+			if (conns[i].state == conn_idle && started < nconns)
+				conn_start(&conns[i]);
+			if (conns[i].state == conn_idle)
+				continue;
+			pfds[active].fd = conns[i].fd;
+			pfds[active].events = conns[i].events;
+			pfds[active].revents = 0;
+			pidx[active++] = i;
+		}
+		if (active == 0)
+			break;
+
+		n = poll(pfds, active, 10000);
+		if (n == -1 && errno != EINTR) {
+			perror("poll");
+			exit(1);
+		}
+		if (n == 0) {
+			fprintf(stderr, "timed out\n");
+			break;
+		}
+		for (i = 0; i < active; i++)
+			if (pfds[i].revents != 0)
+				conn_run(&conns[pidx[i]]);
+	}
+	elapsed = now() - start;
+	if (elapsed <= 0)
+		elapsed = 0.000001;
+
+	printf("connections: %d (handshakes %d, resumed %d, failed %d)\n",
+	       started, handshakes, resumed, failed);
+	printf("queries: sent %ld, answered %ld, errors %ld\n",
+	       queries, answered, errors);
+	if (axfr)
+		printf("transferred records: %ld\n", records);
+	printf("elapsed: %.3f s\n", elapsed);
+	printf("handshakes/s: %.1f\n", handshakes / elapsed);
+	printf("queries/s: %.1f\n", answered / elapsed);
+
+	if (session != NULL)
+		SSL_SESSION_free(session);
+	SSL_CTX_free(ctx);
+
+	return ((failed == 0 && answered == (long)nconns * nqueries) ? 0 : 1);
+}
+
+#else /* HAVE_OPENSSL_SSL */
+
+int
+main(int argc, char **argv) {
+	(void)argc;
+	(void)argv;
+
+	fprintf(stderr, "dotperf: built without OpenSSL TLS support\n");
+	return (1);
+}
+
+#endif /* HAVE_OPENSSL_SSL */
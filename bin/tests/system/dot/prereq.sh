@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+SYSTEMTESTTOP=..
+. $SYSTEMTESTTOP/conf.sh
+
+if $DOTPERF 2>&1 | grep "without OpenSSL TLS support" > /dev/null
+then
+    echo_i "This test requires OpenSSL's TLS library" >&2
+    exit 255
+fi
+
+if ! openssl version > /dev/null 2>&1
+then
+    echo_i "This test requires the openssl command" >&2
+    exit 255
+fi
+
+exit 0
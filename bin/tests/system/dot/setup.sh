@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+SYSTEMTESTTOP=..
+. $SYSTEMTESTTOP/conf.sh
+
+$SHELL clean.sh
+
+copy_setports ns1/named.conf.in ns1/named.conf
+
+# A zone that takes many messages to transfer.
+{
+	cat ns1/example.db | sed -e '/^;/d' -e 's/^@/large.example./'
+	awk 'END { for (i = 0; i < 5000; i++)
+		printf("host%d.large.example. A 10.1.%d.%d\n",
+		       i, int(i / 256), i % 256) }' < /dev/null
+} > ns1/large.db
+
+# A self-signed certificate for the server.
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 \
+	-subj "/CN=ns1.example" \
+	-keyout ns1/key.pem -out ns1/cert.pem > /dev/null 2>&1
@@ -0,0 +1,151 @@
+#!/bin/sh
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+SYSTEMTESTTOP=..
+. $SYSTEMTESTTOP/conf.sh
+
+DIGOPTS="-p ${PORT}"
+RNDCCMD="$RNDC -p ${CONTROLPORT} -c ../common/rndc.conf"
+DOTOPTS="-a 10.53.0.1 -p ${EXTRAPORT1}"
+
+status=0
+n=0
+
+# Print the current value of the ns1 counter described by $1.
+counter() {
+	rm -f ns1/named.stats
+	$RNDCCMD -s 10.53.0.1 stats > /dev/null 2>&1
+	value=`grep " $1\$" ns1/named.stats | tail -1 | awk '{print $1}'`
+	echo ${value:-0}
+}
+
+n=`expr $n + 1`
+echo_i "checking that plain DNS is still served ($n)"
+ret=0
+$DIG $DIGOPTS +tcp @10.53.0.1 a.example. a > dig.out.test$n || ret=1
+grep "status: NOERROR" dig.out.test$n > /dev/null || ret=1
+grep "^a.example..*10.0.0.1" dig.out.test$n > /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+n=`expr $n + 1`
+echo_i "checking pipelined queries over TLS ($n)"
+ret=0
+req0=`counter "requests received over TLS"`
+$DOTPERF $DOTOPTS -c 10 -n 10 -q 100 -d 16 \
+	a.example b.example c.example > dotperf.out.test$n 2>&1 || ret=1
+grep "^queries: sent 1000, answered 1000, errors 0" dotperf.out.test$n \
+	> /dev/null || ret=1
+req1=`counter "requests received over TLS"`
+[ `expr $req1 - $req0` -eq 1000 ] || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+n=`expr $n + 1`
+echo_i "checking the handshake counters ($n)"
+ret=0
+hs0=`counter "TLS handshakes completed"`
+$DOTPERF $DOTOPTS -c 5 -n 50 -q 1 a.example > dotperf.out.test$n 2>&1 || ret=1
+grep "^connections: 50 (handshakes 50, resumed 0, failed 0)" \
+	dotperf.out.test$n > /dev/null || ret=1
+hs1=`counter "TLS handshakes completed"`
+[ `expr $hs1 - $hs0` -eq 50 ] || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+for port in ${EXTRAPORT1} ${EXTRAPORT2}
+do
+	n=`expr $n + 1`
+	echo_i "checking session resumption on port $port ($n)"
+	ret=0
+	res0=`counter "TLS sessions resumed"`
+	$DOTPERF -a 10.53.0.1 -p $port -r -c 1 -n 20 -q 2 a.example \
+		> dotperf.out.test$n 2>&1 || ret=1
+	grep "^connections: 20 (handshakes 20, resumed 19, failed 0)" \
+		dotperf.out.test$n > /dev/null || ret=1
+	res1=`counter "TLS sessions resumed"`
+	[ `expr $res1 - $res0` -eq 19 ] || ret=1
+	if [ $ret != 0 ]; then echo_i "failed"; fi
+	status=`expr $status + $ret`
+done
+
+n=`expr $n + 1`
+echo_i "checking that plain DNS on a TLS listener fails the handshake ($n)"
+ret=0
+fail0=`counter "TLS handshakes failed"`
+$DIG -p ${EXTRAPORT1} +tcp +tries=1 +time=2 @10.53.0.1 a.example. a \
+	> dig.out.test$n 2>&1
+grep "status: NOERROR" dig.out.test$n > /dev/null && ret=1
+fail1=`counter "TLS handshakes failed"`
+[ `expr $fail1 - $fail0` -ge 1 ] || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+n=`expr $n + 1`
+echo_i "checking that TLS listeners survive a reconfiguration ($n)"
+ret=0
+$RNDCCMD -s 10.53.0.1 reconfig > rndc.out.test$n 2>&1 || ret=1
+$DOTPERF $DOTOPTS -c 2 -n 4 -q 10 -d 4 a.example \
+	> dotperf.out.test$n 2>&1 || ret=1
+grep "^queries: sent 40, answered 40, errors 0" dotperf.out.test$n \
+	> /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+# Zone transfers over TLS, first rendered for each transfer and then
+# from the shared stream; the records must match those sent over plain
+# TCP, so they cannot have gone out unencrypted.
+$DIG $DIGOPTS +tcp +noall +answer @10.53.0.1 large.example. axfr \
+	> dig.out.axfr
+nrecords=`grep -c . dig.out.axfr`
+for threads in 0 2
+do
+	if [ $threads -ne 0 ]; then
+		sed -e "s/transfer-render-threads 0;/transfer-render-threads $threads;/" \
+			ns1/named.conf > ns1/named.conf.tmp &&
+		mv ns1/named.conf.tmp ns1/named.conf
+		$RNDCCMD -s 10.53.0.1 reconfig > rndc.out.xfr$threads 2>&1
+	fi
+	n=`expr $n + 1`
+	echo_i "checking zone transfers over TLS with transfer-render-threads $threads ($n)"
+	ret=0
+	nextpart ns1/named.run > /dev/null
+	$DOTPERF $DOTOPTS -x -c 2 -n 4 -q 3 large.example \
+		> dotperf.out.test$n 2>&1 || ret=1
+	grep "^queries: sent 12, answered 12, errors 0" dotperf.out.test$n \
+		> /dev/null || ret=1
+	grep "^connections: 4 (handshakes 4, resumed 0, failed 0)" \
+		dotperf.out.test$n > /dev/null || ret=1
+	grep "^transferred records: `expr $nrecords \* 12`\$" \
+		dotperf.out.test$n > /dev/null || ret=1
+	shared=`nextpart ns1/named.run |
+		grep -c "large.example.*sending shared zone data"`
+	[ $threads -eq 0 -a $shared -eq 0 ] ||
+	[ $threads -ne 0 -a $shared -eq 12 ] || ret=1
+	if [ $ret != 0 ]; then echo_i "failed"; fi
+	status=`expr $status + $ret`
+done
+
+n=`expr $n + 1`
+echo_i "checking that the TLS connections are released ($n)"
+ret=0
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+	$RNDCCMD -s 10.53.0.1 status > rndc.out.test$n 2>&1
+	grep "^tcp clients: 0/1000" rndc.out.test$n > /dev/null && break
+	sleep 1
+done
+grep "^tcp clients: 0/1000" rndc.out.test$n > /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+echo_i "exit status: $status"
+[ $status -eq 0 ] || exit 1
@@ -10,8 +10,9 @@
 # information regarding copyright ownership.
 
 #
-# Don't respond if the "norespond" file exists; otherwise respond to
-# any A or AAAA query.
+# Don't respond if the "norespond" file exists, or to names starting
+# with "hold" while the "hold" file exists; otherwise respond to any A
+# or AAAA query.
 #
 
 use IO::File;
@@ -33,6 +34,9 @@ sub rmpid { unlink "ans.pid"; exit 1; };
 $SIG{INT} = \&rmpid;
 $SIG{TERM} = \&rmpid;
 
+# Tests read the order in which queries arrive from ans.run.
+$| = 1;
+
 for (;;) {
 	$sock->recv($buf, 512);
 
@@ -62,6 +66,8 @@ for (;;) {
 
 	if (-e 'norespond') {
 		$donotrespond = 1;
+	} elsif (-e 'hold' && $qname =~ /^hold\./i) {
+		$donotrespond = 1;
 	} else {
 		$packet->header->aa(1);
 		if ($qtype eq "A") {
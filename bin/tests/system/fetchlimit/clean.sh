@@ -11,6 +11,6 @@
 
 rm -f */named.conf */named.memstats */ans.run */named.recursing */named.run
 rm -f dig.out*
-rm -f ans4/norespond
+rm -f ans4/norespond ans4/hold
 rm -f ns3/named.stats ns3/named_dump.db
 rm -f burst.input.*
@@ -182,5 +182,52 @@ echo_i "clients count exceeded 360 on $exceeded trials (expected 0)"
 if [ $ret != 0 ]; then echo_i "failed"; fi
 status=`expr $status + $ret`
 
+copy_setports ns3/named4.conf.in ns3/named.conf
+$RNDCCMD reconfig 2>&1 | sed 's/^/ns3 /' | cat_i
+
+echo_i "checking queued fetches are admitted in priority order"
+ret=0
+rm -f ans4/norespond
+# let the fetches left over from the earlier tests finish
+for try in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+    stat 0 && break
+    sleep 1
+done
+$RNDCCMD flush
+lines=`wc -l < ans4/ans.run`
+# hold the only slot for lamesub.example, then queue two fetches with a
+# single client each followed by one which three clients are waiting on
+touch ans4/hold
+$DIG @10.53.0.3 -p ${PORT} a hold.lamesub.example > dig.out.hold &
+sleep 1
+$DIG @10.53.0.3 -p ${PORT} a first.lamesub.example > dig.out.first &
+sleep 1
+$DIG @10.53.0.3 -p ${PORT} a second.lamesub.example > dig.out.second &
+sleep 1
+for n in 1 2 3; do
+    $DIG @10.53.0.3 -p ${PORT} a joined.lamesub.example > dig.out.joined.$n &
+done
+sleep 1
+rm -f ans4/hold
+wait
+for f in dig.out.hold dig.out.first dig.out.second dig.out.joined.*; do
+    grep "status: NOERROR" $f > /dev/null || ret=1
+done
+order=`sed "1,${lines}d" ans4/ans.run |
+       grep -o '[a-z]*\.lamesub\.example' | awk '!seen[$0]++' |
+       sed 's/\.lamesub\.example//' | tr '\n' ' '`
+echo_i "order of queries sent: $order"
+[ "$order" = "hold joined first second " ] || ret=1
+rm -f ns3/named.stats
+$RNDCCMD stats
+for try in 1 2 3 4 5; do
+    [ -f ns3/named.stats ] && break
+    sleep 1
+done
+queued=`grep 'queued due to zone quota' ns3/named.stats | sed 's/ *\([0-9][0-9]*\) queued.*/\1/'`
+[ "${queued:-0}" -ge 3 ] || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
 echo_i "exit status: $status"
 [ $status -eq 0 ] || exit 1
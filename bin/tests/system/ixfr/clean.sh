@@ -10,12 +10,14 @@
 # information regarding copyright ownership.
 
 rm -f ns1/myftp.db
+rm -f ns1/compact.bk ns1/batch.bk ns1/*.jnl
 rm -f ns3/*.jnl ns3/mytest.db ns3/subtest.db
 rm -f ns4/*.jnl ns4/*.db
 rm -f */named.memstats
 rm -f */named.conf
 rm -f */named.run
 rm -f */ans.run
-rm -f dig.out dig.out1 dig.out2 dig.out3
+rm -f dig.out dig.out1 dig.out2 dig.out3 dig.out.compact dig.out.batch
+rm -f journalprint.out
 rm -f ns3/large.db
 rm -f ns*/named.lock
@@ -307,5 +307,284 @@ if [ ${ret} != 0 ]; then
 	status=1;
 fi
 
+echo_i "testing IXFR in progress when a journal compaction ends"
+ret=0
+
+# The journal of "compact" on ns1 is compacted by "rndc sync".  ns1 runs
+# with "-T compactdelay=5", so the compaction waits 5 seconds after
+# taking its snapshot of the journal; an IXFR from ans2 is started
+# meanwhile, and ans2 does not answer it, so the transfer is still
+# running when the compaction tries to finish.
+
+# Answer SOA queries with serial $1, and IXFR queries from serial
+# $1 - 1 by adding a TXT record, unless $2 is "hang".
+compact_ixfr() {
+    old=`expr $1 - 1`
+    {
+	echo "/compact SOA/"
+	echo "compact. 300 SOA ns.compact. root.compact. $1 300 300 604800 300"
+	if [ "$2" != hang ]
+	then
+	    echo "/compact IXFR/"
+	    echo "compact. 300 SOA ns.compact. root.compact. $1 300 300 604800 300"
+	    echo "compact. 300 SOA ns.compact. root.compact. $old 300 300 604800 300"
+	    echo "compact. 300 SOA ns.compact. root.compact. $1 300 300 604800 300"
+	    i=0
+	    while [ $i -lt 8 ]
+	    do
+		i=`expr $i + 1`
+		echo "txt$1-$i.compact. 300 TXT \"serial $1 record $i: $LONGTXT\""
+	    done
+	    echo "compact. 300 SOA ns.compact. root.compact. $1 300 300 604800 300"
+	fi
+    } | $SENDCMD
+    sleep 1
+}
+
+wait_for_serial() {
+    for i in 0 1 2 3 4 5 6 7 8 9
+    do
+	$DIG $DIGOPTS @10.53.0.1 compact. SOA > dig.out.compact
+	awk '$4 == "SOA" { print $7 }' dig.out.compact | grep "^$1\$" > /dev/null && return 0
+	sleep 1
+    done
+    return 1
+}
+
+LONGTXT="xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+
+$SENDCMD <<EOF
+/compact SOA/
+compact.	300	SOA	ns.compact. root.compact. 1 300 300 604800 300
+/AXFR/
+compact.	300	SOA	ns.compact. root.compact. 1 300 300 604800 300
+/AXFR/
+compact.	300	NS	ns.compact.
+/AXFR/
+compact.	300	SOA	ns.compact. root.compact. 1 300 300 604800 300
+EOF
+
+sleep 1
+
+cat <<EOF >>ns1/named.conf
+zone "compact" {
+	type slave;
+	file "compact.bk";
+	max-journal-size 2k;
+	masters { 10.53.0.2; };
+};
+EOF
+
+$RNDCCMD 10.53.0.1 reload | sed 's/^/ns1 /' | cat_i
+wait_for_serial 1 || ret=1
+
+for serial in 2 3 4
+do
+    compact_ixfr $serial
+    $RNDCCMD 10.53.0.1 refresh compact | sed 's/^/ns1 /' | cat_i
+    wait_for_serial $serial || ret=1
+done
+
+compact_ixfr 5 hang
+nextpart ns1/named.run > /dev/null
+$RNDCCMD 10.53.0.1 sync compact | sed 's/^/ns1 /' | cat_i
+for i in 0 1 2 3 4 5 6 7 8 9
+do
+    nextpart ns1/named.run | grep "zone_journal_compact: zone compact/IN: target journal size" > /dev/null && break
+    sleep 1
+done
+$RNDCCMD 10.53.0.1 refresh compact | sed 's/^/ns1 /' | cat_i
+for i in 0 1 2 3 4 5 6 7 8 9
+do
+    grep "zone compact/IN: journal compaction deferred: zone transfer in progress" ns1/named.run > /dev/null && break
+    sleep 1
+done
+grep "zone compact/IN: journal compaction deferred: zone transfer in progress" ns1/named.run > /dev/null || {
+    echo_i "compaction did not wait for the transfer"; ret=1;
+}
+grep "zone compact/IN: dns_journal_compact: success" ns1/named.run > /dev/null && ret=1
+
+# Stopping ns1 gives up the transfer.  Once restarted, it replays the
+# journal and completes the IXFR to serial 5, and the journal can then
+# be compacted.
+$PERL $SYSTEMTESTTOP/stop.pl . ns1
+compact_ixfr 5
+$PERL $SYSTEMTESTTOP/start.pl --noclean --restart --port ${PORT} . ns1
+wait_for_serial 4 || ret=1
+$RNDCCMD 10.53.0.1 refresh compact | sed 's/^/ns1 /' | cat_i
+wait_for_serial 5 || ret=1
+$DIG $DIGOPTS @10.53.0.1 txt4-8.compact. TXT > dig.out.compact
+grep "serial 4 record 8" dig.out.compact > /dev/null || ret=1
+$DIG $DIGOPTS @10.53.0.1 txt5-8.compact. TXT > dig.out.compact
+grep "serial 5 record 8" dig.out.compact > /dev/null || ret=1
+$RNDCCMD 10.53.0.1 sync compact | sed 's/^/ns1 /' | cat_i
+for i in 0 1 2 3 4 5 6 7 8 9
+do
+    grep "zone compact/IN: dns_journal_compact: success" ns1/named.run > /dev/null && break
+    sleep 1
+done
+grep "zone compact/IN: dns_journal_compact: success" ns1/named.run > /dev/null || ret=1
+$JOURNALPRINT ns1/compact.bk.jnl > journalprint.out || ret=1
+grep "^add compact.*SOA.* 5 300 300 604800 300" journalprint.out > /dev/null || ret=1
+
+[ $ret -eq 0 ] || { echo_i "failed"; status=1; }
+
+echo_i "testing IXFR changes applied in batches"
+ret=0
+
+# ns1 runs with "-T xfrinapplydelay=50", so each batch of changes is
+# reported as applied 50ms late and the transfer has to stop reading
+# once XFRIN_MAXAPPLIES (16) batches are queued.  ans2 sends the
+# records after each "/batch IXFR/" line as a message of its own.
+
+soa() {
+    echo "batch. 300 SOA ns.batch. root.batch. $1 300 300 604800 300"
+}
+
+# Print 'count' records "$1-<n>.batch. A ..." from n = 'first' on,
+# starting a new message every 50 records.
+records() {
+    awk -v p=$1 -v first=$2 -v count=$3 'END {
+	for (i = first; i < first + count; i++) {
+	    if (i > first && (i - first) % 50 == 0)
+		print "/batch IXFR/";
+	    printf("%s-%d.batch. 300 A 10.53.%d.%d\n", p, i,
+		   int(i / 256), i % 256);
+	}
+    }' < /dev/null
+}
+
+wait_for_batch_serial() {
+    for i in 0 1 2 3 4 5 6 7 8 9
+    do
+	$DIG $DIGOPTS @10.53.0.1 batch. SOA > dig.out.batch
+	awk '$4 == "SOA" { print $7 }' dig.out.batch | grep "^$1\$" > /dev/null && return 0
+	sleep 1
+    done
+    return 1
+}
+
+{
+    echo "/batch SOA/"
+    soa 1
+    echo "/AXFR/"
+    soa 1
+    echo "/AXFR/"
+    echo "batch. 300 NS ns.batch."
+    echo "ns.batch. 300 A 10.53.0.2"
+    echo "/AXFR/"
+    soa 1
+} | $SENDCMD
+sleep 1
+
+cat <<EOF >>ns1/named.conf
+zone "batch" {
+	type slave;
+	file "batch.bk";
+	max-records 2000;
+	masters { 10.53.0.2; };
+};
+EOF
+
+$RNDCCMD 10.53.0.1 reload | sed 's/^/ns1 /' | cat_i
+wait_for_batch_serial 1 || ret=1
+
+# Serial 2 adds x.batch and b-0 to b-1499; serial 3 deletes x.batch
+# and b-0 to b-999 again and adds x.batch back with new data, so the
+# batches only give this result if they are applied in order.
+{
+    echo "/batch SOA/"
+    soa 3
+    echo "/batch IXFR/"
+    soa 3
+    soa 1
+    soa 2
+    echo 'x.batch. 300 TXT "first"'
+    echo "/batch IXFR/"
+    records b 0 1500
+    echo "/batch IXFR/"
+    soa 2
+    echo 'x.batch. 300 TXT "first"'
+    echo "/batch IXFR/"
+    records b 0 1000
+    echo "/batch IXFR/"
+    soa 3
+    echo 'x.batch. 300 TXT "second"'
+    soa 3
+} | $SENDCMD
+sleep 1
+nextpart ns1/named.run > /dev/null
+$RNDCCMD 10.53.0.1 refresh batch | sed 's/^/ns1 /' | cat_i
+wait_for_batch_serial 3 || ret=1
+nextpart ns1/named.run | grep "transfer of 'batch/IN' from 10.53.0.2#${PORT}: [0-9]* batches of changes queued, pausing reads" > /dev/null || {
+    echo_i "reads were not paused"; ret=1;
+}
+$DIG $DIGOPTS @10.53.0.1 x.batch. TXT > dig.out.batch
+grep '"second"' dig.out.batch > /dev/null || ret=1
+grep '"first"' dig.out.batch > /dev/null && ret=1
+$DIG $DIGOPTS @10.53.0.1 b-999.batch. A > dig.out.batch
+grep "^b-999" dig.out.batch > /dev/null && ret=1
+$DIG $DIGOPTS @10.53.0.1 b-1000.batch. A > dig.out.batch
+grep "^b-1000.batch.*10.53.3.232" dig.out.batch > /dev/null || ret=1
+[ $ret -eq 0 ] || { echo_i "failed"; status=1; }
+
+echo_i "testing IXFR rollback when a later batch fails"
+ret=0
+
+# Serial 4 adds c-0 to c-9.  Serial 5 adds d-0 to d-2049, which takes
+# the zone over max-records (2000) in one of its later batches; the
+# changes for serial 5 already applied must be rolled back, leaving
+# the zone and its journal at serial 4.
+{
+    echo "/batch SOA/"
+    soa 5
+    echo "/batch IXFR/"
+    soa 5
+    soa 3
+    soa 4
+    records c 0 10
+    echo "/batch IXFR/"
+    soa 4
+    soa 5
+    echo "/batch IXFR/"
+    records d 0 2050
+    echo "/batch IXFR/"
+    soa 5
+} | $SENDCMD
+sleep 1
+$RNDCCMD 10.53.0.1 refresh batch | sed 's/^/ns1 /' | cat_i
+for i in 0 1 2 3 4 5 6 7 8 9
+do
+    nextpart ns1/named.run | grep "transfer of 'batch/IN' from 10.53.0.2#${PORT}: Transfer status: too many records" > /dev/null && break
+    sleep 1
+done
+[ $i -lt 9 ] || { echo_i "transfer did not fail"; ret=1; }
+
+check_batch_serial4() {
+    $DIG $DIGOPTS @10.53.0.1 batch. SOA > dig.out.batch
+    awk '$4 == "SOA" { print $7 }' dig.out.batch | grep "^4\$" > /dev/null || return 1
+    $DIG $DIGOPTS @10.53.0.1 c-9.batch. A > dig.out.batch
+    grep "^c-9.batch" dig.out.batch > /dev/null || return 1
+    $DIG $DIGOPTS @10.53.0.1 d-0.batch. A > dig.out.batch
+    grep "^d-0.batch" dig.out.batch > /dev/null && return 1
+    $JOURNALPRINT ns1/batch.bk.jnl > journalprint.out || return 1
+    grep "^add batch.*SOA.* 4 300 300 604800 300" journalprint.out > /dev/null || return 1
+    grep " 5 300 300 604800 300" journalprint.out > /dev/null && return 1
+    grep "^add d-" journalprint.out > /dev/null && return 1
+    return 0
+}
+check_batch_serial4 || ret=1
+
+# The journal replays to serial 4 when ns1 is restarted.
+{
+    echo "/batch SOA/"
+    soa 4
+} | $SENDCMD
+$PERL $SYSTEMTESTTOP/stop.pl . ns1
+$PERL $SYSTEMTESTTOP/start.pl --noclean --restart --port ${PORT} . ns1
+wait_for_batch_serial 4 || ret=1
+check_batch_serial4 || ret=1
+[ $ret -eq 0 ] || { echo_i "failed"; status=1; }
+
 echo_i "exit status: $status"
 [ $status -eq 0 ] || exit 1
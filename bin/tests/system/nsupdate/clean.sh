@@ -19,10 +19,12 @@ rm -f */named.run */ans.run
 rm -f */named.conf
 rm -f Kxxx.*
 rm -f dig.out.*
+rm -f jp.out.ns1.*
 rm -f jp.out.ns3.*
 rm -f ns*/named.lock
 rm -f */*.jnl
 rm -f ns1/example.db ns1/unixtime.db ns1/yyyymmddvv.db ns1/update.db ns1/other.db ns1/keytests.db
+rm -f ns1/group.db
 rm -f ns1/many.test.db
 rm -f ns1/maxjournal.db
 rm -f ns1/md5.key ns1/sha1.key ns1/sha224.key ns1/sha256.key ns1/sha384.key
@@ -656,6 +656,80 @@ if [ $ret -ne 0 ]; then
     status=1
 fi
 
+n=`expr $n + 1`
+ret=0
+echo_i "check that a failing update in a group is backed out on its own ($n)"
+#
+# Send bursts of updates at once so that they queue up on the zone task
+# and are committed as a group.  Every third update adds an MX record
+# pointing at an address, which "check-mx fail" rejects after the update
+# has been applied to the group's version, so it has to be backed out;
+# every fifth has a prerequisite that does not hold.
+#
+try=0
+grouped=no
+while [ $try -lt 10 -a $grouped = no ]
+do
+    try=`expr $try + 1`
+    i=0
+    while [ $i -lt 30 ]
+    do
+	i=`expr $i + 1`
+	name=t$try-$i.group.nil.
+	{
+	    echo "server 10.53.0.1 ${PORT}"
+	    case $i in
+	    *[05]) echo "prereq yxdomain absent.group.nil." ;;
+	    esac
+	    echo "update add $name 600 A 10.53.0.$i"
+	    case `expr $i % 3` in
+	    0) echo "update add $name 600 MX 10 10.53.0.$i" ;;
+	    esac
+	    echo "send"
+	} | $NSUPDATE > nsupdate.out.test$n.$try.$i 2>&1 &
+    done
+    wait
+    grep "'group.nil/IN': committing a group of [0-9]* updates, [1-9]" \
+	ns1/named.run > /dev/null && grouped=yes
+done
+[ $grouped = yes ] || { echo_i "no group with a failed update formed"; ret=1; }
+
+check_group() {
+    t=1
+    while [ $t -le $try ]
+    do
+	i=0
+	while [ $i -lt 30 ]
+	do
+	    i=`expr $i + 1`
+	    name=t$t-$i.group.nil.
+	    $DIG $DIGOPTS +tcp @10.53.0.1 $name A > dig.out.ns1.test$n.$1
+	    if [ `expr $i % 3` -eq 0 -o `expr $i % 5` -eq 0 ]
+	    then
+		grep "ANSWER: 0," dig.out.ns1.test$n.$1 > /dev/null ||
+		    { echo_i "$name was added ($1)"; ret=1; }
+		grep "^add $name" jp.out.ns1.test$n > /dev/null &&
+		    { echo_i "$name is in the journal"; ret=1; }
+	    else
+		grep "^$name.*10.53.0.$i\$" dig.out.ns1.test$n.$1 > /dev/null ||
+		    { echo_i "$name is missing ($1)"; ret=1; }
+	    fi
+	done
+	t=`expr $t + 1`
+    done
+}
+# The journal must hold only the updates that succeeded, and replaying
+# it onto the unchanged zone file must give the same zone.
+$JOURNALPRINT ns1/group.db.jnl > jp.out.ns1.test$n
+check_group before
+$RNDCCMD 10.53.0.1 halt 2>&1 | sed 's/^/ns1 /' | cat_i
+$PERL $SYSTEMTESTTOP/start.pl --noclean --restart --port ${PORT} . ns1
+check_group after
+if [ $ret -ne 0 ]; then
+    echo_i "failed"
+    status=1
+fi
+
 n=`expr $n + 1`
 ret=0
 echo_i "add a record which is truncated when logged. ($n)"
@@ -13,4 +13,5 @@ rm -f */named.conf
 rm -f */named.memstats
 rm -f */named.run
 rm -f raw* output*
+rm -f load.*
 rm -f ns*/named.lock
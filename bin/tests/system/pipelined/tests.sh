@@ -71,5 +71,43 @@ grep "address family not supported" output4.mdig > /dev/null || ret=1
 if [ $ret != 0 ]; then echo_i "failed"; fi
 status=`expr $status + $ret`
 
+echo_i "check mdig load mode over UDP"
+ret=0
+$MDIG $MDIGOPTS +count=2000 +inflight=50 @10.53.0.2 \
+	a.examplea b.examplea c.examplea > load.udp.mdig 2>&1 || ret=1
+grep "^;; Queries sent: 2000$" load.udp.mdig > /dev/null || ret=1
+grep "^;; Responses received: 2000 (100.00%)" load.udp.mdig > /dev/null || ret=1
+grep "^;; Queries lost: 0$" load.udp.mdig > /dev/null || ret=1
+grep "^;;   NOERROR *2000$" load.udp.mdig > /dev/null || ret=1
+grep "^;; \(Late\|Unexpected\) responses" load.udp.mdig > /dev/null && ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+echo_i "check mdig load mode over TCP"
+ret=0
+$MDIG $MDIGOPTS +vc +connections=4 +count=2000 +inflight=64 @10.53.0.2 \
+	a.examplea b.examplea c.examplea > load.tcp.mdig 2>&1 || ret=1
+grep "^;; Queries sent: 2000$" load.tcp.mdig > /dev/null || ret=1
+grep "^;; Responses received: 2000 (100.00%)" load.tcp.mdig > /dev/null || ret=1
+grep "^;; Queries lost: 0$" load.tcp.mdig > /dev/null || ret=1
+grep "^;;   NOERROR *2000$" load.tcp.mdig > /dev/null || ret=1
+grep "^;; \(Late\|Unexpected\) responses" load.tcp.mdig > /dev/null && ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+# ns5 answers 1.5 seconds late, after mdig has given up on each query
+# and sent the next one from the same slot; those responses must not be
+# taken for the answer to the next query.
+echo_i "check mdig load mode does not match late responses"
+ret=0
+$MDIG $MDIGOPTS +count=3 +inflight=1 +timeout=1 @10.53.0.5 \
+	a.examplec > load.late.mdig 2>&1 || ret=1
+grep "^;; Queries sent: 3$" load.late.mdig > /dev/null || ret=1
+grep "^;; Responses received: 0 " load.late.mdig > /dev/null || ret=1
+grep "^;; Queries lost: 3$" load.late.mdig > /dev/null || ret=1
+grep "^;; Late responses: 2$" load.late.mdig > /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
 echo_i "exit status: $status"
 [ $status -eq 0 ] || exit 1
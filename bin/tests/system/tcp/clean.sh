@@ -14,4 +14,6 @@ rm -f */named.run
 rm -f */named.conf
 rm -f */named.stats
 rm -f dig.out*
+rm -f rndc.out*
+rm -f tcpconns.out
 rm -f ns*/named.lock
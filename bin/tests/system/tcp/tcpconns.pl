@@ -0,0 +1,161 @@
+#!/usr/bin/perl
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+# Load a name server with many concurrent, mostly idle TCP connections.
+#
+# Every connection is opened and sends one query.  While all of them
+# are held open and idle, an optional command is run (for example to
+# look at "rndc status") and the script optionally waits.  Then every
+# connection sends a burst of pipelined queries at once and waits for
+# all the responses, which may come back in any order.
+#
+# Usage: tcpconns.pl [-a address] [-p port] [-n connections]
+#                    [-q queries] [-c command] [-w seconds]
+#                    qname [qname ...]
+#
+# The queries cycle through the given names, asking for type A.
+# The exit status is 0 if every query was answered with NOERROR.
+#
+# The number of connections is limited by the number of files this
+# process may open; raise it with "ulimit -n" for large loads.
+
+require 5.006_001;
+
+use strict;
+use Getopt::Std;
+use IO::Socket;
+
+sub usage {
+    print STDERR ("Usage: tcpconns.pl [-a address] [-p port] " .
+		  "[-n connections] [-q queries] [-c command] " .
+		  "[-w seconds] qname [qname ...]\n");
+    exit 1;
+}
+
+my %options = ();
+getopts("a:c:n:p:q:w:", \%options) or usage();
+
+my $addr = "127.0.0.1";
+$addr = $options{a} if defined $options{a};
+
+my $port = 53;
+$port = $options{p} if defined $options{p};
+
+my $nconns = 100;
+$nconns = $options{n} if defined $options{n};
+
+my $nqueries = 4;
+$nqueries = $options{q} if defined $options{q};
+
+my @names = @ARGV;
+usage() if (@names == 0 || $nconns < 1 || $nqueries < 1);
+
+my $nextid = 0;
+my $nextname = 0;
+
+# Build a query for the next name, with its TCP length prefix.
+sub query {
+    my ($id) = @_;
+    my $name = $names[$nextname++ % @names];
+    my $msg = pack("nnnnnn", $id, 0, 1, 0, 0, 0);
+    foreach my $label (split(/\./, $name)) {
+	$msg .= pack("C", length($label)) . $label;
+    }
+    $msg .= pack("Cnn", 0, 1, 1);
+    return (pack("n", length($msg)) . $msg);
+}
+
+sub readn {
+    my ($sock, $len) = @_;
+    my $buf = "";
+    while (length($buf) < $len) {
+	my $n = sysread($sock, $buf, $len - length($buf), length($buf));
+	return (undef) if (!defined($n) || $n == 0);
+    }
+    return ($buf);
+}
+
+# Read one response; return its id and rcode.
+sub response {
+    my ($sock) = @_;
+    my $len = readn($sock, 2);
+    return () unless defined($len);
+    my $msg = readn($sock, unpack("n", $len));
+    return () unless defined($msg) && length($msg) >= 12;
+    my ($id, $flags) = unpack("nn", $msg);
+    return ($id, $flags & 0x0f);
+}
+
+# Send 'count' queries on every connection, then collect the responses.
+sub burst {
+    my ($count, $socks) = @_;
+    my @pending;
+    my $answered = 0;
+
+    foreach my $i (0 .. $#$socks) {
+	my $wire = "";
+	foreach (1 .. $count) {
+	    my $id = $nextid++ & 0xffff;
+	    $pending[$i]{$id} = 1;
+	    $wire .= query($id);
+	}
+	syswrite($socks->[$i], $wire) == length($wire)
+	    or die "connection $i: write failed: $!\n";
+    }
+
+    foreach my $i (0 .. $#$socks) {
+	foreach (1 .. $count) {
+	    my ($id, $rcode) = response($socks->[$i]);
+	    if (!defined($id)) {
+		print "connection $i: closed by the server\n";
+		last;
+	    }
+	    if (!delete($pending[$i]{$id})) {
+		print "connection $i: unexpected response id $id\n";
+		next;
+	    }
+	    if ($rcode != 0) {
+		print "connection $i: response id $id has rcode $rcode\n";
+		next;
+	    }
+	    $answered++;
+	}
+    }
+    return ($answered);
+}
+
+my @socks;
+foreach my $i (1 .. $nconns) {
+    my $sock = IO::Socket::INET->new(PeerAddr => $addr,
+				     PeerPort => $port,
+				     Proto => "tcp")
+	or die "connection $i: $!\n";
+    push(@socks, $sock);
+}
+print "opened $nconns connections to $addr#$port\n";
+
+my $status = 0;
+my $answered = burst(1, \@socks);
+print "answered $answered/$nconns initial queries\n";
+$status = 1 if ($answered != $nconns);
+
+if (defined $options{c}) {
+    system($options{c}) == 0 or $status = 1;
+}
+sleep($options{w}) if defined $options{w};
+
+$answered = burst($nqueries, \@socks);
+print "answered $answered/" . $nconns * $nqueries . " pipelined queries\n";
+$status = 1 if ($answered != $nconns * $nqueries);
+
+close($_) foreach (@socks);
+
+exit($status);
@@ -53,5 +53,28 @@ if [ "$ntcp21" -ge "$ntcp22" ];then ret=1; fi
 if [ $ret != 0 ]; then echo_i "failed"; fi
 status=`expr $status + $ret`
 
+echo_i "check many concurrent TCP connections"
+ret=0
+$PERL tcpconns.pl -a 10.53.0.2 -p ${PORT} -n 300 -q 8 \
+	-c "$RNDCCMD -s 10.53.0.2 status > rndc.out.tcpconns 2>&1" \
+	a.example. mail.example. > tcpconns.out 2>&1 || ret=1
+# all connections are counted while they are idle
+grep "^tcp clients: 300/1000" rndc.out.tcpconns > /dev/null || ret=1
+grep "answered 2400/2400 pipelined queries" tcpconns.out > /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+echo_i "check the connections are released"
+ret=0
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+	$RNDCCMD -s 10.53.0.2 status > rndc.out.tcpconns 2>&1
+	grep "^tcp clients: 0/1000" rndc.out.tcpconns > /dev/null && break
+	sleep 1
+done
+grep "^tcp clients: 0/1000" rndc.out.tcpconns > /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
 echo_i "exit status: $status"
 [ $status -eq 0 ] || exit 1
@@ -87,6 +87,29 @@ do
 	[ $dumpit = 1 ] && cat verify.out.$n
 done
 
+n=`expr $n + 1`
+echo_i "checking that the output does not depend on the number of tasks ($n)"
+ret=0
+for file in zones/*.bad
+do
+	zone=`expr "$file" : 'zones/\(.*\).bad'`
+	case $zone in
+	zsk-only.*) only=-z;;
+	ksk-only.*) only=-z;;
+	*) only=;;
+	esac
+	$VERIFY -n 1 ${only} -o $zone $file 2>&1 |
+		grep -v "^Verified .* RRsets" > verify.out.$n.1
+	$VERIFY -n 3 ${only} -o $zone $file 2>&1 |
+		grep -v "^Verified .* RRsets" > verify.out.$n.3
+	cmp -s verify.out.$n.1 verify.out.$n.3 || {
+		echo_i "output differs for $zone"
+		ret=1
+	}
+done
+cat verify.out.$n.1 verify.out.$n.3 > verify.out.$n
+[ $ret = 0 ] || failed
+
 n=`expr $n + 1`
 echo_i "checking error message when -o is not used and a SOA record not at top of zone is found ($n)"
 ret=0
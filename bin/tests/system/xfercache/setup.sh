@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+SYSTEMTESTTOP=..
+. $SYSTEMTESTTOP/conf.sh
+
+$SHELL clean.sh
+
+#
+# Both servers serve the same zones; ns1 shares rendered AXFR streams
+# and ns2 renders every transfer separately.
+#
+makezone() {
+	awk -v n=$2 'BEGIN {
+		print "$TTL 300";
+		print "@ SOA ns1 hostmaster 1 3600 1200 604800 300";
+		print "@ NS ns1";
+		print "ns1 A 10.53.0.1";
+		for (i = 0; i < n; i++) {
+			printf("host%06d A 10.%d.%d.%d\n", i,
+			       int(i / 65536) % 256, int(i / 256) % 256,
+			       i % 256);
+			printf("host%06d TXT \"record %d\"\n", i, i);
+		}
+	}' > ns1/$1.db
+	cp ns1/$1.db ns2/$1.db
+}
+
+makezone small 500
+makezone large 20000
+
+copy_setports ns1/named.conf.in ns1/named.conf
+copy_setports ns2/named.conf.in ns2/named.conf
@@ -0,0 +1,95 @@
+#!/bin/sh
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+SYSTEMTESTTOP=..
+. $SYSTEMTESTTOP/conf.sh
+
+DIGOPTS="+tcp +noadd +nosea +nostat +noquest +nocomm +nocmd -p ${PORT}"
+RNDCCMD="$RNDC -c $SYSTEMTESTTOP/common/rndc.conf -p ${CONTROLPORT} -s"
+
+status=0
+n=0
+
+#
+# Start 'count' AXFRs of 'zone' from ns1 at once and wait for them all.
+#
+parallel_axfr() {
+	zone=$1 count=$2 tag=$3
+	i=0
+	while [ $i -lt $count ]; do
+		$DIG $DIGOPTS $zone. @10.53.0.1 axfr > dig.out.$tag.$i &
+		i=`expr $i + 1`
+	done
+	wait
+}
+
+#
+# Compare every copy of 'zone' fetched from ns1 with the one ns2 sends.
+#
+compare_axfr() {
+	zone=$1 count=$2 tag=$3
+	$DIG $DIGOPTS $zone. @10.53.0.2 axfr > dig.out.$tag.ns2 || return 1
+	grep "^$zone.*SOA" dig.out.$tag.ns2 > /dev/null || return 1
+	i=0
+	while [ $i -lt $count ]; do
+		digcomp dig.out.$tag.$i dig.out.$tag.ns2 || return 1
+		i=`expr $i + 1`
+	done
+	return 0
+}
+
+n=`expr $n + 1`
+echo_i "checking parallel AXFRs from a shared stream match ($n)"
+ret=0
+parallel_axfr small.example 10 small
+compare_axfr small.example 10 small || ret=1
+lines=`grep "small.example.*sending shared zone data" ns1/named.run | wc -l`
+[ $lines -eq 10 ] || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+n=`expr $n + 1`
+echo_i "checking AXFRs of a zone over transfer-render-max-size ($n)"
+ret=0
+parallel_axfr large.example 5 large
+compare_axfr large.example 5 large || ret=1
+lines=`grep "large.example.*zone larger than transfer-render-max-size" ns1/named.run | wc -l`
+[ $lines -eq 5 ] || ret=1
+grep "large.example.*sending shared zone data" ns1/named.run > /dev/null && ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+n=`expr $n + 1`
+echo_i "checking a new shared stream is rendered after the zone changes ($n)"
+ret=0
+sed 's/SOA ns1 hostmaster 1 /SOA ns1 hostmaster 2 /' ns1/small.db > ns1/small.db.new
+echo 'added TXT "new"' >> ns1/small.db.new
+mv ns1/small.db.new ns1/small.db
+cp ns1/small.db ns2/small.db
+$RNDCCMD 10.53.0.1 reload small.example 2>&1 | sed 's/^/ns1 /' | cat_i
+$RNDCCMD 10.53.0.2 reload small.example 2>&1 | sed 's/^/ns2 /' | cat_i
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	$DIG $DIGOPTS small.example. @10.53.0.1 soa > dig.out.soa.ns1
+	$DIG $DIGOPTS small.example. @10.53.0.2 soa > dig.out.soa.ns2
+	grep " 2 3600" dig.out.soa.ns1 > /dev/null &&
+	grep " 2 3600" dig.out.soa.ns2 > /dev/null && break
+	sleep 1
+done
+parallel_axfr small.example 10 changed
+compare_axfr small.example 10 changed || ret=1
+grep '^added.small.example.*"new"' dig.out.changed.0 > /dev/null || ret=1
+lines=`grep "small.example.*sending shared zone data" ns1/named.run | wc -l`
+[ $lines -eq 20 ] || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=`expr $status + $ret`
+
+echo_i "exit status: $status"
+[ $status -eq 0 ] || exit 1
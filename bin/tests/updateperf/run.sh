@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+usage () {
+    echo "Usage: $0 <number of clients> <updates per client>"
+    exit 1
+}
+
+if [ "$#" -ne 2 ]; then
+    usage
+fi
+
+nclients=$1
+nupdates=$2
+
+NSUPDATE=${NSUPDATE:-../../nsupdate/nsupdate}
+
+#
+# Each client adds its own names, so that every update has an effect
+# whatever the order the server gets them in.
+#
+[ -d updates ] || mkdir updates
+run=`date +%s`
+c=0
+while [ $c -lt $nclients ]; do
+    awk -v c=$c -v n=$nupdates -v run=$run 'BEGIN {
+        print "server 127.0.0.1 5300";
+        print "zone example";
+        for (i = 0; i < n; i++) {
+            printf "update add r%s-c%d-u%d.example 300 A 10.%d.%d.%d\n",
+                   run, c, i, c % 256, int(i / 256) % 256, i % 256;
+            print "send";
+        }
+    }' > updates/client$c
+    c=`expr $c + 1`
+done
+
+start=`date +%s.%N`
+c=0
+while [ $c -lt $nclients ]; do
+    $NSUPDATE updates/client$c > updates/client$c.out 2>&1 &
+    c=`expr $c + 1`
+done
+wait
+end=`date +%s.%N`
+
+failed=`cat updates/client*.out | grep -c .`
+awk -v s=$start -v e=$end -v n=`expr $nclients \* $nupdates` \
+    -v f=$failed 'BEGIN {
+        printf "%d updates in %.2f seconds: %.0f updates/second\n",
+               n, e - s, n / (e - s);
+        if (f != 0)
+            printf "%d lines of nsupdate errors in updates/\n", f;
+    }'
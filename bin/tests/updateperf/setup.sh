@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+if [ "$#" -ne 0 ]; then
+    echo "Usage: $0"
+    exit 1
+fi
+
+[ -d zones ] || mkdir zones
+rm -f zones/example.db.jnl
+cat > zones/example.db << EOF
+\$TTL 300
+@	IN SOA	ns1 hostmaster 1 3600 900 604800 300
+	IN NS	ns1
+ns1	IN A	127.0.0.1
+EOF
+
+cat << EOF
+options {
+        directory "`pwd`";
+        listen-on { 127.0.0.1; };
+        listen-on-v6 { none; };
+	port 5300;
+        pid-file "named.pid";
+        allow-query { any; };
+        allow-recursion { none; };
+        recursion no;
+        notify no;
+};
+
+logging {
+        channel basic {
+                file "`pwd`/named.log" versions 3 size 100m;
+                severity info;
+                print-time yes;
+        };
+        category default { basic; };
+        category update { null; };
+};
+
+zone example {
+        type master;
+        file "zones/example.db";
+        allow-update { any; };
+};
+EOF
@@ -82,6 +82,8 @@
 #define MAXTRIES 0xffffffff
 
 static isc_mem_t *mctx;
+static isc_timermgr_t *timermgr;
+static isc_socketmgr_t *socketmgr;
 static dns_requestmgr_t *requestmgr;
 static const char *batchname;
 static FILE *batchfp;
@@ -114,6 +116,10 @@ static isc_dscp_t dscp = -1;
 static unsigned char cookie_secret[33];
 static int onfly = 0;
 static char hexcookie[81];
+static isc_uint32_t load_count = 0;
+static isc_uint32_t load_inflight = 100;
+static isc_uint32_t load_qps = 0;
+static isc_uint32_t load_connections = 1;
 
 struct query {
 	char textname[MXNAME]; /*% Name we're going to be looking up */
@@ -144,6 +150,10 @@ struct query {
 static struct query default_query;
 static ISC_LIST(struct query) queries;
 
+ISC_PLATFORM_NORETURN_PRE static void
+fatal(const char *format, ...)
+ISC_FORMAT_PRINTF(1, 2) ISC_PLATFORM_NORETURN_POST;
+
 #define EDNSOPTS 100U
 /*% opcode text */
 static const char * const opcodetext[] = {
@@ -511,24 +521,22 @@ compute_cookie(unsigned char *cookie, size_t len) {
 	memmove(cookie, cookie_secret, 8);
 }
 
-static isc_result_t
-sendquery(struct query *query, isc_task_t *task)
-{
-	dns_request_t *request;
+/*%
+ * Build the query message for 'query'.  The question name is held in
+ * 'queryname', which must last until the message has been rendered.
+ */
+static dns_message_t *
+buildquery(struct query *query, dns_fixedname_t *queryname) {
 	dns_message_t *message;
 	dns_name_t *qname;
 	dns_rdataset_t *qrdataset;
 	isc_result_t result;
-	dns_fixedname_t queryname;
 	isc_buffer_t buf;
-	unsigned int options;
 
-	onfly++;
-
-	dns_fixedname_init(&queryname);
+	dns_fixedname_init(queryname);
 	isc_buffer_init(&buf, query->textname, strlen(query->textname));
 	isc_buffer_add(&buf, strlen(query->textname));
-	result = dns_name_fromtext(dns_fixedname_name(&queryname), &buf,
+	result = dns_name_fromtext(dns_fixedname_name(queryname), &buf,
 				   dns_rootname, 0, NULL);
 	CHECK("dns_name_fromtext", result);
 
@@ -559,7 +567,7 @@ sendquery(struct query *query, isc_task_t *task)
 	CHECK("dns_message_gettemprdataset", result);
 
 	dns_name_init(qname, NULL);
-	dns_name_clone(dns_fixedname_name(&queryname), qname);
+	dns_name_clone(dns_fixedname_name(queryname), qname);
 	dns_rdataset_makequestion(qrdataset, query->rdclass,
 				  query->rdtype);
 	ISC_LIST_APPEND(qname->list, qrdataset, link);
@@ -680,6 +688,22 @@ sendquery(struct query *query, isc_task_t *task)
 		add_opt(message, query->udpsize, query->edns, flags, opts, i);
 	}
 
+	return (message);
+}
+
+static isc_result_t
+sendquery(struct query *query, isc_task_t *task)
+{
+	dns_request_t *request;
+	dns_message_t *message;
+	dns_fixedname_t queryname;
+	isc_result_t result;
+	unsigned int options;
+
+	onfly++;
+
+	message = buildquery(query, &queryname);
+
 	options = 0;
 	if (tcp_mode)
 		options |= DNS_REQUESTOPT_TCP | DNS_REQUESTOPT_SHARE;
@@ -714,6 +738,672 @@ sendqueries(isc_task_t *task, isc_event_t *event)
 	return;
 }
 
+/*
+ * Load test mode, enabled by +count: the queries are rendered once and
+ * sent over and over, in turn, until +count have been sent.  At most
+ * +inflight are outstanding at any time, and with +qps they are sent at
+ * that steady rate.  Over TCP they are spread across +connections
+ * connections and pipelined.  A query that is not answered within its
+ * timeout is counted as lost; there are no retries.  Instead of the
+ * responses, a summary of the rcodes and latency is printed.
+ *
+ * The ID of each query is the index of the slot it occupies plus a
+ * multiple of +inflight, the slot's generation, which changes each time
+ * the slot is reused: the response is matched without a lookup, and a
+ * late response to a query that was counted as lost is not taken for
+ * the one that replaced it.  Its question must match too.  A slot is
+ * only reused once the send from its buffer has completed.
+ */
+#define LOAD_MAXINFLIGHT	65536
+#define LOAD_TICK		1000000		/* nanoseconds */
+#define LOAD_SCAN		100000		/* microseconds */
+#define LOAD_SUBBUCKETS		16
+#define LOAD_NBUCKETS		(LOAD_SUBBUCKETS * 40)
+#define LOAD_RBUFSIZE		(COMMSIZE + 2)
+
+typedef struct loadconn loadconn_t;
+
+typedef struct loadquery {
+	unsigned char *		wire;
+	unsigned int		length;
+	unsigned int		qlength;	/* header and question */
+	isc_uint64_t		timeout;	/* microseconds */
+} loadquery_t;
+
+typedef struct loadslot {
+	isc_boolean_t		busy;		/* query outstanding */
+	isc_boolean_t		sending;	/* buffer in use */
+	unsigned int		gen;
+	unsigned int		query;
+	loadconn_t *		conn;
+	isc_time_t		sent;
+	unsigned char *		buf;
+	unsigned int		next;		/* free list */
+} loadslot_t;
+
+struct loadconn {
+	isc_socket_t *		sock;
+	isc_boolean_t		ready;
+	isc_boolean_t		dead;
+	unsigned char *		rbuf;
+	unsigned int		rlen;
+};
+
+static loadquery_t *lqueries = NULL;
+static unsigned int nlqueries = 0;
+static loadslot_t *lslots = NULL;
+static unsigned int lfree, lbufsize;
+static loadconn_t *lconns = NULL;
+static unsigned int nlconns = 0, lnextconn = 0, lconnecting = 0;
+static isc_task_t *ltask = NULL;
+static isc_timer_t *ltimer = NULL;
+static isc_boolean_t ldone = ISC_FALSE;
+static isc_time_t lstart, lend, llast, lscan;
+
+static isc_uint64_t lsent, lreceived, loutstanding, llost;
+static isc_uint64_t lunexpected, llate, lerrors, ltruncated;
+static isc_uint64_t lrcodes[16];
+static isc_uint64_t lbuckets[LOAD_NBUCKETS];
+static isc_uint64_t lmin = ISC_UINT64_MAX, lmax, lsum;
+
+/*%
+ * Latency histogram: 16 buckets per power of two, so a value is known
+ * to within about 6%.
+ */
+static unsigned int
+load_bucket(isc_uint64_t us) {
+	unsigned int e = 0, b;
+
+	if (us < LOAD_SUBBUCKETS)
+		return ((unsigned int)us);
+	while ((us >> e) >= 2 * LOAD_SUBBUCKETS)
+		e++;
+	b = (e + 1) * LOAD_SUBBUCKETS +
+	    (unsigned int)((us >> e) - LOAD_SUBBUCKETS);
+	return (ISC_MIN(b, LOAD_NBUCKETS - 1));
+}
+
+static isc_uint64_t
+load_bucketvalue(unsigned int b) {
+	unsigned int e;
+
+	if (b < LOAD_SUBBUCKETS)
+		return (b);
+	e = b / LOAD_SUBBUCKETS - 1;
+	return ((isc_uint64_t)(LOAD_SUBBUCKETS + b % LOAD_SUBBUCKETS) << e);
+}
+
+static isc_uint64_t
+load_percentile(double p) {
+	isc_uint64_t want, seen = 0;
+	unsigned int b;
+
+	want = (isc_uint64_t)(p * lreceived / 100.0);
+	if (want == 0)
+		want = 1;
+	for (b = 0; b < LOAD_NBUCKETS; b++) {
+		seen += lbuckets[b];
+		if (seen >= want)
+			break;
+	}
+	return (ISC_MIN(ISC_MAX(load_bucketvalue(b), lmin), lmax));
+}
+
+static void
+load_render(struct query *query, loadquery_t *lq) {
+	dns_message_t *message;
+	dns_fixedname_t queryname;
+	dns_compress_t cctx;
+	isc_buffer_t *buf = NULL;
+	isc_region_t r;
+	isc_result_t result;
+	unsigned int o;
+
+	message = buildquery(query, &queryname);
+	result = isc_buffer_allocate(mctx, &buf, COMMSIZE);
+	CHECK("isc_buffer_allocate", result);
+	result = dns_compress_init(&cctx, -1, mctx);
+	CHECK("dns_compress_init", result);
+	result = dns_message_renderbegin(message, &cctx, buf);
+	CHECK("dns_message_renderbegin", result);
+	result = dns_message_rendersection(message, DNS_SECTION_QUESTION, 0);
+	CHECK("dns_message_rendersection", result);
+	result = dns_message_rendersection(message, DNS_SECTION_ADDITIONAL, 0);
+	CHECK("dns_message_rendersection", result);
+	result = dns_message_renderend(message);
+	CHECK("dns_message_renderend", result);
+	dns_compress_invalidate(&cctx);
+
+	isc_buffer_usedregion(buf, &r);
+	lq->wire = isc_mem_get(mctx, r.length);
+	if (lq->wire == NULL)
+		fatal("memory allocation failure");
+	memmove(lq->wire, r.base, r.length);
+	lq->length = r.length;
+	lq->timeout = (isc_uint64_t)query->timeout * 1000000;
+
+	/* The question name is the first thing rendered: no compression. */
+	for (o = 12; lq->wire[o] != 0; o += lq->wire[o] + 1)
+		;
+	lq->qlength = o + 1 + 4;
+
+	isc_buffer_free(&buf);
+	dns_message_destroy(&message);
+}
+
+static isc_boolean_t
+load_live(void) {
+	unsigned int i;
+
+	for (i = 0; i < nlconns; i++)
+		if (!lconns[i].dead)
+			return (ISC_TRUE);
+	return (ISC_FALSE);
+}
+
+static void
+load_free(loadslot_t *slot) {
+	slot->next = lfree;
+	lfree = (unsigned int)(slot - lslots);
+}
+
+/*%
+ * The query in 'slot' has been answered or lost.
+ */
+static void
+load_release(loadslot_t *slot) {
+	INSIST(slot->busy);
+
+	slot->busy = ISC_FALSE;
+	slot->conn = NULL;
+	if (!slot->sending)
+		load_free(slot);
+	loutstanding--;
+}
+
+static void
+load_senddone(isc_task_t *task, isc_event_t *event) {
+	isc_socketevent_t *sevent = (isc_socketevent_t *)event;
+	loadslot_t *slot = event->ev_arg;
+
+	UNUSED(task);
+
+	if (sevent->result != ISC_R_SUCCESS &&
+	    sevent->result != ISC_R_CANCELED)
+		lerrors++;
+	isc_event_free(&event);
+	if (ldone)
+		return;
+
+	INSIST(slot->sending);
+	slot->sending = ISC_FALSE;
+	if (!slot->busy)
+		load_free(slot);
+}
+
+/*%
+ * Send the next query if a slot and a connection are free.
+ */
+static isc_boolean_t
+load_sendone(void) {
+	loadslot_t *slot;
+	loadconn_t *conn = NULL;
+	loadquery_t *lq;
+	isc_region_t r;
+	isc_result_t result;
+	unsigned int i, id, index;
+
+	if (lfree == load_inflight)
+		return (ISC_FALSE);
+
+	for (i = 0; i < nlconns; i++) {
+		conn = &lconns[lnextconn++ % nlconns];
+		if (conn->ready && !conn->dead)
+			break;
+		conn = NULL;
+	}
+	if (conn == NULL)
+		return (ISC_FALSE);
+
+	index = lfree;
+	slot = &lslots[index];
+	lfree = slot->next;
+	INSIST(!slot->busy && !slot->sending);
+
+	slot->gen++;
+	if (slot->gen * load_inflight + index > 0xffff)
+		slot->gen = 0;
+	id = slot->gen * load_inflight + index;
+
+	slot->query = (unsigned int)(lsent % nlqueries);
+	lq = &lqueries[slot->query];
+	r.base = slot->buf;
+	r.length = lq->length;
+	if (tcp_mode) {
+		slot->buf[0] = (lq->length >> 8) & 0xff;
+		slot->buf[1] = lq->length & 0xff;
+		r.base += 2;
+		r.length += 2;
+	}
+	memmove(r.base, lq->wire, lq->length);
+	r.base[0] = (id >> 8) & 0xff;
+	r.base[1] = id & 0xff;
+	r.base = slot->buf;
+
+	slot->busy = ISC_TRUE;
+	slot->sending = ISC_TRUE;
+	slot->conn = conn;
+	TIME_NOW(&slot->sent);
+	if (tcp_mode)
+		result = isc_socket_send(conn->sock, &r, ltask,
+					 load_senddone, slot);
+	else
+		result = isc_socket_sendto(conn->sock, &r, ltask,
+					   load_senddone, slot, &dstaddr,
+					   NULL);
+	CHECK("isc_socket_send", result);
+
+	lsent++;
+	loutstanding++;
+	return (ISC_TRUE);
+}
+
+static void
+load_fill(void) {
+	isc_uint64_t due = load_count;
+
+	if (load_qps != 0) {
+		isc_time_t now;
+
+		TIME_NOW(&now);
+		due = (isc_uint64_t)((double)isc_time_microdiff(&now, &lstart)
+				     * load_qps / 1000000.0) + 1;
+		if (due > load_count)
+			due = load_count;
+	}
+
+	while (lsent < due && load_sendone())
+		;
+}
+
+static void
+load_report(void) {
+	isc_uint64_t elapsed;
+	unsigned int i;
+
+	/*
+	 * Waiting for lost queries to time out does not count.
+	 */
+	elapsed = isc_time_microdiff(lreceived != 0 ? &llast : &lend,
+				     &lstart);
+
+	printf(";; Queries sent: %" ISC_PRINT_QUADFORMAT "u\n", lsent);
+	printf(";; Responses received: %" ISC_PRINT_QUADFORMAT "u "
+	       "(%.2f%%), %" ISC_PRINT_QUADFORMAT "u truncated\n",
+	       lreceived, lsent != 0 ? 100.0 * lreceived / lsent : 0.0,
+	       ltruncated);
+	printf(";; Queries lost: %" ISC_PRINT_QUADFORMAT "u\n", llost);
+	if (llate != 0)
+		printf(";; Late responses: %" ISC_PRINT_QUADFORMAT "u\n",
+		       llate);
+	if (lunexpected != 0)
+		printf(";; Unexpected responses: %" ISC_PRINT_QUADFORMAT "u\n",
+		       lunexpected);
+	if (lerrors != 0)
+		printf(";; Network errors: %" ISC_PRINT_QUADFORMAT "u\n",
+		       lerrors);
+	for (i = 0; i < 16; i++) {
+		if (lrcodes[i] != 0)
+			printf(";;   %-10s %" ISC_PRINT_QUADFORMAT "u\n",
+			       rcode_totext(i), lrcodes[i]);
+	}
+	printf(";; Elapsed: %.3f seconds, %.0f queries/second\n",
+	       elapsed / 1000000.0,
+	       elapsed != 0 ? lreceived * 1000000.0 / elapsed : 0.0);
+	if (lreceived == 0)
+		return;
+	printf(";; Latency (ms): min %.3f, avg %.3f, max %.3f\n",
+	       lmin / 1000.0, (double)lsum / lreceived / 1000.0,
+	       lmax / 1000.0);
+	printf(";; Percentiles (ms): 50%% %.3f, 90%% %.3f, 99%% %.3f, "
+	       "99.9%% %.3f\n",
+	       load_percentile(50.0) / 1000.0, load_percentile(90.0) / 1000.0,
+	       load_percentile(99.0) / 1000.0,
+	       load_percentile(99.9) / 1000.0);
+}
+
+static void
+load_finish(void) {
+	unsigned int i;
+
+	ldone = ISC_TRUE;
+	TIME_NOW(&lend);
+	if (ltimer != NULL)
+		isc_timer_detach(&ltimer);
+	for (i = 0; i < nlconns; i++) {
+		if (lconns[i].sock == NULL)
+			continue;
+		isc_socket_cancel(lconns[i].sock, ltask, ISC_SOCKCANCEL_ALL);
+		isc_socket_detach(&lconns[i].sock);
+	}
+	load_report();
+	fflush(stdout);
+	isc_app_shutdown();
+}
+
+static void
+load_check(void) {
+	if (ldone || loutstanding != 0)
+		return;
+	if (lsent < load_count && load_live())
+		return;
+	load_finish();
+}
+
+/*%
+ * A TCP connection failed: its outstanding queries are lost.
+ */
+static void
+load_conndead(loadconn_t *conn, isc_result_t result) {
+	unsigned int i;
+
+	if (conn->dead)
+		return;
+	fprintf(stderr, ";; connection %u: %s\n",
+		(unsigned int)(conn - lconns), isc_result_totext(result));
+	conn->dead = ISC_TRUE;
+	isc_socket_cancel(conn->sock, ltask, ISC_SOCKCANCEL_ALL);
+	for (i = 0; i < load_inflight; i++) {
+		if (lslots[i].busy && lslots[i].conn == conn) {
+			llost++;
+			load_release(&lslots[i]);
+		}
+	}
+}
+
+static void
+load_response(loadconn_t *conn, const unsigned char *base,
+	      unsigned int length)
+{
+	loadslot_t *slot;
+	loadquery_t *lq;
+	isc_time_t now;
+	isc_uint64_t us;
+	unsigned int id;
+
+	if (length < 12) {
+		lunexpected++;
+		return;
+	}
+	id = (base[0] << 8) | base[1];
+	if ((base[2] & 0x80) == 0) {
+		lunexpected++;
+		return;
+	}
+	slot = &lslots[id % load_inflight];
+	if (!slot->busy || slot->conn != conn ||
+	    slot->gen != id / load_inflight)
+	{
+		/* Its query was lost, or this is a duplicate. */
+		llate++;
+		return;
+	}
+	lq = &lqueries[slot->query];
+	if ((base[4] != 0 || base[5] != 0) &&
+	    (length < lq->qlength ||
+	     memcmp(base + 12, lq->wire + 12, lq->qlength - 12) != 0))
+	{
+		lunexpected++;
+		return;
+	}
+
+	TIME_NOW(&now);
+	us = isc_time_microdiff(&now, &slot->sent);
+	lbuckets[load_bucket(us)]++;
+	lsum += us;
+	lmin = ISC_MIN(lmin, us);
+	lmax = ISC_MAX(lmax, us);
+	lrcodes[base[3] & 0x0f]++;
+	if ((base[2] & 0x02) != 0)
+		ltruncated++;
+	lreceived++;
+	llast = now;
+	load_release(slot);
+}
+
+static void load_recvdone(isc_task_t *task, isc_event_t *event);
+
+static void
+load_recv(loadconn_t *conn) {
+	isc_region_t r;
+	isc_result_t result;
+
+	r.base = conn->rbuf + conn->rlen;
+	r.length = LOAD_RBUFSIZE - conn->rlen;
+	result = isc_socket_recv(conn->sock, &r, 1, ltask,
+				 load_recvdone, conn);
+	CHECK("isc_socket_recv", result);
+}
+
+static void
+load_recvdone(isc_task_t *task, isc_event_t *event) {
+	isc_socketevent_t *sevent = (isc_socketevent_t *)event;
+	loadconn_t *conn = event->ev_arg;
+	isc_result_t result = sevent->result;
+	unsigned int n = sevent->n, o, len;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	if (result == ISC_R_CANCELED || ldone || conn->dead)
+		return;
+
+	if (!tcp_mode) {
+		if (result == ISC_R_SUCCESS)
+			load_response(conn, conn->rbuf, n);
+		else
+			lerrors++;
+		load_recv(conn);
+	} else if (result != ISC_R_SUCCESS) {
+		load_conndead(conn, result);
+	} else {
+		conn->rlen += n;
+		for (o = 0; conn->rlen - o >= 2; o += 2 + len) {
+			len = (conn->rbuf[o] << 8) | conn->rbuf[o + 1];
+			if (conn->rlen - o < 2 + len)
+				break;
+			load_response(conn, conn->rbuf + o + 2, len);
+		}
+		if (o != 0) {
+			memmove(conn->rbuf, conn->rbuf + o, conn->rlen - o);
+			conn->rlen -= o;
+		}
+		load_recv(conn);
+	}
+
+	load_fill();
+	load_check();
+}
+
+static void
+load_tick(isc_task_t *task, isc_event_t *event) {
+	isc_time_t now;
+	unsigned int i;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	if (ldone)
+		return;
+
+	TIME_NOW(&now);
+	if (isc_time_microdiff(&now, &lscan) >= LOAD_SCAN) {
+		for (i = 0; i < load_inflight; i++) {
+			loadslot_t *slot = &lslots[i];
+
+			if (slot->busy &&
+			    isc_time_microdiff(&now, &slot->sent) >=
+			    lqueries[slot->query].timeout)
+			{
+				llost++;
+				load_release(slot);
+			}
+		}
+		lscan = now;
+	}
+
+	load_fill();
+	load_check();
+}
+
+static void
+load_run(void) {
+	isc_interval_t interval;
+	isc_result_t result;
+
+	TIME_NOW(&lstart);
+	lscan = lstart;
+	isc_interval_set(&interval, 0, LOAD_TICK);
+	result = isc_timer_create(timermgr, isc_timertype_ticker, NULL,
+				  &interval, ltask, load_tick, NULL, &ltimer);
+	CHECK("isc_timer_create", result);
+
+	load_fill();
+	load_check();
+}
+
+static void
+load_connected(isc_task_t *task, isc_event_t *event) {
+	isc_socket_connev_t *cev = (isc_socket_connev_t *)event;
+	loadconn_t *conn = event->ev_arg;
+	isc_result_t result = cev->result;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	if (result == ISC_R_CANCELED)
+		return;
+
+	if (result == ISC_R_SUCCESS) {
+		conn->ready = ISC_TRUE;
+		load_recv(conn);
+	} else
+		load_conndead(conn, result);
+
+	if (--lconnecting == 0)
+		load_run();
+}
+
+static void
+load_start(isc_task_t *task, isc_event_t *event) {
+	struct query *query = (struct query *)event->ev_arg;
+	isc_sockaddr_t bind_addr;
+	isc_result_t result;
+	unsigned int i;
+
+	isc_event_free(&event);
+	ltask = task;
+
+	for (; query != NULL; query = ISC_LIST_NEXT(query, link))
+		nlqueries++;
+	if (nlqueries == 0)
+		fatal("no queries to send");
+	lqueries = isc_mem_get(mctx, nlqueries * sizeof(*lqueries));
+	if (lqueries == NULL)
+		fatal("memory allocation failure");
+	lbufsize = 0;
+	for (query = ISC_LIST_HEAD(queries), i = 0;
+	     query != NULL;
+	     query = ISC_LIST_NEXT(query, link), i++)
+	{
+		load_render(query, &lqueries[i]);
+		lbufsize = ISC_MAX(lbufsize, lqueries[i].length + 2);
+	}
+
+	lslots = isc_mem_get(mctx, load_inflight * sizeof(*lslots));
+	if (lslots == NULL)
+		fatal("memory allocation failure");
+	for (i = 0; i < load_inflight; i++) {
+		lslots[i].busy = ISC_FALSE;
+		lslots[i].sending = ISC_FALSE;
+		lslots[i].gen = 0;
+		lslots[i].conn = NULL;
+		lslots[i].next = i + 1;
+		lslots[i].buf = isc_mem_get(mctx, lbufsize);
+		if (lslots[i].buf == NULL)
+			fatal("memory allocation failure");
+	}
+	lfree = 0;
+
+	nlconns = tcp_mode ? load_connections : 1;
+	lconns = isc_mem_get(mctx, nlconns * sizeof(*lconns));
+	if (lconns == NULL)
+		fatal("memory allocation failure");
+	for (i = 0; i < nlconns; i++) {
+		loadconn_t *conn = &lconns[i];
+
+		memset(conn, 0, sizeof(*conn));
+		conn->rbuf = isc_mem_get(mctx, LOAD_RBUFSIZE);
+		if (conn->rbuf == NULL)
+			fatal("memory allocation failure");
+		result = isc_socket_create(socketmgr,
+					   isc_sockaddr_pf(&dstaddr),
+					   tcp_mode ? isc_sockettype_tcp
+						    : isc_sockettype_udp,
+					   &conn->sock);
+		CHECK("isc_socket_create", result);
+		if (have_src) {
+			bind_addr = srcaddr;
+			if (tcp_mode && nlconns > 1)
+				isc_sockaddr_setport(&bind_addr, 0);
+		} else
+			isc_sockaddr_anyofpf(&bind_addr,
+					     isc_sockaddr_pf(&dstaddr));
+		result = isc_socket_bind(conn->sock, &bind_addr,
+					 ISC_SOCKET_REUSEADDRESS);
+		CHECK("isc_socket_bind", result);
+		isc_socket_dscp(conn->sock, dscp);
+	}
+
+	if (tcp_mode) {
+		lconnecting = nlconns;
+		for (i = 0; i < nlconns; i++) {
+			result = isc_socket_connect(lconns[i].sock, &dstaddr,
+						    ltask, load_connected,
+						    &lconns[i]);
+			CHECK("isc_socket_connect", result);
+		}
+	} else {
+		lconns[0].ready = ISC_TRUE;
+		load_recv(&lconns[0]);
+		load_run();
+	}
+}
+
+static void
+load_cleanup(void) {
+	unsigned int i;
+
+	if (lqueries != NULL) {
+		for (i = 0; i < nlqueries; i++)
+			isc_mem_put(mctx, lqueries[i].wire,
+				    lqueries[i].length);
+		isc_mem_put(mctx, lqueries, nlqueries * sizeof(*lqueries));
+	}
+	if (lslots != NULL) {
+		for (i = 0; i < load_inflight; i++)
+			isc_mem_put(mctx, lslots[i].buf, lbufsize);
+		isc_mem_put(mctx, lslots, load_inflight * sizeof(*lslots));
+	}
+	if (lconns != NULL) {
+		for (i = 0; i < nlconns; i++) {
+			INSIST(lconns[i].sock == NULL);
+			isc_mem_put(mctx, lconns[i].rbuf, LOAD_RBUFSIZE);
+		}
+		isc_mem_put(mctx, lconns, nlconns * sizeof(*lconns));
+	}
+}
+
 ISC_PLATFORM_NORETURN_PRE static void
 usage(void) ISC_PLATFORM_NORETURN_POST;
 
@@ -768,6 +1458,12 @@ help(void) {
 "                 +[no]all            (Set or clear all display flags)\n"
 "                 +[no]multiline      (Print records in an expanded format)\n"
 "                 +[no]split=##       (Split hex/base64 fields into chunks)\n"
+"                 +count=###          (Load test: send ### queries, cycling\n"
+"                                      through the list, and print only\n"
+"                                      statistics)\n"
+"                 +inflight=###       (Load test: queries outstanding) [100]\n"
+"                 +qps=###            (Load test: queries per second)\n"
+"                 +connections=###    (Load test: TCP connections) [1]\n"
 " local opt       is one of:\n"
 "                 -c class            (specify query class)\n"
 "                 -t type             (specify query type)\n"
@@ -807,10 +1503,6 @@ next_token(char **stringp, const char *delim) {
 	return (res);
 }
 
-ISC_PLATFORM_NORETURN_PRE static void
-fatal(const char *format, ...)
-ISC_FORMAT_PRINTF(1, 2) ISC_PLATFORM_NORETURN_POST;
-
 static void
 fatal(const char *format, ...) {
 	va_list args;
@@ -1170,9 +1862,30 @@ plus_option(char *option, struct query *query, isc_boolean_t global)
 				display_comments = state;
 				break;
 			case 'n':
-				FULLCHECK("continue");
-				GLOBAL();
-				continue_on_error = state;
+				switch (cmd[3]) {
+				case 'n': /* connections */
+					FULLCHECK("connections");
+					GLOBAL();
+					if (value == NULL)
+						goto need_value;
+					if (!state)
+						goto invalid_option;
+					result = parse_uint(&load_connections,
+							    value, 65535,
+							    "connections");
+					CHECK("parse_uint(connections)",
+					      result);
+					if (load_connections == 0)
+						load_connections = 1;
+					break;
+				case 't': /* continue */
+					FULLCHECK("continue");
+					GLOBAL();
+					continue_on_error = state;
+					break;
+				default:
+					goto invalid_option;
+				}
 				break;
 			case 'o':
 				FULLCHECK("cookie");
@@ -1188,6 +1901,19 @@ plus_option(char *option, struct query *query, isc_boolean_t global)
 				} else
 					query->cookie = NULL;
 				break;
+			case 'u': /* count */
+				FULLCHECK("count");
+				GLOBAL();
+				if (!state) {
+					load_count = 0;
+					break;
+				}
+				if (value == NULL)
+					goto need_value;
+				result = parse_uint(&load_count, value,
+						    0xffffffff, "count");
+				CHECK("parse_uint(count)", result);
+				break;
 			default:
 				goto invalid_option;
 			}
@@ -1303,6 +2029,19 @@ plus_option(char *option, struct query *query, isc_boolean_t global)
 			goto invalid_option;
 		}
 		break;
+	case 'i': /* inflight */
+		FULLCHECK("inflight");
+		GLOBAL();
+		if (value == NULL)
+			goto need_value;
+		if (!state)
+			goto invalid_option;
+		result = parse_uint(&load_inflight, value, LOAD_MAXINFLIGHT,
+				    "inflight");
+		CHECK("parse_uint(inflight)", result);
+		if (load_inflight == 0)
+			load_inflight = 1;
+		break;
 	case 'm': /* multiline */
 		FULLCHECK("multiline");
 		GLOBAL();
@@ -1315,9 +2054,28 @@ plus_option(char *option, struct query *query, isc_boolean_t global)
 		query->nsid = state;
 		break;
 	case 'q':
-		FULLCHECK("question");
-		GLOBAL();
-		display_question = state;
+		switch (cmd[1]) {
+		case 'p': /* qps */
+			FULLCHECK("qps");
+			GLOBAL();
+			if (!state) {
+				load_qps = 0;
+				break;
+			}
+			if (value == NULL)
+				goto need_value;
+			result = parse_uint(&load_qps, value, 0xffffffff,
+					    "qps");
+			CHECK("parse_uint(qps)", result);
+			break;
+		case 'u': /* question */
+			FULLCHECK("question");
+			GLOBAL();
+			display_question = state;
+			break;
+		default:
+			goto invalid_option;
+		}
 		break;
 	case 'r':
 		switch (cmd[1]) {
@@ -1904,8 +2662,6 @@ main(int argc, char *argv[]) {
 	isc_entropy_t *ectx;
 	isc_taskmgr_t *taskmgr;
 	isc_task_t *task;
-	isc_timermgr_t *timermgr;
-	isc_socketmgr_t *socketmgr;
 	dns_dispatchmgr_t *dispatchmgr;
 	unsigned int attrs, attrmask;
 	dns_dispatch_t *dispatchvx;
@@ -2002,10 +2758,14 @@ main(int argc, char *argv[]) {
 	RUNCHECK(dns_view_create(mctx, 0, "_test", &view));
 
 	query = ISC_LIST_HEAD(queries);
-	RUNCHECK(isc_app_onrun(mctx, task, sendqueries, query));
+	RUNCHECK(isc_app_onrun(mctx, task,
+			       load_count != 0 ? load_start : sendqueries,
+			       query));
 
 	(void)isc_app_run();
 
+	load_cleanup();
+
 	query = ISC_LIST_HEAD(queries);
 	while (query != NULL) {
 		struct query *next = ISC_LIST_NEXT(query, link);
@@ -40,6 +40,7 @@
 #include <dns/acl.h>
 #include <dns/dnstap.h>
 #include <dns/fixedname.h>
+#include <dns/hotcache.h>
 #include <dns/rdataclass.h>
 #include <dns/rdatatype.h>
 #include <dns/rrl.h>
@@ -1591,6 +1592,21 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 			result = ISC_R_RANGE;
 	}
 
+	obj = NULL;
+	(void)cfg_map_get(options, "prefetch-popular", &obj);
+	if (obj != NULL) {
+		isc_uint32_t names;
+
+		names = cfg_obj_asuint32(cfg_tuple_get(obj, "names"));
+		if (names > DNS_HOTCACHE_MAXSIZE) {
+			cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+				    "prefetch-popular '%u' is out of range "
+				    "(0..%u)", names, DNS_HOTCACHE_MAXSIZE);
+			if (result == ISC_R_SUCCESS)
+				result = ISC_R_RANGE;
+		}
+	}
+
 	return (result);
 }
 
@@ -2066,12 +2082,16 @@ check_zoneconf(const cfg_obj_t *zconfig, const cfg_obj_t *voptions,
 		result = ISC_R_FAILURE;
 
 	/*
-	 * Check validity of the zone options.
+	 * Check validity of the zone options.  Only the clauses that the
+	 * grammar does not allow for this zone type need to be looked up.
 	 */
 	option = cfg_map_firstclause(&cfg_type_zoneopts, &clauses, &i);
 	while (option != NULL) {
+		const cfg_clausedef_t *clause = clauses;
+
 		obj = NULL;
-		if (cfg_map_get(zoptions, option, &obj) == ISC_R_SUCCESS &&
+		if ((clause[i].flags & ztype) == 0 &&
+		    cfg_map_get(zoptions, option, &obj) == ISC_R_SUCCESS &&
 		    obj != NULL && !cfg_clause_validforzone(option, ztype))
 		{
 			cfg_obj_log(obj, logctx, ISC_LOG_WARNING,
@@ -2523,7 +2543,8 @@ check_zoneconf(const cfg_obj_t *zconfig, const cfg_obj_t *voptions,
 	    (tresult == ISC_R_NOTFOUND ||
 	    (tresult == ISC_R_SUCCESS &&
 	     (strcmp("rbt", cfg_obj_asstring(obj)) == 0 ||
-	      strcmp("rbt64", cfg_obj_asstring(obj)) == 0))))
+	      strcmp("rbt64", cfg_obj_asstring(obj)) == 0 ||
+	      strcmp("qp", cfg_obj_asstring(obj)) == 0))))
 	{
 		isc_result_t res1;
 		const cfg_obj_t *fileobj = NULL;
@@ -3758,6 +3779,100 @@ bind9_check_controls(const cfg_obj_t *config, isc_log_t *logctx,
 	return (result);
 }
 
+static isc_boolean_t
+tls_exists(const cfg_obj_t *tlslist, const char *name) {
+	const cfg_listelt_t *element;
+	const cfg_obj_t *obj;
+
+	for (element = cfg_list_first(tlslist);
+	     element != NULL;
+	     element = cfg_list_next(element))
+	{
+		obj = cfg_map_getname(cfg_listelt_value(element));
+		if (strcasecmp(cfg_obj_asstring(obj), name) == 0)
+			return (ISC_TRUE);
+	}
+	return (ISC_FALSE);
+}
+
+/*
+ * Check the "tls" statements, and the listeners that refer to them.
+ */
+static isc_result_t
+bind9_check_tls(const cfg_obj_t *config, const cfg_obj_t *options,
+		isc_log_t *logctx)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	const cfg_obj_t *tlslist = NULL;
+	const cfg_obj_t *listenon;
+	const cfg_obj_t *tls, *obj;
+	const cfg_listelt_t *element, *element2;
+	const char *name;
+	static const char *listeners[] = { "listen-on", "listen-on-v6", NULL };
+	int i;
+
+	(void)cfg_map_get(config, "tls", &tlslist);
+	for (element = cfg_list_first(tlslist);
+	     element != NULL;
+	     element = cfg_list_next(element))
+	{
+		tls = cfg_listelt_value(element);
+		name = cfg_obj_asstring(cfg_map_getname(tls));
+
+		for (element2 = cfg_list_next(element);
+		     element2 != NULL;
+		     element2 = cfg_list_next(element2))
+		{
+			obj = cfg_map_getname(cfg_listelt_value(element2));
+			if (strcasecmp(cfg_obj_asstring(obj), name) == 0) {
+				cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+					    "tls '%s' is duplicated", name);
+				result = ISC_R_EXISTS;
+			}
+		}
+
+		obj = NULL;
+		(void)cfg_map_get(tls, "key-file", &obj);
+		if (obj == NULL) {
+			cfg_obj_log(tls, logctx, ISC_LOG_ERROR,
+				    "tls '%s': missing 'key-file'", name);
+			result = ISC_R_FAILURE;
+		}
+		obj = NULL;
+		(void)cfg_map_get(tls, "cert-file", &obj);
+		if (obj == NULL) {
+			cfg_obj_log(tls, logctx, ISC_LOG_ERROR,
+				    "tls '%s': missing 'cert-file'", name);
+			result = ISC_R_FAILURE;
+		}
+	}
+
+	if (options == NULL)
+		return (result);
+
+	for (i = 0; listeners[i] != NULL; i++) {
+		listenon = NULL;
+		(void)cfg_map_get(options, listeners[i], &listenon);
+		for (element = cfg_list_first(listenon);
+		     element != NULL;
+		     element = cfg_list_next(element))
+		{
+			obj = cfg_tuple_get(cfg_listelt_value(element), "tls");
+			if (!cfg_obj_isstring(obj))
+				continue;
+			name = cfg_obj_asstring(obj);
+			if (!tls_exists(tlslist, name)) {
+				cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+					    "%s: tls '%s' is not defined",
+					    listeners[i], name);
+				result = ISC_R_NOTFOUND;
+			}
+		}
+	}
+
+	return (result);
+}
+
 isc_result_t
 bind9_check_namedconf(const cfg_obj_t *config, isc_log_t *logctx,
 		      isc_mem_t *mctx)
@@ -3789,6 +3904,9 @@ bind9_check_namedconf(const cfg_obj_t *config, isc_log_t *logctx,
 	if (bind9_check_controls(config, logctx, mctx) != ISC_R_SUCCESS)
 		result = ISC_R_FAILURE;
 
+	if (bind9_check_tls(config, options, logctx) != ISC_R_SUCCESS)
+		result = ISC_R_FAILURE;
+
 	(void)cfg_map_get(config, "view", &views);
 
 	if (views != NULL && options != NULL)
@@ -164,6 +164,16 @@ cleaner_shutdown_action(isc_task_t *task, isc_event_t *event);
 static void
 overmem_cleaning_action(isc_task_t *task, isc_event_t *event);
 
+/*%
+ * The built-in cache databases, "rbt" and "qp", take the heap memory
+ * context in argv[0] and clean themselves.
+ */
+static inline isc_boolean_t
+builtin_db(const char *db_type) {
+	return (ISC_TF(strcmp(db_type, "rbt") == 0 ||
+		       strcmp(db_type, "qp") == 0));
+}
+
 static inline isc_result_t
 cache_create_db(dns_cache_t *cache, dns_db_t **db) {
 	isc_result_t result;
@@ -256,11 +266,11 @@ dns_cache_create3(isc_mem_t *cmctx, isc_mem_t *hmctx, isc_taskmgr_t *taskmgr,
 	}
 
 	/*
-	 * For databases of type "rbt" we pass hmctx to dns_db_create()
-	 * via cache->db_argv, followed by the rest of the arguments in
-	 * db_argv (of which there really shouldn't be any).
+	 * For databases of type "rbt" or "qp" we pass hmctx to
+	 * dns_db_create() via cache->db_argv, followed by the rest of the
+	 * arguments in db_argv (of which there really shouldn't be any).
 	 */
-	if (strcmp(cache->db_type, "rbt") == 0)
+	if (builtin_db(cache->db_type))
 		extra = 1;
 
 	cache->db_argc = db_argc + extra;
@@ -311,10 +321,10 @@ dns_cache_create3(isc_mem_t *cmctx, isc_mem_t *hmctx, isc_taskmgr_t *taskmgr,
 	cache->magic = CACHE_MAGIC;
 
 	/*
-	 * RBT-type cache DB has its own mechanism of cache cleaning and doesn't
-	 * need the control of the generic cleaner.
+	 * RBT- and QP-type cache DBs have their own mechanism of cache
+	 * cleaning and don't need the control of the generic cleaner.
 	 */
-	if (strcmp(db_type, "rbt") == 0)
+	if (builtin_db(db_type))
 		result = cache_cleaner_init(cache, NULL, NULL, &cache->cleaner);
 	else {
 		result = cache_cleaner_init(cache, taskmgr, timermgr,
@@ -389,11 +399,11 @@ cache_free(dns_cache_t *cache) {
 
 	if (cache->db_argv != NULL) {
 		/*
-		 * We don't free db_argv[0] in "rbt" cache databases
-		 * as it's a pointer to hmctx
+		 * We don't free db_argv[0] in "rbt" or "qp" cache
+		 * databases as it's a pointer to hmctx
 		 */
 		int extra = 0;
-		if (strcmp(cache->db_type, "rbt") == 0)
+		if (builtin_db(cache->db_type))
 			extra = 1;
 		for (i = extra; i < cache->db_argc; i++)
 			if (cache->db_argv[i] != NULL)
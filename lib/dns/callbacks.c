@@ -84,6 +84,9 @@ dns_rdatacallbacks_initcommon(dns_rdatacallbacks_t *callbacks) {
 
 	callbacks->magic = DNS_CALLBACK_MAGIC;
 	callbacks->add = NULL;
+	callbacks->prepare = NULL;
+	callbacks->addprepared = NULL;
+	callbacks->freeprepared = NULL;
 	callbacks->rawdata = NULL;
 	callbacks->zone = NULL;
 	callbacks->add_private = NULL;
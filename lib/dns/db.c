@@ -55,6 +55,7 @@ struct dns_dbimplementation {
  * Built in database implementations are registered here.
  */
 
+#include "qpdb.h"
 #include "rbtdb.h"
 #include "rbtdb64.h"
 
@@ -64,6 +65,7 @@ static isc_once_t once = ISC_ONCE_INIT;
 
 static dns_dbimplementation_t rbtimp;
 static dns_dbimplementation_t rbt64imp;
+static dns_dbimplementation_t qpimp;
 
 static void
 initialize(void) {
@@ -81,9 +83,16 @@ initialize(void) {
 	rbt64imp.driverarg = NULL;
 	ISC_LINK_INIT(&rbt64imp, link);
 
+	qpimp.name = "qp";
+	qpimp.create = dns_qpdb_create;
+	qpimp.mctx = NULL;
+	qpimp.driverarg = NULL;
+	ISC_LINK_INIT(&qpimp, link);
+
 	ISC_LIST_INIT(implementations);
 	ISC_LIST_APPEND(implementations, &rbtimp, link);
 	ISC_LIST_APPEND(implementations, &rbt64imp, link);
+	ISC_LIST_APPEND(implementations, &qpimp, link);
 }
 
 static inline dns_dbimplementation_t *
@@ -0,0 +1,1017 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <isc/atomic.h>
+#include <isc/hash.h>
+#include <isc/ht.h>
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/platform.h>
+#include <isc/stats.h>
+#include <isc/string.h>
+#include <isc/task.h>
+#include <isc/time.h>
+#include <isc/timer.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/hotcache.h>
+#include <dns/name.h>
+#include <dns/rdataset.h>
+#include <dns/resolver.h>
+#include <dns/result.h>
+#include <dns/stats.h>
+#include <dns/view.h>
+
+#define HOTCACHE_MAGIC		ISC_MAGIC('H', 'o', 't', 'C')
+#define VALID_HOTCACHE(hc)	ISC_MAGIC_VALID(hc, HOTCACHE_MAGIC)
+
+/*
+ * The sketch is updated without locking when atomic operations are
+ * available; otherwise it has a lock of its own.
+ */
+#ifdef ISC_PLATFORM_USETHREADS
+#if (defined(ISC_PLATFORM_HAVESTDATOMIC) && defined(ATOMIC_INT_LOCK_FREE)) || (defined(ISC_PLATFORM_HAVEXADD) && defined(ISC_PLATFORM_HAVECMPXCHG))
+#define HOTCACHE_USEATOMIC 1
+#if (defined(ISC_PLATFORM_HAVESTDATOMIC) && defined(ATOMIC_INT_LOCK_FREE))
+#define HOTCACHE_USESTDATOMIC 1
+#endif
+#else
+#define HOTCACHE_USELOCK 1
+#endif
+#endif
+
+#if defined(HOTCACHE_USESTDATOMIC)
+#include <stdint.h>
+#include <stdatomic.h>
+#endif
+
+/*%
+ * Number of rows in the count-min sketch, and the number of counters
+ * per row for each tracked entry (rounded up to a power of two).
+ */
+#define SKETCH_DEPTH		4
+#define SKETCH_PERENTRY		8
+#define SKETCH_MAX		0xffff
+
+/*%
+ * The counters are halved after this many hits per tracked entry, so
+ * that the sketch follows changes in popularity.
+ */
+#define SKETCH_AGE		10
+
+/*%
+ * ... but not before this many hits in all, so that the epoch cannot
+ * wrap around between two calls of sketch_renew() at any plausible
+ * query rate.
+ */
+#define SKETCH_MINAGE		1000
+
+/*%
+ * The table is split into up to this many shards, each with its own
+ * lock, as long as every shard tracks at least SHARD_MINSIZE entries.
+ */
+#define HOTCACHE_SHARDS		16
+#define SHARD_MINSIZE		64
+
+/*%
+ * Number of tracked entries compared when looking for one to replace.
+ */
+#define EVICT_SAMPLE		8
+
+/*%
+ * An entry must have been hit at least this many times since its last
+ * refresh to be refreshed again.
+ */
+#define REFRESH_MINHITS		2
+
+/*%
+ * Refresh entries expiring within this many seconds even when the view
+ * does not have a prefetch trigger configured.
+ */
+#define REFRESH_MINWINDOW	2
+
+#define KEY_MAX			(2 + DNS_NAME_MAXWIRE)
+
+/*
+ * Each sketch counter holds a count in its low 16 bits and, in its high
+ * 16 bits, the epoch at which it was last written.  Aging the sketch
+ * only advances the epoch; a counter is halved once for each epoch it
+ * has missed when it is next read.
+ */
+#define COUNT(w)		((w) & 0xffff)
+#define EPOCH(w)		((w) >> 16)
+#define PACK(e, c)		((((e) & 0xffff) << 16) | (c))
+
+#if defined(HOTCACHE_USESTDATOMIC)
+typedef atomic_uint_least32_t hccounter_t;
+
+static inline isc_uint32_t
+counter_load(hccounter_t *p) {
+	return ((isc_uint32_t)atomic_load_explicit(p, memory_order_relaxed));
+}
+
+static inline isc_boolean_t
+counter_cas(hccounter_t *p, isc_uint32_t old, isc_uint32_t val) {
+	uint_least32_t expected = old;
+
+	return (ISC_TF(atomic_compare_exchange_strong_explicit(p, &expected,
+						val, memory_order_relaxed,
+						memory_order_relaxed)));
+}
+
+static inline isc_uint32_t
+counter_incr(hccounter_t *p) {
+	return ((isc_uint32_t)atomic_fetch_add_explicit(p, 1,
+						memory_order_relaxed) + 1);
+}
+
+#define counter_init(p, v)	atomic_init((p), (v))
+#elif defined(HOTCACHE_USEATOMIC)
+typedef isc_int32_t hccounter_t;
+
+static inline isc_uint32_t
+counter_load(hccounter_t *p) {
+	return ((isc_uint32_t)isc_atomic_xadd(p, 0));
+}
+
+static inline isc_boolean_t
+counter_cas(hccounter_t *p, isc_uint32_t old, isc_uint32_t val) {
+	return (ISC_TF(isc_atomic_cmpxchg(p, (isc_int32_t)old,
+					  (isc_int32_t)val) ==
+		       (isc_int32_t)old));
+}
+
+static inline isc_uint32_t
+counter_incr(hccounter_t *p) {
+	return ((isc_uint32_t)isc_atomic_xadd(p, 1) + 1);
+}
+
+#define counter_init(p, v)	(*(p) = (v))
+#else
+typedef isc_uint32_t hccounter_t;
+
+static inline isc_uint32_t
+counter_load(hccounter_t *p) {
+	return (*p);
+}
+
+static inline isc_boolean_t
+counter_cas(hccounter_t *p, isc_uint32_t old, isc_uint32_t val) {
+	if (*p != old)
+		return (ISC_FALSE);
+	*p = val;
+	return (ISC_TRUE);
+}
+
+static inline isc_uint32_t
+counter_incr(hccounter_t *p) {
+	return (++(*p));
+}
+
+#define counter_init(p, v)	(*(p) = (v))
+#endif
+
+#if defined(HOTCACHE_USELOCK)
+#define SKETCH_LOCK(hc)		LOCK(&(hc)->sketchlock)
+#define SKETCH_UNLOCK(hc)	UNLOCK(&(hc)->sketchlock)
+#else
+#define SKETCH_LOCK(hc)
+#define SKETCH_UNLOCK(hc)
+#endif
+
+typedef struct hotshard hotshard_t;
+
+typedef struct hotentry {
+	dns_hotcache_t		*hc;
+	hotshard_t		*shard;
+	dns_fixedname_t		fn;
+	dns_name_t		*name;
+	dns_rdatatype_t		type;
+	unsigned int		index;
+	unsigned int		keylen;
+	unsigned char		key[KEY_MAX];
+	isc_uint32_t		freq;		/* packed like a counter */
+	isc_uint32_t		hits;
+	isc_stdtime_t		expire;
+	isc_boolean_t		selected;
+	isc_uint32_t		rank;		/* used by tick() only */
+	dns_fetch_t		*fetch;
+	dns_rdataset_t		rdataset;
+	dns_rdataset_t		sigrdataset;
+} hotentry_t;
+
+struct hotshard {
+	isc_mutex_t		lock;
+	/* Locked by lock. */
+	isc_ht_t		*ht;
+	hotentry_t		**entries;
+	unsigned int		size;
+	unsigned int		count;
+	unsigned int		cursor;
+};
+
+struct dns_hotcache {
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	isc_mutex_t		lock;
+	/* Locked by lock. */
+	unsigned int		references;
+	isc_boolean_t		shuttingdown;
+	isc_boolean_t		enabled;
+	hotentry_t		**candidates;
+	dns_view_t		*view;
+	isc_task_t		*task;
+	isc_timer_t		*timer;
+	unsigned int		rate;
+	/* Unlocked; see SKETCH_LOCK(). */
+#if defined(HOTCACHE_USELOCK)
+	isc_mutex_t		sketchlock;
+#endif
+	hccounter_t		*sketch;
+	hccounter_t		epoch;
+	hccounter_t		additions;
+	/* Constant. */
+	isc_uint32_t		mask;
+	isc_uint32_t		agelimit;
+	unsigned int		size;
+	unsigned int		nshards;
+	hotshard_t		*shards;
+};
+
+static void
+destroy(dns_hotcache_t *hc);
+
+/*
+ * Build the hash table key for 'name'/'type': the type in network
+ * order followed by the name in lower case wire format.  Label length
+ * octets are at most 63 and therefore never mistaken for upper case
+ * letters.
+ */
+static unsigned int
+makekey(const dns_name_t *name, dns_rdatatype_t type, unsigned char *key) {
+	unsigned int i;
+
+	key[0] = (type >> 8) & 0xff;
+	key[1] = type & 0xff;
+	for (i = 0; i < name->length; i++) {
+		unsigned char c = name->ndata[i];
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		key[i + 2] = c;
+	}
+	return (name->length + 2);
+}
+
+/*
+ * Return the count in 'word' as of epoch 'epoch'.
+ */
+static inline isc_uint32_t
+decay(isc_uint32_t word, isc_uint32_t epoch) {
+	isc_uint32_t age = (epoch - EPOCH(word)) & 0xffff;
+
+	return (age >= 16 ? 0 : COUNT(word) >> age);
+}
+
+static isc_uint32_t
+sketch_index(dns_hotcache_t *hc, const unsigned char *key,
+	     unsigned int keylen, isc_uint32_t *idx)
+{
+	isc_uint32_t h1, h2;
+	unsigned int i;
+
+	/*
+	 * Derive the row positions from two independent hashes
+	 * (Kirsch-Mitzenmacher double hashing).
+	 */
+	h1 = isc_hash_function(key, keylen, ISC_TRUE, NULL);
+	h2 = isc_hash_function(key, keylen, ISC_TRUE, &h1) | 1;
+	for (i = 0; i < SKETCH_DEPTH; i++)
+		idx[i] = i * (hc->mask + 1) + ((h1 + i * h2) & hc->mask);
+	return (h1);
+}
+
+static isc_uint32_t
+sketch_estimate(dns_hotcache_t *hc, const isc_uint32_t *idx,
+		isc_uint32_t epoch)
+{
+	isc_uint32_t est = SKETCH_MAX, val;
+	unsigned int i;
+
+	for (i = 0; i < SKETCH_DEPTH; i++) {
+		val = decay(counter_load(&hc->sketch[idx[i]]), epoch);
+		if (val < est)
+			est = val;
+	}
+	return (est);
+}
+
+/*
+ * Count a hit and return the new estimate, packed with the epoch it
+ * was made in.  Only the smallest counters are incremented
+ * ("conservative update"), which reduces the overestimate caused by
+ * collisions.  A counter another thread has raised in the meantime is
+ * left alone.
+ */
+static isc_uint32_t
+sketch_add(dns_hotcache_t *hc, const isc_uint32_t *idx) {
+	isc_uint32_t epoch, est, word, n;
+	unsigned int i;
+
+	SKETCH_LOCK(hc);
+	epoch = counter_load(&hc->epoch) & 0xffff;
+	est = sketch_estimate(hc, idx, epoch);
+	if (est < SKETCH_MAX) {
+		for (i = 0; i < SKETCH_DEPTH; i++) {
+			hccounter_t *counter = &hc->sketch[idx[i]];
+			do {
+				word = counter_load(counter);
+				if (decay(word, epoch) > est)
+					break;
+			} while (!counter_cas(counter, word,
+					      PACK(epoch, est + 1)));
+		}
+		est++;
+	}
+
+	/*
+	 * Whoever makes the addition that reaches the limit starts a new
+	 * epoch, which halves every counter.
+	 */
+	n = counter_incr(&hc->additions);
+	if (n >= hc->agelimit && counter_cas(&hc->additions, n, 0)) {
+		epoch = counter_incr(&hc->epoch) & 0xffff;
+		est >>= 1;
+	}
+	SKETCH_UNLOCK(hc);
+
+	return (PACK(epoch, est));
+}
+
+/*
+ * Rewrite the counters which have missed epochs with their current
+ * value, so that a counter is never left alone long enough for the
+ * epoch to wrap around to the one it was written in.  Called from
+ * tick(), away from the query path.
+ */
+static void
+sketch_renew(dns_hotcache_t *hc) {
+	isc_uint32_t epoch, word;
+	unsigned int i, n;
+
+	SKETCH_LOCK(hc);
+	epoch = counter_load(&hc->epoch) & 0xffff;
+	n = SKETCH_DEPTH * (hc->mask + 1);
+	for (i = 0; i < n; i++) {
+		word = counter_load(&hc->sketch[i]);
+		if (word != 0 && EPOCH(word) != epoch)
+			(void)counter_cas(&hc->sketch[i], word,
+					  PACK(epoch, decay(word, epoch)));
+	}
+	SKETCH_UNLOCK(hc);
+}
+
+static hotshard_t *
+shard_of(dns_hotcache_t *hc, isc_uint32_t hash) {
+	return (&hc->shards[(hash >> 24) & (hc->nshards - 1)]);
+}
+
+static isc_result_t
+shard_init(dns_hotcache_t *hc, hotshard_t *shard, unsigned int size) {
+	isc_result_t result;
+	isc_uint32_t width;
+	isc_uint8_t bits;
+
+	shard->ht = NULL;
+	shard->size = size;
+	shard->count = 0;
+	shard->cursor = 0;
+
+	for (width = 64, bits = 6; width < size && bits < 16;
+	     width <<= 1, bits++)
+		;
+
+	result = isc_mutex_init(&shard->lock);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	shard->entries = isc_mem_get(hc->mctx, size * sizeof(hotentry_t *));
+	if (shard->entries == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_lock;
+	}
+
+	result = isc_ht_init(&shard->ht, hc->mctx, bits);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_entries;
+
+	return (ISC_R_SUCCESS);
+
+ cleanup_entries:
+	isc_mem_put(hc->mctx, shard->entries, size * sizeof(hotentry_t *));
+ cleanup_lock:
+	DESTROYLOCK(&shard->lock);
+	return (result);
+}
+
+static void
+shard_destroy(dns_hotcache_t *hc, hotshard_t *shard) {
+	unsigned int i;
+
+	for (i = 0; i < shard->count; i++) {
+		INSIST(shard->entries[i]->fetch == NULL);
+		isc_mem_put(hc->mctx, shard->entries[i], sizeof(hotentry_t));
+	}
+	isc_ht_destroy(&shard->ht);
+	isc_mem_put(hc->mctx, shard->entries,
+		    shard->size * sizeof(hotentry_t *));
+	DESTROYLOCK(&shard->lock);
+}
+
+isc_result_t
+dns_hotcache_create(isc_mem_t *mctx, unsigned int size,
+		    dns_hotcache_t **hcp)
+{
+	dns_hotcache_t *hc;
+	isc_result_t result;
+	isc_uint32_t width;
+	unsigned int i, n = 0;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(size > 0 && size <= DNS_HOTCACHE_MAXSIZE);
+	REQUIRE(hcp != NULL && *hcp == NULL);
+
+	hc = isc_mem_get(mctx, sizeof(*hc));
+	if (hc == NULL)
+		return (ISC_R_NOMEMORY);
+
+	hc->mctx = NULL;
+	isc_mem_attach(mctx, &hc->mctx);
+	hc->references = 1;
+	hc->shuttingdown = ISC_FALSE;
+	hc->enabled = ISC_FALSE;
+	hc->sketch = NULL;
+	hc->candidates = NULL;
+	hc->shards = NULL;
+	hc->size = size;
+	counter_init(&hc->epoch, 0);
+	counter_init(&hc->additions, 0);
+	hc->agelimit = ISC_MAX(size * SKETCH_AGE, SKETCH_MINAGE);
+	hc->view = NULL;
+	hc->task = NULL;
+	hc->timer = NULL;
+	hc->rate = 0;
+
+	for (width = 64; width < size * SKETCH_PERENTRY; width <<= 1)
+		;
+	hc->mask = width - 1;
+
+	for (hc->nshards = 1;
+	     hc->nshards < HOTCACHE_SHARDS &&
+	     size / (hc->nshards * 2) >= SHARD_MINSIZE;
+	     hc->nshards *= 2)
+		;
+
+	result = isc_mutex_init(&hc->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_hc;
+
+#if defined(HOTCACHE_USELOCK)
+	result = isc_mutex_init(&hc->sketchlock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+#endif
+
+	hc->sketch = isc_mem_get(mctx, SKETCH_DEPTH * width *
+					sizeof(hccounter_t));
+	if (hc->sketch == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_sketchlock;
+	}
+	for (i = 0; i < SKETCH_DEPTH * width; i++)
+		counter_init(&hc->sketch[i], 0);
+
+	hc->candidates = isc_mem_get(mctx, size * sizeof(hotentry_t *));
+	if (hc->candidates == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_sketch;
+	}
+
+	hc->shards = isc_mem_get(mctx, hc->nshards * sizeof(hotshard_t));
+	if (hc->shards == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_candidates;
+	}
+
+	/*
+	 * Spread 'size' over the shards, giving the remainder to the
+	 * first ones.
+	 */
+	for (n = 0; n < hc->nshards; n++) {
+		result = shard_init(hc, &hc->shards[n],
+				    size / hc->nshards +
+				    (n < size % hc->nshards ? 1 : 0));
+		if (result != ISC_R_SUCCESS)
+			goto cleanup_shards;
+	}
+
+	hc->magic = HOTCACHE_MAGIC;
+	*hcp = hc;
+	return (ISC_R_SUCCESS);
+
+ cleanup_shards:
+	while (n > 0)
+		shard_destroy(hc, &hc->shards[--n]);
+	isc_mem_put(mctx, hc->shards, hc->nshards * sizeof(hotshard_t));
+ cleanup_candidates:
+	isc_mem_put(mctx, hc->candidates, size * sizeof(hotentry_t *));
+ cleanup_sketch:
+	isc_mem_put(mctx, hc->sketch, SKETCH_DEPTH * width *
+				      sizeof(hccounter_t));
+ cleanup_sketchlock:
+#if defined(HOTCACHE_USELOCK)
+	DESTROYLOCK(&hc->sketchlock);
+ cleanup_lock:
+#endif
+	DESTROYLOCK(&hc->lock);
+ cleanup_hc:
+	isc_mem_putanddetach(&hc->mctx, hc, sizeof(*hc));
+	return (result);
+}
+
+static void
+fetch_done(isc_task_t *task, isc_event_t *event) {
+	dns_fetchevent_t *devent = (dns_fetchevent_t *)event;
+	hotentry_t *entry = devent->ev_arg;
+	dns_hotcache_t *hc = entry->hc;
+	hotshard_t *shard = entry->shard;
+	isc_stdtime_t now;
+
+	UNUSED(task);
+
+	isc_stdtime_get(&now);
+
+	LOCK(&shard->lock);
+	INSIST(entry->fetch == devent->fetch);
+	entry->fetch = NULL;
+	if (devent->result == ISC_R_SUCCESS ||
+	    devent->result == DNS_R_NCACHENXDOMAIN ||
+	    devent->result == DNS_R_NCACHENXRRSET ||
+	    devent->result == DNS_R_CNAME ||
+	    devent->result == DNS_R_DNAME)
+	{
+		if (dns_rdataset_isassociated(&entry->rdataset))
+			entry->expire = now + entry->rdataset.ttl;
+	}
+	if (dns_rdataset_isassociated(&entry->rdataset))
+		dns_rdataset_disassociate(&entry->rdataset);
+	if (dns_rdataset_isassociated(&entry->sigrdataset))
+		dns_rdataset_disassociate(&entry->sigrdataset);
+	UNLOCK(&shard->lock);
+
+	dns_resolver_destroyfetch(&devent->fetch);
+	if (devent->node != NULL)
+		dns_db_detachnode(devent->db, &devent->node);
+	if (devent->db != NULL)
+		dns_db_detach(&devent->db);
+	isc_event_free(&event);
+
+	dns_hotcache_detach(&hc);
+}
+
+static int
+candidate_compare(const void *a, const void *b) {
+	const hotentry_t *ea = *(const hotentry_t * const *)a;
+	const hotentry_t *eb = *(const hotentry_t * const *)b;
+
+	if (ea->rank > eb->rank)
+		return (-1);
+	if (ea->rank < eb->rank)
+		return (1);
+	return (0);
+}
+
+static void
+tick(isc_task_t *task, isc_event_t *event) {
+	dns_hotcache_t *hc = event->ev_arg;
+	dns_view_t *view;
+	isc_stdtime_t now;
+	isc_uint32_t epoch;
+	dns_ttl_t window;
+	unsigned int i, j, n = 0;
+	isc_result_t result;
+
+	isc_event_free(&event);
+
+	sketch_renew(hc);
+
+	LOCK(&hc->lock);
+	if (hc->shuttingdown) {
+		UNLOCK(&hc->lock);
+		return;
+	}
+
+	view = hc->view;
+	window = view->prefetch_trigger;
+	if (window < REFRESH_MINWINDOW)
+		window = REFRESH_MINWINDOW;
+
+	/*
+	 * Collect the candidates one shard at a time, bringing the
+	 * frequency of every entry up to date as sketch_renew() does for
+	 * the counters.  Selected entries are not replaced by
+	 * dns_hotcache_hit() until they have been dealt with below.
+	 */
+	isc_stdtime_get(&now);
+	epoch = counter_load(&hc->epoch) & 0xffff;
+	for (i = 0; i < hc->nshards; i++) {
+		hotshard_t *shard = &hc->shards[i];
+
+		LOCK(&shard->lock);
+		for (j = 0; j < shard->count; j++) {
+			hotentry_t *entry = shard->entries[j];
+			entry->freq = PACK(epoch, decay(entry->freq, epoch));
+			if (!hc->enabled || entry->fetch != NULL ||
+			    entry->hits < REFRESH_MINHITS ||
+			    entry->expire <= now ||
+			    entry->expire - now > window)
+				continue;
+			entry->selected = ISC_TRUE;
+			entry->rank = COUNT(entry->freq);
+			hc->candidates[n++] = entry;
+		}
+		UNLOCK(&shard->lock);
+	}
+
+	if (n > hc->rate)
+		qsort(hc->candidates, n, sizeof(hotentry_t *),
+		      candidate_compare);
+
+	for (i = 0; i < n; i++) {
+		hotentry_t *entry = hc->candidates[i];
+		hotshard_t *shard = entry->shard;
+
+		LOCK(&shard->lock);
+		entry->selected = ISC_FALSE;
+		if (i >= hc->rate) {
+			UNLOCK(&shard->lock);
+			continue;
+		}
+
+		hc->references++;
+		result = dns_resolver_createfetch(view->resolver, entry->name,
+						  entry->type, NULL, NULL,
+						  NULL, DNS_FETCHOPT_PREFETCH,
+						  task, fetch_done, entry,
+						  &entry->rdataset,
+						  &entry->sigrdataset,
+						  &entry->fetch);
+		if (result != ISC_R_SUCCESS) {
+			hc->references--;
+			UNLOCK(&shard->lock);
+			continue;
+		}
+		entry->hits = 0;
+		UNLOCK(&shard->lock);
+		if (view->resstats != NULL)
+			isc_stats_increment(view->resstats,
+					    dns_resstatscounter_hotrefresh);
+	}
+	UNLOCK(&hc->lock);
+}
+
+static void
+shutdown_done(isc_task_t *task, isc_event_t *event) {
+	dns_hotcache_t *hc = event->ev_arg;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	dns_hotcache_detach(&hc);
+}
+
+isc_result_t
+dns_hotcache_start(dns_hotcache_t *hc, dns_view_t *view,
+		   isc_taskmgr_t *taskmgr, isc_timermgr_t *timermgr,
+		   unsigned int rate)
+{
+	isc_result_t result;
+	isc_interval_t interval;
+
+	REQUIRE(VALID_HOTCACHE(hc));
+	REQUIRE(DNS_VIEW_VALID(view));
+	REQUIRE(rate > 0);
+
+	LOCK(&hc->lock);
+	REQUIRE(hc->task == NULL && !hc->shuttingdown);
+
+	result = isc_task_create(taskmgr, 0, &hc->task);
+	if (result != ISC_R_SUCCESS)
+		goto unlock;
+	isc_task_setname(hc->task, "hotcache", hc);
+
+	/*
+	 * The shutdown event holds a reference, so that ticks which
+	 * are already queued can run after dns_hotcache_shutdown().
+	 */
+	result = isc_task_onshutdown(hc->task, shutdown_done, hc);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_task;
+	hc->references++;
+
+	isc_interval_set(&interval, 1, 0);
+	result = isc_timer_create(timermgr, isc_timertype_ticker, NULL,
+				  &interval, hc->task, tick, hc, &hc->timer);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_task;
+
+	hc->view = view;
+	hc->rate = rate;
+	UNLOCK(&hc->lock);
+	return (ISC_R_SUCCESS);
+
+ cleanup_task:
+	isc_task_shutdown(hc->task);
+	isc_task_detach(&hc->task);
+ unlock:
+	UNLOCK(&hc->lock);
+	return (result);
+}
+
+void
+dns_hotcache_enable(dns_hotcache_t *hc) {
+	REQUIRE(VALID_HOTCACHE(hc));
+
+	LOCK(&hc->lock);
+	hc->enabled = ISC_TRUE;
+	UNLOCK(&hc->lock);
+}
+
+void
+dns_hotcache_shutdown(dns_hotcache_t *hc) {
+	unsigned int i, j;
+
+	REQUIRE(VALID_HOTCACHE(hc));
+
+	LOCK(&hc->lock);
+	if (hc->shuttingdown) {
+		UNLOCK(&hc->lock);
+		return;
+	}
+	hc->shuttingdown = ISC_TRUE;
+	hc->view = NULL;
+	if (hc->timer != NULL)
+		isc_timer_detach(&hc->timer);
+	for (i = 0; i < hc->nshards; i++) {
+		hotshard_t *shard = &hc->shards[i];
+
+		LOCK(&shard->lock);
+		for (j = 0; j < shard->count; j++)
+			if (shard->entries[j]->fetch != NULL)
+				dns_resolver_cancelfetch(
+					shard->entries[j]->fetch);
+		UNLOCK(&shard->lock);
+	}
+	if (hc->task != NULL)
+		isc_task_shutdown(hc->task);
+	UNLOCK(&hc->lock);
+}
+
+void
+dns_hotcache_attach(dns_hotcache_t *source, dns_hotcache_t **targetp) {
+	REQUIRE(VALID_HOTCACHE(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	LOCK(&source->lock);
+	INSIST(source->references > 0);
+	source->references++;
+	INSIST(source->references != 0);
+	UNLOCK(&source->lock);
+
+	*targetp = source;
+}
+
+void
+dns_hotcache_detach(dns_hotcache_t **hcp) {
+	dns_hotcache_t *hc;
+	isc_boolean_t free_hc;
+
+	REQUIRE(hcp != NULL && VALID_HOTCACHE(*hcp));
+
+	hc = *hcp;
+	*hcp = NULL;
+
+	LOCK(&hc->lock);
+	INSIST(hc->references > 0);
+	hc->references--;
+	free_hc = ISC_TF(hc->references == 0);
+	UNLOCK(&hc->lock);
+
+	if (free_hc)
+		destroy(hc);
+}
+
+static void
+destroy(dns_hotcache_t *hc) {
+	isc_uint32_t width = hc->mask + 1;
+	unsigned int i;
+
+	for (i = 0; i < hc->nshards; i++)
+		shard_destroy(hc, &hc->shards[i]);
+	if (hc->timer != NULL)
+		isc_timer_detach(&hc->timer);
+	if (hc->task != NULL)
+		isc_task_detach(&hc->task);
+	isc_mem_put(hc->mctx, hc->shards, hc->nshards * sizeof(hotshard_t));
+	isc_mem_put(hc->mctx, hc->candidates, hc->size * sizeof(hotentry_t *));
+	isc_mem_put(hc->mctx, hc->sketch, SKETCH_DEPTH * width *
+					  sizeof(hccounter_t));
+#if defined(HOTCACHE_USELOCK)
+	DESTROYLOCK(&hc->sketchlock);
+#endif
+	DESTROYLOCK(&hc->lock);
+	hc->magic = 0;
+	isc_mem_putanddetach(&hc->mctx, hc, sizeof(*hc));
+}
+
+/*
+ * Find the least popular of a few tracked entries in 'shard', skipping
+ * those which are being refreshed or considered for refreshing.
+ * Sampling keeps the cost of a miss constant; over time the cursor
+ * visits every entry.
+ */
+static hotentry_t *
+find_victim(hotshard_t *shard, isc_uint32_t epoch) {
+	hotentry_t *victim = NULL;
+	isc_uint32_t freq, vfreq = 0;
+	unsigned int i;
+
+	for (i = 0; i < EVICT_SAMPLE && i < shard->count; i++) {
+		hotentry_t *entry;
+
+		shard->cursor = (shard->cursor + 1) % shard->count;
+		entry = shard->entries[shard->cursor];
+		if (entry->fetch != NULL || entry->selected)
+			continue;
+		freq = decay(entry->freq, epoch);
+		if (victim == NULL || freq < vfreq) {
+			victim = entry;
+			vfreq = freq;
+		}
+	}
+	return (victim);
+}
+
+void
+dns_hotcache_hit(dns_hotcache_t *hc, const dns_name_t *name,
+		 dns_rdatatype_t type, dns_ttl_t ttl, isc_stdtime_t now)
+{
+	unsigned char key[KEY_MAX];
+	unsigned int keylen;
+	isc_uint32_t idx[SKETCH_DEPTH];
+	hotshard_t *shard;
+	hotentry_t *entry = NULL;
+	isc_uint32_t freq, epoch;
+	isc_result_t result;
+
+	REQUIRE(VALID_HOTCACHE(hc));
+	REQUIRE(dns_name_isabsolute(name));
+
+	/*
+	 * Hits recorded after dns_hotcache_shutdown() are harmless, as
+	 * nothing is refreshed any more, so the shutdown state is not
+	 * checked here.
+	 */
+	keylen = makekey(name, type, key);
+	shard = shard_of(hc, sketch_index(hc, key, keylen, idx));
+	freq = sketch_add(hc, idx);
+	epoch = EPOCH(freq);
+
+	LOCK(&shard->lock);
+	result = isc_ht_find(shard->ht, key, keylen, (void **)&entry);
+	if (result == ISC_R_SUCCESS) {
+		entry->freq = freq;
+		entry->hits++;
+		if (entry->fetch == NULL)
+			entry->expire = now + ttl;
+		goto unlock;
+	}
+
+	if (ttl == 0)
+		goto unlock;
+
+	if (shard->count < shard->size) {
+		entry = isc_mem_get(hc->mctx, sizeof(*entry));
+		if (entry == NULL)
+			goto unlock;
+		entry->hc = hc;
+		entry->shard = shard;
+		entry->index = shard->count;
+		entry->selected = ISC_FALSE;
+		entry->rank = 0;
+		entry->fetch = NULL;
+		dns_rdataset_init(&entry->rdataset);
+		dns_rdataset_init(&entry->sigrdataset);
+		dns_fixedname_init(&entry->fn);
+		entry->name = dns_fixedname_name(&entry->fn);
+	} else {
+		/*
+		 * Only replace an entry that is less popular than the
+		 * newcomer, otherwise a stream of one-off names would
+		 * keep flushing the table.
+		 */
+		entry = find_victim(shard, epoch);
+		if (entry == NULL ||
+		    decay(entry->freq, epoch) >= COUNT(freq))
+			goto unlock;
+		(void)isc_ht_delete(shard->ht, entry->key, entry->keylen);
+	}
+
+	memmove(entry->key, key, keylen);
+	entry->keylen = keylen;
+	dns_name_copy(name, entry->name, NULL);
+	entry->type = type;
+	entry->freq = freq;
+	entry->hits = 1;
+	entry->expire = now + ttl;
+
+	result = isc_ht_add(shard->ht, entry->key, entry->keylen, entry);
+	if (result != ISC_R_SUCCESS) {
+		/*
+		 * Out of memory: drop the entry, moving the last one
+		 * into its slot.
+		 */
+		if (entry->index < shard->count) {
+			hotentry_t *last = shard->entries[--shard->count];
+			if (last != entry) {
+				shard->entries[entry->index] = last;
+				last->index = entry->index;
+			}
+		}
+		isc_mem_put(hc->mctx, entry, sizeof(*entry));
+		goto unlock;
+	}
+	if (entry->index == shard->count)
+		shard->entries[shard->count++] = entry;
+
+ unlock:
+	UNLOCK(&shard->lock);
+}
+
+isc_uint32_t
+dns_hotcache_estimate(dns_hotcache_t *hc, const dns_name_t *name,
+		      dns_rdatatype_t type)
+{
+	unsigned char key[KEY_MAX];
+	unsigned int keylen;
+	isc_uint32_t idx[SKETCH_DEPTH];
+	isc_uint32_t est;
+
+	REQUIRE(VALID_HOTCACHE(hc));
+
+	keylen = makekey(name, type, key);
+	(void)sketch_index(hc, key, keylen, idx);
+	SKETCH_LOCK(hc);
+	est = sketch_estimate(hc, idx, counter_load(&hc->epoch) & 0xffff);
+	SKETCH_UNLOCK(hc);
+
+	return (est);
+}
+
+isc_boolean_t
+dns_hotcache_tracked(dns_hotcache_t *hc, const dns_name_t *name,
+		     dns_rdatatype_t type)
+{
+	unsigned char key[KEY_MAX];
+	unsigned int keylen;
+	isc_uint32_t idx[SKETCH_DEPTH];
+	hotshard_t *shard;
+	void *value = NULL;
+	isc_result_t result;
+
+	REQUIRE(VALID_HOTCACHE(hc));
+
+	keylen = makekey(name, type, key);
+	shard = shard_of(hc, sketch_index(hc, key, keylen, idx));
+	LOCK(&shard->lock);
+	result = isc_ht_find(shard->ht, key, keylen, &value);
+	UNLOCK(&shard->lock);
+
+	return (ISC_TF(result == ISC_R_SUCCESS));
+}
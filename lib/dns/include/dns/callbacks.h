@@ -42,6 +42,18 @@ struct dns_rdatacallbacks {
 	 */
 	dns_addrdatasetfunc_t add;
 
+	/*%
+	 * If 'prepare' is set, a loader may call it, from several threads
+	 * at once, to convert an rdataset into the database's own form
+	 * ahead of time.  Each prepared rdataset is then either passed to
+	 * 'addprepared', from one thread at a time and in the order in
+	 * which 'add' would have been called, or released with
+	 * 'freeprepared'.  'addprepared' releases it when it fails.
+	 */
+	dns_preparefunc_t prepare;
+	dns_addpreparedfunc_t addprepared;
+	dns_freepreparedfunc_t freeprepared;
+
 	/*%
 	 * This is called when reading in a database image from a 'map'
 	 * format zone file.
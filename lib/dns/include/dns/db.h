@@ -807,6 +807,14 @@ dns_db_findext(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
  *	in the NSEC3 tree and not the main tree.  Without this option being
  *	set NSEC3 records will not be found.
  *
+ * \li	If both the DNS_DBFIND_COVERINGNSEC and #DNS_DBFIND_FORCENSEC3
+ *	options are set and 'type' is NSEC3, then 'name' is taken to be
+ *	a hashed owner name and the cached NSEC3 record at 'name' or the
+ *	one preceding it in its zone's NSEC3 chain is returned.  As with
+ *	DNS_DBFIND_COVERINGNSEC the record needs to be checked to ensure
+ *	that it is correct.  This only affects answers returned from the
+ *	cache.
+ *
  * \li	To respond to a query for SIG records, the caller should create a
  *	rdataset iterator and extract the signatures from each rdataset.
  *
@@ -921,7 +929,8 @@ dns_db_findext(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
  *						no data at the name.
  *
  *	\li	#DNS_R_COVERINGNSEC		The returned data is a NSEC
- *						that potentially covers 'name'.
+ *						or NSEC3 that potentially
+ *						covers 'name'.
  *
  *	\li	#DNS_R_EMPTYWILD		The name is a wildcard without
  *						resource records.
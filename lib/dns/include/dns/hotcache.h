@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_HOTCACHE_H
+#define DNS_HOTCACHE_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file
+ * \brief
+ * The hotcache module keeps track of the most popular names and types
+ * answered from a view's cache, and refreshes them in the background
+ * shortly before they expire so that clients asking for them keep
+ * getting cache hits.
+ *
+ * Popularity is estimated with a count-min sketch that is halved
+ * periodically, so that names which stop being queried fade away.
+ * The names with the highest estimates (up to the configured size)
+ * are kept in a table together with the time their cached data
+ * expires.  Once a second, tracked names that have been queried since
+ * their last refresh and are within the view's prefetch trigger of
+ * expiring are refetched, most popular first, up to a configured rate.
+ */
+
+#include <isc/lang.h>
+#include <isc/stdtime.h>
+
+#include <dns/types.h>
+
+ISC_LANG_BEGINDECLS
+
+/*%
+ * The largest number of names a hotcache can track.
+ */
+#define DNS_HOTCACHE_MAXSIZE	100000
+
+isc_result_t
+dns_hotcache_create(isc_mem_t *mctx, unsigned int size,
+		    dns_hotcache_t **hcp);
+/*%<
+ * Create a table tracking the 'size' most popular names.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	0 < 'size' <= #DNS_HOTCACHE_MAXSIZE.
+ *\li	hcp != NULL && *hcp == NULL
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOMEMORY
+ */
+
+isc_result_t
+dns_hotcache_start(dns_hotcache_t *hc, dns_view_t *view,
+		   isc_taskmgr_t *taskmgr, isc_timermgr_t *timermgr,
+		   unsigned int rate);
+/*%<
+ * Prepare to refresh popular names using 'view's resolver, starting at
+ * most 'rate' refreshes per second.  No refreshes are started until
+ * dns_hotcache_enable() has been called, which dns_view_freeze() does
+ * once the view's resolver can be used.
+ *
+ * The hotcache does not hold a reference to 'view'; the view must call
+ * dns_hotcache_shutdown() before its resolver is shut down.
+ *
+ * Requires:
+ *\li	'hc' is a valid hotcache which has not been started.
+ *\li	'view' is a valid view with a resolver.
+ *\li	'rate' > 0.
+ */
+
+void
+dns_hotcache_enable(dns_hotcache_t *hc);
+/*%<
+ * Allow refreshes to start.
+ *
+ * Requires:
+ *\li	'hc' is a valid hotcache whose view's resolver is frozen.
+ */
+
+void
+dns_hotcache_shutdown(dns_hotcache_t *hc);
+/*%<
+ * Stop refreshing and cancel any refreshes in progress.
+ *
+ * Requires:
+ *\li	'hc' is a valid hotcache.
+ */
+
+void
+dns_hotcache_attach(dns_hotcache_t *source, dns_hotcache_t **targetp);
+
+void
+dns_hotcache_detach(dns_hotcache_t **hcp);
+
+void
+dns_hotcache_hit(dns_hotcache_t *hc, const dns_name_t *name,
+		 dns_rdatatype_t type, dns_ttl_t ttl, isc_stdtime_t now);
+/*%<
+ * Record that 'name'/'type' was answered from the cache with 'ttl'
+ * seconds left to live at 'now'.
+ *
+ * Requires:
+ *\li	'hc' is a valid hotcache.
+ *\li	'name' is a valid absolute name.
+ */
+
+isc_uint32_t
+dns_hotcache_estimate(dns_hotcache_t *hc, const dns_name_t *name,
+		      dns_rdatatype_t type);
+/*%<
+ * Return the estimated number of recent hits for 'name'/'type'.
+ * The estimate may be too high because of collisions, and slightly
+ * too low when the same name was counted by several threads at once.
+ */
+
+isc_boolean_t
+dns_hotcache_tracked(dns_hotcache_t *hc, const dns_name_t *name,
+		     dns_rdatatype_t type);
+/*%<
+ * Return ISC_TRUE if 'name'/'type' is currently among the names being
+ * kept fresh.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_HOTCACHE_H */
@@ -43,6 +43,7 @@
 #define DNS_JOURNAL_READ	0x00000000	/* ISC_FALSE */
 #define DNS_JOURNAL_CREATE	0x00000001	/* ISC_TRUE */
 #define DNS_JOURNAL_WRITE	0x00000002
+#define DNS_JOURNAL_MAP		0x00000004
 
 #define DNS_JOURNAL_SIZE_MAX	ISC_INT32_MAX
 #define DNS_JOURNAL_SIZE_MIN	4096
@@ -62,6 +63,12 @@
  */
 typedef struct dns_journal dns_journal_t;
 
+/*%
+ * A dns_compactctx_t holds the state of a journal compaction that is
+ * done in steps.  This is an opaque type.
+ */
+typedef struct dns_compactctx dns_compactctx_t;
+
 
 /***
  *** Functions
@@ -105,6 +112,14 @@ dns_journal_open(isc_mem_t *mctx, const char *filename, unsigned int mode,
  * the journal if it does not exist.
  * DNS_JOURNAL_WRITE open the journal for reading and writing.
  * DNS_JOURNAL_READ open the journal for reading only.
+ *
+ * DNS_JOURNAL_MAP may be added to DNS_JOURNAL_READ to map the committed
+ * part of the journal into memory and index every transaction in it
+ * when it is opened.  Finding a serial number is then a binary search
+ * and RRs are parsed straight out of the mapping rather than read from
+ * the file, which suits outgoing IXFR from long journals.  Transactions
+ * committed after the journal was opened are not seen.  If the journal
+ * cannot be mapped it is read from the file as usual.
  */
 
 void
@@ -289,6 +304,53 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
  * exists and is non-empty 'serial' must exist in the journal.
  */
 
+isc_result_t
+dns_journal_compactbegin(isc_mem_t *mctx, const char *filename,
+			 isc_uint32_t serial, isc_uint32_t target_size,
+			 dns_compactctx_t **cctxp);
+isc_result_t
+dns_journal_compactcopy(dns_compactctx_t *cctx);
+isc_result_t
+dns_journal_compactend(dns_compactctx_t **cctxp);
+void
+dns_journal_compactcancel(dns_compactctx_t **cctxp);
+/*%<
+ * Compact the journal as dns_journal_compact() does, in steps, so that
+ * transactions can be committed to it while the bulk of the work is
+ * done.
+ *
+ * dns_journal_compactbegin() takes a snapshot of the journal's header
+ * and index.  dns_journal_compactcopy() copies the transactions to be
+ * kept, as of the snapshot, into a new journal file; it does not need
+ * to be serialized with writers of the journal and may be run in
+ * another task.  dns_journal_compactend() copies the transactions
+ * committed since the snapshot was taken to the new file and replaces
+ * the journal with it; it must be serialized with writers of the
+ * journal.  dns_journal_compactcancel() abandons the compaction after
+ * any step.  dns_journal_compactend() and dns_journal_compactcancel()
+ * free '*cctxp' and set it to NULL.
+ *
+ * Requires:
+ *\li	'cctxp' is not NULL and '*cctxp' is NULL
+ *	(dns_journal_compactbegin()).
+ *\li	'cctx' is a context that has not been copied yet
+ *	(dns_journal_compactcopy()).
+ *\li	'*cctxp' is a context that has been copied
+ *	(dns_journal_compactend()).
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	DNS_R_UNCHANGED		the journal is empty or already small enough;
+ *				no context is returned
+ *				(dns_journal_compactbegin()).
+ *\li	ISC_R_RANGE		'serial' is not in the journal
+ *				(dns_journal_compactbegin()).
+ *\li	ISC_R_NOTFOUND		the journal has gone, or has been replaced
+ *				since the snapshot was taken
+ *				(dns_journal_compactend()).
+ *\li	Other errors are possible.
+ */
+
 isc_boolean_t
 dns_journal_get_sourceserial(dns_journal_t *j, isc_uint32_t *sourceserial);
 void
@@ -167,6 +167,19 @@ dns_master_loadfile5(const char *master_file,
 		     dns_masterformat_t format,
 		     dns_ttl_t maxttl);
 
+isc_result_t
+dns_master_loadfile6(const char *master_file,
+		     dns_name_t *top,
+		     dns_name_t *origin,
+		     dns_rdataclass_t zclass,
+		     unsigned int options,
+		     isc_uint32_t resign,
+		     dns_rdatacallbacks_t *callbacks,
+		     dns_masterincludecb_t include_cb,
+		     void *include_arg, isc_mem_t *mctx,
+		     dns_masterformat_t format,
+		     dns_ttl_t maxttl, unsigned int threads);
+
 isc_result_t
 dns_master_loadstream(FILE *stream,
 		      dns_name_t *top,
@@ -259,6 +272,21 @@ dns_master_loadfileinc5(const char *master_file,
 			isc_mem_t *mctx, dns_masterformat_t format,
 			isc_uint32_t maxttl);
 
+isc_result_t
+dns_master_loadfileinc6(const char *master_file,
+			dns_name_t *top,
+			dns_name_t *origin,
+			dns_rdataclass_t zclass,
+			unsigned int options,
+			isc_uint32_t resign,
+			dns_rdatacallbacks_t *callbacks,
+			isc_task_t *task,
+			dns_loaddonefunc_t done, void *done_arg,
+			dns_loadctx_t **ctxp,
+			dns_masterincludecb_t include_cb, void *include_arg,
+			isc_mem_t *mctx, dns_masterformat_t format,
+			isc_uint32_t maxttl, unsigned int threads);
+
 isc_result_t
 dns_master_loadstreaminc(FILE *stream,
 			 dns_name_t *top,
@@ -312,6 +340,13 @@ dns_master_loadlexerinc(isc_lex_t *lex,
  * 'resign' the number of seconds before a RRSIG expires that it should
  * be re-signed.  0 is used if not provided.
  *
+ * dns_master_loadfile6() and dns_master_loadfileinc6() parse text files
+ * on 'threads' threads when it is greater than 1.  The file is split at
+ * record boundaries and the pieces are parsed concurrently, but
+ * 'callbacks->add', 'callbacks->error', 'callbacks->warn' and
+ * 'include_cb' are still only called from the calling thread (or task),
+ * in file order.  The incremental variant adds one piece per quantum.
+ *
  * Requires:
  *\li	'master_file' points to a valid string.
  *\li	'lexer' points to a valid lexer.
@@ -324,6 +359,7 @@ dns_master_loadlexerinc(isc_lex_t *lex,
  *\li	'task' and 'done' to be valid.
  *\li	'lmgr' to be valid.
  *\li	'ctxp != NULL && ctxp == NULL'.
+ *\li	'threads' to be greater than 0.
  *
  * Returns:
  *\li	ISC_R_SUCCESS upon successfully loading the master file.
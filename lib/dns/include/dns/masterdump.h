@@ -281,6 +281,14 @@ dns_master_dumptostream3(isc_mem_t *mctx, dns_db_t *db,
 			 const dns_master_style_t *style,
 			 dns_masterformat_t format,
 			 dns_masterrawheader_t *header, FILE *f);
+
+isc_result_t
+dns_master_dumptostream4(isc_mem_t *mctx, dns_db_t *db,
+			 dns_dbversion_t *version,
+			 const dns_master_style_t *style,
+			 dns_masterformat_t format,
+			 dns_masterrawheader_t *header, FILE *f,
+			 unsigned int threads);
 /*%<
  * Dump the database 'db' to the steam 'f' in the specified format by
  * 'format'.  If the format is dns_masterformat_text (the RFC1035 format),
@@ -294,6 +302,12 @@ dns_master_dumptostream3(isc_mem_t *mctx, dns_db_t *db,
  * If 'format' is dns_masterformat_raw, then 'header' can contain
  * information to be written to the file header.
  *
+ * dns_master_dumptostream4() renders raw format on 'threads' threads
+ * when it is greater than 1.  The database is still walked, and the
+ * file written, by the calling thread in node order, so the output is
+ * the same whatever the number of threads.  Other formats ignore
+ * 'threads'.
+ *
  * Temporary dynamic memory may be allocated from 'mctx'.
  *
  * Require:
@@ -359,6 +373,12 @@ dns_master_dump3(isc_mem_t *mctx, dns_db_t *db,
  * If 'format' is dns_masterformat_raw, then 'header' can contain
  * information to be written to the file header.
  *
+ * dns_master_dumptostream4() renders raw format on 'threads' threads
+ * when it is greater than 1.  The database is still walked, and the
+ * file written, by the calling thread in node order, so the output is
+ * the same whatever the number of threads.  Other formats ignore
+ * 'threads'.
+ *
  * Temporary dynamic memory may be allocated from 'mctx'.
  *
  * Returns:
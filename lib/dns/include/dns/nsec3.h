@@ -16,10 +16,13 @@
 
 #include <isc/lang.h>
 #include <isc/iterated_hash.h>
+#include <isc/stdtime.h>
 
 #include <dns/db.h>
 #include <dns/diff.h>
+#include <dns/fixedname.h>
 #include <dns/name.h>
+#include <dns/rdataset.h>
 #include <dns/rdatastruct.h>
 #include <dns/types.h>
 
@@ -40,6 +43,21 @@
  */
 #define DNS_NSEC3_UNKNOWNALG ((dns_hash_t)245U)
 
+/*
+ * The parts of a proof of nonexistence found by dns_nsec3_findproof().
+ */
+#define DNS_NSEC3PROOF_CLOSEST		0	/* closest encloser */
+#define DNS_NSEC3PROOF_NEXTCLOSER	1	/* covers the next closer */
+#define DNS_NSEC3PROOF_WILDCARD		2	/* covers the wildcard */
+#define DNS_NSEC3PROOF_MAX		3
+
+typedef struct dns_nsec3proof {
+	isc_boolean_t		exists;
+	dns_fixedname_t		names[DNS_NSEC3PROOF_MAX];
+	dns_rdataset_t		rdatasets[DNS_NSEC3PROOF_MAX];
+	dns_rdataset_t		sigrdatasets[DNS_NSEC3PROOF_MAX];
+} dns_nsec3proof_t;
+
 ISC_LANG_BEGINDECLS
 
 isc_result_t
@@ -269,6 +287,47 @@ dns_nsec3_noexistnodata(dns_rdatatype_t type, const dns_name_t *name,
 			isc_boolean_t *setnearest, dns_name_t *closest,
 			dns_name_t *nearest, dns_nseclog_t logit, void *arg);
 
+void
+dns_nsec3proof_init(dns_nsec3proof_t *proof);
+
+void
+dns_nsec3proof_invalidate(dns_nsec3proof_t *proof);
+/*%<
+ * Initialize 'proof', or disassociate any rdatasets held by it.
+ */
+
+isc_result_t
+dns_nsec3_findproof(dns_db_t *db, const dns_name_t *zone,
+		    const dns_name_t *name, dns_rdatatype_t type,
+		    isc_stdtime_t now, dns_nsec3proof_t *proof,
+		    dns_nseclog_t logit, void *arg);
+/*%<
+ * Try to prove from the secure NSEC3 records of 'zone' held in the cache
+ * 'db' that 'name' does not exist, or that it has no records of 'type'.
+ *
+ * If 'name' exists but has no 'type' records, 'proof->exists' is set
+ * and the DNS_NSEC3PROOF_CLOSEST slot of 'proof' holds the NSEC3 record
+ * matching 'name'.  Otherwise all three slots hold the records proving
+ * the closest encloser, and that neither the next closer name nor the
+ * wildcard at the closest encloser exist.  The same record may appear
+ * in more than one slot.
+ *
+ * No proof is returned when the next closer name is covered by an
+ * opt-out record, when there is a matching wildcard, or when the
+ * NSEC3 chain uses too many iterations to be hashed cheaply.
+ *
+ * Requires:
+ *\li	'db' is a valid cache database.
+ *\li	'name' is a subdomain of 'zone'.
+ *\li	'proof' was initialized with dns_nsec3proof_init() and holds
+ *	no rdatasets.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOTFOUND	if no proof can be made from the cached records.
+ *\li	other errors from dns_db_find() or hashing.
+ */
+
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_NSEC3_H */
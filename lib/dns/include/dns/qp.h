@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_QP_H
+#define DNS_QP_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file
+ * \brief
+ * A qp-trie mapping DNS names to caller supplied values.
+ *
+ * Names are converted to byte keys before they are stored: the labels
+ * are taken from the root down, each octet is folded to lower case and
+ * mapped to one of a small set of symbols (common hostname characters
+ * get one symbol each, everything else an escape symbol followed by a
+ * second symbol), and every label is terminated by a separator symbol.
+ * Comparing two keys symbol by symbol therefore gives the DNSSEC
+ * canonical order of the names, so an in-order walk of the trie visits
+ * the names in the order NSEC chains need, and the keys of the
+ * ancestors of a name are exactly its prefixes that end in a separator.
+ *
+ * Each branch of the trie tests a single key offset and holds a bitmap
+ * of the symbols present at that offset followed by a packed array of
+ * its children, so a lookup touches one small node per branch instead
+ * of one tree node per label plus the nodes of the binary trees
+ * between them.  Leaves are the caller's values; the trie does not
+ * store the keys but asks the caller to recreate them when needed.
+ *
+ * The trie is not locked; callers must serialize modifications and
+ * must not look up or iterate while the trie is being modified.
+ */
+
+#include <isc/lang.h>
+#include <isc/magic.h>
+
+#include <dns/types.h>
+
+ISC_LANG_BEGINDECLS
+
+/*%
+ * The longest key of any name, which is two symbols for each octet of
+ * a name in wire format.
+ */
+#define DNS_QP_MAXKEY		512
+
+/*%
+ * The most ancestors a name can have.
+ */
+#define DNS_QP_MAXCHAIN		128
+
+typedef isc_uint8_t dns_qpkey_t[DNS_QP_MAXKEY];
+
+typedef struct dns_qpnode dns_qpnode_t;
+
+typedef struct dns_qpmethods {
+	unsigned int	(*makekey)(dns_qpkey_t key, void *ctx, void *value);
+	void		(*destroy)(void *ctx, void *value);
+} dns_qpmethods_t;
+/*%<
+ * 'makekey' recreates the key of 'value' (usually by calling
+ * dns_qpkey_fromname() on the name stored in it) and returns its
+ * length.  'destroy', which may be NULL, is called for each value
+ * left in the trie when it is destroyed.
+ */
+
+typedef struct dns_qpchain {
+	unsigned int	length;
+	void *		values[DNS_QP_MAXCHAIN];
+} dns_qpchain_t;
+/*%<
+ * The values of the ancestors of a name which are present in the trie,
+ * starting with the one nearest the root.
+ */
+
+typedef struct dns_qpiter {
+	unsigned int		magic;
+	dns_qp_t *		qp;
+	int			sp;
+	struct {
+		dns_qpnode_t *	branch;
+		unsigned int	twig;
+	}			stack[DNS_QP_MAXKEY + 1];
+} dns_qpiter_t;
+/*%<
+ * A position in the trie.  The contents are private.
+ */
+
+unsigned int
+dns_qpkey_fromname(dns_qpkey_t key, const dns_name_t *name);
+/*%<
+ * Convert 'name' to a trie key and return the length of the key.
+ *
+ * Requires:
+ *\li	'name' is a valid absolute name.
+ */
+
+isc_result_t
+dns_qp_create(isc_mem_t *mctx, const dns_qpmethods_t *methods, void *ctx,
+	      dns_qp_t **qpp);
+/*%<
+ * Create an empty trie.  'ctx' is passed to the methods.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	'methods' is not NULL and methods->makekey is not NULL.
+ *\li	qpp != NULL && *qpp == NULL
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOMEMORY
+ */
+
+void
+dns_qp_destroy(dns_qp_t **qpp);
+/*%<
+ * Destroy a trie, calling the 'destroy' method for each value in it.
+ *
+ * Requires:
+ *\li	'*qpp' is a valid trie.
+ */
+
+isc_result_t
+dns_qp_insert(dns_qp_t *qp, void *value);
+/*%<
+ * Add 'value' to the trie under the key the 'makekey' method returns
+ * for it.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_EXISTS		there already is a value with the same key
+ *\li	ISC_R_NOMEMORY
+ */
+
+isc_result_t
+dns_qp_getname(dns_qp_t *qp, const dns_name_t *name, void **valuep);
+/*%<
+ * Find the value stored under 'name'.
+ *
+ * Requires:
+ *\li	valuep != NULL && *valuep == NULL
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOTFOUND
+ */
+
+isc_result_t
+dns_qp_deletename(dns_qp_t *qp, const dns_name_t *name, void **valuep);
+/*%<
+ * Remove the value stored under 'name' from the trie.  If 'valuep' is
+ * not NULL the value is returned in it; the 'destroy' method is not
+ * called.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOTFOUND
+ *\li	ISC_R_NOMEMORY		the trie is unchanged
+ */
+
+isc_result_t
+dns_qp_findname_ancestor(dns_qp_t *qp, const dns_name_t *name,
+			 void **valuep, dns_qpchain_t *chain);
+/*%<
+ * Find the value stored under 'name' or, failing that, under its
+ * closest ancestor.  If 'chain' is not NULL, it is set to the values of
+ * all ancestors of 'name' in the trie (not including 'name' itself).
+ *
+ * Requires:
+ *\li	valuep != NULL && *valuep == NULL
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS		'name' was found
+ *\li	DNS_R_PARTIALMATCH	'*valuep' is the closest ancestor
+ *\li	ISC_R_NOTFOUND		neither 'name' nor an ancestor was found
+ */
+
+unsigned int
+dns_qp_count(dns_qp_t *qp);
+/*%<
+ * Return the number of values in the trie.
+ */
+
+size_t
+dns_qp_memusage(dns_qp_t *qp);
+/*%<
+ * Return the number of bytes of memory used by the trie itself, not
+ * counting the values.
+ */
+
+void
+dns_qpiter_init(dns_qp_t *qp, dns_qpiter_t *it);
+/*%<
+ * Initialize an iterator over 'qp'.  The iterator is not positioned:
+ * dns_qpiter_next() returns the first value and dns_qpiter_prev() the
+ * last.  Modifying the trie invalidates its iterators.
+ */
+
+isc_result_t
+dns_qpiter_first(dns_qpiter_t *it, void **valuep);
+isc_result_t
+dns_qpiter_last(dns_qpiter_t *it, void **valuep);
+/*%<
+ * Move to the value with the smallest (largest) key.  If 'valuep' is
+ * not NULL the value is returned in it.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOMORE		the trie is empty
+ */
+
+isc_result_t
+dns_qpiter_next(dns_qpiter_t *it, void **valuep);
+isc_result_t
+dns_qpiter_prev(dns_qpiter_t *it, void **valuep);
+/*%<
+ * Move to the next (previous) value in canonical order.  If 'valuep'
+ * is not NULL the value is returned in it.  After ISC_R_NOMORE the
+ * iterator is no longer positioned.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOMORE
+ */
+
+isc_result_t
+dns_qpiter_seek(dns_qpiter_t *it, const dns_name_t *name, void **valuep);
+/*%<
+ * Move to the value stored under 'name' or, if there is none, the
+ * value with the largest key less than that of 'name'.  If 'valuep' is
+ * not NULL the value is returned in it.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS		'name' was found
+ *\li	DNS_R_PARTIALMATCH	positioned at the predecessor of 'name'
+ *\li	ISC_R_NOTFOUND		'name' sorts before every key in the trie;
+ *				the iterator is not positioned
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_QP_H */
@@ -126,6 +126,18 @@ typedef enum {
 #define DNS_RESOLVER_QRYRTTCLASS4	1600
 #define DNS_RESOLVER_QRYRTTCLASS4STR	"1600"
 
+/*
+ * Upper bounds of class of time spent waiting in a fetches-per-zone
+ * admission queue (ms).  Corresponds to dns_resstatscounter_zonequeuelatX
+ * statistics counters.
+ */
+#define DNS_RESOLVER_QUEUELATCLASS0	10
+#define DNS_RESOLVER_QUEUELATCLASS0STR	"10"
+#define DNS_RESOLVER_QUEUELATCLASS1	100
+#define DNS_RESOLVER_QUEUELATCLASS1STR	"100"
+#define DNS_RESOLVER_QUEUELATCLASS2	500
+#define DNS_RESOLVER_QUEUELATCLASS2STR	"500"
+
 /*
  * XXXRTH  Should this API be made semi-private?  (I.e.
  * _dns_resolver_create()).
@@ -572,6 +584,23 @@ dns_resolver_setclientsperquery(dns_resolver_t *resolver,
 void
 dns_resolver_setfetchesperzone(dns_resolver_t *resolver, isc_uint32_t clients);
 
+void
+dns_resolver_setfetchesperzonequeue(dns_resolver_t *resolver,
+				    isc_uint32_t queue);
+/*%<
+ * Set the number of new fetches per zone that may wait for a
+ * fetches-per-zone slot to become free instead of being dropped or
+ * failed immediately.  Waiting fetches are admitted in priority order:
+ * fetches that other resolutions depend upon first, then those with
+ * the most clients attached, and prefetches last.  Fetches still
+ * waiting when the fetch lifetime expires time out as usual.
+ *
+ * A value of zero (the default) disables queueing.
+ *
+ * Requires:
+ * \li  resolver to be valid.
+ */
+
 void
 dns_resolver_getclientsperquery(dns_resolver_t *resolver, isc_uint32_t *cur,
 				isc_uint32_t *min, isc_uint32_t *max);
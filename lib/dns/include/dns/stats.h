@@ -68,7 +68,15 @@ enum {
 	dns_resstatscounter_serverquota = 42,
 	dns_resstatscounter_nextitem = 43,
 	dns_resstatscounter_priming = 44,
-	dns_resstatscounter_max = 45,
+	dns_resstatscounter_zonequeued = 45,
+	dns_resstatscounter_zonequeuedepth = 46,
+	dns_resstatscounter_zonequeueexpired = 47,
+	dns_resstatscounter_zonequeuelat0 = 48,
+	dns_resstatscounter_zonequeuelat1 = 49,
+	dns_resstatscounter_zonequeuelat2 = 50,
+	dns_resstatscounter_zonequeuelat3 = 51,
+	dns_resstatscounter_hotrefresh = 52,
+	dns_resstatscounter_max = 53,
 
 	/*
 	 * DNSSEC stats.
@@ -86,6 +86,7 @@ typedef struct dns_fixedname			dns_fixedname_t;
 typedef struct dns_forwarders			dns_forwarders_t;
 typedef struct dns_forwarder			dns_forwarder_t;
 typedef struct dns_fwdtable			dns_fwdtable_t;
+typedef struct dns_hotcache			dns_hotcache_t;
 typedef struct dns_iptable			dns_iptable_t;
 typedef isc_uint32_t				dns_iterations_t;
 typedef isc_uint16_t				dns_keyflags_t;
@@ -111,6 +112,7 @@ typedef struct dns_order			dns_order_t;
 typedef struct dns_peer				dns_peer_t;
 typedef struct dns_peerlist			dns_peerlist_t;
 typedef struct dns_portlist			dns_portlist_t;
+typedef struct dns_qp				dns_qp_t;
 typedef struct dns_rbt				dns_rbt_t;
 typedef isc_uint16_t				dns_rcode_t;
 typedef struct dns_rdata			dns_rdata_t;
@@ -402,6 +404,15 @@ typedef void
 typedef isc_result_t
 (*dns_addrdatasetfunc_t)(void *, const dns_name_t *, dns_rdataset_t *);
 
+typedef isc_result_t
+(*dns_preparefunc_t)(void *, const dns_name_t *, dns_rdataset_t *, void **);
+
+typedef isc_result_t
+(*dns_addpreparedfunc_t)(void *, const dns_name_t *, void *);
+
+typedef void
+(*dns_freepreparedfunc_t)(void *, void *);
+
 typedef isc_result_t
 (*dns_additionaldatafunc_t)(void *, const dns_name_t *, dns_rdatatype_t);
 
@@ -427,6 +438,9 @@ typedef isc_boolean_t
 (*dns_checknsfunc_t)(dns_zone_t *, const dns_name_t *, const dns_name_t *,
 		     dns_rdataset_t *, dns_rdataset_t *);
 
+typedef void
+(*dns_checkstartfunc_t)(dns_zone_t *, dns_db_t *);
+
 typedef isc_boolean_t
 (*dns_isselffunc_t)(dns_view_t *, dns_tsigkey_t *, const isc_sockaddr_t *,
 		    const isc_sockaddr_t *, dns_rdataclass_t, void *);
@@ -154,6 +154,7 @@ struct dns_view {
 	char				*nta_file;
 	dns_ttl_t			prefetch_trigger;
 	dns_ttl_t			prefetch_eligible;
+	dns_hotcache_t			*hotcache;
 	in_port_t			dstport;
 	dns_aclenv_t			aclenv;
 	dns_rdatatype_t			preferred_glue;
@@ -521,6 +522,8 @@ void
 dns_view_freeze(dns_view_t *view);
 /*%<
  * Freeze view.  No changes can be made to view configuration while frozen.
+ * The view's hotcache, if any, starts refreshing names once the view has
+ * been frozen.
  *
  * Requires:
  *
@@ -1135,6 +1138,23 @@ dns_view_initntatable(dns_view_t *view,
  *\li	Any other result indicates failure
  */
 
+isc_result_t
+dns_view_inithotcache(dns_view_t *view, unsigned int size, unsigned int rate,
+		      isc_taskmgr_t *taskmgr, isc_timermgr_t *timermgr);
+/*%<
+ * Start keeping the 'size' most popular names in the view's cache
+ * fresh, refreshing at most 'rate' of them per second once the view
+ * is frozen.  Any previous hotcache is shut down first.
+ *
+ * Requires:
+ * \li	'view' is valid and has a resolver.
+ * \li	0 < 'size' <= #DNS_HOTCACHE_MAXSIZE and 'rate' > 0.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	Any other result indicates failure
+ */
+
 isc_result_t
 dns_view_getntatable(dns_view_t *view, dns_ntatable_t **ntp);
 /*%<
@@ -368,6 +368,27 @@ dns_zone_getmaxttl(dns_zone_t *zone);
  *\li	dns_ttl_t maxttl.
  */
 
+void
+dns_zone_setthreads(dns_zone_t *zone, unsigned int threads);
+/*%<
+ * 	Sets the number of threads used to parse the master file when
+ *	it is in text format, and to write the zone with
+ *	dns_zone_dumptostream3() in raw format.  The default is 1.
+ *
+ * Requires:
+ *\li	'zone' to be valid initialised zone.
+ *\li	'threads' to be greater than 0.
+ */
+
+unsigned int
+dns_zone_getthreads(dns_zone_t *zone);
+/*%<
+ * 	Gets the number of threads set by dns_zone_setthreads().
+ *
+ * Requires:
+ *\li	'zone' to be valid initialised zone.
+ */
+
 isc_result_t
 dns_zone_load(dns_zone_t *zone);
 
@@ -1400,6 +1421,23 @@ dns_zone_gettask(dns_zone_t *zone, isc_task_t **target);
  *\li	'target' to be != NULL && '*target' == NULL.
  */
 
+isc_result_t
+dns_zone_createtask(dns_zone_t *zone, isc_task_t **target);
+/*%<
+ * Create a new task with the task manager of the zone's zone manager,
+ * for work that must run off the zone's own task without waiting
+ * behind the zone manager's shared load tasks.
+ *
+ * Requires:
+ *\li	'zone' to be valid initialised zone.
+ *\li	'target' to be != NULL && '*target' == NULL.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOTFOUND	the zone is not managed by a zone manager.
+ *\li	Any error isc_task_create() can return.
+ */
+
 void
 dns_zone_notify(dns_zone_t *zone);
 /*%<
@@ -1843,6 +1881,18 @@ dns_zonemgr_setserialqueryrate(dns_zonemgr_t *zmgr, unsigned int value);
  *\li	'zmgr' to be a valid zone manager
  */
 
+void
+dns_zonemgr_setserialquerybatch(dns_zonemgr_t *zmgr, unsigned int value);
+/*%<
+ *	Set the number of SOA queries to the same master that are sent
+ *	together each time the serial query rate allows a query to that
+ *	master.  Queries waiting to be sent are queued per master and
+ *	the masters take turns.  Zero is treated as one, the default.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager
+ */
+
 unsigned int
 dns_zonemgr_getnotifyrate(dns_zonemgr_t *zmgr);
 /*%<
@@ -1870,6 +1920,28 @@ dns_zonemgr_getserialqueryrate(dns_zonemgr_t *zmgr);
  *\li	'zmgr' to be a valid zone manager.
  */
 
+unsigned int
+dns_zonemgr_getserialquerybatch(dns_zonemgr_t *zmgr);
+/*%<
+ *	Return the number of SOA queries to one master sent together.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ */
+
+void
+dns_zonemgr_getrefreshqueue(dns_zonemgr_t *zmgr, unsigned int *queriesp,
+			    unsigned int *primariesp);
+/*%<
+ *	Return the number of SOA queries waiting for the serial query
+ *	rate limiter in '*queriesp', and the number of masters they are
+ *	queued for in '*primariesp'.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ *\li	'queriesp' and 'primariesp' to be non NULL.
+ */
+
 unsigned int
 dns_zonemgr_getcount(dns_zonemgr_t *zmgr, int state);
 /*%<
@@ -2096,6 +2168,18 @@ dns_zone_setcheckns(dns_zone_t *zone, dns_checknsfunc_t checkns);
  *	'zone' to be a valid zone.
  */
 
+void
+dns_zone_setcheckstart(dns_zone_t *zone, dns_checkstartfunc_t checkstart);
+/*%<
+ *	Set the callback function 'checkstart'.  'checkstart' will be
+ *	called with the newly loaded database just before the post load
+ *	integrity checks, so that it can prepare whatever 'checkmx',
+ *	'checksrv' and 'checkns' will need.
+ *
+ * Require:
+ *	'zone' to be a valid zone.
+ */
+
 void
 dns_zone_setnotifydelay(dns_zone_t *zone, isc_uint32_t delay);
 /*%<
@@ -34,6 +34,14 @@
 #include <dns/result.h>
 #include <dns/soa.h>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#else
+#define PROT_READ	0x01
+#define MAP_PRIVATE	0x0002
+#define MAP_FAILED	((void *)-1)
+#endif
+
 /*! \file
  * \brief Journaling.
  *
@@ -310,6 +318,11 @@ struct dns_journal {
 	journal_header_t 	header;		/*%< In-core journal header */
 	unsigned char		*rawindex;	/*%< In-core buffer for journal index in on-disk format */
 	journal_pos_t		*index;		/*%< In-core journal index */
+	unsigned char		*map;		/*%< Mapped journal, or NULL */
+	size_t			maplen;		/*%< Length of the mapping */
+	journal_pos_t		*xindex;	/*%< Position of every mapped
+						     transaction, and the end */
+	unsigned int		xcount;		/*%< Entries in 'xindex' */
 
 	/*% Current transaction state (when writing). */
 	struct {
@@ -325,6 +338,7 @@ struct dns_journal {
 		/* The rest is iterator state. */
 		isc_uint32_t current_serial;	/*%< Current SOA serial */
 		isc_buffer_t source;		/*%< Data from disk */
+		isc_buffer_t mapped;		/*%< Data in the mapping */
 		isc_buffer_t target;		/*%< Data from _fromwire check */
 		dns_decompress_t dctx;		/*%< Dummy decompression ctx */
 		dns_name_t name;		/*%< Current domain name */
@@ -385,6 +399,17 @@ static isc_result_t
 journal_seek(dns_journal_t *j, isc_uint32_t offset) {
 	isc_result_t result;
 
+	if (j->map != NULL) {
+		if (offset > j->maplen) {
+			isc_log_write(JOURNAL_COMMON_LOGARGS, ISC_LOG_ERROR,
+				      "%s: seek: offset %u past end of "
+				      "journal", j->filename, offset);
+			return (ISC_R_UNEXPECTED);
+		}
+		j->offset = offset;
+		return (ISC_R_SUCCESS);
+	}
+
 	result = isc_stdio_seek(j->fp, (off_t)offset, SEEK_SET);
 	if (result != ISC_R_SUCCESS) {
 		isc_log_write(JOURNAL_COMMON_LOGARGS, ISC_LOG_ERROR,
@@ -400,6 +425,15 @@ static isc_result_t
 journal_read(dns_journal_t *j, void *mem, size_t nbytes) {
 	isc_result_t result;
 
+	if (j->map != NULL) {
+		if ((size_t)j->offset > j->maplen ||
+		    nbytes > j->maplen - (size_t)j->offset)
+			return (ISC_R_NOMORE);
+		memmove(mem, j->map + j->offset, nbytes);
+		j->offset += (isc_offset_t)nbytes;
+		return (ISC_R_SUCCESS);
+	}
+
 	result = isc_stdio_read(mem, 1, nbytes, j->fp, NULL);
 	if (result != ISC_R_SUCCESS) {
 		if (result == ISC_R_EOF)
@@ -552,9 +586,11 @@ journal_file_create(isc_mem_t *mctx, const char *filename) {
 	return (ISC_R_SUCCESS);
 }
 
+static isc_result_t journal_map(dns_journal_t *j);
+
 static isc_result_t
 journal_open(isc_mem_t *mctx, const char *filename, isc_boolean_t writable,
-	     isc_boolean_t create, dns_journal_t **journalp)
+	     isc_boolean_t create, isc_boolean_t map, dns_journal_t **journalp)
 {
 	FILE *fp = NULL;
 	isc_result_t result;
@@ -573,6 +609,10 @@ journal_open(isc_mem_t *mctx, const char *filename, isc_boolean_t writable,
 	j->filename = isc_mem_strdup(mctx, filename);
 	j->index = NULL;
 	j->rawindex = NULL;
+	j->map = NULL;
+	j->maplen = 0;
+	j->xindex = NULL;
+	j->xcount = 0;
 
 	if (j->filename == NULL)
 		FAIL(ISC_R_NOMEMORY);
@@ -666,6 +706,9 @@ journal_open(isc_mem_t *mctx, const char *filename, isc_boolean_t writable,
 	isc_buffer_init(&j->it.target, NULL, 0);
 	dns_decompress_init(&j->it.dctx, -1, DNS_DECOMPRESS_NONE);
 
+	if (map)
+		CHECK(journal_map(j));
+
 	j->state =
 		writable ? JOURNAL_STATE_WRITE : JOURNAL_STATE_READ;
 
@@ -674,6 +717,11 @@ journal_open(isc_mem_t *mctx, const char *filename, isc_boolean_t writable,
 
  failure:
 	j->magic = 0;
+	if (j->xindex != NULL)
+		isc_mem_put(j->mctx, j->xindex,
+			    j->xcount * sizeof(journal_pos_t));
+	if (j->map != NULL)
+		(void)isc_file_munmap(j->map, j->maplen);
 	if (j->rawindex != NULL)
 		isc_mem_put(j->mctx, j->rawindex, j->header.index_size *
 			    sizeof(journal_rawpos_t));
@@ -695,12 +743,15 @@ dns_journal_open(isc_mem_t *mctx, const char *filename, unsigned int mode,
 	isc_result_t result;
 	size_t namelen;
 	char backup[1024];
-	isc_boolean_t writable, create;
+	isc_boolean_t writable, create, map;
 
 	create = ISC_TF(mode & DNS_JOURNAL_CREATE);
 	writable = ISC_TF(mode & (DNS_JOURNAL_WRITE|DNS_JOURNAL_CREATE));
+	map = ISC_TF(mode & DNS_JOURNAL_MAP);
+	REQUIRE(!(writable && map));
 
-	result = journal_open(mctx, filename, writable, create, journalp);
+	result = journal_open(mctx, filename, writable, create, map,
+			      journalp);
 	if (result == ISC_R_NOTFOUND) {
 		namelen = strlen(filename);
 		if (namelen > 4U && strcmp(filename + namelen - 4, ".jnl") == 0)
@@ -710,7 +761,7 @@ dns_journal_open(isc_mem_t *mctx, const char *filename, unsigned int mode,
 					   (int)namelen, filename);
 		if (result != ISC_R_SUCCESS)
 			return (result);
-		result = journal_open(mctx, backup, writable, writable,
+		result = journal_open(mctx, backup, writable, writable, map,
 				      journalp);
 	}
 	return (result);
@@ -951,6 +1002,30 @@ journal_find(dns_journal_t *j, isc_uint32_t serial, journal_pos_t *pos) {
 		return (ISC_R_SUCCESS);
 	}
 
+	if (j->xindex != NULL) {
+		unsigned int lo = 0, hi = j->xcount, mid;
+		isc_uint32_t distance = serial - j->header.begin.serial;
+
+		/*
+		 * Binary search for the first transaction starting at
+		 * 'serial'.  The serial numbers in the index do not
+		 * decrease, so neither does their distance from the
+		 * first one.
+		 */
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (j->xindex[mid].serial - j->header.begin.serial <
+			    distance)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == j->xcount || j->xindex[lo].serial != serial)
+			return (ISC_R_NOTFOUND);
+		*pos = j->xindex[lo];
+		return (ISC_R_SUCCESS);
+	}
+
 	current_pos = j->header.begin;
 	index_find(j, serial, &current_pos);
 
@@ -965,6 +1040,79 @@ journal_find(dns_journal_t *j, isc_uint32_t serial, journal_pos_t *pos) {
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Map the committed part of the journal 'j', which has just been
+ * opened for reading, into memory and record the position of every
+ * transaction in it in 'j->xindex', followed by the end position.
+ * If the journal cannot be mapped, it is left to be read from the file.
+ */
+static isc_result_t
+journal_map(dns_journal_t *j) {
+	isc_result_t result;
+	journal_pos_t pos;
+	off_t filesize = 0;
+	void *base;
+	unsigned int i, n;
+	int flags;
+
+	result = isc_file_getsizefd(fileno(j->fp), &filesize);
+	if (result != ISC_R_SUCCESS ||
+	    filesize < (off_t)j->header.end.offset)
+		return (ISC_R_SUCCESS);
+
+	flags = MAP_PRIVATE;
+#ifdef MAP_FILE
+	flags |= MAP_FILE;
+#endif
+	base = isc_file_mmap(NULL, (size_t)j->header.end.offset, PROT_READ,
+			     flags, fileno(j->fp), 0);
+	if (base == NULL || base == MAP_FAILED) {
+		isc_log_write(JOURNAL_DEBUG_LOGARGS(3),
+			      "%s: could not map journal, reading it instead",
+			      j->filename);
+		return (ISC_R_SUCCESS);
+	}
+	j->map = base;
+	j->maplen = (size_t)j->header.end.offset;
+
+	/*
+	 * Count the transactions, checking that they lead from the
+	 * beginning to the end of the journal.
+	 */
+	pos = j->header.begin;
+	for (n = 0; (result = journal_next(j, &pos)) == ISC_R_SUCCESS; n++)
+		;
+	if (result != ISC_R_NOMORE)
+		return (result);
+	if (pos.offset != j->header.end.offset) {
+		isc_log_write(JOURNAL_COMMON_LOGARGS, ISC_LOG_ERROR,
+			      "%s: journal file corrupt: transactions "
+			      "do not end at the end of the journal",
+			      j->filename);
+		return (ISC_R_UNEXPECTED);
+	}
+
+	j->xindex = isc_mem_get(j->mctx, (n + 1) * sizeof(journal_pos_t));
+	if (j->xindex == NULL)
+		return (ISC_R_NOMEMORY);
+	j->xcount = n + 1;
+
+	pos = j->header.begin;
+	for (i = 0; i < n; i++) {
+		j->xindex[i] = pos;
+		RUNTIME_CHECK(journal_next(j, &pos) == ISC_R_SUCCESS);
+	}
+	j->xindex[n] = pos;
+
+	/*
+	 * Everything is read from the mapping from now on.
+	 */
+	(void)isc_stdio_close(j->fp);
+	j->fp = NULL;
+
+	return (ISC_R_SUCCESS);
+}
+
 isc_result_t
 dns_journal_begin_transaction(dns_journal_t *j) {
 	isc_uint32_t offset;
@@ -1246,6 +1394,11 @@ dns_journal_destroy(dns_journal_t **journalp) {
 		isc_mem_put(j->mctx, j->it.target.base, j->it.target.length);
 	if (j->it.source.base != NULL)
 		isc_mem_put(j->mctx, j->it.source.base, j->it.source.length);
+	if (j->xindex != NULL)
+		isc_mem_put(j->mctx, j->xindex,
+			    j->xcount * sizeof(journal_pos_t));
+	if (j->map != NULL)
+		(void)isc_file_munmap(j->map, j->maplen);
 	if (j->filename != NULL)
 		isc_mem_free(j->mctx, j->filename);
 	if (j->fp != NULL)
@@ -1662,6 +1815,7 @@ read_one_rr(dns_journal_t *j) {
 	isc_uint32_t ttl;
 	journal_xhdr_t xhdr;
 	journal_rrhdr_t rrhdr;
+	isc_buffer_t *source;
 
 	INSIST(j->offset <= j->it.epos.offset);
 	if (j->offset == j->it.epos.offset)
@@ -1707,9 +1861,23 @@ read_one_rr(dns_journal_t *j) {
 		FAIL(ISC_R_UNEXPECTED);
 	}
 
-	CHECK(size_buffer(j->mctx, &j->it.source, rrhdr.size));
-	CHECK(journal_read(j, j->it.source.base, rrhdr.size));
-	isc_buffer_add(&j->it.source, rrhdr.size);
+	if (j->map != NULL) {
+		/*
+		 * Parse the RR where it is in the mapping.
+		 */
+		if ((size_t)j->offset > j->maplen ||
+		    rrhdr.size > j->maplen - (size_t)j->offset)
+			FAIL(ISC_R_NOMORE);
+		source = &j->it.mapped;
+		isc_buffer_init(source, j->map + j->offset, rrhdr.size);
+		isc_buffer_add(source, rrhdr.size);
+		j->offset += rrhdr.size;
+	} else {
+		source = &j->it.source;
+		CHECK(size_buffer(j->mctx, source, rrhdr.size));
+		CHECK(journal_read(j, source->base, rrhdr.size));
+		isc_buffer_add(source, rrhdr.size);
+	}
 
 	/*
 	 * The target buffer is made the same size
@@ -1724,31 +1892,30 @@ read_one_rr(dns_journal_t *j) {
 	 * ends yet, so we make the entire "remaining"
 	 * part of the buffer "active".
 	 */
-	isc_buffer_setactive(&j->it.source,
-			     j->it.source.used - j->it.source.current);
-	CHECK(dns_name_fromwire(&j->it.name, &j->it.source,
+	isc_buffer_setactive(source, source->used - source->current);
+	CHECK(dns_name_fromwire(&j->it.name, source,
 				&j->it.dctx, 0, &j->it.target));
 
 	/*
 	 * Check that the RR header is there, and parse it.
 	 */
-	if (isc_buffer_remaininglength(&j->it.source) < 10)
+	if (isc_buffer_remaininglength(source) < 10)
 		FAIL(DNS_R_FORMERR);
 
-	rdtype = isc_buffer_getuint16(&j->it.source);
-	rdclass = isc_buffer_getuint16(&j->it.source);
-	ttl = isc_buffer_getuint32(&j->it.source);
-	rdlen = isc_buffer_getuint16(&j->it.source);
+	rdtype = isc_buffer_getuint16(source);
+	rdclass = isc_buffer_getuint16(source);
+	ttl = isc_buffer_getuint32(source);
+	rdlen = isc_buffer_getuint16(source);
 
 	/*
 	 * Parse the rdata.
 	 */
-	if (isc_buffer_remaininglength(&j->it.source) != rdlen)
+	if (isc_buffer_remaininglength(source) != rdlen)
 		FAIL(DNS_R_FORMERR);
-	isc_buffer_setactive(&j->it.source, rdlen);
+	isc_buffer_setactive(source, rdlen);
 	dns_rdata_reset(&j->it.rdata);
 	CHECK(dns_rdata_fromwire(&j->it.rdata, rdclass,
-				 rdtype, &j->it.source, &j->it.dctx,
+				 rdtype, source, &j->it.dctx,
 				 0, &j->it.target));
 	j->it.ttl = ttl;
 
@@ -2085,60 +2252,170 @@ dns_db_diffx(dns_diff_t *diff, dns_db_t *dba, dns_dbversion_t *dbvera,
 	return (result);
 }
 
-isc_result_t
-dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
-		    isc_uint32_t target_size)
+/*
+ * Journal compaction is done in three steps so that the one that does
+ * most of the work does not hold up the journal's writers.
+ * dns_journal_compactbegin() takes a snapshot of the journal's header
+ * and index, dns_journal_compactcopy() copies the transactions to be
+ * kept into a new journal file, and dns_journal_compactend() catches
+ * up with the transactions committed while the copy was made and
+ * replaces the journal with the new file.
+ */
+struct dns_compactctx {
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	dns_journal_t		*j1;		/*%< Snapshot of the journal */
+	dns_journal_t		*j2;		/*%< New journal */
+	char			*filename;
+	char			newname[1024];
+	char			backup[1024];
+	isc_boolean_t		is_backup;	/*%< Compacting the backup */
+	isc_boolean_t		created;	/*%< 'newname' was created */
+	isc_uint32_t		serial;		/*%< Keep changes from here */
+	isc_uint32_t		target_size;
+	journal_pos_t		begin;		/*%< Snapshot's beginning */
+	journal_pos_t		end;		/*%< Snapshot's end */
+};
+
+#define DNS_COMPACTCTX_MAGIC	ISC_MAGIC('J', 'C', 'M', 'P')
+#define DNS_COMPACTCTX_VALID(c)	ISC_MAGIC_VALID(c, DNS_COMPACTCTX_MAGIC)
+
+static void
+compactctx_free(dns_compactctx_t *cctx) {
+	if (cctx->j1 != NULL)
+		dns_journal_destroy(&cctx->j1);
+	if (cctx->j2 != NULL)
+		dns_journal_destroy(&cctx->j2);
+	if (cctx->created)
+		(void)isc_file_remove(cctx->newname);
+	if (cctx->filename != NULL)
+		isc_mem_free(cctx->mctx, cctx->filename);
+	cctx->magic = 0;
+	isc_mem_putanddetach(&cctx->mctx, cctx, sizeof(*cctx));
+}
+
+/*
+ * Make the empty journal 'j' begin and end with 'serial', after its
+ * index.
+ */
+static void
+journal_header_start(dns_journal_t *j, isc_uint32_t serial) {
+	INSIST(JOURNAL_EMPTY(&j->header));
+
+	j->header.begin.serial = serial;
+	j->header.begin.offset = sizeof(journal_rawheader_t) +
+				 j->header.index_size *
+				 sizeof(journal_rawpos_t);
+	j->header.end = j->header.begin;
+}
+
+/*
+ * Copy 'length' bytes from 'offset' in 'src' to 'dst', at the end of
+ * the data already in it.
+ */
+static isc_result_t
+journal_copy(dns_journal_t *src, isc_uint32_t offset, dns_journal_t *dst,
+	     unsigned int length)
 {
-	unsigned int i;
-	journal_pos_t best_guess;
-	journal_pos_t current_pos;
-	dns_journal_t *j1 = NULL;
-	dns_journal_t *j2 = NULL;
+	isc_result_t result;
+	unsigned int i, len, size;
+	char *buf;
+
+	size = 64*1024;
+	if (length < size)
+		size = length;
+	buf = isc_mem_get(src->mctx, size);
+	if (buf == NULL)
+		return (ISC_R_NOMEMORY);
+
+	CHECK(journal_seek(src, offset));
+	CHECK(journal_seek(dst, dst->header.end.offset));
+	for (i = 0; i < length; i += size) {
+		len = (length - i) > size ? size : (length - i);
+		CHECK(journal_read(src, buf, len));
+		CHECK(journal_write(dst, buf, len));
+	}
+	result = journal_fsync(dst);
+
+ failure:
+	isc_mem_put(src->mctx, buf, size);
+	return (result);
+}
+
+/*
+ * Write the header and the index of the journal 'j', which has been
+ * written to directly, to disk.
+ */
+static isc_result_t
+journal_sync_header(dns_journal_t *j) {
 	journal_rawheader_t rawheader;
-	unsigned int copy_length;
-	size_t namelen;
-	char *buf = NULL;
-	unsigned int size = 0;
+	isc_result_t result;
+
+	journal_header_encode(&j->header, &rawheader);
+	CHECK(journal_seek(j, 0));
+	CHECK(journal_write(j, &rawheader, sizeof(rawheader)));
+	CHECK(journal_fsync(j));
+	CHECK(index_to_disk(j));
+	result = journal_fsync(j);
+
+ failure:
+	return (result);
+}
+
+isc_result_t
+dns_journal_compactbegin(isc_mem_t *mctx, const char *filename,
+			 isc_uint32_t serial, isc_uint32_t target_size,
+			 dns_compactctx_t **cctxp)
+{
+	dns_compactctx_t *cctx;
+	dns_journal_t *j1;
 	isc_result_t result;
 	unsigned int indexend;
-	char newname[1024];
-	char backup[1024];
-	isc_boolean_t is_backup = ISC_FALSE;
+	size_t namelen;
 
 	REQUIRE(filename != NULL);
+	REQUIRE(cctxp != NULL && *cctxp == NULL);
+
+	cctx = isc_mem_get(mctx, sizeof(*cctx));
+	if (cctx == NULL)
+		return (ISC_R_NOMEMORY);
+	cctx->mctx = NULL;
+	isc_mem_attach(mctx, &cctx->mctx);
+	cctx->j1 = NULL;
+	cctx->j2 = NULL;
+	cctx->is_backup = ISC_FALSE;
+	cctx->created = ISC_FALSE;
+	cctx->serial = serial;
+	cctx->filename = isc_mem_strdup(mctx, filename);
+	if (cctx->filename == NULL)
+		FAIL(ISC_R_NOMEMORY);
 
 	namelen = strlen(filename);
 	if (namelen > 4U && strcmp(filename + namelen - 4, ".jnl") == 0)
 		namelen -= 4;
 
-	result = isc_string_printf(newname, sizeof(newname), "%.*s.jnw",
-				   (int)namelen, filename);
-	if (result != ISC_R_SUCCESS)
-		return (result);
-
-	result = isc_string_printf(backup, sizeof(backup), "%.*s.jbk",
-				   (int)namelen, filename);
-	if (result != ISC_R_SUCCESS)
-		return (result);
+	CHECK(isc_string_printf(cctx->newname, sizeof(cctx->newname),
+				"%.*s.jnw", (int)namelen, filename));
+	CHECK(isc_string_printf(cctx->backup, sizeof(cctx->backup),
+				"%.*s.jbk", (int)namelen, filename));
 
-	result = journal_open(mctx, filename, ISC_FALSE, ISC_FALSE, &j1);
+	result = journal_open(mctx, filename, ISC_FALSE, ISC_FALSE, ISC_FALSE,
+			      &cctx->j1);
 	if (result == ISC_R_NOTFOUND) {
-		is_backup = ISC_TRUE;
-		result = journal_open(mctx, backup, ISC_FALSE, ISC_FALSE, &j1);
+		cctx->is_backup = ISC_TRUE;
+		result = journal_open(mctx, cctx->backup, ISC_FALSE, ISC_FALSE,
+				      ISC_FALSE, &cctx->j1);
 	}
 	if (result != ISC_R_SUCCESS)
-		return (result);
+		goto failure;
+	j1 = cctx->j1;
 
-	if (JOURNAL_EMPTY(&j1->header)) {
-		dns_journal_destroy(&j1);
-		return (ISC_R_SUCCESS);
-	}
+	if (JOURNAL_EMPTY(&j1->header))
+		FAIL(DNS_R_UNCHANGED);
 
 	if (DNS_SERIAL_GT(j1->header.begin.serial, serial) ||
-	    DNS_SERIAL_GT(serial, j1->header.end.serial)) {
-		dns_journal_destroy(&j1);
-		return (ISC_R_RANGE);
-	}
+	    DNS_SERIAL_GT(serial, j1->header.end.serial))
+		FAIL(ISC_R_RANGE);
 
 	/*
 	 * Cope with very small target sizes.
@@ -2153,12 +2430,45 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	/*
 	 * See if there is any work to do.
 	 */
-	if ((isc_uint32_t) j1->header.end.offset < target_size) {
-		dns_journal_destroy(&j1);
-		return (ISC_R_SUCCESS);
-	}
+	if ((isc_uint32_t) j1->header.end.offset < target_size)
+		FAIL(DNS_R_UNCHANGED);
+
+	cctx->target_size = target_size;
+	cctx->begin = j1->header.begin;
+	cctx->end = j1->header.end;
+	cctx->magic = DNS_COMPACTCTX_MAGIC;
+	*cctxp = cctx;
+	return (ISC_R_SUCCESS);
+
+ failure:
+	compactctx_free(cctx);
+	return (result);
+}
+
+isc_result_t
+dns_journal_compactcopy(dns_compactctx_t *cctx) {
+	unsigned int i;
+	journal_pos_t best_guess;
+	journal_pos_t current_pos;
+	dns_journal_t *j1, *j2;
+	unsigned int copy_length;
+	isc_result_t result;
+	isc_uint32_t serial, target_size;
+	unsigned int indexend;
+
+	REQUIRE(DNS_COMPACTCTX_VALID(cctx));
+	REQUIRE(cctx->j1 != NULL && cctx->j2 == NULL);
 
-	CHECK(journal_open(mctx, newname, ISC_TRUE, ISC_TRUE, &j2));
+	j1 = cctx->j1;
+	serial = cctx->serial;
+	target_size = cctx->target_size;
+	indexend = sizeof(journal_rawheader_t) +
+		   j1->header.index_size * sizeof(journal_rawpos_t);
+
+	CHECK(journal_open(cctx->mctx, cctx->newname, ISC_TRUE, ISC_TRUE,
+			   ISC_FALSE, &cctx->j2));
+	cctx->created = ISC_TRUE;
+	j2 = cctx->j2;
 
 	/*
 	 * Remove overhead so space test below can succeed.
@@ -2209,44 +2519,17 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 		/*
 		 * Copy best_guess to end into space just freed.
 		 */
-		size = 64*1024;
-		if (copy_length < size)
-			size = copy_length;
-		buf = isc_mem_get(mctx, size);
-		if (buf == NULL) {
-			result = ISC_R_NOMEMORY;
-			goto failure;
-		}
-
-		CHECK(journal_seek(j1, best_guess.offset));
-		CHECK(journal_seek(j2, indexend));
-		for (i = 0; i < copy_length; i += size) {
-			unsigned int len = (copy_length - i) > size ? size :
-							 (copy_length - i);
-			CHECK(journal_read(j1, buf, len));
-			CHECK(journal_write(j2, buf, len));
-		}
-
-		CHECK(journal_fsync(j2));
+		journal_header_start(j2, best_guess.serial);
+		CHECK(journal_copy(j1, best_guess.offset, j2, copy_length));
 
 		/*
 		 * Compute new header.
 		 */
-		j2->header.begin.serial = best_guess.serial;
-		j2->header.begin.offset = indexend;
 		j2->header.end.serial = j1->header.end.serial;
-		j2->header.end.offset = indexend + copy_length;
+		j2->header.end.offset += copy_length;
 		j2->header.sourceserial = j1->header.sourceserial;
 		j2->header.serialset = j1->header.serialset;
 
-		/*
-		 * Update the journal header.
-		 */
-		journal_header_encode(&j2->header, &rawheader);
-		CHECK(journal_seek(j2, 0));
-		CHECK(journal_write(j2, &rawheader, sizeof(rawheader)));
-		CHECK(journal_fsync(j2));
-
 		/*
 		 * Build new index.
 		 */
@@ -2256,14 +2539,90 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 			CHECK(journal_next(j2, &current_pos));
 		}
 
-		/*
-		 * Write index.
-		 */
-		CHECK(index_to_disk(j2));
-		CHECK(journal_fsync(j2));
+		CHECK(journal_sync_header(j2));
+	}
+
+	/*
+	 * The snapshot is not needed any more, and the old journal
+	 * must be closed before it can be renamed on WIN32.
+	 */
+	dns_journal_destroy(&cctx->j1);
+	result = ISC_R_SUCCESS;
+
+ failure:
+	return (result);
+}
+
+isc_result_t
+dns_journal_compactend(dns_compactctx_t **cctxp) {
+	dns_compactctx_t *cctx;
+	dns_journal_t *j1 = NULL;
+	dns_journal_t *j2;
+	journal_pos_t current_pos;
+	unsigned int copy_length;
+	isc_result_t result;
+	const char *filename;
+
+	REQUIRE(cctxp != NULL && DNS_COMPACTCTX_VALID(*cctxp));
+
+	cctx = *cctxp;
+	*cctxp = NULL;
+
+	REQUIRE(cctx->j1 == NULL && cctx->j2 != NULL);
+	j2 = cctx->j2;
+
+	/*
+	 * Reopen the journal and check that it is the one the snapshot
+	 * was taken of, with any transactions committed since then
+	 * appended to it.
+	 */
+	filename = cctx->is_backup ? cctx->backup : cctx->filename;
+	CHECK(journal_open(cctx->mctx, filename, ISC_FALSE, ISC_FALSE,
+			   ISC_FALSE, &j1));
+	if (j1->header.begin.serial != cctx->begin.serial ||
+	    j1->header.begin.offset != cctx->begin.offset ||
+	    j1->header.end.offset < cctx->end.offset ||
+	    ((j1->header.end.offset == cctx->end.offset) !=
+	     (j1->header.end.serial == cctx->end.serial)))
+	{
+		isc_log_write(JOURNAL_DEBUG_LOGARGS(3),
+			      "%s: journal replaced during compaction",
+			      filename);
+		FAIL(ISC_R_NOTFOUND);
+	}
+
+	/*
+	 * Catch up: copy the transactions committed while the new
+	 * journal was being written, and index them, checking that
+	 * they follow on from the ones already in it.
+	 */
+	copy_length = j1->header.end.offset - cctx->end.offset;
+	if (copy_length != 0) {
+		if (JOURNAL_EMPTY(&j2->header))
+			journal_header_start(j2, cctx->end.serial);
+		INSIST(j2->header.end.serial == cctx->end.serial);
+
+		CHECK(journal_copy(j1, cctx->end.offset, j2, copy_length));
+
+		current_pos = j2->header.end;
+		j2->header.end.serial = j1->header.end.serial;
+		j2->header.end.offset += copy_length;
+		j2->header.sourceserial = j1->header.sourceserial;
+		j2->header.serialset = j1->header.serialset;
+
+		while (current_pos.serial != j2->header.end.serial) {
+			index_add(j2, &current_pos);
+			CHECK(journal_next(j2, &current_pos));
+		}
+		if (current_pos.offset != j2->header.end.offset) {
+			isc_log_write(JOURNAL_COMMON_LOGARGS, ISC_LOG_ERROR,
+				      "%s: journal file corrupt: transactions "
+				      "do not end at the end of the journal",
+				      filename);
+			FAIL(ISC_R_UNEXPECTED);
+		}
 
-		indexend = j2->header.end.offset;
-		POST(indexend);
+		CHECK(journal_sync_header(j2));
 	}
 
 	/*
@@ -2271,7 +2630,7 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	 * necessary on WIN32).
 	 */
 	dns_journal_destroy(&j1);
-	dns_journal_destroy(&j2);
+	dns_journal_destroy(&cctx->j2);
 
 	/*
 	 * With a UFS file system this should just succeed and be atomic.
@@ -2284,17 +2643,17 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	 * if so, hopefully they'll be finished by the next time we
 	 * compact.)
 	 */
-	if (rename(newname, filename) == -1) {
-		if (errno == EEXIST && !is_backup) {
-			result = isc_file_remove(backup);
+	if (rename(cctx->newname, cctx->filename) == -1) {
+		if (errno == EEXIST && !cctx->is_backup) {
+			result = isc_file_remove(cctx->backup);
 			if (result != ISC_R_SUCCESS &&
 			    result != ISC_R_FILENOTFOUND)
 				goto failure;
-			if (rename(filename, backup) == -1)
+			if (rename(cctx->filename, cctx->backup) == -1)
 				goto maperrno;
-			if (rename(newname, filename) == -1)
+			if (rename(cctx->newname, cctx->filename) == -1)
 				goto maperrno;
-			(void)isc_file_remove(backup);
+			(void)isc_file_remove(cctx->backup);
 		} else {
  maperrno:
 			result = ISC_R_FAILURE;
@@ -2305,16 +2664,43 @@ dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
 	result = ISC_R_SUCCESS;
 
  failure:
-	(void)isc_file_remove(newname);
-	if (buf != NULL)
-		isc_mem_put(mctx, buf, size);
 	if (j1 != NULL)
 		dns_journal_destroy(&j1);
-	if (j2 != NULL)
-		dns_journal_destroy(&j2);
+	compactctx_free(cctx);
 	return (result);
 }
 
+void
+dns_journal_compactcancel(dns_compactctx_t **cctxp) {
+	REQUIRE(cctxp != NULL && DNS_COMPACTCTX_VALID(*cctxp));
+
+	compactctx_free(*cctxp);
+	*cctxp = NULL;
+}
+
+isc_result_t
+dns_journal_compact(isc_mem_t *mctx, char *filename, isc_uint32_t serial,
+		    isc_uint32_t target_size)
+{
+	dns_compactctx_t *cctx = NULL;
+	isc_result_t result;
+
+	result = dns_journal_compactbegin(mctx, filename, serial,
+					  target_size, &cctx);
+	if (result == DNS_R_UNCHANGED)
+		return (ISC_R_SUCCESS);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	result = dns_journal_compactcopy(cctx);
+	if (result != ISC_R_SUCCESS) {
+		dns_journal_compactcancel(&cctx);
+		return (result);
+	}
+
+	return (dns_journal_compactend(&cctx));
+}
+
 static isc_result_t
 index_to_disk(dns_journal_t *j) {
 	isc_result_t result = ISC_R_SUCCESS;
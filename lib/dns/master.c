@@ -15,16 +15,20 @@
 
 #include <config.h>
 
+#include <isc/buffer.h>
+#include <isc/condition.h>
 #include <isc/event.h>
 #include <isc/lex.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/print.h>
 #include <isc/serial.h>
 #include <isc/stdio.h>
 #include <isc/stdtime.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/thread.h>
 #include <isc/util.h>
 
 #include <dns/callbacks.h>
@@ -87,9 +91,19 @@
 
 #define CHECKNAMESFAIL(x) (((x) & DNS_MASTER_CHECKNAMESFAIL) != 0)
 
+/*%
+ * Parallel loading of text files: the target size of the pieces of the
+ * file handed to each thread, how many pieces may be in flight per
+ * thread, and how much is read from the file at a time.
+ */
+#define PARCHUNKSIZ	(256*1024)
+#define PARCHUNKS	2
+#define PARREADSIZ	(64*1024)
+
 typedef ISC_LIST(dns_rdatalist_t) rdatalist_head_t;
 
 typedef struct dns_incctx dns_incctx_t;
+typedef struct parload parload_t;
 
 /*%
  * Master file load state.
@@ -148,6 +162,12 @@ struct dns_loadctx {
 
 	dns_masterincludecb_t	include_cb;
 	void			*include_arg;
+
+	/* Members used by the parallel text loader: */
+	unsigned int		threads;
+	parload_t		*par;
+	isc_buffer_t		*batch;		/*%< commit() records here */
+	char			*batchsource;
 };
 
 struct dns_incctx {
@@ -196,6 +216,31 @@ static isc_result_t
 commit(dns_rdatacallbacks_t *, dns_loadctx_t *, rdatalist_head_t *,
        dns_name_t *, const char *, unsigned int);
 
+static void
+add_failed(dns_rdatacallbacks_t *callbacks, dns_name_t *owner,
+	   const char *source, unsigned int line, isc_result_t result);
+
+static isc_result_t
+add_rdataset(dns_rdatacallbacks_t *callbacks, dns_loadctx_t *lctx,
+	     dns_name_t *owner, dns_rdataset_t *dataset,
+	     const char *source, unsigned int line);
+
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_result_t
+openfile_partext(dns_loadctx_t *lctx, const char *master_file);
+
+static isc_result_t
+load_partext(dns_loadctx_t *lctx);
+
+static isc_result_t
+batch_rdataset(dns_loadctx_t *lctx, dns_name_t *owner,
+	       dns_rdataset_t *dataset, const char *source,
+	       unsigned int line);
+
+static void
+parload_destroy(parload_t **parp);
+#endif
+
 static isc_boolean_t
 is_glue(rdatalist_head_t *, dns_name_t *);
 
@@ -456,6 +501,13 @@ loadctx_destroy(dns_loadctx_t *lctx) {
 		}
 	}
 
+#ifdef ISC_PLATFORM_USETHREADS
+	if (lctx->par != NULL)
+		parload_destroy(&lctx->par);
+#endif
+	if (lctx->batchsource != NULL)
+		isc_mem_free(lctx->mctx, lctx->batchsource);
+
 	/* isc_lex_destroy() will close all open streams */
 	if (lctx->lex != NULL && !lctx->keep_lex)
 		isc_lex_destroy(&lctx->lex);
@@ -596,6 +648,10 @@ loadctx_create(dns_masterformat_t format, isc_mem_t *mctx,
 	lctx->result = ISC_R_SUCCESS;
 	lctx->include_cb = include_cb;
 	lctx->include_arg = include_arg;
+	lctx->threads = 1;
+	lctx->par = NULL;
+	lctx->batch = NULL;
+	lctx->batchsource = NULL;
 	isc_stdtime_get(&lctx->now);
 
 	dns_fixedname_init(&lctx->fixed_top);
@@ -2586,6 +2642,1131 @@ load_raw(dns_loadctx_t *lctx) {
 	return (result);
 }
 
+#ifdef ISC_PLATFORM_USETHREADS
+/*
+ * Parallel loading of text master files.
+ *
+ * The calling thread reads the file and cuts it into chunks at record
+ * boundaries.  Worker threads parse the chunks with load_text(), which,
+ * rather than passing each rdataset to callbacks->add, records it in a
+ * batch belonging to the chunk together with any messages and $INCLUDE
+ * notifications.  The calling thread then replays the batches in file
+ * order so that the database sees the same sequence of additions, and
+ * the user the same messages, as a sequential load would produce.
+ *
+ * A chunk only starts at a line that introduces a new owner name outside
+ * of parentheses.  While reading, the calling thread follows $ORIGIN and
+ * $TTL so that most chunks can be parsed independently of the preceding
+ * one; when it can not be sure of them (e.g. after $INCLUDE, or before
+ * any $TTL has been seen) the chunk waits for the state left at the end
+ * of the previous chunk instead.
+ */
+
+typedef struct {
+	dns_fixedname_t		origin;
+	isc_boolean_t		ttl_known;
+	isc_boolean_t		default_ttl_known;
+	isc_uint32_t		ttl;
+	isc_uint32_t		default_ttl;
+} parstate_t;
+
+typedef enum {
+	parchunk_free = 0,
+	parchunk_queued,
+	parchunk_done
+} parchunkstate_t;
+
+typedef struct {
+	parchunkstate_t		state;
+	isc_boolean_t		inherit;	/*%< start from previous end */
+	parstate_t		start;
+	char			*text;
+	size_t			textlen;
+	size_t			textsize;
+	unsigned long		line;
+	isc_buffer_t		*batch;
+	isc_boolean_t		seen_include;
+	isc_result_t		result;
+} parchunk_t;
+
+typedef struct {
+	isc_uint64_t		seq;		/*%< chunk this state ended */
+	parstate_t		state;
+} parend_t;
+
+struct parload {
+	dns_loadctx_t		*lctx;
+	char			*filename;
+	FILE			*f;
+	isc_boolean_t		eof;
+
+	/* Text read past the end of the last chunk. */
+	char			*carry;
+	size_t			carrylen;
+	size_t			carrysize;
+
+	/* Scanner state, only used by the reading thread. */
+	dns_fixedname_t		origin;
+	isc_boolean_t		origin_known;
+	isc_boolean_t		ttl_known;	/*%< default_ttl is exact */
+	isc_uint32_t		default_ttl;
+	isc_boolean_t		nosplit;
+	isc_boolean_t		continued;	/*%< escaped newline */
+	unsigned int		depth;		/*%< open parentheses */
+	unsigned long		line;
+	char			owner[64];
+	size_t			ownerlen;
+
+	/* Replay scratch space, only used by the reading thread. */
+	dns_rdata_t		*rdata;
+	unsigned int		rdatasize;
+
+	isc_mutex_t		lock;
+	/* Locked by lock. */
+	isc_condition_t		work;		/*%< a chunk was queued */
+	isc_condition_t		done;		/*%< a chunk was parsed */
+	isc_boolean_t		shutdown;
+	isc_uint64_t		filled;
+	isc_uint64_t		taken;
+	isc_uint64_t		committed;
+	isc_boolean_t		warn_1035;
+	isc_boolean_t		warn_tcr;
+	isc_boolean_t		warn_sigexpired;
+
+	unsigned int		nchunks;
+	parchunk_t		*chunks;
+	parend_t		*ends;		/*%< nchunks + 1 entries */
+	unsigned int		nthreads;
+	unsigned int		running;
+	isc_thread_t		*threads;
+};
+
+/*%
+ * Callbacks handed to the load contexts of the worker threads.
+ * Messages are recorded in the chunk's batch.
+ */
+typedef struct {
+	dns_rdatacallbacks_t	callbacks;	/*%< must be first */
+	dns_rdatacallbacks_t	*orig;
+	isc_buffer_t		*batch;
+} parcallbacks_t;
+
+/* Batch record types. */
+#define PARBATCH_SOURCE		1
+#define PARBATCH_RDATASET	2
+#define PARBATCH_ERROR		3
+#define PARBATCH_WARN		4
+#define PARBATCH_INCLUDE	5
+#define PARBATCH_PREPARED	6
+
+static void
+parstate_copy(parstate_t *to, parstate_t *from) {
+	dns_fixedname_init(&to->origin);
+	RUNTIME_CHECK(dns_name_copy(dns_fixedname_name(&from->origin),
+				    dns_fixedname_name(&to->origin),
+				    NULL) == ISC_R_SUCCESS);
+	to->ttl_known = from->ttl_known;
+	to->default_ttl_known = from->default_ttl_known;
+	to->ttl = from->ttl;
+	to->default_ttl = from->default_ttl;
+}
+
+/*%
+ * Ensure there is room for 'size' more bytes in 'batch', at least
+ * doubling it when it has to grow.
+ */
+static isc_result_t
+batch_reserve(isc_buffer_t *batch, unsigned int size) {
+	isc_buffer_t *b = batch;
+
+	if (isc_buffer_availablelength(batch) >= size)
+		return (ISC_R_SUCCESS);
+	return (isc_buffer_reserve(&b, ISC_MAX(size,
+					       isc_buffer_length(batch))));
+}
+
+static isc_result_t
+batch_string(isc_buffer_t *batch, unsigned int kind, const char *str) {
+	isc_result_t result;
+	size_t len;
+
+	len = strlen(str);
+	if (len > 0xffffU)
+		len = 0xffffU;
+	result = batch_reserve(batch, (unsigned int)len + 4);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	isc_buffer_putuint8(batch, kind);
+	isc_buffer_putuint16(batch, (isc_uint16_t)len);
+	isc_buffer_putmem(batch, (const unsigned char *)str,
+			  (unsigned int)len);
+	isc_buffer_putuint8(batch, 0);
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Record 'dataset' in lctx->batch so that it can be added to the
+ * database later, from the thread that started the load.  If the
+ * database can prepare rdatasets, it is converted here, on the
+ * parsing thread, and only the result is recorded.  If that fails the
+ * rdataset itself is recorded, so that the failure is reported in
+ * order when it is added.
+ */
+static isc_result_t
+batch_rdataset(dns_loadctx_t *lctx, dns_name_t *owner,
+	       dns_rdataset_t *dataset, const char *source,
+	       unsigned int line)
+{
+	dns_rdatacallbacks_t *callbacks = lctx->callbacks;
+	isc_buffer_t *batch = lctx->batch;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	isc_result_t result;
+	isc_region_t r;
+	unsigned int size, count = 0;
+	void *prepared = NULL;
+
+	if (source != NULL && (lctx->batchsource == NULL ||
+			       strcmp(source, lctx->batchsource) != 0))
+	{
+		if (lctx->batchsource != NULL)
+			isc_mem_free(lctx->mctx, lctx->batchsource);
+		lctx->batchsource = isc_mem_strdup(lctx->mctx, source);
+		if (lctx->batchsource == NULL)
+			return (ISC_R_NOMEMORY);
+		result = batch_string(batch, PARBATCH_SOURCE, source);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+
+	dns_name_toregion(owner, &r);
+	if (callbacks->prepare != NULL &&
+	    (callbacks->prepare)(callbacks->add_private, owner,
+				 dataset, &prepared) == ISC_R_SUCCESS)
+	{
+		result = batch_reserve(batch, 6 + r.length + sizeof(prepared));
+		if (result != ISC_R_SUCCESS) {
+			(callbacks->freeprepared)(callbacks->add_private,
+						  prepared);
+			return (result);
+		}
+		isc_buffer_putuint8(batch, PARBATCH_PREPARED);
+		isc_buffer_putuint32(batch, line);
+		isc_buffer_putuint8(batch, (isc_uint8_t)r.length);
+		isc_buffer_putmem(batch, r.base, r.length);
+		isc_buffer_putmem(batch, (unsigned char *)&prepared,
+				  sizeof(prepared));
+		return (ISC_R_SUCCESS);
+	}
+
+	size = 29 + r.length;
+	for (result = dns_rdataset_first(dataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(dataset))
+	{
+		dns_rdataset_current(dataset, &rdata);
+		size += 2 + rdata.length;
+		count++;
+		dns_rdata_reset(&rdata);
+	}
+	result = batch_reserve(batch, size);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	isc_buffer_putuint8(batch, PARBATCH_RDATASET);
+	isc_buffer_putuint32(batch, line);
+	isc_buffer_putuint8(batch, (isc_uint8_t)r.length);
+	isc_buffer_putmem(batch, r.base, r.length);
+	isc_buffer_putuint16(batch, dataset->type);
+	isc_buffer_putuint16(batch, dataset->covers);
+	isc_buffer_putuint32(batch, dataset->ttl);
+	isc_buffer_putuint16(batch, dataset->trust);
+	if ((dataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
+		isc_buffer_putuint8(batch, 1);
+		isc_buffer_putuint32(batch, dataset->resign);
+	} else {
+		isc_buffer_putuint8(batch, 0);
+		isc_buffer_putuint32(batch, 0);
+	}
+	isc_buffer_putuint32(batch, count);
+	for (result = dns_rdataset_first(dataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(dataset))
+	{
+		dns_rdataset_current(dataset, &rdata);
+		isc_buffer_putuint16(batch, (isc_uint16_t)rdata.length);
+		isc_buffer_putmem(batch, rdata.data, rdata.length);
+		dns_rdata_reset(&rdata);
+	}
+	return (ISC_R_SUCCESS);
+}
+
+static void
+parload_message(dns_rdatacallbacks_t *callbacks, unsigned int kind,
+		const char *fmt, va_list ap)
+{
+	parcallbacks_t *pcb = (parcallbacks_t *)callbacks;
+	char msg[2048];
+
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	if (batch_string(pcb->batch, kind, msg) == ISC_R_SUCCESS)
+		return;
+	/* Better out of order than not at all. */
+	if (kind == PARBATCH_ERROR)
+		(*pcb->orig->error)(pcb->orig, "%s", msg);
+	else
+		(*pcb->orig->warn)(pcb->orig, "%s", msg);
+}
+
+static void
+parload_error(dns_rdatacallbacks_t *callbacks, const char *fmt, ...) {
+	va_list ap;
+
+	va_start(ap, fmt);
+	parload_message(callbacks, PARBATCH_ERROR, fmt, ap);
+	va_end(ap);
+}
+
+static void
+parload_warn(dns_rdatacallbacks_t *callbacks, const char *fmt, ...) {
+	va_list ap;
+
+	va_start(ap, fmt);
+	parload_message(callbacks, PARBATCH_WARN, fmt, ap);
+	va_end(ap);
+}
+
+static void
+parload_include(const char *filename, void *arg) {
+	parcallbacks_t *pcb = arg;
+
+	(void)batch_string(pcb->batch, PARBATCH_INCLUDE, filename);
+}
+
+/*%
+ * Return the first token of the text between 'p' and 'end' in
+ * '*tokenp' and '*lenp', and a pointer to the text following it.
+ */
+static const char *
+parload_token(const char *p, const char *end, const char **tokenp,
+	      size_t *lenp)
+{
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	*tokenp = p;
+	while (p < end && strchr(" \t\r\n;()\"", *p) == NULL)
+		p++;
+	*lenp = p - *tokenp;
+	return (p);
+}
+
+static isc_boolean_t
+parload_isowner(char c) {
+	return (ISC_TF(strchr(" \t\r\n;$()\"", c) == NULL));
+}
+
+static void
+parload_origin(parload_t *par, const char *arg, size_t len) {
+	dns_fixedname_t fixed;
+	dns_name_t *name, *origin = NULL;
+	isc_buffer_t b;
+	isc_result_t result;
+
+	if (len == 0 || memchr(arg, '\\', len) != NULL) {
+		par->origin_known = ISC_FALSE;
+		return;
+	}
+	dns_fixedname_init(&fixed);
+	name = dns_fixedname_name(&fixed);
+	if (par->origin_known)
+		origin = dns_fixedname_name(&par->origin);
+	isc_buffer_constinit(&b, arg, len);
+	isc_buffer_add(&b, (unsigned int)len);
+	result = dns_name_fromtext(name, &b, origin, 0, NULL);
+	if (result != ISC_R_SUCCESS || !dns_name_isabsolute(name)) {
+		par->origin_known = ISC_FALSE;
+		return;
+	}
+	RUNTIME_CHECK(dns_name_copy(name, dns_fixedname_name(&par->origin),
+				    NULL) == ISC_R_SUCCESS);
+	par->origin_known = ISC_TRUE;
+}
+
+static void
+parload_directive(parload_t *par, const char *p, const char *end) {
+	const char *directive, *arg;
+	size_t dlen, alen;
+	isc_textregion_t r;
+	isc_uint32_t ttl;
+
+	p = parload_token(p, end, &directive, &dlen);
+	(void)parload_token(p, end, &arg, &alen);
+
+	if (dlen == 7 && strncasecmp(directive, "$ORIGIN", 7) == 0) {
+		parload_origin(par, arg, alen);
+	} else if (dlen == 4 && strncasecmp(directive, "$TTL", 4) == 0) {
+		DE_CONST(arg, r.base);
+		r.length = (unsigned int)alen;
+		if (alen != 0 && dns_ttl_fromtext(&r, &ttl) == ISC_R_SUCCESS) {
+			if (ttl > 0x7fffffffUL)
+				ttl = 0;
+			par->default_ttl = ttl;
+			par->ttl_known = ISC_TRUE;
+		} else
+			par->ttl_known = ISC_FALSE;
+	} else if (dlen == 8 && strncasecmp(directive, "$INCLUDE", 8) == 0) {
+		/* The included file may set $TTL. */
+		par->ttl_known = ISC_FALSE;
+	} else if (dlen == 5 && strncasecmp(directive, "$DATE", 5) == 0 &&
+		   (par->lctx->options & DNS_MASTER_AGETTL) != 0)
+	{
+		/* The $DATE offset is local to load_text(). */
+		par->nosplit = ISC_TRUE;
+	}
+}
+
+/*%
+ * Can a chunk start with the 'len' byte line at 'p'?
+ */
+static isc_boolean_t
+parload_cansplit(parload_t *par, const char *p, size_t len) {
+	const char *token;
+	size_t tlen;
+
+	if (par->nosplit || par->depth != 0 || par->continued ||
+	    len == 0 || !parload_isowner(*p))
+		return (ISC_FALSE);
+
+	/*
+	 * Keep the records of a name together so that its rdatasets are
+	 * still built and checked as a whole, and glue (as far as that
+	 * can be told from the text) with the delegation.
+	 */
+	(void)parload_token(p, p + len, &token, &tlen);
+	if (tlen == par->ownerlen &&
+	    strncasecmp(token, par->owner,
+			ISC_MIN(tlen, sizeof(par->owner))) == 0)
+		return (ISC_FALSE);
+	if (tlen > par->ownerlen && par->ownerlen <= sizeof(par->owner) &&
+	    token[tlen - par->ownerlen - 1] == '.' &&
+	    strncasecmp(token + tlen - par->ownerlen, par->owner,
+			par->ownerlen) == 0)
+		return (ISC_FALSE);
+	return (ISC_TRUE);
+}
+
+/*%
+ * Follow the state of the file across the 'len' byte line at 'p'.
+ */
+static void
+parload_scanline(parload_t *par, const char *p, size_t len) {
+	const char *end = p + len;
+	const char *token;
+	isc_boolean_t escape = ISC_FALSE, quote = ISC_FALSE;
+	size_t tlen;
+
+	if (len != 0 && par->depth == 0 && !par->continued) {
+		if (*p == '$') {
+			parload_directive(par, p, end);
+		} else if (parload_isowner(*p)) {
+			(void)parload_token(p, end, &token, &tlen);
+			memmove(par->owner, token,
+				ISC_MIN(tlen, sizeof(par->owner)));
+			par->ownerlen = tlen;
+		}
+	}
+
+	par->continued = ISC_FALSE;
+	for (; p < end; p++) {
+		if (escape) {
+			escape = ISC_FALSE;
+			if (*p == '\n')
+				par->continued = ISC_TRUE;
+			continue;
+		}
+		if (*p == '\\')
+			escape = ISC_TRUE;
+		else if (*p == '"')
+			quote = ISC_TF(!quote);
+		else if (quote)
+			continue;
+		else if (*p == ';')
+			break;
+		else if (*p == '(')
+			par->depth++;
+		else if (*p == ')' && par->depth > 0)
+			par->depth--;
+	}
+	par->line++;
+}
+
+static isc_result_t
+parload_grow(isc_mem_t *mctx, char **textp, size_t *sizep, size_t len,
+	     size_t need)
+{
+	size_t size;
+	char *text;
+
+	if (*sizep >= need)
+		return (ISC_R_SUCCESS);
+	size = ISC_MAX(need, *sizep * 2);
+	text = isc_mem_get(mctx, size);
+	if (text == NULL)
+		return (ISC_R_NOMEMORY);
+	if (*textp != NULL) {
+		memmove(text, *textp, len);
+		isc_mem_put(mctx, *textp, *sizep);
+	}
+	*textp = text;
+	*sizep = size;
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Read the next chunk of the file into 'chunk'.
+ */
+static isc_result_t
+parload_fill(parload_t *par, parchunk_t *chunk) {
+	dns_loadctx_t *lctx = par->lctx;
+	isc_mem_t *mctx = lctx->mctx;
+	isc_result_t result;
+	size_t pos = 0, len, n;
+	char *nl;
+
+	chunk->line = par->line;
+	chunk->inherit = ISC_FALSE;
+	chunk->seen_include = ISC_FALSE;
+	chunk->result = ISC_R_SUCCESS;
+	if (par->filled == 0) {
+		dns_fixedname_init(&chunk->start.origin);
+		RUNTIME_CHECK(dns_name_copy(lctx->inc->origin,
+				    dns_fixedname_name(&chunk->start.origin),
+				    NULL) == ISC_R_SUCCESS);
+		chunk->start.ttl_known = lctx->ttl_known;
+		chunk->start.default_ttl_known = lctx->default_ttl_known;
+		chunk->start.ttl = lctx->ttl;
+		chunk->start.default_ttl = lctx->default_ttl;
+	} else if (par->origin_known && par->ttl_known) {
+		dns_fixedname_init(&chunk->start.origin);
+		RUNTIME_CHECK(dns_name_copy(dns_fixedname_name(&par->origin),
+				    dns_fixedname_name(&chunk->start.origin),
+				    NULL) == ISC_R_SUCCESS);
+		chunk->start.ttl_known = ISC_TRUE;
+		chunk->start.default_ttl_known = ISC_TRUE;
+		chunk->start.ttl = par->default_ttl;
+		chunk->start.default_ttl = par->default_ttl;
+	} else
+		chunk->inherit = ISC_TRUE;
+
+	result = parload_grow(mctx, &chunk->text, &chunk->textsize, 0,
+			      par->carrylen + PARREADSIZ);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	if (par->carrylen != 0)
+		memmove(chunk->text, par->carry, par->carrylen);
+	chunk->textlen = par->carrylen;
+	par->carrylen = 0;
+
+	for (;;) {
+		nl = NULL;
+		if (pos < chunk->textlen)
+			nl = memchr(chunk->text + pos, '\n',
+				    chunk->textlen - pos);
+		if (nl == NULL) {
+			if (par->eof) {
+				if (pos < chunk->textlen)
+					parload_scanline(par,
+							 chunk->text + pos,
+							 chunk->textlen - pos);
+				break;
+			}
+			result = parload_grow(mctx, &chunk->text,
+					      &chunk->textsize,
+					      chunk->textlen,
+					      chunk->textlen + PARREADSIZ);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+			n = 0;
+			result = isc_stdio_read(chunk->text + chunk->textlen,
+						1, PARREADSIZ, par->f, &n);
+			if (result == ISC_R_EOF || n == 0) {
+				par->eof = ISC_TRUE;
+				result = ISC_R_SUCCESS;
+			}
+			if (result != ISC_R_SUCCESS)
+				return (result);
+			chunk->textlen += n;
+			continue;
+		}
+
+		len = nl - (chunk->text + pos) + 1;
+		if (pos >= PARCHUNKSIZ &&
+		    parload_cansplit(par, chunk->text + pos, len))
+		{
+			/* Leave this line for the next chunk. */
+			len = chunk->textlen - pos;
+			result = parload_grow(mctx, &par->carry,
+					      &par->carrysize, 0, len);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+			memmove(par->carry, chunk->text + pos, len);
+			par->carrylen = len;
+			chunk->textlen = pos;
+			break;
+		}
+		parload_scanline(par, chunk->text + pos, len);
+		pos += len;
+	}
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Parse 'chunk' starting from the state 'chunk->start' and return the
+ * state at its end in 'end'.
+ */
+static void
+parload_parse(parload_t *par, parchunk_t *chunk, parstate_t *end,
+	      isc_boolean_t *warn_1035, isc_boolean_t *warn_tcr,
+	      isc_boolean_t *warn_sigexpired)
+{
+	dns_loadctx_t *lctx = par->lctx;
+	dns_loadctx_t *wctx = NULL;
+	dns_incctx_t *ictx;
+	parcallbacks_t pcb;
+	isc_buffer_t source;
+	isc_result_t result;
+
+	parstate_copy(end, &chunk->start);
+
+	pcb.callbacks = *lctx->callbacks;
+	pcb.callbacks.error = parload_error;
+	pcb.callbacks.warn = parload_warn;
+	pcb.orig = lctx->callbacks;
+	pcb.batch = chunk->batch;
+
+	result = loadctx_create(dns_masterformat_text, lctx->mctx,
+				lctx->options, lctx->resign, lctx->top,
+				lctx->zclass,
+				dns_fixedname_name(&chunk->start.origin),
+				&pcb.callbacks, NULL, NULL, NULL,
+				(lctx->include_cb != NULL) ?
+					parload_include : NULL,
+				&pcb, NULL, &wctx);
+	if (result != ISC_R_SUCCESS) {
+		chunk->result = result;
+		return;
+	}
+	wctx->maxttl = lctx->maxttl;
+	wctx->now = lctx->now;
+	wctx->ttl_known = chunk->start.ttl_known;
+	wctx->default_ttl_known = chunk->start.default_ttl_known;
+	wctx->ttl = chunk->start.ttl;
+	wctx->default_ttl = chunk->start.default_ttl;
+	wctx->warn_1035 = *warn_1035;
+	wctx->warn_tcr = *warn_tcr;
+	wctx->warn_sigexpired = *warn_sigexpired;
+	wctx->batch = chunk->batch;
+
+	isc_buffer_constinit(&source, chunk->text, chunk->textlen);
+	isc_buffer_add(&source, (unsigned int)chunk->textlen);
+	result = isc_lex_openbuffer(wctx->lex, &source);
+	if (result == ISC_R_SUCCESS)
+		result = isc_lex_setsourcename(wctx->lex, par->filename);
+	if (result == ISC_R_SUCCESS)
+		result = isc_lex_setsourceline(wctx->lex, chunk->line);
+	if (result == ISC_R_SUCCESS)
+		result = load_text(wctx);
+	chunk->result = result;
+	chunk->seen_include = wctx->seen_include;
+
+	for (ictx = wctx->inc; ictx->parent != NULL; ictx = ictx->parent)
+		;
+	RUNTIME_CHECK(dns_name_copy(ictx->origin,
+				    dns_fixedname_name(&end->origin),
+				    NULL) == ISC_R_SUCCESS);
+	end->ttl_known = wctx->ttl_known;
+	end->default_ttl_known = wctx->default_ttl_known;
+	end->ttl = wctx->ttl;
+	end->default_ttl = wctx->default_ttl;
+	*warn_1035 = wctx->warn_1035;
+	*warn_tcr = wctx->warn_tcr;
+	*warn_sigexpired = wctx->warn_sigexpired;
+
+	dns_loadctx_detach(&wctx);
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+parload_run(isc_threadarg_t arg) {
+	parload_t *par = arg;
+	parchunk_t *chunk;
+	parend_t *prev, *end;
+	parstate_t state;
+	isc_uint64_t seq;
+	isc_boolean_t warn_1035, warn_tcr, warn_sigexpired;
+
+	LOCK(&par->lock);
+	for (;;) {
+		while (!par->shutdown && par->taken == par->filled)
+			WAIT(&par->work, &par->lock);
+		if (par->shutdown)
+			break;
+		seq = par->taken++;
+		chunk = &par->chunks[seq % par->nchunks];
+		if (chunk->inherit) {
+			prev = &par->ends[(seq - 1) % (par->nchunks + 1)];
+			while (!par->shutdown && prev->seq != seq - 1)
+				WAIT(&par->done, &par->lock);
+			if (par->shutdown)
+				break;
+			parstate_copy(&chunk->start, &prev->state);
+		}
+		warn_1035 = par->warn_1035;
+		warn_tcr = par->warn_tcr;
+		warn_sigexpired = par->warn_sigexpired;
+		UNLOCK(&par->lock);
+
+		dns_fixedname_init(&state.origin);
+		parload_parse(par, chunk, &state, &warn_1035, &warn_tcr,
+			      &warn_sigexpired);
+
+		LOCK(&par->lock);
+		end = &par->ends[seq % (par->nchunks + 1)];
+		parstate_copy(&end->state, &state);
+		end->seq = seq;
+		chunk->state = parchunk_done;
+		par->warn_1035 = ISC_TF(par->warn_1035 && warn_1035);
+		par->warn_tcr = ISC_TF(par->warn_tcr && warn_tcr);
+		par->warn_sigexpired = ISC_TF(par->warn_sigexpired &&
+					      warn_sigexpired);
+		BROADCAST(&par->done);
+	}
+	UNLOCK(&par->lock);
+
+	return ((isc_threadresult_t)0);
+}
+
+/*%
+ * Add the contents of 'chunk->batch' to the database and report the
+ * messages recorded in it.
+ */
+static isc_result_t
+parload_replay(parload_t *par, parchunk_t *chunk) {
+	dns_loadctx_t *lctx = par->lctx;
+	dns_rdatacallbacks_t *callbacks = lctx->callbacks;
+	isc_buffer_t *batch = chunk->batch;
+	const char *source = NULL, *text;
+	dns_fixedname_t fixed;
+	dns_name_t *owner;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t dataset;
+	dns_rdata_t *rdata;
+	dns_trust_t trust;
+	isc_boolean_t resign;
+	isc_uint32_t resigntime;
+	isc_result_t result;
+	isc_region_t r;
+	unsigned int kind, line, count, size, i;
+	void *prepared;
+
+	dns_fixedname_init(&fixed);
+	owner = dns_fixedname_name(&fixed);
+
+	while (isc_buffer_remaininglength(batch) != 0) {
+		kind = isc_buffer_getuint8(batch);
+		if (kind == PARBATCH_PREPARED) {
+			line = isc_buffer_getuint32(batch);
+			r.length = isc_buffer_getuint8(batch);
+			r.base = isc_buffer_current(batch);
+			isc_buffer_forward(batch, r.length);
+			dns_name_fromregion(owner, &r);
+			memmove(&prepared, isc_buffer_current(batch),
+				sizeof(prepared));
+			isc_buffer_forward(batch, sizeof(prepared));
+			result = (callbacks->addprepared)(callbacks->add_private,
+							  owner, prepared);
+			if (result != ISC_R_SUCCESS)
+				add_failed(callbacks, owner, source, line,
+					   result);
+			if (MANYERRS(lctx, result))
+				SETRESULT(lctx, result);
+			else if (result != ISC_R_SUCCESS)
+				return (result);
+			continue;
+		}
+		if (kind != PARBATCH_RDATASET) {
+			(void)isc_buffer_getuint16(batch);
+			text = isc_buffer_current(batch);
+			isc_buffer_forward(batch,
+					   (unsigned int)strlen(text) + 1);
+			switch (kind) {
+			case PARBATCH_SOURCE:
+				source = text;
+				break;
+			case PARBATCH_ERROR:
+				(*callbacks->error)(callbacks, "%s", text);
+				break;
+			case PARBATCH_WARN:
+				(*callbacks->warn)(callbacks, "%s", text);
+				break;
+			case PARBATCH_INCLUDE:
+				if (lctx->include_cb != NULL)
+					(lctx->include_cb)(text,
+							   lctx->include_arg);
+				break;
+			default:
+				INSIST(0);
+			}
+			continue;
+		}
+
+		line = isc_buffer_getuint32(batch);
+		r.length = isc_buffer_getuint8(batch);
+		r.base = isc_buffer_current(batch);
+		isc_buffer_forward(batch, r.length);
+		dns_name_fromregion(owner, &r);
+
+		dns_rdatalist_init(&rdatalist);
+		rdatalist.rdclass = lctx->zclass;
+		rdatalist.type = isc_buffer_getuint16(batch);
+		rdatalist.covers = isc_buffer_getuint16(batch);
+		rdatalist.ttl = isc_buffer_getuint32(batch);
+		trust = isc_buffer_getuint16(batch);
+		resign = ISC_TF(isc_buffer_getuint8(batch) != 0);
+		resigntime = isc_buffer_getuint32(batch);
+		count = isc_buffer_getuint32(batch);
+
+		if (count > par->rdatasize) {
+			size = ISC_MAX(count, par->rdatasize * 2);
+			rdata = isc_mem_get(lctx->mctx, size * sizeof(*rdata));
+			if (rdata == NULL)
+				return (ISC_R_NOMEMORY);
+			if (par->rdata != NULL)
+				isc_mem_put(lctx->mctx, par->rdata,
+					    par->rdatasize * sizeof(*rdata));
+			par->rdata = rdata;
+			par->rdatasize = size;
+		}
+		for (i = 0; i < count; i++) {
+			rdata = &par->rdata[i];
+			dns_rdata_init(rdata);
+			r.length = isc_buffer_getuint16(batch);
+			r.base = isc_buffer_current(batch);
+			isc_buffer_forward(batch, r.length);
+			dns_rdata_fromregion(rdata, rdatalist.rdclass,
+					     rdatalist.type, &r);
+			ISC_LIST_APPEND(rdatalist.rdata, rdata, link);
+		}
+
+		dns_rdataset_init(&dataset);
+		RUNTIME_CHECK(dns_rdatalist_tordataset(&rdatalist, &dataset)
+			      == ISC_R_SUCCESS);
+		dataset.trust = trust;
+		if (resign) {
+			dataset.attributes |= DNS_RDATASETATTR_RESIGN;
+			dataset.resign = resigntime;
+		}
+		result = add_rdataset(callbacks, lctx, owner, &dataset,
+				      source, line);
+		if (MANYERRS(lctx, result))
+			SETRESULT(lctx, result);
+		else if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+parload_create(dns_loadctx_t *lctx, const char *filename,
+	       parload_t **parp)
+{
+	isc_mem_t *mctx = lctx->mctx;
+	parload_t *par;
+	isc_result_t result;
+	unsigned int i;
+
+	REQUIRE(parp != NULL && *parp == NULL);
+
+	par = isc_mem_get(mctx, sizeof(*par));
+	if (par == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(par, 0, sizeof(*par));
+
+	result = isc_mutex_init(&par->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_par;
+	result = isc_condition_init(&par->work);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+	result = isc_condition_init(&par->done);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_work;
+
+	par->lctx = lctx;
+	par->nthreads = lctx->threads;
+	par->nchunks = PARCHUNKS * lctx->threads;
+	par->line = 1;
+	dns_fixedname_init(&par->origin);
+	RUNTIME_CHECK(dns_name_copy(lctx->inc->origin,
+				    dns_fixedname_name(&par->origin),
+				    NULL) == ISC_R_SUCCESS);
+	par->origin_known = ISC_TRUE;
+	par->ttl_known = ISC_TF((lctx->options & DNS_MASTER_NOTTL) != 0);
+	par->warn_1035 = lctx->warn_1035;
+	par->warn_tcr = lctx->warn_tcr;
+	par->warn_sigexpired = lctx->warn_sigexpired;
+
+	/* From here on parload_destroy() can clean up. */
+	*parp = par;
+
+	par->filename = isc_mem_strdup(mctx, filename);
+	if (par->filename == NULL)
+		return (ISC_R_NOMEMORY);
+	par->threads = isc_mem_get(mctx,
+				   par->nthreads * sizeof(isc_thread_t));
+	if (par->threads == NULL)
+		return (ISC_R_NOMEMORY);
+	par->ends = isc_mem_get(mctx,
+				(par->nchunks + 1) * sizeof(parend_t));
+	if (par->ends == NULL)
+		return (ISC_R_NOMEMORY);
+	for (i = 0; i <= par->nchunks; i++) {
+		par->ends[i].seq = ~(isc_uint64_t)0;
+		dns_fixedname_init(&par->ends[i].state.origin);
+	}
+	par->chunks = isc_mem_get(mctx, par->nchunks * sizeof(parchunk_t));
+	if (par->chunks == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(par->chunks, 0, par->nchunks * sizeof(parchunk_t));
+	for (i = 0; i < par->nchunks; i++) {
+		par->chunks[i].state = parchunk_free;
+		dns_fixedname_init(&par->chunks[i].start.origin);
+		result = isc_buffer_allocate(mctx, &par->chunks[i].batch,
+					     PARCHUNKSIZ);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+
+	return (isc_stdio_open(filename, "r", &par->f));
+
+ cleanup_work:
+	(void)isc_condition_destroy(&par->work);
+ cleanup_lock:
+	DESTROYLOCK(&par->lock);
+ cleanup_par:
+	isc_mem_put(mctx, par, sizeof(*par));
+	return (result);
+}
+
+/*%
+ * Release the prepared rdatasets left in the part of 'batch' that has
+ * not been replayed.
+ */
+static void
+parload_discard(parload_t *par, isc_buffer_t *batch) {
+	dns_rdatacallbacks_t *callbacks = par->lctx->callbacks;
+	unsigned int kind, count, len;
+	void *prepared;
+
+	while (isc_buffer_remaininglength(batch) != 0) {
+		kind = isc_buffer_getuint8(batch);
+		switch (kind) {
+		case PARBATCH_PREPARED:
+			(void)isc_buffer_getuint32(batch);
+			len = isc_buffer_getuint8(batch);
+			isc_buffer_forward(batch, len);
+			memmove(&prepared, isc_buffer_current(batch),
+				sizeof(prepared));
+			isc_buffer_forward(batch, sizeof(prepared));
+			(callbacks->freeprepared)(callbacks->add_private,
+						  prepared);
+			break;
+		case PARBATCH_RDATASET:
+			(void)isc_buffer_getuint32(batch);
+			len = isc_buffer_getuint8(batch);
+			isc_buffer_forward(batch, len + 15);
+			count = isc_buffer_getuint32(batch);
+			while (count-- > 0) {
+				len = isc_buffer_getuint16(batch);
+				isc_buffer_forward(batch, len);
+			}
+			break;
+		default:
+			len = isc_buffer_getuint16(batch);
+			isc_buffer_forward(batch, len + 1);
+			break;
+		}
+	}
+}
+
+/*%
+ * Stop the worker threads and free 'par'.  Rdatasets they prepared
+ * that were not added are released, so this must be done before the
+ * load is ended.
+ */
+static void
+parload_destroy(parload_t **parp) {
+	parload_t *par;
+	isc_mem_t *mctx;
+	unsigned int i;
+
+	REQUIRE(parp != NULL && *parp != NULL);
+
+	par = *parp;
+	*parp = NULL;
+	mctx = par->lctx->mctx;
+
+	LOCK(&par->lock);
+	par->shutdown = ISC_TRUE;
+	BROADCAST(&par->work);
+	BROADCAST(&par->done);
+	UNLOCK(&par->lock);
+	for (i = 0; i < par->running; i++)
+		(void)isc_thread_join(par->threads[i], NULL);
+
+	if (par->chunks != NULL) {
+		for (i = 0; i < par->nchunks; i++) {
+			if (par->chunks[i].text != NULL)
+				isc_mem_put(mctx, par->chunks[i].text,
+					    par->chunks[i].textsize);
+			if (par->chunks[i].batch == NULL)
+				continue;
+			parload_discard(par, par->chunks[i].batch);
+			isc_buffer_free(&par->chunks[i].batch);
+		}
+		isc_mem_put(mctx, par->chunks,
+			    par->nchunks * sizeof(parchunk_t));
+	}
+	if (par->ends != NULL)
+		isc_mem_put(mctx, par->ends,
+			    (par->nchunks + 1) * sizeof(parend_t));
+	if (par->threads != NULL)
+		isc_mem_put(mctx, par->threads,
+			    par->nthreads * sizeof(isc_thread_t));
+	if (par->carry != NULL)
+		isc_mem_put(mctx, par->carry, par->carrysize);
+	if (par->rdata != NULL)
+		isc_mem_put(mctx, par->rdata,
+			    par->rdatasize * sizeof(dns_rdata_t));
+	if (par->filename != NULL)
+		isc_mem_free(mctx, par->filename);
+	if (par->f != NULL)
+		(void)isc_stdio_close(par->f);
+	(void)isc_condition_destroy(&par->done);
+	(void)isc_condition_destroy(&par->work);
+	DESTROYLOCK(&par->lock);
+	isc_mem_put(mctx, par, sizeof(*par));
+}
+
+static isc_result_t
+openfile_partext(dns_loadctx_t *lctx, const char *master_file) {
+	return (parload_create(lctx, master_file, &lctx->par));
+}
+
+static isc_result_t
+load_partext(dns_loadctx_t *lctx) {
+	parload_t *par;
+	parchunk_t *chunk;
+	isc_result_t result = ISC_R_SUCCESS;
+	char name[16];
+
+	REQUIRE(DNS_LCTX_VALID(lctx));
+	REQUIRE(lctx->par != NULL);
+
+	par = lctx->par;
+
+	/*
+	 * Start the workers on the first call.  Fewer of them than were
+	 * asked for will do.
+	 */
+	while (par->running < par->nthreads && par->filled == 0) {
+		result = isc_thread_create(parload_run, par,
+					   &par->threads[par->running]);
+		if (result != ISC_R_SUCCESS)
+			break;
+		snprintf(name, sizeof(name), "isc-loader%u", par->running);
+		isc_thread_setname(par->threads[par->running], name);
+		par->running++;
+	}
+	if (par->running == 0)
+		return (result);
+
+	for (;;) {
+		LOCK(&par->lock);
+		while ((!par->eof || par->carrylen != 0) &&
+		       par->filled - par->committed < par->nchunks)
+		{
+			chunk = &par->chunks[par->filled % par->nchunks];
+			INSIST(chunk->state == parchunk_free);
+			UNLOCK(&par->lock);
+			result = parload_fill(par, chunk);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+			LOCK(&par->lock);
+			if (chunk->textlen != 0) {
+				chunk->state = parchunk_queued;
+				par->filled++;
+				SIGNAL(&par->work);
+			}
+		}
+		if (par->committed == par->filled) {
+			UNLOCK(&par->lock);
+			break;
+		}
+		chunk = &par->chunks[par->committed % par->nchunks];
+		while (chunk->state != parchunk_done)
+			WAIT(&par->done, &par->lock);
+		UNLOCK(&par->lock);
+
+		result = parload_replay(par, chunk);
+		if (result == ISC_R_SUCCESS)
+			result = chunk->result;
+		if (chunk->seen_include) {
+			lctx->seen_include = ISC_TRUE;
+			if (result == DNS_R_SEENINCLUDE)
+				result = ISC_R_SUCCESS;
+		}
+		if (MANYERRS(lctx, result))
+			SETRESULT(lctx, result);
+		else if (result != ISC_R_SUCCESS)
+			return (result);
+		isc_buffer_clear(chunk->batch);
+
+		LOCK(&par->lock);
+		chunk->state = parchunk_free;
+		par->committed++;
+		UNLOCK(&par->lock);
+
+		if (lctx->loop_cnt != 0)
+			return (DNS_R_CONTINUE);
+	}
+
+	if (lctx->result != ISC_R_SUCCESS)
+		return (lctx->result);
+	if (lctx->seen_include)
+		return (DNS_R_SEENINCLUDE);
+	return (ISC_R_SUCCESS);
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*%
+ * Parse text files with 'threads' threads.
+ */
+static void
+setthreads(dns_loadctx_t *lctx, unsigned int threads) {
+#ifdef ISC_PLATFORM_USETHREADS
+	if (lctx->format == dns_masterformat_text && threads > 1) {
+		lctx->threads = threads;
+		lctx->openfile = openfile_partext;
+		lctx->load = load_partext;
+	}
+#else
+	UNUSED(lctx);
+	UNUSED(threads);
+#endif
+}
+
 isc_result_t
 dns_master_loadfile(const char *master_file, dns_name_t *top,
 		    dns_name_t *origin,
@@ -2643,10 +3824,27 @@ dns_master_loadfile5(const char *master_file, dns_name_t *top,
 		     dns_masterincludecb_t include_cb, void *include_arg,
 		     isc_mem_t *mctx, dns_masterformat_t format,
 		     dns_ttl_t maxttl)
+{
+	return (dns_master_loadfile6(master_file, top, origin, zclass,
+				     options, resign, callbacks,
+				     include_cb, include_arg,
+				     mctx, format, maxttl, 1));
+}
+
+isc_result_t
+dns_master_loadfile6(const char *master_file, dns_name_t *top,
+		     dns_name_t *origin, dns_rdataclass_t zclass,
+		     unsigned int options, isc_uint32_t resign,
+		     dns_rdatacallbacks_t *callbacks,
+		     dns_masterincludecb_t include_cb, void *include_arg,
+		     isc_mem_t *mctx, dns_masterformat_t format,
+		     dns_ttl_t maxttl, unsigned int threads)
 {
 	dns_loadctx_t *lctx = NULL;
 	isc_result_t result;
 
+	REQUIRE(threads > 0);
+
 	result = loadctx_create(format, mctx, options, resign, top, zclass,
 				origin, callbacks, NULL, NULL, NULL,
 				include_cb, include_arg, NULL, &lctx);
@@ -2654,6 +3852,7 @@ dns_master_loadfile5(const char *master_file, dns_name_t *top,
 		return (result);
 
 	lctx->maxttl = maxttl;
+	setthreads(lctx, threads);
 
 	result = (lctx->openfile)(lctx, master_file);
 	if (result != ISC_R_SUCCESS)
@@ -2736,12 +3935,30 @@ dns_master_loadfileinc5(const char *master_file, dns_name_t *top,
 			dns_masterincludecb_t include_cb, void *include_arg,
 			isc_mem_t *mctx, dns_masterformat_t format,
 			isc_uint32_t maxttl)
+{
+	return (dns_master_loadfileinc6(master_file, top, origin, zclass,
+					options, resign, callbacks, task,
+					done, done_arg, lctxp, include_cb,
+					include_arg, mctx, format, maxttl, 1));
+}
+
+isc_result_t
+dns_master_loadfileinc6(const char *master_file, dns_name_t *top,
+			dns_name_t *origin, dns_rdataclass_t zclass,
+			unsigned int options, isc_uint32_t resign,
+			dns_rdatacallbacks_t *callbacks,
+			isc_task_t *task, dns_loaddonefunc_t done,
+			void *done_arg, dns_loadctx_t **lctxp,
+			dns_masterincludecb_t include_cb, void *include_arg,
+			isc_mem_t *mctx, dns_masterformat_t format,
+			isc_uint32_t maxttl, unsigned int threads)
 {
 	dns_loadctx_t *lctx = NULL;
 	isc_result_t result;
 
 	REQUIRE(task != NULL);
 	REQUIRE(done != NULL);
+	REQUIRE(threads > 0);
 
 	result = loadctx_create(format, mctx, options, resign, top, zclass,
 				origin, callbacks, task, done, done_arg,
@@ -2750,6 +3967,7 @@ dns_master_loadfileinc5(const char *master_file, dns_name_t *top,
 		return (result);
 
 	lctx->maxttl = maxttl;
+	setthreads(lctx, threads);
 
 	result = (lctx->openfile)(lctx, master_file);
 	if (result != ISC_R_SUCCESS)
@@ -3105,11 +4323,8 @@ commit(dns_rdatacallbacks_t *callbacks, dns_loadctx_t *lctx,
 	dns_rdatalist_t *this;
 	dns_rdataset_t dataset;
 	isc_result_t result;
-	char namebuf[DNS_NAME_FORMATSIZE];
-	void    (*error)(struct dns_rdatacallbacks *, const char *, ...);
 
 	this = ISC_LIST_HEAD(*head);
-	error = callbacks->error;
 
 	if (this == NULL)
 		return (ISC_R_SUCCESS);
@@ -3126,23 +4341,14 @@ commit(dns_rdatacallbacks_t *callbacks, dns_loadctx_t *lctx,
 			dataset.attributes |= DNS_RDATASETATTR_RESIGN;
 			dataset.resign = resign_fromlist(this, lctx);
 		}
-		result = ((*callbacks->add)(callbacks->add_private, owner,
-					    &dataset));
-		if (result == ISC_R_NOMEMORY) {
-			(*error)(callbacks, "dns_master_load: %s",
-				 dns_result_totext(result));
-		} else if (result != ISC_R_SUCCESS) {
-			dns_name_format(owner, namebuf, sizeof(namebuf));
-			if (source != NULL) {
-				(*error)(callbacks, "%s: %s:%lu: %s: %s",
-					 "dns_master_load", source, line,
-					 namebuf, dns_result_totext(result));
-			} else {
-				(*error)(callbacks, "%s: %s: %s",
-					 "dns_master_load", namebuf,
-					 dns_result_totext(result));
-			}
-		}
+#ifdef ISC_PLATFORM_USETHREADS
+		if (lctx->batch != NULL)
+			result = batch_rdataset(lctx, owner, &dataset,
+						source, line);
+		else
+#endif
+			result = add_rdataset(callbacks, lctx, owner,
+					      &dataset, source, line);
 		if (MANYERRS(lctx, result))
 			SETRESULT(lctx, result);
 		else if (result != ISC_R_SUCCESS)
@@ -3153,6 +4359,52 @@ commit(dns_rdatacallbacks_t *callbacks, dns_loadctx_t *lctx,
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Report that the rdataset of 'owner' could not be added.
+ */
+static void
+add_failed(dns_rdatacallbacks_t *callbacks, dns_name_t *owner,
+	   const char *source, unsigned int line, isc_result_t result)
+{
+	char namebuf[DNS_NAME_FORMATSIZE];
+	void    (*error)(struct dns_rdatacallbacks *, const char *, ...);
+
+	error = callbacks->error;
+	if (result == ISC_R_NOMEMORY) {
+		(*error)(callbacks, "dns_master_load: %s",
+			 dns_result_totext(result));
+	} else if (result != ISC_R_SUCCESS) {
+		dns_name_format(owner, namebuf, sizeof(namebuf));
+		if (source != NULL) {
+			(*error)(callbacks, "%s: %s:%lu: %s: %s",
+				 "dns_master_load", source, line,
+				 namebuf, dns_result_totext(result));
+		} else {
+			(*error)(callbacks, "%s: %s: %s",
+				 "dns_master_load", namebuf,
+				 dns_result_totext(result));
+		}
+	}
+}
+
+/*
+ * Pass 'dataset' to 'callbacks->add' and report any failure.
+ */
+static isc_result_t
+add_rdataset(dns_rdatacallbacks_t *callbacks, dns_loadctx_t *lctx,
+	     dns_name_t *owner, dns_rdataset_t *dataset,
+	     const char *source, unsigned int line)
+{
+	isc_result_t result;
+
+	UNUSED(lctx);
+
+	result = ((*callbacks->add)(callbacks->add_private, owner, dataset));
+	if (result != ISC_R_SUCCESS)
+		add_failed(callbacks, owner, source, line, result);
+	return (result);
+}
+
 /*
  * Returns ISC_TRUE if one of the NS rdata's contains 'owner'.
  */
@@ -3205,6 +4457,10 @@ load_quantum(isc_task_t *task, isc_event_t *event) {
 		event->ev_arg = lctx;
 		isc_task_send(task, &event);
 	} else {
+#ifdef ISC_PLATFORM_USETHREADS
+		if (lctx->par != NULL)
+			parload_destroy(&lctx->par);
+#endif
 		(lctx->done)(lctx->done_arg, result);
 		isc_event_free(&event);
 		dns_loadctx_detach(&lctx);
@@ -16,14 +16,17 @@
 #include <stdlib.h>
 
 #include <isc/buffer.h>
+#include <isc/condition.h>
 #include <isc/event.h>
 #include <isc/file.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/print.h>
 #include <isc/stdio.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/thread.h>
 #include <isc/time.h>
 #include <isc/types.h>
 #include <isc/util.h>
@@ -232,6 +235,7 @@ struct dns_dumpctx {
 	dns_dumpdonefunc_t	done;
 	void			*done_arg;
 	unsigned int		nodes;
+	unsigned int		threads;
 	/* dns_master_dumpinc() */
 	char			*file;
 	char 			*tmpfile;
@@ -1082,11 +1086,13 @@ dump_rdatasets_text(isc_mem_t *mctx, const dns_name_t *name,
 }
 
 /*
- * Dump given RRsets in the "raw" format.
+ * Dump given RRsets in the "raw" format.  If 'out' is not NULL the
+ * record is appended to '*out' instead of being written to 'f'.
  */
 static isc_result_t
 dump_rdataset_raw(isc_mem_t *mctx, const dns_name_t *name,
-		  dns_rdataset_t *rdataset, isc_buffer_t *buffer, FILE *f)
+		  dns_rdataset_t *rdataset, isc_buffer_t *buffer, FILE *f,
+		  isc_buffer_t **out)
 {
 	isc_result_t result;
 	isc_uint32_t totallen;
@@ -1176,6 +1182,14 @@ dump_rdataset_raw(isc_mem_t *mctx, const dns_name_t *name,
 	isc_buffer_putuint32(buffer, totallen);
 	INSIST(isc_buffer_usedlength(buffer) < totallen);
 
+	if (out != NULL) {
+		result = isc_buffer_reserve(out, r.length);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+		isc_buffer_putmem(*out, r.base, r.length);
+		return (ISC_R_SUCCESS);
+	}
+
 	/*
 	 * Write the buffer contents to the raw master file.
 	 */
@@ -1192,9 +1206,9 @@ dump_rdataset_raw(isc_mem_t *mctx, const dns_name_t *name,
 }
 
 static isc_result_t
-dump_rdatasets_raw(isc_mem_t *mctx, const dns_name_t *name,
-		   dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
-		   isc_buffer_t *buffer, FILE *f)
+raw_rdatasets(isc_mem_t *mctx, const dns_name_t *name,
+	      dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
+	      isc_buffer_t *buffer, FILE *f, isc_buffer_t **out)
 {
 	isc_result_t result;
 	dns_rdataset_t rdataset;
@@ -1211,7 +1225,7 @@ dump_rdatasets_raw(isc_mem_t *mctx, const dns_name_t *name,
 			/* Omit negative cache entries */
 		} else {
 			result = dump_rdataset_raw(mctx, name, &rdataset,
-						   buffer, f);
+						   buffer, f, out);
 		}
 		dns_rdataset_disassociate(&rdataset);
 		if (result != ISC_R_SUCCESS)
@@ -1224,6 +1238,14 @@ dump_rdatasets_raw(isc_mem_t *mctx, const dns_name_t *name,
 	return (result);
 }
 
+static isc_result_t
+dump_rdatasets_raw(isc_mem_t *mctx, const dns_name_t *name,
+		   dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
+		   isc_buffer_t *buffer, FILE *f)
+{
+	return (raw_rdatasets(mctx, name, rdsiter, ctx, buffer, f, NULL));
+}
+
 static isc_result_t
 dump_rdatasets_map(isc_mem_t *mctx, const dns_name_t *name,
 		   dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
@@ -1464,6 +1486,7 @@ dumpctx_create(isc_mem_t *mctx, dns_db_t *db, dns_dbversion_t *version,
 	dctx->done_arg = NULL;
 	dctx->task = NULL;
 	dctx->nodes = 0;
+	dctx->threads = 1;
 	dctx->first = ISC_TRUE;
 	dctx->canceled = ISC_FALSE;
 	dctx->file = NULL;
@@ -1632,6 +1655,353 @@ writeheader(dns_dumpctx_t *dctx) {
 	return (result);
 }
 
+#ifdef ISC_PLATFORM_USETHREADS
+/*
+ * Parallel dumping of raw master files.
+ *
+ * The calling thread walks the database and hands the nodes out in runs
+ * of PARDUMP_NODES.  Worker threads render each run into a buffer of its
+ * own, and the calling thread writes the buffers out in the order the
+ * runs were made, so the file is the same as a sequential dump writes.
+ */
+
+#define PARDUMP_NODES	128
+
+typedef enum {
+	parrun_free = 0,
+	parrun_queued,
+	parrun_done
+} parrunstate_t;
+
+typedef struct {
+	parrunstate_t		state;
+	unsigned int		count;
+	dns_dbnode_t		*nodes[PARDUMP_NODES];
+	dns_fixedname_t		names[PARDUMP_NODES];
+	isc_buffer_t		buffer;		/*%< scratch space */
+	isc_buffer_t		*out;
+	isc_result_t		result;
+} parrun_t;
+
+typedef struct {
+	dns_dumpctx_t		*dctx;
+
+	isc_mutex_t		lock;
+	/* Locked by lock. */
+	isc_condition_t		work;		/*%< a run was queued */
+	isc_condition_t		done;		/*%< a run was rendered */
+	isc_boolean_t		shutdown;
+	isc_uint64_t		filled;
+	isc_uint64_t		taken;
+
+	unsigned int		nruns;
+	parrun_t		*runs;
+	unsigned int		nthreads;
+	unsigned int		running;
+	isc_thread_t		*threads;
+} pardump_t;
+
+/*%
+ * Render the nodes of 'run' into 'run->out' and release them.
+ */
+static void
+pardump_render(pardump_t *par, parrun_t *run) {
+	dns_dumpctx_t *dctx = par->dctx;
+	dns_rdatasetiter_t *rdsiter;
+	isc_result_t result = ISC_R_SUCCESS;
+	unsigned int i;
+
+	isc_buffer_clear(run->out);
+	for (i = 0; i < run->count; i++) {
+		if (result == ISC_R_SUCCESS) {
+			rdsiter = NULL;
+			result = dns_db_allrdatasets(dctx->db, run->nodes[i],
+						     dctx->version, dctx->now,
+						     &rdsiter);
+			if (result == ISC_R_SUCCESS) {
+				result = raw_rdatasets(dctx->mctx,
+					    dns_fixedname_name(&run->names[i]),
+					    rdsiter, &dctx->tctx,
+					    &run->buffer, NULL, &run->out);
+				dns_rdatasetiter_destroy(&rdsiter);
+			}
+		}
+		dns_db_detachnode(dctx->db, &run->nodes[i]);
+	}
+	run->count = 0;
+	run->result = result;
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+pardump_run(isc_threadarg_t arg) {
+	pardump_t *par = arg;
+	parrun_t *run;
+
+	LOCK(&par->lock);
+	for (;;) {
+		while (!par->shutdown && par->taken == par->filled)
+			WAIT(&par->work, &par->lock);
+		/*
+		 * Runs that are already queued hold nodes, so they are
+		 * rendered even when shutting down.
+		 */
+		if (par->taken == par->filled)
+			break;
+		run = &par->runs[par->taken++ % par->nruns];
+		UNLOCK(&par->lock);
+
+		pardump_render(par, run);
+
+		LOCK(&par->lock);
+		run->state = parrun_done;
+		BROADCAST(&par->done);
+	}
+	UNLOCK(&par->lock);
+
+	return ((isc_threadresult_t)0);
+}
+
+/*%
+ * Stop the worker threads and free 'par'.
+ */
+static void
+pardump_destroy(pardump_t **parp) {
+	pardump_t *par;
+	isc_mem_t *mctx;
+	parrun_t *run;
+	unsigned int i;
+
+	REQUIRE(parp != NULL && *parp != NULL);
+
+	par = *parp;
+	*parp = NULL;
+	mctx = par->dctx->mctx;
+
+	LOCK(&par->lock);
+	par->shutdown = ISC_TRUE;
+	BROADCAST(&par->work);
+	UNLOCK(&par->lock);
+	for (i = 0; i < par->running; i++)
+		(void)isc_thread_join(par->threads[i], NULL);
+
+	if (par->runs != NULL) {
+		for (i = 0; i < par->nruns; i++) {
+			run = &par->runs[i];
+			INSIST(run->count == 0);
+			if (run->buffer.base != NULL)
+				isc_mem_put(mctx, run->buffer.base,
+					    run->buffer.length);
+			if (run->out != NULL)
+				isc_buffer_free(&run->out);
+		}
+		isc_mem_put(mctx, par->runs, par->nruns * sizeof(parrun_t));
+	}
+	if (par->threads != NULL)
+		isc_mem_put(mctx, par->threads,
+			    par->nthreads * sizeof(isc_thread_t));
+	(void)isc_condition_destroy(&par->done);
+	(void)isc_condition_destroy(&par->work);
+	DESTROYLOCK(&par->lock);
+	isc_mem_put(mctx, par, sizeof(*par));
+}
+
+/*%
+ * Set up the runs and start the worker threads.  Fails if not even
+ * one thread could be started.
+ */
+static isc_result_t
+pardump_create(dns_dumpctx_t *dctx, pardump_t **parp) {
+	pardump_t *par;
+	parrun_t *run;
+	isc_result_t result;
+	unsigned int i;
+	void *bufmem;
+	char name[16];
+
+	REQUIRE(parp != NULL && *parp == NULL);
+
+	par = isc_mem_get(dctx->mctx, sizeof(*par));
+	if (par == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(par, 0, sizeof(*par));
+	par->dctx = dctx;
+
+	result = isc_mutex_init(&par->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_par;
+	result = isc_condition_init(&par->work);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+	result = isc_condition_init(&par->done);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_work;
+
+	/*
+	 * From here on pardump_destroy() can clean up.
+	 */
+	*parp = par;
+
+	par->nthreads = dctx->threads;
+	par->nruns = par->nthreads * 2;
+	par->runs = isc_mem_get(dctx->mctx, par->nruns * sizeof(parrun_t));
+	if (par->runs == NULL) {
+		par->nruns = 0;
+		result = ISC_R_NOMEMORY;
+		goto cleanup;
+	}
+	memset(par->runs, 0, par->nruns * sizeof(parrun_t));
+	for (i = 0; i < par->nruns; i++) {
+		run = &par->runs[i];
+		bufmem = isc_mem_get(dctx->mctx, initial_buffer_length);
+		if (bufmem == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+		isc_buffer_init(&run->buffer, bufmem, initial_buffer_length);
+		result = isc_buffer_allocate(dctx->mctx, &run->out, 65536);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
+	par->threads = isc_mem_get(dctx->mctx,
+				   par->nthreads * sizeof(isc_thread_t));
+	if (par->threads == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup;
+	}
+	while (par->running < par->nthreads) {
+		result = isc_thread_create(pardump_run, par,
+					   &par->threads[par->running]);
+		if (result != ISC_R_SUCCESS)
+			break;
+		snprintf(name, sizeof(name), "isc-dumper%u", par->running);
+		isc_thread_setname(par->threads[par->running], name);
+		par->running++;
+	}
+	if (par->running == 0)
+		goto cleanup;
+
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	pardump_destroy(parp);
+	return (result);
+
+ cleanup_work:
+	(void)isc_condition_destroy(&par->work);
+ cleanup_lock:
+	DESTROYLOCK(&par->lock);
+ cleanup_par:
+	isc_mem_put(dctx->mctx, par, sizeof(*par));
+	return (result);
+}
+
+/*%
+ * Take up to PARDUMP_NODES nodes from the database iterator.  Returns
+ * ISC_R_NOMORE once the iterator is exhausted.
+ */
+static isc_result_t
+pardump_fill(pardump_t *par, parrun_t *run) {
+	dns_dumpctx_t *dctx = par->dctx;
+	isc_result_t result = ISC_R_SUCCESS;
+	dns_name_t *name;
+
+	while (run->count < PARDUMP_NODES) {
+		dns_fixedname_init(&run->names[run->count]);
+		name = dns_fixedname_name(&run->names[run->count]);
+		result = dns_dbiterator_current(dctx->dbiter,
+						&run->nodes[run->count], name);
+		if (result == DNS_R_NEWORIGIN)
+			result = ISC_R_SUCCESS;
+		if (result != ISC_R_SUCCESS)
+			break;
+		run->count++;
+		result = dns_dbiterator_next(dctx->dbiter);
+		if (result != ISC_R_SUCCESS)
+			break;
+	}
+
+	/*
+	 * Don't hold the database locks while the run is rendered.
+	 */
+	RUNTIME_CHECK(dns_dbiterator_pause(dctx->dbiter) == ISC_R_SUCCESS);
+	return (result);
+}
+
+/*%
+ * Dump the rest of the database, starting at the current iterator
+ * position.
+ */
+static isc_result_t
+pardump_dump(pardump_t *par) {
+	dns_dumpctx_t *dctx = par->dctx;
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_result_t tresult;
+	isc_boolean_t eof = ISC_FALSE;
+	isc_uint64_t written = 0;
+	parrun_t *run;
+	isc_region_t r;
+
+	for (;;) {
+		LOCK(&par->lock);
+		while (!eof && par->filled - written < par->nruns) {
+			run = &par->runs[par->filled % par->nruns];
+			INSIST(run->state == parrun_free);
+			UNLOCK(&par->lock);
+			tresult = pardump_fill(par, run);
+			if (tresult != ISC_R_SUCCESS) {
+				eof = ISC_TRUE;
+				if (tresult != ISC_R_NOMORE)
+					result = tresult;
+			}
+			LOCK(&par->lock);
+			if (run->count != 0) {
+				run->state = parrun_queued;
+				par->filled++;
+				SIGNAL(&par->work);
+			}
+		}
+		if (written == par->filled) {
+			UNLOCK(&par->lock);
+			break;
+		}
+		run = &par->runs[written % par->nruns];
+		while (run->state != parrun_done)
+			WAIT(&par->done, &par->lock);
+		UNLOCK(&par->lock);
+
+		/*
+		 * After a failure keep going until every queued run has
+		 * been rendered, but write nothing more.
+		 */
+		if (result == ISC_R_SUCCESS)
+			result = run->result;
+		if (result == ISC_R_SUCCESS) {
+			isc_buffer_usedregion(run->out, &r);
+			result = isc_stdio_write(r.base, 1, (size_t)r.length,
+						 dctx->f, NULL);
+			if (result != ISC_R_SUCCESS)
+				UNEXPECTED_ERROR(__FILE__, __LINE__,
+						 "raw master file write "
+						 "failed: %s",
+						 isc_result_totext(result));
+		}
+		if (result != ISC_R_SUCCESS)
+			eof = ISC_TRUE;
+
+		LOCK(&par->lock);
+		run->state = parrun_free;
+		written++;
+		UNLOCK(&par->lock);
+	}
+
+	return (result);
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
 static isc_result_t
 dumptostreaminc(dns_dumpctx_t *dctx) {
 	isc_result_t result = ISC_R_SUCCESS;
@@ -1671,6 +2041,25 @@ dumptostreaminc(dns_dumpctx_t *dctx) {
 			goto cleanup;
 
 		dctx->first = ISC_FALSE;
+
+#ifdef ISC_PLATFORM_USETHREADS
+		/*
+		 * Render raw files in parallel when the whole database is
+		 * dumped in one go.  If no threads could be started, fall
+		 * back to a sequential dump.
+		 */
+		if (result == ISC_R_SUCCESS && dctx->threads > 1 &&
+		    dctx->nodes == 0 && dctx->format == dns_masterformat_raw)
+		{
+			pardump_t *par = NULL;
+
+			if (pardump_create(dctx, &par) == ISC_R_SUCCESS) {
+				result = pardump_dump(par);
+				pardump_destroy(&par);
+				goto cleanup;
+			}
+		}
+#endif
 	} else
 		result = ISC_R_SUCCESS;
 
@@ -1822,14 +2211,29 @@ dns_master_dumptostream3(isc_mem_t *mctx, dns_db_t *db,
 			 const dns_master_style_t *style,
 			 dns_masterformat_t format,
 			 dns_masterrawheader_t *header, FILE *f)
+{
+	return (dns_master_dumptostream4(mctx, db, version, style,
+					 format, header, f, 1));
+}
+
+isc_result_t
+dns_master_dumptostream4(isc_mem_t *mctx, dns_db_t *db,
+			 dns_dbversion_t *version,
+			 const dns_master_style_t *style,
+			 dns_masterformat_t format,
+			 dns_masterrawheader_t *header, FILE *f,
+			 unsigned int threads)
 {
 	dns_dumpctx_t *dctx = NULL;
 	isc_result_t result;
 
+	REQUIRE(threads > 0);
+
 	result = dumpctx_create(mctx, db, version, style, f, &dctx,
 				format, header);
 	if (result != ISC_R_SUCCESS)
 		return (result);
+	dctx->threads = threads;
 
 	result = dumptostreaminc(dctx);
 	INSIST(result != DNS_R_CONTINUE);
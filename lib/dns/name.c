@@ -18,6 +18,7 @@
 #include <ctype.h>
 #include <stdlib.h>
 
+#include <isc/ascii.h>
 #include <isc/buffer.h>
 #include <isc/hash.h>
 #include <isc/mem.h>
@@ -47,7 +48,6 @@ typedef enum {
 
 typedef enum {
 	fw_start = 0,
-	fw_ordinary,
 	fw_newcurrent
 } fw_state;
 
@@ -611,43 +611,10 @@ dns_name_fullcompare(const dns_name_t *name1, const dns_name_t *name2,
 		else
 			count = count2;
 
-		/* Loop unrolled for performance */
-		while (ISC_LIKELY(count > 3)) {
-			chdiff = (int)maptolower[label1[0]] -
-				 (int)maptolower[label2[0]];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
-			chdiff = (int)maptolower[label1[1]] -
-				 (int)maptolower[label2[1]];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
-			chdiff = (int)maptolower[label1[2]] -
-				 (int)maptolower[label2[2]];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
-			chdiff = (int)maptolower[label1[3]] -
-				 (int)maptolower[label2[3]];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
-			count -= 4;
-			label1 += 4;
-			label2 += 4;
-		}
-		while (ISC_LIKELY(count-- > 0)) {
-			chdiff = (int)maptolower[*label1++] -
-				 (int)maptolower[*label2++];
-			if (chdiff != 0) {
-				*orderp = chdiff;
-				goto done;
-			}
+		chdiff = isc_ascii_lowercmp(label1, label2, count);
+		if (chdiff != 0) {
+			*orderp = chdiff;
+			goto done;
 		}
 		if (cdiff != 0) {
 			*orderp = cdiff;
@@ -696,9 +663,6 @@ dns_name_compare(const dns_name_t *name1, const dns_name_t *name2) {
 
 isc_boolean_t
 dns_name_equal(const dns_name_t *name1, const dns_name_t *name2) {
-	unsigned int l, count;
-	unsigned char c;
-	unsigned char *label1, *label2;
 
 	/*
 	 * Are 'name1' and 'name2' equal?
@@ -723,46 +687,16 @@ dns_name_equal(const dns_name_t *name1, const dns_name_t *name2) {
 	if (name1->length != name2->length)
 		return (ISC_FALSE);
 
-	l = name1->labels;
-
-	if (l != name2->labels)
+	if (name1->labels != name2->labels)
 		return (ISC_FALSE);
 
-	label1 = name1->ndata;
-	label2 = name2->ndata;
-	while (ISC_LIKELY(l-- > 0)) {
-		count = *label1++;
-		if (count != *label2++)
-			return (ISC_FALSE);
-
-		INSIST(count <= 63); /* no bitstring support */
-
-		/* Loop unrolled for performance */
-		while (ISC_LIKELY(count > 3)) {
-			c = maptolower[label1[0]];
-			if (c != maptolower[label2[0]])
-				return (ISC_FALSE);
-			c = maptolower[label1[1]];
-			if (c != maptolower[label2[1]])
-				return (ISC_FALSE);
-			c = maptolower[label1[2]];
-			if (c != maptolower[label2[2]])
-				return (ISC_FALSE);
-			c = maptolower[label1[3]];
-			if (c != maptolower[label2[3]])
-				return (ISC_FALSE);
-			count -= 4;
-			label1 += 4;
-			label2 += 4;
-		}
-		while (ISC_LIKELY(count-- > 0)) {
-			c = maptolower[*label1++];
-			if (c != maptolower[*label2++])
-				return (ISC_FALSE);
-		}
-	}
-
-	return (ISC_TRUE);
+	/*
+	 * Label lengths are below 'A', so case folding leaves them alone
+	 * and the whole wire form can be compared in one pass: while the
+	 * names are equal, their labels start at the same offsets.
+	 */
+	return (isc_ascii_lowerequal(name1->ndata, name2->ndata,
+				     name1->length));
 }
 
 isc_boolean_t
@@ -1687,7 +1621,7 @@ dns_name_downcase(const dns_name_t *source, dns_name_t *name,
 		  isc_buffer_t *target)
 {
 	unsigned char *sndata, *ndata;
-	unsigned int nlen, count, labels;
+	unsigned int nlen;
 	isc_buffer_t buffer;
 
 	/*
@@ -1715,31 +1649,17 @@ dns_name_downcase(const dns_name_t *source, dns_name_t *name,
 
 	sndata = source->ndata;
 	nlen = source->length;
-	labels = source->labels;
 
 	if (nlen > (target->length - target->used)) {
 		MAKE_EMPTY(name);
 		return (ISC_R_NOSPACE);
 	}
 
-	while (labels > 0 && nlen > 0) {
-		labels--;
-		count = *sndata++;
-		*ndata++ = count;
-		nlen--;
-		if (count < 64) {
-			INSIST(nlen >= count);
-			while (count > 0) {
-				*ndata++ = maptolower[(*sndata++)];
-				nlen--;
-				count--;
-			}
-		} else {
-			FATAL_ERROR(__FILE__, __LINE__,
-				    "Unexpected label type %02x", count);
-			/* Does not return. */
-		}
-	}
+	/*
+	 * Label lengths are below 'A' and are copied unchanged, so the
+	 * whole name can be folded in one pass.
+	 */
+	isc_ascii_lowercopy(ndata, sndata, nlen);
 
 	if (source != name) {
 		name->labels = source->labels;
@@ -1804,7 +1724,7 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 {
 	unsigned char *cdata, *ndata;
 	unsigned int cused; /* Bytes of compressed name data used */
-	unsigned int nused, labels, n, nmax;
+	unsigned int nused, labels, nmax;
 	unsigned int current, new_current, biggest_pointer;
 	isc_boolean_t done;
 	fw_state state = fw_start;
@@ -1844,7 +1764,6 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 	/*
 	 * Initialize things to make the compiler happy; they're not required.
 	 */
-	n = 0;
 	new_current = 0;
 
 	/*
@@ -1874,8 +1793,9 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 	biggest_pointer = current;
 
 	/*
-	 * Note:  The following code is not optimized for speed, but
-	 * rather for correctness.  Speed will be addressed in the future.
+	 * Label lengths and pointers are handled an octet at a time by
+	 * the state machine below; the contents of each label are copied
+	 * in one go.
 	 */
 
 	while (current < source->active && !done) {
@@ -1893,10 +1813,21 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 					goto full;
 				nused += c + 1;
 				*ndata++ = c;
-				if (c == 0)
+				if (c == 0) {
 					done = ISC_TRUE;
-				n = c;
-				state = fw_ordinary;
+					break;
+				}
+				if (c > source->active - current)
+					return (ISC_R_UNEXPECTEDEND);
+				if (downcase)
+					isc_ascii_lowercopy(ndata, cdata, c);
+				else
+					memmove(ndata, cdata, c);
+				ndata += c;
+				cdata += c;
+				current += c;
+				if (!seen_pointer)
+					cused += c;
 			} else if (c >= 128 && c < 192) {
 				/*
 				 * 14 bit local compression pointer.
@@ -1916,14 +1847,6 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 			} else
 				return (DNS_R_BADLABELTYPE);
 			break;
-		case fw_ordinary:
-			if (downcase)
-				c = maptolower[c];
-			*ndata++ = c;
-			n--;
-			if (n == 0)
-				state = fw_start;
-			break;
 		case fw_newcurrent:
 			new_current *= 256;
 			new_current += c;
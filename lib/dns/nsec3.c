@@ -2122,3 +2122,315 @@ dns_nsec3_noexistnodata(dns_rdatatype_t type, const dns_name_t *name,
 	}
 	return (answer);
 }
+
+/*
+ * Don't synthesize answers from NSEC3 chains which make hashing
+ * each name expensive.
+ */
+#define NSEC3_PROOF_MAXITERATIONS 150
+
+void
+dns_nsec3proof_init(dns_nsec3proof_t *proof) {
+	int i;
+
+	REQUIRE(proof != NULL);
+
+	proof->exists = ISC_FALSE;
+	for (i = 0; i < DNS_NSEC3PROOF_MAX; i++) {
+		dns_fixedname_init(&proof->names[i]);
+		dns_rdataset_init(&proof->rdatasets[i]);
+		dns_rdataset_init(&proof->sigrdatasets[i]);
+	}
+}
+
+void
+dns_nsec3proof_invalidate(dns_nsec3proof_t *proof) {
+	int i;
+
+	REQUIRE(proof != NULL);
+
+	for (i = 0; i < DNS_NSEC3PROOF_MAX; i++) {
+		if (dns_rdataset_isassociated(&proof->rdatasets[i]))
+			dns_rdataset_disassociate(&proof->rdatasets[i]);
+		if (dns_rdataset_isassociated(&proof->sigrdatasets[i]))
+			dns_rdataset_disassociate(&proof->sigrdatasets[i]);
+	}
+}
+
+static void
+proof_clear(dns_nsec3proof_t *proof, int which) {
+	if (dns_rdataset_isassociated(&proof->rdatasets[which]))
+		dns_rdataset_disassociate(&proof->rdatasets[which]);
+	if (dns_rdataset_isassociated(&proof->sigrdatasets[which]))
+		dns_rdataset_disassociate(&proof->sigrdatasets[which]);
+}
+
+static void
+proof_move(dns_nsec3proof_t *proof, int from, int to) {
+	proof_clear(proof, to);
+	dns_name_copy(dns_fixedname_name(&proof->names[from]),
+		      dns_fixedname_name(&proof->names[to]), NULL);
+	dns_rdataset_clone(&proof->rdatasets[from], &proof->rdatasets[to]);
+	dns_rdataset_clone(&proof->sigrdatasets[from],
+			   &proof->sigrdatasets[to]);
+	proof_clear(proof, from);
+}
+
+/*
+ * Look up the cached NSEC3 record matching or covering the hash of
+ * 'name' (or 'name' itself, if 'params' is NULL) and store it in
+ * slot 'which' of 'proof'.  The record must be secure and signed by
+ * 'zone'.
+ */
+static isc_result_t
+proof_lookup(dns_db_t *db, const dns_name_t *zone, const dns_name_t *name,
+	     const dns_rdata_nsec3_t *params, isc_stdtime_t now,
+	     dns_nsec3proof_t *proof, int which, isc_boolean_t *matchp)
+{
+	dns_fixedname_t fhashed;
+	const dns_name_t *hashed;
+	dns_name_t *owner;
+	dns_rdataset_t *rdataset, *sigrdataset;
+	isc_result_t result;
+
+	if (params != NULL) {
+		result = dns_nsec3_hashname(&fhashed, NULL, NULL, name, zone,
+					    params->hash, params->iterations,
+					    params->salt,
+					    params->salt_length);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+		hashed = dns_fixedname_name(&fhashed);
+	} else
+		hashed = name;
+
+	proof_clear(proof, which);
+	owner = dns_fixedname_name(&proof->names[which]);
+	rdataset = &proof->rdatasets[which];
+	sigrdataset = &proof->sigrdatasets[which];
+
+	result = dns_db_find(db, hashed, NULL, dns_rdatatype_nsec3,
+			     DNS_DBFIND_COVERINGNSEC | DNS_DBFIND_FORCENSEC3,
+			     now, NULL, owner, rdataset, sigrdataset);
+	if (result == ISC_R_SUCCESS)
+		*matchp = ISC_TRUE;
+	else if (result == DNS_R_COVERINGNSEC)
+		*matchp = ISC_FALSE;
+	else
+		goto failure;
+
+	if (rdataset->trust != dns_trust_secure ||
+	    !dns_rdataset_isassociated(sigrdataset) ||
+	    sigrdataset->trust != dns_trust_secure)
+	{
+		result = ISC_R_NOTFOUND;
+		goto failure;
+	}
+
+	/*
+	 * The record must have been signed by the zone itself.
+	 */
+	for (result = dns_rdataset_first(sigrdataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(sigrdataset))
+	{
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+		dns_rdata_rrsig_t rrsig;
+
+		dns_rdataset_current(sigrdataset, &rdata);
+		result = dns_rdata_tostruct(&rdata, &rrsig, NULL);
+		if (result != ISC_R_SUCCESS)
+			goto failure;
+		if (!dns_name_equal(&rrsig.signer, zone)) {
+			result = ISC_R_NOTFOUND;
+			goto failure;
+		}
+	}
+	return (ISC_R_SUCCESS);
+
+ failure:
+	proof_clear(proof, which);
+	if (result == ISC_R_SUCCESS || result == ISC_R_NOMORE)
+		result = ISC_R_NOTFOUND;
+	return (result);
+}
+
+static isc_result_t
+proof_firstrdata(dns_rdataset_t *rdataset, dns_rdata_t *rdata,
+		 dns_rdata_nsec3_t *nsec3)
+{
+	isc_result_t result;
+
+	result = dns_rdataset_first(rdataset);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	dns_rdataset_current(rdataset, rdata);
+	return (dns_rdata_tostruct(rdata, nsec3, NULL));
+}
+
+isc_result_t
+dns_nsec3_findproof(dns_db_t *db, const dns_name_t *zone,
+		    const dns_name_t *name, dns_rdatatype_t type,
+		    isc_stdtime_t now, dns_nsec3proof_t *proof,
+		    dns_nseclog_t logit, void *arg)
+{
+	dns_fixedname_t fwild, fancestor, fzonename;
+	dns_name_t *wild, *ancestor, *zonename;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdata_nsec3_t params, nsec3;
+	unsigned char salt[DNS_NSEC3_SALTSIZE];
+	isc_boolean_t match, exists, data, optout;
+	unsigned int labels, zlabels;
+	isc_result_t result;
+
+	REQUIRE(DNS_DB_VALID(db));
+	REQUIRE(dns_name_issubdomain(name, zone));
+	REQUIRE(proof != NULL);
+
+	proof->exists = ISC_FALSE;
+	zlabels = dns_name_countlabels(zone);
+	labels = dns_name_countlabels(name);
+
+	dns_fixedname_init(&fwild);
+	wild = dns_fixedname_name(&fwild);
+	dns_fixedname_init(&fancestor);
+	ancestor = dns_fixedname_name(&fancestor);
+	dns_fixedname_init(&fzonename);
+	zonename = dns_fixedname_name(&fzonename);
+
+	/*
+	 * Any owner name directly below the zone finds one of its NSEC3
+	 * records if there are any; take the hash parameters from it.
+	 */
+	result = dns_name_concatenate(dns_wildcardname, zone, wild, NULL);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	result = proof_lookup(db, zone, wild, NULL, now, proof,
+			      DNS_NSEC3PROOF_CLOSEST, &match);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	result = proof_firstrdata(&proof->rdatasets[DNS_NSEC3PROOF_CLOSEST],
+				  &rdata, &params);
+	if (result != ISC_R_SUCCESS)
+		goto failure;
+	if (!dns_nsec3_supportedhash(params.hash) ||
+	    params.iterations > NSEC3_PROOF_MAXITERATIONS)
+	{
+		result = ISC_R_NOTFOUND;
+		goto failure;
+	}
+
+	/*
+	 * The salt refers to the rdataset, which is about to be reused.
+	 */
+	memmove(salt, params.salt, params.salt_length);
+	params.salt = salt;
+
+	/*
+	 * Does 'name' itself exist?
+	 */
+	result = proof_lookup(db, zone, name, &params, now, proof,
+			      DNS_NSEC3PROOF_CLOSEST, &match);
+	if (result != ISC_R_SUCCESS)
+		goto failure;
+	if (match) {
+		result = dns_nsec3_noexistnodata(type, name,
+				dns_fixedname_name(
+					&proof->names[DNS_NSEC3PROOF_CLOSEST]),
+				&proof->rdatasets[DNS_NSEC3PROOF_CLOSEST],
+				zonename, &exists, &data, NULL, NULL,
+				NULL, NULL, NULL, NULL, logit, arg);
+		if (result != ISC_R_SUCCESS || !exists || data) {
+			result = ISC_R_NOTFOUND;
+			goto failure;
+		}
+		proof->exists = ISC_TRUE;
+		return (ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Find the closest encloser.  The NSEC3 record covering the name
+	 * one label below it (the next closer name) was found on the
+	 * previous trip round the loop.
+	 */
+	match = ISC_FALSE;
+	while (labels > zlabels) {
+		proof_move(proof, DNS_NSEC3PROOF_CLOSEST,
+			   DNS_NSEC3PROOF_NEXTCLOSER);
+		labels--;
+		dns_name_split(name, labels, NULL, ancestor);
+		result = proof_lookup(db, zone, ancestor, &params, now, proof,
+				      DNS_NSEC3PROOF_CLOSEST, &match);
+		if (result != ISC_R_SUCCESS)
+			goto failure;
+		if (match)
+			break;
+	}
+	if (!match) {
+		result = ISC_R_NOTFOUND;
+		goto failure;
+	}
+
+	/*
+	 * The closest encloser must not be a delegation or a DNAME.
+	 */
+	dns_rdata_reset(&rdata);
+	result = proof_firstrdata(&proof->rdatasets[DNS_NSEC3PROOF_CLOSEST],
+				  &rdata, &nsec3);
+	if (result != ISC_R_SUCCESS)
+		goto failure;
+	if (dns_nsec3_typepresent(&rdata, dns_rdatatype_dname) ||
+	    (dns_nsec3_typepresent(&rdata, dns_rdatatype_ns) &&
+	     !dns_nsec3_typepresent(&rdata, dns_rdatatype_soa)))
+	{
+		result = ISC_R_NOTFOUND;
+		goto failure;
+	}
+
+	/*
+	 * The next closer name must be covered by a record without the
+	 * opt-out flag; otherwise it may be an insecure delegation.
+	 */
+	dns_name_split(name, labels + 1, NULL, ancestor);
+	dns_name_reset(zonename);
+	optout = ISC_TRUE;
+	result = dns_nsec3_noexistnodata(type, ancestor,
+			dns_fixedname_name(
+				&proof->names[DNS_NSEC3PROOF_NEXTCLOSER]),
+			&proof->rdatasets[DNS_NSEC3PROOF_NEXTCLOSER],
+			zonename, &exists, &data, &optout, NULL,
+			NULL, NULL, NULL, NULL, logit, arg);
+	if (result != ISC_R_SUCCESS || exists || optout) {
+		result = ISC_R_NOTFOUND;
+		goto failure;
+	}
+
+	/*
+	 * And the wildcard at the closest encloser must not exist.
+	 */
+	dns_name_split(name, labels, NULL, ancestor);
+	result = dns_name_concatenate(dns_wildcardname, ancestor, wild, NULL);
+	if (result != ISC_R_SUCCESS)
+		goto failure;
+	result = proof_lookup(db, zone, wild, &params, now, proof,
+			      DNS_NSEC3PROOF_WILDCARD, &match);
+	if (result != ISC_R_SUCCESS)
+		goto failure;
+	dns_name_reset(zonename);
+	result = dns_nsec3_noexistnodata(type, wild,
+			dns_fixedname_name(
+				&proof->names[DNS_NSEC3PROOF_WILDCARD]),
+			&proof->rdatasets[DNS_NSEC3PROOF_WILDCARD],
+			zonename, &exists, &data, NULL, NULL,
+			NULL, NULL, NULL, NULL, logit, arg);
+	if (match || result != ISC_R_SUCCESS || exists) {
+		result = ISC_R_NOTFOUND;
+		goto failure;
+	}
+
+	return (ISC_R_SUCCESS);
+
+ failure:
+	dns_nsec3proof_invalidate(proof);
+	return (result);
+}
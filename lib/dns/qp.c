@@ -0,0 +1,760 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/mem.h>
+#include <isc/once.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/name.h>
+#include <dns/qp.h>
+#include <dns/result.h>
+
+#define QP_MAGIC		ISC_MAGIC('Q', 'P', 'T', 'r')
+#define VALID_QP(qp)		ISC_MAGIC_VALID(qp, QP_MAGIC)
+
+#define QPITER_MAGIC		ISC_MAGIC('Q', 'P', 'I', 't')
+#define VALID_QPITER(it)	ISC_MAGIC_VALID(it, QPITER_MAGIC)
+
+#define VALID_NAME(n)		ISC_MAGIC_VALID(n, DNS_NAME_MAGIC)
+
+/*
+ * Key symbols.  NOBYTE pads a key past its end, so that a key sorts
+ * before every key it is a prefix of; SEP terminates each label, so
+ * that a shorter label sorts before a longer one it is a prefix of.
+ * The remaining symbols are assigned to octet values in increasing
+ * order by build_symbols().
+ */
+#define SYM_NOBYTE		0
+#define SYM_SEP			1
+#define SYM_MAX			47
+
+/*
+ * Octets that are not common in host names are encoded as an escape
+ * symbol followed by their position in a run of such octets, offset so
+ * that the second symbol is never NOBYTE or SEP.
+ */
+#define ESCAPE_RUN		(SYM_MAX - 2)
+
+/*
+ * A node is either a leaf or a branch.  A leaf has a zero index and
+ * points to the caller's value.  A branch has the low bit of its index
+ * set, a bitmap of the symbols present at the key offset it tests in
+ * the next SYM_MAX bits and that offset in the top 16 bits, and it
+ * points to an array of its children (twigs), one per bit set in the
+ * bitmap, in symbol order.
+ */
+struct dns_qpnode {
+	isc_uint64_t	index;
+	void *		ptr;
+};
+
+#define BRANCH_TAG		1ULL
+#define BITMAP_MASK		(((1ULL << SYM_MAX) - 1) << 1)
+#define OFFSET_SHIFT		48
+#define ISBRANCH(n)		(((n)->index & BRANCH_TAG) != 0)
+#define SYMBIT(s)		(1ULL << ((s) + 1))
+#define OFFSET(n)		((unsigned int)((n)->index >> OFFSET_SHIFT))
+#define TWIGS(n)		((dns_qpnode_t *)(n)->ptr)
+
+struct dns_qp {
+	unsigned int		magic;
+	isc_mem_t *		mctx;
+	const dns_qpmethods_t *	methods;
+	void *			ctx;
+	dns_qpnode_t		root;
+	unsigned int		leaves;
+	size_t			twigmem;
+};
+
+static isc_once_t symbols_once = ISC_ONCE_INIT;
+static isc_uint8_t symbol1[256];
+static isc_uint8_t symbol2[256];
+
+static isc_boolean_t
+common_octet(unsigned int c) {
+	return (ISC_TF(c == '-' || c == '_' ||
+		       (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')));
+}
+
+static void
+build_symbols(void) {
+	unsigned int c, sym = SYM_SEP + 1, escape = 0, run = ESCAPE_RUN;
+
+	for (c = 0; c < 256; c++) {
+		if (c >= 'A' && c <= 'Z')
+			continue;
+		if (common_octet(c)) {
+			symbol1[c] = sym++;
+			symbol2[c] = 0;
+			run = ESCAPE_RUN;
+			continue;
+		}
+		if (run == ESCAPE_RUN) {
+			escape = sym++;
+			run = 0;
+		}
+		symbol1[c] = escape;
+		symbol2[c] = SYM_SEP + 1 + run++;
+	}
+	INSIST(sym == SYM_MAX);
+
+	for (c = 'A'; c <= 'Z'; c++) {
+		symbol1[c] = symbol1[c - 'A' + 'a'];
+		symbol2[c] = symbol2[c - 'A' + 'a'];
+	}
+}
+
+unsigned int
+dns_qpkey_fromname(dns_qpkey_t key, const dns_name_t *name) {
+	unsigned char offsets[128];
+	const unsigned char *ndata, *label;
+	unsigned int i, n, nlabels, len;
+
+	REQUIRE(VALID_NAME(name));
+	REQUIRE(dns_name_isabsolute(name));
+
+	RUNTIME_CHECK(isc_once_do(&symbols_once, build_symbols)
+		      == ISC_R_SUCCESS);
+
+	ndata = name->ndata;
+	nlabels = 0;
+	for (i = 0; ndata[i] != 0; i += ndata[i] + 1)
+		offsets[nlabels++] = i;
+
+	n = 0;
+	while (nlabels-- > 0) {
+		label = ndata + offsets[nlabels];
+		len = *label++;
+		for (i = 0; i < len; i++) {
+			key[n++] = symbol1[label[i]];
+			if (symbol2[label[i]] != 0)
+				key[n++] = symbol2[label[i]];
+		}
+		key[n++] = SYM_SEP;
+	}
+	INSIST(n <= DNS_QP_MAXKEY);
+
+	return (n);
+}
+
+static inline unsigned int
+keysym(const dns_qpkey_t key, unsigned int len, unsigned int offset) {
+	return (offset < len ? key[offset] : SYM_NOBYTE);
+}
+
+/*
+ * Return the first offset at which the keys differ, or
+ * DNS_QP_MAXKEY if they are equal.
+ */
+static unsigned int
+keydiff(const dns_qpkey_t k1, unsigned int l1,
+	const dns_qpkey_t k2, unsigned int l2)
+{
+	unsigned int i, len = ISC_MIN(l1, l2);
+
+	for (i = 0; i < len; i++)
+		if (k1[i] != k2[i])
+			return (i);
+	return (l1 == l2 ? DNS_QP_MAXKEY : len);
+}
+
+static inline unsigned int
+popcount(isc_uint64_t w) {
+	w -= (w >> 1) & 0x5555555555555555ULL;
+	w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+	w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return ((unsigned int)((w * 0x0101010101010101ULL) >> 56));
+}
+
+static inline unsigned int
+twigcount(const dns_qpnode_t *n) {
+	return (popcount(n->index & BITMAP_MASK));
+}
+
+/*
+ * The position in the twig array of the twig for 'bit', or where it
+ * would go if there is none.
+ */
+static inline unsigned int
+twigpos(const dns_qpnode_t *n, isc_uint64_t bit) {
+	return (popcount(n->index & BITMAP_MASK & (bit - 1)));
+}
+
+static inline isc_uint64_t
+branchbit(const dns_qpnode_t *n, const dns_qpkey_t key, unsigned int len) {
+	return (SYMBIT(keysym(key, len, OFFSET(n))));
+}
+
+static inline isc_boolean_t
+hastwig(const dns_qpnode_t *n, isc_uint64_t bit) {
+	return (ISC_TF((n->index & bit) != 0));
+}
+
+static inline unsigned int
+leafkey(dns_qp_t *qp, const dns_qpnode_t *n, dns_qpkey_t key) {
+	return (qp->methods->makekey(key, qp->ctx, n->ptr));
+}
+
+static dns_qpnode_t *
+twigs_get(dns_qp_t *qp, unsigned int count) {
+	dns_qpnode_t *twigs;
+
+	twigs = isc_mem_get(qp->mctx, count * sizeof(*twigs));
+	if (twigs != NULL)
+		qp->twigmem += count * sizeof(*twigs);
+	return (twigs);
+}
+
+static void
+twigs_put(dns_qp_t *qp, dns_qpnode_t *twigs, unsigned int count) {
+	isc_mem_put(qp->mctx, twigs, count * sizeof(*twigs));
+	qp->twigmem -= count * sizeof(*twigs);
+}
+
+/*
+ * Descend from 'n' along 'key' as far as possible, then to any leaf.
+ * Every leaf below the last branch that matched shares its prefix
+ * with 'key' up to that branch's offset.
+ */
+static dns_qpnode_t *
+anyleaf(dns_qpnode_t *n, const dns_qpkey_t key, unsigned int len) {
+	isc_uint64_t bit;
+
+	while (ISBRANCH(n)) {
+		bit = branchbit(n, key, len);
+		if (hastwig(n, bit))
+			n = &TWIGS(n)[twigpos(n, bit)];
+		else
+			n = &TWIGS(n)[0];
+	}
+	return (n);
+}
+
+isc_result_t
+dns_qp_create(isc_mem_t *mctx, const dns_qpmethods_t *methods, void *ctx,
+	      dns_qp_t **qpp)
+{
+	dns_qp_t *qp;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(methods != NULL && methods->makekey != NULL);
+	REQUIRE(qpp != NULL && *qpp == NULL);
+
+	RUNTIME_CHECK(isc_once_do(&symbols_once, build_symbols)
+		      == ISC_R_SUCCESS);
+
+	qp = isc_mem_get(mctx, sizeof(*qp));
+	if (qp == NULL)
+		return (ISC_R_NOMEMORY);
+
+	qp->mctx = NULL;
+	isc_mem_attach(mctx, &qp->mctx);
+	qp->methods = methods;
+	qp->ctx = ctx;
+	qp->root.index = 0;
+	qp->root.ptr = NULL;
+	qp->leaves = 0;
+	qp->twigmem = 0;
+	qp->magic = QP_MAGIC;
+
+	*qpp = qp;
+	return (ISC_R_SUCCESS);
+}
+
+static void
+destroy_node(dns_qp_t *qp, dns_qpnode_t *n) {
+	unsigned int i, count;
+
+	if (!ISBRANCH(n)) {
+		if (qp->methods->destroy != NULL)
+			qp->methods->destroy(qp->ctx, n->ptr);
+		return;
+	}
+	count = twigcount(n);
+	for (i = 0; i < count; i++)
+		destroy_node(qp, &TWIGS(n)[i]);
+	twigs_put(qp, TWIGS(n), count);
+}
+
+void
+dns_qp_destroy(dns_qp_t **qpp) {
+	dns_qp_t *qp;
+
+	REQUIRE(qpp != NULL && VALID_QP(*qpp));
+
+	qp = *qpp;
+	*qpp = NULL;
+
+	if (qp->leaves != 0)
+		destroy_node(qp, &qp->root);
+	INSIST(qp->twigmem == 0);
+	qp->magic = 0;
+	isc_mem_putanddetach(&qp->mctx, qp, sizeof(*qp));
+}
+
+isc_result_t
+dns_qp_insert(dns_qp_t *qp, void *value) {
+	dns_qpkey_t newkey, oldkey;
+	unsigned int newlen, oldlen, offset, newsym, oldsym, pos, count;
+	dns_qpnode_t *n, *twigs;
+	isc_uint64_t bit;
+
+	REQUIRE(VALID_QP(qp));
+	REQUIRE(value != NULL);
+
+	newlen = qp->methods->makekey(newkey, qp->ctx, value);
+
+	if (qp->leaves == 0) {
+		qp->root.index = 0;
+		qp->root.ptr = value;
+		qp->leaves = 1;
+		return (ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Find where the new key differs from the keys already in
+	 * the trie.
+	 */
+	n = anyleaf(&qp->root, newkey, newlen);
+	oldlen = leafkey(qp, n, oldkey);
+	offset = keydiff(newkey, newlen, oldkey, oldlen);
+	if (offset == DNS_QP_MAXKEY)
+		return (ISC_R_EXISTS);
+	newsym = keysym(newkey, newlen, offset);
+	oldsym = keysym(oldkey, oldlen, offset);
+
+	/*
+	 * Find the node the new leaf goes beside: either a branch at
+	 * that offset, or the first node below it.
+	 */
+	n = &qp->root;
+	while (ISBRANCH(n) && OFFSET(n) < offset) {
+		bit = branchbit(n, newkey, newlen);
+		INSIST(hastwig(n, bit));
+		n = &TWIGS(n)[twigpos(n, bit)];
+	}
+
+	if (ISBRANCH(n) && OFFSET(n) == offset) {
+		bit = SYMBIT(newsym);
+		INSIST(!hastwig(n, bit));
+		count = twigcount(n);
+		pos = twigpos(n, bit);
+		twigs = twigs_get(qp, count + 1);
+		if (twigs == NULL)
+			return (ISC_R_NOMEMORY);
+		memmove(twigs, TWIGS(n), pos * sizeof(*twigs));
+		twigs[pos].index = 0;
+		twigs[pos].ptr = value;
+		memmove(twigs + pos + 1, TWIGS(n) + pos,
+			(count - pos) * sizeof(*twigs));
+		twigs_put(qp, TWIGS(n), count);
+		n->ptr = twigs;
+		n->index |= bit;
+	} else {
+		twigs = twigs_get(qp, 2);
+		if (twigs == NULL)
+			return (ISC_R_NOMEMORY);
+		pos = (newsym < oldsym) ? 0 : 1;
+		twigs[pos].index = 0;
+		twigs[pos].ptr = value;
+		twigs[1 - pos] = *n;
+		n->index = BRANCH_TAG | SYMBIT(newsym) | SYMBIT(oldsym) |
+			   ((isc_uint64_t)offset << OFFSET_SHIFT);
+		n->ptr = twigs;
+	}
+
+	qp->leaves++;
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+dns_qp_getname(dns_qp_t *qp, const dns_name_t *name, void **valuep) {
+	dns_qpkey_t key, leaf;
+	unsigned int len, leaflen;
+	dns_qpnode_t *n;
+	isc_uint64_t bit;
+
+	REQUIRE(VALID_QP(qp));
+	REQUIRE(valuep != NULL && *valuep == NULL);
+
+	if (qp->leaves == 0)
+		return (ISC_R_NOTFOUND);
+
+	len = dns_qpkey_fromname(key, name);
+	n = &qp->root;
+	while (ISBRANCH(n)) {
+		bit = branchbit(n, key, len);
+		if (!hastwig(n, bit))
+			return (ISC_R_NOTFOUND);
+		n = &TWIGS(n)[twigpos(n, bit)];
+	}
+
+	leaflen = leafkey(qp, n, leaf);
+	if (keydiff(key, len, leaf, leaflen) != DNS_QP_MAXKEY)
+		return (ISC_R_NOTFOUND);
+
+	*valuep = n->ptr;
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+dns_qp_deletename(dns_qp_t *qp, const dns_name_t *name, void **valuep) {
+	dns_qpkey_t key, leaf;
+	unsigned int len, leaflen, count, pos;
+	dns_qpnode_t *n, *parent = NULL, *twigs;
+	isc_uint64_t bit, parentbit = 0;
+	void *value;
+
+	REQUIRE(VALID_QP(qp));
+
+	if (qp->leaves == 0)
+		return (ISC_R_NOTFOUND);
+
+	len = dns_qpkey_fromname(key, name);
+	n = &qp->root;
+	while (ISBRANCH(n)) {
+		bit = branchbit(n, key, len);
+		if (!hastwig(n, bit))
+			return (ISC_R_NOTFOUND);
+		parent = n;
+		parentbit = bit;
+		n = &TWIGS(n)[twigpos(n, bit)];
+	}
+
+	leaflen = leafkey(qp, n, leaf);
+	if (keydiff(key, len, leaf, leaflen) != DNS_QP_MAXKEY)
+		return (ISC_R_NOTFOUND);
+
+	value = n->ptr;
+	if (parent == NULL) {
+		qp->root.index = 0;
+		qp->root.ptr = NULL;
+	} else if (twigcount(parent) == 2) {
+		/*
+		 * The branch is no longer needed; its remaining twig
+		 * takes its place.
+		 */
+		twigs = TWIGS(parent);
+		pos = twigpos(parent, parentbit);
+		*parent = twigs[1 - pos];
+		twigs_put(qp, twigs, 2);
+	} else {
+		count = twigcount(parent);
+		pos = twigpos(parent, parentbit);
+		twigs = twigs_get(qp, count - 1);
+		if (twigs == NULL)
+			return (ISC_R_NOMEMORY);
+		memmove(twigs, TWIGS(parent), pos * sizeof(*twigs));
+		memmove(twigs + pos, TWIGS(parent) + pos + 1,
+			(count - pos - 1) * sizeof(*twigs));
+		twigs_put(qp, TWIGS(parent), count);
+		parent->ptr = twigs;
+		parent->index &= ~parentbit;
+	}
+
+	if (valuep != NULL)
+		*valuep = value;
+	qp->leaves--;
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+dns_qp_findname_ancestor(dns_qp_t *qp, const dns_name_t *name,
+			 void **valuep, dns_qpchain_t *chain)
+{
+	dns_qpkey_t key, leaf;
+	unsigned int len, leaflen, prefix, i, found = 0;
+	unsigned int offsets[DNS_QP_MAXCHAIN];
+	void *values[DNS_QP_MAXCHAIN];
+	dns_qpnode_t *n;
+	isc_uint64_t bit;
+
+	REQUIRE(VALID_QP(qp));
+	REQUIRE(valuep != NULL && *valuep == NULL);
+
+	if (chain != NULL)
+		chain->length = 0;
+	if (qp->leaves == 0)
+		return (ISC_R_NOTFOUND);
+
+	/*
+	 * The key of each ancestor of 'name' is a prefix of its key, so
+	 * an ancestor in the trie hangs off the NOBYTE twig of a branch
+	 * at the offset where the ancestor's key ends.  Collect those
+	 * leaves on the way down; which of them really are ancestors is
+	 * decided once we know how much of the key matched.
+	 */
+	len = dns_qpkey_fromname(key, name);
+	n = &qp->root;
+	while (ISBRANCH(n)) {
+		if (OFFSET(n) < len && hastwig(n, SYMBIT(SYM_NOBYTE))) {
+			INSIST(!ISBRANCH(&TWIGS(n)[0]));
+			INSIST(found < DNS_QP_MAXCHAIN);
+			offsets[found] = OFFSET(n);
+			values[found] = TWIGS(n)[0].ptr;
+			found++;
+		}
+		bit = branchbit(n, key, len);
+		if (!hastwig(n, bit)) {
+			n = anyleaf(n, key, len);
+			break;
+		}
+		n = &TWIGS(n)[twigpos(n, bit)];
+	}
+
+	leaflen = leafkey(qp, n, leaf);
+	prefix = keydiff(key, len, leaf, leaflen);
+
+	/*
+	 * An ancestor with no descendants in the trie is the leaf itself.
+	 */
+	if (prefix == leaflen && leaflen < len) {
+		INSIST(found < DNS_QP_MAXCHAIN);
+		offsets[found] = leaflen;
+		values[found] = n->ptr;
+		found++;
+	}
+
+	if (chain != NULL) {
+		for (i = 0; i < found && offsets[i] <= prefix; i++)
+			chain->values[i] = values[i];
+		chain->length = i;
+	}
+
+	if (prefix == DNS_QP_MAXKEY) {
+		*valuep = n->ptr;
+		return (ISC_R_SUCCESS);
+	}
+
+	while (found > 0 && offsets[found - 1] > prefix)
+		found--;
+	if (found == 0)
+		return (ISC_R_NOTFOUND);
+	*valuep = values[found - 1];
+	return (DNS_R_PARTIALMATCH);
+}
+
+unsigned int
+dns_qp_count(dns_qp_t *qp) {
+	REQUIRE(VALID_QP(qp));
+
+	return (qp->leaves);
+}
+
+size_t
+dns_qp_memusage(dns_qp_t *qp) {
+	REQUIRE(VALID_QP(qp));
+
+	return (sizeof(*qp) + qp->twigmem);
+}
+
+/*
+ * Iterators keep the path from the root to the current leaf as a stack
+ * of branches and the twig taken at each.  When the root is itself a
+ * leaf, the stack has a single entry with no branch.
+ */
+
+static inline dns_qpnode_t *
+iter_leaf(dns_qpiter_t *it) {
+	if (it->stack[it->sp].branch == NULL)
+		return (&it->qp->root);
+	return (&TWIGS(it->stack[it->sp].branch)[it->stack[it->sp].twig]);
+}
+
+static inline void
+iter_push(dns_qpiter_t *it, dns_qpnode_t *branch, unsigned int twig) {
+	it->sp++;
+	INSIST(it->sp <= DNS_QP_MAXKEY);
+	it->stack[it->sp].branch = branch;
+	it->stack[it->sp].twig = twig;
+}
+
+/*
+ * Descend from 'n', which is the root or the current twig of the top
+ * of the stack, to its first or last leaf.
+ */
+static void
+iter_descend(dns_qpiter_t *it, dns_qpnode_t *n, isc_boolean_t last) {
+	unsigned int twig;
+
+	if (!ISBRANCH(n) && it->sp < 0) {
+		iter_push(it, NULL, 0);
+		return;
+	}
+	while (ISBRANCH(n)) {
+		twig = last ? twigcount(n) - 1 : 0;
+		iter_push(it, n, twig);
+		n = &TWIGS(n)[twig];
+	}
+}
+
+static isc_result_t
+iter_result(dns_qpiter_t *it, void **valuep) {
+	if (valuep != NULL)
+		*valuep = iter_leaf(it)->ptr;
+	return (ISC_R_SUCCESS);
+}
+
+void
+dns_qpiter_init(dns_qp_t *qp, dns_qpiter_t *it) {
+	REQUIRE(VALID_QP(qp));
+	REQUIRE(it != NULL);
+
+	it->qp = qp;
+	it->sp = -1;
+	it->magic = QPITER_MAGIC;
+}
+
+static isc_result_t
+iter_end(dns_qpiter_t *it, isc_boolean_t last, void **valuep) {
+	it->sp = -1;
+	if (it->qp->leaves == 0)
+		return (ISC_R_NOMORE);
+	iter_descend(it, &it->qp->root, last);
+	return (iter_result(it, valuep));
+}
+
+isc_result_t
+dns_qpiter_first(dns_qpiter_t *it, void **valuep) {
+	REQUIRE(VALID_QPITER(it));
+
+	return (iter_end(it, ISC_FALSE, valuep));
+}
+
+isc_result_t
+dns_qpiter_last(dns_qpiter_t *it, void **valuep) {
+	REQUIRE(VALID_QPITER(it));
+
+	return (iter_end(it, ISC_TRUE, valuep));
+}
+
+static isc_result_t
+iter_step(dns_qpiter_t *it, isc_boolean_t forward, void **valuep) {
+	dns_qpnode_t *branch;
+	unsigned int twig;
+
+	if (it->sp < 0)
+		return (iter_end(it, ISC_TF(!forward), valuep));
+
+	while (it->sp >= 0) {
+		branch = it->stack[it->sp].branch;
+		if (branch == NULL)
+			break;
+		twig = it->stack[it->sp].twig;
+		if (forward ? twig + 1 < twigcount(branch) : twig > 0) {
+			twig = forward ? twig + 1 : twig - 1;
+			it->stack[it->sp].twig = twig;
+			iter_descend(it, &TWIGS(branch)[twig],
+				     ISC_TF(!forward));
+			return (iter_result(it, valuep));
+		}
+		it->sp--;
+	}
+
+	it->sp = -1;
+	return (ISC_R_NOMORE);
+}
+
+isc_result_t
+dns_qpiter_next(dns_qpiter_t *it, void **valuep) {
+	REQUIRE(VALID_QPITER(it));
+
+	return (iter_step(it, ISC_TRUE, valuep));
+}
+
+isc_result_t
+dns_qpiter_prev(dns_qpiter_t *it, void **valuep) {
+	REQUIRE(VALID_QPITER(it));
+
+	return (iter_step(it, ISC_FALSE, valuep));
+}
+
+isc_result_t
+dns_qpiter_seek(dns_qpiter_t *it, const dns_name_t *name, void **valuep) {
+	dns_qpkey_t key, leaf;
+	unsigned int len, leaflen, offset, sym;
+	dns_qp_t *qp;
+	dns_qpnode_t *n;
+	isc_uint64_t bit;
+	unsigned int pos;
+	isc_result_t result;
+
+	REQUIRE(VALID_QPITER(it));
+
+	qp = it->qp;
+	it->sp = -1;
+	if (qp->leaves == 0)
+		return (ISC_R_NOTFOUND);
+
+	len = dns_qpkey_fromname(key, name);
+	n = anyleaf(&qp->root, key, len);
+	leaflen = leafkey(qp, n, leaf);
+	offset = keydiff(key, len, leaf, leaflen);
+
+	/*
+	 * Walk down to where the key diverges from the trie, recording
+	 * the path.
+	 */
+	n = &qp->root;
+	while (ISBRANCH(n) && OFFSET(n) < offset) {
+		bit = branchbit(n, key, len);
+		INSIST(hastwig(n, bit));
+		pos = twigpos(n, bit);
+		iter_push(it, n, pos);
+		n = &TWIGS(n)[pos];
+	}
+
+	if (offset == DNS_QP_MAXKEY) {
+		INSIST(!ISBRANCH(n));
+		if (it->sp < 0)
+			iter_push(it, NULL, 0);
+		return (iter_result(it, valuep));
+	}
+
+	sym = keysym(key, len, offset);
+	if (ISBRANCH(n) && OFFSET(n) == offset) {
+		/*
+		 * 'n' has twigs on both sides of the key; the predecessor
+		 * is the last leaf of the twig before where the key's
+		 * twig would be.
+		 */
+		pos = twigpos(n, SYMBIT(sym));
+		if (pos > 0) {
+			iter_push(it, n, pos - 1);
+			iter_descend(it, &TWIGS(n)[pos - 1], ISC_TRUE);
+			(void)iter_result(it, valuep);
+			return (DNS_R_PARTIALMATCH);
+		}
+		iter_push(it, n, 0);
+		iter_descend(it, &TWIGS(n)[0], ISC_FALSE);
+	} else if (sym > keysym(leaf, leaflen, offset)) {
+		/*
+		 * Every key below 'n' sorts before the key.
+		 */
+		iter_descend(it, n, ISC_TRUE);
+		(void)iter_result(it, valuep);
+		return (DNS_R_PARTIALMATCH);
+	} else
+		iter_descend(it, n, ISC_FALSE);
+
+	/*
+	 * We are at the first leaf after the key.
+	 */
+	result = iter_step(it, ISC_FALSE, valuep);
+	if (result == ISC_R_NOMORE)
+		return (ISC_R_NOTFOUND);
+	return (DNS_R_PARTIALMATCH);
+}
@@ -0,0 +1,6210 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * \brief
+ * A zone and cache database built on the qp-trie in qp.c.
+ *
+ * The data model is the one rbtdb.c uses for zones: each node holds a
+ * list of rdataset headers, one per type, each followed by a list of
+ * older versions of the rdataset, and every header is immediately
+ * followed by its rdataslab.  What differs is the index: the names are
+ * kept in two qp-tries (one for the zone's names and one for its NSEC3
+ * names) which are ordered canonically, so there is no separate NSEC
+ * tree, no per-level node bookkeeping and no node chain.  Each node
+ * carries its owner name in wire format right after the node itself.
+ *
+ * A single read/write lock protects the tries, the nodes, the headers,
+ * the versions and the heap.  Lookups only take it for reading; a node
+ * which loses its last reference while it still needs cleaning is
+ * cleaned at once if the lock can be upgraded and is otherwise put on a
+ * list which is swept whenever the lock is next held for writing.
+ *
+ * A cache uses the same nodes and headers without versions, and keeps
+ * all its names, NSEC3 owners included, in the main trie.  Its heap
+ * orders the headers by expiry time instead of re-signing time, and all
+ * the headers are also on one LRU list, which is trimmed from the tail
+ * when the memory context is over its high water mark.  Expired headers
+ * are marked ANCIENT and freed once nobody can see them; a lookup which
+ * finds one long expired upgrades the tree lock to free it if it can.
+ * Cache lookups move the headers they return to the head of the LRU
+ * list under a separate mutex, since they only hold the tree lock for
+ * reading.
+ */
+
+#include <config.h>
+
+#include <isc/heap.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/print.h>
+#include <isc/random.h>
+#include <isc/refcount.h>
+#include <isc/rwlock.h>
+#include <isc/stats.h>
+#include <isc/stdtime.h>
+#include <isc/string.h>
+#include <isc/task.h>
+#include <isc/util.h>
+
+#include <dns/callbacks.h>
+#include <dns/db.h>
+#include <dns/dbiterator.h>
+#include <dns/fixedname.h>
+#include <dns/log.h>
+#include <dns/masterdump.h>
+#include <dns/nsec3.h>
+#include <dns/qp.h>
+#include <dns/rdata.h>
+#include <dns/rdataset.h>
+#include <dns/rdatasetiter.h>
+#include <dns/rdataslab.h>
+#include <dns/rdatastruct.h>
+#include <dns/result.h>
+#include <dns/stats.h>
+#include <dns/time.h>
+#include <dns/zonekey.h>
+
+#include "qpdb.h"
+#include "slabdb_p.h"
+
+#define QPDB_MAGIC			ISC_MAGIC('Q', 'P', 'D', 'B')
+#define VALID_QPDB(qpdb)		((qpdb) != NULL && \
+					 (qpdb)->common.impmagic == QPDB_MAGIC)
+
+typedef isc_uint32_t			qpdb_serial_t;
+typedef isc_uint32_t			qpdb_rdatatype_t;
+
+#define QPDB_RDATATYPE_BASE(type)	((dns_rdatatype_t)((type) & 0xFFFF))
+#define QPDB_RDATATYPE_EXT(type)	((dns_rdatatype_t)((type) >> 16))
+#define QPDB_RDATATYPE_VALUE(base, ext) \
+	((qpdb_rdatatype_t)(((isc_uint32_t)ext) << 16) | \
+	 (((isc_uint32_t)base) & 0xffff))
+
+#define QPDB_RDATATYPE_SIGNSEC \
+		QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, dns_rdatatype_nsec)
+#define QPDB_RDATATYPE_SIGNSEC3 \
+		QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, dns_rdatatype_nsec3)
+#define QPDB_RDATATYPE_SIGCNAME \
+		QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, dns_rdatatype_cname)
+#define QPDB_RDATATYPE_SIGDNAME \
+		QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, dns_rdatatype_dname)
+#define QPDB_RDATATYPE_SIGNS \
+		QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, dns_rdatatype_ns)
+#define QPDB_RDATATYPE_SIGDDS \
+		QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, dns_rdatatype_ds)
+#define QPDB_RDATATYPE_NCACHEANY \
+		QPDB_RDATATYPE_VALUE(0, dns_rdatatype_any)
+
+typedef struct qpdb_node qpdb_node_t;
+
+typedef struct rdatasetheader {
+	qpdb_serial_t			serial;
+	dns_ttl_t			rdh_ttl;
+	qpdb_rdatatype_t		type;
+	isc_uint16_t			attributes;
+	dns_trust_t			trust;
+	isc_uint32_t			count;
+	isc_stdtime_t			resign;
+	unsigned int			resign_lsb : 1;
+	unsigned int			heap_index;
+	/*%<
+	 * Index in the re-signing heap (or in a cache, the TTL heap), or
+	 * 0 if the header is not in it.
+	 */
+	struct rdatasetheader		*next;
+	/*%<
+	 * The header of the next type at the node.  Only meaningful for
+	 * the newest header of each type.
+	 */
+	struct rdatasetheader		*down;
+	/*%<
+	 * The next older version of this type.
+	 */
+	qpdb_node_t			*node;
+	ISC_LINK(struct rdatasetheader)	link;
+	/*%<
+	 * Used for the re-signed list of a version, or in a cache for the
+	 * LRU list.
+	 */
+	isc_stdtime_t			last_used;
+	slabdb_proof_t			*noqname;
+	slabdb_proof_t			*closest;
+	unsigned char			upper[DNS_SLABDB_CASEBYTES];
+	/*%<
+	 * The case of the owner name, set by dns_rdataset_setownercase().
+	 */
+} rdatasetheader_t;
+
+typedef ISC_LIST(rdatasetheader_t)	rdatasetheaderlist_t;
+
+#define RDATASET_ATTR_NONEXISTENT	0x0001
+#define RDATASET_ATTR_IGNORE		0x0002
+#define RDATASET_ATTR_RESIGN		0x0004
+#define RDATASET_ATTR_STALE		0x0008
+#define RDATASET_ATTR_ANCIENT		0x0010
+#define RDATASET_ATTR_NEGATIVE		0x0020
+#define RDATASET_ATTR_NXDOMAIN		0x0040
+#define RDATASET_ATTR_OPTOUT		0x0080
+#define RDATASET_ATTR_PREFETCH		0x0100
+#define RDATASET_ATTR_ZEROTTL		0x0200
+#define RDATASET_ATTR_STATCOUNT		0x0400
+#define RDATASET_ATTR_CASESET		0x0800
+#define RDATASET_ATTR_CASEFULLYLOWER	0x1000
+
+#define EXISTS(header) \
+	(((header)->attributes & RDATASET_ATTR_NONEXISTENT) == 0)
+#define NONEXISTENT(header) \
+	(((header)->attributes & RDATASET_ATTR_NONEXISTENT) != 0)
+#define IGNORE(header) \
+	(((header)->attributes & RDATASET_ATTR_IGNORE) != 0)
+#define RESIGN(header) \
+	(((header)->attributes & RDATASET_ATTR_RESIGN) != 0)
+#define STALE(header) \
+	(((header)->attributes & RDATASET_ATTR_STALE) != 0)
+#define ANCIENT(header) \
+	(((header)->attributes & RDATASET_ATTR_ANCIENT) != 0)
+#define NEGATIVE(header) \
+	(((header)->attributes & RDATASET_ATTR_NEGATIVE) != 0)
+#define NXDOMAIN(header) \
+	(((header)->attributes & RDATASET_ATTR_NXDOMAIN) != 0)
+#define OPTOUT(header) \
+	(((header)->attributes & RDATASET_ATTR_OPTOUT) != 0)
+#define PREFETCH(header) \
+	(((header)->attributes & RDATASET_ATTR_PREFETCH) != 0)
+#define ZEROTTL(header) \
+	(((header)->attributes & RDATASET_ATTR_ZEROTTL) != 0)
+#define STATCOUNT(header) \
+	(((header)->attributes & RDATASET_ATTR_STATCOUNT) != 0)
+#define CASESET(header) \
+	(((header)->attributes & RDATASET_ATTR_CASESET) != 0)
+#define CASEFULLYLOWER(header) \
+	(((header)->attributes & RDATASET_ATTR_CASEFULLYLOWER) != 0)
+
+/*%
+ * Whether a cached rdataset may still be returned at 'now'.  An
+ * rdataset with a zero TTL is usable for the second it was added in.
+ */
+#define ACTIVE(header, now) \
+	(((header)->rdh_ttl > (now)) || \
+	 ((header)->rdh_ttl == (now) && ZEROTTL(header)))
+
+/*%
+ * How long an expired cache rdataset is kept in case a node reference
+ * taken before it expired still needs it.
+ */
+#define QPDB_VIRTUAL			300
+
+/*%
+ * The most nodes find_coveringnsec3() looks at before giving up.
+ */
+#define QPDB_NSEC3_MAXSTEPS		16
+
+struct qpdb_node {
+	isc_refcount_t			references;
+	rdatasetheader_t		*data;
+	ISC_LINK(qpdb_node_t)		deadlink;
+	unsigned int			nsec3 : 1;
+	unsigned int			delegating : 1;
+	unsigned int			dirty : 1;
+	unsigned int			namelen : 8;
+	/* The owner name in wire format follows. */
+};
+
+#define NODENAME(node)		((unsigned char *)((node) + 1))
+
+typedef struct qpdb_changed {
+	qpdb_node_t			*node;
+	isc_boolean_t			dirty;
+	ISC_LINK(struct qpdb_changed)	link;
+} qpdb_changed_t;
+
+typedef ISC_LIST(qpdb_changed_t)	qpdb_changedlist_t;
+
+typedef struct qpdb_version {
+	/* Not locked */
+	qpdb_serial_t			serial;
+	struct dns_qpdb			*qpdb;
+	/*
+	 * Protected in the refcount routines.
+	 */
+	isc_refcount_t			references;
+	/* Locked by the database lock. */
+	isc_boolean_t			writer;
+	isc_boolean_t			commit_ok;
+	qpdb_changedlist_t		changed_list;
+	rdatasetheaderlist_t		resigned_list;
+	ISC_LINK(struct qpdb_version)	link;
+	dns_db_secure_t			secure;
+	isc_boolean_t			havensec3;
+	slabdb_nsec3params_t		nsec3params;
+	isc_uint64_t			records;
+	isc_uint64_t			bytes;
+} qpdb_version_t;
+
+typedef ISC_LIST(qpdb_version_t)	qpdb_versionlist_t;
+
+typedef struct dns_qpdb {
+	/* Unlocked. */
+	dns_db_t			common;
+	/* Locks the tries, the nodes, the versions and the heap. */
+	isc_rwlock_t			tree_lock;
+	/* Locks the dead node list. */
+	isc_mutex_t			dead_lock;
+	ISC_LIST(qpdb_node_t)		deadnodes;
+	isc_refcount_t			references;
+	/* Locked by tree_lock. */
+	unsigned int			attributes;
+	qpdb_serial_t			current_serial;
+	qpdb_serial_t			least_serial;
+	qpdb_serial_t			next_serial;
+	qpdb_version_t			*current_version;
+	qpdb_version_t			*future_version;
+	qpdb_versionlist_t		open_versions;
+	isc_task_t			*task;
+	isc_heap_t			*heap;
+	/*%<
+	 * The re-signing heap of a zone, or the TTL heap of a cache.
+	 */
+	rdatasetheaderlist_t		lru;
+	/*%<
+	 * The headers of a cache, most recently used first.  Only locked
+	 * by tree_lock when the lock is held for writing; lookups holding
+	 * it for reading also take lru_lock.
+	 */
+	unsigned int			generation;
+	/*%<
+	 * Incremented whenever a node is added to or removed from a
+	 * trie, which invalidates qp-trie iterators.
+	 */
+	dns_qp_t			*tree;
+	dns_qp_t			*nsec3;
+	qpdb_node_t			*origin_node;
+	qpdb_node_t			*nsec3_origin_node;
+	/* Locks the LRU list and the stale marks for readers. */
+	isc_mutex_t			lru_lock;
+	/* Unlocked. */
+	isc_mem_t			*hmctx;
+	isc_stats_t			*cachestats;
+	dns_stats_t			*rrsetstats;
+	dns_ttl_t			serve_stale_ttl;
+	isc_stdtime_t			loadtime;
+} dns_qpdb_t;
+
+#define QPDB_ATTR_LOADED		0x01
+#define QPDB_ATTR_LOADING		0x02
+
+#define IS_STUB(qpdb)	(((qpdb)->common.attributes & DNS_DBATTR_STUB) != 0)
+#define IS_CACHE(qpdb)	(((qpdb)->common.attributes & DNS_DBATTR_CACHE) != 0)
+#define KEEPSTALE(qpdb)	((qpdb)->serve_stale_ttl > 0)
+
+/*%
+ * Search Context
+ */
+typedef struct {
+	dns_qpdb_t			*qpdb;
+	qpdb_version_t			*version;
+	qpdb_serial_t			serial;
+	unsigned int			options;
+	dns_qp_t			*tree;
+	qpdb_node_t			*zonecut;
+	rdatasetheader_t		*zonecut_rdataset;
+	rdatasetheader_t		*zonecut_sigrdataset;
+	dns_fixedname_t			zonecut_name;
+	isc_stdtime_t			now;
+	isc_rwlocktype_t		locktype;
+	/*%<
+	 * How the tree lock is held.  A cache lookup which finds long
+	 * expired rdatasets upgrades it to free them if it can.
+	 */
+} qpdb_search_t;
+
+static void rdataset_settrust(dns_rdataset_t *rdataset, dns_trust_t trust);
+static void rdataset_expire(dns_rdataset_t *rdataset);
+static void rdataset_clearprefetch(dns_rdataset_t *rdataset);
+static void rdataset_setownercase(dns_rdataset_t *rdataset,
+				  const dns_name_t *name);
+static void rdataset_getownercase(const dns_rdataset_t *rdataset,
+				  dns_name_t *name);
+
+static dns_rdatasetmethods_t rdataset_methods = {
+	dns__slabdb_disassociate,
+	dns__slabdb_first,
+	dns__slabdb_next,
+	dns__slabdb_current,
+	dns__slabdb_clone,
+	dns__slabdb_count,
+	NULL,			/* addnoqname */
+	dns__slabdb_getnoqname,
+	NULL,			/* addclosest */
+	dns__slabdb_getclosest,
+	rdataset_settrust,
+	rdataset_expire,
+	rdataset_clearprefetch,
+	rdataset_setownercase,
+	rdataset_getownercase,
+	NULL			/* addglue */
+};
+
+static void rdatasetiter_destroy(dns_rdatasetiter_t **iteratorp);
+static isc_result_t rdatasetiter_first(dns_rdatasetiter_t *iterator);
+static isc_result_t rdatasetiter_next(dns_rdatasetiter_t *iterator);
+static void rdatasetiter_current(dns_rdatasetiter_t *iterator,
+				 dns_rdataset_t *rdataset);
+
+static dns_rdatasetitermethods_t rdatasetiter_methods = {
+	rdatasetiter_destroy,
+	rdatasetiter_first,
+	rdatasetiter_next,
+	rdatasetiter_current
+};
+
+typedef struct qpdb_rdatasetiter {
+	dns_rdatasetiter_t		common;
+	rdatasetheader_t		*current;
+} qpdb_rdatasetiter_t;
+
+static void dbiterator_destroy(dns_dbiterator_t **iteratorp);
+static isc_result_t dbiterator_first(dns_dbiterator_t *iterator);
+static isc_result_t dbiterator_last(dns_dbiterator_t *iterator);
+static isc_result_t dbiterator_seek(dns_dbiterator_t *iterator,
+				    const dns_name_t *name);
+static isc_result_t dbiterator_prev(dns_dbiterator_t *iterator);
+static isc_result_t dbiterator_next(dns_dbiterator_t *iterator);
+static isc_result_t dbiterator_current(dns_dbiterator_t *iterator,
+				       dns_dbnode_t **nodep,
+				       dns_name_t *name);
+static isc_result_t dbiterator_pause(dns_dbiterator_t *iterator);
+static isc_result_t dbiterator_origin(dns_dbiterator_t *iterator,
+				      dns_name_t *name);
+
+static dns_dbiteratormethods_t dbiterator_methods = {
+	dbiterator_destroy,
+	dbiterator_first,
+	dbiterator_last,
+	dbiterator_seek,
+	dbiterator_prev,
+	dbiterator_next,
+	dbiterator_current,
+	dbiterator_pause,
+	dbiterator_origin
+};
+
+/*
+ * The iterator does not keep the tree locked between calls.  It holds
+ * a reference to its current node instead, and if the trie has changed
+ * since the last call it finds its place again by the node's name.
+ */
+typedef struct qpdb_dbiterator {
+	dns_dbiterator_t		common;
+	isc_boolean_t			nsec3only;
+	isc_boolean_t			nonsec3;
+	isc_result_t			result;
+	dns_qp_t			*tree;
+	qpdb_node_t			*node;
+	unsigned int			generation;
+	dns_qpiter_t			iter;
+} qpdb_dbiterator_t;
+
+static void free_qpdb(dns_qpdb_t *qpdb);
+static void iszonesecure(dns_db_t *db, qpdb_version_t *version,
+			 dns_dbnode_t *origin);
+
+/*%
+ * 'init_count' is used to initialize 'newheader->count' which in turn
+ * is used to determine where in the cycle rrset-order cyclic starts.
+ * We don't lock this as we don't care about simultaneous updates.
+ */
+static unsigned int init_count;
+
+/*
+ * Node names and the qp-trie methods.
+ */
+
+static inline void
+nodename(qpdb_node_t *node, dns_name_t *name) {
+	isc_region_t r;
+
+	r.base = NODENAME(node);
+	r.length = node->namelen;
+	dns_name_fromregion(name, &r);
+}
+
+static unsigned int
+qp_makekey(dns_qpkey_t key, void *ctx, void *value) {
+	qpdb_node_t *node = value;
+	dns_name_t name;
+	dns_offsets_t offsets;
+
+	UNUSED(ctx);
+
+	dns_name_init(&name, offsets);
+	nodename(node, &name);
+	return (dns_qpkey_fromname(key, &name));
+}
+
+static void free_node(dns_qpdb_t *qpdb, qpdb_node_t *node);
+
+static void
+qp_destroy(void *ctx, void *value) {
+	free_node(ctx, value);
+}
+
+static dns_qpmethods_t qpmethods = {
+	qp_makekey,
+	qp_destroy
+};
+
+/*
+ * Headers.
+ */
+
+static isc_boolean_t
+resign_sooner(void *v1, void *v2) {
+	rdatasetheader_t *h1 = v1;
+	rdatasetheader_t *h2 = v2;
+
+	return (ISC_TF(h1->resign < h2->resign ||
+		       (h1->resign == h2->resign &&
+			h1->resign_lsb < h2->resign_lsb)));
+}
+
+static isc_boolean_t
+ttl_sooner(void *v1, void *v2) {
+	rdatasetheader_t *h1 = v1;
+	rdatasetheader_t *h2 = v2;
+
+	return (ISC_TF(h1->rdh_ttl < h2->rdh_ttl));
+}
+
+/*%
+ * This function sets the heap index into the header.
+ */
+static void
+set_index(void *what, unsigned int idx) {
+	rdatasetheader_t *h = what;
+
+	h->heap_index = idx;
+}
+
+static inline void
+init_rdataset(rdatasetheader_t *h) {
+	ISC_LINK_INIT(h, link);
+	h->heap_index = 0;
+	h->next = NULL;
+	h->down = NULL;
+	h->noqname = NULL;
+	h->closest = NULL;
+}
+
+static inline rdatasetheader_t *
+new_rdataset(dns_qpdb_t *qpdb, qpdb_node_t *node, qpdb_rdatatype_t type,
+	     qpdb_serial_t serial)
+{
+	rdatasetheader_t *h;
+
+	h = isc_mem_get(qpdb->common.mctx, sizeof(*h));
+	if (h == NULL)
+		return (NULL);
+	init_rdataset(h);
+	h->rdh_ttl = 0;
+	h->type = type;
+	h->attributes = RDATASET_ATTR_NONEXISTENT;
+	h->trust = 0;
+	h->serial = serial;
+	h->count = 0;
+	h->node = node;
+	h->resign = 0;
+	h->resign_lsb = 0;
+	h->last_used = 0;
+	return (h);
+}
+
+static void
+update_rrsetstats(dns_qpdb_t *qpdb, rdatasetheader_t *header,
+		  isc_boolean_t increment)
+{
+	dns_rdatastatstype_t statattributes = 0;
+	dns_rdatastatstype_t base = 0;
+	dns_rdatastatstype_t type;
+
+	/* At the moment we count statistics only for cache DB */
+	INSIST(IS_CACHE(qpdb));
+
+	if (NEGATIVE(header)) {
+		if (NXDOMAIN(header))
+			statattributes = DNS_RDATASTATSTYPE_ATTR_NXDOMAIN;
+		else {
+			statattributes = DNS_RDATASTATSTYPE_ATTR_NXRRSET;
+			base = QPDB_RDATATYPE_EXT(header->type);
+		}
+	} else
+		base = QPDB_RDATATYPE_BASE(header->type);
+
+	if (STALE(header))
+		statattributes |= DNS_RDATASTATSTYPE_ATTR_STALE;
+
+	type = DNS_RDATASTATSTYPE_VALUE(base, statattributes);
+	if (increment)
+		dns_rdatasetstats_increment(qpdb->rrsetstats, type);
+	else
+		dns_rdatasetstats_decrement(qpdb->rrsetstats, type);
+}
+
+static inline void
+free_rdataset(dns_qpdb_t *qpdb, rdatasetheader_t *rdataset) {
+	unsigned int size;
+
+	if (EXISTS(rdataset) && STATCOUNT(rdataset))
+		update_rrsetstats(qpdb, rdataset, ISC_FALSE);
+
+	if (ISC_LINK_LINKED(rdataset, link)) {
+		INSIST(IS_CACHE(qpdb));
+		ISC_LIST_UNLINK(qpdb->lru, rdataset, link);
+	}
+
+	if (rdataset->heap_index != 0)
+		isc_heap_delete(qpdb->heap, rdataset->heap_index);
+	rdataset->heap_index = 0;
+
+	if (rdataset->noqname != NULL)
+		dns__slabdb_freeproof(qpdb->common.mctx, &rdataset->noqname);
+	if (rdataset->closest != NULL)
+		dns__slabdb_freeproof(qpdb->common.mctx, &rdataset->closest);
+
+	if (NONEXISTENT(rdataset))
+		size = sizeof(*rdataset);
+	else
+		size = dns_rdataslab_size((unsigned char *)rdataset,
+					  sizeof(*rdataset));
+	isc_mem_put(qpdb->common.mctx, rdataset, size);
+}
+
+/*%
+ * Return the version of the rdataset 'header' heads that is active in
+ * 'serial', or NULL if there is none or it is a "this rdataset doesn't
+ * exist" record.
+ */
+static inline rdatasetheader_t *
+active_header(rdatasetheader_t *header, qpdb_serial_t serial) {
+	do {
+		if (header->serial <= serial && !IGNORE(header)) {
+			if (NONEXISTENT(header))
+				header = NULL;
+			break;
+		}
+		header = header->down;
+	} while (header != NULL);
+
+	return (header);
+}
+
+static inline isc_boolean_t
+node_active(qpdb_node_t *node, qpdb_serial_t serial) {
+	rdatasetheader_t *header;
+
+	for (header = node->data; header != NULL; header = header->next)
+		if (active_header(header, serial) != NULL)
+			return (ISC_TRUE);
+	return (ISC_FALSE);
+}
+
+/*
+ * Nodes.
+ */
+
+static isc_result_t
+new_node(dns_qpdb_t *qpdb, const dns_name_t *name, qpdb_node_t **nodep) {
+	qpdb_node_t *node;
+	isc_region_t r;
+
+	dns_name_toregion(name, &r);
+	node = isc_mem_get(qpdb->common.mctx, sizeof(*node) + r.length);
+	if (node == NULL)
+		return (ISC_R_NOMEMORY);
+	isc_refcount_init(&node->references, 0);
+	node->data = NULL;
+	ISC_LINK_INIT(node, deadlink);
+	node->nsec3 = 0;
+	node->delegating = 0;
+	node->dirty = 0;
+	node->namelen = r.length;
+	memmove(NODENAME(node), r.base, r.length);
+
+	*nodep = node;
+	return (ISC_R_SUCCESS);
+}
+
+static void
+free_node(dns_qpdb_t *qpdb, qpdb_node_t *node) {
+	rdatasetheader_t *current, *top_next, *down_next;
+
+	for (current = node->data; current != NULL; current = top_next) {
+		top_next = current->next;
+		do {
+			down_next = current->down;
+			free_rdataset(qpdb, current);
+			current = down_next;
+		} while (current != NULL);
+	}
+	isc_refcount_destroy(&node->references);
+	isc_mem_put(qpdb->common.mctx, node, sizeof(*node) + node->namelen);
+}
+
+/*%
+ * Find the node for 'name' in 'tree', creating it if necessary.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static isc_result_t
+addnode(dns_qpdb_t *qpdb, dns_qp_t *tree, const dns_name_t *name,
+	qpdb_node_t **nodep)
+{
+	qpdb_node_t *node = NULL;
+	isc_result_t result;
+
+	result = dns_qp_getname(tree, name, (void **)&node);
+	if (result == ISC_R_SUCCESS) {
+		*nodep = node;
+		return (ISC_R_SUCCESS);
+	}
+
+	result = new_node(qpdb, name, &node);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	if (tree == qpdb->nsec3)
+		node->nsec3 = 1;
+	result = dns_qp_insert(tree, node);
+	if (result != ISC_R_SUCCESS) {
+		free_node(qpdb, node);
+		return (result);
+	}
+	qpdb->generation++;
+
+	*nodep = node;
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Make sure that every wildcard name between the origin and 'name'
+ * has a node, even if it only is an empty non-terminal, so that
+ * zone_find() can answer from it.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static isc_result_t
+add_empty_wildcards(dns_qpdb_t *qpdb, const dns_name_t *name) {
+	dns_name_t wname;
+	qpdb_node_t *node;
+	isc_result_t result;
+	unsigned int n, l, i;
+
+	n = dns_name_countlabels(name);
+	l = dns_name_countlabels(&qpdb->common.origin);
+	i = l + 1;
+	while (i < n) {
+		dns_name_init(&wname, NULL);
+		dns_name_getlabelsequence(name, n - i, i, &wname);
+		if (dns_name_iswildcard(&wname)) {
+			node = NULL;
+			result = addnode(qpdb, qpdb->tree, &wname, &node);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+		}
+		i++;
+	}
+	return (ISC_R_SUCCESS);
+}
+
+static inline void
+rollback_node(qpdb_node_t *node, qpdb_serial_t serial) {
+	rdatasetheader_t *header, *dcurrent;
+	isc_boolean_t make_dirty = ISC_FALSE;
+
+	/*
+	 * Caller must hold the tree lock for writing.
+	 */
+
+	/*
+	 * We set the IGNORE attribute on rdatasets with serial number
+	 * 'serial'.  When the reference count goes to zero, these rdatasets
+	 * will be cleaned up; until that time, they will be ignored.
+	 */
+	for (header = node->data; header != NULL; header = header->next) {
+		if (header->serial == serial) {
+			header->attributes |= RDATASET_ATTR_IGNORE;
+			make_dirty = ISC_TRUE;
+		}
+		for (dcurrent = header->down;
+		     dcurrent != NULL;
+		     dcurrent = dcurrent->down) {
+			if (dcurrent->serial == serial) {
+				dcurrent->attributes |= RDATASET_ATTR_IGNORE;
+				make_dirty = ISC_TRUE;
+			}
+		}
+	}
+	if (make_dirty)
+		node->dirty = 1;
+}
+
+static void
+update_cachestats(dns_qpdb_t *qpdb, isc_result_t result) {
+	INSIST(IS_CACHE(qpdb));
+
+	if (qpdb->cachestats == NULL)
+		return;
+
+	switch (result) {
+	case ISC_R_SUCCESS:
+	case DNS_R_CNAME:
+	case DNS_R_DNAME:
+	case DNS_R_DELEGATION:
+	case DNS_R_NCACHENXDOMAIN:
+	case DNS_R_NCACHENXRRSET:
+		isc_stats_increment(qpdb->cachestats,
+				    dns_cachestatscounter_hits);
+		break;
+	default:
+		isc_stats_increment(qpdb->cachestats,
+				    dns_cachestatscounter_misses);
+	}
+}
+
+/*%
+ * Change the expiry time of a cache header, keeping the TTL heap in
+ * order.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static void
+set_ttl(dns_qpdb_t *qpdb, rdatasetheader_t *header, dns_ttl_t newttl) {
+	dns_ttl_t oldttl;
+
+	oldttl = header->rdh_ttl;
+	header->rdh_ttl = newttl;
+
+	if (!IS_CACHE(qpdb) || header->heap_index == 0)
+		return;
+
+	if (newttl < oldttl)
+		isc_heap_increased(qpdb->heap, header->heap_index);
+	else if (newttl > oldttl)
+		isc_heap_decreased(qpdb->heap, header->heap_index);
+}
+
+/*%
+ * Mark a cache header as expired, so that lookups ignore it and it is
+ * freed when its node is next cleaned.  An expired rdataset no longer
+ * counts in the rdataset statistics.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static inline void
+mark_header_ancient(dns_qpdb_t *qpdb, rdatasetheader_t *header) {
+	if (ANCIENT(header))
+		return;
+
+	header->attributes |= RDATASET_ATTR_ANCIENT;
+	header->node->dirty = 1;
+
+	if (EXISTS(header) && STATCOUNT(header)) {
+		update_rrsetstats(qpdb, header, ISC_FALSE);
+		header->attributes &= ~RDATASET_ATTR_STATCOUNT;
+	}
+}
+
+/*%
+ * Mark a cache header which has expired but may still be served as
+ * stale, moving it to the stale rdataset statistics.
+ *
+ * The caller must be holding the tree lock, and lru_lock as well if the
+ * tree lock is only held for reading.
+ */
+static inline void
+mark_header_stale(dns_qpdb_t *qpdb, rdatasetheader_t *header) {
+	if (STALE(header))
+		return;
+
+	if (EXISTS(header) && STATCOUNT(header))
+		update_rrsetstats(qpdb, header, ISC_FALSE);
+	header->attributes |= RDATASET_ATTR_STALE;
+	if (EXISTS(header) && STATCOUNT(header))
+		update_rrsetstats(qpdb, header, ISC_TRUE);
+}
+
+static inline void
+clean_stale_headers(dns_qpdb_t *qpdb, rdatasetheader_t *top) {
+	rdatasetheader_t *d, *down_next;
+
+	for (d = top->down; d != NULL; d = down_next) {
+		down_next = d->down;
+		free_rdataset(qpdb, d);
+	}
+	top->down = NULL;
+}
+
+/*%
+ * Free the headers of a cache node which have been replaced, have
+ * expired or no longer may be served stale.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static void
+clean_cache_node(dns_qpdb_t *qpdb, qpdb_node_t *node) {
+	rdatasetheader_t *current, *top_prev, *top_next;
+
+	top_prev = NULL;
+	for (current = node->data; current != NULL; current = top_next) {
+		top_next = current->next;
+		clean_stale_headers(qpdb, current);
+		/*
+		 * If current is nonexistent or stale, we can clean it up.
+		 */
+		if (NONEXISTENT(current) || ANCIENT(current) ||
+		    (STALE(current) && !KEEPSTALE(qpdb))) {
+			if (top_prev != NULL)
+				top_prev->next = current->next;
+			else
+				node->data = current->next;
+			free_rdataset(qpdb, current);
+		} else
+			top_prev = current;
+	}
+	node->dirty = 0;
+}
+
+static void
+clean_zone_node(dns_qpdb_t *qpdb, qpdb_node_t *node,
+		qpdb_serial_t least_serial)
+{
+	rdatasetheader_t *current, *dcurrent, *down_next, *dparent;
+	rdatasetheader_t *top_prev, *top_next;
+	isc_boolean_t still_dirty = ISC_FALSE;
+
+	/*
+	 * Caller must be holding the tree lock for writing.
+	 */
+	REQUIRE(least_serial != 0);
+
+	top_prev = NULL;
+	for (current = node->data; current != NULL; current = top_next) {
+		top_next = current->next;
+
+		/*
+		 * First, we clean up any instances of multiple rdatasets
+		 * with the same serial number, or that have the IGNORE
+		 * attribute.
+		 */
+		dparent = current;
+		for (dcurrent = current->down;
+		     dcurrent != NULL;
+		     dcurrent = down_next) {
+			down_next = dcurrent->down;
+			INSIST(dcurrent->serial <= dparent->serial);
+			if (dcurrent->serial == dparent->serial ||
+			    IGNORE(dcurrent)) {
+				dparent->down = down_next;
+				free_rdataset(qpdb, dcurrent);
+			} else
+				dparent = dcurrent;
+		}
+
+		/*
+		 * We've now eliminated all IGNORE datasets with the possible
+		 * exception of current, which we now check.
+		 */
+		if (IGNORE(current)) {
+			down_next = current->down;
+			if (down_next == NULL) {
+				if (top_prev != NULL)
+					top_prev->next = current->next;
+				else
+					node->data = current->next;
+				free_rdataset(qpdb, current);
+				/*
+				 * current no longer exists, so we can
+				 * just continue with the loop.
+				 */
+				continue;
+			} else {
+				/*
+				 * Pull up current->down, making it the new
+				 * current.
+				 */
+				if (top_prev != NULL)
+					top_prev->next = down_next;
+				else
+					node->data = down_next;
+				down_next->next = top_next;
+				free_rdataset(qpdb, current);
+				current = down_next;
+			}
+		}
+
+		/*
+		 * We now try to find the first down node less than the
+		 * least serial.
+		 */
+		dparent = current;
+		for (dcurrent = current->down;
+		     dcurrent != NULL;
+		     dcurrent = down_next) {
+			down_next = dcurrent->down;
+			if (dcurrent->serial < least_serial)
+				break;
+			dparent = dcurrent;
+		}
+
+		/*
+		 * If there is a such an rdataset, delete it and any older
+		 * versions.
+		 */
+		if (dcurrent != NULL) {
+			do {
+				down_next = dcurrent->down;
+				INSIST(dcurrent->serial <= least_serial);
+				free_rdataset(qpdb, dcurrent);
+				dcurrent = down_next;
+			} while (dcurrent != NULL);
+			dparent->down = NULL;
+		}
+
+		/*
+		 * Note.  The serial number of 'current' might be less than
+		 * least_serial too, but we cannot delete it because it is
+		 * the most recent version, unless it is a NONEXISTENT
+		 * rdataset.
+		 */
+		if (current->down != NULL) {
+			still_dirty = ISC_TRUE;
+			top_prev = current;
+		} else {
+			/*
+			 * If this is a NONEXISTENT rdataset, we can delete it.
+			 */
+			if (NONEXISTENT(current)) {
+				if (top_prev != NULL)
+					top_prev->next = current->next;
+				else
+					node->data = current->next;
+				free_rdataset(qpdb, current);
+			} else
+				top_prev = current;
+		}
+	}
+	if (!still_dirty)
+		node->dirty = 0;
+}
+
+/*%
+ * Remove an unreferenced node without data from its trie.  The origin
+ * nodes are never removed, and neither are a zone's wildcard nodes,
+ * which may be needed as empty non-terminals (see add_empty_wildcards()).
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static void
+delete_node(dns_qpdb_t *qpdb, qpdb_node_t *node) {
+	dns_name_t name;
+	dns_offsets_t offsets;
+	isc_result_t result;
+
+	INSIST(node->data == NULL);
+
+	if (node == qpdb->origin_node || node == qpdb->nsec3_origin_node)
+		return;
+
+	dns_name_init(&name, offsets);
+	nodename(node, &name);
+	if (!IS_CACHE(qpdb) && dns_name_iswildcard(&name))
+		return;
+
+	result = dns_qp_deletename(node->nsec3 ? qpdb->nsec3 : qpdb->tree,
+				   &name, NULL);
+	if (result != ISC_R_SUCCESS) {
+		/*
+		 * The node stays in the trie until it is next found to
+		 * be dead.
+		 */
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE,
+			      DNS_LOGMODULE_DB, ISC_LOG_WARNING,
+			      "delete_node(): dns_qp_deletename: %s",
+			      isc_result_totext(result));
+		return;
+	}
+	qpdb->generation++;
+
+	LOCK(&qpdb->dead_lock);
+	if (ISC_LINK_LINKED(node, deadlink))
+		ISC_LIST_UNLINK(qpdb->deadnodes, node, deadlink);
+	UNLOCK(&qpdb->dead_lock);
+
+	free_node(qpdb, node);
+}
+
+/*%
+ * Clean an unreferenced node: drop rdataset versions nobody can see any
+ * more and remove the node if nothing is left.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static void
+clean_node(dns_qpdb_t *qpdb, qpdb_node_t *node, qpdb_serial_t least_serial) {
+	if (least_serial == 0)
+		least_serial = qpdb->least_serial;
+	if (node->dirty) {
+		if (IS_CACHE(qpdb))
+			clean_cache_node(qpdb, node);
+		else
+			clean_zone_node(qpdb, node, least_serial);
+	}
+	if (node->data == NULL)
+		delete_node(qpdb, node);
+}
+
+/*%
+ * Clean the nodes that lost their last reference while the tree lock
+ * was only held for reading.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static void
+cleanup_dead_nodes(dns_qpdb_t *qpdb) {
+	qpdb_node_t *node;
+
+	LOCK(&qpdb->dead_lock);
+	while ((node = ISC_LIST_HEAD(qpdb->deadnodes)) != NULL) {
+		ISC_LIST_UNLINK(qpdb->deadnodes, node, deadlink);
+		UNLOCK(&qpdb->dead_lock);
+		if (isc_refcount_current(&node->references) == 0)
+			clean_node(qpdb, node, 0);
+		LOCK(&qpdb->dead_lock);
+	}
+	UNLOCK(&qpdb->dead_lock);
+}
+
+static inline void
+new_reference(dns_qpdb_t *qpdb, qpdb_node_t *node) {
+	unsigned int refs;
+
+	isc_refcount_increment0(&node->references, &refs);
+	INSIST(refs != 0);
+	isc_refcount_increment(&qpdb->references, &refs);
+	INSIST(refs > 1);
+}
+
+/*%
+ * Release a node reference and the database reference that goes with
+ * it.  If this was the last reference to a node that needs cleaning, the
+ * node is cleaned now if the tree lock is (or can be made) exclusive,
+ * and put on the dead node list otherwise.
+ *
+ * Returns ISC_TRUE if the last database reference was released, in
+ * which case the caller must free the database after unlocking.
+ *
+ * The caller must be holding the tree lock ('locktype').
+ */
+static isc_boolean_t
+decrement_reference(dns_qpdb_t *qpdb, qpdb_node_t *node,
+		    qpdb_serial_t least_serial, isc_rwlocktype_t locktype)
+{
+	unsigned int refs;
+
+	isc_refcount_decrement(&node->references, &refs);
+	if (refs == 0 && (node->dirty || node->data == NULL)) {
+		if (locktype == isc_rwlocktype_write) {
+			clean_node(qpdb, node, least_serial);
+		} else if (isc_rwlock_tryupgrade(&qpdb->tree_lock) ==
+			   ISC_R_SUCCESS)
+		{
+			if (isc_refcount_current(&node->references) == 0)
+				clean_node(qpdb, node, least_serial);
+			isc_rwlock_downgrade(&qpdb->tree_lock);
+		} else {
+			LOCK(&qpdb->dead_lock);
+			if (!ISC_LINK_LINKED(node, deadlink))
+				ISC_LIST_APPEND(qpdb->deadnodes, node,
+						deadlink);
+			UNLOCK(&qpdb->dead_lock);
+		}
+	}
+
+	isc_refcount_decrement(&qpdb->references, &refs);
+	return (ISC_TF(refs == 0));
+}
+
+/*
+ * DB Routines
+ */
+
+static void
+attach(dns_db_t *source, dns_db_t **targetp) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)source;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	isc_refcount_increment(&qpdb->references, NULL);
+
+	*targetp = source;
+}
+
+static void
+free_qpdb(dns_qpdb_t *qpdb) {
+	qpdb_version_t *version;
+	isc_mem_t *mctx = qpdb->common.mctx;
+
+	version = qpdb->current_version;
+	if (version != NULL) {
+		INSIST(ISC_LIST_EMPTY(version->changed_list));
+		isc_refcount_decrement(&version->references, NULL);
+		isc_refcount_destroy(&version->references);
+		isc_mem_put(mctx, version, sizeof(*version));
+	}
+
+	if (qpdb->tree != NULL)
+		dns_qp_destroy(&qpdb->tree);
+	if (qpdb->nsec3 != NULL)
+		dns_qp_destroy(&qpdb->nsec3);
+	if (qpdb->heap != NULL)
+		isc_heap_destroy(&qpdb->heap);
+	if (qpdb->hmctx != NULL)
+		isc_mem_detach(&qpdb->hmctx);
+	if (qpdb->task != NULL)
+		isc_task_detach(&qpdb->task);
+
+	if (dns_name_dynamic(&qpdb->common.origin))
+		dns_name_free(&qpdb->common.origin, mctx);
+
+	if (qpdb->cachestats != NULL)
+		isc_stats_detach(&qpdb->cachestats);
+	if (qpdb->rrsetstats != NULL)
+		dns_stats_detach(&qpdb->rrsetstats);
+
+	DESTROYLOCK(&qpdb->lru_lock);
+	DESTROYLOCK(&qpdb->dead_lock);
+	isc_rwlock_destroy(&qpdb->tree_lock);
+	isc_refcount_destroy(&qpdb->references);
+	qpdb->common.magic = 0;
+	qpdb->common.impmagic = 0;
+	isc_mem_putanddetach(&qpdb->common.mctx, qpdb, sizeof(*qpdb));
+}
+
+static void
+detach(dns_db_t **dbp) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)(*dbp);
+	unsigned int refs;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	isc_refcount_decrement(&qpdb->references, &refs);
+	if (refs == 0)
+		free_qpdb(qpdb);
+
+	*dbp = NULL;
+}
+
+static void
+currentversion(dns_db_t *db, dns_dbversion_t **versionp) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_version_t *version;
+	unsigned int refs;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	version = qpdb->current_version;
+	isc_refcount_increment(&version->references, &refs);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	*versionp = (dns_dbversion_t *)version;
+}
+
+static inline qpdb_version_t *
+allocate_version(isc_mem_t *mctx, qpdb_serial_t serial,
+		 unsigned int references, isc_boolean_t writer)
+{
+	isc_result_t result;
+	qpdb_version_t *version;
+
+	version = isc_mem_get(mctx, sizeof(*version));
+	if (version == NULL)
+		return (NULL);
+	memset(version, 0, sizeof(*version));
+	version->serial = serial;
+	result = isc_refcount_init(&version->references, references);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(mctx, version, sizeof(*version));
+		return (NULL);
+	}
+	version->writer = writer;
+	version->commit_ok = ISC_FALSE;
+	ISC_LIST_INIT(version->changed_list);
+	ISC_LIST_INIT(version->resigned_list);
+	ISC_LINK_INIT(version, link);
+	version->secure = dns_db_insecure;
+	version->havensec3 = ISC_FALSE;
+
+	return (version);
+}
+
+static isc_result_t
+newversion(dns_db_t *db, dns_dbversion_t **versionp) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_version_t *version, *current;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(versionp != NULL && *versionp == NULL);
+	REQUIRE(qpdb->future_version == NULL);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	if (qpdb->next_serial == 0) {
+		/*
+		 * The serial numbers have wrapped; a new version would sort
+		 * before every existing one.
+		 */
+		RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+		return (ISC_R_RANGE);
+	}
+	version = allocate_version(qpdb->common.mctx, qpdb->next_serial, 1,
+				   ISC_TRUE);
+	if (version == NULL) {
+		RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+		return (ISC_R_NOMEMORY);
+	}
+	current = qpdb->current_version;
+	version->qpdb = qpdb;
+	version->commit_ok = ISC_TRUE;
+	version->secure = current->secure;
+	version->havensec3 = current->havensec3;
+	if (version->havensec3)
+		version->nsec3params = current->nsec3params;
+	version->records = current->records;
+	version->bytes = current->bytes;
+	qpdb->next_serial++;
+	qpdb->future_version = version;
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	*versionp = version;
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+attachversion(dns_db_t *db, dns_dbversion_t *source,
+	      dns_dbversion_t **targetp)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_version_t *version = source;
+	unsigned int refs;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	INSIST(version != NULL && version->qpdb == qpdb);
+
+	isc_refcount_increment(&version->references, &refs);
+	INSIST(refs > 1);
+
+	*targetp = version;
+}
+
+/*%
+ * The caller must be holding the tree lock for writing.
+ */
+static qpdb_changed_t *
+add_changed(dns_qpdb_t *qpdb, qpdb_version_t *version, qpdb_node_t *node) {
+	qpdb_changed_t *changed;
+
+	REQUIRE(version->writer);
+
+	changed = isc_mem_get(qpdb->common.mctx, sizeof(*changed));
+	if (changed == NULL) {
+		version->commit_ok = ISC_FALSE;
+		return (NULL);
+	}
+	new_reference(qpdb, node);
+	changed->node = node;
+	changed->dirty = ISC_FALSE;
+	ISC_LIST_INITANDAPPEND(version->changed_list, changed, link);
+
+	return (changed);
+}
+
+static inline void
+make_least_version(dns_qpdb_t *qpdb, qpdb_version_t *version,
+		   qpdb_changedlist_t *cleanup_list)
+{
+	/*
+	 * Caller must be holding the tree lock for writing.
+	 */
+
+	qpdb->least_serial = version->serial;
+	*cleanup_list = version->changed_list;
+	ISC_LIST_INIT(version->changed_list);
+}
+
+static inline void
+cleanup_nondirty(qpdb_version_t *version, qpdb_changedlist_t *cleanup_list) {
+	qpdb_changed_t *changed, *next_changed;
+
+	/*
+	 * If the changed record is dirty, then
+	 * an update created multiple versions of
+	 * a given rdataset.  We keep this list
+	 * until we're the least open version, at
+	 * which point it's safe to get rid of any
+	 * older versions.
+	 *
+	 * If the changed record isn't dirty, then
+	 * we don't need it anymore since we're
+	 * committing and not rolling back.
+	 *
+	 * The caller must be holding the tree lock for writing.
+	 */
+	for (changed = ISC_LIST_HEAD(version->changed_list);
+	     changed != NULL;
+	     changed = next_changed) {
+		next_changed = ISC_LIST_NEXT(changed, link);
+		if (!changed->dirty) {
+			ISC_LIST_UNLINK(version->changed_list, changed, link);
+			ISC_LIST_APPEND(*cleanup_list, changed, link);
+		}
+	}
+}
+
+static isc_result_t
+resign_insert(dns_qpdb_t *qpdb, rdatasetheader_t *newheader) {
+	INSIST(newheader->heap_index == 0);
+	INSIST(!ISC_LINK_LINKED(newheader, link));
+
+	return (isc_heap_insert(qpdb->heap, newheader));
+}
+
+static void
+resign_delete(dns_qpdb_t *qpdb, qpdb_version_t *version,
+	      rdatasetheader_t *header)
+{
+	/*
+	 * Remove the old header from the heap
+	 */
+	if (header != NULL && header->heap_index != 0) {
+		isc_heap_delete(qpdb->heap, header->heap_index);
+		header->heap_index = 0;
+		if (version != NULL) {
+			new_reference(qpdb, header->node);
+			ISC_LIST_APPEND(version->resigned_list, header, link);
+		}
+	}
+}
+
+static void
+closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_version_t *version, *cleanup_version, *least_greater;
+	isc_boolean_t rollback = ISC_FALSE;
+	isc_boolean_t want_free = ISC_FALSE;
+	qpdb_changedlist_t cleanup_list;
+	rdatasetheaderlist_t resigned_list;
+	qpdb_changed_t *changed, *next_changed;
+	qpdb_serial_t serial, least_serial;
+	rdatasetheader_t *header;
+	unsigned int refs;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	version = (qpdb_version_t *)*versionp;
+	INSIST(version->qpdb == qpdb);
+
+	cleanup_version = NULL;
+	ISC_LIST_INIT(cleanup_list);
+	ISC_LIST_INIT(resigned_list);
+
+	isc_refcount_decrement(&version->references, &refs);
+	if (refs > 0) {		/* typical and easy case first */
+		if (commit) {
+			RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+			INSIST(!version->writer);
+			RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+		}
+		goto end;
+	}
+
+	/*
+	 * Update the zone's secure status in version before making
+	 * it the current version.
+	 */
+	if (version->writer && commit && !IS_CACHE(qpdb))
+		iszonesecure(db, version, qpdb->origin_node);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	serial = version->serial;
+	if (version->writer) {
+		if (commit) {
+			unsigned int cur_ref;
+			qpdb_version_t *cur_version;
+
+			INSIST(version->commit_ok);
+			INSIST(version == qpdb->future_version);
+			/*
+			 * The current version is going to be replaced.
+			 * Release the (likely last) reference to it from the
+			 * DB itself and unlink it from the open list.
+			 */
+			cur_version = qpdb->current_version;
+			isc_refcount_decrement(&cur_version->references,
+					       &cur_ref);
+			if (cur_ref == 0) {
+				if (cur_version->serial == qpdb->least_serial)
+					INSIST(ISC_LIST_EMPTY(
+						cur_version->changed_list));
+				ISC_LIST_UNLINK(qpdb->open_versions,
+						cur_version, link);
+			}
+			if (ISC_LIST_EMPTY(qpdb->open_versions)) {
+				/*
+				 * We're going to become the least open
+				 * version.
+				 */
+				make_least_version(qpdb, version,
+						   &cleanup_list);
+			} else {
+				/*
+				 * Some other open version is the
+				 * least version.  We can't cleanup
+				 * records that were changed in this
+				 * version because the older versions
+				 * may still be in use by an open
+				 * version.
+				 *
+				 * We can, however, discard the
+				 * changed records for things that
+				 * we've added that didn't exist in
+				 * prior versions.
+				 */
+				cleanup_nondirty(version, &cleanup_list);
+			}
+			/*
+			 * If the (soon to be former) current version
+			 * isn't being used by anyone, we can clean
+			 * it up.
+			 */
+			if (cur_ref == 0) {
+				cleanup_version = cur_version;
+				ISC_LIST_APPENDLIST(version->changed_list,
+					cleanup_version->changed_list, link);
+			}
+			/*
+			 * Become the current version.
+			 */
+			version->writer = ISC_FALSE;
+			qpdb->current_version = version;
+			qpdb->current_serial = version->serial;
+			qpdb->future_version = NULL;
+
+			/*
+			 * Keep the current version in the open list, and
+			 * gain a reference for the DB itself.
+			 */
+			isc_refcount_increment0(&version->references,
+						&cur_ref);
+			INSIST(cur_ref == 1);
+			ISC_LIST_PREPEND(qpdb->open_versions,
+					 qpdb->current_version, link);
+			resigned_list = version->resigned_list;
+			ISC_LIST_INIT(version->resigned_list);
+		} else {
+			/*
+			 * We're rolling back this transaction.
+			 */
+			cleanup_list = version->changed_list;
+			ISC_LIST_INIT(version->changed_list);
+			resigned_list = version->resigned_list;
+			ISC_LIST_INIT(version->resigned_list);
+			rollback = ISC_TRUE;
+			cleanup_version = version;
+			qpdb->future_version = NULL;
+		}
+	} else {
+		if (version != qpdb->current_version) {
+			/*
+			 * There are no external or internal references
+			 * to this version and it can be cleaned up.
+			 */
+			cleanup_version = version;
+
+			/*
+			 * Find the version with the least serial
+			 * number greater than ours.
+			 */
+			least_greater = ISC_LIST_PREV(version, link);
+			if (least_greater == NULL)
+				least_greater = qpdb->current_version;
+
+			INSIST(version->serial < least_greater->serial);
+			/*
+			 * Is this the least open version?
+			 */
+			if (version->serial == qpdb->least_serial) {
+				/*
+				 * Yes.  Install the new least open
+				 * version.
+				 */
+				make_least_version(qpdb, least_greater,
+						   &cleanup_list);
+			} else {
+				/*
+				 * Add any unexecuted cleanups to
+				 * those of the least greater version.
+				 */
+				ISC_LIST_APPENDLIST(least_greater->changed_list,
+						    version->changed_list,
+						    link);
+			}
+		} else if (version->serial == qpdb->least_serial)
+			INSIST(ISC_LIST_EMPTY(version->changed_list));
+		ISC_LIST_UNLINK(qpdb->open_versions, version, link);
+	}
+	least_serial = qpdb->least_serial;
+
+	/*
+	 * Commit/rollback re-signed headers.
+	 */
+	for (header = ISC_LIST_HEAD(resigned_list);
+	     header != NULL;
+	     header = ISC_LIST_HEAD(resigned_list)) {
+		ISC_LIST_UNLINK(resigned_list, header, link);
+		if (rollback && !IGNORE(header)) {
+			isc_result_t result;
+			result = resign_insert(qpdb, header);
+			if (result != ISC_R_SUCCESS)
+				isc_log_write(dns_lctx,
+					      DNS_LOGCATEGORY_DATABASE,
+					      DNS_LOGMODULE_ZONE, ISC_LOG_ERROR,
+					      "Unable to reinsert header to "
+					      "re-signing heap: %s",
+					      dns_result_totext(result));
+		}
+		if (decrement_reference(qpdb, header->node, least_serial,
+					isc_rwlocktype_write))
+			want_free = ISC_TRUE;
+	}
+
+	if (!ISC_LIST_EMPTY(cleanup_list))
+		cleanup_dead_nodes(qpdb);
+	for (changed = ISC_LIST_HEAD(cleanup_list);
+	     changed != NULL;
+	     changed = next_changed) {
+		next_changed = ISC_LIST_NEXT(changed, link);
+		if (rollback)
+			rollback_node(changed->node, serial);
+		if (decrement_reference(qpdb, changed->node, least_serial,
+					isc_rwlocktype_write))
+			want_free = ISC_TRUE;
+		isc_mem_put(qpdb->common.mctx, changed, sizeof(*changed));
+	}
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	if (cleanup_version != NULL) {
+		INSIST(ISC_LIST_EMPTY(cleanup_version->changed_list));
+		isc_refcount_destroy(&cleanup_version->references);
+		isc_mem_put(qpdb->common.mctx, cleanup_version,
+			    sizeof(*cleanup_version));
+	}
+
+	if (want_free)
+		free_qpdb(qpdb);
+
+ end:
+	*versionp = NULL;
+}
+
+static isc_result_t
+findnodeintree(dns_qpdb_t *qpdb, dns_qp_t *tree, const dns_name_t *name,
+	       isc_boolean_t create, dns_dbnode_t **nodep)
+{
+	qpdb_node_t *node = NULL;
+	isc_result_t result;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	result = dns_qp_getname(tree, name, (void **)&node);
+	if (result == ISC_R_SUCCESS)
+		new_reference(qpdb, node);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	if (result != ISC_R_SUCCESS) {
+		if (!create)
+			return (result);
+
+		RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+		cleanup_dead_nodes(qpdb);
+		result = ISC_R_SUCCESS;
+		if (tree == qpdb->tree && !IS_CACHE(qpdb))
+			result = add_empty_wildcards(qpdb, name);
+		if (result == ISC_R_SUCCESS)
+			result = addnode(qpdb, tree, name, &node);
+		if (result == ISC_R_SUCCESS)
+			new_reference(qpdb, node);
+		RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+
+	*nodep = (dns_dbnode_t *)node;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+findnode(dns_db_t *db, const dns_name_t *name, isc_boolean_t create,
+	 dns_dbnode_t **nodep)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	return (findnodeintree(qpdb, qpdb->tree, name, create, nodep));
+}
+
+static isc_result_t
+findnsec3node(dns_db_t *db, const dns_name_t *name, isc_boolean_t create,
+	      dns_dbnode_t **nodep)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	return (findnodeintree(qpdb, qpdb->nsec3, name, create, nodep));
+}
+
+static inline void
+bind_rdataset(dns_qpdb_t *qpdb, qpdb_node_t *node, rdatasetheader_t *header,
+	      isc_stdtime_t now, dns_rdataset_t *rdataset)
+{
+	unsigned char *raw;	/* RDATASLAB */
+
+	/*
+	 * Caller must be holding the tree lock.  As in rbtdb.c the header
+	 * count is incremented without a writer lock since its actual
+	 * value doesn't matter.
+	 */
+
+	if (rdataset == NULL)
+		return;
+
+	new_reference(qpdb, node);
+
+	INSIST(rdataset->methods == NULL);	/* We must be disassociated. */
+
+	rdataset->methods = &rdataset_methods;
+	rdataset->rdclass = qpdb->common.rdclass;
+	rdataset->type = QPDB_RDATATYPE_BASE(header->type);
+	rdataset->covers = QPDB_RDATATYPE_EXT(header->type);
+	rdataset->ttl = header->rdh_ttl - now;
+	rdataset->trust = header->trust;
+	if (NEGATIVE(header))
+		rdataset->attributes |= DNS_RDATASETATTR_NEGATIVE;
+	if (NXDOMAIN(header))
+		rdataset->attributes |= DNS_RDATASETATTR_NXDOMAIN;
+	if (OPTOUT(header))
+		rdataset->attributes |= DNS_RDATASETATTR_OPTOUT;
+	if (PREFETCH(header))
+		rdataset->attributes |= DNS_RDATASETATTR_PREFETCH;
+	if (STALE(header)) {
+		rdataset->attributes |= DNS_RDATASETATTR_STALE;
+		rdataset->ttl = 0;
+	}
+	rdataset->private1 = qpdb;
+	rdataset->private2 = node;
+	raw = (unsigned char *)header + sizeof(*header);
+	rdataset->private3 = raw;
+	rdataset->count = header->count++;
+	if (rdataset->count == ISC_UINT32_MAX)
+		rdataset->count = 0;
+
+	/*
+	 * Reset iterator state.
+	 */
+	rdataset->privateuint4 = 0;
+	rdataset->private5 = NULL;
+
+	/*
+	 * Add noqname proof.
+	 */
+	rdataset->private6 = header->noqname;
+	if (rdataset->private6 != NULL)
+		rdataset->attributes |= DNS_RDATASETATTR_NOQNAME;
+	rdataset->private7 = header->closest;
+	if (rdataset->private7 != NULL)
+		rdataset->attributes |= DNS_RDATASETATTR_CLOSEST;
+
+	/*
+	 * Copy out re-signing information.
+	 */
+	if (RESIGN(header)) {
+		rdataset->attributes |= DNS_RDATASETATTR_RESIGN;
+		rdataset->resign = (header->resign << 1) | header->resign_lsb;
+	} else
+		rdataset->resign = 0;
+}
+
+
+/*%
+ * If 'node' is a zone cut active in the search version and no zone cut
+ * has been seen above it, remember it.  Returns ISC_TRUE if the search
+ * should stop here because the caller does not want glue.
+ *
+ * The caller must be holding the tree lock.
+ */
+static isc_boolean_t
+check_zonecut(qpdb_search_t *search, qpdb_node_t *node) {
+	rdatasetheader_t *header, *active;
+	rdatasetheader_t *dname_header, *sigdname_header, *ns_header;
+	rdatasetheader_t *found;
+	dns_name_t name;
+	dns_offsets_t offsets;
+
+	/*
+	 * We only want to remember the topmost zone cut, since it's the one
+	 * that counts.
+	 */
+	if (search->zonecut != NULL || !node->delegating)
+		return (ISC_FALSE);
+
+	/*
+	 * Look for an NS or DNAME rdataset active in our version.
+	 */
+	ns_header = NULL;
+	dname_header = NULL;
+	sigdname_header = NULL;
+	for (header = node->data; header != NULL; header = header->next) {
+		if (header->type != dns_rdatatype_ns &&
+		    header->type != dns_rdatatype_dname &&
+		    header->type != QPDB_RDATATYPE_SIGDNAME)
+			continue;
+		active = active_header(header, search->serial);
+		if (active == NULL)
+			continue;
+		if (active->type == dns_rdatatype_dname)
+			dname_header = active;
+		else if (active->type == QPDB_RDATATYPE_SIGDNAME)
+			sigdname_header = active;
+		else if (node != search->qpdb->origin_node ||
+			 IS_STUB(search->qpdb)) {
+			/*
+			 * An NS rdataset at the origin node is not a
+			 * delegation, except in a stub zone.
+			 */
+			ns_header = active;
+		}
+	}
+
+	/*
+	 * Did we find anything?
+	 */
+	if (!IS_STUB(search->qpdb) && ns_header != NULL) {
+		/*
+		 * Note that NS has precedence over DNAME if both exist
+		 * in a zone.  Otherwise DNAME take precedence over NS.
+		 */
+		found = ns_header;
+		search->zonecut_sigrdataset = NULL;
+	} else if (dname_header != NULL) {
+		found = dname_header;
+		search->zonecut_sigrdataset = sigdname_header;
+	} else if (ns_header != NULL) {
+		found = ns_header;
+		search->zonecut_sigrdataset = NULL;
+	} else
+		return (ISC_FALSE);
+
+	search->zonecut = node;
+	search->zonecut_rdataset = found;
+	dns_name_init(&name, offsets);
+	nodename(node, &name);
+	RUNTIME_CHECK(dns_name_copy(&name,
+				    dns_fixedname_name(&search->zonecut_name),
+				    NULL) == ISC_R_SUCCESS);
+
+	/*
+	 * If the caller does not want to find glue, then this is the
+	 * best answer and the search should stop now.
+	 */
+	return (ISC_TF((search->options & DNS_DBFIND_GLUEOK) == 0));
+}
+
+static isc_result_t
+setup_delegation(qpdb_search_t *search, dns_dbnode_t **nodep,
+		 dns_name_t *foundname, dns_rdataset_t *rdataset,
+		 dns_rdataset_t *sigrdataset)
+{
+	isc_result_t result;
+	qpdb_rdatatype_t type;
+	qpdb_node_t *node;
+
+	/*
+	 * The caller must be holding the tree lock.
+	 */
+
+	node = search->zonecut;
+	type = search->zonecut_rdataset->type;
+
+	/*
+	 * If we have to set foundname, we do it before anything else.
+	 */
+	if (foundname != NULL) {
+		result = dns_name_copy(dns_fixedname_name(&search->zonecut_name),
+				       foundname, NULL);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+	if (nodep != NULL) {
+		new_reference(search->qpdb, node);
+		*nodep = node;
+	}
+	bind_rdataset(search->qpdb, node, search->zonecut_rdataset,
+		      search->now, rdataset);
+	if (sigrdataset != NULL && search->zonecut_sigrdataset != NULL)
+		bind_rdataset(search->qpdb, node, search->zonecut_sigrdataset,
+			      search->now, sigrdataset);
+
+	if (type == dns_rdatatype_dname)
+		return (DNS_R_DNAME);
+	return (DNS_R_DELEGATION);
+}
+
+static inline isc_boolean_t
+valid_glue(qpdb_search_t *search, dns_name_t *name, qpdb_rdatatype_t type,
+	   qpdb_node_t *node)
+{
+	rdatasetheader_t *header;
+
+	/*
+	 * Valid glue types are A, AAAA, A6.  NS is also a valid glue type
+	 * if it occurs at a zone cut, but is not valid below it.
+	 */
+	if (type == dns_rdatatype_ns) {
+		if (node != search->zonecut) {
+			return (ISC_FALSE);
+		}
+	} else if (type != dns_rdatatype_a &&
+		   type != dns_rdatatype_aaaa &&
+		   type != dns_rdatatype_a6) {
+		return (ISC_FALSE);
+	}
+
+	header = search->zonecut_rdataset;
+	return (dns__slabdb_hasnstarget((unsigned char *)(header + 1),
+					search->qpdb->common.rdclass, name));
+}
+
+static isc_boolean_t
+matchparams(rdatasetheader_t *header, qpdb_search_t *search) {
+	REQUIRE(header->type == dns_rdatatype_nsec3);
+
+	return (dns__slabdb_matchnsec3((unsigned char *)(header + 1),
+				       search->qpdb->common.rdclass,
+				       &search->version->nsec3params));
+}
+
+/*%
+ * Find the names of the nearest nodes before and after 'name' in the
+ * search tree that are active in the search version.  'prev' (if not
+ * NULL) and 'next' are left without labels if there is no such node.
+ *
+ * The caller must be holding the tree lock.
+ */
+static void
+find_neighbours(qpdb_search_t *search, const dns_name_t *name,
+		dns_name_t *prev, dns_name_t *next)
+{
+	dns_qpiter_t iter;
+	qpdb_node_t *node = NULL;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+	isc_result_t result;
+
+	dns_name_init(&nname, offsets);
+
+	if (prev != NULL) {
+		dns_qpiter_init(search->tree, &iter);
+		result = dns_qpiter_seek(&iter, name, (void **)&node);
+		if (result == ISC_R_SUCCESS)
+			result = dns_qpiter_prev(&iter, (void **)&node);
+		else if (result == DNS_R_PARTIALMATCH)
+			result = ISC_R_SUCCESS;
+		while (result == ISC_R_SUCCESS &&
+		       !node_active(node, search->serial))
+			result = dns_qpiter_prev(&iter, (void **)&node);
+		if (result == ISC_R_SUCCESS) {
+			nodename(node, &nname);
+			RUNTIME_CHECK(dns_name_copy(&nname, prev, NULL) ==
+				      ISC_R_SUCCESS);
+		}
+	}
+
+	/*
+	 * If 'name' sorts before every node the iterator is left
+	 * unpositioned, and the next node is the first one.
+	 */
+	dns_qpiter_init(search->tree, &iter);
+	(void)dns_qpiter_seek(&iter, name, NULL);
+	do {
+		result = dns_qpiter_next(&iter, (void **)&node);
+	} while (result == ISC_R_SUCCESS &&
+		 !node_active(node, search->serial));
+	if (result == ISC_R_SUCCESS) {
+		nodename(node, &nname);
+		RUNTIME_CHECK(dns_name_copy(&nname, next, NULL) ==
+			      ISC_R_SUCCESS);
+	}
+}
+
+/*%
+ * 'qname' does not exist in the search version and is not at or below
+ * an empty non-terminal.  Look for the wildcard at its closest encloser,
+ * which is the longest ancestor 'qname' shares with either of its
+ * active neighbours (or the origin).  The wildcard matches if its node
+ * is active or is an empty non-terminal.
+ *
+ * The caller must be holding the tree lock.
+ */
+static isc_result_t
+find_wildcard(qpdb_search_t *search, qpdb_node_t **nodep,
+	      const dns_name_t *qname, const dns_name_t *prev,
+	      const dns_name_t *next)
+{
+	dns_qpdb_t *qpdb = search->qpdb;
+	qpdb_node_t *wnode = NULL;
+	dns_fixedname_t fwname, fnext;
+	dns_name_t *wname, *wnext;
+	dns_name_t encloser;
+	unsigned int labels, nlabels, n;
+	int order;
+	isc_result_t result;
+
+	if (!dns_name_issubdomain(qname, &qpdb->common.origin))
+		return (ISC_R_NOTFOUND);
+
+	labels = dns_name_countlabels(&qpdb->common.origin);
+	if (dns_name_countlabels(prev) != 0) {
+		(void)dns_name_fullcompare(qname, prev, &order, &nlabels);
+		if (nlabels > labels)
+			labels = nlabels;
+	}
+	if (dns_name_countlabels(next) != 0) {
+		(void)dns_name_fullcompare(qname, next, &order, &nlabels);
+		if (nlabels > labels)
+			labels = nlabels;
+	}
+
+	n = dns_name_countlabels(qname);
+	INSIST(labels < n);
+	dns_name_init(&encloser, NULL);
+	dns_name_getlabelsequence(qname, n - labels, labels, &encloser);
+	dns_fixedname_init(&fwname);
+	wname = dns_fixedname_name(&fwname);
+	result = dns_name_concatenate(dns_wildcardname, &encloser, wname,
+				      NULL);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	result = dns_qp_getname(qpdb->tree, wname, (void **)&wnode);
+	if (result != ISC_R_SUCCESS)
+		return (ISC_R_NOTFOUND);
+
+	if (!node_active(wnode, search->serial)) {
+		dns_fixedname_init(&fnext);
+		wnext = dns_fixedname_name(&fnext);
+		find_neighbours(search, wname, NULL, wnext);
+		if (dns_name_countlabels(wnext) == 0 ||
+		    !dns_name_issubdomain(wnext, wname))
+			return (ISC_R_NOTFOUND);
+	}
+
+	*nodep = wnode;
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+find_closest_nsec(qpdb_search_t *search, dns_dbnode_t **nodep,
+		  dns_name_t *foundname, dns_rdataset_t *rdataset,
+		  dns_rdataset_t *sigrdataset, const dns_name_t *name)
+{
+	dns_qpiter_t iter;
+	qpdb_node_t *node = NULL;
+	rdatasetheader_t *header, *active, *found, *foundsig;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+	dns_rdatatype_t type;
+	qpdb_rdatatype_t sigtype;
+	isc_boolean_t wraps, empty_node;
+	isc_boolean_t need_sig = ISC_TF(search->version->secure ==
+					dns_db_secure);
+	isc_result_t result;
+
+	/*
+	 * The caller must be holding the tree lock.
+	 */
+
+	if (search->tree == search->qpdb->nsec3) {
+		type = dns_rdatatype_nsec3;
+		sigtype = QPDB_RDATATYPE_SIGNSEC3;
+		wraps = ISC_TRUE;
+	} else {
+		type = dns_rdatatype_nsec;
+		sigtype = QPDB_RDATATYPE_SIGNSEC;
+		wraps = ISC_FALSE;
+	}
+
+	/*
+	 * Since the names are in canonical order, the closest NSEC is on
+	 * the nearest active node at or before 'name'.
+	 */
+	dns_qpiter_init(search->tree, &iter);
+	result = dns_qpiter_seek(&iter, name, (void **)&node);
+	if (result == DNS_R_PARTIALMATCH)
+		result = ISC_R_SUCCESS;
+	else if (result == ISC_R_NOTFOUND)
+		result = ISC_R_NOMORE;
+	for (;;) {
+		if (result == ISC_R_NOMORE && wraps) {
+			wraps = ISC_FALSE;
+			result = dns_qpiter_last(&iter, (void **)&node);
+		}
+		if (result != ISC_R_SUCCESS)
+			break;
+
+		found = NULL;
+		foundsig = NULL;
+		empty_node = ISC_TRUE;
+		for (header = node->data; header != NULL;
+		     header = header->next)
+		{
+			/*
+			 * Look for an active, extant NSEC or RRSIG NSEC.
+			 */
+			active = active_header(header, search->serial);
+			if (active == NULL)
+				continue;
+			empty_node = ISC_FALSE;
+			if (active->type == type)
+				found = active;
+			else if (active->type == sigtype)
+				foundsig = active;
+		}
+		if (found != NULL && search->version->havensec3 &&
+		    found->type == dns_rdatatype_nsec3 &&
+		    !matchparams(found, search))
+		{
+			/*
+			 * An NSEC3 record from another chain; keep
+			 * looking.
+			 */
+		} else if (found != NULL && (foundsig != NULL || !need_sig)) {
+			/*
+			 * We've found the right NSEC/NSEC3 record.
+			 *
+			 * Note: for this to really be the right
+			 * NSEC record, it's essential that the NSEC
+			 * records of any nodes obscured by a zone
+			 * cut have been removed; we assume this is
+			 * the case.
+			 */
+			dns_name_init(&nname, offsets);
+			nodename(node, &nname);
+			result = dns_name_copy(&nname, foundname, NULL);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+			if (nodep != NULL) {
+				new_reference(search->qpdb, node);
+				*nodep = node;
+			}
+			bind_rdataset(search->qpdb, node, found, 0, rdataset);
+			if (foundsig != NULL)
+				bind_rdataset(search->qpdb, node, foundsig, 0,
+					      sigrdataset);
+			return (ISC_R_SUCCESS);
+		} else if (!empty_node && (found != NULL || foundsig != NULL)) {
+			/*
+			 * We found an active node, but either the
+			 * NSEC or the RRSIG NSEC is missing.  This
+			 * shouldn't happen.
+			 */
+			return (DNS_R_BADDB);
+		}
+		/*
+		 * Otherwise the node is empty, or is glue or other
+		 * obscured zone data without an NSEC; keep looking.
+		 */
+		result = dns_qpiter_prev(&iter, (void **)&node);
+	}
+
+	/*
+	 * If the result is ISC_R_NOMORE, then we got to the beginning of
+	 * the database and didn't find a NSEC record.  This shouldn't
+	 * happen.
+	 */
+	if (result == ISC_R_NOMORE)
+		result = DNS_R_BADDB;
+
+	return (result);
+}
+
+static isc_result_t
+zone_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
+	  dns_rdatatype_t type, unsigned int options, isc_stdtime_t now,
+	  dns_dbnode_t **nodep, dns_name_t *foundname,
+	  dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *node = NULL;
+	isc_result_t result, tresult;
+	qpdb_search_t search;
+	isc_boolean_t cname_ok = ISC_TRUE;
+	isc_boolean_t close_version = ISC_FALSE;
+	isc_boolean_t maybe_zonecut = ISC_FALSE;
+	isc_boolean_t wild = ISC_FALSE;
+	isc_boolean_t empty_node, active;
+	rdatasetheader_t *header, *found, *nsecheader;
+	rdatasetheader_t *foundsig, *cnamesig, *nsecsig;
+	qpdb_rdatatype_t sigtype;
+	dns_qpchain_t chain;
+	dns_fixedname_t fprev, fnext;
+	dns_name_t *prev, *next;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+	unsigned int i;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	INSIST(version == NULL ||
+	       ((qpdb_version_t *)version)->qpdb == qpdb);
+
+	/*
+	 * We don't care about 'now'.
+	 */
+	UNUSED(now);
+
+	/*
+	 * If the caller didn't supply a version, attach to the current
+	 * version.
+	 */
+	if (version == NULL) {
+		currentversion(db, &version);
+		close_version = ISC_TRUE;
+	}
+
+	search.qpdb = qpdb;
+	search.version = version;
+	search.serial = search.version->serial;
+	search.options = options;
+	search.tree = (options & DNS_DBFIND_FORCENSEC3) != 0 ? qpdb->nsec3 :
+							       qpdb->tree;
+	search.zonecut = NULL;
+	search.zonecut_rdataset = NULL;
+	search.zonecut_sigrdataset = NULL;
+	dns_fixedname_init(&search.zonecut_name);
+	search.now = 0;
+	search.locktype = isc_rwlocktype_read;
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	/*
+	 * Find the name or its closest ancestor, and check the ancestors
+	 * from the top down for active zone cuts.
+	 */
+	result = dns_qp_findname_ancestor(search.tree, name, (void **)&node,
+					  &chain);
+	if (result != ISC_R_SUCCESS && result != DNS_R_PARTIALMATCH)
+		goto tree_exit;
+
+	dns_name_init(&nname, offsets);
+	nodename(node, &nname);
+	tresult = dns_name_copy(&nname, foundname, NULL);
+	if (tresult != ISC_R_SUCCESS) {
+		result = tresult;
+		goto tree_exit;
+	}
+
+	if (search.tree == qpdb->tree) {
+		for (i = 0; i < chain.length; i++) {
+			if (check_zonecut(&search, chain.values[i])) {
+				result = DNS_R_PARTIALMATCH;
+				break;
+			}
+		}
+	}
+
+	if (result == DNS_R_PARTIALMATCH) {
+	partial_match:
+		if (search.zonecut != NULL) {
+			result = setup_delegation(&search, nodep, foundname,
+						  rdataset, sigrdataset);
+			goto tree_exit;
+		}
+
+		dns_fixedname_init(&fprev);
+		prev = dns_fixedname_name(&fprev);
+		dns_fixedname_init(&fnext);
+		next = dns_fixedname_name(&fnext);
+		find_neighbours(&search, name, prev, next);
+
+		/*
+		 * The name is an empty non-terminal if the next active
+		 * name is below it.
+		 */
+		active = ISC_TF(dns_name_countlabels(next) != 0 &&
+				dns_name_issubdomain(next, name));
+
+		if (!active && search.tree == qpdb->tree &&
+		    (options & DNS_DBFIND_NOWILD) == 0)
+		{
+			result = find_wildcard(&search, &node, name,
+					       prev, next);
+			if (result == ISC_R_SUCCESS) {
+				result = dns_name_copy(name, foundname, NULL);
+				if (result != ISC_R_SUCCESS)
+					goto tree_exit;
+				wild = ISC_TRUE;
+				goto found;
+			} else if (result != ISC_R_NOTFOUND)
+				goto tree_exit;
+		}
+
+		/*
+		 * If we're here, then the name does not exist, is not
+		 * beneath a zonecut, and there's no matching wildcard.
+		 */
+		if ((search.version->secure == dns_db_secure &&
+		     !search.version->havensec3) ||
+		    (options & DNS_DBFIND_FORCENSEC) != 0 ||
+		    (options & DNS_DBFIND_FORCENSEC3) != 0)
+		{
+			result = find_closest_nsec(&search, nodep, foundname,
+						   rdataset, sigrdataset,
+						   name);
+			if (result == ISC_R_SUCCESS)
+				result = active ? DNS_R_EMPTYNAME :
+						  DNS_R_NXDOMAIN;
+		} else
+			result = active ? DNS_R_EMPTYNAME : DNS_R_NXDOMAIN;
+		goto tree_exit;
+	}
+
+ found:
+	/*
+	 * We have found a node whose name is the desired name, or we
+	 * have matched a wildcard.
+	 */
+
+	if (search.zonecut != NULL) {
+		/*
+		 * If we're beneath a zone cut, we don't want to look for
+		 * CNAMEs because they're not legitimate zone glue.
+		 */
+		cname_ok = ISC_FALSE;
+	} else {
+		/*
+		 * The node may be a zone cut itself.  If it might be one,
+		 * make sure we check for it later.
+		 *
+		 * DS records live above the zone cut in ordinary zone so
+		 * we want to ignore any referral.
+		 *
+		 * Stub zones don't have anything "above" the delgation so
+		 * we always return a referral.
+		 */
+		if (node->delegating &&
+		    ((node != qpdb->origin_node &&
+		      !dns_rdatatype_atparent(type)) ||
+		     IS_STUB(qpdb)))
+			maybe_zonecut = ISC_TRUE;
+	}
+
+	/*
+	 * Certain DNSSEC types are not subject to CNAME matching
+	 * (RFC4035, section 2.5 and RFC3007).
+	 *
+	 * We don't check for RRSIG, because we don't store RRSIG records
+	 * directly.
+	 */
+	if (type == dns_rdatatype_key || type == dns_rdatatype_nsec)
+		cname_ok = ISC_FALSE;
+
+	/*
+	 * We now go looking for rdata...
+	 */
+
+	found = NULL;
+	foundsig = NULL;
+	sigtype = QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, type);
+	nsecheader = NULL;
+	nsecsig = NULL;
+	cnamesig = NULL;
+	empty_node = ISC_TRUE;
+	for (header = node->data; header != NULL; header = header->next) {
+		/*
+		 * Look for an active, extant rdataset.
+		 */
+		rdatasetheader_t *active_h = active_header(header,
+							   search.serial);
+		if (active_h == NULL)
+			continue;
+
+		/*
+		 * We now know that there is at least one active
+		 * rdataset at this node.
+		 */
+		empty_node = ISC_FALSE;
+
+		/*
+		 * Do special zone cut handling, if requested.
+		 */
+		if (maybe_zonecut && active_h->type == dns_rdatatype_ns) {
+			search.zonecut = node;
+			search.zonecut_rdataset = active_h;
+			search.zonecut_sigrdataset = NULL;
+			RUNTIME_CHECK(dns_name_copy(&nname,
+				dns_fixedname_name(&search.zonecut_name),
+				NULL) == ISC_R_SUCCESS);
+			maybe_zonecut = ISC_FALSE;
+			/*
+			 * It is not clear if KEY should still be
+			 * allowed at the parent side of the zone
+			 * cut or not.  It is needed for RFC3007
+			 * validated updates.
+			 */
+			if ((options & DNS_DBFIND_GLUEOK) == 0 &&
+			    type != dns_rdatatype_nsec &&
+			    type != dns_rdatatype_key) {
+				/*
+				 * Glue is not OK, but any answer we
+				 * could return would be glue.  Return
+				 * the delegation.
+				 */
+				found = NULL;
+				break;
+			}
+			if (found != NULL && foundsig != NULL)
+				break;
+		}
+
+		/*
+		 * If the NSEC3 record doesn't match the chain
+		 * we are using behave as if it isn't here.
+		 */
+		if (active_h->type == dns_rdatatype_nsec3 &&
+		    !matchparams(active_h, &search))
+			goto partial_match;
+
+		/*
+		 * If we found a type we were looking for,
+		 * remember it.
+		 */
+		if (active_h->type == type ||
+		    type == dns_rdatatype_any ||
+		    (active_h->type == dns_rdatatype_cname && cname_ok)) {
+			/*
+			 * We've found the answer!
+			 */
+			found = active_h;
+			if (active_h->type == dns_rdatatype_cname &&
+			    cname_ok) {
+				/*
+				 * We may be finding a CNAME instead
+				 * of the desired type.
+				 *
+				 * If we've already got the CNAME RRSIG,
+				 * use it, otherwise change sigtype
+				 * so that we find it.
+				 */
+				if (cnamesig != NULL)
+					foundsig = cnamesig;
+				else
+					sigtype = QPDB_RDATATYPE_SIGCNAME;
+			}
+			/*
+			 * If we've got all we need, end the search.
+			 */
+			if (!maybe_zonecut && foundsig != NULL)
+				break;
+		} else if (active_h->type == sigtype) {
+			/*
+			 * We've found the RRSIG rdataset for our
+			 * target type.  Remember it.
+			 */
+			foundsig = active_h;
+			/*
+			 * If we've got all we need, end the search.
+			 */
+			if (!maybe_zonecut && found != NULL)
+				break;
+		} else if (active_h->type == dns_rdatatype_nsec &&
+			   !search.version->havensec3) {
+			/*
+			 * Remember a NSEC rdataset even if we're
+			 * not specifically looking for it, because
+			 * we might need it later.
+			 */
+			nsecheader = active_h;
+		} else if (active_h->type == QPDB_RDATATYPE_SIGNSEC &&
+			   !search.version->havensec3) {
+			/*
+			 * If we need the NSEC rdataset, we'll also
+			 * need its signature.
+			 */
+			nsecsig = active_h;
+		} else if (cname_ok &&
+			   active_h->type == QPDB_RDATATYPE_SIGCNAME) {
+			/*
+			 * If we get a CNAME match, we'll also need
+			 * its signature.
+			 */
+			cnamesig = active_h;
+		}
+	}
+
+	if (empty_node) {
+		/*
+		 * We have an exact match for the name, but there are no
+		 * active rdatasets in the desired version.  That means that
+		 * this node doesn't exist in the desired version, and that
+		 * we really have a partial match.
+		 */
+		if (!wild)
+			goto partial_match;
+	}
+
+	/*
+	 * If we didn't find what we were looking for...
+	 */
+	if (found == NULL) {
+		if (search.zonecut != NULL) {
+			/*
+			 * We were trying to find glue at a node beneath a
+			 * zone cut, but didn't.
+			 *
+			 * Return the delegation.
+			 */
+			result = setup_delegation(&search, nodep, foundname,
+						  rdataset, sigrdataset);
+			goto tree_exit;
+		}
+		/*
+		 * The desired type doesn't exist.
+		 */
+		result = DNS_R_NXRRSET;
+		if (search.version->secure == dns_db_secure &&
+		    !search.version->havensec3 &&
+		    (nsecheader == NULL || nsecsig == NULL)) {
+			/*
+			 * The zone is secure but there's no NSEC,
+			 * or the NSEC has no signature!
+			 */
+			if (!wild) {
+				result = DNS_R_BADDB;
+				goto tree_exit;
+			}
+
+			result = find_closest_nsec(&search, nodep, foundname,
+						   rdataset, sigrdataset,
+						   name);
+			if (result == ISC_R_SUCCESS)
+				result = DNS_R_EMPTYWILD;
+			goto tree_exit;
+		}
+		if ((options & DNS_DBFIND_FORCENSEC) != 0 &&
+		    nsecheader == NULL)
+		{
+			/*
+			 * There's no NSEC record, and we were told
+			 * to find one.
+			 */
+			result = DNS_R_BADDB;
+			goto tree_exit;
+		}
+		if (nodep != NULL) {
+			new_reference(qpdb, node);
+			*nodep = node;
+		}
+		if ((search.version->secure == dns_db_secure &&
+		     !search.version->havensec3) ||
+		    (options & DNS_DBFIND_FORCENSEC) != 0)
+		{
+			bind_rdataset(qpdb, node, nsecheader, 0, rdataset);
+			if (nsecsig != NULL)
+				bind_rdataset(qpdb, node, nsecsig, 0,
+					      sigrdataset);
+		}
+		if (wild)
+			foundname->attributes |= DNS_NAMEATTR_WILDCARD;
+		goto tree_exit;
+	}
+
+	/*
+	 * We found what we were looking for, or we found a CNAME.
+	 */
+
+	if (type != found->type &&
+	    type != dns_rdatatype_any &&
+	    found->type == dns_rdatatype_cname) {
+		/*
+		 * We weren't doing an ANY query and we found a CNAME instead
+		 * of the type we were looking for, so we need to indicate
+		 * that result to the caller.
+		 */
+		result = DNS_R_CNAME;
+	} else if (search.zonecut != NULL) {
+		/*
+		 * If we're beneath a zone cut, we must indicate that the
+		 * result is glue, unless we're actually at the zone cut
+		 * and the type is NSEC or KEY.
+		 */
+		if (search.zonecut == node) {
+			/*
+			 * It is not clear if KEY should still be
+			 * allowed at the parent side of the zone
+			 * cut or not.  It is needed for RFC3007
+			 * validated updates.
+			 */
+			if (type == dns_rdatatype_nsec ||
+			    type == dns_rdatatype_nsec3 ||
+			    type == dns_rdatatype_key)
+				result = ISC_R_SUCCESS;
+			else if (type == dns_rdatatype_any)
+				result = DNS_R_ZONECUT;
+			else
+				result = DNS_R_GLUE;
+		} else
+			result = DNS_R_GLUE;
+		/*
+		 * We might have found data that isn't glue, but was occluded
+		 * by a dynamic update.  If the caller cares about this, they
+		 * will have told us to validate glue.
+		 */
+		if (result == DNS_R_GLUE &&
+		    (options & DNS_DBFIND_VALIDATEGLUE) != 0 &&
+		    !valid_glue(&search, foundname, type, node)) {
+			result = setup_delegation(&search, nodep, foundname,
+						  rdataset, sigrdataset);
+			goto tree_exit;
+		}
+	} else {
+		/*
+		 * An ordinary successful query!
+		 */
+		result = ISC_R_SUCCESS;
+	}
+
+	if (nodep != NULL) {
+		new_reference(qpdb, node);
+		*nodep = node;
+	}
+
+	if (type != dns_rdatatype_any) {
+		bind_rdataset(qpdb, node, found, 0, rdataset);
+		if (foundsig != NULL)
+			bind_rdataset(qpdb, node, foundsig, 0, sigrdataset);
+	}
+
+	if (wild)
+		foundname->attributes |= DNS_NAMEATTR_WILDCARD;
+
+ tree_exit:
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	if (close_version)
+		closeversion(db, &version, ISC_FALSE);
+
+	return (result);
+}
+
+static isc_result_t
+zone_findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
+		 isc_stdtime_t now, dns_dbnode_t **nodep,
+		 dns_name_t *foundname,
+		 dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset)
+{
+	/*
+	 * The deepest zone cut is only meaningful in a cache; zone lookups
+	 * find delegations through zone_find().
+	 */
+	UNUSED(db);
+	UNUSED(name);
+	UNUSED(options);
+	UNUSED(now);
+	UNUSED(nodep);
+	UNUSED(foundname);
+	UNUSED(rdataset);
+	UNUSED(sigrdataset);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+/*%
+ * If a cache 'header' is no longer active, decide what to do with it:
+ * it may still be served stale, or if it expired long ago it is freed
+ * (or if the node is in use, marked ANCIENT) when the tree lock is or can
+ * be made exclusive.  Returns ISC_TRUE if the caller should skip the
+ * header.
+ *
+ * Freeing a header does not remove nodes from the trie, so iterators
+ * and ancestor chains stay valid; a node left without data is put on the
+ * dead node list instead.
+ *
+ * The caller must be holding the tree lock ('search->locktype').
+ */
+static isc_boolean_t
+check_stale_header(qpdb_node_t *node, rdatasetheader_t *header,
+		   qpdb_search_t *search, rdatasetheader_t **header_prev)
+{
+	dns_qpdb_t *qpdb = search->qpdb;
+
+	if (!ACTIVE(header, search->now)) {
+		dns_ttl_t stale = header->rdh_ttl + qpdb->serve_stale_ttl;
+		/*
+		 * If this data is in the stale window keep it and if
+		 * DNS_DBFIND_STALEOK is not set we tell the caller to
+		 * skip this record.
+		 */
+		if (KEEPSTALE(qpdb) && stale > search->now) {
+			if (!STALE(header)) {
+				if (search->locktype != isc_rwlocktype_write)
+					LOCK(&qpdb->lru_lock);
+				mark_header_stale(qpdb, header);
+				if (search->locktype != isc_rwlocktype_write)
+					UNLOCK(&qpdb->lru_lock);
+			}
+			return (ISC_TF((search->options &
+					DNS_DBFIND_STALEOK) == 0));
+		}
+
+		/*
+		 * This rdataset is stale.  If no one else is using the
+		 * node, we can clean it up right now, otherwise we mark
+		 * it as ancient, and the node as dirty, so it will get
+		 * cleaned up later.  We won't downgrade the lock, since
+		 * other rdatasets are probably stale, too.
+		 */
+		if ((header->rdh_ttl < search->now - QPDB_VIRTUAL) &&
+		    (search->locktype == isc_rwlocktype_write ||
+		     isc_rwlock_tryupgrade(&qpdb->tree_lock) == ISC_R_SUCCESS))
+		{
+			search->locktype = isc_rwlocktype_write;
+
+			if (isc_refcount_current(&node->references) == 0) {
+				clean_stale_headers(qpdb, header);
+				if (*header_prev != NULL)
+					(*header_prev)->next = header->next;
+				else
+					node->data = header->next;
+				free_rdataset(qpdb, header);
+				if (node->data == NULL) {
+					LOCK(&qpdb->dead_lock);
+					if (!ISC_LINK_LINKED(node, deadlink))
+						ISC_LIST_APPEND(qpdb->deadnodes,
+								node, deadlink);
+					UNLOCK(&qpdb->dead_lock);
+				}
+			} else {
+				mark_header_ancient(qpdb, header);
+				*header_prev = header;
+			}
+		} else
+			*header_prev = header;
+		return (ISC_TRUE);
+	}
+	return (ISC_FALSE);
+}
+
+static inline isc_boolean_t
+need_headerupdate(rdatasetheader_t *header) {
+	return (ISC_TF((header->attributes &
+			(RDATASET_ATTR_NONEXISTENT |
+			 RDATASET_ATTR_ANCIENT |
+			 RDATASET_ATTR_ZEROTTL)) == 0));
+}
+
+/*%
+ * Move 'header' to the head of the LRU list.  Its TTL has not changed,
+ * so the heap is left alone.
+ *
+ * The caller must be holding the tree lock for writing, or for reading
+ * and lru_lock as well.
+ */
+static void
+update_header(dns_qpdb_t *qpdb, rdatasetheader_t *header, isc_stdtime_t now) {
+	INSIST(IS_CACHE(qpdb));
+	INSIST(ISC_LINK_LINKED(header, link));
+
+	ISC_LIST_UNLINK(qpdb->lru, header, link);
+	header->last_used = now;
+	ISC_LIST_PREPEND(qpdb->lru, header, link);
+}
+
+/*%
+ * Record that a lookup has used 'header' and 'sigheader' (either may be
+ * NULL).
+ *
+ * The caller must be holding the tree lock ('search->locktype').
+ */
+static void
+update_headers(qpdb_search_t *search, rdatasetheader_t *header,
+	       rdatasetheader_t *sigheader)
+{
+	dns_qpdb_t *qpdb = search->qpdb;
+	isc_boolean_t locked;
+
+	if (header != NULL && !need_headerupdate(header))
+		header = NULL;
+	if (sigheader != NULL && !need_headerupdate(sigheader))
+		sigheader = NULL;
+	if (header == NULL && sigheader == NULL)
+		return;
+
+	locked = ISC_TF(search->locktype != isc_rwlocktype_write);
+	if (locked)
+		LOCK(&qpdb->lru_lock);
+	if (header != NULL)
+		update_header(qpdb, header, search->now);
+	if (sigheader != NULL)
+		update_header(qpdb, sigheader, search->now);
+	if (locked)
+		UNLOCK(&qpdb->lru_lock);
+}
+
+/*%
+ * If 'node' has a usable DNAME, make it the zone cut of the search.
+ * Returns ISC_TRUE if it does.
+ *
+ * The caller must be holding the tree lock.
+ */
+static isc_boolean_t
+check_cache_zonecut(qpdb_search_t *search, qpdb_node_t *node) {
+	rdatasetheader_t *header, *header_prev, *header_next;
+	rdatasetheader_t *dname_header, *sigdname_header;
+	dns_name_t name;
+	dns_offsets_t offsets;
+
+	REQUIRE(search->zonecut == NULL);
+
+	if (!node->delegating)
+		return (ISC_FALSE);
+
+	/*
+	 * Look for a DNAME or RRSIG DNAME rdataset.
+	 */
+	dname_header = NULL;
+	sigdname_header = NULL;
+	header_prev = NULL;
+	for (header = node->data; header != NULL; header = header_next) {
+		header_next = header->next;
+		if (check_stale_header(node, header, search, &header_prev)) {
+			/* Do nothing. */
+		} else if (header->type == dns_rdatatype_dname &&
+			   EXISTS(header) && !ANCIENT(header)) {
+			dname_header = header;
+			header_prev = header;
+		} else if (header->type == QPDB_RDATATYPE_SIGDNAME &&
+			   EXISTS(header) && !ANCIENT(header)) {
+			sigdname_header = header;
+			header_prev = header;
+		} else
+			header_prev = header;
+	}
+
+	if (dname_header == NULL ||
+	    (DNS_TRUST_PENDING(dname_header->trust) &&
+	     (search->options & DNS_DBFIND_PENDINGOK) == 0))
+		return (ISC_FALSE);
+
+	search->zonecut = node;
+	search->zonecut_rdataset = dname_header;
+	search->zonecut_sigrdataset = sigdname_header;
+	dns_name_init(&name, offsets);
+	nodename(node, &name);
+	RUNTIME_CHECK(dns_name_copy(&name,
+				    dns_fixedname_name(&search->zonecut_name),
+				    NULL) == ISC_R_SUCCESS);
+	return (ISC_TRUE);
+}
+
+/*%
+ * Look for the deepest cached NS rdataset at 'node' or above it; the
+ * ancestors of 'node' are in 'chain'.
+ *
+ * The caller must be holding the tree lock.
+ */
+static isc_result_t
+find_deepest_zonecut(qpdb_search_t *search, qpdb_node_t *node,
+		     dns_qpchain_t *chain, dns_dbnode_t **nodep,
+		     dns_name_t *foundname, dns_rdataset_t *rdataset,
+		     dns_rdataset_t *sigrdataset)
+{
+	rdatasetheader_t *header, *header_prev, *header_next;
+	rdatasetheader_t *found, *foundsig;
+	dns_name_t name;
+	dns_offsets_t offsets;
+	isc_result_t result;
+	unsigned int i;
+
+	i = chain->length;
+	if (i > 0 && chain->values[i - 1] == node)
+		i--;
+	for (;;) {
+		/*
+		 * Look for NS and RRSIG NS rdatasets.
+		 */
+		found = NULL;
+		foundsig = NULL;
+		header_prev = NULL;
+		for (header = node->data; header != NULL; header = header_next)
+		{
+			header_next = header->next;
+			if (check_stale_header(node, header, search,
+					       &header_prev)) {
+				/* Do nothing. */
+			} else if (EXISTS(header) && !ANCIENT(header)) {
+				/*
+				 * We've found an extant rdataset.  See if
+				 * we're interested in it.
+				 */
+				if (header->type == dns_rdatatype_ns)
+					found = header;
+				else if (header->type == QPDB_RDATATYPE_SIGNS)
+					foundsig = header;
+				header_prev = header;
+			} else
+				header_prev = header;
+		}
+		if (found != NULL)
+			break;
+		if (i == 0)
+			return (ISC_R_NOTFOUND);
+		node = chain->values[--i];
+	}
+
+	if (foundname != NULL) {
+		dns_name_init(&name, offsets);
+		nodename(node, &name);
+		result = dns_name_copy(&name, foundname, NULL);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+	if (nodep != NULL) {
+		new_reference(search->qpdb, node);
+		*nodep = node;
+	}
+	bind_rdataset(search->qpdb, node, found, search->now, rdataset);
+	if (foundsig != NULL)
+		bind_rdataset(search->qpdb, node, foundsig, search->now,
+			      sigrdataset);
+	update_headers(search, found, foundsig);
+
+	return (DNS_R_DELEGATION);
+}
+
+/*%
+ * Look for a cached NSEC record which covers 'name', on the nearest
+ * node before it which has anything more than noqname proofs and
+ * signatures.
+ *
+ * The caller must be holding the tree lock.
+ */
+static isc_result_t
+find_coveringnsec(qpdb_search_t *search, const dns_name_t *name,
+		  dns_dbnode_t **nodep, dns_name_t *foundname,
+		  dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset)
+{
+	dns_qpiter_t iter;
+	qpdb_node_t *node = NULL;
+	rdatasetheader_t *header, *header_next, *header_prev;
+	rdatasetheader_t *found, *foundsig;
+	isc_boolean_t empty_node;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+	isc_result_t result;
+
+	dns_qpiter_init(search->tree, &iter);
+	result = dns_qpiter_seek(&iter, name, (void **)&node);
+	if (result == DNS_R_PARTIALMATCH)
+		result = ISC_R_SUCCESS;
+
+	while (result == ISC_R_SUCCESS) {
+		found = NULL;
+		foundsig = NULL;
+		empty_node = ISC_TRUE;
+		header_prev = NULL;
+		for (header = node->data; header != NULL; header = header_next)
+		{
+			header_next = header->next;
+			if (check_stale_header(node, header, search,
+					       &header_prev)) {
+				continue;
+			}
+			if (NONEXISTENT(header) || ANCIENT(header) ||
+			    QPDB_RDATATYPE_BASE(header->type) == 0) {
+				header_prev = header;
+				continue;
+			}
+			/*
+			 * Don't stop on provable noqname / RRSIG.
+			 */
+			if (header->noqname == NULL &&
+			    QPDB_RDATATYPE_BASE(header->type) !=
+			    dns_rdatatype_rrsig)
+			{
+				empty_node = ISC_FALSE;
+			}
+			if (header->type == dns_rdatatype_nsec)
+				found = header;
+			else if (header->type == QPDB_RDATATYPE_SIGNSEC)
+				foundsig = header;
+			header_prev = header;
+		}
+		if (found != NULL) {
+			dns_name_init(&nname, offsets);
+			nodename(node, &nname);
+			result = dns_name_copy(&nname, foundname, NULL);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+			bind_rdataset(search->qpdb, node, found, search->now,
+				      rdataset);
+			if (foundsig != NULL)
+				bind_rdataset(search->qpdb, node, foundsig,
+					      search->now, sigrdataset);
+			if (nodep != NULL) {
+				new_reference(search->qpdb, node);
+				*nodep = node;
+			}
+			return (DNS_R_COVERINGNSEC);
+		}
+		if (!empty_node)
+			break;
+		result = dns_qpiter_prev(&iter, (void **)&node);
+	}
+
+	return (ISC_R_NOTFOUND);
+}
+
+/*%
+ * Find the cached NSEC3 record whose owner is 'name', or failing that
+ * the one whose owner precedes 'name' in the hash order of the zone
+ * that 'name' is directly below.  If no earlier NSEC3 record of the
+ * zone is cached, wrap around to the last one, which covers the start
+ * of the chain.
+ *
+ * The NSEC3 owners sort among the other names of the zone, so when the
+ * walk reaches a name below one of the zone's children it skips to the
+ * child, passing over the whole subtree.  Only QPDB_NSEC3_MAXSTEPS nodes
+ * are examined.
+ *
+ * The caller must be holding the tree lock.
+ */
+static isc_result_t
+find_coveringnsec3(qpdb_search_t *search, const dns_name_t *name,
+		   dns_dbnode_t **nodep, dns_name_t *foundname,
+		   dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset)
+{
+	static unsigned char maxlabel[] = { 1, 0xff };
+	dns_qpdb_t *qpdb = search->qpdb;
+	dns_qpiter_t iter;
+	qpdb_node_t *node = NULL;
+	rdatasetheader_t *header, *header_next, *header_prev;
+	rdatasetheader_t *found, *foundsig;
+	dns_fixedname_t fzone, fmax;
+	dns_name_t *zone;
+	dns_name_t maxname, owner, child;
+	dns_offsets_t offsets;
+	const dns_name_t *target = name;
+	isc_region_t r;
+	isc_boolean_t wrapped = ISC_FALSE;
+	unsigned int labels, steps = 0;
+	isc_result_t result;
+
+	labels = dns_name_countlabels(name);
+	if (labels < 2)
+		return (ISC_R_NOTFOUND);
+
+	dns_fixedname_init(&fzone);
+	zone = dns_fixedname_name(&fzone);
+	dns_name_split(name, labels - 1, NULL, zone);
+	dns_name_init(&owner, offsets);
+
+ search:
+	dns_qpiter_init(qpdb->tree, &iter);
+	result = dns_qpiter_seek(&iter, target, (void **)&node);
+	if (result == DNS_R_PARTIALMATCH)
+		result = ISC_R_SUCCESS;
+
+	while (result == ISC_R_SUCCESS) {
+		if (++steps > QPDB_NSEC3_MAXSTEPS)
+			return (ISC_R_NOTFOUND);
+
+		nodename(node, &owner);
+
+		/*
+		 * Everything preceding the zone itself is outside it.
+		 */
+		if (!dns_name_issubdomain(&owner, zone) ||
+		    dns_name_equal(&owner, zone))
+			break;
+
+		if (dns_name_countlabels(&owner) > labels) {
+			/*
+			 * Skip to the child of the zone this name is
+			 * below, or to whatever precedes it.
+			 */
+			dns_name_init(&child, NULL);
+			dns_name_getlabelsequence(&owner,
+					dns_name_countlabels(&owner) - labels,
+					labels, &child);
+			result = dns_qpiter_seek(&iter, &child,
+						 (void **)&node);
+			if (result == DNS_R_PARTIALMATCH)
+				result = ISC_R_SUCCESS;
+			continue;
+		}
+
+		found = NULL;
+		foundsig = NULL;
+		header_prev = NULL;
+		for (header = node->data; header != NULL; header = header_next)
+		{
+			header_next = header->next;
+			if (check_stale_header(node, header, search,
+					       &header_prev)) {
+				continue;
+			}
+			if (EXISTS(header) && !ANCIENT(header)) {
+				if (header->type == dns_rdatatype_nsec3)
+					found = header;
+				else if (header->type ==
+					 QPDB_RDATATYPE_SIGNSEC3)
+					foundsig = header;
+			}
+			header_prev = header;
+		}
+		if (found != NULL) {
+			result = dns_name_copy(&owner, foundname, NULL);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+			bind_rdataset(qpdb, node, found, search->now, rdataset);
+			if (foundsig != NULL)
+				bind_rdataset(qpdb, node, foundsig,
+					      search->now, sigrdataset);
+			if (nodep != NULL) {
+				new_reference(qpdb, node);
+				*nodep = node;
+			}
+			if (!dns_name_equal(&owner, name))
+				return (DNS_R_COVERINGNSEC);
+			return (ISC_R_SUCCESS);
+		}
+
+		result = dns_qpiter_prev(&iter, (void **)&node);
+	}
+
+	/*
+	 * Nothing precedes 'name' in the zone; restart from the
+	 * end of the zone's hash order.
+	 */
+	if (wrapped)
+		return (ISC_R_NOTFOUND);
+	wrapped = ISC_TRUE;
+	dns_name_init(&maxname, NULL);
+	r.base = maxlabel;
+	r.length = sizeof(maxlabel);
+	dns_name_fromregion(&maxname, &r);
+	dns_fixedname_init(&fmax);
+	result = dns_name_concatenate(&maxname, zone,
+				      dns_fixedname_name(&fmax), NULL);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	target = dns_fixedname_name(&fmax);
+	goto search;
+}
+
+static isc_result_t
+cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
+	   dns_rdatatype_t type, unsigned int options, isc_stdtime_t now,
+	   dns_dbnode_t **nodep, dns_name_t *foundname,
+	   dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *node = NULL;
+	isc_result_t result, tresult;
+	qpdb_search_t search;
+	isc_boolean_t cname_ok = ISC_TRUE;
+	isc_boolean_t empty_node;
+	rdatasetheader_t *header, *header_prev, *header_next;
+	rdatasetheader_t *found, *nsheader;
+	rdatasetheader_t *foundsig, *nssig, *cnamesig;
+	rdatasetheader_t *nsecheader, *nsecsig;
+	qpdb_rdatatype_t sigtype, negtype;
+	dns_qpchain_t chain;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+	unsigned int i;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(version == NULL);
+
+	if (now == 0)
+		isc_stdtime_get(&now);
+
+	search.qpdb = qpdb;
+	search.version = NULL;
+	search.serial = 1;
+	search.options = options;
+	search.tree = qpdb->tree;
+	search.zonecut = NULL;
+	search.zonecut_rdataset = NULL;
+	search.zonecut_sigrdataset = NULL;
+	dns_fixedname_init(&search.zonecut_name);
+	search.now = now;
+	search.locktype = isc_rwlocktype_read;
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	/*
+	 * Covering NSEC3 records are looked up by their hashed owner
+	 * names, which sort among the other names of their zone.
+	 */
+	if (type == dns_rdatatype_nsec3 &&
+	    (options & DNS_DBFIND_FORCENSEC3) != 0 &&
+	    (options & DNS_DBFIND_COVERINGNSEC) != 0)
+	{
+		result = find_coveringnsec3(&search, name, nodep, foundname,
+					    rdataset, sigrdataset);
+		RWUNLOCK(&qpdb->tree_lock, search.locktype);
+		return (result);
+	}
+
+	/*
+	 * Find the name or its closest ancestor, and check the ancestors
+	 * from the top down for a DNAME.
+	 */
+	result = dns_qp_findname_ancestor(search.tree, name, (void **)&node,
+					  &chain);
+	if (result != ISC_R_SUCCESS && result != DNS_R_PARTIALMATCH)
+		goto tree_exit;
+
+	dns_name_init(&nname, offsets);
+	nodename(node, &nname);
+	tresult = dns_name_copy(&nname, foundname, NULL);
+	if (tresult != ISC_R_SUCCESS) {
+		result = tresult;
+		goto tree_exit;
+	}
+
+	for (i = 0; i < chain.length; i++) {
+		if (check_cache_zonecut(&search, chain.values[i])) {
+			result = DNS_R_PARTIALMATCH;
+			break;
+		}
+	}
+
+	if (result == DNS_R_PARTIALMATCH) {
+		if ((search.options & DNS_DBFIND_COVERINGNSEC) != 0) {
+			/*
+			 * Below a DNAME, look from the DNAME owner.
+			 */
+			result = find_coveringnsec(&search,
+					search.zonecut != NULL ?
+					dns_fixedname_name(&search.zonecut_name) :
+					name,
+					nodep, foundname, rdataset,
+					sigrdataset);
+			if (result == DNS_R_COVERINGNSEC)
+				goto tree_exit;
+		}
+		if (search.zonecut != NULL) {
+			result = setup_delegation(&search, nodep, foundname,
+						  rdataset, sigrdataset);
+			goto tree_exit;
+		} else {
+		find_ns:
+			result = find_deepest_zonecut(&search, node, &chain,
+						      nodep, foundname,
+						      rdataset, sigrdataset);
+			goto tree_exit;
+		}
+	}
+
+	/*
+	 * Certain DNSSEC types are not subject to CNAME matching
+	 * (RFC4035, section 2.5 and RFC3007).
+	 *
+	 * We don't check for RRSIG, because we don't store RRSIG records
+	 * directly.
+	 */
+	if (type == dns_rdatatype_key || type == dns_rdatatype_nsec)
+		cname_ok = ISC_FALSE;
+
+	/*
+	 * We now go looking for rdata...
+	 */
+
+	found = NULL;
+	foundsig = NULL;
+	sigtype = QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, type);
+	negtype = QPDB_RDATATYPE_VALUE(0, type);
+	nsheader = NULL;
+	nsecheader = NULL;
+	nssig = NULL;
+	nsecsig = NULL;
+	cnamesig = NULL;
+	empty_node = ISC_TRUE;
+	header_prev = NULL;
+	for (header = node->data; header != NULL; header = header_next) {
+		header_next = header->next;
+		if (check_stale_header(node, header, &search, &header_prev)) {
+			/* Do nothing. */
+		} else if (EXISTS(header) && !ANCIENT(header)) {
+			/*
+			 * We now know that there is at least one active
+			 * non-stale rdataset at this node.
+			 */
+			empty_node = ISC_FALSE;
+
+			/*
+			 * If we found a type we were looking for, remember
+			 * it.
+			 */
+			if (header->type == type ||
+			    (type == dns_rdatatype_any &&
+			     QPDB_RDATATYPE_BASE(header->type) != 0) ||
+			    (cname_ok && header->type ==
+			     dns_rdatatype_cname)) {
+				/*
+				 * We've found the answer.
+				 */
+				found = header;
+				if (header->type == dns_rdatatype_cname &&
+				    cname_ok &&
+				    cnamesig != NULL) {
+					/*
+					 * If we've already got the
+					 * CNAME RRSIG, use it.
+					 */
+					foundsig = cnamesig;
+				}
+			} else if (header->type == sigtype) {
+				/*
+				 * We've found the RRSIG rdataset for our
+				 * target type.  Remember it.
+				 */
+				foundsig = header;
+			} else if (header->type == QPDB_RDATATYPE_NCACHEANY ||
+				   header->type == negtype) {
+				/*
+				 * We've found a negative cache entry.
+				 */
+				found = header;
+			} else if (header->type == dns_rdatatype_ns) {
+				/*
+				 * Remember a NS rdataset even if we're
+				 * not specifically looking for it, because
+				 * we might need it later.
+				 */
+				nsheader = header;
+			} else if (header->type == QPDB_RDATATYPE_SIGNS) {
+				/*
+				 * If we need the NS rdataset, we'll also
+				 * need its signature.
+				 */
+				nssig = header;
+			} else if (header->type == dns_rdatatype_nsec) {
+				nsecheader = header;
+			} else if (header->type == QPDB_RDATATYPE_SIGNSEC) {
+				nsecsig = header;
+			} else if (cname_ok &&
+				   header->type == QPDB_RDATATYPE_SIGCNAME) {
+				/*
+				 * If we get a CNAME match, we'll also need
+				 * its signature.
+				 */
+				cnamesig = header;
+			}
+			header_prev = header;
+		} else
+			header_prev = header;
+	}
+
+	if (empty_node) {
+		/*
+		 * We have an exact match for the name, but there are no
+		 * extant rdatasets.  That means that this node doesn't
+		 * meaningfully exist, and that we really have a partial match.
+		 */
+		goto find_ns;
+	}
+
+	/*
+	 * If we didn't find what we were looking for...
+	 */
+	if (found == NULL ||
+	    (DNS_TRUST_ADDITIONAL(found->trust) &&
+	     ((options & DNS_DBFIND_ADDITIONALOK) == 0)) ||
+	    (found->trust == dns_trust_glue &&
+	     ((options & DNS_DBFIND_GLUEOK) == 0)) ||
+	    (DNS_TRUST_PENDING(found->trust) &&
+	     ((options & DNS_DBFIND_PENDINGOK) == 0))) {
+
+		/*
+		 * Return covering NODATA NSEC record.
+		 */
+		if ((search.options & DNS_DBFIND_COVERINGNSEC) != 0 &&
+		    nsecheader != NULL)
+		{
+			if (nodep != NULL) {
+				new_reference(qpdb, node);
+				*nodep = node;
+			}
+			bind_rdataset(qpdb, node, nsecheader, now, rdataset);
+			if (nsecsig != NULL)
+				bind_rdataset(qpdb, node, nsecsig, now,
+					      sigrdataset);
+			update_headers(&search, nsecheader, nsecsig);
+			result = DNS_R_COVERINGNSEC;
+			goto tree_exit;
+		}
+
+		/*
+		 * If there is an NS rdataset at this node, then this is the
+		 * deepest zone cut.
+		 */
+		if (nsheader != NULL) {
+			if (nodep != NULL) {
+				new_reference(qpdb, node);
+				*nodep = node;
+			}
+			bind_rdataset(qpdb, node, nsheader, now, rdataset);
+			if (nssig != NULL)
+				bind_rdataset(qpdb, node, nssig, now,
+					      sigrdataset);
+			update_headers(&search, nsheader, nssig);
+			result = DNS_R_DELEGATION;
+			goto tree_exit;
+		}
+
+		/*
+		 * Go find the deepest zone cut.
+		 */
+		goto find_ns;
+	}
+
+	/*
+	 * We found what we were looking for, or we found a CNAME.
+	 */
+
+	if (nodep != NULL) {
+		new_reference(qpdb, node);
+		*nodep = node;
+	}
+
+	if (NEGATIVE(found)) {
+		/*
+		 * We found a negative cache entry.
+		 */
+		if (NXDOMAIN(found))
+			result = DNS_R_NCACHENXDOMAIN;
+		else
+			result = DNS_R_NCACHENXRRSET;
+	} else if (type != found->type &&
+		   type != dns_rdatatype_any &&
+		   found->type == dns_rdatatype_cname) {
+		/*
+		 * We weren't doing an ANY query and we found a CNAME instead
+		 * of the type we were looking for, so we need to indicate
+		 * that result to the caller.
+		 */
+		result = DNS_R_CNAME;
+	} else {
+		/*
+		 * An ordinary successful query!
+		 */
+		result = ISC_R_SUCCESS;
+	}
+
+	if (type != dns_rdatatype_any || result == DNS_R_NCACHENXDOMAIN ||
+	    result == DNS_R_NCACHENXRRSET) {
+		bind_rdataset(qpdb, node, found, now, rdataset);
+		if (!NEGATIVE(found) && foundsig != NULL)
+			bind_rdataset(qpdb, node, foundsig, now, sigrdataset);
+		else
+			foundsig = NULL;
+		update_headers(&search, found, foundsig);
+	}
+
+ tree_exit:
+	RWUNLOCK(&qpdb->tree_lock, search.locktype);
+
+	update_cachestats(qpdb, result);
+	return (result);
+}
+
+static isc_result_t
+cache_findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
+		  isc_stdtime_t now, dns_dbnode_t **nodep,
+		  dns_name_t *foundname,
+		  dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *node = NULL;
+	rdatasetheader_t *header, *header_prev, *header_next;
+	rdatasetheader_t *found, *foundsig;
+	isc_result_t result;
+	qpdb_search_t search;
+	dns_qpchain_t chain;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	if (now == 0)
+		isc_stdtime_get(&now);
+
+	search.qpdb = qpdb;
+	search.version = NULL;
+	search.serial = 1;
+	search.options = options;
+	search.tree = qpdb->tree;
+	search.zonecut = NULL;
+	search.zonecut_rdataset = NULL;
+	search.zonecut_sigrdataset = NULL;
+	dns_fixedname_init(&search.zonecut_name);
+	search.now = now;
+	search.locktype = isc_rwlocktype_read;
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	/*
+	 * Search down from the root of the tree.
+	 */
+	result = dns_qp_findname_ancestor(search.tree, name, (void **)&node,
+					  &chain);
+	if (result == ISC_R_SUCCESS &&
+	    (options & DNS_DBFIND_NOEXACT) != 0)
+	{
+		/*
+		 * Start from the parent.
+		 */
+		if (chain.length == 0) {
+			result = ISC_R_NOTFOUND;
+			goto tree_exit;
+		}
+		node = chain.values[chain.length - 1];
+		result = DNS_R_PARTIALMATCH;
+	}
+
+	if (result == DNS_R_PARTIALMATCH) {
+	find_ns:
+		result = find_deepest_zonecut(&search, node, &chain, nodep,
+					      foundname, rdataset,
+					      sigrdataset);
+		goto tree_exit;
+	} else if (result != ISC_R_SUCCESS)
+		goto tree_exit;
+
+	/*
+	 * We now go looking for an NS rdataset at the node.
+	 */
+
+	found = NULL;
+	foundsig = NULL;
+	header_prev = NULL;
+	for (header = node->data; header != NULL; header = header_next) {
+		header_next = header->next;
+		if (check_stale_header(node, header, &search, &header_prev)) {
+			/* Do nothing. */
+		} else if (EXISTS(header) && !ANCIENT(header)) {
+			/*
+			 * If we found a type we were looking for, remember
+			 * it.
+			 */
+			if (header->type == dns_rdatatype_ns) {
+				/*
+				 * Remember a NS rdataset even if we're
+				 * not specifically looking for it, because
+				 * we might need it later.
+				 */
+				found = header;
+			} else if (header->type == QPDB_RDATATYPE_SIGNS) {
+				/*
+				 * If we need the NS rdataset, we'll also
+				 * need its signature.
+				 */
+				foundsig = header;
+			}
+			header_prev = header;
+		} else
+			header_prev = header;
+	}
+
+	if (found == NULL) {
+		/*
+		 * No NS records here.
+		 */
+		goto find_ns;
+	}
+
+	if (foundname != NULL) {
+		dns_name_init(&nname, offsets);
+		nodename(node, &nname);
+		result = dns_name_copy(&nname, foundname, NULL);
+		if (result != ISC_R_SUCCESS)
+			goto tree_exit;
+	}
+
+	if (nodep != NULL) {
+		new_reference(qpdb, node);
+		*nodep = node;
+	}
+
+	bind_rdataset(qpdb, node, found, now, rdataset);
+	if (foundsig != NULL)
+		bind_rdataset(qpdb, node, foundsig, now, sigrdataset);
+	update_headers(&search, found, foundsig);
+
+ tree_exit:
+	RWUNLOCK(&qpdb->tree_lock, search.locktype);
+
+	if (result == DNS_R_DELEGATION)
+		result = ISC_R_SUCCESS;
+
+	return (result);
+}
+
+static void
+attachnode(dns_db_t *db, dns_dbnode_t *source, dns_dbnode_t **targetp) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *node = (qpdb_node_t *)source;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	new_reference(qpdb, node);
+
+	*targetp = source;
+}
+
+static void
+detachnode(dns_db_t *db, dns_dbnode_t **targetp) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *node;
+	isc_boolean_t want_free;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(targetp != NULL && *targetp != NULL);
+
+	node = (qpdb_node_t *)(*targetp);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	want_free = decrement_reference(qpdb, node, 0, isc_rwlocktype_read);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	*targetp = NULL;
+
+	if (want_free)
+		free_qpdb(qpdb);
+}
+
+static isc_result_t
+expirenode(dns_db_t *db, dns_dbnode_t *node, isc_stdtime_t now) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *qpnode = node;
+	rdatasetheader_t *header;
+	isc_boolean_t force_expire = ISC_FALSE;
+	/*
+	 * These are the category and module used by the cache cleaner.
+	 */
+	isc_boolean_t log = ISC_FALSE;
+	isc_logcategory_t *category = DNS_LOGCATEGORY_DATABASE;
+	isc_logmodule_t *module = DNS_LOGMODULE_CACHE;
+	int level = ISC_LOG_DEBUG(2);
+	char printname[DNS_NAME_FORMATSIZE];
+	dns_name_t name;
+	dns_offsets_t offsets;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	/*
+	 * Only the cache cleaner expires nodes.
+	 */
+	if (!IS_CACHE(qpdb))
+		return (ISC_R_NOTIMPLEMENTED);
+
+	if (now == 0)
+		isc_stdtime_get(&now);
+
+	if (isc_mem_isovermem(qpdb->common.mctx)) {
+		isc_uint32_t val;
+
+		isc_random_get(&val);
+		force_expire = ISC_TF(val % 4 == 0);
+
+		log = ISC_TF(isc_log_wouldlog(dns_lctx, level));
+		if (log) {
+			dns_name_init(&name, offsets);
+			nodename(qpnode, &name);
+			dns_name_format(&name, printname, sizeof(printname));
+			isc_log_write(dns_lctx, category, module, level,
+				      "overmem cache: %s %s",
+				      force_expire ? "FORCE" : "check",
+				      printname);
+		}
+	}
+
+	/*
+	 * We may not need write access, but this code path is not
+	 * performance sensitive, so it should be okay to always lock as a
+	 * writer.
+	 */
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	for (header = qpnode->data; header != NULL; header = header->next)
+		if (header->rdh_ttl <= now - QPDB_VIRTUAL) {
+			/*
+			 * We don't try to free the header like cache_find()
+			 * does, because the caller holds a reference to
+			 * 'node'.
+			 */
+			mark_header_ancient(qpdb, header);
+			if (log)
+				isc_log_write(dns_lctx, category, module,
+					      level, "overmem cache: stale %s",
+					      printname);
+		} else if (force_expire) {
+			set_ttl(qpdb, header, 0);
+			mark_header_ancient(qpdb, header);
+		} else if (log)
+			isc_log_write(dns_lctx, category, module, level,
+				      "overmem cache: saved %s", printname);
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+printnode(dns_db_t *db, dns_dbnode_t *node, FILE *out) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *qpnode = node;
+	rdatasetheader_t *current, *top_next;
+	isc_boolean_t first;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	fprintf(out, "node %p, %u references\n", qpnode,
+		isc_refcount_current(&qpnode->references));
+	if (qpnode->data != NULL) {
+		for (current = qpnode->data; current != NULL;
+		     current = top_next) {
+			top_next = current->next;
+			first = ISC_TRUE;
+			fprintf(out, "\ttype %u", current->type);
+			do {
+				if (!first)
+					fprintf(out, "\t");
+				first = ISC_FALSE;
+				fprintf(out,
+					"\tserial = %lu, ttl = %u, "
+					"trust = %u, attributes = %u, "
+					"resign = %u\n",
+					(unsigned long)current->serial,
+					current->rdh_ttl,
+					current->trust,
+					current->attributes,
+					(current->resign << 1) |
+					current->resign_lsb);
+				current = current->down;
+			} while (current != NULL);
+		}
+	} else
+		fprintf(out, "(empty)\n");
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+}
+
+static isc_result_t
+createiterator(dns_db_t *db, unsigned int options,
+	       dns_dbiterator_t **iteratorp)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_dbiterator_t *qpdbiter;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	qpdbiter = isc_mem_get(qpdb->common.mctx, sizeof(*qpdbiter));
+	if (qpdbiter == NULL)
+		return (ISC_R_NOMEMORY);
+
+	qpdbiter->common.methods = &dbiterator_methods;
+	qpdbiter->common.db = NULL;
+	dns_db_attach(db, &qpdbiter->common.db);
+	qpdbiter->common.relative_names =
+			ISC_TF((options & DNS_DB_RELATIVENAMES) != 0);
+	qpdbiter->common.magic = DNS_DBITERATOR_MAGIC;
+	qpdbiter->common.cleaning = ISC_FALSE;
+	qpdbiter->result = ISC_R_SUCCESS;
+	qpdbiter->node = NULL;
+	qpdbiter->generation = 0;
+	qpdbiter->nsec3only = ISC_TF((options & DNS_DB_NSEC3ONLY) != 0);
+	qpdbiter->nonsec3 = ISC_TF((options & DNS_DB_NONSEC3) != 0);
+	qpdbiter->tree = qpdbiter->nsec3only ? qpdb->nsec3 : qpdb->tree;
+	dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+
+	*iteratorp = (dns_dbiterator_t *)qpdbiter;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+zone_findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+		  dns_rdatatype_t type, dns_rdatatype_t covers,
+		  isc_stdtime_t now, dns_rdataset_t *rdataset,
+		  dns_rdataset_t *sigrdataset)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *qpnode = (qpdb_node_t *)node;
+	rdatasetheader_t *header, *active, *found, *foundsig;
+	qpdb_serial_t serial;
+	qpdb_version_t *qpversion = version;
+	isc_boolean_t close_version = ISC_FALSE;
+	qpdb_rdatatype_t matchtype, sigmatchtype;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(type != dns_rdatatype_any);
+	INSIST(qpversion == NULL || qpversion->qpdb == qpdb);
+
+	UNUSED(now);
+
+	if (qpversion == NULL) {
+		currentversion(db, (dns_dbversion_t **) (void *)(&qpversion));
+		close_version = ISC_TRUE;
+	}
+	serial = qpversion->serial;
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	found = NULL;
+	foundsig = NULL;
+	matchtype = QPDB_RDATATYPE_VALUE(type, covers);
+	if (covers == 0)
+		sigmatchtype = QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, type);
+	else
+		sigmatchtype = 0;
+
+	for (header = qpnode->data; header != NULL; header = header->next) {
+		if (header->type != matchtype && header->type != sigmatchtype)
+			continue;
+		active = active_header(header, serial);
+		if (active == NULL)
+			continue;
+		if (active->type == matchtype) {
+			found = active;
+			if (foundsig != NULL)
+				break;
+		} else {
+			foundsig = active;
+			if (found != NULL)
+				break;
+		}
+	}
+	if (found != NULL) {
+		bind_rdataset(qpdb, qpnode, found, 0, rdataset);
+		if (foundsig != NULL)
+			bind_rdataset(qpdb, qpnode, foundsig, 0, sigrdataset);
+	}
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	if (close_version)
+		closeversion(db, (dns_dbversion_t **) (void *)(&qpversion),
+			     ISC_FALSE);
+
+	if (found == NULL)
+		return (ISC_R_NOTFOUND);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+cache_findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+		   dns_rdatatype_t type, dns_rdatatype_t covers,
+		   isc_stdtime_t now, dns_rdataset_t *rdataset,
+		   dns_rdataset_t *sigrdataset)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *qpnode = (qpdb_node_t *)node;
+	rdatasetheader_t *header, *found, *foundsig;
+	qpdb_rdatatype_t matchtype, sigmatchtype, negtype;
+	isc_result_t result;
+	isc_rwlocktype_t locktype;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(type != dns_rdatatype_any);
+
+	UNUSED(version);
+
+	result = ISC_R_SUCCESS;
+
+	if (now == 0)
+		isc_stdtime_get(&now);
+
+	locktype = isc_rwlocktype_read;
+	RWLOCK(&qpdb->tree_lock, locktype);
+
+	found = NULL;
+	foundsig = NULL;
+	matchtype = QPDB_RDATATYPE_VALUE(type, covers);
+	negtype = QPDB_RDATATYPE_VALUE(0, type);
+	if (covers == 0)
+		sigmatchtype = QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, type);
+	else
+		sigmatchtype = 0;
+
+	for (header = qpnode->data; header != NULL; header = header->next) {
+		if (!ACTIVE(header, now)) {
+			if ((header->rdh_ttl < now - QPDB_VIRTUAL) &&
+			    (locktype == isc_rwlocktype_write ||
+			     isc_rwlock_tryupgrade(&qpdb->tree_lock) ==
+			     ISC_R_SUCCESS))
+			{
+				/*
+				 * We update the node's status only when we
+				 * can get write access.  The caller holds a
+				 * reference to 'node', so it can't be
+				 * cleaned now.
+				 */
+				locktype = isc_rwlocktype_write;
+				mark_header_ancient(qpdb, header);
+			}
+		} else if (EXISTS(header) && !ANCIENT(header)) {
+			if (header->type == matchtype)
+				found = header;
+			else if (header->type == QPDB_RDATATYPE_NCACHEANY ||
+				 header->type == negtype)
+				found = header;
+			else if (header->type == sigmatchtype)
+				foundsig = header;
+		}
+	}
+	if (found != NULL) {
+		bind_rdataset(qpdb, qpnode, found, now, rdataset);
+		if (!NEGATIVE(found) && foundsig != NULL)
+			bind_rdataset(qpdb, qpnode, foundsig, now,
+				      sigrdataset);
+	}
+
+	RWUNLOCK(&qpdb->tree_lock, locktype);
+
+	if (found == NULL)
+		return (ISC_R_NOTFOUND);
+
+	if (NEGATIVE(found)) {
+		/*
+		 * We found a negative cache entry.
+		 */
+		if (NXDOMAIN(found))
+			result = DNS_R_NCACHENXDOMAIN;
+		else
+			result = DNS_R_NCACHENXRRSET;
+	}
+
+	update_cachestats(qpdb, result);
+
+	return (result);
+}
+
+static isc_result_t
+allrdatasets(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	     isc_stdtime_t now, dns_rdatasetiter_t **iteratorp)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *qpnode = (qpdb_node_t *)node;
+	qpdb_version_t *qpversion = version;
+	qpdb_rdatasetiter_t *iterator;
+	unsigned int refs;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	iterator = isc_mem_get(qpdb->common.mctx, sizeof(*iterator));
+	if (iterator == NULL)
+		return (ISC_R_NOMEMORY);
+
+	if (IS_CACHE(qpdb)) {
+		qpversion = NULL;
+		if (now == 0)
+			isc_stdtime_get(&now);
+	} else {
+		now = 0;
+		if (qpversion == NULL)
+			currentversion(db,
+				(dns_dbversion_t **) (void *)(&qpversion));
+		else {
+			INSIST(qpversion->qpdb == qpdb);
+
+			isc_refcount_increment(&qpversion->references, &refs);
+			INSIST(refs > 1);
+		}
+	}
+
+	iterator->common.magic = DNS_RDATASETITER_MAGIC;
+	iterator->common.methods = &rdatasetiter_methods;
+	iterator->common.db = db;
+	iterator->common.node = node;
+	iterator->common.version = (dns_dbversion_t *)qpversion;
+	iterator->common.now = now;
+
+	new_reference(qpdb, qpnode);
+
+	iterator->current = NULL;
+
+	*iteratorp = (dns_rdatasetiter_t *)iterator;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_boolean_t
+cname_and_other_data(qpdb_node_t *node, qpdb_serial_t serial) {
+	rdatasetheader_t *header;
+	isc_boolean_t cname, other_data;
+	dns_rdatatype_t rdtype;
+
+	/*
+	 * The caller must hold the tree lock.
+	 */
+
+	/*
+	 * Look for CNAME and "other data" rdatasets active in our version.
+	 *
+	 * "Other data" is any rdataset whose type is not KEY, NSEC, SIG
+	 * or RRSIG.
+	 */
+	cname = ISC_FALSE;
+	other_data = ISC_FALSE;
+	for (header = node->data; header != NULL; header = header->next) {
+		rdtype = QPDB_RDATATYPE_BASE(header->type);
+		if (header->type != dns_rdatatype_cname &&
+		    (rdtype == dns_rdatatype_key ||
+		     rdtype == dns_rdatatype_sig ||
+		     rdtype == dns_rdatatype_nsec ||
+		     rdtype == dns_rdatatype_rrsig))
+			continue;
+		if (active_header(header, serial) == NULL)
+			continue;
+		if (header->type == dns_rdatatype_cname)
+			cname = ISC_TRUE;
+		else
+			other_data = ISC_TRUE;
+	}
+
+	return (ISC_TF(cname && other_data));
+}
+
+static void
+update_recordsandbytes(isc_boolean_t add, qpdb_version_t *version,
+		       rdatasetheader_t *header)
+{
+	unsigned char *hdr = (unsigned char *)header;
+	size_t hdrsize = sizeof (*header);
+
+	if (add) {
+		version->records += dns_rdataslab_count(hdr, hdrsize);
+		version->bytes += dns_rdataslab_size(hdr, hdrsize);
+	} else {
+		version->records -= dns_rdataslab_count(hdr, hdrsize);
+		version->bytes -= dns_rdataslab_size(hdr, hdrsize);
+	}
+}
+
+/*%
+ * Put a new cache header on the TTL heap and the LRU list.  Headers with
+ * a zero TTL go at the tail of the list, to be the first purged.
+ */
+static isc_result_t
+cache_insert(dns_qpdb_t *qpdb, rdatasetheader_t *newheader) {
+	isc_result_t result;
+
+	INSIST(newheader->heap_index == 0);
+	INSIST(!ISC_LINK_LINKED(newheader, link));
+
+	result = isc_heap_insert(qpdb->heap, newheader);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	if (ZEROTTL(newheader))
+		ISC_LIST_APPEND(qpdb->lru, newheader, link);
+	else
+		ISC_LIST_PREPEND(qpdb->lru, newheader, link);
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+add32(dns_qpdb_t *qpdb, qpdb_node_t *node, qpdb_version_t *version,
+      rdatasetheader_t *newheader, unsigned int options, isc_boolean_t loading,
+      dns_rdataset_t *addedrdataset, isc_stdtime_t now)
+{
+	qpdb_changed_t *changed = NULL;
+	rdatasetheader_t *topheader, *topheader_prev, *header, *sigheader;
+	unsigned char *merged;
+	isc_result_t result;
+	isc_boolean_t header_nx;
+	isc_boolean_t newheader_nx;
+	isc_boolean_t merge;
+	dns_rdatatype_t rdtype, covers;
+	qpdb_rdatatype_t negtype, sigtype;
+	dns_trust_t trust;
+
+	/*
+	 * Add an rdatasetheader_t to a node.  'version' is NULL when
+	 * adding to a cache, except while it is being loaded.
+	 */
+
+	/*
+	 * Caller must be holding the tree lock for writing.
+	 */
+
+	if ((options & DNS_DBADD_MERGE) != 0) {
+		REQUIRE(version != NULL);
+		merge = ISC_TRUE;
+	} else
+		merge = ISC_FALSE;
+
+	if ((options & DNS_DBADD_FORCE) != 0)
+		trust = dns_trust_ultimate;
+	else
+		trust = newheader->trust;
+
+	if (version != NULL && !loading) {
+		/*
+		 * We always add a changed record, even if no changes end up
+		 * being made to this node, because it's harmless and
+		 * simplifies the code.
+		 */
+		changed = add_changed(qpdb, version, node);
+		if (changed == NULL) {
+			free_rdataset(qpdb, newheader);
+			return (ISC_R_NOMEMORY);
+		}
+	}
+
+	newheader_nx = NONEXISTENT(newheader) ? ISC_TRUE : ISC_FALSE;
+	topheader_prev = NULL;
+	sigheader = NULL;
+	negtype = 0;
+	if (version == NULL && !newheader_nx) {
+		rdtype = QPDB_RDATATYPE_BASE(newheader->type);
+		covers = QPDB_RDATATYPE_EXT(newheader->type);
+		sigtype = QPDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, covers);
+		if (NEGATIVE(newheader)) {
+			/*
+			 * We're adding a negative cache entry.
+			 */
+			if (covers == dns_rdatatype_any) {
+				/*
+				 * An entry which covers all types (NXDOMAIN,
+				 * NODATA(QTYPE=ANY)) makes all other data
+				 * at the node stale, so that it is the only
+				 * rdataset which can be found there.
+				 */
+				for (topheader = node->data;
+				     topheader != NULL;
+				     topheader = topheader->next)
+				{
+					set_ttl(qpdb, topheader, 0);
+					mark_header_ancient(qpdb, topheader);
+				}
+				goto find_header;
+			}
+			/*
+			 * Otherwise look for any RRSIGs of the given
+			 * type so they can be marked stale later.
+			 */
+			for (topheader = node->data;
+			     topheader != NULL;
+			     topheader = topheader->next)
+				if (topheader->type == sigtype)
+					sigheader = topheader;
+			negtype = QPDB_RDATATYPE_VALUE(covers, 0);
+		} else {
+			/*
+			 * We're adding something that isn't a negative
+			 * cache entry.  Look for an extant non-stale
+			 * NXDOMAIN/NODATA(QTYPE=ANY) negative cache entry.
+			 * If we're adding an RRSIG, also check for an
+			 * extant non-stale NODATA ncache entry which covers
+			 * the same type as the RRSIG.
+			 */
+			for (topheader = node->data;
+			     topheader != NULL;
+			     topheader = topheader->next)
+			{
+				if (topheader->type ==
+				    QPDB_RDATATYPE_NCACHEANY ||
+				    (newheader->type == sigtype &&
+				     topheader->type ==
+				     QPDB_RDATATYPE_VALUE(0, covers)))
+					break;
+			}
+			if (topheader != NULL && EXISTS(topheader) &&
+			    ACTIVE(topheader, now))
+			{
+				/*
+				 * Found one.
+				 */
+				if (trust < topheader->trust) {
+					/*
+					 * The NXDOMAIN/NODATA(QTYPE=ANY)
+					 * is more trusted.
+					 */
+					free_rdataset(qpdb, newheader);
+					bind_rdataset(qpdb, node, topheader,
+						      now, addedrdataset);
+					return (DNS_R_UNCHANGED);
+				}
+				/*
+				 * The new rdataset is better.  Expire the
+				 * ncache entry.
+				 */
+				set_ttl(qpdb, topheader, 0);
+				mark_header_ancient(qpdb, topheader);
+				topheader = NULL;
+				goto find_header;
+			}
+			negtype = QPDB_RDATATYPE_VALUE(0, rdtype);
+		}
+	}
+
+	for (topheader = node->data;
+	     topheader != NULL;
+	     topheader = topheader->next) {
+		if (topheader->type == newheader->type ||
+		    topheader->type == negtype)
+			break;
+		topheader_prev = topheader;
+	}
+
+ find_header:
+	/*
+	 * If header isn't NULL, we've found the right type.  There may be
+	 * IGNORE rdatasets between the top of the chain and the first real
+	 * data.  We skip over them.
+	 */
+	header = topheader;
+	while (header != NULL && IGNORE(header))
+		header = header->down;
+	if (header != NULL) {
+		header_nx = NONEXISTENT(header) ? ISC_TRUE : ISC_FALSE;
+
+		/*
+		 * Deleting an already non-existent rdataset has no effect.
+		 */
+		if (header_nx && newheader_nx) {
+			free_rdataset(qpdb, newheader);
+			return (DNS_R_UNCHANGED);
+		}
+
+		/*
+		 * Trying to add an rdataset with lower trust to a cache
+		 * has no effect, provided that the cached data isn't
+		 * stale.  Stale data is superseded below.
+		 */
+		if (version == NULL && trust < header->trust &&
+		    (ACTIVE(header, now) || header_nx)) {
+			free_rdataset(qpdb, newheader);
+			bind_rdataset(qpdb, node, header, now, addedrdataset);
+			return (DNS_R_UNCHANGED);
+		}
+
+		/*
+		 * Don't merge if a nonexistent rdataset is involved.
+		 */
+		if (merge && (header_nx || newheader_nx))
+			merge = ISC_FALSE;
+
+		/*
+		 * If 'merge' is ISC_TRUE, we'll try to create a new rdataset
+		 * that is the union of 'newheader' and 'header'.
+		 */
+		if (merge) {
+			unsigned int flags = 0;
+			INSIST(version->serial >= header->serial);
+			merged = NULL;
+			result = ISC_R_SUCCESS;
+
+			if ((options & DNS_DBADD_EXACT) != 0)
+				flags |= DNS_RDATASLAB_EXACT;
+			if ((options & DNS_DBADD_EXACTTTL) != 0 &&
+			     newheader->rdh_ttl != header->rdh_ttl)
+					result = DNS_R_NOTEXACT;
+			else if (newheader->rdh_ttl != header->rdh_ttl)
+				flags |= DNS_RDATASLAB_FORCE;
+			if (result == ISC_R_SUCCESS)
+				result = dns_rdataslab_merge(
+					     (unsigned char *)header,
+					     (unsigned char *)newheader,
+					     (unsigned int)(sizeof(*newheader)),
+					     qpdb->common.mctx,
+					     qpdb->common.rdclass,
+					     (dns_rdatatype_t)header->type,
+					     flags, &merged);
+			if (result == ISC_R_SUCCESS) {
+				/*
+				 * If 'header' has the same serial number as
+				 * we do, we could clean it up now if we knew
+				 * that our caller had no references to it.
+				 * We don't know this, however, so we leave it
+				 * alone.  It will get cleaned up when
+				 * clean_zone_node() runs.
+				 */
+				free_rdataset(qpdb, newheader);
+				newheader = (rdatasetheader_t *)merged;
+				init_rdataset(newheader);
+				if (loading && RESIGN(newheader) &&
+				    RESIGN(header) &&
+				    resign_sooner(header, newheader))
+				{
+					newheader->resign = header->resign;
+					newheader->resign_lsb =
+							header->resign_lsb;
+				}
+			} else {
+				free_rdataset(qpdb, newheader);
+				return (result);
+			}
+		}
+
+		/*
+		 * Don't replace an existing NS RRset in the cache with the
+		 * same servers, so that named doesn't stay locked to old
+		 * ones, and keep existing A, AAAA and DS RRsets unless this
+		 * is a prefetch.  Nothing special is done for stale data;
+		 * it is replaced normally further down.
+		 */
+		if (IS_CACHE(qpdb) && ACTIVE(header, now) &&
+		    header->type == dns_rdatatype_ns &&
+		    !header_nx && !newheader_nx &&
+		    header->trust >= newheader->trust &&
+		    dns_rdataslab_equalx((unsigned char *)header,
+					 (unsigned char *)newheader,
+					 (unsigned int)(sizeof(*newheader)),
+					 qpdb->common.rdclass,
+					 (dns_rdatatype_t)header->type))
+		{
+			goto keep_header;
+		}
+		/*
+		 * If we will be replacing an NS RRset, force its TTL to be
+		 * no more than the current one's, so that withdrawn
+		 * delegations are honoured.
+		 */
+		if (IS_CACHE(qpdb) && ACTIVE(header, now) &&
+		    header->type == dns_rdatatype_ns &&
+		    !header_nx && !newheader_nx &&
+		    header->trust <= newheader->trust) {
+			if (newheader->rdh_ttl > header->rdh_ttl)
+				newheader->rdh_ttl = header->rdh_ttl;
+		}
+		if (IS_CACHE(qpdb) && ACTIVE(header, now) &&
+		    (options & DNS_DBADD_PREFETCH) == 0 &&
+		    (header->type == dns_rdatatype_a ||
+		     header->type == dns_rdatatype_aaaa ||
+		     header->type == dns_rdatatype_ds ||
+		     header->type == QPDB_RDATATYPE_SIGDDS) &&
+		    !header_nx && !newheader_nx &&
+		    header->trust >= newheader->trust &&
+		    dns_rdataslab_equal((unsigned char *)header,
+					(unsigned char *)newheader,
+					(unsigned int)(sizeof(*newheader))))
+		{
+			goto keep_header;
+		}
+
+		INSIST(version == NULL || version->serial >= topheader->serial);
+		if (loading) {
+			newheader->down = NULL;
+			if (IS_CACHE(qpdb))
+				result = cache_insert(qpdb, newheader);
+			else if (RESIGN(newheader))
+				result = resign_insert(qpdb, newheader);
+			else
+				result = ISC_R_SUCCESS;
+			if (result != ISC_R_SUCCESS) {
+				free_rdataset(qpdb, newheader);
+				return (result);
+			}
+			/*
+			 * There are no other references to 'header' when
+			 * loading, so we MAY clean up 'header' now.
+			 * Since we don't generate changed records when
+			 * loading, we MUST clean up 'header' now.
+			 */
+			if (topheader_prev != NULL)
+				topheader_prev->next = newheader;
+			else
+				node->data = newheader;
+			newheader->next = topheader->next;
+			if (version != NULL && !header_nx)
+				update_recordsandbytes(ISC_FALSE, version,
+						       header);
+			free_rdataset(qpdb, header);
+		} else {
+			if (IS_CACHE(qpdb)) {
+				result = cache_insert(qpdb, newheader);
+				if (result != ISC_R_SUCCESS) {
+					free_rdataset(qpdb, newheader);
+					return (result);
+				}
+			} else if (RESIGN(newheader)) {
+				result = resign_insert(qpdb, newheader);
+				if (result != ISC_R_SUCCESS) {
+					free_rdataset(qpdb, newheader);
+					return (result);
+				}
+				resign_delete(qpdb, version, header);
+			}
+			if (topheader_prev != NULL)
+				topheader_prev->next = newheader;
+			else
+				node->data = newheader;
+			newheader->next = topheader->next;
+			newheader->down = topheader;
+			node->dirty = 1;
+			if (changed != NULL)
+				changed->dirty = ISC_TRUE;
+			if (version == NULL) {
+				set_ttl(qpdb, header, 0);
+				mark_header_ancient(qpdb, header);
+				if (sigheader != NULL) {
+					set_ttl(qpdb, sigheader, 0);
+					mark_header_ancient(qpdb, sigheader);
+				}
+			}
+			if (version != NULL && !header_nx)
+				update_recordsandbytes(ISC_FALSE, version,
+						       header);
+		}
+	} else {
+		/*
+		 * No non-IGNORED rdatasets of the given type exist at
+		 * this node.
+		 */
+
+		/*
+		 * If we're trying to delete the type, don't bother.
+		 */
+		if (newheader_nx) {
+			free_rdataset(qpdb, newheader);
+			return (DNS_R_UNCHANGED);
+		}
+
+		if (IS_CACHE(qpdb))
+			result = cache_insert(qpdb, newheader);
+		else if (RESIGN(newheader))
+			result = resign_insert(qpdb, newheader);
+		else
+			result = ISC_R_SUCCESS;
+		if (result != ISC_R_SUCCESS) {
+			free_rdataset(qpdb, newheader);
+			return (result);
+		}
+
+		if (topheader != NULL) {
+			/*
+			 * We have an list of rdatasets of the given type,
+			 * but they're all marked IGNORE.  We simply insert
+			 * the new rdataset at the head of the list.
+			 *
+			 * Ignored rdatasets cannot occur during loading, so
+			 * we INSIST on it.
+			 */
+			INSIST(!loading);
+			INSIST(version == NULL ||
+			       version->serial >= topheader->serial);
+			if (topheader_prev != NULL)
+				topheader_prev->next = newheader;
+			else
+				node->data = newheader;
+			newheader->next = topheader->next;
+			newheader->down = topheader;
+			node->dirty = 1;
+			if (changed != NULL)
+				changed->dirty = ISC_TRUE;
+		} else {
+			/*
+			 * No rdatasets of the given type exist at the node.
+			 */
+			newheader->next = node->data;
+			newheader->down = NULL;
+			node->data = newheader;
+		}
+	}
+
+	if (version != NULL && !newheader_nx)
+		update_recordsandbytes(ISC_TRUE, version, newheader);
+
+	/*
+	 * Check if the node now contains CNAME and other data.
+	 */
+	if (version != NULL && cname_and_other_data(node, version->serial))
+		return (DNS_R_CNAMEANDOTHER);
+
+	bind_rdataset(qpdb, node, newheader, now, addedrdataset);
+
+	return (ISC_R_SUCCESS);
+
+ keep_header:
+	/*
+	 * Keep the cached 'header', honouring the new TTL if it is
+	 * lower, and take any proofs it lacks from 'newheader'.
+	 */
+	if (header->rdh_ttl > newheader->rdh_ttl)
+		set_ttl(qpdb, header, newheader->rdh_ttl);
+	if (header->noqname == NULL && newheader->noqname != NULL) {
+		header->noqname = newheader->noqname;
+		newheader->noqname = NULL;
+	}
+	if (header->closest == NULL && newheader->closest != NULL) {
+		header->closest = newheader->closest;
+		newheader->closest = NULL;
+	}
+	free_rdataset(qpdb, newheader);
+	bind_rdataset(qpdb, node, header, now, addedrdataset);
+	return (ISC_R_SUCCESS);
+}
+
+static inline isc_boolean_t
+delegating_type(dns_qpdb_t *qpdb, qpdb_node_t *node, dns_rdatatype_t type) {
+	if (IS_CACHE(qpdb))
+		return (ISC_TF(type == dns_rdatatype_dname));
+	return (ISC_TF(type == dns_rdatatype_dname ||
+		       (type == dns_rdatatype_ns &&
+			(node != qpdb->origin_node || IS_STUB(qpdb)))));
+}
+
+typedef enum {
+	expire_lru,
+	expire_ttl,
+	expire_flush
+} expire_t;
+
+/*%
+ * Expire a cache header now, and if nobody is using its node, clean the
+ * node at once.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static void
+expire_header(dns_qpdb_t *qpdb, rdatasetheader_t *header, expire_t reason) {
+	qpdb_node_t *node = header->node;
+
+	set_ttl(qpdb, header, 0);
+	mark_header_ancient(qpdb, header);
+
+	if (isc_refcount_current(&node->references) == 0) {
+		/*
+		 * We first need to gain a new reference to the node to
+		 * meet a requirement of decrement_reference().
+		 */
+		new_reference(qpdb, node);
+		(void)decrement_reference(qpdb, node, 0,
+					  isc_rwlocktype_write);
+
+		if (qpdb->cachestats == NULL)
+			return;
+
+		switch (reason) {
+		case expire_ttl:
+			isc_stats_increment(qpdb->cachestats,
+					    dns_cachestatscounter_deletettl);
+			break;
+		case expire_lru:
+			isc_stats_increment(qpdb->cachestats,
+					    dns_cachestatscounter_deletelru);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*%
+ * Make room in an overmem cache for an rdataslab of 'purgesize' bytes:
+ * expire the header at the top of the TTL heap if it expired long ago,
+ * then the least recently used headers until twice 'purgesize' bytes
+ * have gone.
+ *
+ * The caller must be holding the tree lock for writing.
+ */
+static void
+overmem_purge(dns_qpdb_t *qpdb, size_t purgesize, isc_stdtime_t now) {
+	rdatasetheader_t *header;
+	size_t purged = 0;
+
+	purgesize *= 2;
+
+	header = isc_heap_element(qpdb->heap, 1);
+	if (header != NULL && header->rdh_ttl < now - QPDB_VIRTUAL) {
+		purged += NONEXISTENT(header)
+			? sizeof(*header)
+			: dns_rdataslab_size((unsigned char *)header,
+					     sizeof(*header));
+		expire_header(qpdb, header, expire_ttl);
+	}
+
+	while (purged < purgesize &&
+	       (header = ISC_LIST_TAIL(qpdb->lru)) != NULL)
+	{
+		purged += NONEXISTENT(header)
+			? sizeof(*header)
+			: dns_rdataslab_size((unsigned char *)header,
+					     sizeof(*header));
+
+		/*
+		 * Unlink the header now so that it isn't considered again
+		 * even if its node is in use and it can't be freed yet.
+		 * Its TTL is about to be reset, so no lookup will move it
+		 * back onto the list.
+		 */
+		ISC_LIST_UNLINK(qpdb->lru, header, link);
+		expire_header(qpdb, header, expire_lru);
+	}
+}
+
+static void
+setownercase(rdatasetheader_t *header, const dns_name_t *name) {
+	header->attributes |= RDATASET_ATTR_CASESET;
+	if (ISC_LIKELY(dns__slabdb_setownercase(header->upper, name)))
+		header->attributes |= RDATASET_ATTR_CASEFULLYLOWER;
+}
+
+static isc_result_t
+addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	    isc_stdtime_t now, dns_rdataset_t *rdataset, unsigned int options,
+	    dns_rdataset_t *addedrdataset)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *qpnode = (qpdb_node_t *)node;
+	qpdb_version_t *qpversion = version;
+	isc_region_t region;
+	rdatasetheader_t *newheader;
+	rdatasetheader_t *header;
+	isc_result_t result;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	if (IS_CACHE(qpdb)) {
+		REQUIRE(qpversion == NULL);
+		if (now == 0)
+			isc_stdtime_get(&now);
+	} else {
+		REQUIRE(qpversion != NULL && qpversion->qpdb == qpdb);
+		REQUIRE((qpnode->nsec3 &&
+			 (rdataset->type == dns_rdatatype_nsec3 ||
+			  rdataset->covers == dns_rdatatype_nsec3)) ||
+			(!qpnode->nsec3 &&
+			 rdataset->type != dns_rdatatype_nsec3 &&
+			 rdataset->covers != dns_rdatatype_nsec3));
+		now = 0;
+	}
+
+	result = dns_rdataslab_fromrdataset(rdataset, qpdb->common.mctx,
+					    &region, sizeof(rdatasetheader_t));
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	/*
+	 * The node's name never changes, so it can be read without the
+	 * tree lock.
+	 */
+	dns_fixedname_init(&fixed);
+	name = dns_fixedname_name(&fixed);
+	dns_name_init(&nname, offsets);
+	nodename(qpnode, &nname);
+	RUNTIME_CHECK(dns_name_copy(&nname, name, NULL) == ISC_R_SUCCESS);
+	dns_rdataset_getownercase(rdataset, name);
+
+	newheader = (rdatasetheader_t *)region.base;
+	init_rdataset(newheader);
+	setownercase(newheader, name);
+	newheader->rdh_ttl = rdataset->ttl + now;
+	newheader->type = QPDB_RDATATYPE_VALUE(rdataset->type,
+					       rdataset->covers);
+	newheader->attributes = 0;
+	if (IS_CACHE(qpdb) && rdataset->ttl == 0U)
+		newheader->attributes |= RDATASET_ATTR_ZEROTTL;
+	newheader->count = init_count++;
+	newheader->trust = rdataset->trust;
+	newheader->last_used = now;
+	newheader->node = qpnode;
+	if (qpversion != NULL) {
+		newheader->serial = qpversion->serial;
+		if ((rdataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
+			newheader->attributes |= RDATASET_ATTR_RESIGN;
+			newheader->resign = (isc_stdtime_t)
+				(dns_time64_from32(rdataset->resign) >> 1);
+			newheader->resign_lsb = rdataset->resign & 0x1;
+		} else {
+			newheader->resign = 0;
+			newheader->resign_lsb = 0;
+		}
+	} else {
+		newheader->serial = 1;
+		newheader->resign = 0;
+		newheader->resign_lsb = 0;
+		if ((rdataset->attributes & DNS_RDATASETATTR_PREFETCH) != 0)
+			newheader->attributes |= RDATASET_ATTR_PREFETCH;
+		if ((rdataset->attributes & DNS_RDATASETATTR_NEGATIVE) != 0)
+			newheader->attributes |= RDATASET_ATTR_NEGATIVE;
+		if ((rdataset->attributes & DNS_RDATASETATTR_NXDOMAIN) != 0)
+			newheader->attributes |= RDATASET_ATTR_NXDOMAIN;
+		if ((rdataset->attributes & DNS_RDATASETATTR_OPTOUT) != 0)
+			newheader->attributes |= RDATASET_ATTR_OPTOUT;
+		if ((rdataset->attributes & DNS_RDATASETATTR_NOQNAME) != 0) {
+			result = dns__slabdb_newproof(qpdb->common.mctx,
+						      rdataset, ISC_FALSE,
+						      &newheader->noqname);
+			if (result != ISC_R_SUCCESS) {
+				free_rdataset(qpdb, newheader);
+				return (result);
+			}
+		}
+		if ((rdataset->attributes & DNS_RDATASETATTR_CLOSEST) != 0) {
+			result = dns__slabdb_newproof(qpdb->common.mctx,
+						      rdataset, ISC_TRUE,
+						      &newheader->closest);
+			if (result != ISC_R_SUCCESS) {
+				free_rdataset(qpdb, newheader);
+				return (result);
+			}
+		}
+	}
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	cleanup_dead_nodes(qpdb);
+
+	if (IS_CACHE(qpdb)) {
+		if (isc_mem_isovermem(qpdb->common.mctx))
+			overmem_purge(qpdb, region.length, now);
+
+		if (qpdb->rrsetstats != NULL) {
+			newheader->attributes |= RDATASET_ATTR_STATCOUNT;
+			update_rrsetstats(qpdb, newheader, ISC_TRUE);
+		}
+
+		header = isc_heap_element(qpdb->heap, 1);
+		if (header != NULL && header->rdh_ttl < now - QPDB_VIRTUAL)
+			expire_header(qpdb, header, expire_ttl);
+	}
+
+	result = add32(qpdb, qpnode, qpversion, newheader, options, ISC_FALSE,
+		       addedrdataset, now);
+
+	/*
+	 * If we've added a delegation type (NS or DNAME for a zone, just
+	 * DNAME for a cache), lookups must check the node for zone cuts.
+	 */
+	if (result == ISC_R_SUCCESS &&
+	    delegating_type(qpdb, qpnode, rdataset->type))
+		qpnode->delegating = 1;
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	return (result);
+}
+
+static isc_result_t
+subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+		 dns_rdataset_t *rdataset, unsigned int options,
+		 dns_rdataset_t *newrdataset)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *qpnode = (qpdb_node_t *)node;
+	qpdb_version_t *qpversion = version;
+	rdatasetheader_t *topheader, *topheader_prev, *header, *newheader;
+	unsigned char *subresult;
+	isc_region_t region;
+	isc_result_t result;
+	qpdb_changed_t *changed;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(qpversion != NULL && qpversion->qpdb == qpdb);
+	REQUIRE((qpnode->nsec3 &&
+		 (rdataset->type == dns_rdatatype_nsec3 ||
+		  rdataset->covers == dns_rdatatype_nsec3)) ||
+		(!qpnode->nsec3 &&
+		 rdataset->type != dns_rdatatype_nsec3 &&
+		 rdataset->covers != dns_rdatatype_nsec3));
+
+	result = dns_rdataslab_fromrdataset(rdataset, qpdb->common.mctx,
+					    &region, sizeof(rdatasetheader_t));
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	newheader = (rdatasetheader_t *)region.base;
+	init_rdataset(newheader);
+	newheader->rdh_ttl = rdataset->ttl;
+	newheader->type = QPDB_RDATATYPE_VALUE(rdataset->type,
+					       rdataset->covers);
+	newheader->attributes = 0;
+	newheader->serial = qpversion->serial;
+	newheader->trust = 0;
+	newheader->count = init_count++;
+	newheader->node = qpnode;
+	if ((rdataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
+		newheader->attributes |= RDATASET_ATTR_RESIGN;
+		newheader->resign = (isc_stdtime_t)
+			(dns_time64_from32(rdataset->resign) >> 1);
+		newheader->resign_lsb = rdataset->resign & 0x1;
+	} else {
+		newheader->resign = 0;
+		newheader->resign_lsb = 0;
+	}
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	cleanup_dead_nodes(qpdb);
+
+	changed = add_changed(qpdb, qpversion, qpnode);
+	if (changed == NULL) {
+		free_rdataset(qpdb, newheader);
+		RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+		return (ISC_R_NOMEMORY);
+	}
+
+	topheader_prev = NULL;
+	for (topheader = qpnode->data;
+	     topheader != NULL;
+	     topheader = topheader->next) {
+		if (topheader->type == newheader->type)
+			break;
+		topheader_prev = topheader;
+	}
+	/*
+	 * If header isn't NULL, we've found the right type.  There may be
+	 * IGNORE rdatasets between the top of the chain and the first real
+	 * data.  We skip over them.
+	 */
+	header = topheader;
+	while (header != NULL && IGNORE(header))
+		header = header->down;
+	if (header != NULL && EXISTS(header)) {
+		unsigned int flags = 0;
+		subresult = NULL;
+		result = ISC_R_SUCCESS;
+		if ((options & DNS_DBSUB_EXACT) != 0) {
+			flags |= DNS_RDATASLAB_EXACT;
+			if (newheader->rdh_ttl != header->rdh_ttl)
+				result = DNS_R_NOTEXACT;
+		}
+		if (result == ISC_R_SUCCESS)
+			result = dns_rdataslab_subtract(
+					(unsigned char *)header,
+					(unsigned char *)newheader,
+					(unsigned int)(sizeof(*newheader)),
+					qpdb->common.mctx,
+					qpdb->common.rdclass,
+					(dns_rdatatype_t)header->type,
+					flags, &subresult);
+		if (result == ISC_R_SUCCESS) {
+			free_rdataset(qpdb, newheader);
+			newheader = (rdatasetheader_t *)subresult;
+			init_rdataset(newheader);
+			/*
+			 * The rdataslab subtraction routine copies the
+			 * reserved portion of 'header', so we have to set
+			 * the serial and the re-signing state ourselves.
+			 */
+			newheader->serial = qpversion->serial;
+			if (RESIGN(header)) {
+				newheader->attributes |= RDATASET_ATTR_RESIGN;
+				newheader->resign = header->resign;
+				newheader->resign_lsb = header->resign_lsb;
+				result = resign_insert(qpdb, newheader);
+				if (result != ISC_R_SUCCESS) {
+					free_rdataset(qpdb, newheader);
+					goto unlock;
+				}
+			}
+			update_recordsandbytes(ISC_TRUE, qpversion, newheader);
+		} else if (result == DNS_R_NXRRSET) {
+			/*
+			 * This subtraction would remove all of the rdata;
+			 * add a nonexistent header instead.
+			 */
+			free_rdataset(qpdb, newheader);
+			newheader = new_rdataset(qpdb, qpnode, topheader->type,
+						 qpversion->serial);
+			if (newheader == NULL) {
+				result = ISC_R_NOMEMORY;
+				goto unlock;
+			}
+		} else {
+			free_rdataset(qpdb, newheader);
+			goto unlock;
+		}
+
+		/*
+		 * If we're here, we want to link newheader in front of
+		 * topheader.
+		 */
+		INSIST(qpversion->serial >= topheader->serial);
+		update_recordsandbytes(ISC_FALSE, qpversion, header);
+		if (topheader_prev != NULL)
+			topheader_prev->next = newheader;
+		else
+			qpnode->data = newheader;
+		newheader->next = topheader->next;
+		newheader->down = topheader;
+		qpnode->dirty = 1;
+		changed->dirty = ISC_TRUE;
+		resign_delete(qpdb, qpversion, header);
+	} else {
+		/*
+		 * The rdataset doesn't exist, so we don't need to do anything
+		 * to satisfy the deletion request.
+		 */
+		free_rdataset(qpdb, newheader);
+		if ((options & DNS_DBSUB_EXACT) != 0)
+			result = DNS_R_NOTEXACT;
+		else
+			result = DNS_R_UNCHANGED;
+	}
+
+	if (result == ISC_R_SUCCESS && newrdataset != NULL)
+		bind_rdataset(qpdb, qpnode, newheader, 0, newrdataset);
+
+	if (result == DNS_R_NXRRSET && newrdataset != NULL &&
+	    (options & DNS_DBSUB_WANTOLD) != 0)
+		bind_rdataset(qpdb, qpnode, header, 0, newrdataset);
+
+ unlock:
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	return (result);
+}
+
+static isc_result_t
+deleterdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	       dns_rdatatype_t type, dns_rdatatype_t covers)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_node_t *qpnode = (qpdb_node_t *)node;
+	qpdb_version_t *qpversion = version;
+	isc_result_t result;
+	rdatasetheader_t *newheader;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	if (IS_CACHE(qpdb))
+		REQUIRE(qpversion == NULL);
+	else
+		REQUIRE(qpversion != NULL && qpversion->qpdb == qpdb);
+
+	if (type == dns_rdatatype_any)
+		return (ISC_R_NOTIMPLEMENTED);
+	if (type == dns_rdatatype_rrsig && covers == 0)
+		return (ISC_R_NOTIMPLEMENTED);
+
+	newheader = new_rdataset(qpdb, qpnode,
+				 QPDB_RDATATYPE_VALUE(type, covers),
+				 qpversion != NULL ? qpversion->serial : 0);
+	if (newheader == NULL)
+		return (ISC_R_NOMEMORY);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	cleanup_dead_nodes(qpdb);
+	result = add32(qpdb, qpnode, qpversion, newheader, DNS_DBADD_FORCE,
+		       ISC_FALSE, NULL, 0);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	return (result);
+}
+
+static isc_result_t
+loading_addrdataset(void *arg, const dns_name_t *name,
+		    dns_rdataset_t *rdataset)
+{
+	dns_qpdb_t *qpdb = arg;
+	qpdb_node_t *node = NULL;
+	isc_result_t result;
+	isc_region_t region;
+	rdatasetheader_t *newheader;
+	isc_boolean_t nsec3;
+
+	REQUIRE(rdataset->rdclass == qpdb->common.rdclass);
+
+	/*
+	 * SOA records are only allowed at top of zone.
+	 */
+	if (rdataset->type == dns_rdatatype_soa && !IS_CACHE(qpdb) &&
+	    !dns_name_equal(name, &qpdb->common.origin))
+		return (DNS_R_NOTZONETOP);
+
+	if (dns_name_iswildcard(name)) {
+		/*
+		 * NS record owners cannot legally be wild cards.
+		 */
+		if (rdataset->type == dns_rdatatype_ns)
+			return (DNS_R_INVALIDNS);
+		/*
+		 * NSEC3 record owners cannot legally be wild cards.
+		 */
+		if (rdataset->type == dns_rdatatype_nsec3)
+			return (DNS_R_INVALIDNSEC3);
+	}
+
+	result = dns_rdataslab_fromrdataset(rdataset, qpdb->common.mctx,
+					    &region, sizeof(rdatasetheader_t));
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	newheader = (rdatasetheader_t *)region.base;
+	init_rdataset(newheader);
+	newheader->rdh_ttl = rdataset->ttl;
+	if (IS_CACHE(qpdb))
+		newheader->rdh_ttl += qpdb->loadtime;
+	newheader->type = QPDB_RDATATYPE_VALUE(rdataset->type,
+					       rdataset->covers);
+	newheader->attributes = 0;
+	newheader->trust = rdataset->trust;
+	newheader->serial = 1;
+	newheader->count = init_count++;
+	newheader->last_used = 0;
+	if ((rdataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
+		newheader->attributes |= RDATASET_ATTR_RESIGN;
+		newheader->resign = (isc_stdtime_t)
+			(dns_time64_from32(rdataset->resign) >> 1);
+		newheader->resign_lsb = rdataset->resign & 0x1;
+	} else {
+		newheader->resign = 0;
+		newheader->resign_lsb = 0;
+	}
+
+	/*
+	 * A cache keeps its NSEC3 records in the main tree.
+	 */
+	nsec3 = ISC_TF(!IS_CACHE(qpdb) &&
+		       (rdataset->type == dns_rdatatype_nsec3 ||
+			rdataset->covers == dns_rdatatype_nsec3));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	if (nsec3)
+		result = addnode(qpdb, qpdb->nsec3, name, &node);
+	else if (IS_CACHE(qpdb))
+		result = addnode(qpdb, qpdb->tree, name, &node);
+	else {
+		result = add_empty_wildcards(qpdb, name);
+		if (result == ISC_R_SUCCESS)
+			result = addnode(qpdb, qpdb->tree, name, &node);
+	}
+	if (result != ISC_R_SUCCESS) {
+		free_rdataset(qpdb, newheader);
+		goto unlock;
+	}
+	newheader->node = node;
+
+	result = add32(qpdb, node, qpdb->current_version, newheader,
+		       DNS_DBADD_MERGE, ISC_TRUE, NULL, 0);
+	if (result == ISC_R_SUCCESS &&
+	    delegating_type(qpdb, node, rdataset->type))
+		node->delegating = 1;
+	else if (result == DNS_R_UNCHANGED)
+		result = ISC_R_SUCCESS;
+
+ unlock:
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	return (result);
+}
+
+static isc_result_t
+beginload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(DNS_CALLBACK_VALID(callbacks));
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	REQUIRE((qpdb->attributes & (QPDB_ATTR_LOADED|QPDB_ATTR_LOADING))
+		== 0);
+	qpdb->attributes |= QPDB_ATTR_LOADING;
+	if (IS_CACHE(qpdb))
+		isc_stdtime_get(&qpdb->loadtime);
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	callbacks->add = loading_addrdataset;
+	callbacks->add_private = qpdb;
+	callbacks->deserialize = NULL;
+	callbacks->deserialize_private = NULL;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+endload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(DNS_CALLBACK_VALID(callbacks));
+	REQUIRE(callbacks->add_private == qpdb);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	REQUIRE((qpdb->attributes & QPDB_ATTR_LOADING) != 0);
+	REQUIRE((qpdb->attributes & QPDB_ATTR_LOADED) == 0);
+
+	qpdb->attributes &= ~QPDB_ATTR_LOADING;
+	qpdb->attributes |= QPDB_ATTR_LOADED;
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	/*
+	 * If there's a KEY rdataset at the zone origin containing a
+	 * zone key, we consider the zone secure.
+	 */
+	if (!IS_CACHE(qpdb))
+		iszonesecure(db, qpdb->current_version, qpdb->origin_node);
+
+	callbacks->add = NULL;
+	callbacks->add_private = NULL;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+dump(dns_db_t *db, dns_dbversion_t *version, const char *filename,
+     dns_masterformat_t masterformat)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_version_t *qpversion = version;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	INSIST(qpversion == NULL || qpversion->qpdb == qpdb);
+
+	return (dns_master_dump2(qpdb->common.mctx, db, version,
+				 &dns_master_style_default,
+				 filename, masterformat));
+}
+
+static isc_boolean_t
+issecure(dns_db_t *db) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	isc_boolean_t secure;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	secure = ISC_TF(qpdb->current_version->secure == dns_db_secure);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	return (secure);
+}
+
+static isc_boolean_t
+isdnssec(dns_db_t *db) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	isc_boolean_t dnssec;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	dnssec = ISC_TF(qpdb->current_version->secure != dns_db_insecure);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	return (dnssec);
+}
+
+static unsigned int
+nodecount(dns_db_t *db) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	unsigned int count;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	count = dns_qp_count(qpdb->tree);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	return (count);
+}
+
+static isc_boolean_t
+ispersistent(dns_db_t *db) {
+	UNUSED(db);
+	return (ISC_FALSE);
+}
+
+static void
+overmem(dns_db_t *db, isc_boolean_t over) {
+	/* This is an empty callback.  See adb.c:water() */
+
+	UNUSED(db);
+	UNUSED(over);
+
+	return;
+}
+
+static void
+settask(dns_db_t *db, isc_task_t *task) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	if (qpdb->task != NULL)
+		isc_task_detach(&qpdb->task);
+	if (task != NULL)
+		isc_task_attach(task, &qpdb->task);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+}
+
+static isc_result_t
+getoriginnode(dns_db_t *db, dns_dbnode_t **nodep) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(nodep != NULL && *nodep == NULL);
+
+	/*
+	 * A cache has no origin node.  A zone's is never removed, so no
+	 * lock is needed.
+	 */
+	if (qpdb->origin_node == NULL)
+		return (ISC_R_NOTFOUND);
+	new_reference(qpdb, qpdb->origin_node);
+	*nodep = qpdb->origin_node;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+getnsec3parameters(dns_db_t *db, dns_dbversion_t *version, dns_hash_t *hash,
+		   isc_uint8_t *flags, isc_uint16_t *iterations,
+		   unsigned char *salt, size_t *salt_length)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	isc_result_t result = ISC_R_NOTFOUND;
+	qpdb_version_t *qpversion = version;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	INSIST(qpversion == NULL || qpversion->qpdb == qpdb);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	if (qpversion == NULL)
+		qpversion = qpdb->current_version;
+
+	if (qpversion->havensec3) {
+		dns__slabdb_getnsec3params(&qpversion->nsec3params, hash,
+					   flags, iterations, salt,
+					   salt_length);
+		result = ISC_R_SUCCESS;
+	}
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	return (result);
+}
+
+static isc_result_t
+getsize(dns_db_t *db, dns_dbversion_t *version, isc_uint64_t *records,
+	isc_uint64_t *bytes)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	qpdb_version_t *qpversion = version;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	INSIST(qpversion == NULL || qpversion->qpdb == qpdb);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	if (qpversion == NULL)
+		qpversion = qpdb->current_version;
+	if (records != NULL)
+		*records = qpversion->records;
+	if (bytes != NULL)
+		*bytes = qpversion->bytes;
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+setsigningtime(dns_db_t *db, dns_rdataset_t *rdataset, isc_stdtime_t resign) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	isc_result_t result = ISC_R_SUCCESS;
+	rdatasetheader_t *header, oldheader;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(rdataset != NULL);
+
+	header = rdataset->private3;
+	header--;
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	oldheader = *header;
+	/*
+	 * Only break the heap invariant (by adjusting resign and resign_lsb)
+	 * if we are going to be restoring it by calling isc_heap_increased
+	 * or isc_heap_decreased.
+	 */
+	if (resign != 0) {
+		header->resign =
+			 (isc_stdtime_t)(dns_time64_from32(resign) >> 1);
+		header->resign_lsb = resign & 0x1;
+	}
+	if (header->heap_index != 0) {
+		INSIST(RESIGN(header));
+		if (resign == 0) {
+			isc_heap_delete(qpdb->heap, header->heap_index);
+			header->heap_index = 0;
+		} else if (resign_sooner(header, &oldheader)) {
+			isc_heap_increased(qpdb->heap, header->heap_index);
+		} else if (resign_sooner(&oldheader, header)) {
+			isc_heap_decreased(qpdb->heap, header->heap_index);
+		}
+	} else if (resign != 0) {
+		header->attributes |= RDATASET_ATTR_RESIGN;
+		result = resign_insert(qpdb, header);
+	}
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+
+	return (result);
+}
+
+static isc_result_t
+getsigningtime(dns_db_t *db, dns_rdataset_t *rdataset,
+	       dns_name_t *foundname)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	rdatasetheader_t *header;
+	isc_result_t result = ISC_R_NOTFOUND;
+	dns_name_t name;
+	dns_offsets_t offsets;
+
+	REQUIRE(VALID_QPDB(qpdb));
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	header = isc_heap_element(qpdb->heap, 1);
+	if (header == NULL)
+		goto unlock;
+
+	bind_rdataset(qpdb, header->node, header, 0, rdataset);
+
+	if (foundname != NULL) {
+		dns_name_init(&name, offsets);
+		nodename(header->node, &name);
+		result = dns_name_copy(&name, foundname, NULL);
+		if (result != ISC_R_SUCCESS)
+			goto unlock;
+	}
+
+	result = ISC_R_SUCCESS;
+
+ unlock:
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	return (result);
+}
+
+static void
+resigned(dns_db_t *db, dns_rdataset_t *rdataset, dns_dbversion_t *version) {
+	qpdb_version_t *qpversion = (qpdb_version_t *)version;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	rdatasetheader_t *header;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(rdataset != NULL);
+	REQUIRE(rdataset->methods == &rdataset_methods);
+	REQUIRE(qpdb->future_version == qpversion);
+	REQUIRE(qpversion != NULL);
+	REQUIRE(qpversion->writer);
+	REQUIRE(qpversion->qpdb == qpdb);
+
+	header = rdataset->private3;
+	INSIST(header != NULL);
+	header--;
+
+	if (header->heap_index == 0)
+		return;
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	/*
+	 * Delete from heap and save to re-signed list so that it can
+	 * be restored if we backout of this change.
+	 */
+	resign_delete(qpdb, qpversion, header);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+}
+
+static isc_result_t
+nodefullname(dns_db_t *db, dns_dbnode_t *node, dns_name_t *name) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(node != NULL);
+	REQUIRE(name != NULL);
+
+	/* Node names never change, so no lock is needed. */
+	dns_name_init(&nname, offsets);
+	nodename((qpdb_node_t *)node, &nname);
+	return (dns_name_copy(&nname, name, NULL));
+}
+
+static void
+iszonesecure(dns_db_t *db, qpdb_version_t *version, dns_dbnode_t *origin) {
+	version->secure = dns__slabdb_iszonesecure(db,
+						   (dns_dbversion_t *)version,
+						   origin,
+						   &version->nsec3params,
+						   &version->havensec3);
+}
+
+static isc_result_t
+setcachestats(dns_db_t *db, isc_stats_t *stats) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(IS_CACHE(qpdb)); /* current restriction */
+	REQUIRE(stats != NULL);
+
+	isc_stats_attach(stats, &qpdb->cachestats);
+	return (ISC_R_SUCCESS);
+}
+
+static dns_stats_t *
+getrrsetstats(dns_db_t *db) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(IS_CACHE(qpdb)); /* current restriction */
+
+	return (qpdb->rrsetstats);
+}
+
+static isc_result_t
+setservestalettl(dns_db_t *db, dns_ttl_t ttl) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(IS_CACHE(qpdb));
+
+	/* currently no bounds checking.  0 means disable. */
+	qpdb->serve_stale_ttl = ttl;
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+getservestalettl(dns_db_t *db, dns_ttl_t *ttl) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)db;
+
+	REQUIRE(VALID_QPDB(qpdb));
+	REQUIRE(IS_CACHE(qpdb));
+
+	*ttl = qpdb->serve_stale_ttl;
+	return (ISC_R_SUCCESS);
+}
+
+static dns_dbmethods_t zone_methods = {
+	attach,
+	detach,
+	beginload,
+	endload,
+	NULL,			/* serialize */
+	dump,
+	currentversion,
+	newversion,
+	attachversion,
+	closeversion,
+	findnode,
+	zone_find,
+	zone_findzonecut,
+	attachnode,
+	detachnode,
+	expirenode,
+	printnode,
+	createiterator,
+	zone_findrdataset,
+	allrdatasets,
+	addrdataset,
+	subtractrdataset,
+	deleterdataset,
+	issecure,
+	nodecount,
+	ispersistent,
+	overmem,
+	settask,
+	getoriginnode,
+	NULL,			/* transfernode */
+	getnsec3parameters,
+	findnsec3node,
+	setsigningtime,
+	getsigningtime,
+	resigned,
+	isdnssec,
+	NULL,			/* getrrsetstats */
+	NULL,			/* rpz_attach */
+	NULL,			/* rpz_ready */
+	NULL,			/* findnodeext */
+	NULL,			/* findext */
+	NULL,			/* setcachestats */
+	NULL,			/* hashsize */
+	nodefullname,
+	getsize,
+	NULL,			/* setservestalettl */
+	NULL,			/* getservestalettl */
+	NULL			/* setgluecachestats */
+};
+
+static dns_dbmethods_t cache_methods = {
+	attach,
+	detach,
+	beginload,
+	endload,
+	NULL,			/* serialize */
+	dump,
+	currentversion,
+	newversion,
+	attachversion,
+	closeversion,
+	findnode,
+	cache_find,
+	cache_findzonecut,
+	attachnode,
+	detachnode,
+	expirenode,
+	printnode,
+	createiterator,
+	cache_findrdataset,
+	allrdatasets,
+	addrdataset,
+	subtractrdataset,
+	deleterdataset,
+	issecure,
+	nodecount,
+	ispersistent,
+	overmem,
+	settask,
+	getoriginnode,
+	NULL,			/* transfernode */
+	NULL,			/* getnsec3parameters */
+	NULL,			/* findnsec3node */
+	NULL,			/* setsigningtime */
+	NULL,			/* getsigningtime */
+	NULL,			/* resigned */
+	isdnssec,
+	getrrsetstats,
+	NULL,			/* rpz_attach */
+	NULL,			/* rpz_ready */
+	NULL,			/* findnodeext */
+	NULL,			/* findext */
+	setcachestats,
+	NULL,			/* hashsize */
+	nodefullname,
+	NULL,			/* getsize */
+	setservestalettl,
+	getservestalettl,
+	NULL			/* setgluecachestats */
+};
+
+isc_result_t
+dns_qpdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
+		dns_rdataclass_t rdclass, unsigned int argc, char *argv[],
+		void *driverarg, dns_db_t **dbp)
+{
+	dns_qpdb_t *qpdb;
+	isc_result_t result;
+
+	/* Keep the compiler happy. */
+	UNUSED(driverarg);
+
+	qpdb = isc_mem_get(mctx, sizeof(*qpdb));
+	if (qpdb == NULL)
+		return (ISC_R_NOMEMORY);
+
+	memset(qpdb, '\0', sizeof(*qpdb));
+	dns_name_init(&qpdb->common.origin, NULL);
+	qpdb->common.attributes = 0;
+	if (type == dns_dbtype_cache) {
+		qpdb->common.methods = &cache_methods;
+		qpdb->common.attributes |= DNS_DBATTR_CACHE;
+	} else if (type == dns_dbtype_stub) {
+		qpdb->common.methods = &zone_methods;
+		qpdb->common.attributes |= DNS_DBATTR_STUB;
+	} else
+		qpdb->common.methods = &zone_methods;
+	qpdb->common.rdclass = rdclass;
+	qpdb->common.mctx = NULL;
+
+	ISC_LIST_INIT(qpdb->common.update_listeners);
+
+	result = isc_rwlock_init(&qpdb->tree_lock, 0, 0);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_qpdb;
+
+	result = isc_mutex_init(&qpdb->dead_lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_tree_lock;
+	ISC_LIST_INIT(qpdb->deadnodes);
+
+	result = isc_mutex_init(&qpdb->lru_lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_dead_lock;
+	ISC_LIST_INIT(qpdb->lru);
+
+	result = isc_refcount_init(&qpdb->references, 1);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lru_lock;
+
+	/*
+	 * Attach to the mctx.  The database will persist so long as there
+	 * are references to it, and attaching to the mctx ensures that our
+	 * mctx won't disappear out from under us.  From here on
+	 * free_qpdb() does the cleaning up.
+	 */
+	isc_mem_attach(mctx, &qpdb->common.mctx);
+	qpdb->common.magic = DNS_DB_MAGIC;
+	qpdb->common.impmagic = QPDB_MAGIC;
+
+	/*
+	 * Make a copy of the origin name.
+	 */
+	result = dns_name_dupwithoffsets(origin, mctx, &qpdb->common.origin);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	/*
+	 * A cache may be given a separate memory context for its heap
+	 * in argv[0], so that the heap doesn't count towards the cache's
+	 * memory limit.
+	 */
+	if (IS_CACHE(qpdb) && argc != 0)
+		isc_mem_attach((isc_mem_t *)argv[0], &qpdb->hmctx);
+	else
+		isc_mem_attach(mctx, &qpdb->hmctx);
+
+	result = isc_heap_create(qpdb->hmctx,
+				 IS_CACHE(qpdb) ? ttl_sooner : resign_sooner,
+				 set_index, 0, &qpdb->heap);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	if (IS_CACHE(qpdb)) {
+		result = dns_rdatasetstats_create(mctx, &qpdb->rrsetstats);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
+	result = dns_qp_create(mctx, &qpmethods, qpdb, &qpdb->tree);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	result = dns_qp_create(mctx, &qpmethods, qpdb, &qpdb->nsec3);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	/*
+	 * A zone's origin nodes always exist; there are no ancestors
+	 * above them that zone_find() would need.
+	 */
+	if (!IS_CACHE(qpdb)) {
+		result = addnode(qpdb, qpdb->tree, &qpdb->common.origin,
+				 &qpdb->origin_node);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		result = addnode(qpdb, qpdb->nsec3, &qpdb->common.origin,
+				 &qpdb->nsec3_origin_node);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
+	/*
+	 * Version Initialization.
+	 */
+	qpdb->current_serial = 1;
+	qpdb->least_serial = 1;
+	qpdb->next_serial = 2;
+	qpdb->current_version = allocate_version(mctx, 1, 1, ISC_FALSE);
+	if (qpdb->current_version == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup;
+	}
+	qpdb->current_version->qpdb = qpdb;
+	qpdb->future_version = NULL;
+	ISC_LIST_INIT(qpdb->open_versions);
+	/*
+	 * Keep the current version in the open list so that list operation
+	 * won't happen in normal lookup operations.
+	 */
+	ISC_LIST_PREPEND(qpdb->open_versions, qpdb->current_version, link);
+
+	*dbp = (dns_db_t *)qpdb;
+
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	isc_refcount_decrement(&qpdb->references, NULL);
+	free_qpdb(qpdb);
+	return (result);
+
+ cleanup_lru_lock:
+	DESTROYLOCK(&qpdb->lru_lock);
+
+ cleanup_dead_lock:
+	DESTROYLOCK(&qpdb->dead_lock);
+
+ cleanup_tree_lock:
+	isc_rwlock_destroy(&qpdb->tree_lock);
+
+ cleanup_qpdb:
+	isc_mem_put(mctx, qpdb, sizeof(*qpdb));
+	return (result);
+}
+
+/*
+ * Slabbed Rdataset Methods
+ */
+
+static void
+rdataset_settrust(dns_rdataset_t *rdataset, dns_trust_t trust) {
+	dns_qpdb_t *qpdb = rdataset->private1;
+	rdatasetheader_t *header = rdataset->private3;
+
+	header--;
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	header->trust = rdataset->trust = trust;
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+}
+
+static void
+rdataset_expire(dns_rdataset_t *rdataset) {
+	dns_qpdb_t *qpdb = rdataset->private1;
+	rdatasetheader_t *header = rdataset->private3;
+
+	/*
+	 * Only cached data expires.
+	 */
+	if (!IS_CACHE(qpdb))
+		return;
+
+	header--;
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	expire_header(qpdb, header, expire_flush);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+}
+
+static void
+rdataset_clearprefetch(dns_rdataset_t *rdataset) {
+	dns_qpdb_t *qpdb = rdataset->private1;
+	rdatasetheader_t *header = rdataset->private3;
+
+	header--;
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	header->attributes &= ~RDATASET_ATTR_PREFETCH;
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+}
+
+static void
+rdataset_setownercase(dns_rdataset_t *rdataset, const dns_name_t *name) {
+	dns_qpdb_t *qpdb = rdataset->private1;
+	rdatasetheader_t *header = rdataset->private3;
+
+	header--;
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+	setownercase(header, name);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_write);
+}
+
+static void
+rdataset_getownercase(const dns_rdataset_t *rdataset, dns_name_t *name) {
+	const rdatasetheader_t *header = rdataset->private3;
+
+	header--;
+	if (!CASESET(header))
+		return;
+
+	dns__slabdb_getownercase(header->upper, CASEFULLYLOWER(header), name);
+}
+
+/*
+ * Rdataset Iterator Methods
+ */
+
+static void
+rdatasetiter_destroy(dns_rdatasetiter_t **iteratorp) {
+	qpdb_rdatasetiter_t *qpiterator;
+	isc_mem_t *mctx = NULL;
+
+	qpiterator = (qpdb_rdatasetiter_t *)(*iteratorp);
+
+	/*
+	 * Releasing the node may release the last database reference,
+	 * so hold on to the memory context.
+	 */
+	isc_mem_attach(qpiterator->common.db->mctx, &mctx);
+	if (qpiterator->common.version != NULL)
+		closeversion(qpiterator->common.db,
+			     &qpiterator->common.version, ISC_FALSE);
+	detachnode(qpiterator->common.db, &qpiterator->common.node);
+	isc_mem_putanddetach(&mctx, qpiterator, sizeof(*qpiterator));
+
+	*iteratorp = NULL;
+}
+
+/*%
+ * Find the first header at or after 'header' in the node's list of
+ * types which has a version active in 'serial'.
+ */
+static rdatasetheader_t *
+next_active(rdatasetheader_t *header, qpdb_serial_t serial) {
+	rdatasetheader_t *active;
+
+	for (; header != NULL; header = header->next) {
+		active = active_header(header, serial);
+		if (active != NULL)
+			return (active);
+	}
+	return (NULL);
+}
+
+/*%
+ * Find the first header at or after 'header' in a cache node's list of
+ * types which can still be served at 'now', stale or not.
+ *
+ * Unlike everywhere else, we check for now > header->rdh_ttl instead of
+ * now >= header->rdh_ttl.  This allows ANY and RRSIG queries for 0 TTL
+ * rdatasets to work.
+ */
+static rdatasetheader_t *
+next_cached(dns_qpdb_t *qpdb, rdatasetheader_t *header, isc_stdtime_t now) {
+	for (; header != NULL; header = header->next) {
+		if (!NONEXISTENT(header) && !ANCIENT(header) &&
+		    now <= header->rdh_ttl + qpdb->serve_stale_ttl)
+			return (header);
+	}
+	return (NULL);
+}
+
+static isc_result_t
+rdatasetiter_first(dns_rdatasetiter_t *iterator) {
+	qpdb_rdatasetiter_t *qpiterator = (qpdb_rdatasetiter_t *)iterator;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)(qpiterator->common.db);
+	qpdb_node_t *qpnode = qpiterator->common.node;
+	qpdb_version_t *qpversion = qpiterator->common.version;
+	rdatasetheader_t *header;
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	if (IS_CACHE(qpdb))
+		header = next_cached(qpdb, qpnode->data,
+				     qpiterator->common.now);
+	else
+		header = next_active(qpnode->data, qpversion->serial);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpiterator->current = header;
+
+	if (header == NULL)
+		return (ISC_R_NOMORE);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+rdatasetiter_next(dns_rdatasetiter_t *iterator) {
+	qpdb_rdatasetiter_t *qpiterator = (qpdb_rdatasetiter_t *)iterator;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)(qpiterator->common.db);
+	qpdb_node_t *qpnode = qpiterator->common.node;
+	qpdb_version_t *qpversion = qpiterator->common.version;
+	rdatasetheader_t *header;
+
+	header = qpiterator->current;
+	if (header == NULL)
+		return (ISC_R_NOMORE);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	/*
+	 * 'current' may be an older version of its type, whose 'next'
+	 * pointer is stale, so continue from the newest one.
+	 */
+	header = qpnode->data;
+	while (header != NULL && header->type != qpiterator->current->type)
+		header = header->next;
+	if (header != NULL && IS_CACHE(qpdb))
+		header = next_cached(qpdb, header->next,
+				     qpiterator->common.now);
+	else if (header != NULL)
+		header = next_active(header->next, qpversion->serial);
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpiterator->current = header;
+
+	if (header == NULL)
+		return (ISC_R_NOMORE);
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+rdatasetiter_current(dns_rdatasetiter_t *iterator, dns_rdataset_t *rdataset) {
+	qpdb_rdatasetiter_t *qpiterator = (qpdb_rdatasetiter_t *)iterator;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)(qpiterator->common.db);
+	qpdb_node_t *qpnode = qpiterator->common.node;
+	rdatasetheader_t *header;
+
+	header = qpiterator->current;
+	REQUIRE(header != NULL);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	bind_rdataset(qpdb, qpnode, header, qpiterator->common.now,
+		      rdataset);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+}
+
+/*
+ * Database Iterator Methods
+ */
+
+/*%
+ * Release the iterator's reference to its current node.  The iterator
+ * holds a database reference of its own, so this is never the last one.
+ *
+ * The caller must be holding the tree lock for reading.
+ */
+static inline void
+dereference_iter_node(qpdb_dbiterator_t *qpdbiter) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)qpdbiter->common.db;
+	qpdb_node_t *node = qpdbiter->node;
+	isc_boolean_t want_free;
+
+	if (node == NULL)
+		return;
+
+	want_free = decrement_reference(qpdb, node, 0, isc_rwlocktype_read);
+	INSIST(!want_free);
+	qpdbiter->node = NULL;
+}
+
+/*%
+ * Make the trie iterator valid again if the trie has changed since the
+ * last call, by finding the current node by its name.
+ *
+ * The caller must be holding the tree lock for reading.
+ */
+static inline void
+resume_iteration(qpdb_dbiterator_t *qpdbiter) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)qpdbiter->common.db;
+	dns_name_t name;
+	dns_offsets_t offsets;
+	isc_result_t result;
+
+	if (qpdbiter->generation == qpdb->generation)
+		return;
+
+	INSIST(qpdbiter->node != NULL);
+	dns_name_init(&name, offsets);
+	nodename(qpdbiter->node, &name);
+	dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+	result = dns_qpiter_seek(&qpdbiter->iter, &name, NULL);
+	/* The node is referenced, so it is still in the trie. */
+	INSIST(result == ISC_R_SUCCESS);
+	qpdbiter->generation = qpdb->generation;
+}
+
+/*%
+ * Make 'node' the current node of the iterator and release the old
+ * one.  The generation is recorded first so that if releasing the old
+ * node removes it from the trie, the next call finds its place again.
+ *
+ * The caller must be holding the tree lock for reading.
+ */
+static inline void
+set_iter_node(qpdb_dbiterator_t *qpdbiter, qpdb_node_t *node) {
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)qpdbiter->common.db;
+
+	if (node != NULL)
+		new_reference(qpdb, node);
+	qpdbiter->generation = qpdb->generation;
+	dereference_iter_node(qpdbiter);
+	qpdbiter->node = node;
+}
+
+static void
+dbiterator_destroy(dns_dbiterator_t **iteratorp) {
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)(*iteratorp);
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)qpdbiter->common.db;
+	dns_db_t *db = NULL;
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+	dereference_iter_node(qpdbiter);
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	dns_db_attach(qpdbiter->common.db, &db);
+	dns_db_detach(&qpdbiter->common.db);
+
+	isc_mem_put(db->mctx, qpdbiter, sizeof(*qpdbiter));
+	dns_db_detach(&db);
+
+	*iteratorp = NULL;
+}
+
+static inline isc_boolean_t
+iterator_usable(qpdb_dbiterator_t *qpdbiter) {
+	return (ISC_TF(qpdbiter->result == ISC_R_SUCCESS ||
+		       qpdbiter->result == ISC_R_NOTFOUND ||
+		       qpdbiter->result == DNS_R_PARTIALMATCH ||
+		       qpdbiter->result == ISC_R_NOMORE));
+}
+
+static isc_result_t
+dbiterator_first(dns_dbiterator_t *iterator) {
+	isc_result_t result;
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)iterator;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)iterator->db;
+	qpdb_node_t *node = NULL;
+
+	if (!iterator_usable(qpdbiter))
+		return (qpdbiter->result);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpdbiter->tree = qpdbiter->nsec3only ? qpdb->nsec3 : qpdb->tree;
+	dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+	result = dns_qpiter_first(&qpdbiter->iter, (void **)&node);
+	if (result == ISC_R_NOMORE && !qpdbiter->nsec3only &&
+	    !qpdbiter->nonsec3)
+	{
+		qpdbiter->tree = qpdb->nsec3;
+		dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+		result = dns_qpiter_first(&qpdbiter->iter, (void **)&node);
+	}
+	set_iter_node(qpdbiter, (result == ISC_R_SUCCESS) ? node : NULL);
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpdbiter->result = result;
+
+	return (result);
+}
+
+static isc_result_t
+dbiterator_last(dns_dbiterator_t *iterator) {
+	isc_result_t result;
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)iterator;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)iterator->db;
+	qpdb_node_t *node = NULL;
+
+	if (!iterator_usable(qpdbiter))
+		return (qpdbiter->result);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpdbiter->tree = qpdbiter->nsec3only ? qpdb->nsec3 : qpdb->tree;
+	dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+	result = dns_qpiter_last(&qpdbiter->iter, (void **)&node);
+	set_iter_node(qpdbiter, (result == ISC_R_SUCCESS) ? node : NULL);
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpdbiter->result = result;
+
+	return (result);
+}
+
+static isc_result_t
+dbiterator_seek(dns_dbiterator_t *iterator, const dns_name_t *name) {
+	isc_result_t result;
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)iterator;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)iterator->db;
+	qpdb_node_t *node = NULL;
+
+	if (!iterator_usable(qpdbiter))
+		return (qpdbiter->result);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	/*
+	 * Only names at or below the origin are in the database.
+	 */
+	if (!dns_name_issubdomain(name, &qpdb->common.origin)) {
+		set_iter_node(qpdbiter, NULL);
+		result = ISC_R_NOTFOUND;
+		goto unlock;
+	}
+
+	qpdbiter->tree = qpdbiter->nsec3only ? qpdb->nsec3 : qpdb->tree;
+	dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+	result = dns_qpiter_seek(&qpdbiter->iter, name, (void **)&node);
+	if (result == DNS_R_PARTIALMATCH && !qpdbiter->nsec3only &&
+	    !qpdbiter->nonsec3)
+	{
+		/*
+		 * Stay on the main trie if not found in either.
+		 */
+		qpdb_node_t *nsec3node = NULL;
+
+		if (dns_qp_getname(qpdb->nsec3, name,
+				   (void **)&nsec3node) == ISC_R_SUCCESS)
+		{
+			qpdbiter->tree = qpdb->nsec3;
+			dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+			result = dns_qpiter_seek(&qpdbiter->iter, name,
+						 (void **)&node);
+			INSIST(result == ISC_R_SUCCESS);
+		}
+	}
+	/*
+	 * Every name below the origin sorts after it, so the search in
+	 * the main trie always lands somewhere.
+	 */
+	INSIST(result != ISC_R_NOTFOUND || qpdbiter->nsec3only);
+	set_iter_node(qpdbiter, (result == ISC_R_NOTFOUND) ? NULL : node);
+
+ unlock:
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpdbiter->result = (result == DNS_R_PARTIALMATCH) ?
+			   ISC_R_SUCCESS : result;
+
+	return (result);
+}
+
+static isc_result_t
+dbiterator_prev(dns_dbiterator_t *iterator) {
+	isc_result_t result;
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)iterator;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)iterator->db;
+	qpdb_node_t *node = NULL;
+
+	REQUIRE(qpdbiter->node != NULL);
+
+	if (qpdbiter->result != ISC_R_SUCCESS)
+		return (qpdbiter->result);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	resume_iteration(qpdbiter);
+	result = dns_qpiter_prev(&qpdbiter->iter, (void **)&node);
+	if (result == ISC_R_NOMORE && !qpdbiter->nsec3only &&
+	    !qpdbiter->nonsec3 && qpdbiter->tree == qpdb->nsec3)
+	{
+		qpdbiter->tree = qpdb->tree;
+		dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+		result = dns_qpiter_last(&qpdbiter->iter, (void **)&node);
+	}
+	set_iter_node(qpdbiter, (result == ISC_R_SUCCESS) ? node : NULL);
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpdbiter->result = result;
+
+	return (result);
+}
+
+static isc_result_t
+dbiterator_next(dns_dbiterator_t *iterator) {
+	isc_result_t result;
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)iterator;
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)iterator->db;
+	qpdb_node_t *node = NULL;
+
+	REQUIRE(qpdbiter->node != NULL);
+
+	if (qpdbiter->result != ISC_R_SUCCESS)
+		return (qpdbiter->result);
+
+	RWLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	resume_iteration(qpdbiter);
+	result = dns_qpiter_next(&qpdbiter->iter, (void **)&node);
+	if (result == ISC_R_NOMORE && !qpdbiter->nsec3only &&
+	    !qpdbiter->nonsec3 && qpdbiter->tree == qpdb->tree)
+	{
+		qpdbiter->tree = qpdb->nsec3;
+		dns_qpiter_init(qpdbiter->tree, &qpdbiter->iter);
+		result = dns_qpiter_first(&qpdbiter->iter, (void **)&node);
+	}
+	set_iter_node(qpdbiter, (result == ISC_R_SUCCESS) ? node : NULL);
+
+	RWUNLOCK(&qpdb->tree_lock, isc_rwlocktype_read);
+
+	qpdbiter->result = result;
+
+	return (result);
+}
+
+static isc_result_t
+dbiterator_current(dns_dbiterator_t *iterator, dns_dbnode_t **nodep,
+		   dns_name_t *name)
+{
+	dns_qpdb_t *qpdb = (dns_qpdb_t *)iterator->db;
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)iterator;
+	qpdb_node_t *node = qpdbiter->node;
+	dns_name_t nname;
+	dns_offsets_t offsets;
+	isc_result_t result;
+
+	REQUIRE(qpdbiter->result == ISC_R_SUCCESS);
+	REQUIRE(qpdbiter->node != NULL);
+
+	/*
+	 * Names are always absolute; dbiterator_origin() returns the
+	 * root name.
+	 */
+	if (name != NULL) {
+		dns_name_init(&nname, offsets);
+		nodename(node, &nname);
+		result = dns_name_copy(&nname, name, NULL);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+
+	new_reference(qpdb, node);
+
+	*nodep = qpdbiter->node;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+dbiterator_pause(dns_dbiterator_t *iterator) {
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)iterator;
+
+	/*
+	 * The tree is never kept locked between calls.
+	 */
+	if (!iterator_usable(qpdbiter))
+		return (qpdbiter->result);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+dbiterator_origin(dns_dbiterator_t *iterator, dns_name_t *name) {
+	qpdb_dbiterator_t *qpdbiter = (qpdb_dbiterator_t *)iterator;
+
+	if (qpdbiter->result != ISC_R_SUCCESS)
+		return (qpdbiter->result);
+
+	return (dns_name_copy(dns_rootname, name, NULL));
+}
@@ -65,7 +65,12 @@
 #define CHAIN_MAGIC             ISC_MAGIC('0', '-', '0', '-')
 #define VALID_CHAIN(chain)      ISC_MAGIC_VALID(chain, CHAIN_MAGIC)
 
-#define RBT_HASH_SIZE           64
+/*%
+ * Initial number of hash buckets.  The table grows with the tree, so this
+ * is kept small: zone databases carry three trees each, most of which stay
+ * tiny or empty.
+ */
+#define RBT_HASH_SIZE           16
 
 #ifdef RBT_MEM_TEST
 #undef RBT_HASH_SIZE
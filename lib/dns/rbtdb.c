@@ -83,6 +83,7 @@
 #else
 #include "rbtdb.h"
 #endif
+#include "slabdb_p.h"
 
 #ifdef DNS_RBTDB_VERSION64
 #define RBTDB_MAGIC                     ISC_MAGIC('R', 'B', 'D', '8')
@@ -143,7 +144,6 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define dbiterator_methods dbiterator_methods64
 #define rdataset_methods rdataset_methods64
 #define rdatasetiter_methods rdatasetiter_methods64
-#define slab_methods slab_methods64
 #define zone_methods zone_methods64
 
 #define activeempty activeempty64
@@ -152,8 +152,6 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define add_changed add_changed64
 #define add_empty_wildcards add_empty_wildcards64
 #define add_wildcard_magic add_wildcard_magic64
-#define addclosest addclosest64
-#define addnoqname addnoqname64
 #define addrdataset addrdataset64
 #define adjust_quantum adjust_quantum64
 #define allocate_version allocate_tversion64
@@ -202,6 +200,7 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define expirenode expirenode64
 #define find_closest_nsec find_closest_nsec64
 #define find_coveringnsec find_coveringnsec64
+#define find_coveringnsec3 find_coveringnsec364
 #define find_deepest_zonecut find_deepest_zonecut64
 #define find_wildcard find_wildcard64
 #define findnode findnode64
@@ -210,7 +209,6 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define flush_deletions flush_deletions64
 #define free_gluelist free_gluelist64
 #define free_gluetable free_gluetable64
-#define free_noqname free_noqname64
 #define free_rbtdb free_rbtdb64
 #define free_rbtdb_callback free_rbtdb_callback64
 #define free_rdataset free_rdataset64
@@ -222,13 +220,17 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define getsize getsize64
 #define glue_nsdname_cb glue_nsdname_cb64
 #define hashsize hashsize64
+#define header_cost header_cost64
 #define init_file_version init_file_version64
 #define init_rdataset init_rdataset64
 #define isdnssec isdnssec64
 #define ispersistent ispersistent64
 #define issecure issecure64
 #define iszonesecure iszonesecure64
+#define loading_addprepared loading_addprepared64
 #define loading_addrdataset loading_addrdataset64
+#define loading_freeprepared loading_freeprepared64
+#define loading_prepare loading_prepare64
 #define loadnode loadnode64
 #define make_least_version make_least_version64
 #define mark_header_ancient mark_header_ancient64
@@ -253,16 +255,8 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define rbtdb_zero_header rbtdb_zero_header64
 #define rdataset_addglue rdataset_addglue64
 #define rdataset_clearprefetch rdataset_clearprefetch64
-#define rdataset_clone rdataset_clone64
-#define rdataset_count rdataset_count64
-#define rdataset_current rdataset_current64
-#define rdataset_disassociate rdataset_disassociate64
 #define rdataset_expire rdataset_expire64
-#define rdataset_first rdataset_first64
-#define rdataset_getclosest rdataset_getclosest64
-#define rdataset_getnoqname rdataset_getnoqname64
 #define rdataset_getownercase rdataset_getownercase64
-#define rdataset_next rdataset_next64
 #define rdataset_setownercase rdataset_setownercase64
 #define rdataset_settrust rdataset_settrust64
 #define rdatasetiter_current rdatasetiter_current64
@@ -283,7 +277,6 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define set_ttl set_ttl64
 #define setcachestats setcachestats64
 #define setgluecachestats setgluecachestats64
-#define setnsec3parameters setnsec3parameters64
 #define setownercase setownercase64
 #define setservestalettl setservestalettl64
 #define setsigningtime setsigningtime64
@@ -417,12 +410,19 @@ typedef isc_mutex_t nodelock_t;
  */
 #define RBTDB_VIRTUAL 300
 
-struct noqname {
-	dns_name_t 	name;
-	void *     	neg;
-	void *     	negsig;
-	dns_rdatatype_t	type;
-};
+/*%
+ * Number of headers at the tail of each LRU list that overmem_purge()
+ * examines when choosing which one to evict.
+ */
+#define RBTDB_PURGE_SAMPLE 8
+
+#define RBTDB_HITS_MAX 7
+
+/*%
+ * Number of entries of a cache's auxiliary NSEC3 tree that
+ * find_coveringnsec3() examines before giving up.
+ */
+#define RBTDB_NSEC3_MAXSTEPS 16
 
 typedef struct rdatasetheader {
 	/*%
@@ -433,12 +433,17 @@ typedef struct rdatasetheader {
 	rbtdb_rdatatype_t               type;
 	isc_uint16_t                    attributes;
 	dns_trust_t                     trust;
-	struct noqname                  *noqname;
-	struct noqname                  *closest;
+	slabdb_proof_t                  *noqname;
+	slabdb_proof_t                  *closest;
 	unsigned int 			is_mmapped : 1;
 	unsigned int 			next_is_relative : 1;
 	unsigned int 			node_is_relative : 1;
 	unsigned int 			resign_lsb : 1;
+	unsigned int			hits : 3;
+	/*%<
+	 * Saturating count of recent cache hits, halved whenever the
+	 * header survives an overmem_purge() pass.
+	 */
 	/*%<
 	 * We don't use the LIST macros, because the LIST structure has
 	 * both head and tail pointers, and is doubly linked.
@@ -547,7 +552,23 @@ typedef ISC_LIST(dns_rbtnode_t)         rbtnodelist_t;
 	(((header)->rdh_ttl > (now)) || \
 	 ((header)->rdh_ttl == (now) && ZEROTTL(header)))
 
+/*%
+ * Number of node locks (and resigning heaps and dead node lists) for zone
+ * databases.  Each costs a few hundred bytes per zone, about a fifth of
+ * the footprint of a small zone with the default; servers hosting a great
+ * many tiny zones can lower it at compilation time via the
+ * DNS_RBTDB_NODE_LOCK_COUNT variable, at the expense of more lock
+ * contention when querying a single large zone.
+ */
+#ifdef DNS_RBTDB_NODE_LOCK_COUNT
+#if DNS_RBTDB_NODE_LOCK_COUNT < 1
+#error "DNS_RBTDB_NODE_LOCK_COUNT must be at least 1"
+#else
+#define DEFAULT_NODE_LOCK_COUNT DNS_RBTDB_NODE_LOCK_COUNT
+#endif
+#else
 #define DEFAULT_NODE_LOCK_COUNT         7       /*%< Should be prime. */
+#endif	/* DNS_RBTDB_NODE_LOCK_COUNT */
 #define RBTDB_GLUE_TABLE_INIT_SIZE     2U
 
 /*%
@@ -586,12 +607,6 @@ typedef struct rbtdb_changed {
 
 typedef ISC_LIST(rbtdb_changed_t)       rbtdb_changedlist_t;
 
-typedef enum {
-	dns_db_insecure,
-	dns_db_partial,
-	dns_db_secure
-} dns_db_secure_t;
-
 typedef struct dns_rbtdb dns_rbtdb_t;
 
 /* Reason for expiring a record from cache */
@@ -633,12 +648,7 @@ typedef struct rbtdb_version {
 	ISC_LINK(struct rbtdb_version)  link;
 	dns_db_secure_t			secure;
 	isc_boolean_t			havensec3;
-	/* NSEC3 parameters */
-	dns_hash_t			hash;
-	isc_uint8_t			flags;
-	isc_uint16_t			iterations;
-	isc_uint8_t			salt_length;
-	unsigned char			salt[DNS_NSEC3_SALTSIZE];
+	slabdb_nsec3params_t		nsec3params;
 
 	/*
 	 * records and bytes are covered by rwlock.
@@ -764,20 +774,6 @@ typedef struct {
 } rbtdb_load_t;
 
 static void delete_callback(void *data, void *arg);
-static void rdataset_disassociate(dns_rdataset_t *rdataset);
-static isc_result_t rdataset_first(dns_rdataset_t *rdataset);
-static isc_result_t rdataset_next(dns_rdataset_t *rdataset);
-static void rdataset_current(dns_rdataset_t *rdataset, dns_rdata_t *rdata);
-static void rdataset_clone(dns_rdataset_t *source, dns_rdataset_t *target);
-static unsigned int rdataset_count(dns_rdataset_t *rdataset);
-static isc_result_t rdataset_getnoqname(dns_rdataset_t *rdataset,
-					dns_name_t *name,
-					dns_rdataset_t *neg,
-					dns_rdataset_t *negsig);
-static isc_result_t rdataset_getclosest(dns_rdataset_t *rdataset,
-					dns_name_t *name,
-					dns_rdataset_t *neg,
-					dns_rdataset_t *negsig);
 static inline isc_boolean_t need_headerupdate(rdatasetheader_t *header,
 					      isc_stdtime_t now);
 static void update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
@@ -785,7 +781,8 @@ static void update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
 static void expire_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
 			  isc_boolean_t tree_locked, expire_t reason);
 static void overmem_purge(dns_rbtdb_t *rbtdb, unsigned int locknum_start,
-			  isc_stdtime_t now, isc_boolean_t tree_locked);
+			  size_t purgesize, isc_stdtime_t now,
+			  isc_boolean_t tree_locked);
 static isc_result_t resign_insert(dns_rbtdb_t *rbtdb, int idx,
 				  rdatasetheader_t *newheader);
 static void resign_delete(dns_rbtdb_t *rbtdb, rbtdb_version_t *version,
@@ -805,16 +802,16 @@ static isc_result_t rdataset_addglue(dns_rdataset_t *rdataset,
 static void free_gluetable(rbtdb_version_t *version);
 
 static dns_rdatasetmethods_t rdataset_methods = {
-	rdataset_disassociate,
-	rdataset_first,
-	rdataset_next,
-	rdataset_current,
-	rdataset_clone,
-	rdataset_count,
+	dns__slabdb_disassociate,
+	dns__slabdb_first,
+	dns__slabdb_next,
+	dns__slabdb_current,
+	dns__slabdb_clone,
+	dns__slabdb_count,
 	NULL, /* addnoqname */
-	rdataset_getnoqname,
+	dns__slabdb_getnoqname,
 	NULL, /* addclosest */
-	rdataset_getclosest,
+	dns__slabdb_getclosest,
 	rdataset_settrust,
 	rdataset_expire,
 	rdataset_clearprefetch,
@@ -823,25 +820,6 @@ static dns_rdatasetmethods_t rdataset_methods = {
 	rdataset_addglue
 };
 
-static dns_rdatasetmethods_t slab_methods = {
-	rdataset_disassociate,
-	rdataset_first,
-	rdataset_next,
-	rdataset_current,
-	rdataset_clone,
-	rdataset_count,
-	NULL, /* addnoqname */
-	NULL, /* getnoqname */
-	NULL, /* addclosest */
-	NULL, /* getclosest */
-	NULL, /* settrust */
-	NULL, /* expire */
-	NULL, /* clearprefetch */
-	NULL, /* setownercase */
-	NULL, /* getownercase */
-	NULL  /* addglue */
-};
-
 static void rdatasetiter_destroy(dns_rdatasetiter_t **iteratorp);
 static isc_result_t rdatasetiter_first(dns_rdatasetiter_t *iterator);
 static isc_result_t rdatasetiter_next(dns_rdatasetiter_t *iterator);
@@ -925,7 +903,6 @@ typedef struct rbtdb_dbiterator {
 static void free_rbtdb(dns_rbtdb_t *rbtdb, isc_boolean_t log,
 		       isc_event_t *event);
 static void overmem(dns_db_t *db, isc_boolean_t over);
-static void setnsec3parameters(dns_db_t *db, rbtdb_version_t *version);
 static void setownercase(rdatasetheader_t *header, const dns_name_t *name);
 
 static isc_boolean_t match_header_version(rbtdb_file_header_t *header);
@@ -1516,22 +1493,12 @@ newversion(dns_db_t *db, dns_dbversion_t **versionp) {
 		version->commit_ok = ISC_TRUE;
 		version->secure = rbtdb->current_version->secure;
 		version->havensec3 = rbtdb->current_version->havensec3;
-		if (version->havensec3) {
-			version->flags = rbtdb->current_version->flags;
-			version->iterations =
-				rbtdb->current_version->iterations;
-			version->hash = rbtdb->current_version->hash;
-			version->salt_length =
-				rbtdb->current_version->salt_length;
-			memmove(version->salt, rbtdb->current_version->salt,
-				version->salt_length);
-		} else {
-			version->flags = 0;
-			version->iterations = 0;
-			version->hash = 0;
-			version->salt_length = 0;
-			memset(version->salt, 0, sizeof(version->salt));
-		}
+		if (version->havensec3)
+			version->nsec3params =
+				rbtdb->current_version->nsec3params;
+		else
+			memset(&version->nsec3params, 0,
+			       sizeof(version->nsec3params));
 		result = isc_rwlock_init(&version->rwlock, 0, 0);
 		if (result != ISC_R_SUCCESS) {
 			free_gluetable(version);
@@ -1611,21 +1578,6 @@ add_changed(dns_rbtdb_t *rbtdb, rbtdb_version_t *version,
 	return (changed);
 }
 
-static inline void
-free_noqname(isc_mem_t *mctx, struct noqname **noqname) {
-
-	if (dns_name_dynamic(&(*noqname)->name))
-		dns_name_free(&(*noqname)->name, mctx);
-	if ((*noqname)->neg != NULL)
-		isc_mem_put(mctx, (*noqname)->neg,
-			    dns_rdataslab_size((*noqname)->neg, 0));
-	if ((*noqname)->negsig != NULL)
-		isc_mem_put(mctx, (*noqname)->negsig,
-			    dns_rdataslab_size((*noqname)->negsig, 0));
-	isc_mem_put(mctx, *noqname, sizeof(**noqname));
-	*noqname = NULL;
-}
-
 static inline void
 init_rdataset(dns_rbtdb_t *rbtdb, rdatasetheader_t *h) {
 	ISC_LINK_INIT(h, link);
@@ -1633,6 +1585,7 @@ init_rdataset(dns_rbtdb_t *rbtdb, rdatasetheader_t *h) {
 	h->is_mmapped = 0;
 	h->next_is_relative = 0;
 	h->node_is_relative = 0;
+	h->hits = 0;
 
 #if TRACE_HEADER
 	if (IS_CACHE(rbtdb) && rbtdb->common.rdclass == dns_rdataclass_in)
@@ -1708,9 +1661,9 @@ free_rdataset(dns_rbtdb_t *rbtdb, isc_mem_t *mctx, rdatasetheader_t *rdataset) {
 	rdataset->heap_index = 0;
 
 	if (rdataset->noqname != NULL)
-		free_noqname(mctx, &rdataset->noqname);
+		dns__slabdb_freeproof(mctx, &rdataset->noqname);
 	if (rdataset->closest != NULL)
-		free_noqname(mctx, &rdataset->closest);
+		dns__slabdb_freeproof(mctx, &rdataset->closest);
 
 	if (NONEXISTENT(rdataset))
 		size = sizeof(*rdataset);
@@ -2532,151 +2485,11 @@ cleanup_nondirty(rbtdb_version_t *version, rbtdb_changedlist_t *cleanup_list) {
 
 static void
 iszonesecure(dns_db_t *db, rbtdb_version_t *version, dns_dbnode_t *origin) {
-	dns_rdataset_t keyset;
-	dns_rdataset_t nsecset, signsecset;
-	isc_boolean_t haszonekey = ISC_FALSE;
-	isc_boolean_t hasnsec = ISC_FALSE;
-	isc_result_t result;
-
-	dns_rdataset_init(&keyset);
-	result = dns_db_findrdataset(db, origin, version, dns_rdatatype_dnskey,
-				     0, 0, &keyset, NULL);
-	if (result == ISC_R_SUCCESS) {
-		result = dns_rdataset_first(&keyset);
-		while (result == ISC_R_SUCCESS) {
-			dns_rdata_t keyrdata = DNS_RDATA_INIT;
-			dns_rdataset_current(&keyset, &keyrdata);
-			if (dns_zonekey_iszonekey(&keyrdata)) {
-				haszonekey = ISC_TRUE;
-				break;
-			}
-			result = dns_rdataset_next(&keyset);
-		}
-		dns_rdataset_disassociate(&keyset);
-	}
-	if (!haszonekey) {
-		version->secure = dns_db_insecure;
-		version->havensec3 = ISC_FALSE;
-		return;
-	}
-
-	dns_rdataset_init(&nsecset);
-	dns_rdataset_init(&signsecset);
-	result = dns_db_findrdataset(db, origin, version, dns_rdatatype_nsec,
-				     0, 0, &nsecset, &signsecset);
-	if (result == ISC_R_SUCCESS) {
-		if (dns_rdataset_isassociated(&signsecset)) {
-			hasnsec = ISC_TRUE;
-			dns_rdataset_disassociate(&signsecset);
-		}
-		dns_rdataset_disassociate(&nsecset);
-	}
-
-	setnsec3parameters(db, version);
-
-	/*
-	 * Do we have a valid NSEC/NSEC3 chain?
-	 */
-	if (version->havensec3 || hasnsec)
-		version->secure = dns_db_secure;
-	else
-		version->secure = dns_db_insecure;
-}
-
-/*%<
- * Walk the origin node looking for NSEC3PARAM records.
- * Cache the nsec3 parameters.
- */
-static void
-setnsec3parameters(dns_db_t *db, rbtdb_version_t *version) {
-	dns_rbtnode_t *node;
-	dns_rdata_nsec3param_t nsec3param;
-	dns_rdata_t rdata = DNS_RDATA_INIT;
-	isc_region_t region;
-	isc_result_t result;
-	rdatasetheader_t *header, *header_next;
-	unsigned char *raw;             /* RDATASLAB */
-	unsigned int count, length;
-	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
-
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
-	version->havensec3 = ISC_FALSE;
-	node = rbtdb->origin_node;
-	NODE_LOCK(&(rbtdb->node_locks[node->locknum].lock),
-		  isc_rwlocktype_read);
-	for (header = node->data;
-	     header != NULL;
-	     header = header_next) {
-		header_next = header->next;
-		do {
-			if (header->serial <= version->serial &&
-			    !IGNORE(header)) {
-				if (NONEXISTENT(header))
-					header = NULL;
-				break;
-			} else
-				header = header->down;
-		} while (header != NULL);
-
-		if (header != NULL &&
-		    (header->type == dns_rdatatype_nsec3param)) {
-			/*
-			 * Find A NSEC3PARAM with a supported algorithm.
-			 */
-			raw = (unsigned char *)header + sizeof(*header);
-			count = raw[0] * 256 + raw[1]; /* count */
-#if DNS_RDATASET_FIXED
-			raw += count * 4 + 2;
-#else
-			raw += 2;
-#endif
-			while (count-- > 0U) {
-				length = raw[0] * 256 + raw[1];
-#if DNS_RDATASET_FIXED
-				raw += 4;
-#else
-				raw += 2;
-#endif
-				region.base = raw;
-				region.length = length;
-				raw += length;
-				dns_rdata_fromregion(&rdata,
-						     rbtdb->common.rdclass,
-						     dns_rdatatype_nsec3param,
-						     &region);
-				result = dns_rdata_tostruct(&rdata,
-							    &nsec3param,
-							    NULL);
-				INSIST(result == ISC_R_SUCCESS);
-				dns_rdata_reset(&rdata);
-
-				if (nsec3param.hash != DNS_NSEC3_UNKNOWNALG &&
-				    !dns_nsec3_supportedhash(nsec3param.hash))
-					continue;
-
-				if (nsec3param.flags != 0)
-					continue;
-
-				memmove(version->salt, nsec3param.salt,
-					nsec3param.salt_length);
-				version->hash = nsec3param.hash;
-				version->salt_length = nsec3param.salt_length;
-				version->iterations = nsec3param.iterations;
-				version->flags = nsec3param.flags;
-				version->havensec3 = ISC_TRUE;
-				/*
-				 * Look for a better algorithm than the
-				 * unknown test algorithm.
-				 */
-				if (nsec3param.hash != DNS_NSEC3_UNKNOWNALG)
-					goto unlock;
-			}
-		}
-	}
- unlock:
-	NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].lock),
-		    isc_rwlocktype_read);
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	version->secure = dns__slabdb_iszonesecure(db,
+						   (dns_dbversion_t *)version,
+						   origin,
+						   &version->nsec3params,
+						   &version->havensec3);
 }
 
 static void
@@ -3417,12 +3230,6 @@ static inline isc_boolean_t
 valid_glue(rbtdb_search_t *search, dns_name_t *name, rbtdb_rdatatype_t type,
 	   dns_rbtnode_t *node)
 {
-	unsigned char *raw;     /* RDATASLAB */
-	unsigned int count, size;
-	dns_name_t ns_name;
-	isc_boolean_t valid = ISC_FALSE;
-	dns_offsets_t offsets;
-	isc_region_t region;
 	rdatasetheader_t *header;
 
 	/*
@@ -3444,38 +3251,8 @@ valid_glue(rbtdb_search_t *search, dns_name_t *name, rbtdb_rdatatype_t type,
 	}
 
 	header = search->zonecut_rdataset;
-	raw = (unsigned char *)header + sizeof(*header);
-	count = raw[0] * 256 + raw[1];
-#if DNS_RDATASET_FIXED
-	raw += 2 + (4 * count);
-#else
-	raw += 2;
-#endif
-
-	while (count > 0) {
-		count--;
-		size = raw[0] * 256 + raw[1];
-#if DNS_RDATASET_FIXED
-		raw += 4;
-#else
-		raw += 2;
-#endif
-		region.base = raw;
-		region.length = size;
-		raw += size;
-		/*
-		 * XXX Until we have rdata structures, we have no choice but
-		 * to directly access the rdata format.
-		 */
-		dns_name_init(&ns_name, offsets);
-		dns_name_fromregion(&ns_name, &region);
-		if (dns_name_compare(&ns_name, name) == 0) {
-			valid = ISC_TRUE;
-			break;
-		}
-	}
-
-	return (valid);
+	return (dns__slabdb_hasnstarget((unsigned char *)(header + 1),
+					search->rbtdb->common.rdclass, name));
 }
 
 static inline isc_boolean_t
@@ -3804,47 +3581,12 @@ find_wildcard(rbtdb_search_t *search, dns_rbtnode_t **nodep,
 }
 
 static isc_boolean_t
-matchparams(rdatasetheader_t *header, rbtdb_search_t *search)
-{
-	dns_rdata_t rdata = DNS_RDATA_INIT;
-	dns_rdata_nsec3_t nsec3;
-	unsigned char *raw;                     /* RDATASLAB */
-	unsigned int rdlen, count;
-	isc_region_t region;
-	isc_result_t result;
-
+matchparams(rdatasetheader_t *header, rbtdb_search_t *search) {
 	REQUIRE(header->type == dns_rdatatype_nsec3);
 
-	raw = (unsigned char *)header + sizeof(*header);
-	count = raw[0] * 256 + raw[1]; /* count */
-#if DNS_RDATASET_FIXED
-	raw += count * 4 + 2;
-#else
-	raw += 2;
-#endif
-	while (count-- > 0) {
-		rdlen = raw[0] * 256 + raw[1];
-#if DNS_RDATASET_FIXED
-		raw += 4;
-#else
-		raw += 2;
-#endif
-		region.base = raw;
-		region.length = rdlen;
-		dns_rdata_fromregion(&rdata, search->rbtdb->common.rdclass,
-				     dns_rdatatype_nsec3, &region);
-		raw += rdlen;
-		result = dns_rdata_tostruct(&rdata, &nsec3, NULL);
-		INSIST(result == ISC_R_SUCCESS);
-		if (nsec3.hash == search->rbtversion->hash &&
-		    nsec3.iterations == search->rbtversion->iterations &&
-		    nsec3.salt_length == search->rbtversion->salt_length &&
-		    memcmp(nsec3.salt, search->rbtversion->salt,
-			   nsec3.salt_length) == 0)
-			return (ISC_TRUE);
-		dns_rdata_reset(&rdata);
-	}
-	return (ISC_FALSE);
+	return (dns__slabdb_matchnsec3((unsigned char *)(header + 1),
+				       search->rbtdb->common.rdclass,
+				       &search->rbtversion->nsec3params));
 }
 
 /*
@@ -5041,6 +4783,180 @@ find_coveringnsec(rbtdb_search_t *search, dns_dbnode_t **nodep,
 	return (result);
 }
 
+/*
+ * Find the cached NSEC3 record whose owner is 'name', or failing that
+ * the one whose owner precedes 'name' in the hash order of the zone
+ * that 'name' is directly below.  If no earlier NSEC3 record of the
+ * zone is cached, wrap around to the last one, which covers the start
+ * of the chain.
+ *
+ * The owners of cached NSEC3 records are indexed in the auxiliary NSEC
+ * tree along with those of NSEC records; only RBTDB_NSEC3_MAXSTEPS
+ * entries of it are examined so that a long NSEC3 chain of a child
+ * zone, which sorts in between, does not make this expensive.
+ *
+ * The tree lock must be held.
+ */
+static isc_result_t
+find_coveringnsec3(rbtdb_search_t *search, const dns_name_t *name,
+		   dns_dbnode_t **nodep, dns_name_t *foundname,
+		   dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset)
+{
+	static unsigned char maxlabel[] = { 1, 0xff };
+	dns_rbtdb_t *rbtdb = search->rbtdb;
+	dns_rbtnode_t *node;
+	rdatasetheader_t *header, *header_next, *header_prev;
+	rdatasetheader_t *found, *foundsig;
+	dns_rbtnodechain_t chain;
+	dns_fixedname_t fzone, fmax, fname, forigin, fowner;
+	dns_name_t *zone, *owner, *auxname, *auxorigin;
+	dns_name_t maxname;
+	const dns_name_t *target = name;
+	isc_region_t r;
+	nodelock_t *lock;
+	isc_rwlocktype_t locktype;
+	isc_boolean_t wrapped = ISC_FALSE;
+	unsigned int labels, steps = 0;
+	isc_result_t result;
+
+	labels = dns_name_countlabels(name);
+	if (labels < 2)
+		return (ISC_R_NOTFOUND);
+
+	dns_fixedname_init(&fzone);
+	zone = dns_fixedname_name(&fzone);
+	dns_name_split(name, labels - 1, NULL, zone);
+	dns_fixedname_init(&fname);
+	auxname = dns_fixedname_name(&fname);
+	dns_fixedname_init(&forigin);
+	auxorigin = dns_fixedname_name(&forigin);
+	dns_fixedname_init(&fowner);
+	owner = dns_fixedname_name(&fowner);
+
+	dns_rbtnodechain_init(&chain, rbtdb->common.mctx);
+
+ search:
+	node = NULL;
+	result = dns_rbt_findnode(rbtdb->nsec, target, NULL, &node, &chain,
+				  DNS_RBTFIND_EMPTYDATA, NULL, NULL);
+	if (result == ISC_R_SUCCESS || result == DNS_R_PARTIALMATCH ||
+	    result == ISC_R_NOTFOUND)
+	{
+		result = dns_rbtnodechain_current(&chain, auxname, auxorigin,
+						  NULL);
+	}
+
+	while (result == ISC_R_SUCCESS) {
+		if (++steps > RBTDB_NSEC3_MAXSTEPS) {
+			result = ISC_R_NOTFOUND;
+			goto done;
+		}
+
+		result = dns_name_concatenate(auxname, auxorigin, owner, NULL);
+		if (result != ISC_R_SUCCESS)
+			goto done;
+
+		/*
+		 * Everything preceding the zone itself is outside it.
+		 */
+		if (!dns_name_issubdomain(owner, zone) ||
+		    dns_name_equal(owner, zone))
+		{
+			break;
+		}
+
+		node = NULL;
+		if (dns_name_countlabels(owner) == labels &&
+		    dns_rbt_findnode(rbtdb->tree, owner, NULL, &node, NULL,
+				     DNS_RBTFIND_EMPTYDATA, NULL,
+				     NULL) == ISC_R_SUCCESS)
+		{
+			lock = &rbtdb->node_locks[node->locknum].lock;
+			locktype = isc_rwlocktype_read;
+			NODE_LOCK(lock, locktype);
+			found = NULL;
+			foundsig = NULL;
+			header_prev = NULL;
+			for (header = node->data;
+			     header != NULL;
+			     header = header_next)
+			{
+				header_next = header->next;
+				if (check_stale_header(node, header,
+						       &locktype, lock, search,
+						       &header_prev))
+				{
+					continue;
+				}
+				if (header->type == dns_rdatatype_nsec3)
+					found = header;
+				else if (header->type ==
+					 RBTDB_RDATATYPE_SIGNSEC3)
+					foundsig = header;
+				header_prev = header;
+			}
+			if (found != NULL) {
+				bind_rdataset(rbtdb, node, found,
+					      search->now, rdataset);
+				if (foundsig != NULL)
+					bind_rdataset(rbtdb, node, foundsig,
+						      search->now,
+						      sigrdataset);
+				if (nodep != NULL) {
+					new_reference(rbtdb, node);
+					*nodep = node;
+				}
+			}
+			NODE_UNLOCK(lock, locktype);
+			if (found != NULL) {
+				result = dns_name_copy(owner, foundname, NULL);
+				if (result == ISC_R_SUCCESS &&
+				    !dns_name_equal(owner, name))
+				{
+					result = DNS_R_COVERINGNSEC;
+				}
+				goto done;
+			}
+		}
+
+		result = dns_rbtnodechain_prev(&chain, auxname, auxorigin);
+		if (result == DNS_R_NEWORIGIN)
+			result = ISC_R_SUCCESS;
+	}
+
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE &&
+	    result != ISC_R_NOTFOUND)
+	{
+		goto done;
+	}
+
+	/*
+	 * Nothing precedes 'name' in the zone; restart from the
+	 * end of the zone's hash order.
+	 */
+	if (wrapped) {
+		result = ISC_R_NOTFOUND;
+		goto done;
+	}
+	wrapped = ISC_TRUE;
+	dns_name_init(&maxname, NULL);
+	r.base = maxlabel;
+	r.length = sizeof(maxlabel);
+	dns_name_fromregion(&maxname, &r);
+	dns_fixedname_init(&fmax);
+	result = dns_name_concatenate(&maxname, zone,
+				      dns_fixedname_name(&fmax), NULL);
+	if (result != ISC_R_SUCCESS)
+		goto done;
+	target = dns_fixedname_name(&fmax);
+	dns_rbtnodechain_reset(&chain);
+	goto search;
+
+ done:
+	dns_rbtnodechain_invalidate(&chain);
+	return (result);
+}
+
 static isc_result_t
 cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	   dns_rdatatype_t type, unsigned int options, isc_stdtime_t now,
@@ -5086,6 +5002,21 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 
 	RWLOCK(&search.rbtdb->tree_lock, isc_rwlocktype_read);
 
+	/*
+	 * Covering NSEC3 records are looked up by their hashed owner
+	 * names in the auxiliary NSEC3 tree, bypassing the main tree.
+	 */
+	if (type == dns_rdatatype_nsec3 &&
+	    (options & DNS_DBFIND_FORCENSEC3) != 0 &&
+	    (options & DNS_DBFIND_COVERINGNSEC) != 0)
+	{
+		result = find_coveringnsec3(&search, name, nodep, foundname,
+					    rdataset, sigrdataset);
+		RWUNLOCK(&search.rbtdb->tree_lock, isc_rwlocktype_read);
+		dns_rbtnodechain_reset(&search.chain);
+		return (result);
+	}
+
 	/*
 	 * Search down from the root of the tree.  If, while going down, we
 	 * encounter a callback node, cache_zonecut_callback() will search the
@@ -6536,6 +6467,11 @@ add32(dns_rbtdb_t *rbtdb, dns_rbtnode_t *rbtnode, rbtdb_version_t *rbtversion,
 		} else {
 			idx = newheader->node->locknum;
 			if (IS_CACHE(rbtdb)) {
+				/*
+				 * The replacement inherits the popularity
+				 * of the data it replaces.
+				 */
+				newheader->hits = header->hits;
 				INSIST(rbtdb->heaps != NULL);
 				result = isc_heap_insert(rbtdb->heaps[idx],
 							 newheader);
@@ -6693,108 +6629,6 @@ delegating_type(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 	return (ISC_FALSE);
 }
 
-static inline isc_result_t
-addnoqname(dns_rbtdb_t *rbtdb, rdatasetheader_t *newheader,
-	   dns_rdataset_t *rdataset)
-{
-	struct noqname *noqname;
-	isc_mem_t *mctx = rbtdb->common.mctx;
-	dns_name_t name;
-	dns_rdataset_t neg, negsig;
-	isc_result_t result;
-	isc_region_t r;
-
-	dns_name_init(&name, NULL);
-	dns_rdataset_init(&neg);
-	dns_rdataset_init(&negsig);
-
-	result = dns_rdataset_getnoqname(rdataset, &name, &neg, &negsig);
-	RUNTIME_CHECK(result == ISC_R_SUCCESS);
-
-	noqname = isc_mem_get(mctx, sizeof(*noqname));
-	if (noqname == NULL) {
-		result = ISC_R_NOMEMORY;
-		goto cleanup;
-	}
-	dns_name_init(&noqname->name, NULL);
-	noqname->neg = NULL;
-	noqname->negsig = NULL;
-	noqname->type = neg.type;
-	result = dns_name_dup(&name, mctx, &noqname->name);
-	if (result != ISC_R_SUCCESS)
-		goto cleanup;
-	result = dns_rdataslab_fromrdataset(&neg, mctx, &r, 0);
-	if (result != ISC_R_SUCCESS)
-		goto cleanup;
-	noqname->neg = r.base;
-	result = dns_rdataslab_fromrdataset(&negsig, mctx, &r, 0);
-	if (result != ISC_R_SUCCESS)
-		goto cleanup;
-	noqname->negsig = r.base;
-	dns_rdataset_disassociate(&neg);
-	dns_rdataset_disassociate(&negsig);
-	newheader->noqname = noqname;
-	return (ISC_R_SUCCESS);
-
-cleanup:
-	dns_rdataset_disassociate(&neg);
-	dns_rdataset_disassociate(&negsig);
-	if (noqname != NULL)
-		free_noqname(mctx, &noqname);
-	return(result);
-}
-
-static inline isc_result_t
-addclosest(dns_rbtdb_t *rbtdb, rdatasetheader_t *newheader,
-	   dns_rdataset_t *rdataset)
-{
-	struct noqname *closest;
-	isc_mem_t *mctx = rbtdb->common.mctx;
-	dns_name_t name;
-	dns_rdataset_t neg, negsig;
-	isc_result_t result;
-	isc_region_t r;
-
-	dns_name_init(&name, NULL);
-	dns_rdataset_init(&neg);
-	dns_rdataset_init(&negsig);
-
-	result = dns_rdataset_getclosest(rdataset, &name, &neg, &negsig);
-	RUNTIME_CHECK(result == ISC_R_SUCCESS);
-
-	closest = isc_mem_get(mctx, sizeof(*closest));
-	if (closest == NULL) {
-		result = ISC_R_NOMEMORY;
-		goto cleanup;
-	}
-	dns_name_init(&closest->name, NULL);
-	closest->neg = NULL;
-	closest->negsig = NULL;
-	closest->type = neg.type;
-	result = dns_name_dup(&name, mctx, &closest->name);
-	if (result != ISC_R_SUCCESS)
-		goto cleanup;
-	result = dns_rdataslab_fromrdataset(&neg, mctx, &r, 0);
-	if (result != ISC_R_SUCCESS)
-		goto cleanup;
-	closest->neg = r.base;
-	result = dns_rdataslab_fromrdataset(&negsig, mctx, &r, 0);
-	if (result != ISC_R_SUCCESS)
-		goto cleanup;
-	closest->negsig = r.base;
-	dns_rdataset_disassociate(&neg);
-	dns_rdataset_disassociate(&negsig);
-	newheader->closest = closest;
-	return (ISC_R_SUCCESS);
-
- cleanup:
-	dns_rdataset_disassociate(&neg);
-	dns_rdataset_disassociate(&negsig);
-	if (closest != NULL)
-		free_noqname(mctx, &closest);
-	return(result);
-}
-
 static dns_dbmethods_t zone_methods;
 
 static isc_result_t
@@ -6886,7 +6720,9 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		if ((rdataset->attributes & DNS_RDATASETATTR_OPTOUT) != 0)
 			newheader->attributes |= RDATASET_ATTR_OPTOUT;
 		if ((rdataset->attributes & DNS_RDATASETATTR_NOQNAME) != 0) {
-			result = addnoqname(rbtdb, newheader, rdataset);
+			result = dns__slabdb_newproof(rbtdb->common.mctx,
+						      rdataset, ISC_FALSE,
+						      &newheader->noqname);
 			if (result != ISC_R_SUCCESS) {
 				free_rdataset(rbtdb, rbtdb->common.mctx,
 					      newheader);
@@ -6894,7 +6730,9 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 			}
 		}
 		if ((rdataset->attributes & DNS_RDATASETATTR_CLOSEST) != 0) {
-			result = addclosest(rbtdb, newheader, rdataset);
+			result = dns__slabdb_newproof(rbtdb->common.mctx,
+						      rdataset, ISC_TRUE,
+						      &newheader->closest);
 			if (result != ISC_R_SUCCESS) {
 				free_rdataset(rbtdb, rbtdb->common.mctx,
 					      newheader);
@@ -6915,9 +6753,12 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 
 	/*
 	 * Add to the auxiliary NSEC tree if we're adding an NSEC record.
+	 * A cache also indexes the owners of its NSEC3 records there,
+	 * so that covering NSEC3 records can be found by hash.
 	 */
 	if (rbtnode->nsec != DNS_RBT_NSEC_HAS_NSEC &&
-	    rdataset->type == dns_rdatatype_nsec)
+	    (rdataset->type == dns_rdatatype_nsec ||
+	     (IS_CACHE(rbtdb) && rdataset->type == dns_rdatatype_nsec3)))
 		newnsec = ISC_TRUE;
 	else
 		newnsec = ISC_FALSE;
@@ -6936,7 +6777,8 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	}
 
 	if (cache_is_overmem)
-		overmem_purge(rbtdb, rbtnode->locknum, now, tree_locked);
+		overmem_purge(rbtdb, rbtnode->locknum, region.length, now,
+			      tree_locked);
 
 	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
 		  isc_rwlocktype_write);
@@ -7345,18 +7187,78 @@ loadnode(dns_rbtdb_t *rbtdb, const dns_name_t *name, dns_rbtnode_t **nodep,
 	return (noderesult);
 }
 
+/*
+ * Build the slab for 'rdataset' of 'name' without touching the tree, so
+ * that a loader can do it on several threads at once.
+ */
 static isc_result_t
-loading_addrdataset(void *arg, const dns_name_t *name,
-		    dns_rdataset_t *rdataset)
+loading_prepare(void *arg, const dns_name_t *name, dns_rdataset_t *rdataset,
+		void **preparedp)
 {
 	rbtdb_load_t *loadctx = arg;
 	dns_rbtdb_t *rbtdb = loadctx->rbtdb;
-	dns_rbtnode_t *node;
 	isc_result_t result;
 	isc_region_t region;
 	rdatasetheader_t *newheader;
 
 	REQUIRE(rdataset->rdclass == rbtdb->common.rdclass);
+	REQUIRE(preparedp != NULL && *preparedp == NULL);
+
+	result = dns_rdataslab_fromrdataset(rdataset, rbtdb->common.mctx,
+					    &region,
+					    sizeof(rdatasetheader_t));
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	newheader = (rdatasetheader_t *)region.base;
+	init_rdataset(rbtdb, newheader);
+	set_ttl(rbtdb, newheader,
+		rdataset->ttl + loadctx->now); /* XXX overflow check */
+	newheader->type = RBTDB_RDATATYPE_VALUE(rdataset->type,
+						rdataset->covers);
+	newheader->attributes = 0;
+	newheader->trust = rdataset->trust;
+	newheader->serial = 1;
+	newheader->noqname = NULL;
+	newheader->closest = NULL;
+	newheader->last_used = 0;
+	newheader->node = NULL;
+	setownercase(newheader, name);
+
+	if ((rdataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
+		newheader->attributes |= RDATASET_ATTR_RESIGN;
+		newheader->resign = (isc_stdtime_t)
+			(dns_time64_from32(rdataset->resign) >> 1);
+		newheader->resign_lsb = rdataset->resign & 0x1;
+	} else {
+		newheader->resign = 0;
+		newheader->resign_lsb = 0;
+	}
+
+	*preparedp = newheader;
+	return (ISC_R_SUCCESS);
+}
+
+static void
+loading_freeprepared(void *arg, void *prepared) {
+	rbtdb_load_t *loadctx = arg;
+	rdatasetheader_t *newheader = prepared;
+
+	isc_mem_put(loadctx->rbtdb->common.mctx, newheader,
+		    dns_rdataslab_size((unsigned char *)newheader,
+				       sizeof(*newheader)));
+}
+
+static isc_result_t
+loading_addprepared(void *arg, const dns_name_t *name, void *prepared) {
+	rbtdb_load_t *loadctx = arg;
+	dns_rbtdb_t *rbtdb = loadctx->rbtdb;
+	rdatasetheader_t *newheader = prepared;
+	dns_rdatatype_t type, covers;
+	dns_rbtnode_t *node;
+	isc_result_t result;
+
+	type = RBTDB_RDATATYPE_BASE(newheader->type);
+	covers = RBTDB_RDATATYPE_EXT(newheader->type);
 
 	/*
 	 * This routine does no node locking.  See comments in
@@ -7367,43 +7269,48 @@ loading_addrdataset(void *arg, const dns_name_t *name,
 	/*
 	 * SOA records are only allowed at top of zone.
 	 */
-	if (rdataset->type == dns_rdatatype_soa &&
+	if (type == dns_rdatatype_soa &&
 	    !IS_CACHE(rbtdb) && !dns_name_equal(name, &rbtdb->common.origin))
-		return (DNS_R_NOTZONETOP);
+	{
+		result = DNS_R_NOTZONETOP;
+		goto failure;
+	}
 
-	if (rdataset->type != dns_rdatatype_nsec3 &&
-	    rdataset->covers != dns_rdatatype_nsec3)
+	if (type != dns_rdatatype_nsec3 && covers != dns_rdatatype_nsec3)
 		add_empty_wildcards(rbtdb, name);
 
 	if (dns_name_iswildcard(name)) {
 		/*
 		 * NS record owners cannot legally be wild cards.
 		 */
-		if (rdataset->type == dns_rdatatype_ns)
-			return (DNS_R_INVALIDNS);
+		if (type == dns_rdatatype_ns) {
+			result = DNS_R_INVALIDNS;
+			goto failure;
+		}
 		/*
 		 * NSEC3 record owners cannot legally be wild cards.
 		 */
-		if (rdataset->type == dns_rdatatype_nsec3)
-			return (DNS_R_INVALIDNSEC3);
+		if (type == dns_rdatatype_nsec3) {
+			result = DNS_R_INVALIDNSEC3;
+			goto failure;
+		}
 		result = add_wildcard_magic(rbtdb, name);
 		if (result != ISC_R_SUCCESS)
-			return (result);
+			goto failure;
 	}
 
 	node = NULL;
-	if (rdataset->type == dns_rdatatype_nsec3 ||
-	    rdataset->covers == dns_rdatatype_nsec3) {
+	if (type == dns_rdatatype_nsec3 || covers == dns_rdatatype_nsec3) {
 		result = dns_rbt_addnode(rbtdb->nsec3, name, &node);
 		if (result == ISC_R_SUCCESS)
 			node->nsec = DNS_RBT_NSEC_NSEC3;
-	} else if (rdataset->type == dns_rdatatype_nsec) {
+	} else if (type == dns_rdatatype_nsec) {
 		result = loadnode(rbtdb, name, &node, ISC_TRUE);
 	} else {
 		result = loadnode(rbtdb, name, &node, ISC_FALSE);
 	}
 	if (result != ISC_R_SUCCESS && result != ISC_R_EXISTS)
-		return (result);
+		goto failure;
 	if (result == ISC_R_SUCCESS) {
 		dns_name_t foundname;
 		dns_name_init(&foundname, NULL);
@@ -7416,46 +7323,35 @@ loading_addrdataset(void *arg, const dns_name_t *name,
 #endif
 	}
 
-	result = dns_rdataslab_fromrdataset(rdataset, rbtdb->common.mctx,
-					    &region,
-					    sizeof(rdatasetheader_t));
-	if (result != ISC_R_SUCCESS)
-		return (result);
-	newheader = (rdatasetheader_t *)region.base;
-	init_rdataset(rbtdb, newheader);
-	set_ttl(rbtdb, newheader,
-		rdataset->ttl + loadctx->now); /* XXX overflow check */
-	newheader->type = RBTDB_RDATATYPE_VALUE(rdataset->type,
-						rdataset->covers);
-	newheader->attributes = 0;
-	newheader->trust = rdataset->trust;
-	newheader->serial = 1;
-	newheader->noqname = NULL;
-	newheader->closest = NULL;
 	newheader->count = init_count++;
-	newheader->last_used = 0;
 	newheader->node = node;
-	setownercase(newheader, name);
-
-	if ((rdataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
-		newheader->attributes |= RDATASET_ATTR_RESIGN;
-		newheader->resign = (isc_stdtime_t)
-			(dns_time64_from32(rdataset->resign) >> 1);
-		newheader->resign_lsb = rdataset->resign & 0x1;
-	} else {
-		newheader->resign = 0;
-		newheader->resign_lsb = 0;
-	}
 
 	result = add32(rbtdb, node, rbtdb->current_version, newheader,
 		       DNS_DBADD_MERGE, ISC_TRUE, NULL, 0);
 	if (result == ISC_R_SUCCESS &&
-	    delegating_type(rbtdb, node, rdataset->type))
+	    delegating_type(rbtdb, node, type))
 		node->find_callback = 1;
 	else if (result == DNS_R_UNCHANGED)
 		result = ISC_R_SUCCESS;
 
 	return (result);
+
+ failure:
+	loading_freeprepared(arg, prepared);
+	return (result);
+}
+
+static isc_result_t
+loading_addrdataset(void *arg, const dns_name_t *name,
+		    dns_rdataset_t *rdataset)
+{
+	isc_result_t result;
+	void *prepared = NULL;
+
+	result = loading_prepare(arg, name, rdataset, &prepared);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	return (loading_addprepared(arg, name, prepared));
 }
 
 static isc_result_t
@@ -7663,6 +7559,9 @@ beginload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
 	RBTDB_UNLOCK(&rbtdb->lock, isc_rwlocktype_write);
 
 	callbacks->add = loading_addrdataset;
+	callbacks->prepare = loading_prepare;
+	callbacks->addprepared = loading_addprepared;
+	callbacks->freeprepared = loading_freeprepared;
 	callbacks->add_private = loadctx;
 	callbacks->deserialize = deserialize32;
 	callbacks->deserialize_private = loadctx;
@@ -7699,6 +7598,9 @@ endload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
 		iszonesecure(db, rbtdb->current_version, rbtdb->origin_node);
 
 	callbacks->add = NULL;
+	callbacks->prepare = NULL;
+	callbacks->addprepared = NULL;
+	callbacks->freeprepared = NULL;
 	callbacks->add_private = NULL;
 	callbacks->deserialize = NULL;
 	callbacks->deserialize_private = NULL;
@@ -8084,19 +7986,9 @@ getnsec3parameters(dns_db_t *db, dns_dbversion_t *version, dns_hash_t *hash,
 		rbtversion = rbtdb->current_version;
 
 	if (rbtversion->havensec3) {
-		if (hash != NULL)
-			*hash = rbtversion->hash;
-		if (salt != NULL && salt_length != NULL) {
-			REQUIRE(*salt_length >= rbtversion->salt_length);
-			memmove(salt, rbtversion->salt,
-				rbtversion->salt_length);
-		}
-		if (salt_length != NULL)
-			*salt_length = rbtversion->salt_length;
-		if (iterations != NULL)
-			*iterations = rbtversion->iterations;
-		if (flags != NULL)
-			*flags = rbtversion->flags;
+		dns__slabdb_getnsec3params(&rbtversion->nsec3params, hash,
+					   flags, iterations, salt,
+					   salt_length);
 		result = ISC_R_SUCCESS;
 	}
 	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
@@ -8729,12 +8621,8 @@ dns_rbtdb_create
 	rbtdb->current_version->rbtdb = rbtdb;
 	rbtdb->current_version->secure = dns_db_insecure;
 	rbtdb->current_version->havensec3 = ISC_FALSE;
-	rbtdb->current_version->flags = 0;
-	rbtdb->current_version->iterations = 0;
-	rbtdb->current_version->hash = 0;
-	rbtdb->current_version->salt_length = 0;
-	memset(rbtdb->current_version->salt, 0,
-	       sizeof(rbtdb->current_version->salt));
+	memset(&rbtdb->current_version->nsec3params, 0,
+	       sizeof(rbtdb->current_version->nsec3params));
 	result = isc_rwlock_init(&rbtdb->current_version->rwlock, 0, 0);
 	if (result != ISC_R_SUCCESS) {
 		free_gluetable(rbtdb->current_version);
@@ -8807,241 +8695,6 @@ dns_rbtdb_create
  * Slabbed Rdataset Methods
  */
 
-static void
-rdataset_disassociate(dns_rdataset_t *rdataset) {
-	dns_db_t *db = rdataset->private1;
-	dns_dbnode_t *node = rdataset->private2;
-
-	detachnode(db, &node);
-}
-
-static isc_result_t
-rdataset_first(dns_rdataset_t *rdataset) {
-	unsigned char *raw = rdataset->private3;        /* RDATASLAB */
-	unsigned int count;
-
-	count = raw[0] * 256 + raw[1];
-	if (count == 0) {
-		rdataset->private5 = NULL;
-		return (ISC_R_NOMORE);
-	}
-
-#if DNS_RDATASET_FIXED
-	if ((rdataset->attributes & DNS_RDATASETATTR_LOADORDER) == 0)
-		raw += 2 + (4 * count);
-	else
-#endif
-		raw += 2;
-
-	/*
-	 * The privateuint4 field is the number of rdata beyond the
-	 * cursor position, so we decrement the total count by one
-	 * before storing it.
-	 *
-	 * If DNS_RDATASETATTR_LOADORDER is not set 'raw' points to the
-	 * first record.  If DNS_RDATASETATTR_LOADORDER is set 'raw' points
-	 * to the first entry in the offset table.
-	 */
-	count--;
-	rdataset->privateuint4 = count;
-	rdataset->private5 = raw;
-
-	return (ISC_R_SUCCESS);
-}
-
-static isc_result_t
-rdataset_next(dns_rdataset_t *rdataset) {
-	unsigned int count;
-	unsigned int length;
-	unsigned char *raw;     /* RDATASLAB */
-
-	count = rdataset->privateuint4;
-	if (count == 0)
-		return (ISC_R_NOMORE);
-	count--;
-	rdataset->privateuint4 = count;
-
-	/*
-	 * Skip forward one record (length + 4) or one offset (4).
-	 */
-	raw = rdataset->private5;
-#if DNS_RDATASET_FIXED
-	if ((rdataset->attributes & DNS_RDATASETATTR_LOADORDER) == 0) {
-#endif
-		length = raw[0] * 256 + raw[1];
-		raw += length;
-#if DNS_RDATASET_FIXED
-	}
-	rdataset->private5 = raw + 4;           /* length(2) + order(2) */
-#else
-	rdataset->private5 = raw + 2;           /* length(2) */
-#endif
-
-	return (ISC_R_SUCCESS);
-}
-
-static void
-rdataset_current(dns_rdataset_t *rdataset, dns_rdata_t *rdata) {
-	unsigned char *raw = rdataset->private5;        /* RDATASLAB */
-#if DNS_RDATASET_FIXED
-	unsigned int offset;
-#endif
-	unsigned int length;
-	isc_region_t r;
-	unsigned int flags = 0;
-
-	REQUIRE(raw != NULL);
-
-	/*
-	 * Find the start of the record if not already in private5
-	 * then skip the length and order fields.
-	 */
-#if DNS_RDATASET_FIXED
-	if ((rdataset->attributes & DNS_RDATASETATTR_LOADORDER) != 0) {
-		offset = (raw[0] << 24) + (raw[1] << 16) +
-			 (raw[2] << 8) + raw[3];
-		raw = rdataset->private3;
-		raw += offset;
-	}
-#endif
-	length = raw[0] * 256 + raw[1];
-#if DNS_RDATASET_FIXED
-	raw += 4;
-#else
-	raw += 2;
-#endif
-	if (rdataset->type == dns_rdatatype_rrsig) {
-		if (*raw & DNS_RDATASLAB_OFFLINE)
-			flags |= DNS_RDATA_OFFLINE;
-		length--;
-		raw++;
-	}
-	r.length = length;
-	r.base = raw;
-	dns_rdata_fromregion(rdata, rdataset->rdclass, rdataset->type, &r);
-	rdata->flags |= flags;
-}
-
-static void
-rdataset_clone(dns_rdataset_t *source, dns_rdataset_t *target) {
-	dns_db_t *db = source->private1;
-	dns_dbnode_t *node = source->private2;
-	dns_dbnode_t *cloned_node = NULL;
-
-	attachnode(db, node, &cloned_node);
-	INSIST(!ISC_LINK_LINKED(target, link));
-	*target = *source;
-	ISC_LINK_INIT(target, link);
-
-	/*
-	 * Reset iterator state.
-	 */
-	target->privateuint4 = 0;
-	target->private5 = NULL;
-}
-
-static unsigned int
-rdataset_count(dns_rdataset_t *rdataset) {
-	unsigned char *raw = rdataset->private3;        /* RDATASLAB */
-	unsigned int count;
-
-	count = raw[0] * 256 + raw[1];
-
-	return (count);
-}
-
-static isc_result_t
-rdataset_getnoqname(dns_rdataset_t *rdataset, dns_name_t *name,
-		    dns_rdataset_t *nsec, dns_rdataset_t *nsecsig)
-{
-	dns_db_t *db = rdataset->private1;
-	dns_dbnode_t *node = rdataset->private2;
-	dns_dbnode_t *cloned_node;
-	const struct noqname *noqname = rdataset->private6;
-
-	cloned_node = NULL;
-	attachnode(db, node, &cloned_node);
-	nsec->methods = &slab_methods;
-	nsec->rdclass = db->rdclass;
-	nsec->type = noqname->type;
-	nsec->covers = 0;
-	nsec->ttl = rdataset->ttl;
-	nsec->trust = rdataset->trust;
-	nsec->private1 = rdataset->private1;
-	nsec->private2 = rdataset->private2;
-	nsec->private3 = noqname->neg;
-	nsec->privateuint4 = 0;
-	nsec->private5 = NULL;
-	nsec->private6 = NULL;
-	nsec->private7 = NULL;
-
-	cloned_node = NULL;
-	attachnode(db, node, &cloned_node);
-	nsecsig->methods = &slab_methods;
-	nsecsig->rdclass = db->rdclass;
-	nsecsig->type = dns_rdatatype_rrsig;
-	nsecsig->covers = noqname->type;
-	nsecsig->ttl = rdataset->ttl;
-	nsecsig->trust = rdataset->trust;
-	nsecsig->private1 = rdataset->private1;
-	nsecsig->private2 = rdataset->private2;
-	nsecsig->private3 = noqname->negsig;
-	nsecsig->privateuint4 = 0;
-	nsecsig->private5 = NULL;
-	nsec->private6 = NULL;
-	nsec->private7 = NULL;
-
-	dns_name_clone(&noqname->name, name);
-
-	return (ISC_R_SUCCESS);
-}
-
-static isc_result_t
-rdataset_getclosest(dns_rdataset_t *rdataset, dns_name_t *name,
-		    dns_rdataset_t *nsec, dns_rdataset_t *nsecsig)
-{
-	dns_db_t *db = rdataset->private1;
-	dns_dbnode_t *node = rdataset->private2;
-	dns_dbnode_t *cloned_node;
-	const struct noqname *closest = rdataset->private7;
-
-	cloned_node = NULL;
-	attachnode(db, node, &cloned_node);
-	nsec->methods = &slab_methods;
-	nsec->rdclass = db->rdclass;
-	nsec->type = closest->type;
-	nsec->covers = 0;
-	nsec->ttl = rdataset->ttl;
-	nsec->trust = rdataset->trust;
-	nsec->private1 = rdataset->private1;
-	nsec->private2 = rdataset->private2;
-	nsec->private3 = closest->neg;
-	nsec->privateuint4 = 0;
-	nsec->private5 = NULL;
-	nsec->private6 = NULL;
-	nsec->private7 = NULL;
-
-	cloned_node = NULL;
-	attachnode(db, node, &cloned_node);
-	nsecsig->methods = &slab_methods;
-	nsecsig->rdclass = db->rdclass;
-	nsecsig->type = dns_rdatatype_rrsig;
-	nsecsig->covers = closest->type;
-	nsecsig->ttl = rdataset->ttl;
-	nsecsig->trust = rdataset->trust;
-	nsecsig->private1 = rdataset->private1;
-	nsecsig->private2 = rdataset->private2;
-	nsecsig->private3 = closest->negsig;
-	nsecsig->privateuint4 = 0;
-	nsecsig->private5 = NULL;
-	nsec->private6 = NULL;
-	nsec->private7 = NULL;
-
-	dns_name_clone(&closest->name, name);
-
-	return (ISC_R_SUCCESS);
-}
-
 static void
 rdataset_settrust(dns_rdataset_t *rdataset, dns_trust_t trust) {
 	dns_rbtdb_t *rbtdb = rdataset->private1;
@@ -9763,22 +9416,8 @@ dbiterator_origin(dns_dbiterator_t *iterator, dns_name_t *name) {
 
 static void
 setownercase(rdatasetheader_t *header, const dns_name_t *name) {
-	unsigned int i;
-	isc_boolean_t fully_lower;
-
-	/*
-	 * We do not need to worry about label lengths as they are all
-	 * less than or equal to 63.
-	 */
-	memset(header->upper, 0, sizeof(header->upper));
-	fully_lower = ISC_TRUE;
-	for (i = 0; i < name->length; i++)
-		if (name->ndata[i] >= 0x41 && name->ndata[i] <= 0x5a) {
-			header->upper[i/8] |= 1 << (i%8);
-			fully_lower = ISC_FALSE;
-		}
 	header->attributes |= RDATASET_ATTR_CASESET;
-	if (ISC_LIKELY(fully_lower))
+	if (ISC_LIKELY(dns__slabdb_setownercase(header->upper, name)))
 		header->attributes |= RDATASET_ATTR_CASEFULLYLOWER;
 }
 
@@ -9791,163 +9430,17 @@ rdataset_setownercase(dns_rdataset_t *rdataset, const dns_name_t *name) {
 	setownercase(header, name);
 }
 
-static const unsigned char charmask[] = {
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
-	0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
-	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
-	0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
-
-static const unsigned char maptolower[] = {
-	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
-	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
-	0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
-	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
-	0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
-	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
-	0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
-	0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
-	0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
-	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
-	0x78, 0x79, 0x7a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
-	0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
-	0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
-	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
-	0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
-	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
-	0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
-	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
-	0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
-	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
-	0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
-	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
-	0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
-	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
-	0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
-	0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
-	0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
-	0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
-	0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
-	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
-	0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
-};
-
 static void
 rdataset_getownercase(const dns_rdataset_t *rdataset, dns_name_t *name) {
 	const unsigned char *raw = rdataset->private3;        /* RDATASLAB */
 	const rdatasetheader_t *header;
-	unsigned int i, j;
-	unsigned char bits;
-	unsigned char c, flip;
 
 	header = (const struct rdatasetheader *)(raw - sizeof(*header));
 
 	if (!CASESET(header))
 		return;
 
-#if 0
-	/*
-	 * This was the original code, and is implemented differently in
-	 * the #else block that follows.
-	 */
-	for (i = 0; i < name->length; i++) {
-		/*
-		 * Set the case bit if it does not match the recorded bit.
-		 */
-		if (name->ndata[i] >= 0x61 && name->ndata[i] <= 0x7a &&
-		    (header->upper[i/8] & (1 << (i%8))) != 0)
-			name->ndata[i] &= ~0x20; /* clear the lower case bit */
-		else if (name->ndata[i] >= 0x41 && name->ndata[i] <= 0x5a &&
-			 (header->upper[i/8] & (1 << (i%8))) == 0)
-			name->ndata[i] |= 0x20; /* set the lower case bit */
-	}
-#else
-
-	if (ISC_LIKELY(CASEFULLYLOWER(header))) {
-		unsigned char *bp, *be;
-		bp = name->ndata;
-		be = bp + name->length;
-
-		while (bp <= be - 4) {
-			c = bp[0];
-			bp[0] = maptolower[c];
-			c = bp[1];
-			bp[1] = maptolower[c];
-			c = bp[2];
-			bp[2] = maptolower[c];
-			c = bp[3];
-			bp[3] = maptolower[c];
-			bp += 4;
-		}
-		while (bp < be) {
-			c = *bp;
-			*bp++ = maptolower[c];
-		}
-		return;
-	}
-
-	i = 0;
-	for (j = 0; j < (name->length >> 3); j++) {
-		unsigned int k;
-
-		bits = ~(header->upper[j]);
-
-		for (k = 0; k < 8; k++) {
-			c = name->ndata[i];
-			flip = (bits & 1) << 5;
-			flip ^= c;
-			flip &= charmask[c];
-			name->ndata[i] ^= flip;
-
-			i++;
-			bits >>= 1;
-		}
-	}
-
-	if (ISC_UNLIKELY(i == name->length))
-		return;
-
-	bits = ~(header->upper[j]);
-
-	for (; i < name->length; i++) {
-		c = name->ndata[i];
-		flip = (bits & 1) << 5;
-		flip ^= c;
-		flip &= charmask[c];
-		name->ndata[i] ^= flip;
-
-		bits >>= 1;
-	}
-#endif
+	dns__slabdb_getownercase(header->upper, CASEFULLYLOWER(header), name);
 }
 
 struct rbtdb_glue {
@@ -10192,14 +9685,14 @@ glue_nsdname_cb(void *arg, const dns_name_t *name, dns_rdatatype_t qtype) {
 
 out:
 	if (dns_rdataset_isassociated(&rdataset_a))
-		rdataset_disassociate(&rdataset_a);
+		dns_rdataset_disassociate(&rdataset_a);
 	if (dns_rdataset_isassociated(&sigrdataset_a))
-		rdataset_disassociate(&sigrdataset_a);
+		dns_rdataset_disassociate(&sigrdataset_a);
 
 	if (dns_rdataset_isassociated(&rdataset_aaaa))
-		rdataset_disassociate(&rdataset_aaaa);
+		dns_rdataset_disassociate(&rdataset_aaaa);
 	if (dns_rdataset_isassociated(&sigrdataset_aaaa))
-		rdataset_disassociate(&sigrdataset_aaaa);
+		dns_rdataset_disassociate(&sigrdataset_aaaa);
 
 	if (node_a != NULL)
 		detachnode((dns_db_t *) ctx->rbtdb, (dns_dbnode_t *) &node_a);
@@ -10550,44 +10043,150 @@ update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
 
 	ISC_LIST_UNLINK(rbtdb->rdatasets[header->node->locknum], header, link);
 	header->last_used = now;
+	if (header->hits < RBTDB_HITS_MAX)
+		header->hits++;
 	ISC_LIST_PREPEND(rbtdb->rdatasets[header->node->locknum], header, link);
 }
 
+/*%
+ * Estimate how expensive it would be to fetch 'header' again if it were
+ * evicted.  Delegation and DNSSEC key material may require several
+ * queries further up the tree to recover, and validated data has to be
+ * validated again; glue addresses are needed to reach the servers for a
+ * whole zone.
+ */
+static inline unsigned int
+header_cost(rdatasetheader_t *header) {
+	unsigned int cost;
+
+	switch (RBTDB_RDATATYPE_BASE(header->type)) {
+	case dns_rdatatype_ns:
+	case dns_rdatatype_ds:
+	case dns_rdatatype_dnskey:
+		cost = 4;
+		break;
+	case dns_rdatatype_a:
+	case dns_rdatatype_aaaa:
+		cost = (header->trust == dns_trust_glue) ? 2 : 1;
+		break;
+	case dns_rdatatype_rrsig:
+		switch (RBTDB_RDATATYPE_EXT(header->type)) {
+		case dns_rdatatype_ns:
+		case dns_rdatatype_ds:
+		case dns_rdatatype_dnskey:
+			cost = 4;
+			break;
+		default:
+			cost = 1;
+			break;
+		}
+		break;
+	default:
+		cost = 1;
+		break;
+	}
+
+	if (header->trust >= dns_trust_secure)
+		cost *= 2;
+
+	return (cost);
+}
+
 /*%
  * Purge some expired and/or stale (i.e. unused for some period) cache entries
- * under an overmem condition.  To recover from this condition quickly, up to
- * 2 entries will be purged.  This process is triggered while adding a new
+ * under an overmem condition.  To recover from this condition quickly, entries
+ * totalling at least twice 'purgesize' bytes (the size of the entry being
+ * added) will be purged.  This process is triggered while adding a new
  * entry, and we specifically avoid purging entries in the same LRU bucket as
  * the one to which the new entry will belong.  Otherwise, we might purge
  * entries of the same name of different RR types while adding RRsets from a
  * single response (consider the case where we're adding A and AAAA glue records
  * of the same NS name).
+ *
+ * Rather than evicting strictly from the tail of each LRU list, up to
+ * RBTDB_PURGE_SAMPLE headers at the tail are examined.  Those which have
+ * been hit since they were last examined have their hit count halved and
+ * are moved back to the head of the list; of the rest, the one that is
+ * cheapest to fetch again (see header_cost()) is evicted.  Entries which
+ * were added once and never used again are therefore evicted before
+ * frequently used ones, and cheap answers before delegations and
+ * validated data.  The work per bucket is bounded by the sample size.
  */
 static void
 overmem_purge(dns_rbtdb_t *rbtdb, unsigned int locknum_start,
-	      isc_stdtime_t now, isc_boolean_t tree_locked)
+	      size_t purgesize, isc_stdtime_t now, isc_boolean_t tree_locked)
 {
-	rdatasetheader_t *header, *header_prev;
-	unsigned int locknum;
-	int purgecount = 2;
+	rdatasetheader_t *header, *header_prev, *victim, *moved;
+	unsigned int locknum, i, cost, victimcost;
+	size_t purged = 0;
+	int purgecount = 0;
+
+	purgesize *= 2;
 
 	for (locknum = (locknum_start + 1) % rbtdb->node_lock_count;
-	     locknum != locknum_start && purgecount > 0;
+	     locknum != locknum_start && (purged < purgesize ||
+					  purgecount < 2);
 	     locknum = (locknum + 1) % rbtdb->node_lock_count) {
 		NODE_LOCK(&rbtdb->node_locks[locknum].lock,
 			  isc_rwlocktype_write);
 
 		header = isc_heap_element(rbtdb->heaps[locknum], 1);
 		if (header && header->rdh_ttl < now - RBTDB_VIRTUAL) {
+			purged += NONEXISTENT(header)
+				? sizeof(*header)
+				: dns_rdataslab_size((unsigned char *)header,
+						     sizeof(*header));
 			expire_header(rbtdb, header, tree_locked,
 				      expire_ttl);
-			purgecount--;
+			purgecount++;
 		}
 
-		for (header = ISC_LIST_TAIL(rbtdb->rdatasets[locknum]);
-		     header != NULL && purgecount > 0;
-		     header = header_prev) {
+		/*
+		 * Give headers that have been hit since they were last
+		 * considered a second chance, and evict the cheapest of
+		 * the rest.
+		 */
+		victim = NULL;
+		victimcost = 0;
+		moved = NULL;
+		for (header = ISC_LIST_TAIL(rbtdb->rdatasets[locknum]), i = 0;
+		     header != NULL && header != moved &&
+		     i < RBTDB_PURGE_SAMPLE;
+		     header = header_prev, i++)
+		{
 			header_prev = ISC_LIST_PREV(header, link);
+			if (header->hits > 0) {
+				header->hits >>= 1;
+				ISC_LIST_UNLINK(rbtdb->rdatasets[locknum],
+						header, link);
+				ISC_LIST_PREPEND(rbtdb->rdatasets[locknum],
+						 header, link);
+				if (moved == NULL)
+					moved = header;
+				continue;
+			}
+			cost = header_cost(header);
+			if (victim == NULL || cost < victimcost) {
+				victim = header;
+				victimcost = cost;
+				if (cost == 1)
+					break;
+			}
+		}
+
+		/*
+		 * Everything sampled was in use; fall back to the LRU
+		 * tail.
+		 */
+		if (victim == NULL)
+			victim = ISC_LIST_TAIL(rbtdb->rdatasets[locknum]);
+
+		if (victim != NULL) {
+			purged += NONEXISTENT(victim)
+				? sizeof(*victim)
+				: dns_rdataslab_size((unsigned char *)victim,
+						     sizeof(*victim));
+
 			/*
 			 * Unlink the entry at this point to avoid checking it
 			 * again even if it's currently used someone else and
@@ -10595,11 +10194,11 @@ overmem_purge(dns_rbtdb_t *rbtdb, unsigned int locknum_start,
 			 * referenced any more (so unlinking is safe) since the
 			 * TTL was reset to 0.
 			 */
-			ISC_LIST_UNLINK(rbtdb->rdatasets[locknum], header,
+			ISC_LIST_UNLINK(rbtdb->rdatasets[locknum], victim,
 					link);
-			expire_header(rbtdb, header, tree_locked,
+			expire_header(rbtdb, victim, tree_locked,
 				      expire_lru);
-			purgecount--;
+			purgecount++;
 		}
 
 		NODE_UNLOCK(&rbtdb->node_locks[locknum].lock,
@@ -27,6 +27,8 @@
 #include <dns/rdataset.h>
 #include <dns/rdataslab.h>
 
+#include "slabdb_p.h"
+
 /*
  * The rdataslab structure allows iteration to occur in both load order
  * and DNSSEC order.  The structure is as follows:
@@ -349,83 +351,6 @@ rdataset_disassociate(dns_rdataset_t *rdataset) {
 	UNUSED(rdataset);
 }
 
-static isc_result_t
-rdataset_first(dns_rdataset_t *rdataset) {
-	unsigned char *raw = rdataset->private3;
-	unsigned int count;
-
-	count = raw[0] * 256 + raw[1];
-	if (count == 0) {
-		rdataset->private5 = NULL;
-		return (ISC_R_NOMORE);
-	}
-#if DNS_RDATASET_FIXED
-	raw += 2 + (4 * count);
-#else
-	raw += 2;
-#endif
-	/*
-	 * The privateuint4 field is the number of rdata beyond the cursor
-	 * position, so we decrement the total count by one before storing
-	 * it.
-	 */
-	count--;
-	rdataset->privateuint4 = count;
-	rdataset->private5 = raw;
-
-	return (ISC_R_SUCCESS);
-}
-
-static isc_result_t
-rdataset_next(dns_rdataset_t *rdataset) {
-	unsigned int count;
-	unsigned int length;
-	unsigned char *raw;
-
-	count = rdataset->privateuint4;
-	if (count == 0)
-		return (ISC_R_NOMORE);
-	count--;
-	rdataset->privateuint4 = count;
-	raw = rdataset->private5;
-	length = raw[0] * 256 + raw[1];
-#if DNS_RDATASET_FIXED
-	raw += length + 4;
-#else
-	raw += length + 2;
-#endif
-	rdataset->private5 = raw;
-
-	return (ISC_R_SUCCESS);
-}
-
-static void
-rdataset_current(dns_rdataset_t *rdataset, dns_rdata_t *rdata) {
-	unsigned char *raw = rdataset->private5;
-	isc_region_t r;
-	unsigned int length;
-	unsigned int flags = 0;
-
-	REQUIRE(raw != NULL);
-
-	length = raw[0] * 256 + raw[1];
-#if DNS_RDATASET_FIXED
-	raw += 4;
-#else
-	raw += 2;
-#endif
-	if (rdataset->type == dns_rdatatype_rrsig) {
-		if (*raw & DNS_RDATASLAB_OFFLINE)
-			flags |= DNS_RDATA_OFFLINE;
-		length--;
-		raw++;
-	}
-	r.length = length;
-	r.base = raw;
-	dns_rdata_fromregion(rdata, rdataset->rdclass, rdataset->type, &r);
-	rdata->flags |= flags;
-}
-
 static void
 rdataset_clone(dns_rdataset_t *source, dns_rdataset_t *target) {
 	*target = *source;
@@ -437,23 +362,13 @@ rdataset_clone(dns_rdataset_t *source, dns_rdataset_t *target) {
 	target->private5 = NULL;
 }
 
-static unsigned int
-rdataset_count(dns_rdataset_t *rdataset) {
-	unsigned char *raw = rdataset->private3;
-	unsigned int count;
-
-	count = raw[0] * 256 + raw[1];
-
-	return (count);
-}
-
 static dns_rdatasetmethods_t rdataset_methods = {
 	rdataset_disassociate,
-	rdataset_first,
-	rdataset_next,
-	rdataset_current,
+	dns__slabdb_first,
+	dns__slabdb_next,
+	dns__slabdb_current,
 	rdataset_clone,
-	rdataset_count,
+	dns__slabdb_count,
 	NULL, /* addnoqname */
 	NULL, /* getnoqname */
 	NULL, /* addclosest */
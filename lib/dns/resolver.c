@@ -373,6 +373,17 @@ struct fetchctx {
 	dns_adbaddrinfo_t 		*addrinfo;
 	const isc_sockaddr_t		*client;
 	unsigned int			depth;
+
+	/*%
+	 * fetches-per-zone admission queue state.  Locked by the
+	 * zone bucket lock.
+	 */
+	ISC_LINK(struct fetchctx)	qlink;
+	isc_boolean_t			waited;
+	isc_boolean_t			queued;
+	unsigned int			priority;
+	isc_time_t			queuetime;
+	isc_event_t *			resume_event;
 };
 
 #define FCTX_MAGIC			ISC_MAGIC('F', '!', '!', '!')
@@ -387,6 +398,7 @@ struct fetchctx {
 #define FCTX_ATTR_NEEDEDNS0             0x0040
 #define FCTX_ATTR_TRIEDFIND             0x0080
 #define FCTX_ATTR_TRIEDALT              0x0100
+#define FCTX_ATTR_ADMITTED              0x0200
 
 #define HAVE_ANSWER(f)          (((f)->attributes & FCTX_ATTR_HAVEANSWER) != \
 				 0)
@@ -401,6 +413,7 @@ struct fetchctx {
 #define NEEDEDNS0(f)            (((f)->attributes & FCTX_ATTR_NEEDEDNS0) != 0)
 #define TRIEDFIND(f)            (((f)->attributes & FCTX_ATTR_TRIEDFIND) != 0)
 #define TRIEDALT(f)             (((f)->attributes & FCTX_ATTR_TRIEDALT) != 0)
+#define ADMITTED(f)             (((f)->attributes & FCTX_ATTR_ADMITTED) != 0)
 
 typedef struct {
 	dns_adbaddrinfo_t *		addrinfo;
@@ -431,7 +444,10 @@ struct fctxcount {
 	isc_uint32_t			count;
 	isc_uint32_t			allowed;
 	isc_uint32_t			dropped;
+	isc_uint32_t			queued;
+	isc_uint32_t			expired;
 	isc_stdtime_t			logged;
+	ISC_LIST(fetchctx_t)		queue;
 	ISC_LINK(fctxcount_t)		link;
 };
 
@@ -510,6 +526,7 @@ struct dns_resolver {
 	isc_boolean_t			priming;
 	unsigned int			spillat;	/* clients-per-query */
 	unsigned int			zspill;		/* fetches-per-zone */
+	unsigned int			zqueue;	/* fetches-per-zone-queue */
 
 	dns_badcache_t  * 		badcache;	 /* Bad cache. */
 
@@ -563,6 +580,7 @@ static void fctx_try(fetchctx_t *fctx, isc_boolean_t retrying,
 		     isc_boolean_t badcache);
 static void fctx_destroy(fetchctx_t *fctx);
 static isc_boolean_t fctx_unlink(fetchctx_t *fctx);
+static void fctx_resume(isc_task_t *task, isc_event_t *event);
 static isc_result_t ncache_adderesult(dns_message_t *message,
 				      dns_db_t *cache, dns_dbnode_t *node,
 				      dns_rdatatype_t covers,
@@ -1436,12 +1454,123 @@ fcount_logspill(fetchctx_t *fctx, fctxcount_t *counter) {
 	counter->logged = now;
 }
 
+static fctxcount_t *
+fcount_find(zonebucket_t *dbucket, fetchctx_t *fctx) {
+	fctxcount_t *counter;
+
+	/*
+	 * Caller must be holding the zone bucket lock.
+	 */
+	for (counter = ISC_LIST_HEAD(dbucket->list);
+	     counter != NULL;
+	     counter = ISC_LIST_NEXT(counter, link))
+	{
+		if (dns_name_equal(counter->domain, &fctx->domain))
+			break;
+	}
+
+	return (counter);
+}
+
+/*%
+ * The number of fetches that may wait for a slot in the zone counted
+ * by 'counter'.  Zones whose fetches mostly spill or expire while
+ * queued (typically the target of a random subdomain attack) are
+ * expensive to serve, so they get half the queue and cannot tie up
+ * as much memory and time at the expense of other zones.
+ */
+static isc_uint32_t
+fcount_queuelimit(fctxcount_t *counter, isc_uint32_t zqueue) {
+	if (counter->dropped + counter->expired > counter->allowed)
+		return (zqueue / 2);
+	return (zqueue);
+}
+
+/*%
+ * Admission priority gained by a queued fetch for each fetch that
+ * joins it.  A fetch made on behalf of another resolution (there
+ * is no client) unblocks more work than one made for a single client,
+ * and prefetches only refresh data that is still cached, so they wait
+ * the longest.
+ */
+static unsigned int
+fcount_weight(fetchctx_t *fctx, const isc_sockaddr_t *client) {
+	if ((fctx->options & DNS_FETCHOPT_PREFETCH) != 0)
+		return (0);
+	if (client == NULL)
+		return (2);
+	return (1);
+}
+
+static void
+fcount_enqueue(fctxcount_t *counter, fetchctx_t *fctx) {
+	fetchctx_t *next;
+
+	/*
+	 * Keep the queue ordered by priority, first in first out
+	 * among fetches of equal priority.
+	 */
+	for (next = ISC_LIST_HEAD(counter->queue);
+	     next != NULL;
+	     next = ISC_LIST_NEXT(next, qlink))
+	{
+		if (next->priority < fctx->priority)
+			break;
+	}
+	if (next != NULL)
+		ISC_LIST_INSERTBEFORE(counter->queue, next, fctx, qlink);
+	else
+		ISC_LIST_APPEND(counter->queue, fctx, qlink);
+}
+
+static isc_event_t *
+fcount_dequeue(fctxcount_t *counter, fetchctx_t *fctx) {
+	isc_event_t *event;
+
+	REQUIRE(fctx->queued);
+
+	ISC_LIST_UNLINK(counter->queue, fctx, qlink);
+	INSIST(counter->queued != 0);
+	counter->queued--;
+	fctx->queued = ISC_FALSE;
+	event = fctx->resume_event;
+	fctx->resume_event = NULL;
+	dec_stats(fctx->res, dns_resstatscounter_zonequeuedepth);
+
+	return (event);
+}
+
+static void
+fcount_admit(fctxcount_t *counter, fetchctx_t *fctx, isc_eventlist_t *events)
+{
+	isc_event_t *event;
+	isc_time_t now;
+	isc_uint64_t waitms;
+
+	event = fcount_dequeue(counter, fctx);
+	ISC_LIST_APPEND(*events, event, ev_link);
+	counter->count++;
+	counter->allowed++;
+
+	TIME_NOW(&now);
+	waitms = isc_time_microdiff(&now, &fctx->queuetime) / 1000;
+	if (waitms < DNS_RESOLVER_QUEUELATCLASS0) {
+		inc_stats(fctx->res, dns_resstatscounter_zonequeuelat0);
+	} else if (waitms < DNS_RESOLVER_QUEUELATCLASS1) {
+		inc_stats(fctx->res, dns_resstatscounter_zonequeuelat1);
+	} else if (waitms < DNS_RESOLVER_QUEUELATCLASS2) {
+		inc_stats(fctx->res, dns_resstatscounter_zonequeuelat2);
+	} else {
+		inc_stats(fctx->res, dns_resstatscounter_zonequeuelat3);
+	}
+}
+
 static isc_result_t
 fcount_incr(fetchctx_t *fctx, isc_boolean_t force) {
 	isc_result_t result = ISC_R_SUCCESS;
 	zonebucket_t *dbucket;
 	fctxcount_t *counter;
-	unsigned int bucketnum, spill;
+	unsigned int bucketnum, spill, zqueue;
 
 	REQUIRE(fctx != NULL);
 	REQUIRE(fctx->res != NULL);
@@ -1452,19 +1581,13 @@ fcount_incr(fetchctx_t *fctx, isc_boolean_t force) {
 
 	LOCK(&fctx->res->lock);
 	spill = fctx->res->zspill;
+	zqueue = fctx->res->zqueue;
 	UNLOCK(&fctx->res->lock);
 
 	dbucket = &fctx->res->dbuckets[bucketnum];
 
 	LOCK(&dbucket->lock);
-	for (counter = ISC_LIST_HEAD(dbucket->list);
-	     counter != NULL;
-	     counter = ISC_LIST_NEXT(counter, link))
-	{
-		if (dns_name_equal(counter->domain, &fctx->domain))
-			break;
-	}
-
+	counter = fcount_find(dbucket, fctx);
 	if (counter == NULL) {
 		counter = isc_mem_get(dbucket->mctx, sizeof(fctxcount_t));
 		if (counter == NULL)
@@ -1475,6 +1598,9 @@ fcount_incr(fetchctx_t *fctx, isc_boolean_t force) {
 			counter->logged = 0;
 			counter->allowed = 1;
 			counter->dropped = 0;
+			counter->queued = 0;
+			counter->expired = 0;
+			ISC_LIST_INIT(counter->queue);
 			dns_fixedname_init(&counter->fdname);
 			counter->domain = dns_fixedname_name(&counter->fdname);
 			dns_name_copy(&fctx->domain, counter->domain, NULL);
@@ -1482,9 +1608,31 @@ fcount_incr(fetchctx_t *fctx, isc_boolean_t force) {
 		}
 	} else {
 		if (!force && spill != 0 && counter->count >= spill) {
-			counter->dropped++;
-			fcount_logspill(fctx, counter);
-			result = ISC_R_QUOTA;
+			if (counter->queued <
+			    fcount_queuelimit(counter, zqueue))
+			{
+				fctx->resume_event =
+					isc_event_allocate(fctx->res->mctx,
+							   fctx,
+							   DNS_EVENT_FETCHCONTROL,
+							   fctx_resume, fctx,
+							   sizeof(isc_event_t));
+			}
+			if (fctx->resume_event != NULL) {
+				/*
+				 * Wait for a slot rather than spilling.
+				 */
+				fctx->queued = ISC_TRUE;
+				fctx->priority = 0;
+				TIME_NOW(&fctx->queuetime);
+				fcount_enqueue(counter, fctx);
+				counter->queued++;
+				result = DNS_R_WAIT;
+			} else {
+				counter->dropped++;
+				fcount_logspill(fctx, counter);
+				result = ISC_R_QUOTA;
+			}
 		} else {
 			counter->count++;
 			counter->allowed++;
@@ -1492,7 +1640,7 @@ fcount_incr(fetchctx_t *fctx, isc_boolean_t force) {
 	}
 	UNLOCK(&dbucket->lock);
 
-	if (result == ISC_R_SUCCESS)
+	if (result == ISC_R_SUCCESS || result == DNS_R_WAIT)
 		fctx->dbucketnum = bucketnum;
 
 	return (result);
@@ -1502,35 +1650,133 @@ static void
 fcount_decr(fetchctx_t *fctx) {
 	zonebucket_t *dbucket;
 	fctxcount_t *counter;
+	fetchctx_t *next;
+	isc_event_t *event = NULL;
+	isc_eventlist_t events;
+	unsigned int spill;
 
 	REQUIRE(fctx != NULL);
 
 	if (fctx->dbucketnum == RES_NOBUCKET)
 		return;
 
+	LOCK(&fctx->res->lock);
+	spill = fctx->res->zspill;
+	UNLOCK(&fctx->res->lock);
+
+	ISC_LIST_INIT(events);
 	dbucket = &fctx->res->dbuckets[fctx->dbucketnum];
 
 	LOCK(&dbucket->lock);
-	for (counter = ISC_LIST_HEAD(dbucket->list);
-	     counter != NULL;
-	     counter = ISC_LIST_NEXT(counter, link))
-	{
-		if (dns_name_equal(counter->domain, &fctx->domain))
-			break;
-	}
-
+	counter = fcount_find(dbucket, fctx);
 	if (counter != NULL) {
-		INSIST(counter->count != 0);
-		counter->count--;
+		if (fctx->queued) {
+			/*
+			 * Never admitted, so this fetch holds no slot.
+			 */
+			event = fcount_dequeue(counter, fctx);
+		} else {
+			INSIST(counter->count != 0);
+			counter->count--;
+		}
 		fctx->dbucketnum = RES_NOBUCKET;
 
+		/*
+		 * Hand any free slots to the waiting fetches with the
+		 * highest priority.
+		 */
+		while ((next = ISC_LIST_HEAD(counter->queue)) != NULL &&
+		       (spill == 0 || counter->count < spill))
+		{
+			fcount_admit(counter, next, &events);
+		}
+
 		if (counter->count == 0) {
+			INSIST(ISC_LIST_EMPTY(counter->queue));
 			ISC_LIST_UNLINK(dbucket->list, counter, link);
 			isc_mem_put(dbucket->mctx, counter, sizeof(*counter));
 		}
 	}
 
 	UNLOCK(&dbucket->lock);
+
+	if (event != NULL) {
+		/*
+		 * fctx_create() failed after queueing this fetch; the
+		 * caller is holding the bucket lock.
+		 */
+		isc_event_free(&event);
+		INSIST(fctx->pending > 0);
+		fctx->pending--;
+	}
+
+	while ((event = ISC_LIST_HEAD(events)) != NULL) {
+		fetchctx_t *efctx = event->ev_arg;
+
+		ISC_LIST_UNLINK(events, event, ev_link);
+		isc_task_send(efctx->res->buckets[efctx->bucketnum].task,
+			      &event);
+	}
+}
+
+/*%
+ * Raise the admission priority of a queued fetch when another fetch
+ * joins it.  Caller must be holding the bucket lock.
+ */
+static void
+fcount_prioritize(fetchctx_t *fctx, const isc_sockaddr_t *client) {
+	zonebucket_t *dbucket;
+	fctxcount_t *counter;
+
+	if (!fctx->waited || fctx->dbucketnum == RES_NOBUCKET)
+		return;
+
+	dbucket = &fctx->res->dbuckets[fctx->dbucketnum];
+
+	LOCK(&dbucket->lock);
+	if (fctx->queued) {
+		counter = fcount_find(dbucket, fctx);
+		INSIST(counter != NULL);
+		ISC_LIST_UNLINK(counter->queue, fctx, qlink);
+		fctx->priority += fcount_weight(fctx, client);
+		fcount_enqueue(counter, fctx);
+	}
+	UNLOCK(&dbucket->lock);
+}
+
+/*%
+ * Take 'fctx' out of its zone's admission queue if it is still waiting
+ * there because it timed out or is being shut down before it got a
+ * slot.  Caller must be holding the bucket lock.
+ */
+static void
+fcount_unqueue(fetchctx_t *fctx) {
+	zonebucket_t *dbucket;
+	fctxcount_t *counter;
+	isc_event_t *event = NULL;
+
+	if (!fctx->waited || fctx->dbucketnum == RES_NOBUCKET)
+		return;
+
+	dbucket = &fctx->res->dbuckets[fctx->dbucketnum];
+
+	LOCK(&dbucket->lock);
+	if (fctx->queued) {
+		counter = fcount_find(dbucket, fctx);
+		INSIST(counter != NULL);
+		event = fcount_dequeue(counter, fctx);
+		counter->expired++;
+		fctx->dbucketnum = RES_NOBUCKET;
+		INSIST(counter->count != 0);
+	}
+	UNLOCK(&dbucket->lock);
+
+	if (event != NULL) {
+		isc_event_free(&event);
+		INSIST(fctx->pending > 0);
+		fctx->pending--;
+		inc_stats(fctx->res, dns_resstatscounter_zonequeueexpired);
+	}
 }
 
 static inline void
@@ -1666,6 +1912,7 @@ fctx_done(fetchctx_t *fctx, isc_result_t result, int line) {
 
 	LOCK(&res->buckets[fctx->bucketnum].lock);
 
+	fcount_unqueue(fctx);
 	fctx->state = fetchstate_done;
 	fctx->attributes &= ~FCTX_ATTR_ADDRWAIT;
 	fctx_sendevents(fctx, result, line);
@@ -4285,6 +4532,8 @@ fctx_doshutdown(isc_task_t *task, isc_event_t *event) {
 	       fctx->state == fetchstate_done);
 	INSIST(fctx->want_shutdown);
 
+	fcount_unqueue(fctx);
+
 	if (fctx->state != fetchstate_done) {
 		fctx->state = fetchstate_done;
 		fctx_sendevents(fctx, ISC_R_CANCELED, __LINE__);
@@ -4332,15 +4581,19 @@ fctx_start(isc_task_t *task, isc_event_t *event) {
 		 */
 		fctx->attributes |= FCTX_ATTR_SHUTTINGDOWN;
 		fctx->state = fetchstate_done;
+		fcount_unqueue(fctx);
 		fctx_sendevents(fctx, ISC_R_CANCELED, __LINE__);
 		/*
 		 * Since we haven't started, we INSIST that we have no
-		 * pending ADB finds and no pending validations.
+		 * pending ADB finds and no pending validations.  The
+		 * only event we can be waiting for is fctx_resume()
+		 * from the fetches-per-zone queue, and it will finish
+		 * the cleanup if so.
 		 */
-		INSIST(fctx->pending == 0);
+		INSIST(fctx->pending == 0 || fctx->waited);
 		INSIST(fctx->nqueries == 0);
 		INSIST(ISC_LIST_EMPTY(fctx->validators));
-		if (fctx->references == 0) {
+		if (fctx->references == 0 && fctx->pending == 0) {
 			/*
 			 * It's now safe to destroy this fctx.
 			 */
@@ -4370,12 +4623,15 @@ fctx_start(isc_task_t *task, isc_event_t *event) {
 		INSIST(!dodestroy);
 
 		/*
-		 * All is well.  Start working on the fetch.
+		 * All is well.  Start working on the fetch, unless it
+		 * is still waiting for a fetches-per-zone slot; in that
+		 * case only the lifetime timer runs until fctx_resume()
+		 * is called.
 		 */
 		result = fctx_starttimer(fctx);
 		if (result != ISC_R_SUCCESS)
 			fctx_done(fctx, result, __LINE__);
-		else
+		else if (!fctx->waited || ADMITTED(fctx))
 			fctx_try(fctx, ISC_FALSE, ISC_FALSE);
 	} else if (dodestroy) {
 			fctx_destroy(fctx);
@@ -4384,6 +4640,60 @@ fctx_start(isc_task_t *task, isc_event_t *event) {
 	}
 }
 
+/*
+ * A fetch waiting in the fetches-per-zone queue has been given a slot.
+ */
+static void
+fctx_resume(isc_task_t *task, isc_event_t *event) {
+	fetchctx_t *fctx = event->ev_arg;
+	isc_boolean_t want_try = ISC_FALSE;
+	isc_boolean_t bucket_empty = ISC_FALSE;
+	isc_boolean_t dodestroy = ISC_FALSE;
+	dns_resolver_t *res;
+	unsigned int bucketnum;
+
+	REQUIRE(VALID_FCTX(fctx));
+
+	UNUSED(task);
+
+	res = fctx->res;
+	bucketnum = fctx->bucketnum;
+
+	FCTXTRACE("resume");
+
+	LOCK(&res->buckets[bucketnum].lock);
+
+	INSIST(fctx->pending > 0);
+	fctx->pending--;
+	fctx->attributes |= FCTX_ATTR_ADMITTED;
+
+	if (fctx->state == fetchstate_init) {
+		/*
+		 * fctx_start() hasn't run yet; it will start the fetch.
+		 */
+	} else if (fctx->state == fetchstate_active && !fctx->want_shutdown) {
+		want_try = ISC_TRUE;
+	} else if (SHUTTINGDOWN(fctx) && fctx->pending == 0 &&
+		   fctx->nqueries == 0 && ISC_LIST_EMPTY(fctx->validators) &&
+		   fctx->references == 0)
+	{
+		bucket_empty = fctx_unlink(fctx);
+		dodestroy = ISC_TRUE;
+	}
+
+	UNLOCK(&res->buckets[bucketnum].lock);
+
+	isc_event_free(&event);
+
+	if (want_try) {
+		fctx_try(fctx, ISC_FALSE, ISC_FALSE);
+	} else if (dodestroy) {
+		fctx_destroy(fctx);
+		if (bucket_empty)
+			empty_bucket(res);
+	}
+}
+
 /*
  * Fetch Creation, Joining, and Cancelation.
  */
@@ -4434,6 +4744,7 @@ fctx_join(fetchctx_t *fctx, isc_task_t *task, const isc_sockaddr_t *client,
 		ISC_LIST_APPEND(fctx->events, event, ev_link);
 	fctx->references++;
 	fctx->client = client;
+	fcount_prioritize(fctx, client);
 
 	fetch->magic = DNS_FETCH_MAGIC;
 	fetch->private = fctx;
@@ -4571,6 +4882,11 @@ fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 	fctx->client = NULL;
 	fctx->ns_ttl = 0;
 	fctx->ns_ttl_ok = ISC_FALSE;
+	ISC_LINK_INIT(fctx, qlink);
+	fctx->waited = ISC_FALSE;
+	fctx->queued = ISC_FALSE;
+	fctx->priority = 0;
+	fctx->resume_event = NULL;
 
 	dns_name_init(&fctx->nsname, NULL);
 	fctx->nsfetch = NULL;
@@ -4646,7 +4962,17 @@ fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 	 * Are there too many simultaneous queries for this domain?
 	 */
 	result = fcount_incr(fctx, ISC_FALSE);
-	if (result != ISC_R_SUCCESS) {
+	if (result == DNS_R_WAIT) {
+		/*
+		 * The fetch has been queued until a slot for the zone
+		 * becomes free.  The pending resume event keeps it from
+		 * being destroyed while it waits.
+		 */
+		fctx->waited = ISC_TRUE;
+		fctx->pending++;
+		inc_stats(res, dns_resstatscounter_zonequeued);
+		inc_stats(res, dns_resstatscounter_zonequeuedepth);
+	} else if (result != ISC_R_SUCCESS) {
 		result = fctx->res->quotaresp[dns_quotatype_zone];
 		inc_stats(res, dns_resstatscounter_zonequota);
 		goto cleanup_domain;
@@ -5359,7 +5685,7 @@ validated(isc_task_t *task, isc_event_t *event) {
 
  answer_response:
 	/*
-	 * Cache any SOA/NS/NSEC records that happened to be validated.
+	 * Cache any SOA/NS/NSEC/NSEC3 records that happened to be validated.
 	 */
 	result = dns_message_firstname(fctx->rmessage, DNS_SECTION_AUTHORITY);
 	while (result == ISC_R_SUCCESS) {
@@ -5371,7 +5697,8 @@ validated(isc_task_t *task, isc_event_t *event) {
 		     rdataset = ISC_LIST_NEXT(rdataset, link)) {
 			if ((rdataset->type != dns_rdatatype_ns &&
 			     rdataset->type != dns_rdatatype_soa &&
-			     rdataset->type != dns_rdatatype_nsec) ||
+			     rdataset->type != dns_rdatatype_nsec &&
+			     rdataset->type != dns_rdatatype_nsec3) ||
 			    rdataset->trust != dns_trust_secure)
 				continue;
 			for (sigrdataset = ISC_LIST_HEAD(name->list);
@@ -9689,6 +10016,7 @@ dns_resolver_create(dns_view_t *view,
 	res->spillatmax = 100;
 	res->spillattimer = NULL;
 	res->zspill = 0;
+	res->zqueue = 0;
 	res->zero_no_soa_ttl = ISC_FALSE;
 	res->retryinterval = 30000;
 	res->nonbackofftries = 3;
@@ -10990,6 +11318,17 @@ dns_resolver_setfetchesperzone(dns_resolver_t *resolver, isc_uint32_t clients)
 	UNLOCK(&resolver->lock);
 }
 
+void
+dns_resolver_setfetchesperzonequeue(dns_resolver_t *resolver,
+				    isc_uint32_t queue)
+{
+	REQUIRE(VALID_RESOLVER(resolver));
+
+	LOCK(&resolver->lock);
+	resolver->zqueue = queue;
+	UNLOCK(&resolver->lock);
+}
+
 
 isc_boolean_t
 dns_resolver_getzeronosoattl(dns_resolver_t *resolver) {
@@ -11104,8 +11443,12 @@ dns_resolver_dumpfetches(dns_resolver_t *resolver,
 		     fc = ISC_LIST_NEXT(fc, link))
 		{
 			dns_name_print(fc->domain, fp);
-			fprintf(fp, ": %u active (%u spilled, %u allowed)\n",
+			fprintf(fp, ": %u active (%u spilled, %u allowed)",
 				fc->count, fc->dropped, fc->allowed);
+			if (fc->queued != 0 || fc->expired != 0)
+				fprintf(fp, " (%u queued, %u expired)",
+					fc->queued, fc->expired);
+			fprintf(fp, "\n");
 		}
 		UNLOCK(&resolver->dbuckets[i].lock);
 	}
@@ -0,0 +1,663 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/mem.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/nsec3.h>
+#include <dns/rdata.h>
+#include <dns/rdataset.h>
+#include <dns/rdataslab.h>
+#include <dns/rdatastruct.h>
+#include <dns/zonekey.h>
+
+#include "slabdb_p.h"
+
+/*
+ * Rdataset methods.
+ */
+
+void
+dns__slabdb_disassociate(dns_rdataset_t *rdataset) {
+	dns_db_t *db = rdataset->private1;
+	dns_dbnode_t *node = rdataset->private2;
+
+	dns_db_detachnode(db, &node);
+}
+
+isc_result_t
+dns__slabdb_first(dns_rdataset_t *rdataset) {
+	unsigned char *raw = rdataset->private3;        /* RDATASLAB */
+	unsigned int count;
+
+	count = raw[0] * 256 + raw[1];
+	if (count == 0) {
+		rdataset->private5 = NULL;
+		return (ISC_R_NOMORE);
+	}
+
+#if DNS_RDATASET_FIXED
+	if ((rdataset->attributes & DNS_RDATASETATTR_LOADORDER) == 0)
+		raw += 2 + (4 * count);
+	else
+#endif
+		raw += 2;
+
+	/*
+	 * The privateuint4 field is the number of rdata beyond the
+	 * cursor position, so we decrement the total count by one
+	 * before storing it.
+	 *
+	 * If DNS_RDATASETATTR_LOADORDER is not set 'raw' points to the
+	 * first record.  If DNS_RDATASETATTR_LOADORDER is set 'raw' points
+	 * to the first entry in the offset table.
+	 */
+	count--;
+	rdataset->privateuint4 = count;
+	rdataset->private5 = raw;
+
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+dns__slabdb_next(dns_rdataset_t *rdataset) {
+	unsigned int count;
+	unsigned int length;
+	unsigned char *raw;     /* RDATASLAB */
+
+	count = rdataset->privateuint4;
+	if (count == 0)
+		return (ISC_R_NOMORE);
+	count--;
+	rdataset->privateuint4 = count;
+
+	/*
+	 * Skip forward one record (length + 4) or one offset (4).
+	 */
+	raw = rdataset->private5;
+#if DNS_RDATASET_FIXED
+	if ((rdataset->attributes & DNS_RDATASETATTR_LOADORDER) == 0) {
+#endif
+		length = raw[0] * 256 + raw[1];
+		raw += length;
+#if DNS_RDATASET_FIXED
+	}
+	rdataset->private5 = raw + 4;           /* length(2) + order(2) */
+#else
+	rdataset->private5 = raw + 2;           /* length(2) */
+#endif
+
+	return (ISC_R_SUCCESS);
+}
+
+void
+dns__slabdb_current(dns_rdataset_t *rdataset, dns_rdata_t *rdata) {
+	unsigned char *raw = rdataset->private5;        /* RDATASLAB */
+#if DNS_RDATASET_FIXED
+	unsigned int offset;
+#endif
+	unsigned int length;
+	isc_region_t r;
+	unsigned int flags = 0;
+
+	REQUIRE(raw != NULL);
+
+	/*
+	 * Find the start of the record if not already in private5
+	 * then skip the length and order fields.
+	 */
+#if DNS_RDATASET_FIXED
+	if ((rdataset->attributes & DNS_RDATASETATTR_LOADORDER) != 0) {
+		offset = (raw[0] << 24) + (raw[1] << 16) +
+			 (raw[2] << 8) + raw[3];
+		raw = rdataset->private3;
+		raw += offset;
+	}
+#endif
+	length = raw[0] * 256 + raw[1];
+#if DNS_RDATASET_FIXED
+	raw += 4;
+#else
+	raw += 2;
+#endif
+	if (rdataset->type == dns_rdatatype_rrsig) {
+		if (*raw & DNS_RDATASLAB_OFFLINE)
+			flags |= DNS_RDATA_OFFLINE;
+		length--;
+		raw++;
+	}
+	r.length = length;
+	r.base = raw;
+	dns_rdata_fromregion(rdata, rdataset->rdclass, rdataset->type, &r);
+	rdata->flags |= flags;
+}
+
+void
+dns__slabdb_clone(dns_rdataset_t *source, dns_rdataset_t *target) {
+	dns_db_t *db = source->private1;
+	dns_dbnode_t *node = source->private2;
+	dns_dbnode_t *cloned_node = NULL;
+
+	dns_db_attachnode(db, node, &cloned_node);
+	INSIST(!ISC_LINK_LINKED(target, link));
+	*target = *source;
+	ISC_LINK_INIT(target, link);
+
+	/*
+	 * Reset iterator state.
+	 */
+	target->privateuint4 = 0;
+	target->private5 = NULL;
+}
+
+unsigned int
+dns__slabdb_count(dns_rdataset_t *rdataset) {
+	unsigned char *raw = rdataset->private3;        /* RDATASLAB */
+	unsigned int count;
+
+	count = raw[0] * 256 + raw[1];
+
+	return (count);
+}
+
+/*
+ * The proof rdatasets can't have proofs of their own.
+ */
+static dns_rdatasetmethods_t proof_methods = {
+	dns__slabdb_disassociate,
+	dns__slabdb_first,
+	dns__slabdb_next,
+	dns__slabdb_current,
+	dns__slabdb_clone,
+	dns__slabdb_count,
+	NULL, /* addnoqname */
+	NULL, /* getnoqname */
+	NULL, /* addclosest */
+	NULL, /* getclosest */
+	NULL, /* settrust */
+	NULL, /* expire */
+	NULL, /* clearprefetch */
+	NULL, /* setownercase */
+	NULL, /* getownercase */
+	NULL  /* addglue */
+};
+
+static void
+bind_proof(dns_rdataset_t *rdataset, unsigned char *slab,
+	   dns_rdatatype_t type, dns_rdatatype_t covers,
+	   dns_rdataset_t *target)
+{
+	dns_db_t *db = rdataset->private1;
+	dns_dbnode_t *cloned_node = NULL;
+
+	dns_db_attachnode(db, rdataset->private2, &cloned_node);
+	target->methods = &proof_methods;
+	target->rdclass = db->rdclass;
+	target->type = type;
+	target->covers = covers;
+	target->ttl = rdataset->ttl;
+	target->trust = rdataset->trust;
+	target->private1 = db;
+	target->private2 = cloned_node;
+	target->private3 = slab;
+	target->privateuint4 = 0;
+	target->private5 = NULL;
+	target->private6 = NULL;
+	target->private7 = NULL;
+}
+
+static isc_result_t
+getproof(dns_rdataset_t *rdataset, const slabdb_proof_t *proof,
+	 dns_name_t *name, dns_rdataset_t *neg, dns_rdataset_t *negsig)
+{
+	bind_proof(rdataset, proof->neg, proof->type, 0, neg);
+	bind_proof(rdataset, proof->negsig, dns_rdatatype_rrsig, proof->type,
+		   negsig);
+	dns_name_clone(&proof->name, name);
+
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+dns__slabdb_getnoqname(dns_rdataset_t *rdataset, dns_name_t *name,
+		       dns_rdataset_t *neg, dns_rdataset_t *negsig)
+{
+	return (getproof(rdataset, rdataset->private6, name, neg, negsig));
+}
+
+isc_result_t
+dns__slabdb_getclosest(dns_rdataset_t *rdataset, dns_name_t *name,
+		       dns_rdataset_t *neg, dns_rdataset_t *negsig)
+{
+	return (getproof(rdataset, rdataset->private7, name, neg, negsig));
+}
+
+/*
+ * Proofs.
+ */
+
+isc_result_t
+dns__slabdb_newproof(isc_mem_t *mctx, dns_rdataset_t *rdataset,
+		     isc_boolean_t closest, slabdb_proof_t **proofp)
+{
+	slabdb_proof_t *proof = NULL;
+	dns_name_t name;
+	dns_rdataset_t neg, negsig;
+	isc_result_t result;
+	isc_region_t r;
+
+	REQUIRE(proofp != NULL && *proofp == NULL);
+
+	dns_name_init(&name, NULL);
+	dns_rdataset_init(&neg);
+	dns_rdataset_init(&negsig);
+
+	if (closest)
+		result = dns_rdataset_getclosest(rdataset, &name,
+						 &neg, &negsig);
+	else
+		result = dns_rdataset_getnoqname(rdataset, &name,
+						 &neg, &negsig);
+	RUNTIME_CHECK(result == ISC_R_SUCCESS);
+
+	proof = isc_mem_get(mctx, sizeof(*proof));
+	if (proof == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup;
+	}
+	dns_name_init(&proof->name, NULL);
+	proof->neg = NULL;
+	proof->negsig = NULL;
+	proof->type = neg.type;
+	result = dns_name_dup(&name, mctx, &proof->name);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	result = dns_rdataslab_fromrdataset(&neg, mctx, &r, 0);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	proof->neg = r.base;
+	result = dns_rdataslab_fromrdataset(&negsig, mctx, &r, 0);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	proof->negsig = r.base;
+	dns_rdataset_disassociate(&neg);
+	dns_rdataset_disassociate(&negsig);
+	*proofp = proof;
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	dns_rdataset_disassociate(&neg);
+	dns_rdataset_disassociate(&negsig);
+	if (proof != NULL)
+		dns__slabdb_freeproof(mctx, &proof);
+	return (result);
+}
+
+void
+dns__slabdb_freeproof(isc_mem_t *mctx, slabdb_proof_t **proofp) {
+	slabdb_proof_t *proof = *proofp;
+
+	if (dns_name_dynamic(&proof->name))
+		dns_name_free(&proof->name, mctx);
+	if (proof->neg != NULL)
+		isc_mem_put(mctx, proof->neg,
+			    dns_rdataslab_size(proof->neg, 0));
+	if (proof->negsig != NULL)
+		isc_mem_put(mctx, proof->negsig,
+			    dns_rdataslab_size(proof->negsig, 0));
+	isc_mem_put(mctx, proof, sizeof(*proof));
+	*proofp = NULL;
+}
+
+/*
+ * Owner name case.
+ */
+
+isc_boolean_t
+dns__slabdb_setownercase(unsigned char *upper, const dns_name_t *name) {
+	unsigned int i;
+	isc_boolean_t fully_lower;
+
+	/*
+	 * We do not need to worry about label lengths as they are all
+	 * less than or equal to 63.
+	 */
+	memset(upper, 0, DNS_SLABDB_CASEBYTES);
+	fully_lower = ISC_TRUE;
+	for (i = 0; i < name->length; i++)
+		if (name->ndata[i] >= 0x41 && name->ndata[i] <= 0x5a) {
+			upper[i/8] |= 1 << (i%8);
+			fully_lower = ISC_FALSE;
+		}
+	return (fully_lower);
+}
+
+static const unsigned char charmask[] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static const unsigned char maptolower[] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+	0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+	0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+	0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+	0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+	0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
+	0x78, 0x79, 0x7a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+	0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+	0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
+	0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+	0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+	0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+	0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+	0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+	0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+	0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+	0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+	0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+
+void
+dns__slabdb_getownercase(const unsigned char *upper, isc_boolean_t fullylower,
+			 dns_name_t *name)
+{
+	unsigned int i, j;
+	unsigned char bits;
+	unsigned char c, flip;
+
+	if (ISC_LIKELY(fullylower)) {
+		unsigned char *bp, *be;
+		bp = name->ndata;
+		be = bp + name->length;
+
+		while (bp <= be - 4) {
+			c = bp[0];
+			bp[0] = maptolower[c];
+			c = bp[1];
+			bp[1] = maptolower[c];
+			c = bp[2];
+			bp[2] = maptolower[c];
+			c = bp[3];
+			bp[3] = maptolower[c];
+			bp += 4;
+		}
+		while (bp < be) {
+			c = *bp;
+			*bp++ = maptolower[c];
+		}
+		return;
+	}
+
+	i = 0;
+	for (j = 0; j < (name->length >> 3); j++) {
+		unsigned int k;
+
+		bits = ~(upper[j]);
+
+		for (k = 0; k < 8; k++) {
+			c = name->ndata[i];
+			flip = (bits & 1) << 5;
+			flip ^= c;
+			flip &= charmask[c];
+			name->ndata[i] ^= flip;
+
+			i++;
+			bits >>= 1;
+		}
+	}
+
+	if (ISC_UNLIKELY(i == name->length))
+		return;
+
+	bits = ~(upper[j]);
+
+	for (; i < name->length; i++) {
+		c = name->ndata[i];
+		flip = (bits & 1) << 5;
+		flip ^= c;
+		flip &= charmask[c];
+		name->ndata[i] ^= flip;
+
+		bits >>= 1;
+	}
+}
+
+/*
+ * DNSSEC.
+ */
+
+dns_db_secure_t
+dns__slabdb_iszonesecure(dns_db_t *db, dns_dbversion_t *version,
+			 dns_dbnode_t *origin, slabdb_nsec3params_t *params,
+			 isc_boolean_t *havensec3p)
+{
+	dns_rdataset_t keyset;
+	dns_rdataset_t nsecset, signsecset;
+	dns_rdataset_t paramset;
+	dns_rdata_nsec3param_t nsec3param;
+	isc_boolean_t haszonekey = ISC_FALSE;
+	isc_boolean_t hasnsec = ISC_FALSE;
+	isc_result_t result;
+
+	*havensec3p = ISC_FALSE;
+
+	dns_rdataset_init(&keyset);
+	result = dns_db_findrdataset(db, origin, version, dns_rdatatype_dnskey,
+				     0, 0, &keyset, NULL);
+	if (result == ISC_R_SUCCESS) {
+		result = dns_rdataset_first(&keyset);
+		while (result == ISC_R_SUCCESS) {
+			dns_rdata_t keyrdata = DNS_RDATA_INIT;
+			dns_rdataset_current(&keyset, &keyrdata);
+			if (dns_zonekey_iszonekey(&keyrdata)) {
+				haszonekey = ISC_TRUE;
+				break;
+			}
+			result = dns_rdataset_next(&keyset);
+		}
+		dns_rdataset_disassociate(&keyset);
+	}
+	if (!haszonekey)
+		return (dns_db_insecure);
+
+	dns_rdataset_init(&nsecset);
+	dns_rdataset_init(&signsecset);
+	result = dns_db_findrdataset(db, origin, version, dns_rdatatype_nsec,
+				     0, 0, &nsecset, &signsecset);
+	if (result == ISC_R_SUCCESS) {
+		if (dns_rdataset_isassociated(&signsecset)) {
+			hasnsec = ISC_TRUE;
+			dns_rdataset_disassociate(&signsecset);
+		}
+		dns_rdataset_disassociate(&nsecset);
+	}
+
+	/*
+	 * Find A NSEC3PARAM with a supported algorithm.
+	 */
+	dns_rdataset_init(&paramset);
+	result = dns_db_findrdataset(db, origin, version,
+				     dns_rdatatype_nsec3param, 0, 0,
+				     &paramset, NULL);
+	if (result == ISC_R_SUCCESS) {
+		result = dns_rdataset_first(&paramset);
+		while (result == ISC_R_SUCCESS) {
+			dns_rdata_t rdata = DNS_RDATA_INIT;
+
+			dns_rdataset_current(&paramset, &rdata);
+			result = dns_rdata_tostruct(&rdata, &nsec3param, NULL);
+			INSIST(result == ISC_R_SUCCESS);
+			result = dns_rdataset_next(&paramset);
+
+			if (nsec3param.hash != DNS_NSEC3_UNKNOWNALG &&
+			    !dns_nsec3_supportedhash(nsec3param.hash))
+				continue;
+
+			if (nsec3param.flags != 0)
+				continue;
+
+			memmove(params->salt, nsec3param.salt,
+				nsec3param.salt_length);
+			params->hash = nsec3param.hash;
+			params->salt_length = nsec3param.salt_length;
+			params->iterations = nsec3param.iterations;
+			params->flags = nsec3param.flags;
+			*havensec3p = ISC_TRUE;
+			/*
+			 * Look for a better algorithm than the
+			 * unknown test algorithm.
+			 */
+			if (nsec3param.hash != DNS_NSEC3_UNKNOWNALG)
+				break;
+		}
+		dns_rdataset_disassociate(&paramset);
+	}
+
+	/*
+	 * Do we have a valid NSEC/NSEC3 chain?
+	 */
+	if (*havensec3p || hasnsec)
+		return (dns_db_secure);
+	return (dns_db_insecure);
+}
+
+isc_boolean_t
+dns__slabdb_matchnsec3(unsigned char *slab, dns_rdataclass_t rdclass,
+		       const slabdb_nsec3params_t *params)
+{
+	dns_rdataset_t rdataset;
+	dns_rdata_nsec3_t nsec3;
+	isc_boolean_t match = ISC_FALSE;
+	isc_result_t result;
+
+	dns_rdataset_init(&rdataset);
+	dns_rdataslab_tordataset(slab, 0, rdclass, dns_rdatatype_nsec3, 0, 0,
+				 &rdataset);
+	result = dns_rdataset_first(&rdataset);
+	while (result == ISC_R_SUCCESS && !match) {
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+
+		dns_rdataset_current(&rdataset, &rdata);
+		result = dns_rdata_tostruct(&rdata, &nsec3, NULL);
+		INSIST(result == ISC_R_SUCCESS);
+		if (nsec3.hash == params->hash &&
+		    nsec3.iterations == params->iterations &&
+		    nsec3.salt_length == params->salt_length &&
+		    memcmp(nsec3.salt, params->salt, nsec3.salt_length) == 0)
+			match = ISC_TRUE;
+		result = dns_rdataset_next(&rdataset);
+	}
+	dns_rdataset_disassociate(&rdataset);
+
+	return (match);
+}
+
+void
+dns__slabdb_getnsec3params(const slabdb_nsec3params_t *params,
+			   dns_hash_t *hash, isc_uint8_t *flags,
+			   isc_uint16_t *iterations, unsigned char *salt,
+			   size_t *salt_length)
+{
+	if (hash != NULL)
+		*hash = params->hash;
+	if (salt != NULL && salt_length != NULL) {
+		REQUIRE(*salt_length >= params->salt_length);
+		memmove(salt, params->salt, params->salt_length);
+	}
+	if (salt_length != NULL)
+		*salt_length = params->salt_length;
+	if (iterations != NULL)
+		*iterations = params->iterations;
+	if (flags != NULL)
+		*flags = params->flags;
+}
+
+/*
+ * Delegations.
+ */
+
+isc_boolean_t
+dns__slabdb_hasnstarget(unsigned char *slab, dns_rdataclass_t rdclass,
+			const dns_name_t *name)
+{
+	dns_rdataset_t rdataset;
+	dns_rdata_ns_t ns;
+	isc_boolean_t found = ISC_FALSE;
+	isc_result_t result;
+
+	dns_rdataset_init(&rdataset);
+	dns_rdataslab_tordataset(slab, 0, rdclass, dns_rdatatype_ns, 0, 0,
+				 &rdataset);
+	result = dns_rdataset_first(&rdataset);
+	while (result == ISC_R_SUCCESS && !found) {
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+
+		dns_rdataset_current(&rdataset, &rdata);
+		result = dns_rdata_tostruct(&rdata, &ns, NULL);
+		INSIST(result == ISC_R_SUCCESS);
+		found = dns_name_equal(&ns.name, name);
+		result = dns_rdataset_next(&rdataset);
+	}
+	dns_rdataset_disassociate(&rdataset);
+
+	return (found);
+}
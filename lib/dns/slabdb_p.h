@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_SLABDB_P_H
+#define DNS_SLABDB_P_H
+
+/*! \file
+ * \brief
+ * Code shared by the databases which keep their rdatasets as rdataslabs
+ * (rbtdb.c and qpdb.c), for the parts which depend neither on how the
+ * names are indexed nor on the layout of the databases' rdataset
+ * headers.
+ *
+ * An rdataset bound by one of these databases has the database in
+ * 'private1', the node in 'private2', the slab (just past the header)
+ * in 'private3', and its noqname and closest encloser proofs, if any,
+ * in 'private6' and 'private7'.  The rdatasets made by
+ * dns_rdataslab_tordataset() only use the methods which walk the slab.
+ */
+
+#include <isc/lang.h>
+#include <isc/result.h>
+
+#include <dns/nsec3.h>
+#include <dns/types.h>
+
+/*%
+ *     These functions must not be used outside the slab databases.
+ */
+
+/*%
+ * The number of bytes needed to record the case of an owner name, one
+ * bit per octet of its wire format.
+ */
+#define DNS_SLABDB_CASEBYTES	32
+
+typedef enum {
+	dns_db_insecure,
+	dns_db_partial,
+	dns_db_secure
+} dns_db_secure_t;
+
+/*%
+ * A noqname or closest encloser proof kept with a cached rdataset.
+ */
+typedef struct slabdb_proof {
+	dns_name_t			name;
+	void				*neg;
+	void				*negsig;
+	dns_rdatatype_t			type;
+} slabdb_proof_t;
+
+/*%
+ * The NSEC3 parameters a zone version is signed with.
+ */
+typedef struct slabdb_nsec3params {
+	dns_hash_t			hash;
+	isc_uint8_t			flags;
+	isc_uint16_t			iterations;
+	isc_uint8_t			salt_length;
+	unsigned char			salt[DNS_NSEC3_SALTSIZE];
+} slabdb_nsec3params_t;
+
+ISC_LANG_BEGINDECLS
+
+/*
+ * Rdataset methods.
+ */
+
+void
+dns__slabdb_disassociate(dns_rdataset_t *rdataset);
+
+isc_result_t
+dns__slabdb_first(dns_rdataset_t *rdataset);
+
+isc_result_t
+dns__slabdb_next(dns_rdataset_t *rdataset);
+
+void
+dns__slabdb_current(dns_rdataset_t *rdataset, dns_rdata_t *rdata);
+
+void
+dns__slabdb_clone(dns_rdataset_t *source, dns_rdataset_t *target);
+
+unsigned int
+dns__slabdb_count(dns_rdataset_t *rdataset);
+
+isc_result_t
+dns__slabdb_getnoqname(dns_rdataset_t *rdataset, dns_name_t *name,
+		       dns_rdataset_t *neg, dns_rdataset_t *negsig);
+
+isc_result_t
+dns__slabdb_getclosest(dns_rdataset_t *rdataset, dns_name_t *name,
+		       dns_rdataset_t *neg, dns_rdataset_t *negsig);
+/*%<
+ * Bind 'neg' and 'negsig' to the proof in 'private6' or 'private7'
+ * of 'rdataset'.  The proof rdatasets hold their own node references.
+ *
+ * dns__slabdb_disassociate() and dns__slabdb_clone() detach from and
+ * attach to the node through the database methods, so these functions
+ * work for any database which binds rdatasets as described above.
+ */
+
+/*
+ * Proofs.
+ */
+
+isc_result_t
+dns__slabdb_newproof(isc_mem_t *mctx, dns_rdataset_t *rdataset,
+		     isc_boolean_t closest, slabdb_proof_t **proofp);
+/*%<
+ * Copy the noqname proof of 'rdataset' (or its closest encloser proof
+ * if 'closest' is true) into a new proof.
+ *
+ * Requires:
+ *\li	'rdataset' has the proof.
+ *\li	proofp != NULL && *proofp == NULL
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOMEMORY
+ */
+
+void
+dns__slabdb_freeproof(isc_mem_t *mctx, slabdb_proof_t **proofp);
+/*%<
+ * Free '*proofp' and set it to NULL.
+ */
+
+/*
+ * Owner name case.
+ */
+
+isc_boolean_t
+dns__slabdb_setownercase(unsigned char *upper, const dns_name_t *name);
+/*%<
+ * Record which octets of 'name' are upper case in the
+ * DNS_SLABDB_CASEBYTES bytes at 'upper'.  Returns ISC_TRUE if 'name'
+ * is entirely lower case.
+ */
+
+void
+dns__slabdb_getownercase(const unsigned char *upper, isc_boolean_t fullylower,
+			 dns_name_t *name);
+/*%<
+ * Restore the case recorded by dns__slabdb_setownercase() to 'name',
+ * which must be the same name up to case.
+ */
+
+/*
+ * DNSSEC.
+ */
+
+dns_db_secure_t
+dns__slabdb_iszonesecure(dns_db_t *db, dns_dbversion_t *version,
+			 dns_dbnode_t *origin, slabdb_nsec3params_t *params,
+			 isc_boolean_t *havensec3p);
+/*%<
+ * Work out whether 'version' of the zone in 'db' is signed, by looking
+ * for a zone key and then for an NSEC chain or a usable NSEC3PARAM at
+ * 'origin'.  '*havensec3p' is set to whether NSEC3 parameters were
+ * found, and if so they are copied to '*params'.
+ *
+ * The caller must not be holding any database locks.
+ */
+
+isc_boolean_t
+dns__slabdb_matchnsec3(unsigned char *slab, dns_rdataclass_t rdclass,
+		       const slabdb_nsec3params_t *params);
+/*%<
+ * Return ISC_TRUE if an NSEC3 record in 'slab' uses 'params'.
+ */
+
+void
+dns__slabdb_getnsec3params(const slabdb_nsec3params_t *params,
+			   dns_hash_t *hash, isc_uint8_t *flags,
+			   isc_uint16_t *iterations, unsigned char *salt,
+			   size_t *salt_length);
+/*%<
+ * Copy out 'params' as dns_db_getnsec3parameters() returns them.  Any
+ * of the output pointers may be NULL.
+ */
+
+/*
+ * Delegations.
+ */
+
+isc_boolean_t
+dns__slabdb_hasnstarget(unsigned char *slab, dns_rdataclass_t rdclass,
+			const dns_name_t *name);
+/*%<
+ * Return ISC_TRUE if one of the NS records in 'slab' points to 'name'.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_SLABDB_P_H */
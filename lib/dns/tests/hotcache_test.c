@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <unistd.h>
+
+#include <isc/print.h>
+#include <isc/thread.h>
+
+#include <dns/fixedname.h>
+#include <dns/hotcache.h>
+#include <dns/name.h>
+
+#include "dnstest.h"
+
+static dns_name_t *
+makename(const char *str, dns_fixedname_t *fn) {
+	dns_test_namefromstring(str, fn);
+	return (dns_fixedname_name(fn));
+}
+
+/*
+ * Individual unit tests
+ */
+ATF_TC(estimate);
+ATF_TC_HEAD(estimate, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "check popularity estimates");
+}
+ATF_TC_BODY(estimate, tc) {
+	isc_result_t result;
+	dns_hotcache_t *hc = NULL;
+	dns_fixedname_t f1, f2;
+	dns_name_t *lower, *upper;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_hotcache_create(mctx, 100, &hc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	lower = makename("www.example.", &f1);
+	upper = makename("WWW.Example.", &f2);
+
+	ATF_CHECK_EQ(dns_hotcache_estimate(hc, lower, dns_rdatatype_a), 0);
+
+	for (i = 0; i < 5; i++)
+		dns_hotcache_hit(hc, lower, dns_rdatatype_a, 300, 0);
+	for (i = 0; i < 5; i++)
+		dns_hotcache_hit(hc, upper, dns_rdatatype_a, 300, 0);
+
+	/* Names are compared case insensitively. */
+	ATF_CHECK(dns_hotcache_estimate(hc, lower, dns_rdatatype_a) >= 10);
+	ATF_CHECK(dns_hotcache_estimate(hc, upper, dns_rdatatype_a) >= 10);
+	ATF_CHECK(dns_hotcache_tracked(hc, upper, dns_rdatatype_a));
+
+	/* Types are counted separately. */
+	ATF_CHECK(dns_hotcache_estimate(hc, lower, dns_rdatatype_aaaa) < 10);
+	ATF_CHECK(!dns_hotcache_tracked(hc, lower, dns_rdatatype_aaaa));
+
+	dns_hotcache_detach(&hc);
+	dns_test_end();
+}
+
+ATF_TC(replace);
+ATF_TC_HEAD(replace, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "check that only more popular names replace "
+			  "tracked ones");
+}
+ATF_TC_BODY(replace, tc) {
+	isc_result_t result;
+	dns_hotcache_t *hc = NULL;
+	dns_fixedname_t fn[5];
+	dns_name_t *names[5];
+	unsigned int i, tracked;
+	char buf[64];
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_hotcache_create(mctx, 4, &hc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 5; i++) {
+		snprintf(buf, sizeof(buf), "name%u.example.", i);
+		names[i] = makename(buf, &fn[i]);
+	}
+
+	for (i = 0; i < 4; i++)
+		dns_hotcache_hit(hc, names[i], dns_rdatatype_a, 300, 0);
+	for (i = 0; i < 4; i++)
+		ATF_CHECK(dns_hotcache_tracked(hc, names[i],
+					       dns_rdatatype_a));
+
+	/* A one-off name does not displace an equally popular one. */
+	dns_hotcache_hit(hc, names[4], dns_rdatatype_a, 300, 0);
+	ATF_CHECK(!dns_hotcache_tracked(hc, names[4], dns_rdatatype_a));
+
+	/* Once it becomes more popular it does. */
+	for (i = 0; i < 3; i++)
+		dns_hotcache_hit(hc, names[4], dns_rdatatype_a, 300, 0);
+	ATF_CHECK(dns_hotcache_tracked(hc, names[4], dns_rdatatype_a));
+
+	tracked = 0;
+	for (i = 0; i < 5; i++)
+		if (dns_hotcache_tracked(hc, names[i], dns_rdatatype_a))
+			tracked++;
+	ATF_CHECK_EQ(tracked, 4);
+
+	dns_hotcache_detach(&hc);
+	dns_test_end();
+}
+
+ATF_TC(zerottl);
+ATF_TC_HEAD(zerottl, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "check that expired answers are not tracked");
+}
+ATF_TC_BODY(zerottl, tc) {
+	isc_result_t result;
+	dns_hotcache_t *hc = NULL;
+	dns_fixedname_t fn;
+	dns_name_t *name;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_hotcache_create(mctx, 10, &hc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	name = makename("zero.example.", &fn);
+	dns_hotcache_hit(hc, name, dns_rdatatype_a, 0, 0);
+	ATF_CHECK(!dns_hotcache_tracked(hc, name, dns_rdatatype_a));
+	ATF_CHECK_EQ(dns_hotcache_estimate(hc, name, dns_rdatatype_a), 1);
+
+	dns_hotcache_detach(&hc);
+	dns_test_end();
+}
+
+ATF_TC(aging);
+ATF_TC_HEAD(aging, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "check that estimates are halved periodically");
+}
+ATF_TC_BODY(aging, tc) {
+	isc_result_t result;
+	dns_hotcache_t *hc = NULL;
+	dns_fixedname_t fn, fo;
+	dns_name_t *name, *other;
+	isc_uint32_t est;
+	unsigned int i;
+	char buf[64];
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* 100 entries are aged every 1000 hits. */
+	result = dns_hotcache_create(mctx, 100, &hc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	name = makename("popular.example.", &fn);
+	for (i = 0; i < 100; i++)
+		dns_hotcache_hit(hc, name, dns_rdatatype_a, 300, 0);
+	ATF_CHECK(dns_hotcache_estimate(hc, name, dns_rdatatype_a) >= 100);
+
+	for (i = 0; i < 899; i++) {
+		snprintf(buf, sizeof(buf), "other%u.example.", i);
+		other = makename(buf, &fo);
+		dns_hotcache_hit(hc, other, dns_rdatatype_a, 300, 0);
+	}
+	ATF_CHECK(dns_hotcache_estimate(hc, name, dns_rdatatype_a) >= 100);
+
+	/* The 1000th hit ages the counts. */
+	dns_hotcache_hit(hc, other, dns_rdatatype_a, 300, 0);
+	est = dns_hotcache_estimate(hc, name, dns_rdatatype_a);
+	ATF_CHECK(est >= 50 && est < 100);
+	ATF_CHECK(dns_hotcache_tracked(hc, name, dns_rdatatype_a));
+
+	dns_hotcache_detach(&hc);
+	dns_test_end();
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+#define NTHREADS	4
+#define NHOT		64
+#define NLOOPS		200
+
+static dns_hotcache_t *thc;
+static dns_fixedname_t hotfn[NHOT];
+static dns_name_t *hotnames[NHOT];
+
+static isc_threadresult_t
+#ifdef WIN32
+WINAPI
+#endif
+hit_thread(isc_threadarg_t arg) {
+	unsigned int id = *(unsigned int *)arg;
+	dns_fixedname_t fn;
+	dns_name_t *name;
+	unsigned int i, j;
+	char buf[64];
+
+	for (i = 0; i < NLOOPS; i++) {
+		for (j = 0; j < NHOT; j++) {
+			dns_hotcache_hit(thc, hotnames[j], dns_rdatatype_a,
+					 300, 0);
+			snprintf(buf, sizeof(buf), "once%u-%u-%u.example.",
+				 id, i, j);
+			name = makename(buf, &fn);
+			dns_hotcache_hit(thc, name, dns_rdatatype_a, 300, 0);
+		}
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+ATF_TC(threads);
+ATF_TC_HEAD(threads, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "check that hits counted by several threads "
+			  "keep the popular names tracked");
+}
+ATF_TC_BODY(threads, tc) {
+	isc_result_t result;
+	isc_thread_t threads[NTHREADS];
+	unsigned int ids[NTHREADS];
+	unsigned int i;
+	char buf[64];
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* Large enough to be split into shards. */
+	result = dns_hotcache_create(mctx, 1000, &thc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < NHOT; i++) {
+		snprintf(buf, sizeof(buf), "hot%u.example.", i);
+		hotnames[i] = makename(buf, &hotfn[i]);
+	}
+
+	for (i = 0; i < NTHREADS; i++) {
+		ids[i] = i;
+		result = isc_thread_create(hit_thread, &ids[i], &threads[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	for (i = 0; i < NHOT; i++) {
+		ATF_CHECK(dns_hotcache_tracked(thc, hotnames[i],
+					       dns_rdatatype_a));
+		ATF_CHECK(dns_hotcache_estimate(thc, hotnames[i],
+						dns_rdatatype_a) > 1);
+	}
+
+	dns_hotcache_detach(&thc);
+	dns_test_end();
+}
+#endif
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, estimate);
+	ATF_TP_ADD_TC(tp, replace);
+	ATF_TP_ADD_TC(tp, zerottl);
+	ATF_TP_ADD_TC(tp, aging);
+#ifdef ISC_PLATFORM_USETHREADS
+	ATF_TP_ADD_TC(tp, threads);
+#endif
+	return (atf_no_error());
+}
@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <isc/print.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/diff.h>
+#include <dns/fixedname.h>
+#include <dns/journal.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+
+#include "dnstest.h"
+
+#define JOURNAL		"journal_test.jnl"
+
+/*
+ * Helper functions
+ */
+
+static void
+addtuple(dns_diff_t *diff, dns_diffop_t op, const char *owner,
+	 dns_rdatatype_t type, const char *text)
+{
+	unsigned char buf[1024];
+	dns_fixedname_t fname;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_difftuple_t *tuple = NULL;
+	isc_result_t result;
+
+	dns_test_namefromstring(owner, &fname);
+	result = dns_test_rdata_fromstring(&rdata, dns_rdataclass_in, type,
+					   buf, sizeof(buf), text);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_difftuple_create(mctx, op, dns_fixedname_name(&fname),
+				      300, &rdata, &tuple);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_diff_append(diff, &tuple);
+}
+
+/*
+ * Append transactions 'first' to 'last' - 1 to the journal.  The
+ * transactions take the zone from serial 1 + 2 * first to 1 + 2 * last
+ * in steps of two, so that the even serial numbers are inside the
+ * journal's range but start no transaction.
+ */
+static void
+writejournal(unsigned int first, unsigned int last) {
+	dns_journal_t *j = NULL;
+	dns_diff_t diff;
+	isc_result_t result;
+	char soa[100], owner[100], addr[100];
+	unsigned int i;
+
+	result = dns_journal_open(mctx, JOURNAL, DNS_JOURNAL_CREATE, &j);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = first; i < last; i++) {
+		dns_diff_init(mctx, &diff);
+		snprintf(soa, sizeof(soa),
+			 "ns1.test. hostmaster.test. %u 3600 900 604800 300",
+			 1 + 2 * i);
+		addtuple(&diff, DNS_DIFFOP_DEL, "test.", dns_rdatatype_soa,
+			 soa);
+		snprintf(owner, sizeof(owner), "host%u.test.", i);
+		snprintf(addr, sizeof(addr), "10.0.%u.%u",
+			 (i >> 8) & 0xff, i & 0xff);
+		addtuple(&diff, DNS_DIFFOP_ADD, owner, dns_rdatatype_a, addr);
+		if (i > 0) {
+			snprintf(owner, sizeof(owner), "host%u.test.", i - 1);
+			snprintf(addr, sizeof(addr), "10.0.%u.%u",
+				 ((i - 1) >> 8) & 0xff, (i - 1) & 0xff);
+			addtuple(&diff, DNS_DIFFOP_DEL, owner,
+				 dns_rdatatype_a, addr);
+		}
+		snprintf(soa, sizeof(soa),
+			 "ns1.test. hostmaster.test. %u 3600 900 604800 300",
+			 3 + 2 * i);
+		addtuple(&diff, DNS_DIFFOP_ADD, "test.", dns_rdatatype_soa,
+			 soa);
+		result = dns_journal_write_transaction(j, &diff);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		dns_diff_clear(&diff);
+	}
+	dns_journal_destroy(&j);
+}
+
+static void
+makejournal(unsigned int count) {
+	(void)unlink(JOURNAL);
+	writejournal(0, count);
+}
+
+/*
+ * Check that the journal holds whole transactions from its first
+ * serial number up to 1 + 2 * 'last', and return its first serial.
+ */
+static isc_uint32_t
+checkjournal(unsigned int last) {
+	dns_journal_t *j = NULL;
+	isc_result_t result;
+	isc_uint32_t first;
+	unsigned int n = 0;
+
+	result = dns_journal_open(mctx, JOURNAL, DNS_JOURNAL_READ, &j);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	first = dns_journal_first_serial(j);
+	ATF_REQUIRE_EQ(dns_journal_last_serial(j), 1 + 2 * last);
+	ATF_REQUIRE_EQ(first % 2, 1);
+
+	result = dns_journal_iter_init(j, first, 1 + 2 * last);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	for (result = dns_journal_first_rr(j);
+	     result == ISC_R_SUCCESS;
+	     result = dns_journal_next_rr(j))
+		n++;
+	ATF_REQUIRE_EQ_MSG(result, ISC_R_NOMORE, "%u-%u: %s", first,
+			   1 + 2 * last, isc_result_totext(result));
+
+	/*
+	 * Every transaction but the first has two SOA records and
+	 * adds and deletes an address.
+	 */
+	ATF_REQUIRE_EQ(n, 4 * (last - first / 2) - (first == 1 ? 1 : 0));
+
+	dns_journal_destroy(&j);
+	return (first);
+}
+
+/*
+ * Check that iterating from 'begin' to 'end' gives the same result and
+ * the same RRs whether the journal is mapped or not.
+ */
+static void
+compare(isc_uint32_t begin, isc_uint32_t end, isc_result_t expect) {
+	dns_journal_t *jr = NULL, *jm = NULL;
+	isc_result_t rr, rm;
+	dns_name_t *nr, *nm;
+	isc_uint32_t ttlr, ttlm;
+	dns_rdata_t *rdr, *rdm;
+	unsigned int n = 0;
+
+	rr = dns_journal_open(mctx, JOURNAL, DNS_JOURNAL_READ, &jr);
+	ATF_REQUIRE_EQ(rr, ISC_R_SUCCESS);
+	rm = dns_journal_open(mctx, JOURNAL,
+			      DNS_JOURNAL_READ | DNS_JOURNAL_MAP, &jm);
+	ATF_REQUIRE_EQ(rm, ISC_R_SUCCESS);
+
+	rr = dns_journal_iter_init(jr, begin, end);
+	rm = dns_journal_iter_init(jm, begin, end);
+	ATF_CHECK_EQ_MSG(rr, expect, "%u-%u: %s", begin, end,
+			 isc_result_totext(rr));
+	ATF_CHECK_EQ_MSG(rm, expect, "%u-%u: %s", begin, end,
+			 isc_result_totext(rm));
+
+	if (rr == ISC_R_SUCCESS && rm == ISC_R_SUCCESS) {
+		for (rr = dns_journal_first_rr(jr),
+		     rm = dns_journal_first_rr(jm);
+		     rr == ISC_R_SUCCESS && rm == ISC_R_SUCCESS;
+		     rr = dns_journal_next_rr(jr),
+		     rm = dns_journal_next_rr(jm))
+		{
+			dns_journal_current_rr(jr, &nr, &ttlr, &rdr);
+			dns_journal_current_rr(jm, &nm, &ttlm, &rdm);
+			ATF_REQUIRE(dns_name_equal(nr, nm));
+			ATF_REQUIRE_EQ(ttlr, ttlm);
+			ATF_REQUIRE_EQ(dns_rdata_compare(rdr, rdm), 0);
+			n++;
+		}
+		ATF_CHECK_EQ(rr, ISC_R_NOMORE);
+		ATF_CHECK_EQ(rm, ISC_R_NOMORE);
+		ATF_CHECK(n > 0);
+	}
+
+	dns_journal_destroy(&jr);
+	dns_journal_destroy(&jm);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(map);
+ATF_TC_HEAD(map, tc) {
+	atf_tc_set_md_var(tc, "descr", "a mapped journal reads the same "
+			  "transactions as one read from the file");
+}
+ATF_TC_BODY(map, tc) {
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makejournal(300);
+
+	compare(1, 601, ISC_R_SUCCESS);
+	compare(1, 3, ISC_R_SUCCESS);
+	compare(599, 601, ISC_R_SUCCESS);
+	compare(101, 401, ISC_R_SUCCESS);
+	compare(233, 235, ISC_R_SUCCESS);
+
+	(void)unlink(JOURNAL);
+	dns_test_end();
+}
+
+ATF_TC(map_find);
+ATF_TC_HEAD(map_find, tc) {
+	atf_tc_set_md_var(tc, "descr", "a mapped journal reports serial "
+			  "numbers it does not hold like an unmapped one");
+}
+ATF_TC_BODY(map_find, tc) {
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makejournal(300);
+
+	compare(0, 601, ISC_R_RANGE);
+	compare(1, 603, ISC_R_RANGE);
+	compare(4, 601, ISC_R_NOTFOUND);
+	compare(1, 400, ISC_R_NOTFOUND);
+
+	(void)unlink(JOURNAL);
+	dns_test_end();
+}
+
+ATF_TC(compact);
+ATF_TC_HEAD(compact, tc) {
+	atf_tc_set_md_var(tc, "descr", "compact a journal in steps while "
+			  "transactions are committed to it");
+}
+ATF_TC_BODY(compact, tc) {
+	char name[] = JOURNAL;
+	dns_compactctx_t *cctx = NULL;
+	isc_result_t result;
+	isc_uint32_t first;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makejournal(300);
+
+	/*
+	 * Nothing to do when the journal is small enough.
+	 */
+	result = dns_journal_compactbegin(mctx, JOURNAL, 401, 1000000, &cctx);
+	ATF_REQUIRE_EQ(result, DNS_R_UNCHANGED);
+	ATF_REQUIRE_EQ(cctx, NULL);
+
+	result = dns_journal_compactbegin(mctx, JOURNAL, 1001, 8192, &cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_RANGE);
+	ATF_REQUIRE_EQ(cctx, NULL);
+
+	/*
+	 * Commit more transactions between the copy and the end.
+	 */
+	result = dns_journal_compactbegin(mctx, JOURNAL, 401, 8192, &cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_journal_compactcopy(cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	writejournal(300, 350);
+	result = dns_journal_compactend(&cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_REQUIRE_EQ(cctx, NULL);
+
+	first = checkjournal(350);
+	ATF_CHECK(first > 1);
+	ATF_CHECK(first <= 401);
+
+	/*
+	 * And with nothing committed in the meantime.
+	 */
+	writejournal(350, 600);
+	result = dns_journal_compact(mctx, name, 1001, 8192);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	first = checkjournal(600);
+	ATF_CHECK(first > 401);
+	ATF_CHECK(first <= 1001);
+
+	(void)unlink(JOURNAL);
+	dns_test_end();
+}
+
+ATF_TC(compact_replaced);
+ATF_TC_HEAD(compact_replaced, tc) {
+	atf_tc_set_md_var(tc, "descr", "a compaction is abandoned if the "
+			  "journal is replaced while it runs");
+}
+ATF_TC_BODY(compact_replaced, tc) {
+	dns_compactctx_t *cctx = NULL;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makejournal(300);
+	result = dns_journal_compactbegin(mctx, JOURNAL, 401, 8192, &cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_journal_compactcopy(cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/*
+	 * The zone was transferred in full and a new journal started.
+	 */
+	(void)unlink(JOURNAL);
+	writejournal(400, 410);
+
+	result = dns_journal_compactend(&cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_NOTFOUND);
+	ATF_REQUIRE_EQ(cctx, NULL);
+	ATF_REQUIRE_EQ(access("journal_test.jnw", F_OK), -1);
+	(void)checkjournal(410);
+
+	/*
+	 * Cancelling leaves the journal alone.
+	 */
+	makejournal(300);
+	result = dns_journal_compactbegin(mctx, JOURNAL, 401, 8192, &cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_journal_compactcopy(cctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_journal_compactcancel(&cctx);
+	ATF_REQUIRE_EQ(cctx, NULL);
+	ATF_REQUIRE_EQ(access("journal_test.jnw", F_OK), -1);
+	ATF_REQUIRE_EQ(checkjournal(300), 1);
+
+	(void)unlink(JOURNAL);
+	dns_test_end();
+}
+
+#ifdef DNS_BENCHMARK_TESTS
+ATF_TC(benchmark);
+ATF_TC_HEAD(benchmark, tc) {
+	atf_tc_set_md_var(tc, "descr", "Benchmark finding the start of an "
+			  "IXFR in a long journal, mapped and unmapped");
+}
+
+static void
+bench_find(const char *what, unsigned int mode, unsigned int count) {
+	dns_journal_t *j = NULL;
+	isc_time_t t0, t1;
+	isc_result_t result;
+	isc_uint32_t begin;
+	isc_uint64_t usecs;
+	unsigned int i, rounds = 2000;
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	result = dns_journal_open(mctx, JOURNAL, mode, &j);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	for (i = 0; i < rounds; i++) {
+		begin = 1 + 2 * ((i * 2654435761U) % count);
+		result = dns_journal_iter_init(j, begin, 1 + 2 * count);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+	dns_journal_destroy(&j);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+
+	usecs = isc_time_microdiff(&t1, &t0);
+	printf("%-8s %u transactions, %u lookups: %8.3fs\n", what, count,
+	       rounds, usecs / 1000000.0);
+}
+
+ATF_TC_BODY(benchmark, tc) {
+	isc_result_t result;
+	unsigned int count = 100000;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	makejournal(count);
+	bench_find("unmapped", DNS_JOURNAL_READ, count);
+	bench_find("mapped", DNS_JOURNAL_READ | DNS_JOURNAL_MAP, count);
+
+	(void)unlink(JOURNAL);
+	dns_test_end();
+}
+#endif /* DNS_BENCHMARK_TESTS */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, map);
+	ATF_TP_ADD_TC(tp, map_find);
+	ATF_TP_ADD_TC(tp, compact);
+	ATF_TP_ADD_TC(tp, compact_replaced);
+#ifdef DNS_BENCHMARK_TESTS
+	ATF_TP_ADD_TC(tp, benchmark);
+#endif
+
+	return (atf_no_error());
+}
@@ -654,6 +654,336 @@ ATF_TC_BODY(neworigin, tc) {
 	dns_test_end();
 }
 
+static unsigned int digest_count;
+static isc_uint32_t digest;
+
+static void
+digest_text(const char *text, size_t len) {
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		digest = (digest ^ (unsigned char)text[i]) * 16777619U;
+}
+
+static isc_result_t
+digest_add(void *arg, const dns_name_t *owner, dns_rdataset_t *dataset) {
+	char buf[BIGBUFLEN];
+	isc_buffer_t target;
+	isc_result_t result;
+
+	UNUSED(arg);
+
+	isc_buffer_init(&target, buf, BIGBUFLEN);
+	result = dns_rdataset_totext(dataset, owner, ISC_FALSE, ISC_FALSE,
+				     &target);
+	if (result == ISC_R_SUCCESS) {
+		digest_text(buf, isc_buffer_usedlength(&target));
+		digest_count++;
+	}
+	return (result);
+}
+
+static void
+digest_message(struct dns_rdatacallbacks *mycallbacks, const char *fmt, ...) {
+	char buf[4096];
+	va_list ap;
+
+	UNUSED(mycallbacks);
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	digest_text(buf, strlen(buf));
+}
+
+static void
+digest_include(const char *filename, void *arg) {
+	UNUSED(arg);
+	digest_text(filename, strlen(filename));
+}
+
+/*
+ * Write a large zone file that changes $ORIGIN and $TTL, delegates
+ * subdomains and uses constructs that could be mistaken for record
+ * boundaries along the way.  It includes "parallel.include", which is
+ * written too.
+ */
+static void
+write_parallel(const char *file, isc_boolean_t broken) {
+	FILE *f;
+	unsigned int i;
+
+	f = fopen("parallel.include", "w");
+	ATF_REQUIRE(f != NULL);
+	fprintf(f, "$TTL 1000\n"
+		   "secure1\t3600 IN DNSKEY (\n"
+		   "\t\tNOKEY|FLAG2|FLAG4|FLAG5|NTYP3|FLAG8|FLAG9|FLAG10|"
+		   "FLAG11|SIG15\n"
+		   "\t\t3 3 )\n"
+		   "secure2\t3600 in DNSKEY ( 256 3 3 ) ; )\n");
+	ATF_REQUIRE_EQ(fclose(f), 0);
+
+	f = fopen(file, "w");
+	ATF_REQUIRE(f != NULL);
+
+	fprintf(f, "$TTL 300\n"
+		   "@ IN SOA ns hostmaster ( 1 3600 600 ; (\n"
+		   "\t86400 300 )\n"
+		   "  IN NS ns\n"
+		   "ns IN A 10.0.0.1\n");
+	for (i = 0; i < 20000; i++) {
+		if (i % 5000 == 2500)
+			fprintf(f, "$ORIGIN sub%u.test.\n"
+				   "\tIN TXT \"inherited\"\n", i);
+		if (i % 7000 == 3500)
+			fprintf(f, "$TTL %u\n", i);
+		if (i == 12000)
+			fprintf(f, "$INCLUDE parallel.include "
+				   "include.test.\n");
+		if (i % 100 == 0)
+			fprintf(f, "deleg%u IN NS ns.deleg%u\n"
+				   "ns.deleg%u IN A 10.0.0.2\n", i, i, i);
+		if (broken && i == 15000)
+			fprintf(f, "bad IN A 10.0.0.256\n");
+		fprintf(f, "host%u IN A 10.%u.%u.1 ; (\n",
+			i, i / 256, i % 256);
+		fprintf(f, "\tIN TXT \"a ; b (\" \"%u\"\n", i);
+		fprintf(f, "host%u 60 IN MX ( 10\n\tmail%u ) ; )\n", i, i);
+		fprintf(f, "\\(escaped%u IN AAAA ::%x\n", i, i);
+	}
+	ATF_REQUIRE_EQ(fclose(f), 0);
+}
+
+static isc_result_t
+load_parallel(unsigned int threads, unsigned int *countp,
+	      isc_uint32_t *digestp)
+{
+	isc_result_t result;
+
+	result = setup_master(digest_message, digest_message);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	callbacks.add = digest_add;
+
+	digest_count = 0;
+	digest = 2166136261U;
+	result = dns_master_loadfile6("parallel.data", &dns_origin,
+				      &dns_origin, dns_rdataclass_in, 0, 0,
+				      &callbacks, digest_include, NULL,
+				      mctx, dns_masterformat_text, 0,
+				      threads);
+	*countp = digest_count;
+	*digestp = digest;
+	return (result);
+}
+
+/* Parallel load test */
+ATF_TC(parallel);
+ATF_TC_HEAD(parallel, tc) {
+	atf_tc_set_md_var(tc, "descr", "dns_master_loadfile6() produces "
+				       "the same data and messages with "
+				       "several threads as with one");
+}
+ATF_TC_BODY(parallel, tc) {
+	isc_result_t result, presult;
+	unsigned int count, pcount;
+	isc_uint32_t sum, psum;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	write_parallel("parallel.data", ISC_FALSE);
+	result = load_parallel(1, &count, &sum);
+	ATF_CHECK_EQ(result, DNS_R_SEENINCLUDE);
+	ATF_CHECK(count > 80000);
+	presult = load_parallel(4, &pcount, &psum);
+	ATF_CHECK_EQ(presult, result);
+	ATF_CHECK_EQ(pcount, count);
+	ATF_CHECK_EQ(psum, sum);
+
+	/* A fatal error stops both at the same record. */
+	write_parallel("parallel.data", ISC_TRUE);
+	result = load_parallel(1, &count, &sum);
+	ATF_CHECK_EQ(result, DNS_R_BADDOTTEDQUAD);
+	presult = load_parallel(4, &pcount, &psum);
+	ATF_CHECK_EQ(presult, result);
+	ATF_CHECK_EQ(pcount, count);
+	ATF_CHECK_EQ(psum, sum);
+
+	unlink("parallel.data");
+	unlink("parallel.include");
+	dns_test_end();
+}
+
+static isc_result_t
+dump_parallel(dns_db_t *db, dns_dbversion_t *version, unsigned int threads,
+	      const char *file)
+{
+	isc_result_t result;
+	FILE *f;
+
+	f = fopen(file, "w");
+	ATF_REQUIRE(f != NULL);
+	result = dns_master_dumptostream4(mctx, db, version,
+					  &dns_master_style_default,
+					  dns_masterformat_raw, NULL, f,
+					  threads);
+	ATF_REQUIRE_EQ(fclose(f), 0);
+	return (result);
+}
+
+/*
+ * Compare two raw files, except for the time of the dump in their
+ * headers: the dumps may not have been made in the same second.
+ */
+static isc_boolean_t
+same_raw(const char *file1, const char *file2) {
+	FILE *f1, *f2;
+	int c1, c2;
+	long offset = 0;
+
+	f1 = fopen(file1, "r");
+	ATF_REQUIRE(f1 != NULL);
+	f2 = fopen(file2, "r");
+	ATF_REQUIRE(f2 != NULL);
+	do {
+		c1 = fgetc(f1);
+		c2 = fgetc(f2);
+		if (offset >= 8 && offset < 12)		/* dumptime */
+			c2 = c1;
+		offset++;
+	} while (c1 == c2 && c1 != EOF);
+	fclose(f1);
+	fclose(f2);
+	return (ISC_TF(c1 == c2));
+}
+
+/* Parallel raw dump test */
+ATF_TC(dumpparallel);
+ATF_TC_HEAD(dumpparallel, tc) {
+	atf_tc_set_md_var(tc, "descr", "dns_master_dumptostream4() writes "
+				       "the same raw file with several "
+				       "threads as with one");
+}
+ATF_TC_BODY(dumpparallel, tc) {
+	isc_result_t result;
+	dns_db_t *db = NULL;
+	dns_dbversion_t *version = NULL;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = setup_master(NULL, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	write_parallel("parallel.data", ISC_FALSE);
+	result = dns_db_create(mctx, "rbt", &dns_origin, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_load(db, "parallel.data");
+	ATF_REQUIRE_EQ(result, DNS_R_SEENINCLUDE);
+	dns_db_currentversion(db, &version);
+
+	result = dump_parallel(db, version, 1, "parallel.raw1");
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	result = dump_parallel(db, version, 4, "parallel.raw4");
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(same_raw("parallel.raw1", "parallel.raw4"));
+
+	/* The parallel dump is a valid raw file. */
+	result = test_master("parallel.raw4", dns_masterformat_raw,
+			     NULL, NULL);
+	ATF_CHECK_STREQ(isc_result_totext(result), "success");
+
+	unlink("parallel.data");
+	unlink("parallel.include");
+	unlink("parallel.raw1");
+	unlink("parallel.raw4");
+	dns_db_closeversion(db, &version, ISC_FALSE);
+	dns_db_detach(&db);
+	dns_test_end();
+}
+
+static isc_result_t
+load_paralleldb(unsigned int threads, dns_db_t **dbp) {
+	isc_result_t result, eresult;
+	dns_rdatacallbacks_t dbcallbacks;
+
+	result = dns_db_create(mctx, "rbt", &dns_origin, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, dbp);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_rdatacallbacks_init(&dbcallbacks);
+	result = dns_db_beginload(*dbp, &dbcallbacks);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_master_loadfile6("parallel.data", &dns_origin,
+				      &dns_origin, dns_rdataclass_in, 0, 0,
+				      &dbcallbacks, NULL, NULL, mctx,
+				      dns_masterformat_text, 0, threads);
+	eresult = dns_db_endload(*dbp, &dbcallbacks);
+	if (result == ISC_R_SUCCESS || result == DNS_R_SEENINCLUDE)
+		ATF_CHECK_EQ(eresult, ISC_R_SUCCESS);
+	return (result);
+}
+
+/* Parallel database load test */
+ATF_TC(paralleldb);
+ATF_TC_HEAD(paralleldb, tc) {
+	atf_tc_set_md_var(tc, "descr", "dns_master_loadfile6() builds the "
+				       "same database with several threads "
+				       "as with one");
+}
+ATF_TC_BODY(paralleldb, tc) {
+	isc_result_t result;
+	dns_db_t *db1 = NULL, *db4 = NULL;
+	dns_dbversion_t *version = NULL;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = setup_master(NULL, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	write_parallel("parallel.data", ISC_FALSE);
+	result = load_paralleldb(1, &db1);
+	ATF_CHECK_EQ(result, DNS_R_SEENINCLUDE);
+	result = load_paralleldb(4, &db4);
+	ATF_CHECK_EQ(result, DNS_R_SEENINCLUDE);
+
+	dns_db_currentversion(db1, &version);
+	result = dump_parallel(db1, version, 1, "parallel.raw1");
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db1, &version, ISC_FALSE);
+	dns_db_currentversion(db4, &version);
+	result = dump_parallel(db4, version, 1, "parallel.raw4");
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db4, &version, ISC_FALSE);
+	ATF_CHECK(same_raw("parallel.raw1", "parallel.raw4"));
+	dns_db_detach(&db1);
+	dns_db_detach(&db4);
+
+	/*
+	 * A fatal error stops the load; rdatasets that were prepared
+	 * but not yet added are released.
+	 */
+	write_parallel("parallel.data", ISC_TRUE);
+	result = load_paralleldb(4, &db4);
+	ATF_CHECK_EQ(result, DNS_R_BADDOTTEDQUAD);
+	dns_db_detach(&db4);
+
+	unlink("parallel.data");
+	unlink("parallel.include");
+	unlink("parallel.raw1");
+	unlink("parallel.raw4");
+	dns_test_end();
+}
+
 /*
  * Main
  */
@@ -676,6 +1006,9 @@ ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, toobig);
 	ATF_TP_ADD_TC(tp, maxrdata);
 	ATF_TP_ADD_TC(tp, neworigin);
+	ATF_TP_ADD_TC(tp, parallel);
+	ATF_TP_ADD_TC(tp, dumpparallel);
+	ATF_TP_ADD_TC(tp, paralleldb);
 
 	return (atf_no_error());
 }
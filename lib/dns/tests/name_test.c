@@ -25,6 +25,7 @@
 #include <isc/os.h>
 #include <isc/print.h>
 #include <isc/thread.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
 #include <dns/compress.h>
@@ -473,6 +474,222 @@ ATF_TC_BODY(hash, tc) {
 	}
 }
 
+/*
+ * The name primitives fold case several octets at a time; check them
+ * against octet by octet versions on names made of the octets around
+ * the edges of the upper and lower case ranges.
+ */
+
+static unsigned char refmaptolower[256];
+
+static void
+ref_init(void) {
+	unsigned int c;
+
+	for (c = 0; c < 256; c++)
+		refmaptolower[c] = (c >= 'A' && c <= 'Z') ? c + 0x20 : c;
+}
+
+static isc_boolean_t
+ref_equal(const dns_name_t *name1, const dns_name_t *name2) {
+	unsigned int i;
+
+	if (name1->length != name2->length || name1->labels != name2->labels)
+		return (ISC_FALSE);
+	for (i = 0; i < name1->length; i++)
+		if (refmaptolower[name1->ndata[i]] !=
+		    refmaptolower[name2->ndata[i]])
+			return (ISC_FALSE);
+	return (ISC_TRUE);
+}
+
+static int
+ref_compare(const dns_name_t *name1, const dns_name_t *name2) {
+	dns_label_t l1, l2;
+	unsigned int n1, n2, i, count;
+	int diff;
+
+	n1 = dns_name_countlabels(name1);
+	n2 = dns_name_countlabels(name2);
+	while (n1 > 0 && n2 > 0) {
+		dns_name_getlabel(name1, --n1, &l1);
+		dns_name_getlabel(name2, --n2, &l2);
+		count = ISC_MIN(l1.length, l2.length);
+		for (i = 1; i < count; i++) {
+			diff = (int)refmaptolower[l1.base[i]] -
+			       (int)refmaptolower[l2.base[i]];
+			if (diff != 0)
+				return (diff);
+		}
+		if (l1.length != l2.length)
+			return ((int)l1.length - (int)l2.length);
+	}
+	return ((int)n1 - (int)n2);
+}
+
+static isc_uint32_t lcg = 1;
+
+static unsigned int
+next_random(unsigned int n) {
+	lcg = lcg * 1103515245 + 12345;
+	return ((lcg >> 16) % n);
+}
+
+static void
+random_wire(unsigned char *wire, unsigned int *lenp) {
+	static const unsigned char octets[] = {
+		0x00, '-', '0', '9', '@', 'A', 'B', 'M', 'Y', 'Z', '[',
+		'`', 'a', 'b', 'm', 'y', 'z', '{', 0x7f, 0x80, 0xc0, 0xc1,
+		0xda, 0xdb, 0xe1, 0xfa, 0xff
+	};
+	unsigned int labels, i, j, len, n = 0;
+
+	labels = next_random(5);
+	for (i = 0; i < labels; i++) {
+		len = 1 + next_random(next_random(4) == 0 ? 63 : 12);
+		if (n + len + 2 > DNS_NAME_MAXWIRE)
+			break;
+		wire[n++] = len;
+		for (j = 0; j < len; j++)
+			wire[n++] = octets[next_random(sizeof(octets))];
+	}
+	wire[n++] = 0;
+	*lenp = n;
+}
+
+static void
+mutate_wire(unsigned char *wire, unsigned int len) {
+	unsigned int i, pos;
+
+	switch (next_random(4)) {
+	case 0:
+		/* Flip the case of some octets. */
+		for (i = 0; i < len; i++)
+			if (next_random(2) == 0 &&
+			    refmaptolower[wire[i]] != wire[i])
+				wire[i] = refmaptolower[wire[i]];
+			else if (next_random(2) == 0 &&
+				 wire[i] >= 'a' && wire[i] <= 'z')
+				wire[i] -= 0x20;
+		break;
+	case 1:
+		/* Change one octet in a label. */
+		pos = 0;
+		while (pos + 1 < len && wire[pos] != 0) {
+			if (next_random(3) == 0) {
+				wire[pos + 1 + next_random(wire[pos])] ^=
+					1 << next_random(8);
+				break;
+			}
+			pos += wire[pos] + 1;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+ATF_TC(caseless);
+ATF_TC_HEAD(caseless, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "case-insensitive name comparison and folding");
+}
+ATF_TC_BODY(caseless, tc) {
+	unsigned char wire1[DNS_NAME_MAXWIRE], wire2[DNS_NAME_MAXWIRE];
+	unsigned char out[DNS_NAME_MAXWIRE], copy[DNS_NAME_MAXWIRE];
+	unsigned int len1, len2, i, j, nlabels;
+	dns_name_t name1, name2, name3;
+	dns_decompress_t dctx;
+	isc_buffer_t source, target;
+	isc_region_t r;
+	isc_result_t result;
+	int order, reforder;
+
+	UNUSED(tc);
+
+	ref_init();
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_STRICT);
+	dns_decompress_setmethods(&dctx, DNS_COMPRESS_NONE);
+
+	for (i = 0; i < 20000; i++) {
+		random_wire(wire1, &len1);
+		if (next_random(4) == 0) {
+			random_wire(wire2, &len2);
+		} else {
+			memmove(wire2, wire1, len1);
+			len2 = len1;
+			mutate_wire(wire2, len2);
+		}
+
+		dns_name_init(&name1, NULL);
+		r.base = wire1;
+		r.length = len1;
+		dns_name_fromregion(&name1, &r);
+		dns_name_init(&name2, NULL);
+		r.base = wire2;
+		r.length = len2;
+		dns_name_fromregion(&name2, &r);
+
+		ATF_CHECK_EQ(dns_name_equal(&name1, &name2),
+			     ref_equal(&name1, &name2));
+		(void)dns_name_fullcompare(&name1, &name2, &order, &nlabels);
+		reforder = ref_compare(&name1, &name2);
+		ATF_CHECK_MSG((order < 0 && reforder < 0) ||
+			      (order == 0 && reforder == 0) ||
+			      (order > 0 && reforder > 0),
+			      "order %d, expected %d", order, reforder);
+
+		/* Downcase into a buffer and in place. */
+		dns_name_init(&name3, NULL);
+		isc_buffer_init(&target, out, sizeof(out));
+		result = dns_name_downcase(&name2, &name3, &target);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(name3.length, len2);
+		for (j = 0; j < len2; j++)
+			ATF_CHECK_EQ(out[j], refmaptolower[wire2[j]]);
+		ATF_CHECK(dns_name_equal(&name2, &name3));
+		memmove(copy, wire2, len2);
+		result = dns_name_downcase(&name2, &name2, NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK(memcmp(out, wire2, len2) == 0);
+		memmove(wire2, copy, len2);
+
+		/* Read the wire form back, with and without downcasing. */
+		isc_buffer_init(&source, wire2, len2);
+		isc_buffer_add(&source, len2);
+		isc_buffer_setactive(&source, len2);
+		isc_buffer_init(&target, out, sizeof(out));
+		dns_name_init(&name3, NULL);
+		result = dns_name_fromwire(&name3, &source, &dctx, 0, &target);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(name3.length, len2);
+		ATF_CHECK(memcmp(out, wire2, len2) == 0);
+
+		isc_buffer_init(&source, wire2, len2);
+		isc_buffer_add(&source, len2);
+		isc_buffer_setactive(&source, len2);
+		isc_buffer_init(&target, out, sizeof(out));
+		dns_name_init(&name3, NULL);
+		result = dns_name_fromwire(&name3, &source, &dctx,
+					   DNS_NAME_DOWNCASE, &target);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		for (j = 0; j < len2; j++)
+			ATF_CHECK_EQ(out[j], refmaptolower[wire2[j]]);
+
+		/* A name cut short anywhere is an error. */
+		if (len2 > 1) {
+			isc_buffer_init(&source, wire2, len2);
+			isc_buffer_add(&source, len2 - 1);
+			isc_buffer_setactive(&source, len2 - 1);
+			isc_buffer_init(&target, out, sizeof(out));
+			dns_name_init(&name3, NULL);
+			result = dns_name_fromwire(&name3, &source, &dctx, 0,
+						   &target);
+			ATF_CHECK_EQ(result, ISC_R_UNEXPECTEDEND);
+		}
+	}
+}
+
 ATF_TC(issubdomain);
 ATF_TC_HEAD(issubdomain, tc) {
 	atf_tc_set_md_var(tc, "descr", "dns_nane_issubdomain");
@@ -756,6 +973,158 @@ ATF_TC_BODY(benchmark, tc) {
 #endif /* DNS_BENCHMARK_TESTS */
 #endif /* ISC_PLATFORM_USETHREADS */
 
+#ifdef DNS_BENCHMARK_TESTS
+ATF_TC(casebenchmark);
+ATF_TC_HEAD(casebenchmark, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "Benchmark the case-insensitive name primitives "
+			  "against octet by octet versions");
+}
+
+#define CASEBENCH_NAMES		1024
+#define CASEBENCH_ROUNDS	2000
+
+static void
+casebench_report(const char *what, isc_time_t *t0, isc_time_t *t1,
+		 isc_time_t *t2)
+{
+	isc_uint64_t ref = isc_time_microdiff(t1, t0);
+	isc_uint64_t cur = isc_time_microdiff(t2, t1);
+	double calls = (double)CASEBENCH_NAMES * CASEBENCH_ROUNDS;
+
+	printf("%-12s octets %6.1f ns/call, words %6.1f ns/call, "
+	       "speedup %.2f\n", what, ref * 1000.0 / calls,
+	       cur * 1000.0 / calls, (double)ref / (cur != 0 ? cur : 1));
+}
+
+ATF_TC_BODY(casebenchmark, tc) {
+	static unsigned char wire[CASEBENCH_NAMES][2][DNS_NAME_MAXWIRE];
+	static dns_name_t names[CASEBENCH_NAMES][2];
+	unsigned char out[DNS_NAME_MAXWIRE];
+	unsigned int i, j, k, len, nlabels, sink = 0;
+	dns_decompress_t dctx;
+	isc_buffer_t source, target;
+	isc_time_t t0, t1, t2;
+	isc_region_t r;
+	dns_name_t name;
+	int order;
+
+	UNUSED(tc);
+
+	ref_init();
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_STRICT);
+	dns_decompress_setmethods(&dctx, DNS_COMPRESS_NONE);
+
+	/*
+	 * Pairs of names that are equal except for case, which is the
+	 * common case for lookups and the slowest one to compare.
+	 */
+	for (i = 0; i < CASEBENCH_NAMES; i++) {
+		random_wire(wire[i][0], &len);
+		memmove(wire[i][1], wire[i][0], len);
+		for (j = 0; j < len; j++)
+			if (wire[i][1][j] >= 'a' && wire[i][1][j] <= 'z')
+				wire[i][1][j] -= 0x20;
+		for (k = 0; k < 2; k++) {
+			dns_name_init(&names[i][k], NULL);
+			r.base = wire[i][k];
+			r.length = len;
+			dns_name_fromregion(&names[i][k], &r);
+		}
+	}
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++)
+			sink += ref_equal(&names[i][0], &names[i][1]);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++)
+			sink += dns_name_equal(&names[i][0], &names[i][1]);
+	RUNTIME_CHECK(isc_time_now(&t2) == ISC_R_SUCCESS);
+	casebench_report("equal", &t0, &t1, &t2);
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++)
+			sink += ref_compare(&names[i][0], &names[i][1]);
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++) {
+			(void)dns_name_fullcompare(&names[i][0],
+						   &names[i][1],
+						   &order, &nlabels);
+			sink += order;
+		}
+	RUNTIME_CHECK(isc_time_now(&t2) == ISC_R_SUCCESS);
+	casebench_report("fullcompare", &t0, &t1, &t2);
+
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++) {
+			for (j = 0; j < names[i][1].length; j++)
+				out[j] = refmaptolower[names[i][1].ndata[j]];
+			sink += out[0];
+		}
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++) {
+			dns_name_init(&name, NULL);
+			isc_buffer_init(&target, out, sizeof(out));
+			(void)dns_name_downcase(&names[i][1], &name, &target);
+			sink += out[0];
+		}
+	RUNTIME_CHECK(isc_time_now(&t2) == ISC_R_SUCCESS);
+	casebench_report("downcase", &t0, &t1, &t2);
+
+	/*
+	 * dns_name_fromwire() is too involved to keep an octet by octet
+	 * copy of here; compare its time with that of an older build.
+	 */
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++) {
+			len = names[i][1].length;
+			isc_buffer_init(&source, names[i][1].ndata, len);
+			isc_buffer_add(&source, len);
+			isc_buffer_setactive(&source, len);
+			isc_buffer_init(&target, out, sizeof(out));
+			dns_name_init(&name, NULL);
+			(void)dns_name_fromwire(&name, &source, &dctx,
+						DNS_NAME_DOWNCASE, &target);
+			sink += out[0];
+		}
+	RUNTIME_CHECK(isc_time_now(&t2) == ISC_R_SUCCESS);
+	printf("%-12s %6.1f ns/call\n", "fromwire",
+	       isc_time_microdiff(&t2, &t1) * 1000.0 /
+	       ((double)CASEBENCH_NAMES * CASEBENCH_ROUNDS));
+
+	/*
+	 * FNV-1a takes one octet at a time whatever the case folding
+	 * costs, so this mostly shows the cost of the hash itself.
+	 */
+	RUNTIME_CHECK(isc_time_now(&t0) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++) {
+			isc_uint32_t h = 2166136261U;
+
+			for (j = 0; j < names[i][1].length; j++) {
+				h ^= refmaptolower[names[i][1].ndata[j]];
+				h *= 16777619;
+			}
+			sink += h;
+		}
+	RUNTIME_CHECK(isc_time_now(&t1) == ISC_R_SUCCESS);
+	for (k = 0; k < CASEBENCH_ROUNDS; k++)
+		for (i = 0; i < CASEBENCH_NAMES; i++)
+			sink += dns_name_fullhash(&names[i][1], ISC_FALSE);
+	RUNTIME_CHECK(isc_time_now(&t2) == ISC_R_SUCCESS);
+	casebench_report("hash", &t0, &t1, &t2);
+
+	printf("(%u)\n", sink);
+}
+#endif /* DNS_BENCHMARK_TESTS */
+
 /*
  * Main
  */
@@ -768,6 +1137,7 @@ ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, buffer);
 	ATF_TP_ADD_TC(tp, isabsolute);
 	ATF_TP_ADD_TC(tp, hash);
+	ATF_TP_ADD_TC(tp, caseless);
 	ATF_TP_ADD_TC(tp, issubdomain);
 	ATF_TP_ADD_TC(tp, countlabels);
 	ATF_TP_ADD_TC(tp, getlabel);
@@ -777,6 +1147,9 @@ ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, benchmark);
 #endif /* DNS_BENCHMARK_TESTS */
 #endif /* ISC_PLATFORM_USETHREADS */
+#ifdef DNS_BENCHMARK_TESTS
+	ATF_TP_ADD_TC(tp, casebenchmark);
+#endif /* DNS_BENCHMARK_TESTS */
 
 	return (atf_no_error());
 }
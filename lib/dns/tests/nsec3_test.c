@@ -17,10 +17,19 @@
 
 #include <atf-c.h>
 
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <isc/stdtime.h>
+#include <isc/util.h>
+
 #include <dns/db.h>
+#include <dns/fixedname.h>
 #include <dns/nsec3.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/rdatastruct.h>
 
 #include "dnstest.h"
 
@@ -122,6 +131,193 @@ nsec3param_salttotext_test(const nsec3param_salttotext_test_params_t *params) {
 			 isc_result_totext(result));
 }
 
+
+/*
+ * A small NSEC3 signed zone "example." held in a cache database.
+ */
+#define PROOF_NAMES	5
+
+typedef struct {
+	dns_fixedname_t	owner;
+	unsigned char	hash[NSEC3_MAX_HASH_LENGTH];
+	size_t		length;
+	isc_boolean_t	apex;
+} proofentry_t;
+
+static unsigned char proofsalt[] = { 0xaa, 0xbb, 0xcc, 0xdd };
+
+static int
+proofentrycmp(const void *a, const void *b) {
+	const proofentry_t *ea = a, *eb = b;
+
+	return (memcmp(ea->hash, eb->hash, ea->length));
+}
+
+static void
+addproofrdata(dns_db_t *db, const dns_name_t *owner, dns_rdata_t *rdata,
+	      isc_stdtime_t now)
+{
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	isc_result_t result;
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = rdata->type;
+	if (rdata->type == dns_rdatatype_rrsig)
+		rdatalist.covers = dns_rdatatype_nsec3;
+	rdatalist.ttl = 300;
+	ISC_LIST_APPEND(rdatalist.rdata, rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	rdataset.trust = dns_trust_secure;
+
+	result = dns_db_findnode(db, owner, ISC_TRUE, &node);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_addrdataset(db, node, NULL, now, &rdataset, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_db_detachnode(db, &node);
+	dns_rdataset_disassociate(&rdataset);
+}
+
+/*
+ * Fill a cache with the complete NSEC3 chain of "example.", which has
+ * A records at a, b, c and d.  The signatures are not validated by
+ * dns_nsec3_findproof() so a dummy one is enough.
+ */
+static void
+makeproofcache(dns_db_t **dbp, dns_name_t *zone, isc_boolean_t optout,
+	       isc_stdtime_t now)
+{
+	/* Window 0: A NS SOA | RRSIG | DNSKEY NSEC3PARAM */
+	static unsigned char apexbits[] = {
+		0, 7, 0x62, 0, 0, 0, 0, 0x02, 0x90
+	};
+	static unsigned char namebits[] = { 0, 6, 0x40, 0, 0, 0, 0, 0x02 };
+	static const char *names[PROOF_NAMES] = {
+		"example.", "a.example.", "b.example.", "c.example.",
+		"d.example."
+	};
+	proofentry_t entries[PROOF_NAMES];
+	dns_fixedname_t fname;
+	isc_result_t result;
+	unsigned int i;
+
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_cache,
+			       dns_rdataclass_in, 0, NULL, dbp);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < PROOF_NAMES; i++) {
+		dns_test_namefromstring(names[i], &fname);
+		dns_fixedname_init(&entries[i].owner);
+		result = dns_nsec3_hashname(&entries[i].owner,
+					    entries[i].hash,
+					    &entries[i].length,
+					    dns_fixedname_name(&fname), zone,
+					    dns_hash_sha1, 10, proofsalt,
+					    sizeof(proofsalt));
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		entries[i].apex = ISC_TF(i == 0);
+	}
+	qsort(entries, PROOF_NAMES, sizeof(entries[0]), proofentrycmp);
+
+	for (i = 0; i < PROOF_NAMES; i++) {
+		unsigned char buf[DNS_NSEC3_BUFFERSIZE], sigbuf[512], sig[64];
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+		dns_rdata_t sigrdata = DNS_RDATA_INIT;
+		dns_rdata_nsec3_t nsec3;
+		dns_rdata_rrsig_t rrsig;
+		isc_buffer_t b;
+
+		nsec3.common.rdclass = dns_rdataclass_in;
+		nsec3.common.rdtype = dns_rdatatype_nsec3;
+		ISC_LINK_INIT(&nsec3.common, link);
+		nsec3.mctx = NULL;
+		nsec3.hash = dns_hash_sha1;
+		nsec3.flags = optout ? DNS_NSEC3FLAG_OPTOUT : 0;
+		nsec3.iterations = 10;
+		nsec3.salt_length = sizeof(proofsalt);
+		nsec3.salt = proofsalt;
+		nsec3.next_length = (unsigned char)entries[i].length;
+		nsec3.next = entries[(i + 1) % PROOF_NAMES].hash;
+		nsec3.typebits = entries[i].apex ? apexbits : namebits;
+		nsec3.len = entries[i].apex ? sizeof(apexbits)
+					    : sizeof(namebits);
+		isc_buffer_init(&b, buf, sizeof(buf));
+		result = dns_rdata_fromstruct(&rdata, dns_rdataclass_in,
+					      dns_rdatatype_nsec3, &nsec3, &b);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		memset(sig, 0x5a, sizeof(sig));
+		rrsig.common.rdclass = dns_rdataclass_in;
+		rrsig.common.rdtype = dns_rdatatype_rrsig;
+		ISC_LINK_INIT(&rrsig.common, link);
+		rrsig.mctx = NULL;
+		rrsig.covered = dns_rdatatype_nsec3;
+		rrsig.algorithm = 8;
+		rrsig.labels = dns_name_countlabels(zone);
+		rrsig.originalttl = 300;
+		rrsig.timesigned = now;
+		rrsig.timeexpire = now + 86400;
+		rrsig.keyid = 12345;
+		dns_name_init(&rrsig.signer, NULL);
+		dns_name_clone(zone, &rrsig.signer);
+		rrsig.siglen = sizeof(sig);
+		rrsig.signature = sig;
+		isc_buffer_init(&b, sigbuf, sizeof(sigbuf));
+		result = dns_rdata_fromstruct(&sigrdata, dns_rdataclass_in,
+					      dns_rdatatype_rrsig, &rrsig, &b);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		addproofrdata(*dbp, dns_fixedname_name(&entries[i].owner),
+			      &rdata, now);
+		addproofrdata(*dbp, dns_fixedname_name(&entries[i].owner),
+			      &sigrdata, now);
+	}
+}
+
+static void
+nolog(void *arg, int level, const char *fmt, ...) {
+	UNUSED(arg);
+	UNUSED(level);
+	UNUSED(fmt);
+}
+
+static isc_result_t
+findproof(dns_db_t *db, dns_name_t *zone, const char *namestr,
+	  dns_rdatatype_t type, isc_stdtime_t now, isc_boolean_t *existsp)
+{
+	dns_nsec3proof_t proof;
+	dns_fixedname_t fname;
+	isc_result_t result;
+	unsigned int i;
+
+	dns_test_namefromstring(namestr, &fname);
+	dns_nsec3proof_init(&proof);
+	result = dns_nsec3_findproof(db, zone, dns_fixedname_name(&fname),
+				     type, now, &proof, nolog, NULL);
+	if (result == ISC_R_SUCCESS) {
+		*existsp = proof.exists;
+		ATF_CHECK(dns_rdataset_isassociated(
+			      &proof.rdatasets[DNS_NSEC3PROOF_CLOSEST]));
+		for (i = DNS_NSEC3PROOF_NEXTCLOSER; i < DNS_NSEC3PROOF_MAX;
+		     i++)
+		{
+			ATF_CHECK_EQ(dns_rdataset_isassociated(
+					     &proof.rdatasets[i]),
+				     !proof.exists);
+			ATF_CHECK_EQ(dns_rdataset_isassociated(
+					     &proof.sigrdatasets[i]),
+				     !proof.exists);
+		}
+	}
+	dns_nsec3proof_invalidate(&proof);
+	return (result);
+}
+
 /*
  * Individual unit tests
  */
@@ -181,6 +377,75 @@ ATF_TC_BODY(nsec3param_salttotext, tc) {
 
 	dns_test_end();
 }
+ATF_TC(findproof);
+ATF_TC_HEAD(findproof, tc) {
+	atf_tc_set_md_var(tc, "descr", "check dns_nsec3_findproof()");
+}
+ATF_TC_BODY(findproof, tc) {
+	dns_fixedname_t fzone;
+	dns_name_t *zone;
+	dns_db_t *db = NULL;
+	isc_boolean_t exists = ISC_FALSE;
+	isc_stdtime_t now;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_stdtime_get(&now);
+	dns_test_namefromstring("example.", &fzone);
+	zone = dns_fixedname_name(&fzone);
+
+	/* Nothing cached: no proof. */
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_cache,
+			       dns_rdataclass_in, 0, NULL, &db);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = findproof(db, zone, "x.example.", dns_rdatatype_a, now,
+			   &exists);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+	dns_db_detach(&db);
+
+	makeproofcache(&db, zone, ISC_FALSE, now);
+
+	/* NXDOMAIN, directly below the apex and further down. */
+	result = findproof(db, zone, "x.example.", dns_rdatatype_a, now,
+			   &exists);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(!exists);
+	result = findproof(db, zone, "x.y.a.example.", dns_rdatatype_a, now,
+			   &exists);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(!exists);
+
+	/* NODATA. */
+	result = findproof(db, zone, "a.example.", dns_rdatatype_txt, now,
+			   &exists);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(exists);
+
+	/* The type exists: no negative proof. */
+	result = findproof(db, zone, "a.example.", dns_rdatatype_a, now,
+			   &exists);
+	ATF_CHECK(result != ISC_R_SUCCESS);
+
+	/* Records which have expired are not used. */
+	result = findproof(db, zone, "x.example.", dns_rdatatype_a,
+			   now + 3600, &exists);
+	ATF_CHECK(result != ISC_R_SUCCESS);
+
+	dns_db_detach(&db);
+
+	/* Opt-out coverage does not prove nonexistence. */
+	makeproofcache(&db, zone, ISC_TRUE, now);
+	result = findproof(db, zone, "x.example.", dns_rdatatype_a, now,
+			   &exists);
+	ATF_CHECK(result != ISC_R_SUCCESS);
+	dns_db_detach(&db);
+
+	dns_test_end();
+}
 #else
 ATF_TC(untested);
 ATF_TC_HEAD(untested, tc) {
@@ -197,6 +462,7 @@ ATF_TC_BODY(untested, tc) {
  */
 ATF_TP_ADD_TCS(tp) {
 #if defined(OPENSSL) || defined(PKCS11CRYPTO)
+	ATF_TP_ADD_TC(tp, findproof);
 	ATF_TP_ADD_TC(tp, max_iterations);
 	ATF_TP_ADD_TC(tp, nsec3param_salttotext);
 #else
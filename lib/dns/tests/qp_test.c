@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <isc/print.h>
+#include <isc/string.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/qp.h>
+
+#include "dnstest.h"
+
+static const char *names[] = {
+	"example.", "a.example.", "yljkjljk.a.example.", "Z.a.example.",
+	"zABC.a.EXAMPLE.", "z.example.", "\\001.z.example.", "*.z.example.",
+	"\\200.z.example.", "b.example.", "b-c.example.", "b_c.example.",
+	"b.c.example.", "bc.example.", "\\@.example.", "\\091.example.",
+	"\\~.example.", "\\255\\255.example.", "\\000.example.",
+	"example.com.", "www.example.com.", "org.", "."
+};
+#define NNAMES (sizeof(names) / sizeof(names[0]))
+
+static dns_fixedname_t fnames[NNAMES];
+
+static unsigned int
+makekey(dns_qpkey_t key, void *ctx, void *value) {
+	UNUSED(ctx);
+	return (dns_qpkey_fromname(key, value));
+}
+
+static unsigned int destroyed;
+
+static void
+destroy(void *ctx, void *value) {
+	UNUSED(ctx);
+	UNUSED(value);
+	destroyed++;
+}
+
+static dns_qpmethods_t methods = { makekey, destroy };
+
+static int
+compare(const void *a, const void *b) {
+	return (dns_name_compare(*(dns_name_t * const *)a,
+				 *(dns_name_t * const *)b));
+}
+
+static dns_qp_t *
+maketrie(void) {
+	dns_qp_t *qp = NULL;
+	unsigned int i;
+
+	ATF_REQUIRE_EQ(dns_qp_create(mctx, &methods, NULL, &qp),
+		       ISC_R_SUCCESS);
+	for (i = 0; i < NNAMES; i++) {
+		dns_test_namefromstring(names[i], &fnames[i]);
+		ATF_REQUIRE_EQ(dns_qp_insert(qp, dns_fixedname_name(&fnames[i])),
+			       ISC_R_SUCCESS);
+	}
+	return (qp);
+}
+
+static dns_name_t *
+makename(const char *str, dns_fixedname_t *fn) {
+	dns_test_namefromstring(str, fn);
+	return (dns_fixedname_name(fn));
+}
+
+/*
+ * Individual unit tests
+ */
+ATF_TC(order);
+ATF_TC_HEAD(order, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "check that keys sort in DNSSEC canonical order");
+}
+ATF_TC_BODY(order, tc) {
+	dns_fixedname_t f1, f2;
+	dns_qpkey_t k1, k2;
+	unsigned int i, j, l1, l2;
+	int c1, c2;
+
+	UNUSED(tc);
+
+	ATF_REQUIRE_EQ(dns_test_begin(NULL, ISC_FALSE), ISC_R_SUCCESS);
+
+	for (i = 0; i < NNAMES; i++) {
+		l1 = dns_qpkey_fromname(k1, makename(names[i], &f1));
+		for (j = 0; j < NNAMES; j++) {
+			l2 = dns_qpkey_fromname(k2, makename(names[j], &f2));
+			c1 = dns_name_compare(dns_fixedname_name(&f1),
+					      dns_fixedname_name(&f2));
+			c2 = memcmp(k1, k2, ISC_MIN(l1, l2));
+			if (c2 == 0)
+				c2 = (int)l1 - (int)l2;
+			ATF_CHECK_MSG((c1 < 0) == (c2 < 0) &&
+				      (c1 == 0) == (c2 == 0),
+				      "%s <=> %s: %d %d", names[i], names[j],
+				      c1, c2);
+		}
+	}
+
+	dns_test_end();
+}
+
+ATF_TC(insertdelete);
+ATF_TC_HEAD(insertdelete, tc) {
+	atf_tc_set_md_var(tc, "descr", "insert, find and delete names");
+}
+ATF_TC_BODY(insertdelete, tc) {
+	dns_qp_t *qp;
+	dns_fixedname_t fn;
+	void *value;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	ATF_REQUIRE_EQ(dns_test_begin(NULL, ISC_FALSE), ISC_R_SUCCESS);
+
+	qp = maketrie();
+	ATF_CHECK_EQ(dns_qp_count(qp), NNAMES);
+	ATF_CHECK(dns_qp_memusage(qp) > 0);
+
+	/* Duplicates are refused, regardless of case. */
+	ATF_CHECK_EQ(dns_qp_insert(qp, makename("WWW.Example.COM.", &fn)),
+		     ISC_R_EXISTS);
+
+	for (i = 0; i < NNAMES; i++) {
+		value = NULL;
+		ATF_CHECK_EQ(dns_qp_getname(qp, makename(names[i], &fn),
+					    &value), ISC_R_SUCCESS);
+		ATF_CHECK_EQ(value, dns_fixedname_name(&fnames[i]));
+	}
+
+	value = NULL;
+	ATF_CHECK_EQ(dns_qp_getname(qp, makename("c.example.", &fn), &value),
+		     ISC_R_NOTFOUND);
+	ATF_CHECK_EQ(dns_qp_getname(qp, makename("exampl.", &fn), &value),
+		     ISC_R_NOTFOUND);
+
+	/* Delete every other name and check the rest are still there. */
+	for (i = 0; i < NNAMES; i += 2) {
+		value = NULL;
+		ATF_CHECK_EQ(dns_qp_deletename(qp, makename(names[i], &fn),
+					       &value), ISC_R_SUCCESS);
+		ATF_CHECK_EQ(value, dns_fixedname_name(&fnames[i]));
+		ATF_CHECK_EQ(dns_qp_deletename(qp, makename(names[i], &fn),
+					       NULL), ISC_R_NOTFOUND);
+	}
+	ATF_CHECK_EQ(dns_qp_count(qp), NNAMES / 2);
+	for (i = 0; i < NNAMES; i++) {
+		value = NULL;
+		ATF_CHECK_EQ(dns_qp_getname(qp, makename(names[i], &fn),
+					    &value),
+			     (i % 2 == 0) ? ISC_R_NOTFOUND : ISC_R_SUCCESS);
+	}
+
+	destroyed = 0;
+	dns_qp_destroy(&qp);
+	ATF_CHECK_EQ(qp, NULL);
+	ATF_CHECK_EQ(destroyed, NNAMES / 2);
+
+	dns_test_end();
+}
+
+ATF_TC(ancestor);
+ATF_TC_HEAD(ancestor, tc) {
+	atf_tc_set_md_var(tc, "descr", "find closest ancestors");
+}
+ATF_TC_BODY(ancestor, tc) {
+	dns_qp_t *qp;
+	dns_fixedname_t fn, fexp;
+	dns_qpchain_t chain;
+	void *value;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	ATF_REQUIRE_EQ(dns_test_begin(NULL, ISC_FALSE), ISC_R_SUCCESS);
+
+	qp = maketrie();
+
+	value = NULL;
+	result = dns_qp_findname_ancestor(qp,
+					  makename("x.y.b.c.example.", &fn),
+					  &value, &chain);
+	ATF_CHECK_EQ(result, DNS_R_PARTIALMATCH);
+	ATF_CHECK(dns_name_equal(value, makename("b.c.example.", &fexp)));
+	ATF_REQUIRE_EQ(chain.length, 3);
+	ATF_CHECK(dns_name_equal(chain.values[0], dns_rootname));
+	ATF_CHECK(dns_name_equal(chain.values[1],
+				 makename("example.", &fexp)));
+	ATF_CHECK(dns_name_equal(chain.values[2],
+				 makename("b.c.example.", &fexp)));
+
+	/* A name that shares a prefix but is not an ancestor. */
+	value = NULL;
+	result = dns_qp_findname_ancestor(qp, makename("bcd.example.", &fn),
+					  &value, &chain);
+	ATF_CHECK_EQ(result, DNS_R_PARTIALMATCH);
+	ATF_CHECK(dns_name_equal(value, makename("example.", &fexp)));
+	ATF_CHECK_EQ(chain.length, 2);
+
+	value = NULL;
+	result = dns_qp_findname_ancestor(qp, makename("a.example.", &fn),
+					  &value, &chain);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(dns_name_equal(value, makename("a.example.", &fexp)));
+	ATF_CHECK_EQ(chain.length, 2);
+
+	ATF_CHECK_EQ(dns_qp_deletename(qp, dns_rootname, NULL),
+		     ISC_R_SUCCESS);
+	value = NULL;
+	result = dns_qp_findname_ancestor(qp, makename("net.", &fn),
+					  &value, NULL);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	dns_qp_destroy(&qp);
+	dns_test_end();
+}
+
+ATF_TC(iterate);
+ATF_TC_HEAD(iterate, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "iterate and seek in canonical order");
+}
+ATF_TC_BODY(iterate, tc) {
+	dns_qp_t *qp;
+	dns_qpiter_t it;
+	dns_fixedname_t fn;
+	dns_name_t *sorted[NNAMES];
+	void *value;
+	unsigned int i;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	ATF_REQUIRE_EQ(dns_test_begin(NULL, ISC_FALSE), ISC_R_SUCCESS);
+
+	qp = maketrie();
+	for (i = 0; i < NNAMES; i++)
+		sorted[i] = dns_fixedname_name(&fnames[i]);
+	qsort(sorted, NNAMES, sizeof(sorted[0]), compare);
+
+	dns_qpiter_init(qp, &it);
+	for (i = 0; i < NNAMES; i++) {
+		value = NULL;
+		ATF_REQUIRE_EQ(dns_qpiter_next(&it, &value), ISC_R_SUCCESS);
+		ATF_CHECK_EQ(value, sorted[i]);
+	}
+	ATF_CHECK_EQ(dns_qpiter_next(&it, &value), ISC_R_NOMORE);
+
+	for (i = NNAMES; i-- > 0;) {
+		value = NULL;
+		ATF_REQUIRE_EQ(dns_qpiter_prev(&it, &value), ISC_R_SUCCESS);
+		ATF_CHECK_EQ(value, sorted[i]);
+	}
+	ATF_CHECK_EQ(dns_qpiter_prev(&it, &value), ISC_R_NOMORE);
+
+	value = NULL;
+	ATF_CHECK_EQ(dns_qpiter_last(&it, &value), ISC_R_SUCCESS);
+	ATF_CHECK_EQ(value, sorted[NNAMES - 1]);
+	value = NULL;
+	ATF_CHECK_EQ(dns_qpiter_first(&it, &value), ISC_R_SUCCESS);
+	ATF_CHECK_EQ(value, sorted[0]);
+
+	/* Seek to each name, then to a name just after it. */
+	for (i = 0; i < NNAMES; i++) {
+		value = NULL;
+		result = dns_qpiter_seek(&it, sorted[i], &value);
+		ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(value, sorted[i]);
+		if (i + 1 < NNAMES) {
+			value = NULL;
+			ATF_CHECK_EQ(dns_qpiter_next(&it, &value),
+				     ISC_R_SUCCESS);
+			ATF_CHECK_EQ(value, sorted[i + 1]);
+		}
+	}
+
+	value = NULL;
+	result = dns_qpiter_seek(&it, makename("bb.example.", &fn), &value);
+	ATF_CHECK_EQ(result, DNS_R_PARTIALMATCH);
+	ATF_CHECK(dns_name_equal(value, makename("b_c.example.", &fn)));
+	value = NULL;
+	ATF_CHECK_EQ(dns_qpiter_next(&it, &value), ISC_R_SUCCESS);
+	ATF_CHECK(dns_name_equal(value, makename("bc.example.", &fn)));
+
+	value = NULL;
+	result = dns_qpiter_seek(&it, makename("zz.a.example.", &fn), &value);
+	ATF_CHECK_EQ(result, DNS_R_PARTIALMATCH);
+	ATF_CHECK(dns_name_equal(value, makename("zabc.a.example.", &fn)));
+
+	value = NULL;
+	result = dns_qpiter_seek(&it, makename("zzz.", &fn), &value);
+	ATF_CHECK_EQ(result, DNS_R_PARTIALMATCH);
+	ATF_CHECK_EQ(value, sorted[NNAMES - 1]);
+
+	ATF_CHECK_EQ(dns_qp_deletename(qp, dns_rootname, NULL),
+		     ISC_R_SUCCESS);
+	dns_qpiter_init(qp, &it);
+	value = NULL;
+	result = dns_qpiter_seek(&it, makename("com.", &fn), &value);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	dns_qp_destroy(&qp);
+	dns_test_end();
+}
+
+ATF_TC(random);
+ATF_TC_HEAD(random, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "insert, delete and seek many generated names");
+}
+ATF_TC_BODY(random, tc) {
+	static const char chars[] = "ab-_Z09\\.";
+	dns_qp_t *qp = NULL;
+	dns_qpiter_t it;
+	dns_fixedname_t *fn;
+	dns_name_t **sorted, *name, *expect;
+	char text[64];
+	void *value;
+	unsigned int i, j, k, l, n = 2000, count;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	ATF_REQUIRE_EQ(dns_test_begin(NULL, ISC_FALSE), ISC_R_SUCCESS);
+
+	fn = isc_mem_get(mctx, n * sizeof(*fn));
+	ATF_REQUIRE(fn != NULL);
+	sorted = isc_mem_get(mctx, n * sizeof(*sorted));
+	ATF_REQUIRE(sorted != NULL);
+	ATF_REQUIRE_EQ(dns_qp_create(mctx, &methods, NULL, &qp),
+		       ISC_R_SUCCESS);
+
+	/*
+	 * Short names over a small alphabet, so that there are many
+	 * shared prefixes, duplicates and ancestors.
+	 */
+	srandom(1);
+	for (i = 0; i < n; i++) {
+		k = 0;
+		for (j = random() % 4 + 1; j > 0; j--) {
+			for (l = random() % 3 + 1; l > 0; l--) {
+				char c = chars[random() % (sizeof(chars) - 1)];
+				if (c == '\\' || c == '.')
+					text[k++] = '\\';
+				text[k++] = c;
+			}
+			text[k++] = '.';
+		}
+		text[k] = '\0';
+		dns_test_namefromstring(text, &fn[i]);
+	}
+
+	/* Insert the even names, keeping the ones that were new. */
+	for (i = count = 0; i < n; i += 2) {
+		name = dns_fixedname_name(&fn[i]);
+		result = dns_qp_insert(qp, name);
+		if (result == ISC_R_SUCCESS)
+			sorted[count++] = name;
+		else
+			ATF_REQUIRE_EQ(result, ISC_R_EXISTS);
+	}
+	ATF_CHECK_EQ(dns_qp_count(qp), count);
+
+	/* Remove every third of those. */
+	for (i = 0; i < count; i += 3)
+		ATF_CHECK_EQ(dns_qp_deletename(qp, sorted[i], NULL),
+			     ISC_R_SUCCESS);
+	for (i = j = 0; i < count; i++)
+		if (i % 3 != 0)
+			sorted[j++] = sorted[i];
+	count = j;
+	ATF_CHECK_EQ(dns_qp_count(qp), count);
+	qsort(sorted, count, sizeof(sorted[0]), compare);
+
+	dns_qpiter_init(qp, &it);
+	for (i = 0; i < count; i++) {
+		value = NULL;
+		ATF_REQUIRE_EQ(dns_qpiter_next(&it, &value), ISC_R_SUCCESS);
+		ATF_CHECK_EQ(value, sorted[i]);
+	}
+	ATF_CHECK_EQ(dns_qpiter_next(&it, NULL), ISC_R_NOMORE);
+
+	/* Seek to every generated name, present or not. */
+	for (i = 0; i < n; i++) {
+		name = dns_fixedname_name(&fn[i]);
+		expect = NULL;
+		for (j = 0; j < count; j++) {
+			if (dns_name_compare(sorted[j], name) > 0)
+				break;
+			expect = sorted[j];
+		}
+		value = NULL;
+		result = dns_qpiter_seek(&it, name, &value);
+		if (expect == NULL) {
+			ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+			continue;
+		}
+		ATF_CHECK_EQ(result, dns_name_equal(expect, name)
+				     ? ISC_R_SUCCESS : DNS_R_PARTIALMATCH);
+		ATF_CHECK_EQ(value, expect);
+		value = NULL;
+		result = dns_qpiter_next(&it, &value);
+		if (j < count) {
+			ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+			ATF_CHECK_EQ(value, sorted[j]);
+		} else
+			ATF_CHECK_EQ(result, ISC_R_NOMORE);
+	}
+
+	/* Find the closest ancestor of every generated name. */
+	for (i = 0; i < n; i++) {
+		name = dns_fixedname_name(&fn[i]);
+		expect = NULL;
+		for (j = 0; j < count; j++) {
+			if (dns_name_issubdomain(name, sorted[j]) &&
+			    (expect == NULL ||
+			     dns_name_countlabels(sorted[j]) >
+			     dns_name_countlabels(expect)))
+				expect = sorted[j];
+		}
+		value = NULL;
+		result = dns_qp_findname_ancestor(qp, name, &value, NULL);
+		if (expect == NULL)
+			ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+		else {
+			ATF_CHECK_EQ(result, dns_name_equal(expect, name)
+					     ? ISC_R_SUCCESS
+					     : DNS_R_PARTIALMATCH);
+			ATF_CHECK_EQ(value, expect);
+		}
+	}
+
+	dns_qp_destroy(&qp);
+	isc_mem_put(mctx, sorted, n * sizeof(*sorted));
+	isc_mem_put(mctx, fn, n * sizeof(*fn));
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, order);
+	ATF_TP_ADD_TC(tp, insertdelete);
+	ATF_TP_ADD_TC(tp, ancestor);
+	ATF_TP_ADD_TC(tp, iterate);
+	ATF_TP_ADD_TC(tp, random);
+	return (atf_no_error());
+}
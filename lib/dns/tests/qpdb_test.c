@@ -0,0 +1,1012 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * The "qp" database must answer exactly like the "rbt" database, so
+ * most of these tests load the same data into both and compare.
+ */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/string.h>
+
+#include <dns/db.h>
+#include <dns/dbiterator.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/rdatasetiter.h>
+#include <dns/result.h>
+
+#include "dnstest.h"
+
+/*
+ * Helper functions
+ */
+
+static void
+loaddb(const char *dbtype, const char *origin, const char *file,
+       dns_db_t **dbp)
+{
+	dns_fixedname_t fname;
+	isc_result_t result;
+
+	dns_test_namefromstring(origin, &fname);
+	result = dns_db_create(mctx, dbtype, dns_fixedname_name(&fname),
+			       dns_dbtype_zone, dns_rdataclass_in, 0, NULL,
+			       dbp);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	if (file != NULL) {
+		result = dns_db_load(*dbp, file);
+		ATF_REQUIRE_EQ_MSG(result, ISC_R_SUCCESS, "%s: %s", dbtype,
+				   isc_result_totext(result));
+	}
+}
+
+static void
+check_rdataset(const char *what, const char *namestr, dns_rdataset_t *qp,
+	       dns_rdataset_t *rbt)
+{
+	ATF_CHECK_EQ_MSG(dns_rdataset_isassociated(qp),
+			 dns_rdataset_isassociated(rbt),
+			 "%s %s: associated", namestr, what);
+	if (!dns_rdataset_isassociated(qp) ||
+	    !dns_rdataset_isassociated(rbt))
+		return;
+	ATF_CHECK_EQ_MSG(qp->type, rbt->type, "%s %s: type %u, expected %u",
+			 namestr, what, qp->type, rbt->type);
+	ATF_CHECK_EQ_MSG(qp->covers, rbt->covers, "%s %s: covers", namestr,
+			 what);
+	ATF_CHECK_EQ_MSG(qp->ttl, rbt->ttl, "%s %s: ttl", namestr, what);
+	ATF_CHECK_EQ_MSG(dns_rdataset_count(qp), dns_rdataset_count(rbt),
+			 "%s %s: count", namestr, what);
+}
+
+/*
+ * Look 'namestr' up in both databases and check that the answers match.
+ * 'now' only matters to caches.
+ */
+static void
+check_find(dns_db_t *qpdb, dns_dbversion_t *qpver,
+	   dns_db_t *rbtdb, dns_dbversion_t *rbtver,
+	   const char *namestr, dns_rdatatype_t type, unsigned int options,
+	   isc_stdtime_t now)
+{
+	dns_fixedname_t fname, fqp, frbt;
+	dns_name_t *qpname, *rbtname;
+	dns_rdataset_t qprds, qpsig, rbtrds, rbtsig;
+	dns_dbnode_t *qpnode = NULL, *rbtnode = NULL;
+	isc_result_t qpresult, rbtresult;
+	char qptext[DNS_NAME_FORMATSIZE], rbttext[DNS_NAME_FORMATSIZE];
+
+	dns_test_namefromstring(namestr, &fname);
+	dns_fixedname_init(&fqp);
+	qpname = dns_fixedname_name(&fqp);
+	dns_fixedname_init(&frbt);
+	rbtname = dns_fixedname_name(&frbt);
+	dns_rdataset_init(&qprds);
+	dns_rdataset_init(&qpsig);
+	dns_rdataset_init(&rbtrds);
+	dns_rdataset_init(&rbtsig);
+
+	qpresult = dns_db_find(qpdb, dns_fixedname_name(&fname), qpver,
+			       type, options, now, &qpnode, qpname,
+			       &qprds, &qpsig);
+	rbtresult = dns_db_find(rbtdb, dns_fixedname_name(&fname), rbtver,
+				type, options, now, &rbtnode, rbtname,
+				&rbtrds, &rbtsig);
+
+	ATF_CHECK_EQ_MSG(qpresult, rbtresult, "%s/%u/0x%x: %s, expected %s",
+			 namestr, type, options, isc_result_totext(qpresult),
+			 isc_result_totext(rbtresult));
+
+	/*
+	 * Without an NSEC record to prove it, the name found for a
+	 * name that does not exist is not meaningful, nor is it when a
+	 * cache has nothing at all to say.
+	 */
+	if ((rbtresult != DNS_R_NXDOMAIN && rbtresult != DNS_R_EMPTYNAME &&
+	     rbtresult != ISC_R_NOTFOUND) ||
+	    dns_rdataset_isassociated(&rbtrds))
+	{
+		dns_name_format(qpname, qptext, sizeof(qptext));
+		dns_name_format(rbtname, rbttext, sizeof(rbttext));
+		ATF_CHECK_MSG(dns_name_equal(qpname, rbtname),
+			      "%s/%u/0x%x: found %s, expected %s", namestr,
+			      type, options, qptext, rbttext);
+		ATF_CHECK_EQ_MSG(qpname->attributes & DNS_NAMEATTR_WILDCARD,
+				 rbtname->attributes & DNS_NAMEATTR_WILDCARD,
+				 "%s/%u/0x%x: wildcard", namestr, type,
+				 options);
+	}
+
+	check_rdataset("rdataset", namestr, &qprds, &rbtrds);
+	check_rdataset("sigrdataset", namestr, &qpsig, &rbtsig);
+
+	if (dns_rdataset_isassociated(&qprds))
+		dns_rdataset_disassociate(&qprds);
+	if (dns_rdataset_isassociated(&qpsig))
+		dns_rdataset_disassociate(&qpsig);
+	if (dns_rdataset_isassociated(&rbtrds))
+		dns_rdataset_disassociate(&rbtrds);
+	if (dns_rdataset_isassociated(&rbtsig))
+		dns_rdataset_disassociate(&rbtsig);
+	if (qpnode != NULL)
+		dns_db_detachnode(qpdb, &qpnode);
+	if (rbtnode != NULL)
+		dns_db_detachnode(rbtdb, &rbtnode);
+}
+
+static const dns_rdatatype_t types[] = {
+	dns_rdatatype_a, dns_rdatatype_aaaa, dns_rdatatype_txt,
+	dns_rdatatype_ns, dns_rdatatype_mx, dns_rdatatype_cname,
+	dns_rdatatype_soa, dns_rdatatype_ds, dns_rdatatype_nsec,
+	dns_rdatatype_key, dns_rdatatype_any
+};
+#define NTYPES (sizeof(types) / sizeof(types[0]))
+
+static const unsigned int optionsets[] = {
+	0, DNS_DBFIND_GLUEOK, DNS_DBFIND_NOWILD, DNS_DBFIND_VALIDATEGLUE,
+	DNS_DBFIND_GLUEOK | DNS_DBFIND_VALIDATEGLUE
+};
+#define NOPTIONS (sizeof(optionsets) / sizeof(optionsets[0]))
+
+static void
+check_all(dns_db_t *qpdb, dns_dbversion_t *qpver,
+	  dns_db_t *rbtdb, dns_dbversion_t *rbtver, const char **names)
+{
+	unsigned int i, j;
+
+	for (; *names != NULL; names++)
+		for (i = 0; i < NTYPES; i++)
+			for (j = 0; j < NOPTIONS; j++)
+				check_find(qpdb, qpver, rbtdb, rbtver, *names,
+					   types[i], optionsets[j], 0);
+}
+
+/*
+ * Check that both databases hold the same names with data, in the same
+ * order.
+ */
+static void
+check_iterate(dns_db_t *qpdb, dns_db_t *rbtdb, unsigned int options) {
+	dns_db_t *dbs[2];
+	dns_dbiterator_t *iter[2] = { NULL, NULL };
+	dns_fixedname_t fname[2];
+	dns_name_t *name[2];
+	isc_result_t result[2];
+	unsigned int i, n = 0;
+	char t0[DNS_NAME_FORMATSIZE], t1[DNS_NAME_FORMATSIZE];
+
+	dbs[0] = qpdb;
+	dbs[1] = rbtdb;
+	for (i = 0; i < 2; i++) {
+		ATF_REQUIRE_EQ(dns_db_createiterator(dbs[i], options,
+						     &iter[i]),
+			       ISC_R_SUCCESS);
+		dns_fixedname_init(&fname[i]);
+		name[i] = dns_fixedname_name(&fname[i]);
+		result[i] = dns_dbiterator_first(iter[i]);
+	}
+
+	for (;;) {
+		/*
+		 * Skip nodes without data in the current version; the
+		 * two databases keep different empty nodes.
+		 */
+		for (i = 0; i < 2; i++) {
+			while (result[i] == ISC_R_SUCCESS) {
+				dns_dbnode_t *node = NULL;
+				dns_rdatasetiter_t *rdsiter = NULL;
+				isc_result_t tresult;
+
+				result[i] = dns_dbiterator_current(iter[i],
+								   &node,
+								   name[i]);
+				ATF_REQUIRE(result[i] == ISC_R_SUCCESS ||
+					    result[i] == DNS_R_NEWORIGIN);
+				result[i] = ISC_R_SUCCESS;
+				ATF_REQUIRE_EQ(dns_db_allrdatasets(dbs[i],
+								   node, NULL,
+								   0,
+								   &rdsiter),
+					       ISC_R_SUCCESS);
+				tresult = dns_rdatasetiter_first(rdsiter);
+				dns_rdatasetiter_destroy(&rdsiter);
+				dns_db_detachnode(dbs[i], &node);
+				if (tresult == ISC_R_SUCCESS)
+					break;
+				result[i] = dns_dbiterator_next(iter[i]);
+			}
+		}
+		ATF_REQUIRE_EQ(result[0], result[1]);
+		if (result[0] != ISC_R_SUCCESS)
+			break;
+
+		/*
+		 * The red-black tree iterator returns relative names
+		 * unless told otherwise, so compare absolute ones.
+		 */
+		dns_name_format(name[0], t0, sizeof(t0));
+		dns_name_format(name[1], t1, sizeof(t1));
+		ATF_CHECK_MSG(dns_name_equal(name[0], name[1]),
+			      "name %u: %s, expected %s", n, t0, t1);
+		n++;
+
+		for (i = 0; i < 2; i++)
+			result[i] = dns_dbiterator_next(iter[i]);
+	}
+	ATF_CHECK(n > 0);
+
+	for (i = 0; i < 2; i++)
+		dns_dbiterator_destroy(&iter[i]);
+}
+
+static void
+addrdata(dns_db_t *db, dns_dbversion_t *ver, const char *namestr,
+	 dns_rdatatype_t type, const char *text, isc_boolean_t add)
+{
+	dns_fixedname_t fname;
+	dns_dbnode_t *node = NULL;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	unsigned char buf[1024];
+	isc_result_t result;
+
+	dns_test_namefromstring(namestr, &fname);
+	result = dns_db_findnode(db, dns_fixedname_name(&fname), ISC_TRUE,
+				 &node);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_test_rdata_fromstring(&rdata, dns_rdataclass_in, type,
+					   buf, sizeof(buf), text);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = type;
+	rdatalist.ttl = 300;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+	dns_rdataset_init(&rdataset);
+	ATF_REQUIRE_EQ(dns_rdatalist_tordataset(&rdatalist, &rdataset),
+		       ISC_R_SUCCESS);
+
+	if (add)
+		result = dns_db_addrdataset(db, node, ver, 0, &rdataset,
+					    DNS_DBADD_MERGE, NULL);
+	else
+		result = dns_db_subtractrdataset(db, node, ver, &rdataset,
+						 0, NULL);
+	ATF_CHECK_MSG(result == ISC_R_SUCCESS || result == DNS_R_NXRRSET,
+		      "%s %s: %s", add ? "add" : "subtract", namestr,
+		      isc_result_totext(result));
+
+	dns_rdataset_disassociate(&rdataset);
+	dns_db_detachnode(db, &node);
+}
+
+/*
+ * Add an rdataset with 'ttl' to the cache 'db' at 'now'.  If 'text' is
+ * NULL a negative entry for 'type' is added instead, an NXDOMAIN one if
+ * 'type' is ANY.
+ */
+static void
+addcache(dns_db_t *db, const char *namestr, dns_rdatatype_t type,
+	 const char *text, dns_ttl_t ttl, dns_trust_t trust,
+	 isc_stdtime_t now)
+{
+	dns_fixedname_t fname;
+	dns_dbnode_t *node = NULL;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	unsigned char buf[1024];
+	isc_result_t result;
+
+	dns_test_namefromstring(namestr, &fname);
+	result = dns_db_findnode(db, dns_fixedname_name(&fname), ISC_TRUE,
+				 &node);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.ttl = ttl;
+	if (text != NULL) {
+		result = dns_test_rdata_fromstring(&rdata, dns_rdataclass_in,
+						   type, buf, sizeof(buf),
+						   text);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		rdatalist.type = type;
+		ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+	} else {
+		rdatalist.type = 0;
+		rdatalist.covers = type;
+	}
+	dns_rdataset_init(&rdataset);
+	ATF_REQUIRE_EQ(dns_rdatalist_tordataset(&rdatalist, &rdataset),
+		       ISC_R_SUCCESS);
+	rdataset.trust = trust;
+	if (text == NULL) {
+		rdataset.attributes |= DNS_RDATASETATTR_NEGATIVE;
+		if (type == dns_rdatatype_any)
+			rdataset.attributes |= DNS_RDATASETATTR_NXDOMAIN;
+	}
+
+	result = dns_db_addrdataset(db, node, NULL, now, &rdataset, 0, NULL);
+	ATF_CHECK_MSG(result == ISC_R_SUCCESS || result == DNS_R_UNCHANGED,
+		      "add %s: %s", namestr, isc_result_totext(result));
+
+	dns_rdataset_disassociate(&rdataset);
+	dns_db_detachnode(db, &node);
+}
+
+/*
+ * Look for the zone cut above 'namestr' in both caches and check that
+ * the answers match.
+ */
+static void
+check_findzonecut(dns_db_t *qpdb, dns_db_t *rbtdb, const char *namestr,
+		  unsigned int options, isc_stdtime_t now)
+{
+	dns_fixedname_t fname, fqp, frbt;
+	dns_rdataset_t qprds, qpsig, rbtrds, rbtsig;
+	isc_result_t qpresult, rbtresult;
+	char qptext[DNS_NAME_FORMATSIZE], rbttext[DNS_NAME_FORMATSIZE];
+
+	dns_test_namefromstring(namestr, &fname);
+	dns_fixedname_init(&fqp);
+	dns_fixedname_init(&frbt);
+	dns_rdataset_init(&qprds);
+	dns_rdataset_init(&qpsig);
+	dns_rdataset_init(&rbtrds);
+	dns_rdataset_init(&rbtsig);
+
+	qpresult = dns_db_findzonecut(qpdb, dns_fixedname_name(&fname),
+				      options, now, NULL,
+				      dns_fixedname_name(&fqp),
+				      &qprds, &qpsig);
+	rbtresult = dns_db_findzonecut(rbtdb, dns_fixedname_name(&fname),
+				       options, now, NULL,
+				       dns_fixedname_name(&frbt),
+				       &rbtrds, &rbtsig);
+	ATF_CHECK_EQ_MSG(qpresult, rbtresult, "zonecut %s/0x%x: %s, "
+			 "expected %s", namestr, options,
+			 isc_result_totext(qpresult),
+			 isc_result_totext(rbtresult));
+	if (qpresult == ISC_R_SUCCESS && rbtresult == ISC_R_SUCCESS) {
+		dns_name_format(dns_fixedname_name(&fqp), qptext,
+				sizeof(qptext));
+		dns_name_format(dns_fixedname_name(&frbt), rbttext,
+				sizeof(rbttext));
+		ATF_CHECK_MSG(dns_name_equal(dns_fixedname_name(&fqp),
+					     dns_fixedname_name(&frbt)),
+			      "zonecut %s/0x%x: found %s, expected %s",
+			      namestr, options, qptext, rbttext);
+	}
+	check_rdataset("zonecut", namestr, &qprds, &rbtrds);
+	check_rdataset("zonecut sig", namestr, &qpsig, &rbtsig);
+
+	if (dns_rdataset_isassociated(&qprds))
+		dns_rdataset_disassociate(&qprds);
+	if (dns_rdataset_isassociated(&qpsig))
+		dns_rdataset_disassociate(&qpsig);
+	if (dns_rdataset_isassociated(&rbtrds))
+		dns_rdataset_disassociate(&rbtrds);
+	if (dns_rdataset_isassociated(&rbtsig))
+		dns_rdataset_disassociate(&rbtsig);
+}
+
+static void
+water(void *arg, int mark) {
+	UNUSED(arg);
+	UNUSED(mark);
+}
+
+static const char *zone1names[] = {
+	"example.", "ns.example.", "mail.example.", "www.example.",
+	"WWW.EXAMPLE.", "alias.example.", "loop.example.", "nx.example.",
+	"a.nx.example.", "sub.example.", "ns.sub.example.",
+	"deep.below.sub.example.", "below.sub.example.",
+	"nx.sub.example.", "dname.example.", "x.dname.example.",
+	"y.dname.example.", "wild.example.", "*.wild.example.",
+	"a.wild.example.", "b.a.wild.example.", "explicit.wild.example.",
+	"a.explicit.wild.example.", "y.wild.example.", "x.y.wild.example.",
+	"z.y.wild.example.", "sub2.wild.example.", "a.sub2.wild.example.",
+	"*.sub2.wild.example.", "ent.example.", "c.ent.example.",
+	"b.c.ent.example.", "a.b.c.ent.example.", "x.a.b.c.ent.example.",
+	"case.mixed.example.", "mixed.example.", "\\000.odd.example.",
+	"\\@\\~.odd.example.", "odd.example.", "com.", "example.com.",
+	"a.example.com.", NULL
+};
+
+static const char *nsecnames[] = {
+	"test.", "a.test.", "b.test.", "aa.test.", "b.c.test.", "c.test.",
+	"a.c.test.", "d.c.test.", "deleg.test.", "ns.deleg.test.",
+	"x.deleg.test.", "ns.test.", "nt.test.", "w.test.", "*.w.test.",
+	"x.w.test.", "y.x.w.test.", "z.test.", "zz.test.", "\\000.test.",
+	"\\255.z.test.", NULL
+};
+
+static const char *nsec3names[] = {
+	"test.", "a.test.", "b.test.", "c.test.", "d.e.f.test.",
+	"e.f.test.", "f.test.", "g.test.", "x.test.", "f.g.h.test.",
+	"g.h.test.", "ns.test.", "ns3.test.",
+	"1f3jq6eanhnhocmupqtvnm339vdtr51c.test.",
+	"7qkpelf33jok9bvj7cke99ahg40b0sh7.test.",
+	"7qkpelf33jok9bvj7cke99ahg40b0sh8.test.",
+	"00000000000000000000000000000000.test.",
+	"zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz.test.", NULL
+};
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(find);
+ATF_TC_HEAD(find, tc) {
+	atf_tc_set_md_var(tc, "descr", "compare zone lookups with rbtdb");
+}
+ATF_TC_BODY(find, tc) {
+	dns_db_t *qpdb = NULL, *rbtdb = NULL;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	loaddb("qp", "example.", "testdata/qpdb/zone1.data", &qpdb);
+	loaddb("rbt", "example.", "testdata/qpdb/zone1.data", &rbtdb);
+	ATF_CHECK(!dns_db_issecure(qpdb));
+	ATF_CHECK_EQ(dns_db_nodecount(qpdb) > 0, ISC_TRUE);
+	check_all(qpdb, NULL, rbtdb, NULL, zone1names);
+	dns_db_detach(&qpdb);
+	dns_db_detach(&rbtdb);
+
+	dns_test_end();
+}
+
+ATF_TC(nsec);
+ATF_TC_HEAD(nsec, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "compare NSEC signed zone lookups with rbtdb");
+}
+ATF_TC_BODY(nsec, tc) {
+	dns_db_t *qpdb = NULL, *rbtdb = NULL;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	loaddb("qp", "test.", "testdata/qpdb/nsec.data", &qpdb);
+	loaddb("rbt", "test.", "testdata/qpdb/nsec.data", &rbtdb);
+	ATF_CHECK(dns_db_issecure(qpdb));
+	ATF_CHECK(dns_db_issecure(rbtdb));
+	check_all(qpdb, NULL, rbtdb, NULL, nsecnames);
+	dns_db_detach(&qpdb);
+	dns_db_detach(&rbtdb);
+
+	dns_test_end();
+}
+
+ATF_TC(nsec3);
+ATF_TC_HEAD(nsec3, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "compare NSEC3 signed zone lookups with rbtdb");
+}
+ATF_TC_BODY(nsec3, tc) {
+	dns_db_t *qpdb = NULL, *rbtdb = NULL;
+	isc_result_t result;
+	unsigned int i, j;
+	static const unsigned int nsec3options[] = {
+		DNS_DBFIND_FORCENSEC3, DNS_DBFIND_FORCENSEC3|DNS_DBFIND_GLUEOK
+	};
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	loaddb("qp", "test.", "testdata/dbiterator/zone2.data", &qpdb);
+	loaddb("rbt", "test.", "testdata/dbiterator/zone2.data", &rbtdb);
+	check_all(qpdb, NULL, rbtdb, NULL, nsec3names);
+	for (i = 0; nsec3names[i] != NULL; i++)
+		for (j = 0; j < 2; j++)
+			check_find(qpdb, NULL, rbtdb, NULL, nsec3names[i],
+				   dns_rdatatype_nsec3, nsec3options[j], 0);
+	dns_db_detach(&qpdb);
+	dns_db_detach(&rbtdb);
+
+	dns_test_end();
+}
+
+ATF_TC(iterate);
+ATF_TC_HEAD(iterate, tc) {
+	atf_tc_set_md_var(tc, "descr", "compare iteration with rbtdb");
+}
+ATF_TC_BODY(iterate, tc) {
+	dns_db_t *qpdb = NULL, *rbtdb = NULL;
+	dns_dbiterator_t *iter = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_fixedname_t fname, fseek;
+	isc_result_t result;
+	unsigned int n;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	loaddb("qp", "test.", "testdata/dbiterator/zone2.data", &qpdb);
+	loaddb("rbt", "test.", "testdata/dbiterator/zone2.data", &rbtdb);
+	check_iterate(qpdb, rbtdb, 0);
+	check_iterate(qpdb, rbtdb, DNS_DB_NONSEC3);
+	check_iterate(qpdb, rbtdb, DNS_DB_NSEC3ONLY);
+
+	/*
+	 * Walk backwards from the last name, and seek.  Unlike the
+	 * red-black tree, the trie holds no nodes for empty non-terminals,
+	 * so there is one node per name with data.
+	 */
+	ATF_REQUIRE_EQ(dns_db_createiterator(qpdb, DNS_DB_NONSEC3, &iter),
+		       ISC_R_SUCCESS);
+	dns_fixedname_init(&fname);
+	n = 0;
+	for (result = dns_dbiterator_last(iter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_dbiterator_prev(iter))
+		n++;
+	ATF_CHECK_EQ(result, ISC_R_NOMORE);
+	ATF_CHECK_EQ(n, 12);
+
+	dns_test_namefromstring("e.f.test.", &fseek);
+	result = dns_dbiterator_seek(iter, dns_fixedname_name(&fseek));
+	ATF_CHECK_EQ(result, DNS_R_PARTIALMATCH);
+	result = dns_dbiterator_next(iter);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	result = dns_dbiterator_current(iter, &node,
+					dns_fixedname_name(&fname));
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	dns_test_namefromstring("d.e.f.test.", &fseek);
+	ATF_CHECK(dns_name_equal(dns_fixedname_name(&fname),
+				 dns_fixedname_name(&fseek)));
+	dns_db_detachnode(qpdb, &node);
+
+	dns_test_namefromstring("example.", &fseek);
+	result = dns_dbiterator_seek(iter, dns_fixedname_name(&fseek));
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	dns_dbiterator_destroy(&iter);
+	dns_db_detach(&qpdb);
+	dns_db_detach(&rbtdb);
+
+	dns_test_end();
+}
+
+ATF_TC(update);
+ATF_TC_HEAD(update, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "compare versions and updates with rbtdb");
+}
+ATF_TC_BODY(update, tc) {
+	dns_db_t *qpdb = NULL, *rbtdb = NULL, *origdb = NULL;
+	dns_dbversion_t *qpold = NULL;
+	dns_dbversion_t *qpnew = NULL, *rbtnew = NULL;
+	dns_dbiterator_t *iter = NULL;
+	dns_dbnode_t *node = NULL;
+	isc_result_t result;
+	static const char *names[] = {
+		"new.example.", "x.new.example.", "www.example.",
+		"a.b.c.ent.example.", "b.c.ent.example.", "deleg.example.",
+		"ns.deleg.example.", "a.wild.example.", "nx.example.", NULL
+	};
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	loaddb("qp", "example.", "testdata/qpdb/zone1.data", &qpdb);
+	loaddb("rbt", "example.", "testdata/qpdb/zone1.data", &rbtdb);
+
+	/*
+	 * The red-black tree database does not look past the newest
+	 * version of a node when deciding whether a name is an empty
+	 * non-terminal, so old versions are compared with an unchanged
+	 * copy of the zone instead.
+	 */
+	loaddb("rbt", "example.", "testdata/qpdb/zone1.data", &origdb);
+
+	/*
+	 * Add names, remove others, and add a delegation, keeping the
+	 * old version open.
+	 */
+	dns_db_currentversion(qpdb, &qpold);
+	ATF_REQUIRE_EQ(dns_db_newversion(qpdb, &qpnew), ISC_R_SUCCESS);
+	ATF_REQUIRE_EQ(dns_db_newversion(rbtdb, &rbtnew), ISC_R_SUCCESS);
+
+	addrdata(qpdb, qpnew, "new.example.", dns_rdatatype_a, "10.9.9.9",
+		 ISC_TRUE);
+	addrdata(rbtdb, rbtnew, "new.example.", dns_rdatatype_a, "10.9.9.9",
+		 ISC_TRUE);
+	addrdata(qpdb, qpnew, "a.b.c.ent.example.", dns_rdatatype_a,
+		 "10.0.4.1", ISC_FALSE);
+	addrdata(rbtdb, rbtnew, "a.b.c.ent.example.", dns_rdatatype_a,
+		 "10.0.4.1", ISC_FALSE);
+	addrdata(qpdb, qpnew, "deleg.example.", dns_rdatatype_ns,
+		 "ns.deleg.example.", ISC_TRUE);
+	addrdata(rbtdb, rbtnew, "deleg.example.", dns_rdatatype_ns,
+		 "ns.deleg.example.", ISC_TRUE);
+	addrdata(qpdb, qpnew, "ns.deleg.example.", dns_rdatatype_a,
+		 "10.8.8.8", ISC_TRUE);
+	addrdata(rbtdb, rbtnew, "ns.deleg.example.", dns_rdatatype_a,
+		 "10.8.8.8", ISC_TRUE);
+	addrdata(qpdb, qpnew, "www.example.", dns_rdatatype_a, "10.0.0.4",
+		 ISC_TRUE);
+	addrdata(rbtdb, rbtnew, "www.example.", dns_rdatatype_a, "10.0.0.4",
+		 ISC_TRUE);
+
+	check_all(qpdb, qpold, origdb, NULL, names);
+	check_all(qpdb, qpnew, rbtdb, rbtnew, names);
+
+	/*
+	 * An iterator must survive the trie changing under it.
+	 */
+	ATF_REQUIRE_EQ(dns_db_createiterator(qpdb, 0, &iter), ISC_R_SUCCESS);
+	ATF_REQUIRE_EQ(dns_dbiterator_first(iter), ISC_R_SUCCESS);
+	addrdata(qpdb, qpnew, "aaaa.example.", dns_rdatatype_a, "10.7.7.7",
+		 ISC_TRUE);
+	addrdata(rbtdb, rbtnew, "aaaa.example.", dns_rdatatype_a, "10.7.7.7",
+		 ISC_TRUE);
+	ATF_REQUIRE_EQ(dns_dbiterator_next(iter), ISC_R_SUCCESS);
+	ATF_REQUIRE_EQ(dns_dbiterator_current(iter, &node, NULL),
+		       ISC_R_SUCCESS);
+	dns_db_detachnode(qpdb, &node);
+	dns_dbiterator_destroy(&iter);
+
+	dns_db_closeversion(qpdb, &qpnew, ISC_TRUE);
+	dns_db_closeversion(rbtdb, &rbtnew, ISC_TRUE);
+
+	check_all(qpdb, qpold, origdb, NULL, names);
+	check_all(qpdb, NULL, rbtdb, NULL, names);
+
+	dns_db_closeversion(qpdb, &qpold, ISC_FALSE);
+	check_iterate(qpdb, rbtdb, 0);
+
+	/*
+	 * Changes that are rolled back leave no trace.
+	 */
+	ATF_REQUIRE_EQ(dns_db_newversion(qpdb, &qpnew), ISC_R_SUCCESS);
+	ATF_REQUIRE_EQ(dns_db_newversion(rbtdb, &rbtnew), ISC_R_SUCCESS);
+	addrdata(qpdb, qpnew, "x.new.example.", dns_rdatatype_txt, "\"x\"",
+		 ISC_TRUE);
+	addrdata(rbtdb, rbtnew, "x.new.example.", dns_rdatatype_txt, "\"x\"",
+		 ISC_TRUE);
+	addrdata(qpdb, qpnew, "new.example.", dns_rdatatype_a, "10.9.9.9",
+		 ISC_FALSE);
+	addrdata(rbtdb, rbtnew, "new.example.", dns_rdatatype_a, "10.9.9.9",
+		 ISC_FALSE);
+	check_all(qpdb, qpnew, rbtdb, rbtnew, names);
+	dns_db_closeversion(qpdb, &qpnew, ISC_FALSE);
+	dns_db_closeversion(rbtdb, &rbtnew, ISC_FALSE);
+
+	check_all(qpdb, NULL, rbtdb, NULL, names);
+	check_iterate(qpdb, rbtdb, 0);
+
+	dns_db_detach(&qpdb);
+	dns_db_detach(&rbtdb);
+	dns_db_detach(&origdb);
+
+	dns_test_end();
+}
+
+static const char *cachenames[] = {
+	".", "example.", "ns.example.", "www.example.", "alias.example.",
+	"nx.example.", "sub.nx.example.", "deep.www.example.",
+	"dname.example.", "x.dname.example.", "a.example.", "b.example.",
+	"z.example.", "other.", NULL
+};
+
+static const dns_rdatatype_t cachetypes[] = {
+	dns_rdatatype_a, dns_rdatatype_aaaa, dns_rdatatype_ns,
+	dns_rdatatype_cname, dns_rdatatype_txt, dns_rdatatype_dname,
+	dns_rdatatype_nsec, dns_rdatatype_any
+};
+#define NCACHETYPES (sizeof(cachetypes) / sizeof(cachetypes[0]))
+
+static const unsigned int cacheoptions[] = {
+	0, DNS_DBFIND_GLUEOK, DNS_DBFIND_COVERINGNSEC, DNS_DBFIND_NOEXACT
+};
+#define NCACHEOPTIONS (sizeof(cacheoptions) / sizeof(cacheoptions[0]))
+
+static void
+check_cache(dns_db_t *qpdb, dns_db_t *rbtdb, isc_stdtime_t now) {
+	const char **names;
+	unsigned int i, j;
+
+	for (names = cachenames; *names != NULL; names++) {
+		for (i = 0; i < NCACHETYPES; i++)
+			for (j = 0; j < NCACHEOPTIONS; j++)
+				check_find(qpdb, NULL, rbtdb, NULL, *names,
+					   cachetypes[i], cacheoptions[j],
+					   now);
+		check_findzonecut(qpdb, rbtdb, *names, 0, now);
+		check_findzonecut(qpdb, rbtdb, *names, DNS_DBFIND_NOEXACT,
+				  now);
+	}
+}
+
+ATF_TC(cache);
+ATF_TC_HEAD(cache, tc) {
+	atf_tc_set_md_var(tc, "descr", "qp caches answer like rbt ones, "
+			  "as their data expires");
+}
+ATF_TC_BODY(cache, tc) {
+	dns_db_t *dbs[2] = { NULL, NULL };
+	const char *dbtypes[2] = { "qp", "rbt" };
+	isc_stdtime_t now = 1000000;
+	isc_result_t result;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 2; i++) {
+		result = dns_db_create(mctx, dbtypes[i], dns_rootname,
+				       dns_dbtype_cache, dns_rdataclass_in,
+				       0, NULL, &dbs[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK(dns_db_iscache(dbs[i]));
+
+		addcache(dbs[i], ".", dns_rdatatype_ns, "a.root.", 3600,
+			 dns_trust_answer, now);
+		addcache(dbs[i], "example.", dns_rdatatype_ns, "ns.example.",
+			 1800, dns_trust_authauthority, now);
+		addcache(dbs[i], "ns.example.", dns_rdatatype_a, "10.0.0.1",
+			 600, dns_trust_glue, now);
+		addcache(dbs[i], "www.example.", dns_rdatatype_a, "10.0.0.2",
+			 300, dns_trust_answer, now);
+		addcache(dbs[i], "www.example.", dns_rdatatype_aaaa, NULL,
+			 60, dns_trust_answer, now);
+		addcache(dbs[i], "alias.example.", dns_rdatatype_cname,
+			 "www.example.", 300, dns_trust_answer, now);
+		addcache(dbs[i], "nx.example.", dns_rdatatype_any, NULL,
+			 60, dns_trust_answer, now);
+		addcache(dbs[i], "dname.example.", dns_rdatatype_dname,
+			 "other.", 900, dns_trust_answer, now);
+		addcache(dbs[i], "a.example.", dns_rdatatype_nsec,
+			 "c.example. A NSEC", 120, dns_trust_secure, now);
+		/*
+		 * A less trusted answer doesn't replace the cached one.
+		 */
+		addcache(dbs[i], "www.example.", dns_rdatatype_a, "10.0.0.3",
+			 300, dns_trust_additional, now);
+	}
+
+	check_cache(dbs[0], dbs[1], now);
+	check_cache(dbs[0], dbs[1], now + 100);
+	check_cache(dbs[0], dbs[1], now + 400);
+	check_cache(dbs[0], dbs[1], now + 1000);
+
+	/*
+	 * A positive answer replaces an expired negative one.
+	 */
+	for (i = 0; i < 2; i++)
+		addcache(dbs[i], "nx.example.", dns_rdatatype_txt, "\"here\"",
+			 300, dns_trust_answer, now + 1000);
+	check_cache(dbs[0], dbs[1], now + 1000);
+
+	check_cache(dbs[0], dbs[1], now + 5000);
+
+	for (i = 0; i < 2; i++)
+		dns_db_detach(&dbs[i]);
+
+	/*
+	 * Stub databases are zones.
+	 */
+	result = dns_db_create(mctx, "qp", dns_rootname, dns_dbtype_stub,
+			       dns_rdataclass_in, 0, NULL, &dbs[0]);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(dns_db_isstub(dbs[0]));
+	dns_db_detach(&dbs[0]);
+
+	dns_test_end();
+}
+
+ATF_TC(stale);
+ATF_TC_HEAD(stale, tc) {
+	atf_tc_set_md_var(tc, "descr", "qp caches serve stale data like "
+			  "rbt ones");
+}
+ATF_TC_BODY(stale, tc) {
+	dns_db_t *dbs[2] = { NULL, NULL };
+	const char *dbtypes[2] = { "qp", "rbt" };
+	isc_stdtime_t now = 1000000;
+	dns_fixedname_t fname, ffound;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	dns_ttl_t ttl;
+	isc_result_t result;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 2; i++) {
+		result = dns_db_create(mctx, dbtypes[i], dns_rootname,
+				       dns_dbtype_cache, dns_rdataclass_in,
+				       0, NULL, &dbs[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_REQUIRE_EQ(dns_db_setservestalettl(dbs[i], 3600),
+			       ISC_R_SUCCESS);
+		ATF_REQUIRE_EQ(dns_db_getservestalettl(dbs[i], &ttl),
+			       ISC_R_SUCCESS);
+		ATF_CHECK_EQ(ttl, 3600);
+
+		addcache(dbs[i], "example.", dns_rdatatype_ns, "ns.example.",
+			 7200, dns_trust_authauthority, now);
+		addcache(dbs[i], "www.example.", dns_rdatatype_a, "10.0.0.2",
+			 10, dns_trust_answer, now);
+	}
+
+	for (i = 0; i < 2; i++) {
+		check_find(dbs[0], NULL, dbs[1], NULL, "www.example.",
+			   dns_rdatatype_a, 0, now + 100 * i);
+		check_find(dbs[0], NULL, dbs[1], NULL, "www.example.",
+			   dns_rdatatype_a, DNS_DBFIND_STALEOK, now + 100 * i);
+	}
+	/*
+	 * Stale data is served with a zero TTL.
+	 */
+	dns_test_namefromstring("www.example.", &fname);
+	dns_fixedname_init(&ffound);
+	dns_rdataset_init(&rdataset);
+	result = dns_db_find(dbs[0], dns_fixedname_name(&fname), NULL,
+			     dns_rdatatype_a, DNS_DBFIND_STALEOK, now + 100,
+			     &node, dns_fixedname_name(&ffound), &rdataset,
+			     NULL);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	if (result == ISC_R_SUCCESS) {
+		ATF_CHECK_EQ(rdataset.ttl, 0);
+		ATF_CHECK((rdataset.attributes &
+			   DNS_RDATASETATTR_STALE) != 0);
+	}
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	if (node != NULL)
+		dns_db_detachnode(dbs[0], &node);
+
+	/*
+	 * Once past the stale window, the data is gone.
+	 */
+	check_find(dbs[0], NULL, dbs[1], NULL, "www.example.",
+		   dns_rdatatype_a, DNS_DBFIND_STALEOK, now + 5000);
+
+	for (i = 0; i < 2; i++)
+		dns_db_detach(&dbs[i]);
+
+	dns_test_end();
+}
+
+ATF_TC(lru);
+ATF_TC_HEAD(lru, tc) {
+	atf_tc_set_md_var(tc, "descr", "an overmem qp cache drops the "
+			  "least recently used data");
+}
+ATF_TC_BODY(lru, tc) {
+	isc_mem_t *lmctx = NULL;
+	dns_db_t *db = NULL;
+	isc_stdtime_t now = 1000000;
+	dns_fixedname_t fname, ffound;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	char namestr[DNS_NAME_FORMATSIZE], text[32];
+	isc_result_t result;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_REQUIRE_EQ(isc_mem_create(0, 0, &lmctx), ISC_R_SUCCESS);
+	isc_mem_setwater(lmctx, water, NULL, 256 * 1024, 192 * 1024);
+
+	result = dns_db_create(lmctx, "qp", dns_rootname, dns_dbtype_cache,
+			       dns_rdataclass_in, 0, NULL, &db);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/*
+	 * Keep looking up the first name added, so that it stays at the
+	 * head of the LRU list while the rest fall off its tail.
+	 */
+	dns_test_namefromstring("n0.example.", &fname);
+	dns_fixedname_init(&ffound);
+	for (i = 0; i < 5000; i++) {
+		snprintf(namestr, sizeof(namestr), "n%u.example.", i);
+		snprintf(text, sizeof(text), "10.%u.%u.%u", (i >> 16) & 0xff,
+			 (i >> 8) & 0xff, i & 0xff);
+		addcache(db, namestr, dns_rdatatype_a, text, 3600,
+			 dns_trust_answer, now);
+
+		dns_rdataset_init(&rdataset);
+		result = dns_db_find(db, dns_fixedname_name(&fname), NULL,
+				     dns_rdatatype_a, 0, now, &node,
+				     dns_fixedname_name(&ffound), &rdataset,
+				     NULL);
+		ATF_REQUIRE_EQ_MSG(result, ISC_R_SUCCESS, "%u: %s", i,
+				   isc_result_totext(result));
+		dns_rdataset_disassociate(&rdataset);
+		dns_db_detachnode(db, &node);
+	}
+
+	ATF_CHECK(isc_mem_isovermem(lmctx) ||
+		  isc_mem_inuse(lmctx) < 256 * 1024);
+	ATF_CHECK(isc_mem_inuse(lmctx) < 512 * 1024);
+
+	dns_test_namefromstring("n1.example.", &fname);
+	dns_rdataset_init(&rdataset);
+	result = dns_db_find(db, dns_fixedname_name(&fname), NULL,
+			     dns_rdatatype_a, 0, now, &node,
+			     dns_fixedname_name(&ffound), &rdataset, NULL);
+	ATF_CHECK_EQ_MSG(result, ISC_R_NOTFOUND, "n1: %s",
+			 isc_result_totext(result));
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	if (node != NULL)
+		dns_db_detachnode(db, &node);
+
+	dns_test_namefromstring("n4999.example.", &fname);
+	result = dns_db_find(db, dns_fixedname_name(&fname), NULL,
+			     dns_rdatatype_a, 0, now, &node,
+			     dns_fixedname_name(&ffound), &rdataset, NULL);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	if (node != NULL)
+		dns_db_detachnode(db, &node);
+
+	dns_db_detach(&db);
+	isc_mem_setwater(lmctx, NULL, NULL, 0, 0);
+	isc_mem_destroy(&lmctx);
+
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, find);
+	ATF_TP_ADD_TC(tp, nsec);
+	ATF_TP_ADD_TC(tp, nsec3);
+	ATF_TP_ADD_TC(tp, iterate);
+	ATF_TP_ADD_TC(tp, update);
+	ATF_TP_ADD_TC(tp, cache);
+	ATF_TP_ADD_TC(tp, stale);
+	ATF_TP_ADD_TC(tp, lru);
+	return (atf_no_error());
+}
@@ -17,17 +17,22 @@
 
 #include <atf-c.h>
 
+#include <string.h>
 #include <unistd.h>
 
 #include <isc/buffer.h>
+#include <isc/mutex.h>
 #include <isc/task.h>
 #include <isc/timer.h>
+#include <isc/util.h>
 
+#include <dns/events.h>
 #include <dns/name.h>
 #include <dns/view.h>
 #include <dns/zone.h>
 
 #include "dnstest.h"
+#include "../zone_p.h"
 
 /*
  * Individual unit tests
@@ -145,6 +150,179 @@ ATF_TC_BODY(zonemgr_createzone, tc) {
 	dns_test_end();
 }
 
+ATF_TC(zonemgr_serialquerybatch);
+ATF_TC_HEAD(zonemgr_serialquerybatch, tc) {
+	atf_tc_set_md_var(tc, "descr", "set and get the serial query batch "
+			  "size and the refresh queue depth");
+}
+ATF_TC_BODY(zonemgr_serialquerybatch, tc) {
+	dns_zonemgr_t *myzonemgr = NULL;
+	unsigned int queries = 1, primaries = 1;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_zonemgr_create(mctx, taskmgr, timermgr, socketmgr,
+				    &myzonemgr);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_CHECK_EQ(dns_zonemgr_getserialquerybatch(myzonemgr), 1);
+	dns_zonemgr_setserialquerybatch(myzonemgr, 64);
+	ATF_CHECK_EQ(dns_zonemgr_getserialquerybatch(myzonemgr), 64);
+	/* Zero is raised to one. */
+	dns_zonemgr_setserialquerybatch(myzonemgr, 0);
+	ATF_CHECK_EQ(dns_zonemgr_getserialquerybatch(myzonemgr), 1);
+
+	dns_zonemgr_getrefreshqueue(myzonemgr, &queries, &primaries);
+	ATF_CHECK_EQ(queries, 0);
+	ATF_CHECK_EQ(primaries, 0);
+
+	dns_zonemgr_shutdown(myzonemgr);
+	dns_zonemgr_detach(&myzonemgr);
+	ATF_REQUIRE_EQ(myzonemgr, NULL);
+
+	dns_test_end();
+}
+
+/*
+ * The queries released by the serial query rate limiter, in order,
+ * each named by the letter of its primary.
+ */
+static isc_mutex_t released_lock;
+static char released[32];
+static unsigned int nreleased;
+
+static void
+refreshq_released(isc_task_t *task, isc_event_t *event) {
+	const char *primary = event->ev_arg;
+
+	UNUSED(task);
+
+	LOCK(&released_lock);
+	if (nreleased < sizeof(released) - 1)
+		released[nreleased++] = *primary;
+	UNLOCK(&released_lock);
+	isc_event_free(&event);
+}
+
+/*
+ * Queue five queries for primary A, three for B and one for C with
+ * the rate limiter stalled, in that order, then let it go and return
+ * the order they were released in.
+ */
+static void
+refreshq_run(dns_zonemgr_t *zmgr, isc_task_t *task, char *order) {
+	static char primaries[] = "AAAAABBBC";
+	isc_sockaddr_t addr[3];
+	struct in_addr in;
+	unsigned int i, queries, nprimaries, n;
+	isc_result_t result;
+
+	for (i = 0; i < 3; i++) {
+		in.s_addr = htonl(0x0a350001 + i);	/* 10.53.0.1 ... */
+		isc_sockaddr_fromin(&addr[i], &in, 53);
+	}
+
+	nreleased = 0;
+	dns__zonemgr_refreshqstall(zmgr, ISC_TRUE);
+	for (i = 0; primaries[i] != '\0'; i++) {
+		isc_event_t *event;
+
+		event = isc_event_allocate(mctx, NULL, DNS_EVENT_ZONE,
+					   refreshq_released, &primaries[i],
+					   sizeof(isc_event_t));
+		ATF_REQUIRE(event != NULL);
+		result = dns__zonemgr_refreshqenqueue(zmgr,
+						      &addr[primaries[i] - 'A'],
+						      task, &event);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	dns_zonemgr_getrefreshqueue(zmgr, &queries, &nprimaries);
+	ATF_CHECK_EQ(queries, 9);
+	ATF_CHECK_EQ(nprimaries, 3);
+
+	dns__zonemgr_refreshqstall(zmgr, ISC_FALSE);
+	for (i = 0; i < 500; i++) {
+		LOCK(&released_lock);
+		n = nreleased;
+		UNLOCK(&released_lock);
+		if (n == 9)
+			break;
+		usleep(10000);
+	}
+
+	LOCK(&released_lock);
+	memmove(order, released, nreleased);
+	order[nreleased] = '\0';
+	UNLOCK(&released_lock);
+
+	dns_zonemgr_getrefreshqueue(zmgr, &queries, &nprimaries);
+	ATF_CHECK_EQ(queries, 0);
+	ATF_CHECK_EQ(nprimaries, 0);
+}
+
+ATF_TC(zonemgr_refreshqueue);
+ATF_TC_HEAD(zonemgr_refreshqueue, tc) {
+	atf_tc_set_md_var(tc, "descr", "SOA queries queued per primary are "
+			  "released round robin in batches");
+}
+ATF_TC_BODY(zonemgr_refreshqueue, tc) {
+	dns_zonemgr_t *myzonemgr = NULL;
+	isc_task_t *task = NULL;
+	char order[sizeof(released)];
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_mutex_init(&released_lock);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_zonemgr_create(mctx, taskmgr, timermgr, socketmgr,
+				    &myzonemgr);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_zonemgr_setserialqueryrate(myzonemgr, 100);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/*
+	 * One query at a time: the primaries take turns until only
+	 * A has queries left.
+	 */
+	refreshq_run(myzonemgr, task, order);
+	ATF_CHECK_STREQ(order, "ABCABABAA");
+
+	/*
+	 * Two at a time: each turn takes up to two queries of the
+	 * same primary.
+	 */
+	dns_zonemgr_setserialquerybatch(myzonemgr, 2);
+	refreshq_run(myzonemgr, task, order);
+	ATF_CHECK_STREQ(order, "AABBCAABA");
+
+	/*
+	 * More than any primary has: each sends all it has in turn.
+	 */
+	dns_zonemgr_setserialquerybatch(myzonemgr, 8);
+	refreshq_run(myzonemgr, task, order);
+	ATF_CHECK_STREQ(order, "AAAAABBBC");
+
+	isc_task_detach(&task);
+	dns_zonemgr_shutdown(myzonemgr);
+	dns_zonemgr_detach(&myzonemgr);
+	ATF_REQUIRE_EQ(myzonemgr, NULL);
+	DESTROYLOCK(&released_lock);
+
+	dns_test_end();
+}
+
 ATF_TC(zonemgr_unreachable);
 ATF_TC_HEAD(zonemgr_unreachable, tc) {
 	atf_tc_set_md_var(tc, "descr", "manage and release a zone");
@@ -229,6 +407,8 @@ ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, zonemgr_create);
 	ATF_TP_ADD_TC(tp, zonemgr_managezone);
 	ATF_TP_ADD_TC(tp, zonemgr_createzone);
+	ATF_TP_ADD_TC(tp, zonemgr_serialquerybatch);
+	ATF_TP_ADD_TC(tp, zonemgr_refreshqueue);
 	ATF_TP_ADD_TC(tp, zonemgr_unreachable);
 	return (atf_no_error());
 }
@@ -38,6 +38,7 @@
 #include <dns/dnssec.h>
 #include <dns/events.h>
 #include <dns/forward.h>
+#include <dns/hotcache.h>
 #include <dns/keytable.h>
 #include <dns/keyvalues.h>
 #include <dns/master.h>
@@ -213,6 +214,7 @@ dns_view_create(isc_mem_t *mctx, dns_rdataclass_t rdclass,
 	view->nta_recheck = 0;
 	view->prefetch_eligible = 0;
 	view->prefetch_trigger = 0;
+	view->hotcache = NULL;
 	view->dstport = 53;
 	view->preferred_glue = 0;
 	view->flush = ISC_FALSE;
@@ -498,6 +500,8 @@ destroy(dns_view_t *view) {
 		dns_keytable_detach(&view->secroots_priv);
 	if (view->ntatable_priv != NULL)
 		dns_ntatable_detach(&view->ntatable_priv);
+	if (view->hotcache != NULL)
+		dns_hotcache_detach(&view->hotcache);
 	for (dns64 = ISC_LIST_HEAD(view->dns64);
 	     dns64 != NULL;
 	     dns64 = ISC_LIST_HEAD(view->dns64)) {
@@ -586,6 +590,8 @@ view_flushanddetach(dns_view_t **viewp, isc_boolean_t flush) {
 		dns_zone_t *mkzone = NULL, *rdzone = NULL;
 
 		LOCK(&view->lock);
+		if (view->hotcache != NULL)
+			dns_hotcache_shutdown(view->hotcache);
 		if (!RESSHUTDOWN(view))
 			dns_resolver_shutdown(view->resolver);
 		if (!ADBSHUTDOWN(view))
@@ -943,6 +949,8 @@ dns_view_freeze(dns_view_t *view) {
 		INSIST(view->cachedb != NULL);
 		dns_resolver_freeze(view->resolver);
 	}
+	if (view->hotcache != NULL)
+		dns_hotcache_enable(view->hotcache);
 	view->frozen = ISC_TRUE;
 }
 
@@ -1872,6 +1880,37 @@ dns_view_initntatable(dns_view_t *view,
 				    &view->ntatable_priv));
 }
 
+isc_result_t
+dns_view_inithotcache(dns_view_t *view, unsigned int size, unsigned int rate,
+		      isc_taskmgr_t *taskmgr, isc_timermgr_t *timermgr)
+{
+	dns_hotcache_t *hc = NULL;
+	isc_result_t result;
+
+	REQUIRE(DNS_VIEW_VALID(view));
+	REQUIRE(view->resolver != NULL);
+
+	if (view->hotcache != NULL) {
+		dns_hotcache_shutdown(view->hotcache);
+		dns_hotcache_detach(&view->hotcache);
+	}
+
+	result = dns_hotcache_create(view->mctx, size, &hc);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	result = dns_hotcache_start(hc, view, taskmgr, timermgr, rate);
+	if (result != ISC_R_SUCCESS) {
+		dns_hotcache_detach(&hc);
+		return (result);
+	}
+	if (view->frozen)
+		dns_hotcache_enable(hc);
+
+	view->hotcache = hc;
+	return (ISC_R_SUCCESS);
+}
+
 isc_result_t
 dns_view_getntatable(dns_view_t *view, dns_ntatable_t **ntp) {
 	REQUIRE(DNS_VIEW_VALID(view));
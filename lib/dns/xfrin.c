@@ -97,6 +97,7 @@ struct dns_xfrin_ctx {
 
 	isc_task_t 		*task;
 	isc_timer_t		*timer;
+	isc_timermgr_t		*timermgr;
 	isc_socketmgr_t 	*socketmgr;
 
 	int			connects; 	/*%< Connect in progress */
@@ -136,6 +137,18 @@ struct dns_xfrin_ctx {
 	dns_diff_t 		diff;		/*%< Pending database changes */
 	int 			difflen;	/*%< Number of pending tuples */
 
+	/*%
+	 * IXFR changes are applied to the database and written to
+	 * the journal on 'applytask', a task of the transfer's own,
+	 * while the next messages are received and decoded.  While
+	 * batches are queued there, the apply task owns 'ver' and the
+	 * journal.
+	 */
+	isc_task_t		*applytask;
+	int			applies;	/*%< Batches queued */
+	isc_result_t		applyresult;	/*%< Used by applytask */
+	isc_boolean_t		readpending;	/*%< Read when applied */
+
 	xfrin_state_t 		state;
 	isc_uint32_t 		end_serial;
 	isc_boolean_t 		is_ixfr;
@@ -175,6 +188,26 @@ struct dns_xfrin_ctx {
 #define XFRIN_MAGIC		  ISC_MAGIC('X', 'f', 'r', 'I')
 #define VALID_XFRIN(x)		  ISC_MAGIC_VALID(x, XFRIN_MAGIC)
 
+/*%
+ * IXFR changes are applied in batches of this many tuples, with at
+ * most XFRIN_MAXAPPLIES batches queued for the apply task.
+ */
+#define XFRIN_BATCH		100
+#define XFRIN_MAXAPPLIES	16
+
+/*%
+ * For testing: hold the news that a batch has been applied for this
+ * many milliseconds, so that the apply task seems to fall behind.
+ */
+LIBDNS_EXTERNAL_DATA unsigned int dns_xfrin_applydelay = 0;
+
+typedef struct xfrin_applyevent {
+	ISC_EVENT_COMMON(struct xfrin_applyevent);
+	dns_diff_t		diff;
+	isc_boolean_t		commit;		/*%< Ends a sequence */
+	isc_result_t		result;
+} xfrin_applyevent_t;
+
 /**************************************************************************/
 /*
  * Forward declarations.
@@ -206,7 +239,10 @@ static isc_result_t axfr_commit(dns_xfrin_ctx_t *xfr);
 static isc_result_t axfr_finalize(dns_xfrin_ctx_t *xfr);
 
 static isc_result_t ixfr_init(dns_xfrin_ctx_t *xfr);
-static isc_result_t ixfr_apply(dns_xfrin_ctx_t *xfr);
+static isc_result_t ixfr_apply(dns_xfrin_ctx_t *xfr, isc_boolean_t commit);
+static void ixfr_applybatch(isc_task_t *task, isc_event_t *event);
+static void ixfr_applydone(isc_task_t *task, isc_event_t *event);
+static void ixfr_applywait(isc_task_t *task, isc_event_t *event);
 static isc_result_t ixfr_putdata(dns_xfrin_ctx_t *xfr, dns_diffop_t op,
 				 dns_name_t *name, dns_ttl_t ttl,
 				 dns_rdata_t *rdata);
@@ -224,6 +260,7 @@ static void xfrin_recv_done(isc_task_t *task, isc_event_t *event);
 static void xfrin_timeout(isc_task_t *task, isc_event_t *event);
 
 static void maybe_free(dns_xfrin_ctx_t *xfr);
+static void xfrin_end(dns_xfrin_ctx_t *xfr);
 
 static void
 xfrin_fail(dns_xfrin_ctx_t *xfr, isc_result_t result, const char *msg);
@@ -397,18 +434,19 @@ ixfr_putdata(dns_xfrin_ctx_t *xfr, dns_diffop_t op,
 	CHECK(dns_difftuple_create(xfr->diff.mctx, op,
 				   name, ttl, rdata, &tuple));
 	dns_diff_append(&xfr->diff, &tuple);
-	if (++xfr->difflen > 100)
-		CHECK(ixfr_apply(xfr));
+	if (++xfr->difflen > XFRIN_BATCH)
+		CHECK(ixfr_apply(xfr, ISC_FALSE));
 	result = ISC_R_SUCCESS;
  failure:
 	return (result);
 }
 
 /*
- * Apply a set of IXFR changes to the database.
+ * Apply a set of IXFR changes to the database and write them to the
+ * journal.
  */
 static isc_result_t
-ixfr_apply(dns_xfrin_ctx_t *xfr) {
+ixfr_applydiff(dns_xfrin_ctx_t *xfr, dns_diff_t *diff) {
 	isc_result_t result;
 	isc_uint64_t records;
 
@@ -417,7 +455,7 @@ ixfr_apply(dns_xfrin_ctx_t *xfr) {
 		if (xfr->ixfr.journal != NULL)
 			CHECK(dns_journal_begin_transaction(xfr->ixfr.journal));
 	}
-	CHECK(dns_diff_apply(&xfr->diff, xfr->db, xfr->ver));
+	CHECK(dns_diff_apply(diff, xfr->db, xfr->ver));
 	if (xfr->maxrecords != 0U) {
 		result = dns_db_getsize(xfr->db, xfr->ver, &records, NULL);
 		if (result == ISC_R_SUCCESS && records > xfr->maxrecords) {
@@ -426,22 +464,22 @@ ixfr_apply(dns_xfrin_ctx_t *xfr) {
 		}
 	}
 	if (xfr->ixfr.journal != NULL) {
-		result = dns_journal_writediff(xfr->ixfr.journal, &xfr->diff);
+		result = dns_journal_writediff(xfr->ixfr.journal, diff);
 		if (result != ISC_R_SUCCESS)
 			goto failure;
 	}
-	dns_diff_clear(&xfr->diff);
-	xfr->difflen = 0;
 	result = ISC_R_SUCCESS;
  failure:
 	return (result);
 }
 
+/*
+ * Commit the version built from a difference sequence.
+ */
 static isc_result_t
-ixfr_commit(dns_xfrin_ctx_t *xfr) {
+ixfr_commitversion(dns_xfrin_ctx_t *xfr) {
 	isc_result_t result;
 
-	CHECK(ixfr_apply(xfr));
 	if (xfr->ver != NULL) {
 		/* XXX enter ready-to-commit state here */
 		if (xfr->ixfr.journal != NULL)
@@ -454,6 +492,161 @@ ixfr_commit(dns_xfrin_ctx_t *xfr) {
 	return (result);
 }
 
+/*
+ * Apply the pending IXFR changes, and commit them if 'commit' is set
+ * (at the end of a difference sequence).  With an apply task the
+ * changes are handed over as a batch and applied in order there; if
+ * XFRIN_MAXAPPLIES batches are queued, xfrin_recv_done() stops reading
+ * until ixfr_applydone() sees the queue go down.
+ */
+static isc_result_t
+ixfr_apply(dns_xfrin_ctx_t *xfr, isc_boolean_t commit) {
+	isc_result_t result;
+	xfrin_applyevent_t *event;
+
+	if (xfr->applytask == NULL) {
+		CHECK(ixfr_applydiff(xfr, &xfr->diff));
+		if (commit)
+			CHECK(ixfr_commitversion(xfr));
+		dns_diff_clear(&xfr->diff);
+		xfr->difflen = 0;
+		result = ISC_R_SUCCESS;
+		goto failure;
+	}
+
+	event = (xfrin_applyevent_t *)
+		isc_event_allocate(xfr->mctx, xfr, DNS_EVENT_XFRINAPPLY,
+				   ixfr_applybatch, xfr, sizeof(*event));
+	if (event == NULL)
+		return (ISC_R_NOMEMORY);
+	dns_diff_init(xfr->mctx, &event->diff);
+	ISC_LIST_APPENDLIST(event->diff.tuples, xfr->diff.tuples, link);
+	xfr->difflen = 0;
+	event->commit = commit;
+	event->result = ISC_R_SUCCESS;
+	isc_task_send(xfr->applytask, ISC_EVENT_PTR(&event));
+	xfr->applies++;
+	result = ISC_R_SUCCESS;
+ failure:
+	return (result);
+}
+
+/*
+ * Apply one batch of changes.  Runs on the apply task.
+ */
+static void
+ixfr_applybatch(isc_task_t *task, isc_event_t *event) {
+	xfrin_applyevent_t *aev = (xfrin_applyevent_t *)event;
+	dns_xfrin_ctx_t *xfr = (dns_xfrin_ctx_t *)event->ev_arg;
+	isc_result_t result;
+
+	UNUSED(task);
+
+	REQUIRE(VALID_XFRIN(xfr));
+	INSIST(event->ev_type == DNS_EVENT_XFRINAPPLY);
+
+	/*
+	 * Once a batch has failed the transfer is failing; skip the
+	 * rest and leave the open version to be rolled back.
+	 */
+	if (xfr->applyresult == ISC_R_SUCCESS) {
+		result = ixfr_applydiff(xfr, &aev->diff);
+		if (result == ISC_R_SUCCESS && aev->commit)
+			result = ixfr_commitversion(xfr);
+		xfr->applyresult = result;
+	}
+	aev->result = xfr->applyresult;
+	dns_diff_clear(&aev->diff);
+
+	event->ev_action = ixfr_applydone;
+	if (dns_xfrin_applydelay != 0) {
+		isc_interval_t interval;
+		isc_timer_t *timer = NULL;
+
+		isc_interval_set(&interval, dns_xfrin_applydelay / 1000,
+				 (dns_xfrin_applydelay % 1000) * 1000000);
+		result = isc_timer_create(xfr->timermgr, isc_timertype_once,
+					  NULL, &interval, xfr->task,
+					  ixfr_applywait, event, &timer);
+		if (result == ISC_R_SUCCESS)
+			return;
+	}
+	isc_task_send(xfr->task, &event);
+}
+
+/*
+ * The hold on an applied batch set by dns_xfrin_applydelay is over.
+ * Runs on the transfer's task.
+ */
+static void
+ixfr_applywait(isc_task_t *task, isc_event_t *event) {
+	isc_event_t *aev = event->ev_arg;
+	isc_timer_t *timer = (isc_timer_t *)event->ev_sender;
+
+	isc_event_free(&event);
+	isc_timer_detach(&timer);
+	ixfr_applydone(task, aev);
+}
+
+/*
+ * A batch has been applied.  Runs on the transfer's task.
+ */
+static void
+ixfr_applydone(isc_task_t *task, isc_event_t *event) {
+	xfrin_applyevent_t *aev = (xfrin_applyevent_t *)event;
+	dns_xfrin_ctx_t *xfr = (dns_xfrin_ctx_t *)event->ev_arg;
+	dns_xfrin_ctx_t *tmp = NULL;
+	isc_result_t result = aev->result;
+
+	UNUSED(task);
+
+	REQUIRE(VALID_XFRIN(xfr));
+
+	isc_event_free(&event);
+
+	INSIST(xfr->applies > 0);
+	xfr->applies--;
+
+	if (xfr->shuttingdown) {
+		if (xfr->applies > 0)
+			return;
+		/*
+		 * xfrin_fail() left the journal and the report to us.
+		 * Hold a reference while the zone drops its own, so
+		 * that we are not freed under the zone's lock.
+		 */
+		if (xfr->ixfr.journal != NULL)
+			dns_journal_destroy(&xfr->ixfr.journal);
+		dns_xfrin_attach(xfr, &tmp);
+		if (xfr->done != NULL) {
+			(xfr->done)(xfr->zone, xfr->shutdown_result);
+			xfr->done = NULL;
+		}
+		dns_xfrin_detach(&tmp);
+		return;
+	}
+
+	CHECK(result);
+	if (xfr->state == XFRST_IXFR_END) {
+		if (xfr->applies == 0)
+			xfrin_end(xfr);
+	} else if (xfr->readpending && xfr->applies < XFRIN_MAXAPPLIES) {
+		xfr->readpending = ISC_FALSE;
+		CHECK(dns_tcpmsg_readmessage(&xfr->tcpmsg, xfr->task,
+					     xfrin_recv_done, xfr));
+		xfr->recvs++;
+	}
+	return;
+
+ failure:
+	xfrin_fail(xfr, result, "failed while applying changes");
+}
+
+static isc_result_t
+ixfr_commit(dns_xfrin_ctx_t *xfr) {
+	return (ixfr_apply(xfr, ISC_TRUE));
+}
+
 /**************************************************************************/
 /*
  * Common AXFR/IXFR protocol code
@@ -755,6 +948,8 @@ xfrin_reset(dns_xfrin_ctx_t *xfr) {
 
 	xfrin_log(xfr, ISC_LOG_INFO, "resetting");
 
+	INSIST(xfr->applies == 0);
+
 	xfrin_cancelio(xfr);
 
 	if (xfr->socket != NULL)
@@ -792,6 +987,16 @@ xfrin_fail(dns_xfrin_ctx_t *xfr, isc_result_t result, const char *msg) {
 			result = DNS_R_BADIXFR;
 	}
 	xfrin_cancelio(xfr);
+	if (xfr->applies > 0) {
+		/*
+		 * The apply task still has the journal and the open
+		 * version; ixfr_applydone() reports the failure after
+		 * the last batch.
+		 */
+		xfr->shuttingdown = ISC_TRUE;
+		xfr->shutdown_result = result;
+		return;
+	}
 	/*
 	 * Close the journal.
 	 */
@@ -837,6 +1042,7 @@ xfrin_create(isc_mem_t *mctx,
 	xfr->task = NULL;
 	isc_task_attach(task, &xfr->task);
 	xfr->timer = NULL;
+	xfr->timermgr = timermgr;
 	xfr->socketmgr = socketmgr;
 	xfr->done = NULL;
 
@@ -867,6 +1073,13 @@ xfrin_create(isc_mem_t *mctx,
 	xfr->ver = NULL;
 	dns_diff_init(xfr->mctx, &xfr->diff);
 	xfr->difflen = 0;
+	xfr->applytask = NULL;
+	if (reqtype == dns_rdatatype_ixfr &&
+	    dns_zone_createtask(zone, &xfr->applytask) == ISC_R_SUCCESS)
+		isc_task_setname(xfr->applytask, "xfrinapply", xfr);
+	xfr->applies = 0;
+	xfr->applyresult = ISC_R_SUCCESS;
+	xfr->readpending = ISC_FALSE;
 
 	if (reqtype == dns_rdatatype_soa)
 		xfr->state = XFRST_SOAQUERY;
@@ -929,6 +1142,8 @@ xfrin_create(isc_mem_t *mctx,
 		dns_tsigkey_detach(&xfr->tsigkey);
 	if (xfr->db != NULL)
 		dns_db_detach(&xfr->db);
+	if (xfr->applytask != NULL)
+		isc_task_detach(&xfr->applytask);
 	isc_task_detach(&xfr->task);
 	dns_zone_idetach(&xfr->zone);
 	isc_mem_putanddetach(&xfr->mctx, xfr, sizeof(*xfr));
@@ -1299,7 +1514,8 @@ xfrin_recv_done(isc_task_t *task, isc_event_t *ev) {
 		else if (result == ISC_R_SUCCESS || result == DNS_R_NOERROR)
 			result = DNS_R_UNEXPECTEDID;
 		if (xfr->reqtype == dns_rdatatype_axfr ||
-		    xfr->reqtype == dns_rdatatype_soa)
+		    xfr->reqtype == dns_rdatatype_soa ||
+		    xfr->applies > 0)
 			goto failure;
 		xfrin_log(xfr, ISC_LOG_DEBUG(3), "got %s, retrying with AXFR",
 		       isc_result_totext(result));
@@ -1420,33 +1636,28 @@ xfrin_recv_done(isc_task_t *task, isc_event_t *ev) {
 		break;
 	case XFRST_AXFR_END:
 		CHECK(axfr_finalize(xfr));
-		/* FALLTHROUGH */
+		xfrin_end(xfr);
+		break;
 	case XFRST_IXFR_END:
 		/*
-		 * Close the journal.
-		 */
-		if (xfr->ixfr.journal != NULL)
-			dns_journal_destroy(&xfr->ixfr.journal);
-
-		/*
-		 * Inform the caller we succeeded.
+		 * If changes are still being applied, ixfr_applydone()
+		 * ends the transfer after the last batch.
 		 */
-		if (xfr->done != NULL) {
-			(xfr->done)(xfr->zone, ISC_R_SUCCESS);
-			xfr->done = NULL;
-		}
-		/*
-		 * We should have no outstanding events at this
-		 * point, thus maybe_free() should succeed.
-		 */
-		xfr->shuttingdown = ISC_TRUE;
-		xfr->shutdown_result = ISC_R_SUCCESS;
-		maybe_free(xfr);
+		if (xfr->applies == 0)
+			xfrin_end(xfr);
 		break;
 	default:
 		/*
-		 * Read the next message.
+		 * Read the next message, unless the apply task is
+		 * too far behind.
 		 */
+		if (xfr->applies >= XFRIN_MAXAPPLIES) {
+			xfrin_log(xfr, ISC_LOG_DEBUG(3),
+				  "%d batches of changes queued, "
+				  "pausing reads", xfr->applies);
+			xfr->readpending = ISC_TRUE;
+			break;
+		}
 		CHECK(dns_tcpmsg_readmessage(&xfr->tcpmsg, xfr->task,
 					     xfrin_recv_done, xfr));
 		xfr->recvs++;
@@ -1460,6 +1671,35 @@ xfrin_recv_done(isc_task_t *task, isc_event_t *ev) {
 		xfrin_fail(xfr, result, "failed while receiving responses");
 }
 
+/*
+ * The transfer has succeeded and all its changes are in.
+ */
+static void
+xfrin_end(dns_xfrin_ctx_t *xfr) {
+	INSIST(xfr->applies == 0);
+
+	/*
+	 * Close the journal.
+	 */
+	if (xfr->ixfr.journal != NULL)
+		dns_journal_destroy(&xfr->ixfr.journal);
+
+	/*
+	 * Inform the caller we succeeded.
+	 */
+	if (xfr->done != NULL) {
+		(xfr->done)(xfr->zone, ISC_R_SUCCESS);
+		xfr->done = NULL;
+	}
+	/*
+	 * We should have no outstanding events at this
+	 * point, thus maybe_free() should succeed.
+	 */
+	xfr->shuttingdown = ISC_TRUE;
+	xfr->shutdown_result = ISC_R_SUCCESS;
+	maybe_free(xfr);
+}
+
 static void
 xfrin_timeout(isc_task_t *task, isc_event_t *event) {
 	dns_xfrin_ctx_t *xfr = (dns_xfrin_ctx_t *) event->ev_arg;
@@ -1485,7 +1725,7 @@ maybe_free(dns_xfrin_ctx_t *xfr) {
 
 	if (! xfr->shuttingdown || xfr->refcount != 0 ||
 	    xfr->connects != 0 || xfr->sends != 0 ||
-	    xfr->recvs != 0)
+	    xfr->recvs != 0 || xfr->applies != 0)
 		return;
 
 	INSIST(! xfr->shuttingdown || xfr->shutdown_result != ISC_R_UNSET);
@@ -1524,6 +1764,9 @@ maybe_free(dns_xfrin_ctx_t *xfr) {
 	if (xfr->task != NULL)
 		isc_task_detach(&xfr->task);
 
+	if (xfr->applytask != NULL)
+		isc_task_detach(&xfr->applytask);
+
 	if (xfr->tsigkey != NULL)
 		dns_tsigkey_detach(&xfr->tsigkey);
 
@@ -16,6 +16,7 @@
 
 #include <isc/file.h>
 #include <isc/hex.h>
+#include <isc/ht.h>
 #include <isc/mutex.h>
 #include <isc/pool.h>
 #include <isc/print.h>
@@ -77,6 +78,8 @@
 #include <dns/zone.h>
 #include <dns/zt.h>
 
+#include "zone_p.h"
+
 #include <dst/dst.h>
 
 #define ZONE_MAGIC			ISC_MAGIC('Z', 'O', 'N', 'E')
@@ -145,6 +148,8 @@ typedef ISC_LIST(dns_nsec3chain_t) dns_nsec3chainlist_t;
 typedef struct dns_keyfetch dns_keyfetch_t;
 typedef struct dns_asyncload dns_asyncload_t;
 typedef struct dns_include dns_include_t;
+typedef struct dns_refreshq dns_refreshq_t;
+typedef struct dns_refreshprimary dns_refreshprimary_t;
 
 #define DNS_ZONE_CHECKLOCK
 #ifdef DNS_ZONE_CHECKLOCK
@@ -308,6 +313,7 @@ struct dns_zone {
 	dns_checkmxfunc_t	checkmx;
 	dns_checksrvfunc_t	checksrv;
 	dns_checknsfunc_t	checkns;
+	dns_checkstartfunc_t	checkstart;
 	/*%
 	 * Zones in certain states such as "waiting for zone transfer"
 	 * or "zone transfer in progress" are kept on per-state linked lists
@@ -342,6 +348,10 @@ struct dns_zone {
 	 * Serial number for deferred journal compaction.
 	 */
 	isc_uint32_t		compact_serial;
+	/*%
+	 * Journal compaction in progress.
+	 */
+	dns_compactctx_t	*compactctx;
 	/*%
 	 * Keys that are signing the zone for the first time.
 	 */
@@ -416,6 +426,11 @@ struct dns_zone {
 	 */
 	dns_ttl_t		maxttl;
 
+	/*%
+	 * Threads used to parse text master files and write raw ones.
+	 */
+	unsigned int		threads;
+
 	/*
 	 * Inline zone signing state.
 	 */
@@ -537,6 +552,7 @@ struct dns_zonemgr {
 	isc_ratelimiter_t *	refreshrl;
 	isc_ratelimiter_t *	startupnotifyrl;
 	isc_ratelimiter_t *	startuprefreshrl;
+	dns_refreshq_t *	refreshq;
 	isc_rwlock_t		rwlock;
 	isc_mutex_t		iolock;
 	isc_rwlock_t		urlock;
@@ -565,6 +581,47 @@ struct dns_zonemgr {
 	struct dns_unreachable	unreachable[UNREACH_CHACHE_SIZE];
 };
 
+/*%
+ * SOA queries waiting to be sent, queued per primary server.  The
+ * zone manager's refresh rate limiter holds one release event for
+ * every batch of up to 'batch' queries waiting to the same primary.
+ * Each release sends the next batch of the primary at the head of
+ * 'active' and moves that primary to the tail, so the primaries take
+ * turns: one with a deep queue (after it has restarted and sent
+ * NOTIFY for all its zones, say) does not hold up the refresh of the
+ * zones of the others, and queries to the same primary share a rate
+ * limiter slot and, when they use TCP, a connection.
+ *
+ * The structure is reference counted separately from the zone
+ * manager, as each release event holds a reference and may still be
+ * in flight after the zone manager has been freed.
+ */
+struct dns_refreshq {
+	isc_mem_t *		mctx;
+	isc_mutex_t		lock;
+	isc_task_t *		task;
+	isc_ratelimiter_t *	rl;
+
+	/* Locked by lock. */
+	int			refs;
+	isc_boolean_t		shuttingdown;
+	unsigned int		batch;
+	unsigned int		queued;
+	unsigned int		releases;
+	isc_ht_t *		primaries;
+	ISC_LIST(dns_refreshprimary_t) active;
+};
+
+#define REFRESHQ_KEYSIZE	(1 + 2 + 16)
+
+struct dns_refreshprimary {
+	isc_eventlist_t		queries;
+	unsigned int		count;
+	unsigned char		key[REFRESHQ_KEYSIZE];
+	unsigned int		keysize;
+	ISC_LINK(dns_refreshprimary_t) link;
+};
+
 /*%
  * Hold notify state.
  */
@@ -730,6 +787,13 @@ LIBDNS_EXTERNAL_DATA unsigned int dns_zone_mkey_hour = HOUR;
 LIBDNS_EXTERNAL_DATA unsigned int dns_zone_mkey_day = DAY;
 LIBDNS_EXTERNAL_DATA unsigned int dns_zone_mkey_month = MONTH;
 
+/*
+ * Seconds to hold background journal compactions for between taking
+ * the snapshot and copying the journal; set by -T compactdelay so that
+ * the system tests can run transfers and updates while one is going on.
+ */
+LIBDNS_EXTERNAL_DATA unsigned int dns_zone_compactdelay = 0;
+
 #define SEND_BUFFER_SIZE 2048
 
 static void zone_settimer(dns_zone_t *, isc_time_t *);
@@ -753,6 +817,8 @@ static inline void zone_attachdb(dns_zone_t *zone, dns_db_t *db);
 static inline void zone_detachdb(dns_zone_t *zone);
 static isc_result_t default_journal(dns_zone_t *zone);
 static void zone_xfrdone(dns_zone_t *zone, isc_result_t result);
+static void zone_journal_compact(dns_zone_t *zone, dns_db_t *db,
+				 isc_uint32_t serial);
 static isc_result_t zone_postload(dns_zone_t *zone, dns_db_t *db,
 				  isc_time_t loadtime, isc_result_t result);
 static void zone_needdump(dns_zone_t *zone, unsigned int delay);
@@ -770,6 +836,14 @@ static void refresh_callback(isc_task_t *, isc_event_t *);
 static void stub_callback(isc_task_t *, isc_event_t *);
 static void queue_soa_query(dns_zone_t *zone);
 static void soa_query(isc_task_t *, isc_event_t *);
+static isc_result_t refreshq_create(dns_zonemgr_t *zmgr,
+				    dns_refreshq_t **refreshqp);
+static void refreshq_detach(dns_refreshq_t **refreshqp);
+static void refreshq_shutdown(dns_refreshq_t *refreshq);
+static isc_result_t refreshq_enqueue(dns_refreshq_t *refreshq,
+				     const isc_sockaddr_t *primary,
+				     isc_task_t *task, isc_event_t **eventp);
+static void refreshq_release(isc_task_t *task, isc_event_t *event);
 static void ns_query(dns_zone_t *zone, dns_rdataset_t *soardataset,
 		     dns_stub_t *stub);
 static int message_count(dns_message_t *msg, dns_section_t section,
@@ -937,6 +1011,7 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->keydirectory = NULL;
 	zone->journalsize = -1;
 	zone->journal = NULL;
+	zone->compactctx = NULL;
 	zone->rdclass = dns_rdataclass_none;
 	zone->type = dns_zone_none;
 	zone->flags = 0;
@@ -972,6 +1047,7 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->masterscnt = 0;
 	zone->curmaster = 0;
 	zone->maxttl = 0;
+	zone->threads = 1;
 	zone->notify = NULL;
 	zone->notifykeynames = NULL;
 	zone->notifydscp = NULL;
@@ -1022,6 +1098,7 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->checkmx = NULL;
 	zone->checksrv = NULL;
 	zone->checkns = NULL;
+	zone->checkstart = NULL;
 	ISC_LINK_INIT(zone, statelink);
 	zone->statelist = NULL;
 	zone->stats = NULL;
@@ -1129,6 +1206,7 @@ zone_free(dns_zone_t *zone) {
 	INSIST(zone->readio == NULL);
 	INSIST(zone->statelist == NULL);
 	INSIST(zone->writeio == NULL);
+	INSIST(zone->compactctx == NULL);
 
 	if (zone->task != NULL) {
 		isc_task_detach(&zone->task);
@@ -1683,6 +1761,21 @@ dns_zone_setmaxttl(dns_zone_t *zone, dns_ttl_t maxttl) {
 	return;
 }
 
+unsigned int
+dns_zone_getthreads(dns_zone_t *zone) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+
+	return (zone->threads);
+}
+
+void
+dns_zone_setthreads(dns_zone_t *zone, unsigned int threads) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+	REQUIRE(threads > 0);
+
+	zone->threads = threads;
+}
+
 static isc_result_t
 default_journal(dns_zone_t *zone) {
 	isc_result_t result;
@@ -1926,7 +2019,8 @@ zone_load(dns_zone_t *zone, unsigned int flags, isc_boolean_t locked) {
 	INSIST(zone->db_argc >= 1);
 
 	rbt = strcmp(zone->db_argv[0], "rbt") == 0 ||
-	      strcmp(zone->db_argv[0], "rbt64") == 0;
+	      strcmp(zone->db_argv[0], "rbt64") == 0 ||
+	      strcmp(zone->db_argv[0], "qp") == 0;
 
 	if (zone->db != NULL && zone->masterfile == NULL && rbt) {
 		/*
@@ -2353,7 +2447,7 @@ zone_gotreadhandle(isc_task_t *task, isc_event_t *event) {
 
 	options = get_master_options(load->zone);
 
-	result = dns_master_loadfileinc5(load->zone->masterfile,
+	result = dns_master_loadfileinc6(load->zone->masterfile,
 					 dns_db_origin(load->db),
 					 dns_db_origin(load->db),
 					 load->zone->rdclass, options, 0,
@@ -2363,7 +2457,8 @@ zone_gotreadhandle(isc_task_t *task, isc_event_t *event) {
 					 zone_registerinclude,
 					 load->zone, load->zone->mctx,
 					 load->zone->masterformat,
-					 load->zone->maxttl);
+					 load->zone->maxttl,
+					 load->zone->threads);
 	if (result != ISC_R_SUCCESS && result != DNS_R_CONTINUE &&
 	    result != DNS_R_SEENINCLUDE)
 		goto fail;
@@ -2522,14 +2617,14 @@ zone_startload(dns_db_t *db, dns_zone_t *zone, isc_time_t loadtime) {
 			zone_idetach(&callbacks.zone);
 			return (result);
 		}
-		result = dns_master_loadfile5(zone->masterfile,
+		result = dns_master_loadfile6(zone->masterfile,
 					      &zone->origin, &zone->origin,
 					      zone->rdclass, options, 0,
 					      &callbacks,
 					      zone_registerinclude,
 					      zone, zone->mctx,
 					      zone->masterformat,
-					      zone->maxttl);
+					      zone->maxttl, zone->threads);
 		tresult = dns_db_endload(db, &callbacks);
 		if (result == ISC_R_SUCCESS)
 			result = tresult;
@@ -4626,6 +4721,10 @@ zone_postload(dns_zone_t *zone, dns_db_t *db, isc_time_t loadtime,
 			if (result != ISC_R_SUCCESS)
 				goto cleanup;
 		}
+		if (zone->type == dns_zone_master &&
+		    DNS_ZONE_OPTION(zone, DNS_ZONEOPT_CHECKINTEGRITY) &&
+		    zone->checkstart != NULL)
+			(zone->checkstart)(zone, db);
 		if (zone->type == dns_zone_master &&
 		    DNS_ZONE_OPTION(zone, DNS_ZONEOPT_CHECKINTEGRITY) &&
 		    !integrity_checks(zone, db)) {
@@ -10165,17 +10264,184 @@ dns_zone_refresh(dns_zone_t *zone) {
 	UNLOCK_ZONE(zone);
 }
 
+struct compact_event {
+	isc_event_t e;
+	isc_result_t result;
+};
+
+static void
+zone_journal_compactlog(dns_zone_t *zone, isc_result_t result) {
+	switch (result) {
+	case ISC_R_SUCCESS:
+	case DNS_R_UNCHANGED:
+	case ISC_R_NOSPACE:
+	case ISC_R_NOTFOUND:
+	case ISC_R_CANCELED:
+		dns_zone_log(zone, ISC_LOG_DEBUG(3),
+			     "dns_journal_compact: %s",
+			     dns_result_totext(result));
+		break;
+	default:
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "dns_journal_compact failed: %s",
+			     dns_result_totext(result));
+		break;
+	}
+}
+
+/*
+ * Finish a journal compaction in the zone's task, so that no
+ * transactions are written to the journal while the new journal
+ * catches up with it and replaces it.
+ */
+static void
+zone_journal_compactend(isc_task_t *task, isc_event_t *event) {
+	static char me[] = "zone_journal_compactend";
+	dns_zone_t *zone = event->ev_arg;
+	dns_zone_t *secure = NULL;
+	isc_result_t result, tresult;
+
+	UNUSED(task);
+	INSIST(event->ev_type == DNS_EVENT_ZONECOMPACT);
+	INSIST(DNS_ZONE_VALID(zone));
+
+	ENTER;
+
+	result = ((struct compact_event *)event)->result;
+	isc_event_free(&event);
+
+	/*
+	 * Handle lock order inversion.
+	 */
+ again:
+	LOCK_ZONE(zone);
+	if (inline_raw(zone)) {
+		secure = zone->secure;
+		INSIST(secure != zone);
+		TRYLOCK_ZONE(tresult, secure);
+		if (tresult != ISC_R_SUCCESS) {
+			UNLOCK_ZONE(zone);
+			secure = NULL;
+#if ISC_PLATFORM_USETHREADS
+			isc_thread_yield();
+#endif
+			goto again;
+		}
+	}
+
+	INSIST(zone->compactctx != NULL);
+	if (result == ISC_R_SUCCESS && zone->xfr != NULL) {
+		/*
+		 * A transfer that started since the snapshot was taken
+		 * has the journal open, and would go on writing to the
+		 * old file once the new one replaced it.  Compact again
+		 * when the transfer is done (see zone_xfrdone()).
+		 */
+		dns_journal_compactcancel(&zone->compactctx);
+		DNS_ZONE_SETFLAG(zone, DNS_ZONEFLG_NEEDCOMPACT);
+		dns_zone_log(zone, ISC_LOG_DEBUG(3),
+			     "journal compaction deferred: "
+			     "zone transfer in progress");
+	} else {
+		if (result == ISC_R_SUCCESS &&
+		    !DNS_ZONE_FLAG(zone, DNS_ZONEFLG_EXITING))
+			result = dns_journal_compactend(&zone->compactctx);
+		else
+			dns_journal_compactcancel(&zone->compactctx);
+		zone_journal_compactlog(zone, result);
+	}
+
+	/*
+	 * Run any compaction that was asked for while this one was.
+	 */
+	if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_NEEDCOMPACT) &&
+	    !DNS_ZONE_FLAG(zone, DNS_ZONEFLG_EXITING) && zone->xfr == NULL)
+	{
+		dns_db_t *db = NULL;
+		if (dns_zone_getdb(zone, &db) == ISC_R_SUCCESS) {
+			DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_NEEDCOMPACT);
+			zone_journal_compact(zone, db, zone->compact_serial);
+			dns_db_detach(&db);
+		}
+	}
+
+	if (secure != NULL)
+		UNLOCK_ZONE(secure);
+	UNLOCK_ZONE(zone);
+	dns_zone_idetach(&zone);
+}
+
+/*
+ * Copy the part of the journal to be kept in the zone's load task,
+ * where it does not hold up the zone's task, and send the result back
+ * to the zone's task.
+ */
+static void
+zone_journal_compactcopy(isc_task_t *task, isc_event_t *event) {
+	static char me[] = "zone_journal_compactcopy";
+	dns_zone_t *zone = event->ev_arg;
+	dns_compactctx_t *cctx;
+	isc_result_t result = ISC_R_CANCELED;
+
+	UNUSED(task);
+	INSIST(event->ev_type == DNS_EVENT_ZONECOMPACT);
+	INSIST(DNS_ZONE_VALID(zone));
+
+	ENTER;
+
+	LOCK_ZONE(zone);
+	cctx = zone->compactctx;
+	if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_EXITING))
+		cctx = NULL;
+	UNLOCK_ZONE(zone);
+
+	/*
+	 * 'zone->compactctx' is ours until the event is sent back.
+	 */
+	if (cctx != NULL)
+		result = dns_journal_compactcopy(cctx);
+
+	((struct compact_event *)event)->result = result;
+	event->ev_action = zone_journal_compactend;
+	isc_task_send(zone->task, &event);
+}
+
+/*
+ * Start copying the journal once the -T compactdelay period is over.
+ */
+static void
+zone_journal_compactwait(isc_task_t *task, isc_event_t *event) {
+	isc_event_t *e = event->ev_arg;
+	isc_timer_t *timer = (isc_timer_t *)event->ev_sender;
+
+	isc_event_free(&event);
+	isc_timer_detach(&timer);
+	isc_task_send(task, &e);
+}
+
 static void
 zone_journal_compact(dns_zone_t *zone, dns_db_t *db, isc_uint32_t serial) {
 	isc_result_t result;
 	isc_int32_t journalsize;
 	dns_dbversion_t *ver = NULL;
 	isc_uint64_t dbsize;
+	isc_event_t *e;
+	dns_zone_t *dummy = NULL;
 
 	INSIST(LOCKED_ZONE(zone));
 	if (inline_raw(zone))
 		INSIST(LOCKED_ZONE(zone->secure));
 
+	/*
+	 * Only one compaction of the journal can run at a time; run
+	 * another one when the current one is done.
+	 */
+	if (zone->compactctx != NULL) {
+		zone->compact_serial = serial;
+		DNS_ZONE_SETFLAG(zone, DNS_ZONEFLG_NEEDCOMPACT);
+		return;
+	}
+
 	journalsize = zone->journalsize;
 	if (journalsize == -1) {
 		journalsize = DNS_JOURNAL_SIZE_MAX;
@@ -10193,22 +10459,52 @@ zone_journal_compact(dns_zone_t *zone, dns_db_t *db, isc_uint32_t serial) {
 	}
 	zone_debuglog(zone, "zone_journal_compact", 1,
 		      "target journal size %d", journalsize);
-	result = dns_journal_compact(zone->mctx, zone->journal,
-				     serial, journalsize);
-	switch (result) {
-	case ISC_R_SUCCESS:
-	case ISC_R_NOSPACE:
-	case ISC_R_NOTFOUND:
-		dns_zone_log(zone, ISC_LOG_DEBUG(3),
-			     "dns_journal_compact: %s",
-			     dns_result_totext(result));
-		break;
-	default:
-		dns_zone_log(zone, ISC_LOG_ERROR,
-			     "dns_journal_compact failed: %s",
-			     dns_result_totext(result));
-		break;
+	result = dns_journal_compactbegin(zone->mctx, zone->journal, serial,
+					  journalsize, &zone->compactctx);
+	if (result != ISC_R_SUCCESS) {
+		zone_journal_compactlog(zone, result);
+		return;
 	}
+
+	/*
+	 * Copy the journal in the load task if there is one, and do
+	 * everything here otherwise.
+	 */
+	e = NULL;
+	if (zone->loadtask != NULL)
+		e = isc_event_allocate(zone->mctx, zone,
+				       DNS_EVENT_ZONECOMPACT,
+				       zone_journal_compactcopy, zone,
+				       sizeof(struct compact_event));
+	if (e != NULL) {
+		/*
+		 * Remembered in case the compaction has to be deferred.
+		 */
+		zone->compact_serial = serial;
+		zone_iattach(zone, &dummy);
+		if (dns_zone_compactdelay != 0) {
+			isc_interval_t interval;
+			isc_timer_t *timer = NULL;
+
+			isc_interval_set(&interval, dns_zone_compactdelay, 0);
+			result = isc_timer_create(zone->zmgr->timermgr,
+						  isc_timertype_once, NULL,
+						  &interval, zone->loadtask,
+						  zone_journal_compactwait, e,
+						  &timer);
+			if (result == ISC_R_SUCCESS)
+				return;
+		}
+		isc_task_send(zone->loadtask, &e);
+		return;
+	}
+
+	result = dns_journal_compactcopy(zone->compactctx);
+	if (result == ISC_R_SUCCESS)
+		result = dns_journal_compactend(&zone->compactctx);
+	else
+		dns_journal_compactcancel(&zone->compactctx);
+	zone_journal_compactlog(zone, result);
 }
 
 isc_result_t
@@ -10513,8 +10809,8 @@ dumptostream(dns_zone_t *zone, FILE *fd, const dns_master_style_t *style,
 		rawdata.flags = DNS_MASTERRAW_SOURCESERIALSET;
 		rawdata.sourceserial = zone->sourceserial;
 	}
-	result = dns_master_dumptostream3(zone->mctx, db, version, style,
-					  format, &rawdata, fd);
+	result = dns_master_dumptostream4(zone->mctx, db, version, style,
+					  format, &rawdata, fd, zone->threads);
 	dns_db_closeversion(db, &version, ISC_FALSE);
 	dns_db_detach(&db);
 	return (result);
@@ -12185,7 +12481,10 @@ queue_soa_query(dns_zone_t *zone) {
 
 	e->ev_arg = zone;
 	e->ev_sender = NULL;
-	result = isc_ratelimiter_enqueue(zone->zmgr->refreshrl, zone->task, &e);
+	result = refreshq_enqueue(zone->zmgr->refreshq,
+				  (zone->curmaster < zone->masterscnt)
+				   ? &zone->masters[zone->curmaster] : NULL,
+				  zone->task, &e);
 	if (result != ISC_R_SUCCESS) {
 		zone_idetach(&dummy);
 		isc_event_free(&e);
@@ -12193,6 +12492,314 @@ queue_soa_query(dns_zone_t *zone) {
 	}
 }
 
+static isc_result_t
+refreshq_create(dns_zonemgr_t *zmgr, dns_refreshq_t **refreshqp) {
+	dns_refreshq_t *refreshq;
+	isc_result_t result;
+
+	REQUIRE(refreshqp != NULL && *refreshqp == NULL);
+
+	refreshq = isc_mem_get(zmgr->mctx, sizeof(*refreshq));
+	if (refreshq == NULL)
+		return (ISC_R_NOMEMORY);
+	refreshq->mctx = NULL;
+	refreshq->task = NULL;
+	refreshq->rl = NULL;
+	refreshq->refs = 1;
+	refreshq->shuttingdown = ISC_FALSE;
+	refreshq->batch = 1;
+	refreshq->queued = 0;
+	refreshq->releases = 0;
+	refreshq->primaries = NULL;
+	ISC_LIST_INIT(refreshq->active);
+
+	result = isc_mutex_init(&refreshq->lock);
+	if (result != ISC_R_SUCCESS)
+		goto free_mem;
+
+	result = isc_ht_init(&refreshq->primaries, zmgr->mctx, 10);
+	if (result != ISC_R_SUCCESS)
+		goto free_lock;
+
+	isc_mem_attach(zmgr->mctx, &refreshq->mctx);
+	isc_task_attach(zmgr->task, &refreshq->task);
+	isc_ratelimiter_attach(zmgr->refreshrl, &refreshq->rl);
+
+	*refreshqp = refreshq;
+	return (ISC_R_SUCCESS);
+
+ free_lock:
+	DESTROYLOCK(&refreshq->lock);
+ free_mem:
+	isc_mem_put(zmgr->mctx, refreshq, sizeof(*refreshq));
+	return (result);
+}
+
+static void
+refreshq_detach(dns_refreshq_t **refreshqp) {
+	dns_refreshq_t *refreshq;
+	isc_boolean_t free_now;
+
+	REQUIRE(refreshqp != NULL && *refreshqp != NULL);
+
+	refreshq = *refreshqp;
+	*refreshqp = NULL;
+
+	LOCK(&refreshq->lock);
+	INSIST(refreshq->refs > 0);
+	refreshq->refs--;
+	free_now = ISC_TF(refreshq->refs == 0);
+	UNLOCK(&refreshq->lock);
+
+	if (!free_now)
+		return;
+
+	INSIST(refreshq->queued == 0);
+	INSIST(ISC_LIST_EMPTY(refreshq->active));
+	isc_ht_destroy(&refreshq->primaries);
+	isc_ratelimiter_detach(&refreshq->rl);
+	if (refreshq->task != NULL)
+		isc_task_detach(&refreshq->task);
+	DESTROYLOCK(&refreshq->lock);
+	isc_mem_putanddetach(&refreshq->mctx, refreshq, sizeof(*refreshq));
+}
+
+/*
+ * Stop accepting queries and let go of the zone manager's task so
+ * that the task manager can shut down; the rate limiter must already
+ * have been shut down, so that the queries still waiting are sent
+ * canceled by the release events it has returned.
+ */
+static void
+refreshq_shutdown(dns_refreshq_t *refreshq) {
+	isc_task_t *task;
+
+	LOCK(&refreshq->lock);
+	refreshq->shuttingdown = ISC_TRUE;
+	task = refreshq->task;
+	refreshq->task = NULL;
+	UNLOCK(&refreshq->lock);
+
+	if (task != NULL)
+		isc_task_detach(&task);
+}
+
+/*
+ * Build the hash table key for a primary: the address family, port
+ * and address.  Queries with no primary to go to share one queue.
+ */
+static unsigned int
+refreshq_key(const isc_sockaddr_t *primary, unsigned char *key) {
+	isc_netaddr_t netaddr;
+	in_port_t port;
+
+	if (primary == NULL) {
+		key[0] = 0;
+		return (1);
+	}
+
+	isc_netaddr_fromsockaddr(&netaddr, primary);
+	port = isc_sockaddr_getport(primary);
+	key[0] = (unsigned char)netaddr.family;
+	key[1] = (unsigned char)(port >> 8);
+	key[2] = (unsigned char)(port & 0xff);
+	switch (netaddr.family) {
+	case AF_INET:
+		memmove(key + 3, &netaddr.type.in, 4);
+		return (3 + 4);
+	case AF_INET6:
+		memmove(key + 3, &netaddr.type.in6, 16);
+		return (3 + 16);
+	default:
+		return (3);
+	}
+}
+
+/*
+ * Queue the SOA query event '*eventp' behind the others waiting for
+ * 'primary', to be sent to 'task' when its batch is released.  When
+ * it starts a new batch for the primary, a release event for the
+ * batch is queued with the rate limiter.
+ */
+static isc_result_t
+refreshq_enqueue(dns_refreshq_t *refreshq, const isc_sockaddr_t *primary,
+		 isc_task_t *task, isc_event_t **eventp)
+{
+	dns_refreshprimary_t *rp = NULL;
+	isc_event_t *release = NULL;
+	unsigned char key[REFRESHQ_KEYSIZE];
+	unsigned int keysize;
+	isc_boolean_t added = ISC_FALSE;
+	isc_result_t result;
+
+	REQUIRE(task != NULL);
+	REQUIRE(eventp != NULL && *eventp != NULL);
+	REQUIRE((*eventp)->ev_sender == NULL);
+
+	keysize = refreshq_key(primary, key);
+
+	LOCK(&refreshq->lock);
+	if (refreshq->shuttingdown) {
+		result = ISC_R_SHUTTINGDOWN;
+		goto unlock;
+	}
+
+	result = isc_ht_find(refreshq->primaries, key, keysize, (void **)&rp);
+	if (result != ISC_R_SUCCESS) {
+		rp = isc_mem_get(refreshq->mctx, sizeof(*rp));
+		if (rp == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto unlock;
+		}
+		ISC_LIST_INIT(rp->queries);
+		rp->count = 0;
+		memmove(rp->key, key, keysize);
+		rp->keysize = keysize;
+		ISC_LINK_INIT(rp, link);
+		result = isc_ht_add(refreshq->primaries, rp->key,
+				    rp->keysize, rp);
+		if (result != ISC_R_SUCCESS) {
+			isc_mem_put(refreshq->mctx, rp, sizeof(*rp));
+			goto unlock;
+		}
+		added = ISC_TRUE;
+	}
+
+	if (rp->count % refreshq->batch == 0) {
+		release = isc_event_allocate(refreshq->mctx, NULL,
+					     DNS_EVENT_ZONE, refreshq_release,
+					     refreshq, sizeof(isc_event_t));
+		if (release == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+		/*
+		 * If the rate limiter is idle the release is sent at
+		 * once; it will wait for the lock we hold, by which time
+		 * the query is on the queue.
+		 */
+		result = isc_ratelimiter_enqueue(refreshq->rl, refreshq->task,
+						 &release);
+		if (result != ISC_R_SUCCESS) {
+			isc_event_free(&release);
+			goto cleanup;
+		}
+		refreshq->refs++;
+		refreshq->releases++;
+	}
+
+	if (added)
+		ISC_LIST_APPEND(refreshq->active, rp, link);
+	(*eventp)->ev_sender = task;
+	ISC_LIST_APPEND(rp->queries, *eventp, ev_link);
+	*eventp = NULL;
+	rp->count++;
+	refreshq->queued++;
+	result = ISC_R_SUCCESS;
+	goto unlock;
+
+ cleanup:
+	if (added) {
+		(void)isc_ht_delete(refreshq->primaries, rp->key,
+				    rp->keysize);
+		isc_mem_put(refreshq->mctx, rp, sizeof(*rp));
+	}
+ unlock:
+	UNLOCK(&refreshq->lock);
+	return (result);
+}
+
+/*
+ * Move up to 'max' of the queries waiting for 'rp' to 'queries',
+ * marking them canceled if 'canceled' is set, and forget 'rp' once
+ * it has none left.
+ */
+static void
+refreshq_take(dns_refreshq_t *refreshq, dns_refreshprimary_t *rp,
+	      unsigned int max, isc_boolean_t canceled,
+	      isc_eventlist_t *queries)
+{
+	isc_event_t *e;
+
+	while (max-- > 0 && (e = ISC_LIST_HEAD(rp->queries)) != NULL) {
+		ISC_LIST_UNLINK(rp->queries, e, ev_link);
+		if (canceled)
+			e->ev_attributes |= ISC_EVENTATTR_CANCELED;
+		ISC_LIST_APPEND(*queries, e, ev_link);
+		rp->count--;
+		refreshq->queued--;
+	}
+
+	ISC_LIST_UNLINK(refreshq->active, rp, link);
+	if (rp->count != 0) {
+		ISC_LIST_APPEND(refreshq->active, rp, link);
+		return;
+	}
+	(void)isc_ht_delete(refreshq->primaries, rp->key, rp->keysize);
+	isc_mem_put(refreshq->mctx, rp, sizeof(*rp));
+}
+
+/*
+ * The rate limiter has released a batch: send the next batch of the
+ * primary whose turn it is.  Once the rate limiter is shutting down
+ * every query still waiting is sent at once, marked as canceled.
+ */
+static void
+refreshq_release(isc_task_t *task, isc_event_t *event) {
+	dns_refreshq_t *refreshq = event->ev_arg;
+	dns_refreshprimary_t *rp;
+	isc_eventlist_t queries;
+	isc_event_t *e;
+
+	UNUSED(task);
+
+	ISC_LIST_INIT(queries);
+	LOCK(&refreshq->lock);
+	INSIST(refreshq->releases > 0);
+	refreshq->releases--;
+	if ((event->ev_attributes & ISC_EVENTATTR_CANCELED) != 0) {
+		refreshq->shuttingdown = ISC_TRUE;
+		while ((rp = ISC_LIST_HEAD(refreshq->active)) != NULL)
+			refreshq_take(refreshq, rp, ISC_UINT32_MAX, ISC_TRUE,
+				      &queries);
+	} else if ((rp = ISC_LIST_HEAD(refreshq->active)) != NULL) {
+		refreshq_take(refreshq, rp, refreshq->batch, ISC_FALSE,
+			      &queries);
+	}
+	/*
+	 * A change of batch size can leave fewer releases queued than
+	 * batches waiting; make sure there is always at least one while
+	 * any query is.
+	 */
+	if (refreshq->queued != 0 && refreshq->releases == 0) {
+		event->ev_sender = NULL;
+		if (!refreshq->shuttingdown &&
+		    isc_ratelimiter_enqueue(refreshq->rl, refreshq->task,
+					    &event) == ISC_R_SUCCESS)
+		{
+			refreshq->releases++;
+		} else {
+			refreshq->shuttingdown = ISC_TRUE;
+			while ((rp = ISC_LIST_HEAD(refreshq->active)) != NULL)
+				refreshq_take(refreshq, rp, ISC_UINT32_MAX,
+					      ISC_TRUE, &queries);
+		}
+	}
+	UNLOCK(&refreshq->lock);
+
+	while ((e = ISC_LIST_HEAD(queries)) != NULL) {
+		isc_task_t *evtask = e->ev_sender;
+
+		ISC_LIST_UNLINK(queries, e, ev_link);
+		isc_task_send(evtask, &e);
+	}
+
+	if (event != NULL) {
+		isc_event_free(&event);
+		refreshq_detach(&refreshq);
+	}
+}
+
 static inline isc_result_t
 create_query(dns_zone_t *zone, dns_rdatatype_t rdtype,
 	     dns_message_t **messagep)
@@ -12375,6 +12982,13 @@ soa_query(isc_task_t *task, isc_event_t *event) {
 		}
 	}
 
+	/*
+	 * SOA queries over TCP to the same master are pipelined over
+	 * one connection.
+	 */
+	if ((options & DNS_REQUESTOPT_TCP) != 0)
+		options |= DNS_REQUESTOPT_SHARE;
+
 	switch (isc_sockaddr_pf(&zone->masteraddr)) {
 	case PF_INET:
 		if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_USEALTXFRSRC)) {
@@ -12948,6 +13562,8 @@ zone_settimer(dns_zone_t *zone, isc_time_t *now) {
 
 	if (isc_time_isepoch(&next)) {
 		zone_debuglog(zone, me, 10, "settimer inactive");
+		if (zone->timer == NULL)
+			return;
 		result = isc_timer_reset(zone->timer, isc_timertype_inactive,
 					  NULL, NULL, ISC_TRUE);
 		if (result != ISC_R_SUCCESS)
@@ -12957,6 +13573,30 @@ zone_settimer(dns_zone_t *zone, isc_time_t *now) {
 	} else {
 		if (isc_time_compare(&next, now) <= 0)
 			next = *now;
+		if (zone->timer == NULL) {
+			/*
+			 * The timer is only created once the zone first
+			 * has something to do; many never do.
+			 */
+			if (zone->zmgr == NULL)
+				return;
+			result = isc_timer_create(zone->zmgr->timermgr,
+						  isc_timertype_inactive,
+						  NULL, NULL, zone->task,
+						  zone_timer, zone,
+						  &zone->timer);
+			if (result != ISC_R_SUCCESS) {
+				dns_zone_log(zone, ISC_LOG_ERROR,
+					     "could not create zone timer: %s",
+					     isc_result_totext(result));
+				return;
+			}
+			/*
+			 * The timer "holds" a iref.
+			 */
+			zone->irefs++;
+			INSIST(zone->irefs != 0);
+		}
 		result = isc_timer_reset(zone->timer, isc_timertype_once,
 					 &next, NULL, ISC_TRUE);
 		if (result != ISC_R_SUCCESS)
@@ -13872,6 +14512,20 @@ dns_zone_gettask(dns_zone_t *zone, isc_task_t **target) {
 	isc_task_attach(zone->task, target);
 }
 
+isc_result_t
+dns_zone_createtask(dns_zone_t *zone, isc_task_t **target) {
+	isc_result_t result = ISC_R_NOTFOUND;
+
+	REQUIRE(DNS_ZONE_VALID(zone));
+	REQUIRE(target != NULL && *target == NULL);
+
+	LOCK_ZONE(zone);
+	if (zone->zmgr != NULL)
+		result = isc_task_create(zone->zmgr->taskmgr, 0, target);
+	UNLOCK_ZONE(zone);
+	return (result);
+}
+
 void
 dns_zone_setidlein(dns_zone_t *zone, isc_uint32_t idlein) {
 	REQUIRE(DNS_ZONE_VALID(zone));
@@ -15282,12 +15936,14 @@ zone_xfrdone(dns_zone_t *zone, isc_result_t result) {
 	/*
 	 * Handle any deferred journal compaction.
 	 */
-	if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_NEEDCOMPACT)) {
+	if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_NEEDCOMPACT) &&
+	    !DNS_ZONE_FLAG(zone, DNS_ZONEFLG_EXITING))
+	{
 		dns_db_t *db = NULL;
 		if (dns_zone_getdb(zone, &db) == ISC_R_SUCCESS) {
+			DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_NEEDCOMPACT);
 			zone_journal_compact(zone, db, zone->compact_serial);
 			dns_db_detach(&db);
-			DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_NEEDCOMPACT);
 		}
 	}
 
@@ -15942,6 +16598,7 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	zmgr->refreshrl = NULL;
 	zmgr->startupnotifyrl = NULL;
 	zmgr->startuprefreshrl = NULL;
+	zmgr->refreshq = NULL;
 	ISC_LIST_INIT(zmgr->zones);
 	ISC_LIST_INIT(zmgr->waiting_for_xfrin);
 	ISC_LIST_INIT(zmgr->xfrin_in_progress);
@@ -15992,6 +16649,10 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	isc_ratelimiter_setpushpop(zmgr->startupnotifyrl, ISC_TRUE);
 	isc_ratelimiter_setpushpop(zmgr->startuprefreshrl, ISC_TRUE);
 
+	result = refreshq_create(zmgr, &zmgr->refreshq);
+	if (result != ISC_R_SUCCESS)
+		goto free_startuprefreshrl;
+
 	zmgr->iolimit = 1;
 	zmgr->ioactive = 0;
 	ISC_LIST_INIT(zmgr->high);
@@ -15999,7 +16660,7 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 
 	result = isc_mutex_init(&zmgr->iolock);
 	if (result != ISC_R_SUCCESS)
-		goto free_startuprefreshrl;
+		goto free_refreshq;
 
 	zmgr->magic = ZONEMGR_MAGIC;
 
@@ -16010,6 +16671,8 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
  free_iolock:
 	DESTROYLOCK(&zmgr->iolock);
 #endif
+ free_refreshq:
+	refreshq_detach(&zmgr->refreshq);
  free_startuprefreshrl:
 	isc_ratelimiter_detach(&zmgr->startuprefreshrl);
  free_startupnotifyrl:
@@ -16059,8 +16722,6 @@ dns_zonemgr_createzone(dns_zonemgr_t *zmgr, dns_zone_t **zonep) {
 
 isc_result_t
 dns_zonemgr_managezone(dns_zonemgr_t *zmgr, dns_zone_t *zone) {
-	isc_result_t result;
-
 	REQUIRE(DNS_ZONE_VALID(zone));
 	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
 
@@ -16084,34 +16745,16 @@ dns_zonemgr_managezone(dns_zonemgr_t *zmgr, dns_zone_t *zone) {
 	isc_task_setname(zone->task, "zone", zone);
 	isc_task_setname(zone->loadtask, "loadzone", zone);
 
-	result = isc_timer_create(zmgr->timermgr, isc_timertype_inactive,
-				  NULL, NULL,
-				  zone->task, zone_timer, zone,
-				  &zone->timer);
-
-	if (result != ISC_R_SUCCESS)
-		goto cleanup_tasks;
-
 	/*
-	 * The timer "holds" a iref.
+	 * The zone timer is created by zone_settimer() when first needed.
 	 */
-	zone->irefs++;
-	INSIST(zone->irefs != 0);
-
 	ISC_LIST_APPEND(zmgr->zones, zone, link);
 	zone->zmgr = zmgr;
 	zmgr->refs++;
 
-	goto unlock;
-
- cleanup_tasks:
-	isc_task_detach(&zone->loadtask);
-	isc_task_detach(&zone->task);
-
- unlock:
 	UNLOCK_ZONE(zone);
 	RWUNLOCK(&zmgr->rwlock, isc_rwlocktype_write);
-	return (result);
+	return (ISC_R_SUCCESS);
 }
 
 void
@@ -16219,6 +16862,7 @@ dns_zonemgr_shutdown(dns_zonemgr_t *zmgr) {
 	isc_ratelimiter_shutdown(zmgr->refreshrl);
 	isc_ratelimiter_shutdown(zmgr->startupnotifyrl);
 	isc_ratelimiter_shutdown(zmgr->startuprefreshrl);
+	refreshq_shutdown(zmgr->refreshq);
 
 	if (zmgr->task != NULL)
 		isc_task_destroy(&zmgr->task);
@@ -16352,6 +16996,7 @@ zonemgr_free(dns_zonemgr_t *zmgr) {
 	isc_ratelimiter_detach(&zmgr->refreshrl);
 	isc_ratelimiter_detach(&zmgr->startupnotifyrl);
 	isc_ratelimiter_detach(&zmgr->startuprefreshrl);
+	refreshq_detach(&zmgr->refreshq);
 
 	isc_rwlock_destroy(&zmgr->urlock);
 	isc_rwlock_destroy(&zmgr->rwlock);
@@ -16757,6 +17402,19 @@ dns_zonemgr_setserialqueryrate(dns_zonemgr_t *zmgr, unsigned int value) {
 	setrl(zmgr->startuprefreshrl, &zmgr->startupserialqueryrate, value);
 }
 
+void
+dns_zonemgr_setserialquerybatch(dns_zonemgr_t *zmgr, unsigned int value) {
+
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	if (value == 0)
+		value = 1;
+
+	LOCK(&zmgr->refreshq->lock);
+	zmgr->refreshq->batch = value;
+	UNLOCK(&zmgr->refreshq->lock);
+}
+
 unsigned int
 dns_zonemgr_getnotifyrate(dns_zonemgr_t *zmgr) {
 	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
@@ -16778,6 +17436,53 @@ dns_zonemgr_getserialqueryrate(dns_zonemgr_t *zmgr) {
 	return (zmgr->serialqueryrate);
 }
 
+unsigned int
+dns_zonemgr_getserialquerybatch(dns_zonemgr_t *zmgr) {
+	unsigned int value;
+
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	LOCK(&zmgr->refreshq->lock);
+	value = zmgr->refreshq->batch;
+	UNLOCK(&zmgr->refreshq->lock);
+
+	return (value);
+}
+
+isc_result_t
+dns__zonemgr_refreshqenqueue(dns_zonemgr_t *zmgr,
+			     const isc_sockaddr_t *primary,
+			     isc_task_t *task, isc_event_t **eventp)
+{
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	return (refreshq_enqueue(zmgr->refreshq, primary, task, eventp));
+}
+
+void
+dns__zonemgr_refreshqstall(dns_zonemgr_t *zmgr, isc_boolean_t stall) {
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	if (stall)
+		(void)isc_ratelimiter_stall(zmgr->refreshrl);
+	else
+		(void)isc_ratelimiter_release(zmgr->refreshrl);
+}
+
+void
+dns_zonemgr_getrefreshqueue(dns_zonemgr_t *zmgr, unsigned int *queriesp,
+			    unsigned int *primariesp)
+{
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+	REQUIRE(queriesp != NULL);
+	REQUIRE(primariesp != NULL);
+
+	LOCK(&zmgr->refreshq->lock);
+	*queriesp = zmgr->refreshq->queued;
+	*primariesp = (unsigned int)isc_ht_count(zmgr->refreshq->primaries);
+	UNLOCK(&zmgr->refreshq->lock);
+}
+
 isc_boolean_t
 dns_zonemgr_unreachable(dns_zonemgr_t *zmgr, isc_sockaddr_t *remote,
 			isc_sockaddr_t *local, isc_time_t *now)
@@ -17215,6 +17920,12 @@ dns_zone_setcheckns(dns_zone_t *zone, dns_checknsfunc_t checkns) {
 	zone->checkns = checkns;
 }
 
+void
+dns_zone_setcheckstart(dns_zone_t *zone, dns_checkstartfunc_t checkstart) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+	zone->checkstart = checkstart;
+}
+
 void
 dns_zone_setisself(dns_zone_t *zone, dns_isselffunc_t isself, void *arg) {
 	REQUIRE(DNS_ZONE_VALID(zone));
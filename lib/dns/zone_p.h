@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_ZONE_P_H
+#define DNS_ZONE_P_H
+
+/*! \file */
+
+#include <isc/event.h>
+#include <isc/result.h>
+#include <isc/sockaddr.h>
+#include <isc/task.h>
+
+#include <dns/types.h>
+
+/*%
+ *     These functions must not be used outside this module and
+ *     its associated unit tests.
+ */
+
+ISC_LANG_BEGINDECLS
+
+isc_result_t
+dns__zonemgr_refreshqenqueue(dns_zonemgr_t *zmgr,
+			     const isc_sockaddr_t *primary,
+			     isc_task_t *task, isc_event_t **eventp);
+/*%<
+ * Queue '*eventp' with the SOA queries waiting for 'primary', to be
+ * sent to 'task' when the serial query rate limiter releases it.
+ */
+
+void
+dns__zonemgr_refreshqstall(dns_zonemgr_t *zmgr, isc_boolean_t stall);
+/*%<
+ * Stop the serial query rate limiter from releasing queries if 'stall'
+ * is set, or let it carry on if not.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_ZONE_P_H */
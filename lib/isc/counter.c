@@ -15,23 +15,72 @@
 
 #include <stddef.h>
 
+#include <isc/atomic.h>
 #include <isc/counter.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
+#include <isc/platform.h>
+#include <isc/refcount.h>
 #include <isc/util.h>
 
+#if defined(ISC_PLATFORM_HAVESTDATOMIC)
+#include <stdint.h>
+#include <stdatomic.h>
+#endif
+
 #define COUNTER_MAGIC			ISC_MAGIC('C', 'n', 't', 'r')
 #define VALID_COUNTER(r)		ISC_MAGIC_VALID(r, COUNTER_MAGIC)
 
+#ifdef ISC_PLATFORM_USETHREADS
+#if (defined(ISC_PLATFORM_HAVESTDATOMIC) && defined(ATOMIC_INT_LOCK_FREE)) || (defined(ISC_PLATFORM_HAVEXADD) && defined(ISC_PLATFORM_HAVECMPXCHG))
+#define COUNTER_USEATOMIC 1
+#if (defined(ISC_PLATFORM_HAVESTDATOMIC) && defined(ATOMIC_INT_LOCK_FREE))
+#define COUNTER_USESTDATOMIC 1
+#endif
+#endif
+#endif
+
 struct isc_counter {
 	unsigned int	magic;
 	isc_mem_t	*mctx;
+	isc_refcount_t	references;
+#if defined(COUNTER_USESTDATOMIC)
+	/* Read or modified atomically. */
+	atomic_int_fast32_t	limit;
+	atomic_int_fast32_t	used;
+#elif defined(COUNTER_USEATOMIC)
+	/* Read or modified atomically. */
+	isc_int32_t	limit;
+	isc_int32_t	used;
+#else
 	isc_mutex_t	lock;
-	unsigned int	references;
 	unsigned int	limit;
 	unsigned int	used;
+#endif
 };
 
+#if defined(COUNTER_USESTDATOMIC)
+#define COUNTER_LOAD(p) \
+	((unsigned int)atomic_load_explicit((p), memory_order_relaxed))
+#define COUNTER_STORE(p, v) \
+	atomic_store_explicit((p), (v), memory_order_relaxed)
+#define COUNTER_INCR(p) \
+	((unsigned int)atomic_fetch_add_explicit((p), 1, memory_order_relaxed))
+#elif defined(COUNTER_USEATOMIC)
+#define COUNTER_LOAD(p)		((unsigned int)isc_atomic_xadd((p), 0))
+#define COUNTER_STORE(p, v)	counter_store((p), (v))
+#define COUNTER_INCR(p)		((unsigned int)isc_atomic_xadd((p), 1))
+
+static void
+counter_store(isc_int32_t *p, isc_int32_t val) {
+	isc_int32_t prev;
+
+	do {
+		prev = isc_atomic_xadd(p, 0);
+	} while (isc_atomic_cmpxchg(p, prev, val) != prev);
+}
+#endif
+
 isc_result_t
 isc_counter_create(isc_mem_t *mctx, int limit, isc_counter_t **counterp) {
 	isc_result_t result;
@@ -43,18 +92,30 @@ isc_counter_create(isc_mem_t *mctx, int limit, isc_counter_t **counterp) {
 	if (counter == NULL)
 		return (ISC_R_NOMEMORY);
 
-	result = isc_mutex_init(&counter->lock);
+	result = isc_refcount_init(&counter->references, 1);
 	if (result != ISC_R_SUCCESS) {
 		isc_mem_put(mctx, counter, sizeof(*counter));
 		return (result);
 	}
 
-	counter->mctx = NULL;
-	isc_mem_attach(mctx, &counter->mctx);
+#if defined(COUNTER_USEATOMIC)
+	COUNTER_STORE(&counter->limit, limit);
+	COUNTER_STORE(&counter->used, 0);
+#else
+	result = isc_mutex_init(&counter->lock);
+	if (result != ISC_R_SUCCESS) {
+		isc_refcount_decrement(&counter->references, NULL);
+		isc_refcount_destroy(&counter->references);
+		isc_mem_put(mctx, counter, sizeof(*counter));
+		return (result);
+	}
 
-	counter->references = 1;
 	counter->limit = limit;
 	counter->used = 0;
+#endif
+
+	counter->mctx = NULL;
+	isc_mem_attach(mctx, &counter->mctx);
 
 	counter->magic = COUNTER_MAGIC;
 	*counterp = counter;
@@ -64,12 +125,22 @@ isc_counter_create(isc_mem_t *mctx, int limit, isc_counter_t **counterp) {
 isc_result_t
 isc_counter_increment(isc_counter_t *counter) {
 	isc_result_t result = ISC_R_SUCCESS;
+	unsigned int used, limit;
+
+	REQUIRE(VALID_COUNTER(counter));
 
+#if defined(COUNTER_USEATOMIC)
+	used = COUNTER_INCR(&counter->used) + 1;
+	limit = COUNTER_LOAD(&counter->limit);
+#else
 	LOCK(&counter->lock);
-	counter->used++;
-	if (counter->limit != 0 && counter->used >= counter->limit)
-		result = ISC_R_QUOTA;
+	used = ++counter->used;
+	limit = counter->limit;
 	UNLOCK(&counter->lock);
+#endif
+
+	if (limit != 0 && used >= limit)
+		result = ISC_R_QUOTA;
 
 	return (result);
 }
@@ -78,16 +149,24 @@ unsigned int
 isc_counter_used(isc_counter_t *counter) {
 	REQUIRE(VALID_COUNTER(counter));
 
+#if defined(COUNTER_USEATOMIC)
+	return (COUNTER_LOAD(&counter->used));
+#else
 	return (counter->used);
+#endif
 }
 
 void
 isc_counter_setlimit(isc_counter_t *counter, int limit) {
 	REQUIRE(VALID_COUNTER(counter));
 
+#if defined(COUNTER_USEATOMIC)
+	COUNTER_STORE(&counter->limit, limit);
+#else
 	LOCK(&counter->lock);
 	counter->limit = limit;
 	UNLOCK(&counter->lock);
+#endif
 }
 
 void
@@ -95,10 +174,7 @@ isc_counter_attach(isc_counter_t *source, isc_counter_t **targetp) {
 	REQUIRE(VALID_COUNTER(source));
 	REQUIRE(targetp != NULL && *targetp == NULL);
 
-	LOCK(&source->lock);
-	source->references++;
-	INSIST(source->references > 0);
-	UNLOCK(&source->lock);
+	isc_refcount_increment(&source->references, NULL);
 
 	*targetp = source;
 }
@@ -106,14 +182,17 @@ isc_counter_attach(isc_counter_t *source, isc_counter_t **targetp) {
 static void
 destroy(isc_counter_t *counter) {
 	counter->magic = 0;
+	isc_refcount_destroy(&counter->references);
+#if !defined(COUNTER_USEATOMIC)
 	isc_mutex_destroy(&counter->lock);
+#endif
 	isc_mem_putanddetach(&counter->mctx, counter, sizeof(*counter));
 }
 
 void
 isc_counter_detach(isc_counter_t **counterp) {
 	isc_counter_t *counter;
-	isc_boolean_t want_destroy = ISC_FALSE;
+	unsigned int references;
 
 	REQUIRE(counterp != NULL && *counterp != NULL);
 	counter = *counterp;
@@ -121,13 +200,7 @@ isc_counter_detach(isc_counter_t **counterp) {
 
 	*counterp = NULL;
 
-	LOCK(&counter->lock);
-	INSIST(counter->references > 0);
-	counter->references--;
-	if (counter->references == 0)
-		want_destroy = ISC_TRUE;
-	UNLOCK(&counter->lock);
-
-	if (want_destroy)
+	isc_refcount_decrement(&counter->references, &references);
+	if (references == 0)
 		destroy(counter);
 }
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef ISC_ASCII_H
+#define ISC_ASCII_H 1
+
+/*! \file isc/ascii.h
+ * \brief
+ * Case-insensitive comparison and case folding of runs of octets, as
+ * DNS names need: only the ASCII letters 'A' to 'Z' are folded, every
+ * other octet value (including the label lengths in wire format, which
+ * are all below 'A') compares and copies as itself.
+ *
+ * The functions work on 16 octets at a time with SSE2 when the
+ * compiler targets it (it is part of the x86-64 baseline), and on 8
+ * octets at a time in a 64-bit integer otherwise, finishing the last
+ * few octets one by one.  They never read past the end of the runs.
+ */
+
+#include <string.h>
+
+#include <isc/boolean.h>
+#include <isc/int.h>
+#include <isc/lang.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ISC_ASCII_SSE2 1
+#endif
+
+ISC_LANG_BEGINDECLS
+
+static inline unsigned int
+isc_ascii_tolower(unsigned int c) {
+	/*
+	 * Add 0x20 to 'A' ... 'Z'.  The unsigned subtraction wraps for
+	 * octets below 'A', so one comparison covers both ends.
+	 */
+	return (c + ((c - 'A' < 26U) << 5));
+}
+/*%<
+ * Fold one octet to lower case.
+ */
+
+static inline isc_uint64_t
+isc_ascii_load8(const unsigned char *p) {
+	isc_uint64_t octets;
+
+	memmove(&octets, p, sizeof(octets));
+	return (octets);
+}
+
+static inline isc_uint64_t
+isc_ascii_tolower8(isc_uint64_t octets) {
+	/*
+	 * For every octet below 0x80, adding (0x80 - 'A') sets its top
+	 * bit when it is >= 'A' and adding (0x7f - 'Z') sets it when it
+	 * is > 'Z'; the octets where exactly one of the two is set are
+	 * upper case letters.  Masking the octets to seven bits first
+	 * keeps the additions from carrying into the next octet.
+	 */
+	isc_uint64_t all = ~(isc_uint64_t)0 / 0xff;	/* 0x0101...01 */
+	isc_uint64_t heptets = octets & (0x7f * all);
+	isc_uint64_t is_gt_z = heptets + (0x7f - 'Z') * all;
+	isc_uint64_t is_ge_a = heptets + (0x80 - 'A') * all;
+	isc_uint64_t is_upper = ~octets & (is_ge_a ^ is_gt_z) & (0x80 * all);
+
+	return (octets | (is_upper >> 2));
+}
+/*%<
+ * Fold eight octets packed in an integer to lower case.
+ */
+
+#ifdef ISC_ASCII_SSE2
+static inline __m128i
+isc_ascii_tolower16(__m128i octets) {
+	/*
+	 * The comparisons are signed, so octets >= 0x80 are negative
+	 * and are left alone.
+	 */
+	__m128i ge_a = _mm_cmpgt_epi8(octets, _mm_set1_epi8('A' - 1));
+	__m128i le_z = _mm_cmplt_epi8(octets, _mm_set1_epi8('Z' + 1));
+	__m128i upper = _mm_and_si128(ge_a, le_z);
+
+	return (_mm_or_si128(octets,
+			     _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+}
+#endif
+
+static inline isc_boolean_t
+isc_ascii_lowerequal(const unsigned char *a, const unsigned char *b,
+		     unsigned int len)
+{
+#ifdef ISC_ASCII_SSE2
+	while (len >= 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(const void *)a);
+		__m128i vb = _mm_loadu_si128((const __m128i *)(const void *)b);
+		__m128i eq = _mm_cmpeq_epi8(isc_ascii_tolower16(va),
+					    isc_ascii_tolower16(vb));
+		if (_mm_movemask_epi8(eq) != 0xffff)
+			return (ISC_FALSE);
+		a += 16;
+		b += 16;
+		len -= 16;
+	}
+#endif
+	while (len >= 8) {
+		if (isc_ascii_tolower8(isc_ascii_load8(a)) !=
+		    isc_ascii_tolower8(isc_ascii_load8(b)))
+			return (ISC_FALSE);
+		a += 8;
+		b += 8;
+		len -= 8;
+	}
+	while (len-- > 0) {
+		if (isc_ascii_tolower(*a++) != isc_ascii_tolower(*b++))
+			return (ISC_FALSE);
+	}
+	return (ISC_TRUE);
+}
+/*%<
+ * Return ISC_TRUE if the 'len' octets at 'a' and 'b' are equal when
+ * folded to lower case.
+ */
+
+static inline int
+isc_ascii_lowercmp(const unsigned char *a, const unsigned char *b,
+		   unsigned int len)
+{
+	int diff;
+
+	/*
+	 * Skip the equal words, then find the first different octet.
+	 */
+	while (len >= 8) {
+		if (isc_ascii_tolower8(isc_ascii_load8(a)) !=
+		    isc_ascii_tolower8(isc_ascii_load8(b)))
+			break;
+		a += 8;
+		b += 8;
+		len -= 8;
+	}
+	while (len-- > 0) {
+		diff = (int)isc_ascii_tolower(*a++) -
+		       (int)isc_ascii_tolower(*b++);
+		if (diff != 0)
+			return (diff);
+	}
+	return (0);
+}
+/*%<
+ * Compare the 'len' octets at 'a' and 'b' folded to lower case and
+ * return the difference between the first pair of folded octets that
+ * differ, or 0 if there is none.
+ */
+
+static inline void
+isc_ascii_lowercopy(unsigned char *dst, const unsigned char *src,
+		    unsigned int len)
+{
+	isc_uint64_t octets;
+
+#ifdef ISC_ASCII_SSE2
+	while (len >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(const void *)src);
+		_mm_storeu_si128((__m128i *)(void *)dst,
+				 isc_ascii_tolower16(v));
+		dst += 16;
+		src += 16;
+		len -= 16;
+	}
+#endif
+	while (len >= 8) {
+		octets = isc_ascii_tolower8(isc_ascii_load8(src));
+		memmove(dst, &octets, sizeof(octets));
+		dst += 8;
+		src += 8;
+		len -= 8;
+	}
+	while (len-- > 0)
+		*dst++ = (unsigned char)isc_ascii_tolower(*src++);
+}
+/*%<
+ * Copy 'len' octets from 'src' to 'dst', folding them to lower case.
+ * 'src' and 'dst' may be the same but must not otherwise overlap.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* ISC_ASCII_H */
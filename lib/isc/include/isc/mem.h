@@ -470,6 +470,15 @@ isc_mem_checkdestroyed(FILE *file);
  * Fatally fails if there are still active contexts.
  */
 
+isc_uint64_t
+isc_mem_totalgets(void);
+/*%<
+ * Return the number of allocations made so far from all memory
+ * contexts that have not been destroyed.  Memory pools count an
+ * allocation each time they refill from their context, not for each
+ * item they hand out.
+ */
+
 unsigned int
 isc_mem_references(isc_mem_t *ctx);
 /*%<
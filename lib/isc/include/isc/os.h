@@ -17,9 +17,20 @@
 /*! \file isc/os.h */
 
 #include <isc/lang.h>
+#include <isc/platform.h>
+#include <isc/types.h>
 
 ISC_LANG_BEGINDECLS
 
+LIBISC_EXTERNAL_DATA extern isc_boolean_t isc_os_affinity;
+/*%<
+ * If set before the task, timer and socket managers are created, their
+ * threads are bound to CPUs: each task manager worker to a CPU of its
+ * own, spread evenly across the NUMA nodes, and the timer and socket
+ * threads to the CPUs of the first node.  The task manager then keeps a
+ * separate run queue for each node.  Defaults to ISC_FALSE.
+ */
+
 unsigned int
 isc_os_ncpus(void);
 /*%<
@@ -27,6 +38,39 @@ isc_os_ncpus(void);
  * be determined.
  */
 
+unsigned int
+isc_os_numanodes(void);
+/*%<
+ * Return the number of NUMA nodes which have CPUs this process may run
+ * on, or 1 if the topology cannot be determined.  Nodes are numbered
+ * from 0 to isc_os_numanodes() - 1 in the order the system numbers them,
+ * skipping nodes without usable CPUs.
+ */
+
+unsigned int
+isc_os_nodencpus(unsigned int node);
+/*%<
+ * Return the number of usable CPUs on NUMA node 'node', or 0 if there
+ * is no such node.
+ */
+
+unsigned int
+isc_os_nodecpu(unsigned int node, unsigned int n);
+/*%<
+ * Return the system identifier of the 'n'th usable CPU on NUMA node
+ * 'node', counting modulo isc_os_nodencpus(node).
+ *
+ * Requires:
+ *\li	node < isc_os_numanodes()
+ */
+
+unsigned int
+isc_os_currentnode(void);
+/*%<
+ * Return the NUMA node of the CPU the calling thread is running on, or 0
+ * if this cannot be determined.
+ */
+
 ISC_LANG_ENDDECLS
 
 #endif /* ISC_OS_H */
@@ -25,6 +25,11 @@
  * a server.  It keeps track of the amount of quota in use, and
  * encapsulates the locking necessary to allow multiple tasks to
  * share a quota.
+ *
+ * When atomic operations are available the quota is updated without
+ * taking a lock, so reserving and releasing it does not serialize the
+ * callers.  The counters should only be read through the
+ * isc_quota_get*() functions.
  */
 
 /***
@@ -33,20 +38,47 @@
 
 #include <isc/lang.h>
 #include <isc/mutex.h>
+#include <isc/platform.h>
 #include <isc/types.h>
 
+#if defined(ISC_PLATFORM_HAVESTDATOMIC)
+#include <stdint.h>
+#include <stdatomic.h>
+#endif
+
 /*****
  ***** Types.
  *****/
 
 ISC_LANG_BEGINDECLS
 
+#ifdef ISC_PLATFORM_USETHREADS
+#if (defined(ISC_PLATFORM_HAVESTDATOMIC) && defined(ATOMIC_INT_LOCK_FREE)) || (defined(ISC_PLATFORM_HAVEXADD) && defined(ISC_PLATFORM_HAVECMPXCHG))
+#define ISC_QUOTA_USEATOMIC 1
+#if (defined(ISC_PLATFORM_HAVESTDATOMIC) && defined(ATOMIC_INT_LOCK_FREE))
+#define ISC_QUOTA_USESTDATOMIC 1
+#endif
+#endif
+#endif
+
 /*% isc_quota structure */
 struct isc_quota {
-	isc_mutex_t	lock; /*%< Locked by lock. */
-	int 		max;
-	int 		used;
-	int		soft;
+#if defined(ISC_QUOTA_USESTDATOMIC)
+	/* Read or modified atomically. */
+	atomic_int_fast32_t	max;
+	atomic_int_fast32_t	used;
+	atomic_int_fast32_t	soft;
+#elif defined(ISC_QUOTA_USEATOMIC)
+	/* Read or modified atomically. */
+	isc_int32_t		max;
+	isc_int32_t		used;
+	isc_int32_t		soft;
+#else
+	isc_mutex_t		lock; /*%< Locked by lock. */
+	int			max;
+	int			used;
+	int			soft;
+#endif
 };
 
 isc_result_t
@@ -77,6 +109,26 @@ isc_quota_max(isc_quota_t *quota, int max);
  * Re-set a maximum quota.
  */
 
+int
+isc_quota_getmax(isc_quota_t *quota);
+/*%<
+ * Get the maximum quota.
+ */
+
+int
+isc_quota_getsoft(isc_quota_t *quota);
+/*%<
+ * Get the soft quota.
+ */
+
+int
+isc_quota_getused(isc_quota_t *quota);
+/*%<
+ * Get the amount of quota currently in use.  The value may be out of
+ * date by the time it is returned, so it is only suitable for
+ * reporting.
+ */
+
 isc_result_t
 isc_quota_reserve(isc_quota_t *quota);
 /*%<
@@ -86,6 +138,9 @@ isc_quota_reserve(isc_quota_t *quota);
  * \li 	#ISC_R_SUCCESS		Success
  * \li	#ISC_R_SOFTQUOTA	Success soft quota reached
  * \li	#ISC_R_QUOTA		Quota is full
+ *
+ * The quota is never over-committed, even when several threads
+ * reserve it at the same time.
  */
 
 void
@@ -205,6 +205,16 @@ isc_task_create(isc_taskmgr_t *manager, unsigned int quantum,
  *\li	#ISC_R_SHUTTINGDOWN
  */
 
+isc_result_t
+isc_task_create_bound(isc_taskmgr_t *manager, unsigned int quantum,
+		      isc_task_t **taskp, int node);
+/*%<
+ * Like isc_task_create(), but if 'node' is not negative the task's
+ * events are run by preference on NUMA node 'node' (modulo the number
+ * of nodes in use) when the manager's workers are bound to CPUs; see
+ * isc_os_affinity.  Otherwise, tasks are spread evenly across the nodes.
+ */
+
 void
 isc_task_attach(isc_task_t *source, isc_task_t **targetp);
 /*%<
@@ -727,6 +737,18 @@ isc_taskmgr_mode(isc_taskmgr_t *manager);
  *\li      'manager' is a valid task manager.
  */
 
+unsigned int
+isc_taskmgr_nqueues(isc_taskmgr_t *manager);
+/*%<
+ * Return the number of run queues of 'manager': one per NUMA node its
+ * workers are bound to, or 1.  The 'node' passed to
+ * isc_task_create_bound() is taken modulo this number.
+ *
+ * Requires:
+ *
+ *\li      'manager' is a valid task manager.
+ */
+
 void
 isc_taskmgr_destroy(isc_taskmgr_t **managerp);
 /*%<
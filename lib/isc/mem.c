@@ -2319,6 +2319,29 @@ isc_mem_checkdestroyed(FILE *file) {
 	UNLOCK(&contextslock);
 }
 
+isc_uint64_t
+isc_mem_totalgets(void) {
+	isc__mem_t *ctx;
+	isc_uint64_t gets = 0;
+	size_t i;
+
+	RUNTIME_CHECK(isc_once_do(&once, initialize_action) == ISC_R_SUCCESS);
+
+	LOCK(&contextslock);
+	for (ctx = ISC_LIST_HEAD(contexts);
+	     ctx != NULL;
+	     ctx = ISC_LIST_NEXT(ctx, link))
+	{
+		MCTXLOCK(ctx, &ctx->lock);
+		for (i = 0; i <= ctx->max_size; i++)
+			gets += ctx->stats[i].totalgets;
+		MCTXUNLOCK(ctx, &ctx->lock);
+	}
+	UNLOCK(&contextslock);
+
+	return (gets);
+}
+
 unsigned int
 isc_mem_references(isc_mem_t *ctx0) {
 	isc__mem_t *ctx = (isc__mem_t *)ctx0;
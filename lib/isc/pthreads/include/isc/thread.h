@@ -45,6 +45,12 @@ isc_thread_yield(void);
 void
 isc_thread_setname(isc_thread_t thread, const char *name);
 
+isc_result_t
+isc_thread_setaffinity(unsigned int cpu);
+
+isc_result_t
+isc_thread_setnodeaffinity(unsigned int node);
+
 /* XXX We could do fancier error handling... */
 
 #define isc_thread_join(t, rp) \
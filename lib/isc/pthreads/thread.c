@@ -19,9 +19,17 @@
 #include <sched.h>
 #endif
 
+#include <isc/os.h>
 #include <isc/thread.h>
 #include <isc/util.h>
 
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP) && defined(CPU_SET)
+#define USE_AFFINITY
+#ifdef __FreeBSD__
+typedef cpuset_t cpu_set_t;
+#endif
+#endif
+
 #ifndef THREAD_MINSTACKSIZE
 #define THREAD_MINSTACKSIZE		(1024U * 1024)
 #endif
@@ -92,6 +100,55 @@ isc_thread_setname(isc_thread_t thread, const char *name) {
 #endif
 }
 
+/*
+ * Bind the calling thread to 'cpu'.
+ */
+isc_result_t
+isc_thread_setaffinity(unsigned int cpu) {
+#ifdef USE_AFFINITY
+	cpu_set_t set;
+
+	if (cpu >= CPU_SETSIZE)
+		return (ISC_R_RANGE);
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		return (ISC_R_FAILURE);
+	return (ISC_R_SUCCESS);
+#else
+	UNUSED(cpu);
+	return (ISC_R_NOTIMPLEMENTED);
+#endif
+}
+
+/*
+ * Bind the calling thread to all the CPUs of NUMA node 'node' that it
+ * may run on, so the scheduler can still move it between them.
+ */
+isc_result_t
+isc_thread_setnodeaffinity(unsigned int node) {
+#ifdef USE_AFFINITY
+	cpu_set_t set;
+	unsigned int i, cpu, ncpus;
+
+	ncpus = isc_os_nodencpus(node);
+	if (ncpus == 0)
+		return (ISC_R_RANGE);
+	CPU_ZERO(&set);
+	for (i = 0; i < ncpus; i++) {
+		cpu = isc_os_nodecpu(node, i);
+		if (cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &set);
+	}
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		return (ISC_R_FAILURE);
+	return (ISC_R_SUCCESS);
+#else
+	UNUSED(node);
+	return (ISC_R_NOTIMPLEMENTED);
+#endif
+}
+
 void
 isc_thread_yield(void) {
 #if defined(HAVE_SCHED_YIELD)
@@ -17,43 +17,167 @@
 
 #include <stddef.h>
 
+#include <isc/atomic.h>
 #include <isc/quota.h>
 #include <isc/util.h>
 
+#if defined(ISC_QUOTA_USESTDATOMIC)
+#define QUOTA_LOAD(p) \
+	((int)atomic_load_explicit((p), memory_order_relaxed))
+#define QUOTA_STORE(p, v) \
+	atomic_store_explicit((p), (v), memory_order_relaxed)
+#define QUOTA_DECR(p) \
+	((int)atomic_fetch_sub_explicit((p), 1, memory_order_release))
+#elif defined(ISC_QUOTA_USEATOMIC)
+#define QUOTA_LOAD(p)		((int)isc_atomic_xadd((p), 0))
+#define QUOTA_STORE(p, v)	quota_store((p), (v))
+#define QUOTA_DECR(p)		((int)isc_atomic_xadd((p), -1))
+
+static void
+quota_store(isc_int32_t *p, isc_int32_t val) {
+	isc_int32_t prev;
+
+	do {
+		prev = isc_atomic_xadd(p, 0);
+	} while (isc_atomic_cmpxchg(p, prev, val) != prev);
+}
+#endif
+
 isc_result_t
 isc_quota_init(isc_quota_t *quota, int max) {
+#if defined(ISC_QUOTA_USEATOMIC)
+	QUOTA_STORE(&quota->max, max);
+	QUOTA_STORE(&quota->used, 0);
+	QUOTA_STORE(&quota->soft, 0);
+	return (ISC_R_SUCCESS);
+#else
 	quota->max = max;
 	quota->used = 0;
 	quota->soft = 0;
 	return (isc_mutex_init(&quota->lock));
+#endif
 }
 
 void
 isc_quota_destroy(isc_quota_t *quota) {
+#if defined(ISC_QUOTA_USEATOMIC)
+	INSIST(QUOTA_LOAD(&quota->used) == 0);
+	QUOTA_STORE(&quota->max, 0);
+	QUOTA_STORE(&quota->soft, 0);
+#else
 	INSIST(quota->used == 0);
 	quota->max = 0;
 	quota->used = 0;
 	quota->soft = 0;
 	DESTROYLOCK(&quota->lock);
+#endif
 }
 
 void
 isc_quota_soft(isc_quota_t *quota, int soft) {
+#if defined(ISC_QUOTA_USEATOMIC)
+	QUOTA_STORE(&quota->soft, soft);
+#else
 	LOCK(&quota->lock);
 	quota->soft = soft;
 	UNLOCK(&quota->lock);
+#endif
 }
 
 void
 isc_quota_max(isc_quota_t *quota, int max) {
+#if defined(ISC_QUOTA_USEATOMIC)
+	QUOTA_STORE(&quota->max, max);
+#else
 	LOCK(&quota->lock);
 	quota->max = max;
 	UNLOCK(&quota->lock);
+#endif
+}
+
+int
+isc_quota_getmax(isc_quota_t *quota) {
+#if defined(ISC_QUOTA_USEATOMIC)
+	return (QUOTA_LOAD(&quota->max));
+#else
+	int max;
+
+	LOCK(&quota->lock);
+	max = quota->max;
+	UNLOCK(&quota->lock);
+	return (max);
+#endif
+}
+
+int
+isc_quota_getsoft(isc_quota_t *quota) {
+#if defined(ISC_QUOTA_USEATOMIC)
+	return (QUOTA_LOAD(&quota->soft));
+#else
+	int soft;
+
+	LOCK(&quota->lock);
+	soft = quota->soft;
+	UNLOCK(&quota->lock);
+	return (soft);
+#endif
+}
+
+int
+isc_quota_getused(isc_quota_t *quota) {
+#if defined(ISC_QUOTA_USEATOMIC)
+	return (QUOTA_LOAD(&quota->used));
+#else
+	int used;
+
+	LOCK(&quota->lock);
+	used = quota->used;
+	UNLOCK(&quota->lock);
+	return (used);
+#endif
 }
 
 isc_result_t
 isc_quota_reserve(isc_quota_t *quota) {
 	isc_result_t result;
+#if defined(ISC_QUOTA_USEATOMIC)
+	int max, soft;
+#if defined(ISC_QUOTA_USESTDATOMIC)
+	int_fast32_t used;
+#else
+	isc_int32_t used, prev;
+#endif
+
+	/*
+	 * Claim the next unit only if nobody else has claimed it in the
+	 * meantime; otherwise look at the limits again with the new
+	 * count.  Unlike adding first and backing out, this never lets
+	 * 'used' exceed 'max', even briefly.
+	 */
+	used = QUOTA_LOAD(&quota->used);
+	for (;;) {
+		max = QUOTA_LOAD(&quota->max);
+		soft = QUOTA_LOAD(&quota->soft);
+		if (max != 0 && used >= max)
+			return (ISC_R_QUOTA);
+		if (soft == 0 || used < soft)
+			result = ISC_R_SUCCESS;
+		else
+			result = ISC_R_SOFTQUOTA;
+#if defined(ISC_QUOTA_USESTDATOMIC)
+		if (atomic_compare_exchange_weak_explicit(&quota->used,
+							  &used, used + 1,
+							  memory_order_acquire,
+							  memory_order_relaxed))
+			break;
+#else
+		prev = isc_atomic_cmpxchg(&quota->used, used, used + 1);
+		if (prev == used)
+			break;
+		used = prev;
+#endif
+	}
+#else
 	LOCK(&quota->lock);
 	if (quota->max == 0 || quota->used < quota->max) {
 		if (quota->soft == 0 || quota->used < quota->soft)
@@ -64,15 +188,23 @@ isc_quota_reserve(isc_quota_t *quota) {
 	} else
 		result = ISC_R_QUOTA;
 	UNLOCK(&quota->lock);
+#endif
 	return (result);
 }
 
 void
 isc_quota_release(isc_quota_t *quota) {
+#if defined(ISC_QUOTA_USEATOMIC)
+	int prev;
+
+	prev = QUOTA_DECR(&quota->used);
+	INSIST(prev > 0);
+#else
 	LOCK(&quota->lock);
 	INSIST(quota->used > 0);
 	quota->used--;
 	UNLOCK(&quota->lock);
+#endif
 }
 
 isc_result_t
@@ -15,8 +15,7 @@
 
 #include <config.h>
 
-#include <ctype.h>
-
+#include <isc/ascii.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
 #include <isc/string.h>
@@ -25,6 +24,7 @@
 
 typedef struct elt {
 	char *				key;
+	unsigned int			hashval;
 	unsigned int			type;
 	isc_symvalue_t			value;
 	LINK(struct elt)		link;
@@ -122,7 +122,6 @@ static inline unsigned int
 hash(const char *key, isc_boolean_t case_sensitive) {
 	const char *s;
 	unsigned int h = 0;
-	int c;
 
 	/*
 	 * This hash function is similar to the one Ousterhout
@@ -135,26 +134,31 @@ hash(const char *key, isc_boolean_t case_sensitive) {
 		}
 	} else {
 		for (s = key; *s != '\0'; s++) {
-			c = *s;
-			c = tolower((unsigned char)c);
-			h += (h << 3) + c;
+			h += (h << 3) + isc_ascii_tolower((unsigned char)*s);
 		}
 	}
 
 	return (h);
 }
 
-#define FIND(s, k, t, b, e) \
-	b = hash((k), (s)->case_sensitive) % (s)->size; \
+/*
+ * The full hash value is kept in each element so that most mismatches
+ * in a bucket are rejected without comparing the keys.
+ */
+#define FIND(s, k, t, h, b, e) \
+	h = hash((k), (s)->case_sensitive); \
+	b = h % (s)->size; \
 	if ((s)->case_sensitive) { \
 		for (e = HEAD((s)->table[b]); e != NULL; e = NEXT(e, link)) { \
-			if (((t) == 0 || e->type == (t)) && \
+			if (e->hashval == h && \
+			    ((t) == 0 || e->type == (t)) && \
 			    strcmp(e->key, (k)) == 0) \
 				break; \
 		} \
 	} else { \
 		for (e = HEAD((s)->table[b]); e != NULL; e = NEXT(e, link)) { \
-			if (((t) == 0 || e->type == (t)) && \
+			if (e->hashval == h && \
+			    ((t) == 0 || e->type == (t)) && \
 			    strcasecmp(e->key, (k)) == 0) \
 				break; \
 		} \
@@ -164,13 +168,13 @@ isc_result_t
 isc_symtab_lookup(isc_symtab_t *symtab, const char *key, unsigned int type,
 		  isc_symvalue_t *value)
 {
-	unsigned int bucket;
+	unsigned int hv, bucket;
 	elt_t *elt;
 
 	REQUIRE(VALID_SYMTAB(symtab));
 	REQUIRE(key != NULL);
 
-	FIND(symtab, key, type, bucket, elt);
+	FIND(symtab, key, type, hv, bucket, elt);
 
 	if (elt == NULL)
 		return (ISC_R_NOTFOUND);
@@ -203,13 +207,10 @@ grow_table(isc_symtab_t *symtab) {
 		elt_t *elt, *nelt;
 
 		for (elt = HEAD(symtab->table[i]); elt != NULL; elt = nelt) {
-			unsigned int hv;
-
 			nelt = NEXT(elt, link);
 
 			UNLINK(symtab->table[i], elt, link);
-			hv = hash(elt->key, symtab->case_sensitive);
-			APPEND(newtable[hv % newsize], elt, link);
+			APPEND(newtable[elt->hashval % newsize], elt, link);
 		}
 	}
 
@@ -225,14 +226,14 @@ isc_result_t
 isc_symtab_define(isc_symtab_t *symtab, const char *key, unsigned int type,
 		  isc_symvalue_t value, isc_symexists_t exists_policy)
 {
-	unsigned int bucket;
+	unsigned int hv, bucket;
 	elt_t *elt;
 
 	REQUIRE(VALID_SYMTAB(symtab));
 	REQUIRE(key != NULL);
 	REQUIRE(type != 0);
 
-	FIND(symtab, key, type, bucket, elt);
+	FIND(symtab, key, type, hv, bucket, elt);
 
 	if (exists_policy != isc_symexists_add && elt != NULL) {
 		if (exists_policy == isc_symexists_reject)
@@ -259,6 +260,7 @@ isc_symtab_define(isc_symtab_t *symtab, const char *key, unsigned int type,
 	 * well, don't do that!
 	 */
 	DE_CONST(key, elt->key);
+	elt->hashval = hv;
 	elt->type = type;
 	elt->value = value;
 
@@ -275,13 +277,13 @@ isc_symtab_define(isc_symtab_t *symtab, const char *key, unsigned int type,
 
 isc_result_t
 isc_symtab_undefine(isc_symtab_t *symtab, const char *key, unsigned int type) {
-	unsigned int bucket;
+	unsigned int hv, bucket;
 	elt_t *elt;
 
 	REQUIRE(VALID_SYMTAB(symtab));
 	REQUIRE(key != NULL);
 
-	FIND(symtab, key, type, bucket, elt);
+	FIND(symtab, key, type, hv, bucket, elt);
 
 	if (elt == NULL)
 		return (ISC_R_NOTFOUND);
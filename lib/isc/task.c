@@ -28,6 +28,7 @@
 #include <isc/mem.h>
 #include <isc/msgs.h>
 #include <isc/once.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/string.h>
@@ -111,6 +112,7 @@ struct isc__task {
 	char				name[16];
 	void *				tag;
 	/* Locked by task manager lock. */
+	unsigned int			queue;
 	LINK(isc__task_t)		link;
 	LINK(isc__task_t)		ready_link;
 	LINK(isc__task_t)		ready_priority_link;
@@ -127,6 +129,22 @@ struct isc__task {
 
 typedef ISC_LIST(isc__task_t)	isc__tasklist_t;
 
+/*%
+ * A run queue.  There is one for each NUMA node whose CPUs the workers
+ * are bound to (see isc_os_affinity), or else a single one.  A worker
+ * takes tasks from its own queue first and from the others when that
+ * is empty, so a busy node does not leave the others idle.
+ */
+typedef struct isc__taskqueue {
+	isc__tasklist_t			ready_tasks;
+	isc__tasklist_t			ready_priority_tasks;
+#ifdef USE_WORKER_THREADS
+	isc_condition_t			work_available;
+	unsigned int			idle;	/*%< Workers waiting */
+	unsigned int			wakeups; /*%< ... and signalled */
+#endif /* USE_WORKER_THREADS */
+} isc__taskqueue_t;
+
 struct isc__taskmgr {
 	/* Not locked. */
 	isc_taskmgr_t			common;
@@ -135,15 +153,19 @@ struct isc__taskmgr {
 #ifdef ISC_PLATFORM_USETHREADS
 	unsigned int			workers;
 	isc_thread_t *			threads;
+	isc_boolean_t			affinity;
 #endif /* ISC_PLATFORM_USETHREADS */
+	unsigned int			nqueues;
+	isc__taskqueue_t *		queues;
 	/* Locked by task manager lock. */
 	unsigned int			default_quantum;
 	LIST(isc__task_t)		tasks;
-	isc__tasklist_t			ready_tasks;
-	isc__tasklist_t			ready_priority_tasks;
+	unsigned int			nextqueue;
+#ifdef ISC_PLATFORM_USETHREADS
+	unsigned int			nextworker;
+#endif /* ISC_PLATFORM_USETHREADS */
 	isc_taskmgrmode_t		mode;
 #ifdef ISC_PLATFORM_USETHREADS
-	isc_condition_t			work_available;
 	isc_condition_t			exclusive_granted;
 	isc_condition_t			paused;
 #endif /* ISC_PLATFORM_USETHREADS */
@@ -182,6 +204,9 @@ static isc__taskmgr_t *taskmgr = NULL;
 isc_result_t
 isc__task_create(isc_taskmgr_t *manager0, unsigned int quantum,
 		 isc_task_t **taskp);
+isc_result_t
+isc__task_create_bound(isc_taskmgr_t *manager0, unsigned int quantum,
+		       isc_task_t **taskp, int node);
 void
 isc__task_attach(isc_task_t *source0, isc_task_t **targetp);
 void
@@ -243,16 +268,26 @@ void
 isc__taskmgr_setmode(isc_taskmgr_t *manager0, isc_taskmgrmode_t mode);
 isc_taskmgrmode_t
 isc__taskmgr_mode(isc_taskmgr_t *manager0);
+unsigned int
+isc__taskmgr_nqueues(isc_taskmgr_t *manager0);
 
 static inline isc_boolean_t
 empty_readyq(isc__taskmgr_t *manager);
 
 static inline isc__task_t *
-pop_readyq(isc__taskmgr_t *manager);
+pop_readyq(isc__taskmgr_t *manager, unsigned int queue);
 
 static inline void
 push_readyq(isc__taskmgr_t *manager, isc__task_t *task);
 
+#ifdef USE_WORKER_THREADS
+static inline void
+wake_worker(isc__taskmgr_t *manager, unsigned int queue);
+
+static inline void
+wake_workers(isc__taskmgr_t *manager);
+#endif /* USE_WORKER_THREADS */
+
 static struct isc__taskmethods {
 	isc_taskmethods_t methods;
 
@@ -322,7 +357,7 @@ task_finished(isc__task_t *task) {
 		 * any idle worker threads so they
 		 * can exit.
 		 */
-		BROADCAST(&manager->work_available);
+		wake_workers(manager);
 	}
 #endif /* USE_WORKER_THREADS */
 	UNLOCK(&manager->lock);
@@ -336,6 +371,13 @@ task_finished(isc__task_t *task) {
 isc_result_t
 isc__task_create(isc_taskmgr_t *manager0, unsigned int quantum,
 		 isc_task_t **taskp)
+{
+	return (isc__task_create_bound(manager0, quantum, taskp, -1));
+}
+
+isc_result_t
+isc__task_create_bound(isc_taskmgr_t *manager0, unsigned int quantum,
+		       isc_task_t **taskp, int node)
 {
 	isc__taskmgr_t *manager = (isc__taskmgr_t *)manager0;
 	isc__task_t *task;
@@ -375,6 +417,13 @@ isc__task_create(isc_taskmgr_t *manager0, unsigned int quantum,
 	if (!manager->exiting) {
 		if (task->quantum == 0)
 			task->quantum = manager->default_quantum;
+		if (node >= 0)
+			task->queue = (unsigned int)node % manager->nqueues;
+		else {
+			task->queue = manager->nextqueue++;
+			if (manager->nextqueue == manager->nqueues)
+				manager->nextqueue = 0;
+		}
 		APPEND(manager->tasks, task, link);
 	} else
 		exiting = ISC_TRUE;
@@ -474,7 +523,7 @@ task_ready(isc__task_t *task) {
 	push_readyq(manager, task);
 #ifdef USE_WORKER_THREADS
 	if (manager->mode == isc_taskmgrmode_normal || has_privilege)
-		SIGNAL(&manager->work_available);
+		wake_worker(manager, task->queue);
 #endif /* USE_WORKER_THREADS */
 	UNLOCK(&manager->lock);
 }
@@ -938,68 +987,121 @@ isc__task_getcurrenttimex(isc_task_t *task0, isc_time_t *t) {
  ***/
 
 /*
- * Return ISC_TRUE if the current ready list for the manager, which is
- * either ready_tasks or the ready_priority_tasks, depending on whether
- * the manager is currently in normal or privileged execution mode.
+ * Return ISC_TRUE if the current ready lists of all the run queues,
+ * which are either ready_tasks or the ready_priority_tasks, depending
+ * on whether the manager is currently in normal or privileged execution
+ * mode, are empty.
  *
  * Caller must hold the task manager lock.
  */
 static inline isc_boolean_t
 empty_readyq(isc__taskmgr_t *manager) {
-	isc__tasklist_t queue;
+	isc__taskqueue_t *queue;
+	unsigned int i;
 
-	if (manager->mode == isc_taskmgrmode_normal)
-		queue = manager->ready_tasks;
-	else
-		queue = manager->ready_priority_tasks;
+	for (i = 0; i < manager->nqueues; i++) {
+		queue = &manager->queues[i];
+		if (manager->mode == isc_taskmgrmode_normal) {
+			if (!EMPTY(queue->ready_tasks))
+				return (ISC_FALSE);
+		} else if (!EMPTY(queue->ready_priority_tasks))
+			return (ISC_FALSE);
+	}
 
-	return (ISC_TF(EMPTY(queue)));
+	return (ISC_TRUE);
 }
 
 /*
  * Dequeue and return a pointer to the first task on the current ready
- * list for the manager.
+ * list of run queue 'queue', or if that is empty, of the next run queue
+ * which has one.
  * If the task is privileged, dequeue it from the other ready list
  * as well.
  *
  * Caller must hold the task manager lock.
  */
 static inline isc__task_t *
-pop_readyq(isc__taskmgr_t *manager) {
-	isc__task_t *task;
+pop_readyq(isc__taskmgr_t *manager, unsigned int queue) {
+	isc__taskqueue_t *q;
+	isc__task_t *task = NULL;
+	unsigned int i;
 
-	if (manager->mode == isc_taskmgrmode_normal)
-		task = HEAD(manager->ready_tasks);
-	else
-		task = HEAD(manager->ready_priority_tasks);
+	for (i = 0; i < manager->nqueues && task == NULL; i++) {
+		q = &manager->queues[(queue + i) % manager->nqueues];
+		if (manager->mode == isc_taskmgrmode_normal)
+			task = HEAD(q->ready_tasks);
+		else
+			task = HEAD(q->ready_priority_tasks);
 
-	if (task != NULL) {
-		DEQUEUE(manager->ready_tasks, task, ready_link);
-		if (ISC_LINK_LINKED(task, ready_priority_link))
-			DEQUEUE(manager->ready_priority_tasks, task,
-				ready_priority_link);
+		if (task != NULL) {
+			DEQUEUE(q->ready_tasks, task, ready_link);
+			if (ISC_LINK_LINKED(task, ready_priority_link))
+				DEQUEUE(q->ready_priority_tasks, task,
+					ready_priority_link);
+		}
 	}
 
 	return (task);
 }
 
 /*
- * Push 'task' onto the ready_tasks queue.  If 'task' has the privilege
- * flag set, then also push it onto the ready_priority_tasks queue.
+ * Push 'task' onto the ready_tasks list of its run queue.  If 'task'
+ * has the privilege flag set, then also push it onto the
+ * ready_priority_tasks list.
  *
  * Caller must hold the task manager lock.
  */
 static inline void
 push_readyq(isc__taskmgr_t *manager, isc__task_t *task) {
-	ENQUEUE(manager->ready_tasks, task, ready_link);
+	isc__taskqueue_t *q = &manager->queues[task->queue];
+
+	ENQUEUE(q->ready_tasks, task, ready_link);
 	if ((task->flags & TASK_F_PRIVILEGED) != 0)
-		ENQUEUE(manager->ready_priority_tasks, task,
-			ready_priority_link);
+		ENQUEUE(q->ready_priority_tasks, task, ready_priority_link);
 	manager->tasks_ready++;
 }
 
+#ifdef USE_WORKER_THREADS
+/*
+ * Wake up a worker for run queue 'queue'.  If all of them are busy, or
+ * already signalled but not yet running, wake up one of another queue
+ * instead, which will take the work over.
+ *
+ * Caller must hold the task manager lock.
+ */
+static inline void
+wake_worker(isc__taskmgr_t *manager, unsigned int queue) {
+	isc__taskqueue_t *q;
+	unsigned int i;
+
+	for (i = 0; i < manager->nqueues; i++) {
+		q = &manager->queues[(queue + i) % manager->nqueues];
+		if (q->idle > q->wakeups) {
+			q->wakeups++;
+			SIGNAL(&q->work_available);
+			return;
+		}
+	}
+}
+
+/*
+ * Wake up all the workers.
+ *
+ * Caller must hold the task manager lock.
+ */
+static inline void
+wake_workers(isc__taskmgr_t *manager) {
+	unsigned int i;
+
+	for (i = 0; i < manager->nqueues; i++) {
+		manager->queues[i].wakeups = manager->queues[i].idle;
+		BROADCAST(&manager->queues[i].work_available);
+	}
+}
+#endif /* USE_WORKER_THREADS */
+
 static void
-dispatch(isc__taskmgr_t *manager) {
+dispatch(isc__taskmgr_t *manager, unsigned int queue) {
 	isc__task_t *task;
 #ifndef USE_WORKER_THREADS
 	unsigned int total_dispatch_count = 0;
@@ -1081,10 +1183,16 @@ dispatch(isc__taskmgr_t *manager) {
 		while ((empty_readyq(manager) || manager->pause_requested ||
 			manager->exclusive_requested) && !FINISHED(manager))
 		{
+			isc__taskqueue_t *q = &manager->queues[queue];
+
 			XTHREADTRACE(isc_msgcat_get(isc_msgcat,
 						    ISC_MSGSET_GENERAL,
 						    ISC_MSG_WAIT, "wait"));
-			WAIT(&manager->work_available, &manager->lock);
+			q->idle++;
+			WAIT(&q->work_available, &manager->lock);
+			q->idle--;
+			if (q->wakeups > 0)
+				q->wakeups--;
 			XTHREADTRACE(isc_msgcat_get(isc_msgcat,
 						    ISC_MSGSET_TASK,
 						    ISC_MSG_AWAKE, "awake"));
@@ -1097,7 +1205,7 @@ dispatch(isc__taskmgr_t *manager) {
 		XTHREADTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TASK,
 					    ISC_MSG_WORKING, "working"));
 
-		task = pop_readyq(manager);
+		task = pop_readyq(manager, queue);
 		if (task != NULL) {
 			unsigned int dispatch_count = 0;
 			isc_boolean_t done = ISC_FALSE;
@@ -1282,15 +1390,16 @@ dispatch(isc__taskmgr_t *manager) {
 		if (manager->tasks_running == 0 && empty_readyq(manager)) {
 			manager->mode = isc_taskmgrmode_normal;
 			if (!empty_readyq(manager))
-				BROADCAST(&manager->work_available);
+				wake_workers(manager);
 		}
 #endif
 	}
 
 #ifndef USE_WORKER_THREADS
-	ISC_LIST_APPENDLIST(manager->ready_tasks, new_ready_tasks, ready_link);
-	ISC_LIST_APPENDLIST(manager->ready_priority_tasks, new_priority_tasks,
-			    ready_priority_link);
+	ISC_LIST_APPENDLIST(manager->queues[queue].ready_tasks,
+			    new_ready_tasks, ready_link);
+	ISC_LIST_APPENDLIST(manager->queues[queue].ready_priority_tasks,
+			    new_priority_tasks, ready_priority_link);
 	manager->tasks_ready += tasks_ready;
 	if (empty_readyq(manager))
 		manager->mode = isc_taskmgrmode_normal;
@@ -1306,11 +1415,24 @@ WINAPI
 #endif
 run(void *uap) {
 	isc__taskmgr_t *manager = uap;
+	unsigned int worker, queue;
 
 	XTHREADTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
 				    ISC_MSG_STARTING, "starting"));
 
-	dispatch(manager);
+	/*
+	 * Worker 'n' serves run queue 'n' modulo the number of queues,
+	 * which is also its NUMA node when the workers are bound to CPUs.
+	 */
+	LOCK(&manager->lock);
+	worker = manager->nextworker++;
+	queue = worker % manager->nqueues;
+	UNLOCK(&manager->lock);
+	if (manager->affinity)
+		(void)isc_thread_setaffinity(isc_os_nodecpu(queue,
+						worker / manager->nqueues));
+
+	dispatch(manager, queue);
 
 	XTHREADTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
 				    ISC_MSG_EXITING, "exiting"));
@@ -1326,13 +1448,16 @@ run(void *uap) {
 static void
 manager_free(isc__taskmgr_t *manager) {
 	isc_mem_t *mctx;
-
 #ifdef USE_WORKER_THREADS
+	unsigned int i;
+
 	(void)isc_condition_destroy(&manager->exclusive_granted);
-	(void)isc_condition_destroy(&manager->work_available);
+	for (i = 0; i < manager->nqueues; i++)
+		(void)isc_condition_destroy(&manager->queues[i].work_available);
 	(void)isc_condition_destroy(&manager->paused);
 	isc_mem_free(manager->mctx, manager->threads);
 #endif /* USE_WORKER_THREADS */
+	isc_mem_free(manager->mctx, manager->queues);
 	DESTROYLOCK(&manager->lock);
 	DESTROYLOCK(&manager->excl_lock);
 	manager->common.impmagic = 0;
@@ -1351,7 +1476,7 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 		    unsigned int default_quantum, isc_taskmgr_t **managerp)
 {
 	isc_result_t result;
-	unsigned int i, started = 0;
+	unsigned int i, started = 0, nqueues = 1;
 	isc__taskmgr_t *manager;
 
 	/*
@@ -1393,21 +1518,47 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 		goto cleanup_mgr;
 	}
 
+#ifdef USE_WORKER_THREADS
+	manager->affinity = isc_os_affinity;
+	if (manager->affinity)
+		nqueues = ISC_MIN(isc_os_numanodes(), workers);
+#endif /* USE_WORKER_THREADS */
+	manager->nqueues = 0;
+	manager->queues = isc_mem_allocate(mctx,
+					   nqueues * sizeof(isc__taskqueue_t));
+	if (manager->queues == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_lock;
+	}
+	for (i = 0; i < nqueues; i++) {
+		INIT_LIST(manager->queues[i].ready_tasks);
+		INIT_LIST(manager->queues[i].ready_priority_tasks);
+	}
+
 #ifdef USE_WORKER_THREADS
 	manager->workers = 0;
 	manager->threads = isc_mem_allocate(mctx,
 					    workers * sizeof(isc_thread_t));
 	if (manager->threads == NULL) {
 		result = ISC_R_NOMEMORY;
-		goto cleanup_lock;
+		goto cleanup_queues;
 	}
-	if (isc_condition_init(&manager->work_available) != ISC_R_SUCCESS) {
-		UNEXPECTED_ERROR(__FILE__, __LINE__,
-				 "isc_condition_init() %s",
-				 isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
-						ISC_MSG_FAILED, "failed"));
-		result = ISC_R_UNEXPECTED;
-		goto cleanup_threads;
+	for (i = 0; i < nqueues; i++) {
+		manager->queues[i].idle = 0;
+		manager->queues[i].wakeups = 0;
+		if (isc_condition_init(&manager->queues[i].work_available) !=
+		    ISC_R_SUCCESS)
+		{
+			UNEXPECTED_ERROR(__FILE__, __LINE__,
+					 "isc_condition_init() %s",
+					 isc_msgcat_get(isc_msgcat,
+							ISC_MSGSET_GENERAL,
+							ISC_MSG_FAILED,
+							"failed"));
+			result = ISC_R_UNEXPECTED;
+			goto cleanup_workavailable;
+		}
+		manager->nqueues++;
 	}
 	if (isc_condition_init(&manager->exclusive_granted) != ISC_R_SUCCESS) {
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
@@ -1430,8 +1581,8 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 		default_quantum = DEFAULT_DEFAULT_QUANTUM;
 	manager->default_quantum = default_quantum;
 	INIT_LIST(manager->tasks);
-	INIT_LIST(manager->ready_tasks);
-	INIT_LIST(manager->ready_priority_tasks);
+	manager->nqueues = nqueues;
+	manager->nextqueue = 0;
 	manager->tasks_running = 0;
 	manager->tasks_ready = 0;
 	manager->exclusive_requested = ISC_FALSE;
@@ -1444,8 +1595,10 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 #ifdef USE_WORKER_THREADS
 	LOCK(&manager->lock);
 	/*
-	 * Start workers.
+	 * Start workers.  They wait for the lock before picking their
+	 * run queue, so every queue left will have one.
 	 */
+	manager->nextworker = 0;
 	for (i = 0; i < workers; i++) {
 		if (isc_thread_create(run, manager,
 				      &manager->threads[manager->workers]) ==
@@ -1458,6 +1611,11 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 			started++;
 		}
 	}
+	while (manager->nqueues > 1 && manager->nqueues > started) {
+		manager->nqueues--;
+		(void)isc_condition_destroy(
+			&manager->queues[manager->nqueues].work_available);
+	}
 	UNLOCK(&manager->lock);
 
 	if (started == 0) {
@@ -1479,12 +1637,15 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
  cleanup_exclusivegranted:
 	(void)isc_condition_destroy(&manager->exclusive_granted);
  cleanup_workavailable:
-	(void)isc_condition_destroy(&manager->work_available);
- cleanup_threads:
+	for (i = 0; i < manager->nqueues; i++)
+		(void)isc_condition_destroy(&manager->queues[i].work_available);
 	isc_mem_free(mctx, manager->threads);
+ cleanup_queues:
+	isc_mem_free(mctx, manager->queues);
+#endif
  cleanup_lock:
+	DESTROYLOCK(&manager->excl_lock);
 	DESTROYLOCK(&manager->lock);
-#endif
  cleanup_mgr:
 	isc_mem_put(mctx, manager, sizeof(*manager));
 	return (result);
@@ -1573,7 +1734,7 @@ isc__taskmgr_destroy(isc_taskmgr_t **managerp) {
 	 * there's work left to do, and if there are already no tasks left
 	 * it will cause the workers to see manager->exiting.
 	 */
-	BROADCAST(&manager->work_available);
+	wake_workers(manager);
 	UNLOCK(&manager->lock);
 
 	/*
@@ -1628,6 +1789,16 @@ isc__taskmgr_mode(isc_taskmgr_t *manager0) {
 	return (mode);
 }
 
+unsigned int
+isc__taskmgr_nqueues(isc_taskmgr_t *manager0) {
+	isc__taskmgr_t *manager = (isc__taskmgr_t *)manager0;
+
+	REQUIRE(VALID_MANAGER(manager));
+
+	/* Set when the manager is created. */
+	return (manager->nqueues);
+}
+
 #ifndef USE_WORKER_THREADS
 isc_boolean_t
 isc__taskmgr_ready(isc_taskmgr_t *manager0) {
@@ -1659,7 +1830,7 @@ isc__taskmgr_dispatch(isc_taskmgr_t *manager0) {
 	if (manager == NULL)
 		return (ISC_R_NOTFOUND);
 
-	dispatch(manager);
+	dispatch(manager, 0);
 
 	return (ISC_R_SUCCESS);
 }
@@ -1683,7 +1854,7 @@ isc__taskmgr_resume(isc_taskmgr_t *manager0) {
 	LOCK(&manager->lock);
 	if (manager->pause_requested) {
 		manager->pause_requested = ISC_FALSE;
-		BROADCAST(&manager->work_available);
+		wake_workers(manager);
 	}
 	UNLOCK(&manager->lock);
 }
@@ -1759,7 +1930,7 @@ isc__task_endexclusive(isc_task_t *task0) {
 	LOCK(&manager->lock);
 	REQUIRE(manager->exclusive_requested);
 	manager->exclusive_requested = ISC_FALSE;
-	BROADCAST(&manager->work_available);
+	wake_workers(manager);
 	UNLOCK(&manager->lock);
 #else
 	UNUSED(task0);
@@ -1770,6 +1941,7 @@ void
 isc__task_setprivilege(isc_task_t *task0, isc_boolean_t priv) {
 	isc__task_t *task = (isc__task_t *)task0;
 	isc__taskmgr_t *manager = task->manager;
+	isc__taskqueue_t *q;
 	isc_boolean_t oldpriv;
 
 	LOCK(&task->lock);
@@ -1784,12 +1956,11 @@ isc__task_setprivilege(isc_task_t *task0, isc_boolean_t priv) {
 		return;
 
 	LOCK(&manager->lock);
+	q = &manager->queues[task->queue];
 	if (priv && ISC_LINK_LINKED(task, ready_link))
-		ENQUEUE(manager->ready_priority_tasks, task,
-			ready_priority_link);
+		ENQUEUE(q->ready_priority_tasks, task, ready_priority_link);
 	else if (!priv && ISC_LINK_LINKED(task, ready_priority_link))
-		DEQUEUE(manager->ready_priority_tasks, task,
-			ready_priority_link);
+		DEQUEUE(q->ready_priority_tasks, task, ready_priority_link);
 	UNLOCK(&manager->lock);
 }
 
@@ -2132,6 +2303,16 @@ isc_taskmgr_mode(isc_taskmgr_t *manager) {
 	return (manager->methods->mode(manager));
 }
 
+unsigned int
+isc_taskmgr_nqueues(isc_taskmgr_t *manager) {
+	REQUIRE(ISCAPI_TASKMGR_VALID(manager));
+
+	if (isc_bind9)
+		return (isc__taskmgr_nqueues(manager));
+
+	return (1);
+}
+
 isc_result_t
 isc_task_create(isc_taskmgr_t *manager, unsigned int quantum,
 		isc_task_t **taskp)
@@ -2145,6 +2326,19 @@ isc_task_create(isc_taskmgr_t *manager, unsigned int quantum,
 	return (manager->methods->taskcreate(manager, quantum, taskp));
 }
 
+isc_result_t
+isc_task_create_bound(isc_taskmgr_t *manager, unsigned int quantum,
+		      isc_task_t **taskp, int node)
+{
+	REQUIRE(ISCAPI_TASKMGR_VALID(manager));
+	REQUIRE(taskp != NULL && *taskp == NULL);
+
+	if (isc_bind9)
+		return (isc__task_create_bound(manager, quantum, taskp, node));
+
+	return (manager->methods->taskcreate(manager, quantum, taskp));
+}
+
 void
 isc_task_attach(isc_task_t *source, isc_task_t **targetp) {
 	REQUIRE(ISCAPI_TASK_VALID(source));
@@ -16,6 +16,8 @@
 
 #include <isc/counter.h>
 #include <isc/result.h>
+#include <isc/thread.h>
+#include <isc/util.h>
 
 #include "isctest.h"
 
@@ -54,11 +56,83 @@ ATF_TC_BODY(isc_counter, tc) {
 	isc_test_end();
 }
 
+#ifdef ISC_PLATFORM_USETHREADS
+#define NTHREADS	8
+#define NLOOPS		10000
+
+static isc_counter_t *tcounter;
+static unsigned int quotas[NTHREADS];
+
+static isc_threadresult_t
+#ifdef WIN32
+WINAPI
+#endif
+counter_thread(isc_threadarg_t arg) {
+	unsigned int id = *(unsigned int *)arg;
+	isc_counter_t *counter = NULL;
+	int i;
+
+	isc_counter_attach(tcounter, &counter);
+	for (i = 0; i < NLOOPS; i++) {
+		if (isc_counter_increment(counter) == ISC_R_QUOTA)
+			quotas[id]++;
+	}
+	isc_counter_detach(&counter);
+
+	return ((isc_threadresult_t)0);
+}
+
+ATF_TC(isc_counter_threads);
+ATF_TC_HEAD(isc_counter_threads, tc) {
+	atf_tc_set_md_var(tc, "descr", "isc counter shared by several "
+				       "threads");
+}
+ATF_TC_BODY(isc_counter_threads, tc) {
+	isc_result_t result;
+	isc_thread_t threads[NTHREADS];
+	unsigned int ids[NTHREADS];
+	unsigned int i, total = 0;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_TRUE, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_counter_create(mctx, NTHREADS * NLOOPS / 2, &tcounter);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < NTHREADS; i++) {
+		ids[i] = i;
+		quotas[i] = 0;
+		result = isc_thread_create(counter_thread, &ids[i],
+					   &threads[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		total += quotas[i];
+	}
+
+	/*
+	 * No increment is lost, and every one from the limit onwards
+	 * reports the quota.
+	 */
+	ATF_CHECK_EQ(isc_counter_used(tcounter), NTHREADS * NLOOPS);
+	ATF_CHECK_EQ(total, NTHREADS * NLOOPS / 2 + 1);
+
+	isc_counter_detach(&tcounter);
+	isc_test_end();
+}
+#endif
+
 /*
  * Main
  */
 ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, isc_counter);
+#ifdef ISC_PLATFORM_USETHREADS
+	ATF_TP_ADD_TC(tp, isc_counter_threads);
+#endif
 	return (atf_no_error());
 }
-
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+
+#include <atf-c.h>
+
+#include <isc/quota.h>
+#include <isc/result.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+ATF_TC(isc_quota_hard);
+ATF_TC_HEAD(isc_quota_hard, tc) {
+	atf_tc_set_md_var(tc, "descr", "hard quota limit");
+}
+ATF_TC_BODY(isc_quota_hard, tc) {
+	isc_result_t result;
+	isc_quota_t quota;
+	isc_quota_t *quotas[10];
+	int i;
+
+	UNUSED(tc);
+
+	result = isc_quota_init(&quota, 5);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_quota_getmax(&quota), 5);
+	ATF_CHECK_EQ(isc_quota_getsoft(&quota), 0);
+
+	for (i = 0; i < 10; i++) {
+		quotas[i] = NULL;
+		result = isc_quota_attach(&quota, &quotas[i]);
+		if (i < 5) {
+			ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+			ATF_CHECK(quotas[i] == &quota);
+		} else {
+			ATF_CHECK_EQ(result, ISC_R_QUOTA);
+			ATF_CHECK(quotas[i] == NULL);
+		}
+	}
+	ATF_CHECK_EQ(isc_quota_getused(&quota), 5);
+
+	/* Freeing one unit makes exactly one available again. */
+	isc_quota_detach(&quotas[0]);
+	ATF_CHECK(quotas[0] == NULL);
+	ATF_CHECK_EQ(isc_quota_getused(&quota), 4);
+	result = isc_quota_attach(&quota, &quotas[0]);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	result = isc_quota_reserve(&quota);
+	ATF_CHECK_EQ(result, ISC_R_QUOTA);
+
+	/* Raising the limit takes effect at once. */
+	isc_quota_max(&quota, 6);
+	result = isc_quota_reserve(&quota);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_quota_getused(&quota), 6);
+	isc_quota_release(&quota);
+
+	for (i = 0; i < 5; i++)
+		isc_quota_detach(&quotas[i]);
+	ATF_CHECK_EQ(isc_quota_getused(&quota), 0);
+
+	isc_quota_destroy(&quota);
+}
+
+ATF_TC(isc_quota_soft);
+ATF_TC_HEAD(isc_quota_soft, tc) {
+	atf_tc_set_md_var(tc, "descr", "soft quota limit");
+}
+ATF_TC_BODY(isc_quota_soft, tc) {
+	isc_result_t result;
+	isc_quota_t quota;
+	isc_quota_t *quotas[10];
+	int i;
+
+	UNUSED(tc);
+
+	result = isc_quota_init(&quota, 8);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	isc_quota_soft(&quota, 5);
+	ATF_CHECK_EQ(isc_quota_getsoft(&quota), 5);
+
+	/*
+	 * Reservations beyond the soft limit still succeed, but say so,
+	 * until the hard limit is reached.
+	 */
+	for (i = 0; i < 10; i++) {
+		quotas[i] = NULL;
+		result = isc_quota_attach(&quota, &quotas[i]);
+		if (i < 5) {
+			ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+			ATF_CHECK(quotas[i] == &quota);
+		} else if (i < 8) {
+			ATF_CHECK_EQ(result, ISC_R_SOFTQUOTA);
+			ATF_CHECK(quotas[i] == &quota);
+		} else {
+			ATF_CHECK_EQ(result, ISC_R_QUOTA);
+			ATF_CHECK(quotas[i] == NULL);
+		}
+	}
+	ATF_CHECK_EQ(isc_quota_getused(&quota), 8);
+
+	for (i = 0; i < 8; i++)
+		isc_quota_detach(&quotas[i]);
+	ATF_CHECK_EQ(isc_quota_getused(&quota), 0);
+
+	isc_quota_destroy(&quota);
+}
+
+ATF_TC(isc_quota_unlimited);
+ATF_TC_HEAD(isc_quota_unlimited, tc) {
+	atf_tc_set_md_var(tc, "descr", "quota without a hard limit");
+}
+ATF_TC_BODY(isc_quota_unlimited, tc) {
+	isc_result_t result;
+	isc_quota_t quota;
+	int i;
+
+	UNUSED(tc);
+
+	result = isc_quota_init(&quota, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	isc_quota_soft(&quota, 100);
+
+	for (i = 0; i < 1000; i++) {
+		result = isc_quota_reserve(&quota);
+		ATF_CHECK_EQ(result, i < 100 ? ISC_R_SUCCESS
+					     : ISC_R_SOFTQUOTA);
+	}
+	ATF_CHECK_EQ(isc_quota_getused(&quota), 1000);
+
+	for (i = 0; i < 1000; i++)
+		isc_quota_release(&quota);
+	ATF_CHECK_EQ(isc_quota_getused(&quota), 0);
+
+	isc_quota_destroy(&quota);
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+#define NTHREADS	8
+#define NLOOPS		100000
+#define QUOTAMAX	5
+
+static isc_quota_t tquota;
+static unsigned int overcommit[NTHREADS];
+static unsigned int reserved[NTHREADS];
+
+static isc_threadresult_t
+#ifdef WIN32
+WINAPI
+#endif
+quota_thread(isc_threadarg_t arg) {
+	unsigned int id = *(unsigned int *)arg;
+	isc_quota_t *q;
+	isc_result_t result;
+	int i;
+
+	for (i = 0; i < NLOOPS; i++) {
+		q = NULL;
+		result = isc_quota_attach(&tquota, &q);
+		if (result == ISC_R_QUOTA)
+			continue;
+		reserved[id]++;
+		if (isc_quota_getused(&tquota) > QUOTAMAX)
+			overcommit[id]++;
+		isc_quota_detach(&q);
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+ATF_TC(isc_quota_threads);
+ATF_TC_HEAD(isc_quota_threads, tc) {
+	atf_tc_set_md_var(tc, "descr", "quota shared by several threads "
+				       "is never over-committed");
+}
+ATF_TC_BODY(isc_quota_threads, tc) {
+	isc_result_t result;
+	isc_thread_t threads[NTHREADS];
+	unsigned int ids[NTHREADS];
+	unsigned int i, total = 0;
+
+	UNUSED(tc);
+
+	result = isc_quota_init(&tquota, QUOTAMAX);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < NTHREADS; i++) {
+		ids[i] = i;
+		overcommit[i] = 0;
+		reserved[i] = 0;
+		result = isc_thread_create(quota_thread, &ids[i],
+					   &threads[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(overcommit[i], 0);
+		total += reserved[i];
+	}
+
+	ATF_CHECK(total > 0);
+	ATF_CHECK_EQ(isc_quota_getused(&tquota), 0);
+
+	isc_quota_destroy(&tquota);
+}
+#endif
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, isc_quota_hard);
+	ATF_TP_ADD_TC(tp, isc_quota_soft);
+	ATF_TP_ADD_TC(tp, isc_quota_unlimited);
+#ifdef ISC_PLATFORM_USETHREADS
+	ATF_TP_ADD_TC(tp, isc_quota_threads);
+#endif
+	return (atf_no_error());
+}
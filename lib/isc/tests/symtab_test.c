@@ -129,11 +129,61 @@ ATF_TC_BODY(symtab_grow, tc) {
 	isc_test_end();
 }
 
+ATF_TC(symtab_case);
+ATF_TC_HEAD(symtab_case, tc) {
+	atf_tc_set_md_var(tc, "descr", "symbol table key case folding");
+}
+ATF_TC_BODY(symtab_case, tc) {
+	isc_result_t result;
+	isc_symtab_t *st = NULL;
+	isc_symvalue_t value;
+	isc_boolean_t sensitive;
+	int i;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_TRUE, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 2; i++) {
+		sensitive = ISC_TF(i == 1);
+		result = isc_symtab_create(mctx, 7, NULL, NULL, sensitive,
+					   &st);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+		value.as_uinteger = 1;
+		result = isc_symtab_define(st, "Allow-Transfer", 1, value,
+					   isc_symexists_reject);
+		ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+		value.as_uinteger = 2;
+		result = isc_symtab_define(st, "allow-transfer", 1, value,
+					   isc_symexists_reject);
+		ATF_CHECK_EQ(result,
+			     sensitive ? ISC_R_SUCCESS : ISC_R_EXISTS);
+
+		result = isc_symtab_lookup(st, "ALLOW-TRANSFER", 0, &value);
+		ATF_CHECK_EQ(result,
+			     sensitive ? ISC_R_NOTFOUND : ISC_R_SUCCESS);
+		result = isc_symtab_lookup(st, "Allow-Transfer", 0, &value);
+		ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(value.as_uinteger, 1);
+		result = isc_symtab_lookup(st, "Allow-Transfer", 2, &value);
+		ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+		result = isc_symtab_lookup(st, "allow-query", 0, &value);
+		ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+		isc_symtab_destroy(&st);
+	}
+
+	isc_test_end();
+}
+
 /*
  * Main
  */
 ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, symtab_grow);
+	ATF_TP_ADD_TC(tp, symtab_case);
 
 	return (atf_no_error());
 }
@@ -23,6 +23,7 @@
 
 #include <isc/condition.h>
 #include <isc/mem.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/task.h>
@@ -1447,6 +1448,110 @@ ATF_TC_HEAD(purgeevent_notpurge, tc) {
 ATF_TC_BODY(purgeevent_notpurge, tc) {
 	try_purgeevent(ISC_FALSE);
 }
+
+/*
+ * Affinity test:
+ * With the workers bound to CPUs, events sent to tasks bound to each
+ * NUMA node, and to unbound tasks, are all processed.
+ */
+
+#define AFFINITY_TASKS	16
+#define AFFINITY_EVENTS	100
+
+static int affinity_count = 0;
+
+static void
+affinity_event(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	isc_event_free(&event);
+	LOCK(&lock);
+	if (++affinity_count == AFFINITY_TASKS * AFFINITY_EVENTS)
+		SIGNAL(&cv);
+	UNLOCK(&lock);
+}
+
+ATF_TC(affinity);
+ATF_TC_HEAD(affinity, tc) {
+	atf_tc_set_md_var(tc, "descr", "tasks bound to NUMA nodes");
+}
+ATF_TC_BODY(affinity, tc) {
+	isc_result_t result;
+	isc_task_t *tasks[AFFINITY_TASKS];
+	isc_event_t *event;
+	isc_interval_t interval;
+	isc_time_t now;
+	unsigned int nodes, node;
+	int i, j;
+
+	UNUSED(tc);
+
+	nodes = isc_os_numanodes();
+	ATF_REQUIRE(nodes >= 1);
+	for (node = 0; node < nodes; node++) {
+		ATF_CHECK(isc_os_nodencpus(node) >= 1);
+		ATF_CHECK_EQ(isc_os_nodecpu(node, 0),
+			     isc_os_nodecpu(node, isc_os_nodencpus(node)));
+	}
+	ATF_CHECK_EQ(isc_os_nodencpus(nodes), 0);
+	ATF_CHECK(isc_os_currentnode() < nodes);
+
+	result = isc_mutex_init(&lock);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_condition_init(&cv);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_os_affinity = ISC_TRUE;
+	result = isc_test_begin(NULL, ISC_TRUE, 4);
+	isc_os_affinity = ISC_FALSE;
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(isc_taskmgr_nqueues(taskmgr) >= 1);
+	ATF_CHECK(isc_taskmgr_nqueues(taskmgr) <= ISC_MIN(nodes, 4));
+
+	/*
+	 * Every other task is bound to a node; the rest are unbound.
+	 */
+	for (i = 0; i < AFFINITY_TASKS; i++) {
+		tasks[i] = NULL;
+		if (i % 2 == 0)
+			result = isc_task_create_bound(taskmgr, 0, &tasks[i],
+						       i / 2);
+		else
+			result = isc_task_create_bound(taskmgr, 0, &tasks[i],
+						       -1);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	LOCK(&lock);
+	for (j = 0; j < AFFINITY_EVENTS; j++) {
+		for (i = 0; i < AFFINITY_TASKS; i++) {
+			event = isc_event_allocate(mctx, tasks[i],
+						   ISC_TASKEVENT_TEST,
+						   affinity_event, NULL,
+						   sizeof(*event));
+			ATF_REQUIRE(event != NULL);
+			isc_task_send(tasks[i], &event);
+		}
+	}
+
+	isc_interval_set(&interval, 5, 0);
+	while (affinity_count < AFFINITY_TASKS * AFFINITY_EVENTS) {
+		result = isc_time_nowplusinterval(&now, &interval);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		if (WAITUNTIL(&cv, &lock, &now) == ISC_R_TIMEDOUT)
+			break;
+	}
+	ATF_CHECK_EQ(affinity_count, AFFINITY_TASKS * AFFINITY_EVENTS);
+	UNLOCK(&lock);
+
+	for (i = 0; i < AFFINITY_TASKS; i++)
+		isc_task_detach(&tasks[i]);
+
+	isc_test_end();
+	DESTROYLOCK(&lock);
+	(void) isc_condition_destroy(&cv);
+}
 #endif
 
 /*
@@ -1468,6 +1573,7 @@ ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, purgerange);
 	ATF_TP_ADD_TC(tp, purgeevent);
 	ATF_TP_ADD_TC(tp, purgeevent_notpurge);
+	ATF_TP_ADD_TC(tp, affinity);
 #endif
 
 	return (atf_no_error());
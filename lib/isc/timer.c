@@ -23,6 +23,7 @@
 #include <isc/mem.h>
 #include <isc/msgs.h>
 #include <isc/once.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/task.h>
@@ -786,6 +787,9 @@ run(void *uap) {
 	isc_time_t now;
 	isc_result_t result;
 
+	if (isc_os_affinity)
+		(void)isc_thread_setnodeaffinity(0);
+
 	LOCK(&manager->lock);
 	while (!manager->done) {
 		TIME_NOW(&now);
@@ -13,8 +13,11 @@
 
 #include <config.h>
 
+#include <isc/once.h>
 #include <isc/os.h>
+#include <isc/util.h>
 
+LIBISC_EXTERNAL_DATA isc_boolean_t isc_os_affinity = ISC_FALSE;
 
 #ifdef HAVE_SYSCONF
 
@@ -86,3 +89,193 @@ isc_os_ncpus(void) {
 
 	return ((unsigned int)ncpus);
 }
+
+/*
+ * NUMA topology.  On Linux each node with CPUs appears as
+ * /sys/devices/system/node/nodeN with a 'cpulist' file; elsewhere, or if
+ * that cannot be read, every CPU is taken to be on a single node.
+ */
+#define MAXCPUS		1024
+#define MAXNODES	64
+
+#if defined(HAVE_SCHED_H)
+#include <sched.h>
+#endif
+
+static isc_once_t topology_once = ISC_ONCE_INIT;
+static unsigned int numanodes = 0;
+static unsigned short cpunode[MAXCPUS];		/* by CPU identifier */
+static unsigned short nodecpus[MAXCPUS];	/* CPU identifiers by node */
+static unsigned int nodestart[MAXNODES + 1];	/* ... starting here */
+
+#ifdef __linux__
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NODEDIR		"/sys/devices/system/node"
+
+/*
+ * Read the cpulist of system node 'sysnode', e.g. "0-3,8-11", and append
+ * the CPUs listed there that are also in 'allowed' to the next node.
+ */
+static void
+read_cpulist(unsigned int sysnode, unsigned char *allowed, unsigned int *n) {
+	char path[sizeof(NODEDIR) + 32], line[4096], *p, *end;
+	unsigned long first, last, cpu;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), NODEDIR "/node%u/cpulist", sysnode);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return;
+	if (fgets(line, sizeof(line), fp) == NULL)
+		line[0] = '\0';
+	fclose(fp);
+
+	for (p = line; *p != '\0' && *p != '\n'; p = end) {
+		if (*p == ',')
+			p++;
+		first = last = strtoul(p, &end, 10);
+		if (end == p)
+			break;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (end == p)
+				break;
+		}
+		for (cpu = first; cpu <= last && cpu < MAXCPUS; cpu++) {
+			if (!allowed[cpu])
+				continue;
+			cpunode[cpu] = numanodes;
+			nodecpus[(*n)++] = (unsigned short)cpu;
+		}
+	}
+}
+
+static int
+cmpnode(const void *a, const void *b) {
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+
+	return (x < y ? -1 : x > y ? 1 : 0);
+}
+
+static void
+linux_topology(void) {
+	unsigned char allowed[MAXCPUS];
+	unsigned int sysnodes[MAXNODES];
+	unsigned int i, nsysnodes = 0, n = 0;
+	struct dirent *de;
+	DIR *dir;
+#ifdef CPU_ISSET
+	cpu_set_t set;
+#endif
+
+	memset(allowed, 1, sizeof(allowed));
+#ifdef CPU_ISSET
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for (i = 0; i < MAXCPUS; i++)
+			allowed[i] = (i < CPU_SETSIZE && CPU_ISSET(i, &set));
+	}
+#endif
+
+	dir = opendir(NODEDIR);
+	if (dir == NULL)
+		return;
+	while ((de = readdir(dir)) != NULL && nsysnodes < MAXNODES) {
+		char *end;
+		unsigned long node;
+
+		if (strncmp(de->d_name, "node", 4) != 0 ||
+		    de->d_name[4] < '0' || de->d_name[4] > '9')
+			continue;
+		node = strtoul(de->d_name + 4, &end, 10);
+		if (*end == '\0')
+			sysnodes[nsysnodes++] = (unsigned int)node;
+	}
+	closedir(dir);
+
+	/*
+	 * Number the nodes with usable CPUs densely, keeping the order
+	 * of the system's own numbering.
+	 */
+	qsort(sysnodes, nsysnodes, sizeof(sysnodes[0]), cmpnode);
+	for (i = 0; i < nsysnodes; i++) {
+		nodestart[numanodes] = n;
+		read_cpulist(sysnodes[i], allowed, &n);
+		if (n > nodestart[numanodes])
+			numanodes++;
+	}
+	nodestart[numanodes] = n;
+}
+#endif /* __linux__ */
+
+static void
+init_topology(void) {
+	unsigned int cpu, ncpus;
+
+#ifdef __linux__
+	linux_topology();
+#endif
+	if (numanodes > 0)
+		return;
+
+	/*
+	 * No usable topology: one node with every CPU on it.
+	 */
+	ncpus = ISC_MIN(isc_os_ncpus(), MAXCPUS);
+	for (cpu = 0; cpu < ncpus; cpu++) {
+		cpunode[cpu] = 0;
+		nodecpus[cpu] = (unsigned short)cpu;
+	}
+	nodestart[0] = 0;
+	nodestart[1] = ncpus;
+	numanodes = 1;
+}
+
+static void
+topology(void) {
+	RUNTIME_CHECK(isc_once_do(&topology_once, init_topology) ==
+		      ISC_R_SUCCESS);
+}
+
+unsigned int
+isc_os_numanodes(void) {
+	topology();
+	return (numanodes);
+}
+
+unsigned int
+isc_os_nodencpus(unsigned int node) {
+	topology();
+	if (node >= numanodes)
+		return (0);
+	return (nodestart[node + 1] - nodestart[node]);
+}
+
+unsigned int
+isc_os_nodecpu(unsigned int node, unsigned int n) {
+	topology();
+	REQUIRE(node < numanodes);
+
+	n %= nodestart[node + 1] - nodestart[node];
+	return (nodecpus[nodestart[node] + n]);
+}
+
+unsigned int
+isc_os_currentnode(void) {
+#ifdef HAVE_SCHED_GETCPU
+	int cpu;
+
+	topology();
+	if (numanodes == 1)
+		return (0);
+	cpu = sched_getcpu();
+	if (cpu >= 0 && cpu < MAXCPUS)
+		return (cpunode[cpu]);
+#endif
+	return (0);
+}
@@ -50,6 +50,7 @@
 #include <isc/mutex.h>
 #include <isc/net.h>
 #include <isc/once.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/region.h>
@@ -4298,6 +4299,14 @@ watcher(void *uap) {
 	 */
 	ctlfd = manager->pipe_fds[0];
 #endif
+
+	/*
+	 * The watcher serves the workers of every node alike, so it is
+	 * only kept on the first one.
+	 */
+	if (isc_os_affinity)
+		(void)isc_thread_setnodeaffinity(0);
+
 	done = ISC_FALSE;
 	while (!done) {
 		do {
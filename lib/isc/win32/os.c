@@ -14,6 +14,9 @@
 #include <windows.h>
 
 #include <isc/os.h>
+#include <isc/util.h>
+
+LIBISC_EXTERNAL_DATA isc_boolean_t isc_os_affinity = ISC_FALSE;
 
 static BOOL bInit = FALSE;
 static SYSTEM_INFO SystemInfo;
@@ -37,3 +40,29 @@ isc_os_ncpus(void) {
 
 	return ((unsigned int)ncpus);
 }
+
+/*
+ * The NUMA topology is not looked at: every CPU is taken to be on a
+ * single node.
+ */
+unsigned int
+isc_os_numanodes(void) {
+	return (1);
+}
+
+unsigned int
+isc_os_nodencpus(unsigned int node) {
+	return (node == 0 ? isc_os_ncpus() : 0);
+}
+
+unsigned int
+isc_os_nodecpu(unsigned int node, unsigned int n) {
+	REQUIRE(node == 0);
+
+	return (n % isc_os_ncpus());
+}
+
+unsigned int
+isc_os_currentnode(void) {
+	return (0);
+}
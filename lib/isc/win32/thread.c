@@ -13,6 +13,7 @@
 
 #include <process.h>
 
+#include <isc/os.h>
 #include <isc/thread.h>
 #include <isc/util.h>
 
@@ -66,6 +67,34 @@ isc_thread_setname(isc_thread_t thread, const char *name) {
 	UNUSED(name);
 }
 
+isc_result_t
+isc_thread_setaffinity(unsigned int cpu) {
+	if (cpu >= sizeof(DWORD_PTR) * 8)
+		return (ISC_R_RANGE);
+	if (SetThreadAffinityMask(GetCurrentThread(),
+				  (DWORD_PTR)1 << cpu) == 0)
+		return (ISC_R_FAILURE);
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+isc_thread_setnodeaffinity(unsigned int node) {
+	DWORD_PTR mask = 0;
+	unsigned int i, cpu, ncpus;
+
+	ncpus = isc_os_nodencpus(node);
+	if (ncpus == 0)
+		return (ISC_R_RANGE);
+	for (i = 0; i < ncpus; i++) {
+		cpu = isc_os_nodecpu(node, i);
+		if (cpu < sizeof(mask) * 8)
+			mask |= (DWORD_PTR)1 << cpu;
+	}
+	if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+		return (ISC_R_FAILURE);
+	return (ISC_R_SUCCESS);
+}
+
 void *
 isc_thread_key_getspecific(isc_thread_key_t key) {
 	return(TlsGetValue(key));
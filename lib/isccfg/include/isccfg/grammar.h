@@ -169,12 +169,17 @@ struct cfg_obj {
 		cfg_map_t	map;
 		cfg_list_t	list;
 		cfg_obj_t **	tuple;
-		isc_sockaddr_t	sockaddr;
+		/*
+		 * Addresses are much larger than the other members,
+		 * so they are kept out of line (allocated and freed
+		 * with the object) to keep every object small.
+		 */
+		isc_sockaddr_t *sockaddr;
 		struct {
-			isc_sockaddr_t	sockaddr;
+			isc_sockaddr_t *sockaddr;
 			isc_dscp_t	dscp;
 		} sockaddrdscp;
-		cfg_netprefix_t netprefix;
+		cfg_netprefix_t *netprefix;
 	}               value;
 	isc_refcount_t  references;     /*%< reference counter */
 	const char *	file;
@@ -109,6 +109,7 @@ static cfg_type_t cfg_type_dyndb;
 static cfg_type_t cfg_type_filter_aaaa;
 static cfg_type_t cfg_type_ixfrdifftype;
 static cfg_type_t cfg_type_key;
+static cfg_type_t cfg_type_tls;
 static cfg_type_t cfg_type_logfile;
 static cfg_type_t cfg_type_logging;
 static cfg_type_t cfg_type_logseverity;
@@ -126,6 +127,7 @@ static cfg_type_t cfg_type_optional_dscp;
 static cfg_type_t cfg_type_optional_facility;
 static cfg_type_t cfg_type_optional_keyref;
 static cfg_type_t cfg_type_optional_port;
+static cfg_type_t cfg_type_optional_tls;
 static cfg_type_t cfg_type_optional_uint32;
 static cfg_type_t cfg_type_options;
 static cfg_type_t cfg_type_portiplist;
@@ -165,6 +167,7 @@ static cfg_type_t cfg_type_tkey_dhkey = {
 static cfg_tuplefielddef_t listenon_fields[] = {
 	{ "port", &cfg_type_optional_port, 0 },
 	{ "dscp", &cfg_type_optional_dscp, 0 },
+	{ "tls", &cfg_type_optional_tls, 0 },
 	{ "acl", &cfg_type_bracketed_aml, 0 },
 	{ NULL, NULL, 0 }
 };
@@ -632,6 +635,13 @@ static cfg_type_t cfg_type_optional_port = {
 	doc_optional_keyvalue, &cfg_rep_uint32, &port_kw
 };
 
+static keyword_type_t tls_kw = { "tls", &cfg_type_astring };
+
+static cfg_type_t cfg_type_optional_tls = {
+	"optional_tls", parse_optional_keyvalue, print_keyvalue,
+	doc_optional_keyvalue, &cfg_rep_string, &tls_kw
+};
+
 /*% A list of keys, as in the "key" clause of the controls statement. */
 static cfg_type_t cfg_type_keylist = {
 	"keylist", cfg_parse_bracketed_list, cfg_print_bracketed_list,
@@ -989,6 +999,7 @@ namedconf_clauses[] = {
 	{ "options", &cfg_type_options, 0 },
 	{ "statistics-channels", &cfg_type_statschannels,
 	  CFG_CLAUSEFLAG_MULTI },
+	{ "tls", &cfg_type_tls, CFG_CLAUSEFLAG_MULTI },
 	{ "view", &cfg_type_view, CFG_CLAUSEFLAG_MULTI },
 	{ NULL, NULL, 0 }
 };
@@ -1025,6 +1036,12 @@ static cfg_type_t cfg_type_fstrm_model = {
 	&cfg_rep_string, &fstrm_model_enums
 };
 
+static const char *querylogformat_enums[] = { "text", "compact", NULL };
+static cfg_type_t cfg_type_querylogformat = {
+	"querylogformat", cfg_parse_enum, cfg_print_ustring, cfg_doc_enum,
+	&cfg_rep_string, &querylogformat_enums
+};
+
 /*%
  * Clauses that can be found within the 'options' statement.
  */
@@ -1111,12 +1128,17 @@ options_clauses[] = {
 	{ "pid-file", &cfg_type_qstringornone, 0 },
 	{ "port", &cfg_type_uint32, 0 },
 	{ "querylog", &cfg_type_boolean, 0 },
+	{ "querylog-async", &cfg_type_boolean, 0 },
+	{ "querylog-buffer-size", &cfg_type_sizeval, 0 },
+	{ "querylog-file", &cfg_type_qstring, 0 },
+	{ "querylog-format", &cfg_type_querylogformat, 0 },
 	{ "random-device", &cfg_type_qstringornone, 0 },
 	{ "recursing-file", &cfg_type_qstring, 0 },
 	{ "recursive-clients", &cfg_type_uint32, 0 },
 	{ "reserved-sockets", &cfg_type_uint32, 0 },
 	{ "secroots-file", &cfg_type_qstring, 0 },
 	{ "serial-queries", &cfg_type_uint32, CFG_CLAUSEFLAG_OBSOLETE },
+	{ "serial-query-batch", &cfg_type_uint32, 0 },
 	{ "serial-query-rate", &cfg_type_uint32, 0 },
 	{ "server-id", &cfg_type_serverid, 0 },
 	{ "session-keyalg", &cfg_type_astring, 0 },
@@ -1138,6 +1160,8 @@ options_clauses[] = {
 	{ "tkey-gssapi-credential", &cfg_type_qstring, 0 },
 	{ "tkey-gssapi-keytab", &cfg_type_qstring, 0 },
 	{ "transfer-message-size", &cfg_type_uint32, 0 },
+	{ "transfer-render-max-size", &cfg_type_sizenodefault, 0 },
+	{ "transfer-render-threads", &cfg_type_uint32, 0 },
 	{ "transfers-in", &cfg_type_uint32, 0 },
 	{ "transfers-out", &cfg_type_uint32, 0 },
 	{ "transfers-per-ns", &cfg_type_uint32, 0 },
@@ -1810,6 +1834,17 @@ static cfg_type_t cfg_type_prefetch = {
 	"prefetch", cfg_parse_tuple, cfg_print_tuple, cfg_doc_tuple,
 	&cfg_rep_tuple, prefetch_fields
 };
+
+static cfg_tuplefielddef_t prefetchpopular_fields[] = {
+	{ "names", &cfg_type_uint32, 0 },
+	{ "rate", &cfg_type_optional_uint32, 0 },
+	{ NULL, NULL, 0 }
+};
+
+static cfg_type_t cfg_type_prefetchpopular = {
+	"prefetchpopular", cfg_parse_tuple, cfg_print_tuple, cfg_doc_tuple,
+	&cfg_rep_tuple, prefetchpopular_fields
+};
 /*
  * DNS64.
  */
@@ -1902,6 +1937,7 @@ view_clauses[] = {
 	{ "fetch-quota-params", &cfg_type_fetchquota, 0 },
 	{ "fetches-per-server", &cfg_type_fetchesper, 0 },
 	{ "fetches-per-zone", &cfg_type_fetchesper, 0 },
+	{ "fetches-per-zone-queue", &cfg_type_uint32, 0 },
 	{ "filter-aaaa", &cfg_type_bracketed_aml, 0 },
 	{ "filter-aaaa-on-v4", &cfg_type_filter_aaaa, 0 },
 	{ "filter-aaaa-on-v6", &cfg_type_filter_aaaa, 0 },
@@ -1936,6 +1972,7 @@ view_clauses[] = {
 	{ "nxdomain-redirect", &cfg_type_astring, 0 },
 	{ "preferred-glue", &cfg_type_astring, 0 },
 	{ "prefetch", &cfg_type_prefetch, 0 },
+	{ "prefetch-popular", &cfg_type_prefetchpopular, 0 },
 	{ "provide-ixfr", &cfg_type_boolean, 0 },
 	/*
 	 * Note that the query-source option syntax is different
@@ -2399,6 +2436,27 @@ static cfg_type_t cfg_type_key = {
 	cfg_doc_map, &cfg_rep_map, key_clausesets
 };
 
+/*%
+ * Clauses that can be found within the 'tls' statement.
+ */
+static cfg_clausedef_t
+tls_clauses[] = {
+	{ "cert-file", &cfg_type_qstring, 0 },
+	{ "key-file", &cfg_type_qstring, 0 },
+	{ "session-tickets", &cfg_type_boolean, 0 },
+	{ NULL, NULL, 0 }
+};
+
+static cfg_clausedef_t *
+tls_clausesets[] = {
+	tls_clauses,
+	NULL
+};
+static cfg_type_t cfg_type_tls = {
+	"tls", cfg_parse_named_map, cfg_print_map,
+	cfg_doc_map, &cfg_rep_map, tls_clausesets
+};
+
 
 /*%
  * Clauses that can be found in a 'server' statement.
@@ -3307,7 +3365,7 @@ parse_querysource(cfg_parser_t *pctx, const cfg_type_t *type,
 	}
 
 	CHECK(cfg_create_obj(pctx, &cfg_type_querysource, &obj));
-	isc_sockaddr_fromnetaddr(&obj->value.sockaddr, &netaddr, port);
+	isc_sockaddr_fromnetaddr(obj->value.sockaddr, &netaddr, port);
 	obj->value.sockaddrdscp.dscp = dscp;
 	*ret = obj;
 	return (ISC_R_SUCCESS);
@@ -3321,11 +3379,11 @@ parse_querysource(cfg_parser_t *pctx, const cfg_type_t *type,
 static void
 print_querysource(cfg_printer_t *pctx, const cfg_obj_t *obj) {
 	isc_netaddr_t na;
-	isc_netaddr_fromsockaddr(&na, &obj->value.sockaddr);
+	isc_netaddr_fromsockaddr(&na, obj->value.sockaddr);
 	cfg_print_cstr(pctx, "address ");
 	cfg_print_rawaddr(pctx, &na);
 	cfg_print_cstr(pctx, " port ");
-	cfg_print_rawuint(pctx, isc_sockaddr_getport(&obj->value.sockaddr));
+	cfg_print_rawuint(pctx, isc_sockaddr_getport(obj->value.sockaddr));
 	if (obj->value.sockaddrdscp.dscp != -1) {
 		cfg_print_cstr(pctx, " dscp ");
 		cfg_print_rawuint(pctx, obj->value.sockaddrdscp.dscp);
@@ -15,6 +15,7 @@
 
 #include <stdlib.h>
 
+#include <isc/ascii.h>
 #include <isc/buffer.h>
 #include <isc/dir.h>
 #include <isc/formatcheck.h>
@@ -93,6 +94,12 @@ parse_symtab_elt(cfg_parser_t *pctx, const char *name,
 static void
 free_noop(cfg_parser_t *pctx, cfg_obj_t *obj);
 
+static void
+free_sockaddr(cfg_parser_t *pctx, cfg_obj_t *obj);
+
+static void
+free_netprefix(cfg_parser_t *pctx, cfg_obj_t *obj);
+
 static isc_result_t
 cfg_getstringtoken(cfg_parser_t *pctx);
 
@@ -113,9 +120,10 @@ LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_boolean = { "boolean", free_noop };
 LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_map = { "map", free_map };
 LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_list = { "list", free_list };
 LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_tuple = { "tuple", free_tuple };
-LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_sockaddr = { "sockaddr", free_noop };
+LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_sockaddr =
+	{ "sockaddr", free_sockaddr };
 LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_netprefix =
-	{ "netprefix", free_noop };
+	{ "netprefix", free_netprefix };
 LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_void = { "void", free_noop };
 LIBISCCFG_EXTERNAL_DATA cfg_rep_t cfg_rep_fixedpoint =
 	{ "fixedpoint", free_noop };
@@ -1644,6 +1652,7 @@ cfg_parse_mapbody(cfg_parser_t *pctx, const cfg_type_t *type, cfg_obj_t **ret)
 	cfg_obj_t *includename = NULL;
 	isc_symvalue_t symval;
 	cfg_list_t *list = NULL;
+	unsigned int first;
 
 	REQUIRE(pctx != NULL);
 	REQUIRE(type != NULL);
@@ -1685,13 +1694,20 @@ cfg_parse_mapbody(cfg_parser_t *pctx, const cfg_type_t *type, cfg_obj_t **ret)
 			 goto redo;
 		}
 
+		/*
+		 * Comparing the first characters first skips most of
+		 * the full comparisons.
+		 */
 		clause = NULL;
+		first = isc_ascii_tolower((unsigned char)TOKEN_STRING(pctx)[0]);
 		for (clauseset = clausesets; *clauseset != NULL; clauseset++) {
 			for (clause = *clauseset;
 			     clause->name != NULL;
 			     clause++) {
+				if (isc_ascii_tolower(*clause->name) != first)
+					continue;
 				if (strcasecmp(TOKEN_STRING(pctx),
-					   clause->name) == 0)
+					       clause->name) == 0)
 					goto done;
 			}
 		}
@@ -2470,7 +2486,7 @@ parse_netaddr(cfg_parser_t *pctx, const cfg_type_t *type, cfg_obj_t **ret) {
 
 	CHECK(cfg_create_obj(pctx, type, &obj));
 	CHECK(cfg_parse_rawaddr(pctx, flags, &netaddr));
-	isc_sockaddr_fromnetaddr(&obj->value.sockaddr, &netaddr, 0);
+	isc_sockaddr_fromnetaddr(obj->value.sockaddr, &netaddr, 0);
 	*ret = obj;
 	return (ISC_R_SUCCESS);
  cleanup:
@@ -2579,8 +2595,8 @@ cfg_parse_netprefix(cfg_parser_t *pctx, const cfg_type_t *type,
 		prefixlen = addrlen;
 	}
 	CHECK(cfg_create_obj(pctx, &cfg_type_netprefix, &obj));
-	obj->value.netprefix.address = netaddr;
-	obj->value.netprefix.prefixlen = prefixlen;
+	obj->value.netprefix->address = netaddr;
+	obj->value.netprefix->prefixlen = prefixlen;
 	*ret = obj;
 	return (ISC_R_SUCCESS);
  cleanup:
@@ -2590,7 +2606,7 @@ cfg_parse_netprefix(cfg_parser_t *pctx, const cfg_type_t *type,
 
 static void
 print_netprefix(cfg_printer_t *pctx, const cfg_obj_t *obj) {
-	const cfg_netprefix_t *p = &obj->value.netprefix;
+	const cfg_netprefix_t *p = obj->value.netprefix;
 
 	cfg_print_rawaddr(pctx, &p->address);
 	cfg_print_cstr(pctx, "/");
@@ -2611,8 +2627,14 @@ cfg_obj_asnetprefix(const cfg_obj_t *obj, isc_netaddr_t *netaddr,
 	REQUIRE(netaddr != NULL);
 	REQUIRE(prefixlen != NULL);
 
-	*netaddr = obj->value.netprefix.address;
-	*prefixlen = obj->value.netprefix.prefixlen;
+	*netaddr = obj->value.netprefix->address;
+	*prefixlen = obj->value.netprefix->prefixlen;
+}
+
+static void
+free_netprefix(cfg_parser_t *pctx, cfg_obj_t *obj) {
+	isc_mem_put(pctx->mctx, obj->value.netprefix,
+		    sizeof(*obj->value.netprefix));
 }
 
 LIBISCCFG_EXTERNAL_DATA cfg_type_t cfg_type_netprefix = {
@@ -2662,7 +2684,7 @@ parse_sockaddrsub(cfg_parser_t *pctx, const cfg_type_t *type,
 		result = ISC_R_UNEXPECTEDTOKEN;
 		goto cleanup;
 	}
-	isc_sockaddr_fromnetaddr(&obj->value.sockaddr, &netaddr, port);
+	isc_sockaddr_fromnetaddr(obj->value.sockaddr, &netaddr, port);
 	obj->value.sockaddrdscp.dscp = dscp;
 	*ret = obj;
 	return (ISC_R_SUCCESS);
@@ -2707,10 +2729,10 @@ cfg_print_sockaddr(cfg_printer_t *pctx, const cfg_obj_t *obj) {
 	REQUIRE(pctx != NULL);
 	REQUIRE(obj != NULL);
 
-	isc_netaddr_fromsockaddr(&netaddr, &obj->value.sockaddr);
+	isc_netaddr_fromsockaddr(&netaddr, obj->value.sockaddr);
 	isc_netaddr_format(&netaddr, buf, sizeof(buf));
 	cfg_print_cstr(pctx, buf);
-	port = isc_sockaddr_getport(&obj->value.sockaddr);
+	port = isc_sockaddr_getport(obj->value.sockaddr);
 	if (port != 0) {
 		cfg_print_cstr(pctx, " port ");
 		cfg_print_rawuint(pctx, port);
@@ -2767,7 +2789,7 @@ cfg_obj_issockaddr(const cfg_obj_t *obj) {
 const isc_sockaddr_t *
 cfg_obj_assockaddr(const cfg_obj_t *obj) {
 	REQUIRE(obj != NULL && obj->type->rep == &cfg_rep_sockaddr);
-	return (&obj->value.sockaddr);
+	return (obj->value.sockaddr);
 }
 
 isc_dscp_t
@@ -2776,6 +2798,12 @@ cfg_obj_getdscp(const cfg_obj_t *obj) {
 	return (obj->value.sockaddrdscp.dscp);
 }
 
+static void
+free_sockaddr(cfg_parser_t *pctx, cfg_obj_t *obj) {
+	isc_mem_put(pctx->mctx, obj->value.sockaddr,
+		    sizeof(*obj->value.sockaddr));
+}
+
 isc_result_t
 cfg_gettoken(cfg_parser_t *pctx, int options) {
 	isc_result_t result;
@@ -3058,8 +3086,29 @@ cfg_create_obj(cfg_parser_t *pctx, const cfg_type_t *type, cfg_obj_t **ret) {
 	obj->line = pctx->line;
 	obj->pctx = pctx;
 
+	/*
+	 * Addresses are stored out of line; see struct cfg_obj.
+	 */
+	if (type->rep == &cfg_rep_sockaddr) {
+		obj->value.sockaddrdscp.sockaddr =
+			isc_mem_get(pctx->mctx, sizeof(isc_sockaddr_t));
+		if (obj->value.sockaddrdscp.sockaddr == NULL) {
+			isc_mem_put(pctx->mctx, obj, sizeof(cfg_obj_t));
+			return (ISC_R_NOMEMORY);
+		}
+		obj->value.sockaddrdscp.dscp = -1;
+	} else if (type->rep == &cfg_rep_netprefix) {
+		obj->value.netprefix = isc_mem_get(pctx->mctx,
+						   sizeof(cfg_netprefix_t));
+		if (obj->value.netprefix == NULL) {
+			isc_mem_put(pctx->mctx, obj, sizeof(cfg_obj_t));
+			return (ISC_R_NOMEMORY);
+		}
+	}
+
 	result = isc_refcount_init(&obj->references, 1);
 	if (result != ISC_R_SUCCESS) {
+		obj->type->rep->free(pctx, obj);
 		isc_mem_put(pctx->mctx, obj, sizeof(cfg_obj_t));
 		return (result);
 	}
@@ -17,6 +17,7 @@
 #include <isc/hmacsha.h>
 #include <isc/mutex.h>
 #include <isc/once.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/queue.h>
@@ -47,6 +48,7 @@
 #include <dns/rdataset.h>
 #include <dns/resolver.h>
 #include <dns/stats.h>
+#include <dns/tcpmsg.h>
 #include <dns/tsig.h>
 #include <dns/view.h>
 #include <dns/zone.h>
@@ -56,6 +58,7 @@
 #include <ns/notify.h>
 #include <ns/server.h>
 #include <ns/stats.h>
+#include <ns/tls.h>
 #include <ns/update.h>
 
 /***
@@ -73,6 +76,15 @@
  *
  * If a routine is ever created that allows someone other than the client's
  * task to change the client, then the client will have to be locked.
+ *
+ * TCP connections are not owned by a client.  Each accepted connection
+ * gets a small ns_tcpconn_t which holds the socket, the TCP quota and
+ * the idle timer and reads requests from the connection.  A client is
+ * only attached to the connection while it processes a request, so an
+ * idle connection ties up no client object, and the responses to
+ * pipelined requests are sent as soon as they are ready.  Connection
+ * events are run by a small set of tasks shared by all connections of
+ * a client manager, so the connection state is locked.
  */
 
 #define NS_CLIENT_TRACE
@@ -98,6 +110,20 @@
 #define SEND_BUFFER_SIZE		4096
 #define RECV_BUFFER_SIZE		4096
 
+#define TCPCONN_MAXREQUESTS		32
+/*%<
+ * Maximum number of requests from a single TCP connection that are
+ * processed at the same time.  Reading from the connection is suspended
+ * while this many are outstanding.
+ */
+
+#define TLS_RECV_BUFFER_SIZE		4096
+/*%<
+ * Size of the buffer a DNS-over-TLS connection reads into.  It is kept
+ * for the life of the connection, so it is small; bigger records are
+ * simply read in several pieces.
+ */
+
 #ifdef ISC_PLATFORM_USETHREADS
 #define NMCTXS				100
 /*%<
@@ -106,7 +132,11 @@
  * client objects, since concurrent access to a shared context would cause
  * heavy contentions.  The above constant is expected to be enough for
  * completely avoiding contentions among threads for an authoritative-only
- * server.
+ * server.  When the worker threads are bound to NUMA nodes, the pool is
+ * divided into a slice for each node, and a client only uses contexts of
+ * the node its task runs on, so that the memory it frees is reused there.
+ * Inactive clients are kept on a queue per node, and reused by preference
+ * for work arriving on the same node.
  */
 #else
 #define NMCTXS				0
@@ -116,6 +146,17 @@
  */
 #endif
 
+#ifdef ISC_PLATFORM_USETHREADS
+#define NCONNTASKS			16
+/*%<
+ * Number of tasks shared by the TCP connections of a client manager.
+ * A connection task only hands requests over to clients, so a handful
+ * of them is enough to keep all worker threads busy.
+ */
+#else
+#define NCONNTASKS			1
+#endif
+
 #define COOKIE_SIZE 24U /* 8 + 4 + 4 + 8 */
 #define ECS_SIZE 20U /* 2 + 1 + 1 + [0..16] */
 
@@ -129,8 +170,9 @@ struct ns_clientmgr {
 	/* Unlocked. */
 	unsigned int			magic;
 
-	/* The queue object has its own locks */
-	client_queue_t			inactive;     /*%< To be recycled */
+	/* The queue objects have their own locks */
+	client_queue_t *		inactive;     /*%< To be recycled,
+						       *   one per node */
 
 	isc_mem_t *			mctx;
 	ns_server_t *			sctx;
@@ -142,9 +184,10 @@ struct ns_clientmgr {
 	isc_mutex_t			lock;
 	isc_boolean_t			exiting;
 
-	/* Lock covers the clients list */
+	/* Lock covers the clients and connections lists */
 	isc_mutex_t			listlock;
 	client_list_t			clients;      /*%< All active clients */
+	ISC_LIST(ns_tcpconn_t)		conns;	      /*%< TCP connections */
 
 	/* Lock covers the recursing list */
 	isc_mutex_t			reclock;
@@ -155,11 +198,64 @@ struct ns_clientmgr {
 	unsigned int			nextmctx;
 	isc_mem_t *			mctxpool[NMCTXS];
 #endif
+	unsigned int			nnodes;	      /*%< NUMA nodes used */
+
+	/*%< tasks for TCP connections, covered by lock. */
+	unsigned int			nextconntask;
+	isc_task_t *			conntasks[NCONNTASKS];
 };
 
 #define MANAGER_MAGIC			ISC_MAGIC('N', 'S', 'C', 'm')
 #define VALID_MANAGER(m)		ISC_MAGIC_VALID(m, MANAGER_MAGIC)
 
+/*% TCP connection structure */
+struct ns_tcpconn {
+	unsigned int			magic;
+	isc_mem_t *			mctx;
+	ns_clientmgr_t *		manager;
+	ns_interface_t *		interface;
+	isc_task_t *			task;	      /*%< Shared */
+	isc_timer_t *			timer;	      /*%< Idle timer */
+	isc_socket_t *			sock;
+	isc_quota_t *			tcpquota;
+	isc_sockaddr_t			peeraddr;
+	isc_boolean_t			ordered;      /*%< keep-response-order */
+	unsigned int			node;	      /*%< NUMA node */
+	dns_tcpmsg_t			tcpmsg;
+	isc_event_t			ctlevent;     /*%< Sent when closing */
+	unsigned char *			tlsbuf;	      /*%< TLS input */
+
+	/* Lock covers everything below. */
+	isc_mutex_t			lock;
+	unsigned int			references;
+	unsigned int			nrequests;    /*%< Attached clients */
+	isc_boolean_t			reading;
+	isc_boolean_t			timing;	      /*%< Timer set for the
+							   next request */
+	isc_boolean_t			serial;	      /*%< Wait for nrequests 0 */
+	isc_boolean_t			closing;
+	isc_boolean_t			newconn;
+	isc_boolean_t			keepalive;
+
+	/* DNS-over-TLS: the session and the request being decrypted. */
+	ns_tls_t *			tls;	      /*%< NULL for plain DNS */
+	isc_boolean_t			tlsready;     /*%< Handshake done */
+	unsigned char			tlslen[2];
+	unsigned int			tlslenread;
+	unsigned char *			tlsreq;
+	unsigned int			tlsreqlen;
+	unsigned int			tlsreqread;
+
+	/* Covered by the manager's listlock. */
+	ISC_LINK(ns_tcpconn_t)		link;
+};
+
+#define TCPCONN_MAGIC			ISC_MAGIC('N', 'S', 'C', 't')
+#define VALID_TCPCONN(c)		ISC_MAGIC_VALID(c, TCPCONN_MAGIC)
+
+/*% Opcode of a request, taken from its header. */
+#define TCPREQ_OPCODE(base)		(((base)[2] >> 3) & 0x0f)
+
 /*!
  * Client object states.  Ordering is significant: higher-numbered
  * states are generally "more active", meaning that the client can
@@ -191,29 +287,22 @@ struct ns_clientmgr {
  * it is associated with a network interface.  It is on the
  * client manager's list of active clients.
  *
- * If it is a TCP client object, it has a TCP listener socket
- * and an outstanding TCP listen request.
+ * If it is a TCP client object, it either has a TCP listener
+ * socket and an outstanding TCP listen request, or it is attached
+ * to a TCP connection and has been handed a request read from it.
  *
  * If it is a UDP client object, it has a UDP listener socket
  * and an outstanding UDP receive request.
  */
 
-#define NS_CLIENTSTATE_READING  3
-/*%<
- * The client object is a TCP client object that has received
- * a connection.  It has a tcpsocket, tcpmsg, TCP quota, and an
- * outstanding TCP read request.  This state is not used for
- * UDP client objects.
- */
-
-#define NS_CLIENTSTATE_WORKING  4
+#define NS_CLIENTSTATE_WORKING  3
 /*%<
  * The client object has received a request and is working
  * on it.  It has a view, and it may have any of a non-reset OPT,
  * recursion quota, and an outstanding write request.
  */
 
-#define NS_CLIENTSTATE_RECURSING  5
+#define NS_CLIENTSTATE_RECURSING  4
 /*%<
  * The client object is recursing.  It will be on the 'recursing'
  * list.
@@ -235,19 +324,23 @@ struct ns_clientmgr {
 
 LIBNS_EXTERNAL_DATA unsigned int ns_client_requests;
 
-static void read_settimeout(ns_client_t *client, isc_boolean_t newconn);
-static void client_read(ns_client_t *client, isc_boolean_t newconn);
 static void client_accept(ns_client_t *client);
 static void client_udprecv(ns_client_t *client);
+static void client_injectdone(ns_client_t *client, isc_region_t *r);
 static void clientmgr_destroy(ns_clientmgr_t *manager);
 static isc_boolean_t exit_check(ns_client_t *client);
 static void ns_client_endrequest(ns_client_t *client);
 static void client_start(isc_task_t *task, isc_event_t *event);
 static void ns_client_dumpmessage(ns_client_t *client, const char *reason);
 static isc_result_t get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
-			       dns_dispatch_t *disp, isc_boolean_t tcp);
-static isc_result_t get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp,
-			       isc_socket_t *sock);
+			       dns_dispatch_t *disp, isc_boolean_t tcp,
+			       int node);
+static isc_result_t get_worker(ns_clientmgr_t *manager, ns_tcpconn_t *conn,
+			       isc_region_t *r);
+static void tcpconn_close(ns_tcpconn_t *conn);
+static isc_result_t tcpconn_tlssend(ns_tcpconn_t *conn, ns_client_t *client,
+				    isc_region_t *r, unsigned int sockflags);
+static void tcpconn_detach(ns_tcpconn_t **connp, isc_boolean_t keepalive);
 static void compute_cookie(ns_client_t *client, isc_uint32_t when,
 			   isc_uint32_t nonce, const unsigned char *secret,
 			   isc_buffer_t *buf);
@@ -296,30 +389,15 @@ ns_client_settimeout(ns_client_t *client, unsigned int seconds) {
 	}
 }
 
+/*%
+ * Release a request handed over by a TCP connection.
+ */
 static void
-read_settimeout(ns_client_t *client, isc_boolean_t newconn) {
-	isc_result_t result;
-	isc_interval_t interval;
-	unsigned int ds;
-
-	if (newconn)
-		ds = client->sctx->initialtimo;
-	else if (USEKEEPALIVE(client))
-		ds = client->sctx->keepalivetimo;
-	else
-		ds = client->sctx->idletimo;
-
-	isc_interval_set(&interval, ds / 10, 100000000 * (ds % 10));
-	result = isc_timer_reset(client->timer, isc_timertype_once, NULL,
-				 &interval, ISC_FALSE);
-	client->timerset = ISC_TRUE;
-	if (result != ISC_R_SUCCESS) {
-		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-			      NS_LOGMODULE_CLIENT, ISC_LOG_ERROR,
-			      "setting timeout: %s",
-			      isc_result_totext(result));
-		/* Continue anyway. */
-	}
+client_freetcpreq(ns_client_t *client) {
+	if (client->tcpreq != NULL && client->tcpreq != client->recvbuf)
+		isc_mem_put(client->mctx, client->tcpreq, client->tcpreqlen);
+	client->tcpreq = NULL;
+	client->tcpreqlen = 0;
 }
 
 /*%
@@ -359,7 +437,7 @@ exit_check(ns_client_t *client) {
 	if (client->state == NS_CLIENTSTATE_WORKING ||
 	    client->state == NS_CLIENTSTATE_RECURSING)
 	{
-		INSIST(client->newstate <= NS_CLIENTSTATE_READING);
+		INSIST(client->newstate <= NS_CLIENTSTATE_READY);
 		/*
 		 * Let the update processing complete.
 		 */
@@ -405,49 +483,15 @@ exit_check(ns_client_t *client) {
 						client, rlink);
 			UNLOCK(&manager->reclock);
 		}
+		if (client->tcpconn != NULL)
+			tcpconn_detach(&client->tcpconn, USEKEEPALIVE(client));
 		ns_client_endrequest(client);
 
-		client->state = NS_CLIENTSTATE_READING;
-		INSIST(client->recursionquota == NULL);
-
-		if (NS_CLIENTSTATE_READING == client->newstate) {
-			if (!client->pipelined) {
-				client_read(client, ISC_FALSE);
-				client->newstate = NS_CLIENTSTATE_MAX;
-				return (ISC_TRUE); /* We're done. */
-			} else if (client->mortal) {
-				client->newstate = NS_CLIENTSTATE_INACTIVE;
-			} else
-				return (ISC_FALSE);
-		}
-	}
-
-	if (client->state == NS_CLIENTSTATE_READING) {
-		/*
-		 * We are trying to abort the current TCP connection,
-		 * if any.
-		 */
-		INSIST(client->recursionquota == NULL);
-		INSIST(client->newstate <= NS_CLIENTSTATE_READY);
-		if (client->nreads > 0)
-			dns_tcpmsg_cancelread(&client->tcpmsg);
-		if (client->nreads != 0) {
-			/* Still waiting for read cancel completion. */
-			return (ISC_TRUE);
-		}
-
-		if (client->tcpmsg_valid) {
-			dns_tcpmsg_invalidate(&client->tcpmsg);
-			client->tcpmsg_valid = ISC_FALSE;
-		}
 		if (client->tcpsocket != NULL) {
 			CTRACE("closetcp");
 			isc_socket_detach(&client->tcpsocket);
 		}
 
-		if (client->tcpquota != NULL)
-			isc_quota_detach(&client->tcpquota);
-
 		if (client->timerset) {
 			(void)isc_timer_reset(client->timer,
 					      isc_timertype_inactive,
@@ -455,36 +499,17 @@ exit_check(ns_client_t *client) {
 			client->timerset = ISC_FALSE;
 		}
 
-		client->pipelined = ISC_FALSE;
-
 		client->peeraddr_valid = ISC_FALSE;
 
 		client->state = NS_CLIENTSTATE_READY;
 		INSIST(client->recursionquota == NULL);
 
 		/*
-		 * Now the client is ready to accept a new TCP connection
-		 * or UDP request, but we may have enough clients doing
-		 * that already.  Check whether this client needs to remain
-		 * active and force it to go inactive if not.
-		 *
-		 * UDP clients go inactive at this point, but TCP clients
-		 * may remain active if we have fewer active TCP client
-		 * objects than desired due to an earlier quota exhaustion.
-		 */
-		if (client->mortal && TCP_CLIENT(client) &&
-		    ((client->sctx->options & NS_SERVER_CLIENTTEST) == 0))
-		{
-			LOCK(&client->interface->lock);
-			if (client->interface->ntcpcurrent <
-				    client->interface->ntcptarget)
-				client->mortal = ISC_FALSE;
-			UNLOCK(&client->interface->lock);
-		}
-
-		/*
-		 * We don't need the client; send it to the inactive
-		 * queue for recycling.
+		 * Now the client is ready to receive a new UDP request,
+		 * but we may have enough clients doing that already.
+		 * Check whether this client needs to remain active and
+		 * force it to go inactive if not.  TCP clients that
+		 * served a request from a connection are always mortal.
 		 */
 		if (client->mortal) {
 			if (client->newstate > NS_CLIENTSTATE_INACTIVE)
@@ -492,10 +517,8 @@ exit_check(ns_client_t *client) {
 		}
 
 		if (NS_CLIENTSTATE_READY == client->newstate) {
-			if (TCP_CLIENT(client)) {
-				client_accept(client);
-			} else
-				client_udprecv(client);
+			INSIST(!TCP_CLIENT(client));
+			client_udprecv(client);
 			client->newstate = NS_CLIENTSTATE_MAX;
 			return (ISC_TRUE);
 		}
@@ -515,8 +538,11 @@ exit_check(ns_client_t *client) {
 		if (! (client->naccepts == 0))
 			return (ISC_TRUE);
 
-		/* Accept cancel is complete. */
-		if (client->nrecvs > 0)
+		/*
+		 * Accept cancel is complete.  An injected request has no
+		 * socket to cancel; it will be delivered shortly.
+		 */
+		if (client->nrecvs > 0 && client->udpsocket != NULL)
 			isc_socket_cancel(client->udpsocket, client->task,
 					  ISC_SOCKCANCEL_RECV);
 
@@ -529,6 +555,13 @@ exit_check(ns_client_t *client) {
 			return (ISC_TRUE);
 
 		/* Deactivate the client. */
+		if (client->tcpconn != NULL)
+			tcpconn_detach(&client->tcpconn, ISC_FALSE);
+		client_freetcpreq(client);
+		if (client->tcpsocket != NULL)
+			isc_socket_detach(&client->tcpsocket);
+		client->peeraddr_valid = ISC_FALSE;
+
 		if (client->interface)
 			ns_interface_detach(&client->interface);
 
@@ -546,6 +579,7 @@ exit_check(ns_client_t *client) {
 		client->attributes = 0;
 		client->mortal = ISC_FALSE;
 		client->sendcb = NULL;
+		client_injectdone(client, NULL);
 
 		if (client->keytag != NULL) {
 			isc_mem_put(client->mctx, client->keytag,
@@ -569,8 +603,8 @@ exit_check(ns_client_t *client) {
 			     NS_SERVER_CLIENTTEST) == 0 &&
 			    manager != NULL && !manager->exiting)
 			{
-				ISC_QUEUE_PUSH(manager->inactive, client,
-					       ilink);
+				ISC_QUEUE_PUSH(manager->inactive[client->node],
+					       client, ilink);
 			}
 			if (client->needshutdown)
 				isc_task_shutdown(client->task);
@@ -598,7 +632,8 @@ exit_check(ns_client_t *client) {
 			ISC_LIST_UNLINK(manager->clients, client, link);
 			LOCK(&manager->lock);
 			if (manager->exiting &&
-			    ISC_LIST_EMPTY(manager->clients))
+			    ISC_LIST_EMPTY(manager->clients) &&
+			    ISC_LIST_EMPTY(manager->conns))
 				destroy_manager = ISC_TRUE;
 			UNLOCK(&manager->lock);
 			UNLOCK(&manager->listlock);
@@ -615,6 +650,9 @@ exit_check(ns_client_t *client) {
 		if (client->tcpbuf != NULL)
 			isc_mem_put(client->mctx, client->tcpbuf,
 				    TCP_BUFFER_SIZE);
+		if (client->tlsbuf != NULL)
+			isc_mem_put(client->mctx, client->tlsbuf,
+				    client->tlsbuflen);
 		if (client->opt != NULL) {
 			INSIST(dns_rdataset_isassociated(client->opt));
 			dns_rdataset_disassociate(client->opt);
@@ -688,8 +726,8 @@ client_start(isc_task_t *task, isc_event_t *event) {
 		return;
 
 	if (TCP_CLIENT(client)) {
-		if (client->pipelined) {
-			client_read(client, ISC_FALSE);
+		if (client->tcpconn != NULL) {
+			ns__client_request(task, event);
 		} else {
 			client_accept(client);
 		}
@@ -725,7 +763,8 @@ client_shutdown(isc_task_t *task, isc_event_t *event) {
 	}
 
 	if (ISC_QLINK_LINKED(client, ilink))
-		ISC_QUEUE_UNLINK(client->manager->inactive, client, ilink);
+		ISC_QUEUE_UNLINK(client->manager->inactive[client->node],
+				 client, ilink);
 
 	client->newstate = NS_CLIENTSTATE_FREED;
 	client->needshutdown = ISC_FALSE;
@@ -735,7 +774,6 @@ client_shutdown(isc_task_t *task, isc_event_t *event) {
 static void
 ns_client_endrequest(ns_client_t *client) {
 	INSIST(client->naccepts == 0);
-	INSIST(client->nreads == 0);
 	INSIST(client->nsends == 0);
 	INSIST(client->nrecvs == 0);
 	INSIST(client->nupdates == 0);
@@ -769,6 +807,8 @@ ns_client_endrequest(ns_client_t *client) {
 	client->extflags = 0;
 	client->ednsversion = -1;
 	dns_message_reset(client->message, DNS_MESSAGE_INTENTPARSE);
+	client_freetcpreq(client);
+	client_injectdone(client, NULL);
 
 	if (client->recursionquota != NULL) {
 		isc_quota_detach(&client->recursionquota);
@@ -795,12 +835,9 @@ ns_client_endrequest(ns_client_t *client) {
 
 void
 ns_client_next(ns_client_t *client, isc_result_t result) {
-	int newstate;
-
 	REQUIRE(NS_CLIENT_VALID(client));
 	REQUIRE(client->state == NS_CLIENTSTATE_WORKING ||
-		client->state == NS_CLIENTSTATE_RECURSING ||
-		client->state == NS_CLIENTSTATE_READING);
+		client->state == NS_CLIENTSTATE_RECURSING);
 
 	CTRACE("next");
 
@@ -813,14 +850,17 @@ ns_client_next(ns_client_t *client, isc_result_t result) {
 	 * An error processing a TCP request may have left
 	 * the connection out of sync.  To be safe, we always
 	 * sever the connection when result != ISC_R_SUCCESS.
+	 * Responses to other requests that are already being
+	 * processed are still sent.
 	 */
-	if (result == ISC_R_SUCCESS && TCP_CLIENT(client))
-		newstate = NS_CLIENTSTATE_READING;
-	else
-		newstate = NS_CLIENTSTATE_READY;
+	if (result != ISC_R_SUCCESS && client->tcpconn != NULL) {
+		LOCK(&client->tcpconn->lock);
+		tcpconn_close(client->tcpconn);
+		UNLOCK(&client->tcpconn->lock);
+	}
 
-	if (client->newstate > newstate)
-		client->newstate = newstate;
+	if (client->newstate > NS_CLIENTSTATE_READY)
+		client->newstate = NS_CLIENTSTATE_READY;
 	(void)exit_check(client);
 }
 
@@ -855,6 +895,10 @@ client_senddone(isc_task_t *task, isc_event_t *event) {
 		isc_mem_put(client->mctx, client->tcpbuf, TCP_BUFFER_SIZE);
 		client->tcpbuf = NULL;
 	}
+	if (client->tlsbuf != NULL) {
+		isc_mem_put(client->mctx, client->tlsbuf, client->tlsbuflen);
+		client->tlsbuf = NULL;
+	}
 
 	ns_client_next(client, ISC_R_SUCCESS);
 }
@@ -992,9 +1036,21 @@ client_sendpkg(ns_client_t *client, isc_buffer_t *buffer) {
 
 	CTRACE("sendto");
 
-	result = isc_socket_sendto2(sock, &r, client->task,
-				    address, pktinfo,
-				    client->sendevent, sockflags);
+	if (client->injectcb != NULL) {
+		/*
+		 * The request was injected; the response is "sent" at
+		 * once by handing it to the injector.
+		 */
+		client_injectdone(client, &r);
+		client->sendevent->result = ISC_R_SUCCESS;
+		result = ISC_R_SUCCESS;
+	} else if (client->tcpconn != NULL && client->tcpconn->tls != NULL)
+		result = tcpconn_tlssend(client->tcpconn, client, &r,
+					 sockflags);
+	else
+		result = isc_socket_sendto2(sock, &r, client->task,
+					    address, pktinfo,
+					    client->sendevent, sockflags);
 	if (result == ISC_R_SUCCESS || result == ISC_R_INPROGRESS) {
 		client->nsends++;
 		if (result == ISC_R_SUCCESS)
@@ -2246,7 +2302,8 @@ process_opt(ns_client_t *client, dns_rdataset_t *opt) {
 
 /*
  * Handle an incoming request event from the socket (UDP case)
- * or tcpmsg (TCP case).
+ * or the control event of a client that has been handed a request
+ * by a TCP connection (TCP case).
  */
 void
 ns__client_request(isc_task_t *task, isc_event_t *event) {
@@ -2278,9 +2335,7 @@ ns__client_request(isc_task_t *task, isc_event_t *event) {
 
 	INSIST(client->recursionquota == NULL);
 
-	INSIST(client->state == (TCP_CLIENT(client) ?
-				       NS_CLIENTSTATE_READING :
-				       NS_CLIENTSTATE_READY));
+	INSIST(client->state == NS_CLIENTSTATE_READY);
 
 	ns_client_requests++;
 
@@ -2312,21 +2367,25 @@ ns__client_request(isc_task_t *task, isc_event_t *event) {
 		client->nrecvs--;
 	} else {
 		INSIST(TCP_CLIENT(client));
-		REQUIRE(event->ev_type == DNS_EVENT_TCPMSG);
-		REQUIRE(event->ev_sender == &client->tcpmsg);
-		buffer = &client->tcpmsg.buffer;
-		result = client->tcpmsg.result;
-		INSIST(client->nreads == 1);
+		REQUIRE(event->ev_type == NS_EVENT_CLIENTCONTROL);
+		REQUIRE(client->tcpconn != NULL);
 		/*
-		 * client->peeraddr was set when the connection was accepted.
+		 * client->peeraddr was set when the request was handed
+		 * over; tcpreq is NULL if it could not be copied.
 		 */
-		client->nreads--;
+		if (client->tcpreq != NULL) {
+			isc_buffer_init(&tbuffer, client->tcpreq,
+					client->tcpreqlen);
+			isc_buffer_add(&tbuffer, client->tcpreqlen);
+			result = ISC_R_SUCCESS;
+		} else {
+			isc_buffer_initnull(&tbuffer);
+			result = ISC_R_NOMEMORY;
+		}
+		buffer = &tbuffer;
 	}
 
 	reqsize = isc_buffer_usedlength(buffer);
-	/* don't count the length header */
-	if (TCP_CLIENT(client))
-		reqsize -= 2;
 
 	if (exit_check(client)) {
 		return;
@@ -2337,6 +2396,15 @@ ns__client_request(isc_task_t *task, isc_event_t *event) {
 	client->tnow = client->requesttime;
 	client->now = isc_time_seconds(&client->tnow);
 
+	/*
+	 * Count the requests handled away from the NUMA node the client's
+	 * memory belongs to.
+	 */
+	if (client->manager->nnodes > 1 &&
+	    isc_os_currentnode() != client->node)
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_remotenode);
+
 	if (result != ISC_R_SUCCESS) {
 		if (TCP_CLIENT(client)) {
 			ns_client_next(client, result);
@@ -2493,24 +2561,6 @@ ns__client_request(isc_task_t *task, isc_event_t *event) {
 		return;
 	}
 
-	/*
-	 * Pipeline TCP query processing.
-	 */
-	if (client->message->opcode != dns_opcode_query)
-		client->pipelined = ISC_FALSE;
-	if (TCP_CLIENT(client) && client->pipelined) {
-		result = isc_quota_reserve(&client->sctx->tcpquota);
-		if (result == ISC_R_SUCCESS)
-			result = ns_client_replace(client);
-		if (result != ISC_R_SUCCESS) {
-			ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-				      NS_LOGMODULE_CLIENT, ISC_LOG_WARNING,
-				      "no more TCP clients(read): %s",
-				      isc_result_totext(result));
-			client->pipelined = ISC_FALSE;
-		}
-	}
-
 	dns_opcodestats_increment(client->sctx->opcodestats,
 				  client->message->opcode);
 	switch (client->message->opcode) {
@@ -2879,12 +2929,19 @@ client_timeout(isc_task_t *task, isc_event_t *event) {
 	(void)exit_check(client);
 }
 
+/*%
+ * Get a memory context for a client or connection on NUMA node 'node',
+ * or on any node if 'node' is negative.  The node is returned in
+ * '*nodep'.
+ */
 static isc_result_t
-get_clientmctx(ns_clientmgr_t *manager, isc_mem_t **mctxp) {
+get_clientmctx(ns_clientmgr_t *manager, int node, isc_mem_t **mctxp,
+	       unsigned int *nodep)
+{
 	isc_mem_t *clientmctx;
 	isc_result_t result;
 #if NMCTXS > 0
-	unsigned int nextmctx;
+	unsigned int nextmctx, slice;
 #endif
 
 	MTRACE("clientmctx");
@@ -2893,15 +2950,21 @@ get_clientmctx(ns_clientmgr_t *manager, isc_mem_t **mctxp) {
 	 * Caller must be holding the manager lock.
 	 */
 	if ((manager->sctx->options & NS_SERVER_CLIENTTEST) != 0) {
+		*nodep = (node >= 0) ? (unsigned int)node % manager->nnodes : 0;
 		result = isc_mem_create(0, 0, mctxp);
 		if (result == ISC_R_SUCCESS)
 			isc_mem_setname(*mctxp, "client", NULL);
 		return (result);
 	}
 #if NMCTXS > 0
+	slice = NMCTXS / manager->nnodes;
 	nextmctx = manager->nextmctx++;
-	if (manager->nextmctx == NMCTXS)
+	if (manager->nextmctx == slice * manager->nnodes)
 		manager->nextmctx = 0;
+	if (node >= 0)
+		nextmctx = ((unsigned int)node % manager->nnodes) * slice +
+			   nextmctx % slice;
+	*nodep = nextmctx / slice;
 
 	INSIST(nextmctx < NMCTXS);
 
@@ -2915,6 +2978,8 @@ get_clientmctx(ns_clientmgr_t *manager, isc_mem_t **mctxp) {
 		manager->mctxpool[nextmctx] = clientmctx;
 	}
 #else
+	UNUSED(node);
+	*nodep = 0;
 	clientmctx = manager->mctx;
 #endif
 
@@ -2924,10 +2989,11 @@ get_clientmctx(ns_clientmgr_t *manager, isc_mem_t **mctxp) {
 }
 
 static isc_result_t
-client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
+client_create(ns_clientmgr_t *manager, int node, ns_client_t **clientp) {
 	ns_client_t *client;
 	isc_result_t result;
 	isc_mem_t *mctx = NULL;
+	unsigned int mctxnode;
 
 	/*
 	 * Caller must be holding the manager lock.
@@ -2939,7 +3005,7 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 
 	REQUIRE(clientp != NULL && *clientp == NULL);
 
-	result = get_clientmctx(manager, &mctx);
+	result = get_clientmctx(manager, node, &mctx, &mctxnode);
 	if (result != ISC_R_SUCCESS)
 		return (result);
 
@@ -2949,12 +3015,14 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 		return (ISC_R_NOMEMORY);
 	}
 	client->mctx = mctx;
+	client->node = mctxnode;
 
 	client->sctx = NULL;
 	ns_server_attach(manager->sctx, &client->sctx);
 
 	client->task = NULL;
-	result = isc_task_create(manager->taskmgr, 0, &client->task);
+	result = isc_task_create_bound(manager->taskmgr, 0, &client->task,
+				       (int)client->node);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_client;
 	isc_task_setname(client->task, "client", client);
@@ -3004,7 +3072,6 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	client->state = NS_CLIENTSTATE_INACTIVE;
 	client->newstate = NS_CLIENTSTATE_MAX;
 	client->naccepts = 0;
-	client->nreads = 0;
 	client->nsends = 0;
 	client->nrecvs = 0;
 	client->nupdates = 0;
@@ -3016,8 +3083,12 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	client->udpsocket = NULL;
 	client->tcplistener = NULL;
 	client->tcpsocket = NULL;
-	client->tcpmsg_valid = ISC_FALSE;
+	client->tcpconn = NULL;
 	client->tcpbuf = NULL;
+	client->tlsbuf = NULL;
+	client->tlsbuflen = 0;
+	client->tcpreq = NULL;
+	client->tcpreqlen = 0;
 	client->opt = NULL;
 	client->udpsize = 512;
 	client->dscp = -1;
@@ -3030,8 +3101,8 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	dns_name_init(&client->signername, NULL);
 	client->mortal = ISC_FALSE;
 	client->sendcb = NULL;
-	client->pipelined = ISC_FALSE;
-	client->tcpquota = NULL;
+	client->injectcb = NULL;
+	client->injectarg = NULL;
 	client->recursionquota = NULL;
 	client->interface = NULL;
 	client->peeraddr_valid = ISC_FALSE;
@@ -3106,162 +3177,969 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	return (result);
 }
 
-static void
-client_read(ns_client_t *client, isc_boolean_t newconn) {
-	isc_result_t result;
+/***
+ *** TCP connections
+ ***/
 
-	CTRACE("read");
+static void
+tcpconn_log(ns_tcpconn_t *conn, int level, const char *fmt, ...)
+     ISC_FORMAT_PRINTF(3, 4);
 
-	result = dns_tcpmsg_readmessage(&client->tcpmsg, client->task,
-					ns__client_request, client);
-	if (result != ISC_R_SUCCESS)
-		goto fail;
+static void
+tcpconn_log(ns_tcpconn_t *conn, int level, const char *fmt, ...) {
+	char msgbuf[2048];
+	char peerbuf[ISC_SOCKADDR_FORMATSIZE];
+	va_list ap;
 
-	/*
-	 * Set a timeout to limit the amount of time we will wait
-	 * for a request on this TCP connection.
-	 */
-	read_settimeout(client, newconn);
+	if (! isc_log_wouldlog(ns_lctx, level))
+		return;
 
-	client->state = client->newstate = NS_CLIENTSTATE_READING;
-	INSIST(client->nreads == 0);
-	INSIST(client->recursionquota == NULL);
-	client->nreads++;
+	va_start(ap, fmt);
+	vsnprintf(msgbuf, sizeof(msgbuf), fmt, ap);
+	va_end(ap);
 
-	return;
- fail:
-	ns_client_next(client, result);
+	isc_sockaddr_format(&conn->peeraddr, peerbuf, sizeof(peerbuf));
+	isc_log_write(ns_lctx, NS_LOGCATEGORY_CLIENT, NS_LOGMODULE_CLIENT,
+		      level, "client @%p %s: TCP connection: %s",
+		      conn, peerbuf, msgbuf);
 }
 
+static void tcpconn_request(isc_task_t *task, isc_event_t *event);
+static void tcpconn_tlsrecv(isc_task_t *task, isc_event_t *event);
+static void tcpconn_tlssenddone(isc_task_t *task, isc_event_t *event);
+static isc_boolean_t tcpconn_tlsrequests(ns_tcpconn_t *conn);
+
+/*%
+ * Start reading the next request from 'conn', unless it is closing,
+ * already reading, or has to wait for the requests being processed.
+ *
+ * Requires conn->lock to be held.
+ */
 static void
-client_newconn(isc_task_t *task, isc_event_t *event) {
-	ns_client_t *client = event->ev_arg;
-	isc_socket_newconnev_t *nevent = (isc_socket_newconnev_t *)event;
-	dns_aclenv_t *env = ns_interfacemgr_getaclenv(client->interface->mgr);
+tcpconn_read(ns_tcpconn_t *conn) {
 	isc_result_t result;
+	isc_interval_t interval;
+	isc_region_t r;
+	ns_server_t *sctx = conn->manager->sctx;
+	unsigned int ds;
 
-	REQUIRE(event->ev_type == ISC_SOCKEVENT_NEWCONN);
-	REQUIRE(NS_CLIENT_VALID(client));
-	REQUIRE(client->task == task);
+	if (conn->closing || conn->reading || conn->serial ||
+	    conn->nrequests >= TCPCONN_MAXREQUESTS)
+		return;
 
-	UNUSED(task);
+	if (conn->tls != NULL) {
+		/*
+		 * Requests may have been decrypted from what was read
+		 * before; the socket is only read when none is left.
+		 */
+		if (!tcpconn_tlsrequests(conn))
+			return;
+		r.base = conn->tlsbuf;
+		r.length = TLS_RECV_BUFFER_SIZE;
+		result = isc_socket_recv(conn->sock, &r, 1, conn->task,
+					 tcpconn_tlsrecv, conn);
+	} else
+		result = dns_tcpmsg_readmessage(&conn->tcpmsg, conn->task,
+						tcpconn_request, conn);
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "read failed: %s",
+			    isc_result_totext(result));
+		tcpconn_close(conn);
+		return;
+	}
+	conn->reading = ISC_TRUE;
 
-	INSIST(client->state == NS_CLIENTSTATE_READY);
+	/*
+	 * Set a timeout to limit the amount of time we will wait
+	 * for a request on this TCP connection.  A TLS request can
+	 * take several reads; the timer is not restarted by those,
+	 * so that a request cannot be trickled in a byte at a time.
+	 */
+	if (conn->timing)
+		return;
+	conn->timing = ISC_TRUE;
+	if (conn->newconn)
+		ds = sctx->initialtimo;
+	else if (conn->keepalive)
+		ds = sctx->keepalivetimo;
+	else
+		ds = sctx->idletimo;
 
-	INSIST(client->naccepts == 1);
-	client->naccepts--;
+	isc_interval_set(&interval, ds / 10, 100000000 * (ds % 10));
+	result = isc_timer_reset(conn->timer, isc_timertype_once, NULL,
+				 &interval, ISC_TRUE);
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_ERROR, "setting timeout: %s",
+			    isc_result_totext(result));
+		/* Continue anyway. */
+	}
+}
 
-	LOCK(&client->interface->lock);
-	INSIST(client->interface->ntcpcurrent > 0);
-	client->interface->ntcpcurrent--;
-	UNLOCK(&client->interface->lock);
+/*%
+ * Stop reading from 'conn'.  Requests that are already being processed
+ * are completed and their responses sent; the connection goes away
+ * when the last of them is done.
+ *
+ * Requires conn->lock to be held.
+ */
+static void
+tcpconn_close(ns_tcpconn_t *conn) {
+	isc_event_t *ev;
 
-	/*
-	 * We must take ownership of the new socket before the exit
-	 * check to make sure it gets destroyed if we decide to exit.
-	 */
-	if (nevent->result == ISC_R_SUCCESS) {
-		client->tcpsocket = nevent->newsocket;
-		isc_socket_setname(client->tcpsocket, "client-tcp", NULL);
-		client->state = NS_CLIENTSTATE_READING;
-		INSIST(client->recursionquota == NULL);
+	if (conn->closing)
+		return;
 
-		(void)isc_socket_getpeername(client->tcpsocket,
-					     &client->peeraddr);
-		client->peeraddr_valid = ISC_TRUE;
-		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-			   NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
-			   "new TCP connection");
-	} else {
+	conn->closing = ISC_TRUE;
+	if (conn->reading) {
 		/*
-		 * XXXRTH  What should we do?  We're trying to accept but
-		 *	   it didn't work.  If we just give up, then TCP
-		 *	   service may eventually stop.
-		 *
-		 *	   For now, we just go idle.
-		 *
-		 *	   Going idle is probably the right thing if the
-		 *	   I/O was canceled.
+		 * tcpconn_request() or tcpconn_tlsrecv() will finish
+		 * closing when the read completes.
 		 */
-		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-			      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
-			      "accept failed: %s",
-			      isc_result_totext(nevent->result));
+		if (conn->tls != NULL)
+			isc_socket_cancel(conn->sock, conn->task,
+					  ISC_SOCKCANCEL_RECV);
+		else
+			dns_tcpmsg_cancelread(&conn->tcpmsg);
+	} else {
+		ev = &conn->ctlevent;
+		isc_task_send(conn->task, &ev);
 	}
+}
 
-	if (exit_check(client))
-		goto freeevent;
+/*%
+ * Release what the read loop of a closing connection holds.  Returns
+ * ISC_TRUE if the caller must destroy the connection after unlocking it.
+ *
+ * Requires conn->lock to be held; must be called from conn->task so
+ * that no timer event can be running.
+ */
+static isc_boolean_t
+tcpconn_finish(ns_tcpconn_t *conn) {
+	INSIST(conn->closing && !conn->reading);
 
-	if (nevent->result == ISC_R_SUCCESS) {
-		int match;
-		isc_netaddr_t netaddr;
+	isc_timer_detach(&conn->timer);
 
-		isc_netaddr_fromsockaddr(&netaddr, &client->peeraddr);
+	INSIST(conn->references > 0);
+	conn->references--;
+	return (ISC_TF(conn->references == 0));
+}
 
-		if (client->sctx->blackholeacl != NULL &&
-		    dns_acl_match(&netaddr, NULL,
-				  client->sctx->blackholeacl,
-				  env, &match, NULL) == ISC_R_SUCCESS &&
-		    match > 0)
-		{
-			ns_client_log(client, DNS_LOGCATEGORY_SECURITY,
-				      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(10),
-				      "blackholed connection attempt");
-			client->newstate = NS_CLIENTSTATE_READY;
-			(void)exit_check(client);
-			goto freeevent;
-		}
+static void
+tcpconn_destroy(ns_tcpconn_t *conn) {
+	ns_clientmgr_t *manager = conn->manager;
+	isc_boolean_t destroy_manager = ISC_FALSE;
 
-		INSIST(client->tcpmsg_valid == ISC_FALSE);
-		dns_tcpmsg_init(client->mctx, client->tcpsocket,
-				&client->tcpmsg);
-		client->tcpmsg_valid = ISC_TRUE;
+	REQUIRE(VALID_TCPCONN(conn));
+	INSIST(conn->references == 0 && conn->nrequests == 0);
+	INSIST(conn->timer == NULL);
+
+	tcpconn_log(conn, ISC_LOG_DEBUG(3), "closed");
+
+	LOCK(&manager->listlock);
+	ISC_LIST_UNLINK(manager->conns, conn, link);
+	LOCK(&manager->lock);
+	if (manager->exiting &&
+	    ISC_LIST_EMPTY(manager->clients) &&
+	    ISC_LIST_EMPTY(manager->conns))
+		destroy_manager = ISC_TRUE;
+	UNLOCK(&manager->lock);
+	UNLOCK(&manager->listlock);
+
+	if (conn->tls != NULL) {
+		ns_tls_destroy(&conn->tls);
+		isc_mem_put(conn->mctx, conn->tlsbuf, TLS_RECV_BUFFER_SIZE);
+		if (conn->tlsreq != NULL)
+			isc_mem_put(conn->mctx, conn->tlsreq, conn->tlsreqlen);
+	}
+	dns_tcpmsg_invalidate(&conn->tcpmsg);
+	isc_socket_detach(&conn->sock);
+	if (conn->tcpquota != NULL)
+		isc_quota_detach(&conn->tcpquota);
+	isc_task_detach(&conn->task);
+	ns_interface_detach(&conn->interface);
+
+	DESTROYLOCK(&conn->lock);
+	conn->magic = 0;
+	isc_mem_putanddetach(&conn->mctx, conn, sizeof(*conn));
+
+	if (destroy_manager)
+		clientmgr_destroy(manager);
+}
 
-		/*
-		 * Let a new client take our place immediately, before
-		 * we wait for a request packet.  If we don't,
-		 * telnetting to port 53 (once per CPU) will
-		 * deny service to legitimate TCP clients.
-		 */
-		client->pipelined = ISC_FALSE;
-		result = isc_quota_attach(&client->sctx->tcpquota,
-					  &client->tcpquota);
-		if (result == ISC_R_SUCCESS)
-			result = ns_client_replace(client);
-		if (result != ISC_R_SUCCESS) {
-			ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-				      NS_LOGMODULE_CLIENT, ISC_LOG_WARNING,
-				      "no more TCP clients(accept): %s",
-				      isc_result_totext(result));
-		} else if (client->sctx->keepresporder == NULL ||
-			   !dns_acl_allowed(&netaddr, NULL, NULL, 0, NULL,
-					    client->sctx->keepresporder, env))
-		{
-			client->pipelined = ISC_TRUE;
-		}
+/*%
+ * Hand the request in 'r', read from 'conn', over to a client.  If that
+ * fails the connection is closed.
+ *
+ * Requires conn->lock to be held.
+ */
+static isc_result_t
+tcpconn_dispatch(ns_tcpconn_t *conn, isc_region_t *r) {
+	isc_result_t result;
 
-		client_read(client, ISC_TRUE);
+	/*
+	 * Requests other than queries, and all requests from clients
+	 * that want their responses in order, are processed one at
+	 * a time: nothing more is read until they are done.
+	 */
+	if (conn->ordered || r->length < DNS_MESSAGE_HEADERLEN ||
+	    TCPREQ_OPCODE(r->base) != dns_opcode_query)
+		conn->serial = ISC_TRUE;
+
+	conn->newconn = ISC_FALSE;
+	conn->timing = ISC_FALSE;
+	conn->nrequests++;
+	conn->references++;
+	result = get_worker(conn->manager, conn, r);
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_WARNING,
+			    "no more TCP clients(read): %s",
+			    isc_result_totext(result));
+		conn->nrequests--;
+		conn->references--;
+		if (conn->nrequests == 0)
+			conn->serial = ISC_FALSE;
+		tcpconn_close(conn);
 	}
-
- freeevent:
-	isc_event_free(&event);
+	return (result);
 }
 
+/*%
+ * A request has been read from the connection, or the read failed.
+ * Hand the request over to a client and read the next one.
+ */
 static void
-client_accept(ns_client_t *client) {
+tcpconn_request(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+	isc_region_t r;
 	isc_result_t result;
+	isc_boolean_t destroy;
 
-	CTRACE("accept");
+	REQUIRE(event->ev_type == DNS_EVENT_TCPMSG);
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(event->ev_sender == &conn->tcpmsg);
+	REQUIRE(task == conn->task);
 
-	result = isc_socket_accept(client->tcplistener, client->task,
-				   client_newconn, client);
+	UNUSED(task);
+
+	LOCK(&conn->lock);
+	INSIST(conn->reading);
+	conn->reading = ISC_FALSE;
+	conn->timing = ISC_FALSE;
+	(void)isc_timer_reset(conn->timer, isc_timertype_inactive,
+			      NULL, NULL, ISC_TRUE);
+
+	result = conn->tcpmsg.result;
+	if (result == ISC_R_SUCCESS && conn->closing)
+		result = ISC_R_CANCELED;
 	if (result != ISC_R_SUCCESS) {
-		UNEXPECTED_ERROR(__FILE__, __LINE__,
-				 "isc_socket_accept() failed: %s",
-				 isc_result_totext(result));
-		/*
-		 * XXXRTH  What should we do?  We're trying to accept but
-		 *	   it didn't work.  If we just give up, then TCP
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "closing: %s",
+			    isc_result_totext(result));
+		conn->closing = ISC_TRUE;
+		destroy = tcpconn_finish(conn);
+		UNLOCK(&conn->lock);
+		if (destroy)
+			tcpconn_destroy(conn);
+		return;
+	}
+
+	isc_buffer_usedregion(&conn->tcpmsg.buffer, &r);
+	if (tcpconn_dispatch(conn, &r) == ISC_R_SUCCESS)
+		tcpconn_read(conn);
+	UNLOCK(&conn->lock);
+}
+
+/*%
+ * Send the data that the TLS session of 'conn' has to transmit on its
+ * own behalf: handshake messages, session tickets and alerts.
+ *
+ * Requires conn->lock to be held.
+ */
+static void
+tcpconn_tlsflush(ns_tcpconn_t *conn) {
+	isc_region_t r;
+	isc_result_t result;
+
+	r.length = ns_tls_pending(conn->tls);
+	if (r.length == 0)
+		return;
+
+	r.base = isc_mem_get(conn->mctx, r.length);
+	if (r.base == NULL) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "TLS send failed: %s",
+			    isc_result_totext(ISC_R_NOMEMORY));
+		tcpconn_close(conn);
+		return;
+	}
+	r.length = ns_tls_output(conn->tls, r.base, r.length);
+
+	result = isc_socket_send(conn->sock, &r, conn->task,
+				 tcpconn_tlssenddone, conn);
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "TLS send failed: %s",
+			    isc_result_totext(result));
+		isc_mem_put(conn->mctx, r.base, r.length);
+		tcpconn_close(conn);
+		return;
+	}
+	conn->references++;
+}
+
+static void
+tcpconn_tlssenddone(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+	isc_socketevent_t *sevent = (isc_socketevent_t *)event;
+	isc_boolean_t destroy;
+
+	REQUIRE(event->ev_type == ISC_SOCKEVENT_SENDDONE);
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(task == conn->task);
+
+	UNUSED(task);
+
+	LOCK(&conn->lock);
+	isc_mem_put(conn->mctx, sevent->region.base, sevent->region.length);
+	if (sevent->result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "TLS send failed: %s",
+			    isc_result_totext(sevent->result));
+		tcpconn_close(conn);
+	}
+	INSIST(conn->references > 0);
+	conn->references--;
+	destroy = ISC_TF(conn->references == 0);
+	UNLOCK(&conn->lock);
+
+	isc_event_free(&event);
+	if (destroy)
+		tcpconn_destroy(conn);
+}
+
+/*%
+ * Take the next complete request out of the TLS session of 'conn'.
+ * The length prefix and the request are assembled across calls, as
+ * the stream is decrypted piecemeal.
+ *
+ * Requires conn->lock to be held.
+ */
+static isc_result_t
+tcpconn_tlsmessage(ns_tcpconn_t *conn, isc_region_t *r) {
+	isc_result_t result;
+	unsigned int n;
+
+	while (conn->tlslenread < sizeof(conn->tlslen)) {
+		result = ns_tls_read(conn->tls,
+				     conn->tlslen + conn->tlslenread,
+				     sizeof(conn->tlslen) - conn->tlslenread,
+				     &n);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+		conn->tlslenread += n;
+	}
+
+	if (conn->tlsreq == NULL) {
+		conn->tlsreqlen = (conn->tlslen[0] << 8) | conn->tlslen[1];
+		if (conn->tlsreqlen == 0)
+			return (ISC_R_UNEXPECTEDEND);
+		conn->tlsreq = isc_mem_get(conn->mctx, conn->tlsreqlen);
+		if (conn->tlsreq == NULL)
+			return (ISC_R_NOMEMORY);
+		conn->tlsreqread = 0;
+	}
+
+	while (conn->tlsreqread < conn->tlsreqlen) {
+		result = ns_tls_read(conn->tls,
+				     conn->tlsreq + conn->tlsreqread,
+				     conn->tlsreqlen - conn->tlsreqread, &n);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+		conn->tlsreqread += n;
+	}
+
+	r->base = conn->tlsreq;
+	r->length = conn->tlsreqlen;
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Hand the requests that can be decrypted from what has been read from
+ * 'conn' over to clients, as tcpconn_request() does for plain DNS, and
+ * send what the TLS session has to transmit.  Returns ISC_TRUE if more
+ * must be read from the socket.
+ *
+ * Requires conn->lock to be held.
+ */
+static isc_boolean_t
+tcpconn_tlsrequests(ns_tcpconn_t *conn) {
+	ns_server_t *sctx = conn->manager->sctx;
+	isc_result_t result;
+	isc_region_t r;
+	isc_boolean_t resumed;
+
+	for (;;) {
+		result = tcpconn_tlsmessage(conn, &r);
+
+		if (!conn->tlsready && ns_tls_handshakedone(conn->tls)) {
+			conn->tlsready = ISC_TRUE;
+			resumed = ns_tls_resumed(conn->tls);
+			ns_stats_increment(sctx->nsstats,
+					   ns_statscounter_tlshandshake);
+			if (resumed)
+				ns_stats_increment(sctx->nsstats,
+						   ns_statscounter_tlsresumed);
+			tcpconn_log(conn, ISC_LOG_DEBUG(3),
+				    "TLS handshake done%s",
+				    resumed ? " (resumed)" : "");
+		}
+
+		if (result != ISC_R_SUCCESS)
+			break;
+
+		ns_stats_increment(sctx->nsstats, ns_statscounter_tlsrequest);
+		result = tcpconn_dispatch(conn, &r);
+		isc_mem_put(conn->mctx, conn->tlsreq, conn->tlsreqlen);
+		conn->tlsreq = NULL;
+		conn->tlslenread = 0;
+		if (result != ISC_R_SUCCESS || conn->serial ||
+		    conn->nrequests >= TCPCONN_MAXREQUESTS)
+		{
+			tcpconn_tlsflush(conn);
+			return (ISC_FALSE);
+		}
+	}
+
+	/*
+	 * Send the handshake messages, or the alert for an error.
+	 */
+	tcpconn_tlsflush(conn);
+	if (result == ISC_R_WOULDBLOCK)
+		return (ISC_TRUE);
+
+	if (result == ISC_R_FAILURE)
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "TLS error: %s",
+			    ns_tls_error(conn->tls));
+	else
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "closing: %s",
+			    isc_result_totext(result));
+	if (!conn->tlsready)
+		ns_stats_increment(sctx->nsstats,
+				   ns_statscounter_tlshandshakefail);
+	tcpconn_close(conn);
+	return (ISC_FALSE);
+}
+
+/*%
+ * Data has been read from a DNS-over-TLS connection, or the read
+ * failed.  Decrypt it and hand the requests it completes over to
+ * clients.
+ */
+static void
+tcpconn_tlsrecv(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+	isc_socketevent_t *sevent = (isc_socketevent_t *)event;
+	isc_region_t r;
+	isc_result_t result;
+	isc_boolean_t destroy;
+
+	REQUIRE(event->ev_type == ISC_SOCKEVENT_RECVDONE);
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(task == conn->task);
+
+	UNUSED(task);
+
+	LOCK(&conn->lock);
+	INSIST(conn->reading);
+	conn->reading = ISC_FALSE;
+
+	result = sevent->result;
+	if (result == ISC_R_SUCCESS && conn->closing)
+		result = ISC_R_CANCELED;
+	if (result == ISC_R_SUCCESS) {
+		r.base = sevent->region.base;
+		r.length = sevent->n;
+		result = ns_tls_input(conn->tls, &r);
+	}
+	isc_event_free(&event);
+
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "closing: %s",
+			    isc_result_totext(result));
+		conn->closing = ISC_TRUE;
+		destroy = tcpconn_finish(conn);
+		UNLOCK(&conn->lock);
+		if (destroy)
+			tcpconn_destroy(conn);
+		return;
+	}
+
+	tcpconn_read(conn);
+	UNLOCK(&conn->lock);
+}
+
+/*%
+ * Encrypt the response in 'r', prepared by 'client', and send it on the
+ * TLS connection 'conn'.  The encrypted response is kept in the client
+ * until the send completes.  This is done under the connection lock,
+ * so that records go out in the order the session produced them.
+ */
+static isc_result_t
+tcpconn_tlssend(ns_tcpconn_t *conn, ns_client_t *client, isc_region_t *r,
+		unsigned int sockflags)
+{
+	isc_region_t cr;
+	isc_result_t result;
+
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(client->tlsbuf == NULL);
+
+	LOCK(&conn->lock);
+	result = ns_tls_write(conn->tls, r);
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "TLS error: %s",
+			    ns_tls_error(conn->tls));
+		goto unlock;
+	}
+
+	cr.length = ns_tls_pending(conn->tls);
+	cr.base = isc_mem_get(client->mctx, cr.length);
+	if (cr.base == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto unlock;
+	}
+	cr.length = ns_tls_output(conn->tls, cr.base, cr.length);
+	client->tlsbuf = cr.base;
+	client->tlsbuflen = cr.length;
+
+	result = isc_socket_sendto2(conn->sock, &cr, client->task, NULL, NULL,
+				    client->sendevent, sockflags);
+	if (result != ISC_R_SUCCESS && result != ISC_R_INPROGRESS) {
+		isc_mem_put(client->mctx, client->tlsbuf, client->tlsbuflen);
+		client->tlsbuf = NULL;
+	} else
+		ns_stats_increment(conn->manager->sctx->nsstats,
+				   ns_statscounter_tlsresponse);
+
+ unlock:
+	UNLOCK(&conn->lock);
+	return (result);
+}
+
+isc_result_t
+ns_client_sendstream(ns_client_t *client, isc_mem_t *mctx,
+		     isc_region_t *region, isc_taskaction_t action, void *arg,
+		     isc_boolean_t *copiedp)
+{
+	ns_tcpconn_t *conn;
+	isc_region_t cr;
+	isc_result_t result;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+	REQUIRE(TCP_CLIENT(client));
+	REQUIRE(copiedp != NULL);
+
+	*copiedp = ISC_FALSE;
+	conn = client->tcpconn;
+	if (conn == NULL || conn->tls == NULL)
+		return (isc_socket_send(client->tcpsocket, region,
+					client->task, action, arg));
+
+	/*
+	 * The connection lock keeps the records of this stream and
+	 * those of other requests on the connection apart.
+	 */
+	LOCK(&conn->lock);
+	result = ns_tls_write(conn->tls, region);
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "TLS error: %s",
+			    ns_tls_error(conn->tls));
+		goto unlock;
+	}
+
+	cr.length = ns_tls_pending(conn->tls);
+	cr.base = isc_mem_get(mctx, cr.length);
+	if (cr.base == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto unlock;
+	}
+	cr.length = ns_tls_output(conn->tls, cr.base, cr.length);
+
+	result = isc_socket_send(conn->sock, &cr, client->task, action, arg);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(mctx, cr.base, cr.length);
+		goto unlock;
+	}
+	*copiedp = ISC_TRUE;
+	ns_stats_increment(conn->manager->sctx->nsstats,
+			   ns_statscounter_tlsresponse);
+
+ unlock:
+	UNLOCK(&conn->lock);
+	return (result);
+}
+
+static void
+tcpconn_timeout(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+
+	REQUIRE(event->ev_type == ISC_TIMEREVENT_LIFE ||
+		event->ev_type == ISC_TIMEREVENT_IDLE);
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(task == conn->task);
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+
+	LOCK(&conn->lock);
+	if (conn->reading) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "timed out");
+		tcpconn_close(conn);
+	}
+	UNLOCK(&conn->lock);
+}
+
+/*%
+ * The connection has been closed while no read was outstanding.
+ */
+static void
+tcpconn_shutdown(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+	isc_boolean_t destroy;
+
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(event == &conn->ctlevent);
+	REQUIRE(task == conn->task);
+
+	UNUSED(task);
+
+	LOCK(&conn->lock);
+	destroy = tcpconn_finish(conn);
+	UNLOCK(&conn->lock);
+	if (destroy)
+		tcpconn_destroy(conn);
+}
+
+/*%
+ * Detach a client that has finished processing a request from the
+ * connection, and resume reading if the connection was waiting for it.
+ */
+static void
+tcpconn_detach(ns_tcpconn_t **connp, isc_boolean_t keepalive) {
+	ns_tcpconn_t *conn;
+	isc_boolean_t destroy;
+
+	REQUIRE(connp != NULL && VALID_TCPCONN(*connp));
+
+	conn = *connp;
+	*connp = NULL;
+
+	LOCK(&conn->lock);
+	INSIST(conn->nrequests > 0);
+	conn->nrequests--;
+	if (keepalive)
+		conn->keepalive = ISC_TRUE;
+	if (conn->nrequests == 0)
+		conn->serial = ISC_FALSE;
+	tcpconn_read(conn);
+	INSIST(conn->references > 0);
+	conn->references--;
+	destroy = ISC_TF(conn->references == 0);
+	UNLOCK(&conn->lock);
+
+	if (destroy)
+		tcpconn_destroy(conn);
+}
+
+/*%
+ * Get a connection task; connection task 'n' runs on NUMA node 'n'
+ * modulo the number of nodes, which is returned in '*nodep'.
+ */
+static isc_result_t
+get_conntask(ns_clientmgr_t *manager, isc_task_t **taskp,
+	     unsigned int *nodep)
+{
+	isc_task_t *task;
+	isc_result_t result;
+	unsigned int n;
+
+	/*
+	 * Caller must be holding the manager lock.
+	 */
+	n = manager->nextconntask++;
+	if (manager->nextconntask == NCONNTASKS)
+		manager->nextconntask = 0;
+
+	*nodep = n % manager->nnodes;
+	task = manager->conntasks[n];
+	if (task == NULL) {
+		result = isc_task_create_bound(manager->taskmgr, 0, &task,
+					       (int)*nodep);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+		isc_task_setname(task, "tcpconn", manager);
+		manager->conntasks[n] = task;
+	}
+
+	isc_task_attach(task, taskp);
+
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Create a connection object for 'sock', a connection accepted by
+ * 'client', and start reading requests from it.  On success the
+ * connection takes over the caller's reference to the socket.
+ */
+static isc_result_t
+tcpconn_create(ns_client_t *client, isc_socket_t **sockp,
+	       isc_boolean_t ordered)
+{
+	ns_clientmgr_t *manager = client->manager;
+	ns_tcpconn_t *conn = NULL;
+	isc_mem_t *mctx = NULL;
+	isc_task_t *task = NULL;
+	isc_quota_t *quota = NULL;
+	ns_tlsctx_t *tlsctx = NULL;
+	ns_tls_t *tls = NULL;
+	unsigned char *tlsbuf = NULL;
+	unsigned int node = 0;
+	isc_result_t result;
+
+	REQUIRE(sockp != NULL && *sockp != NULL);
+
+	result = isc_quota_attach(&client->sctx->tcpquota, &quota);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	LOCK(&manager->lock);
+	if (manager->exiting)
+		result = ISC_R_SHUTTINGDOWN;
+	else
+		result = get_conntask(manager, &task, &node);
+	if (result == ISC_R_SUCCESS)
+		result = get_clientmctx(manager, (int)node, &mctx, &node);
+	UNLOCK(&manager->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	LOCK(&client->interface->lock);
+	if (client->interface->tlsctx != NULL)
+		ns_tlsctx_attach(client->interface->tlsctx, &tlsctx);
+	UNLOCK(&client->interface->lock);
+	if (tlsctx != NULL) {
+		result = ns_tls_create(mctx, tlsctx, &tls);
+		ns_tlsctx_detach(&tlsctx);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		tlsbuf = isc_mem_get(mctx, TLS_RECV_BUFFER_SIZE);
+		if (tlsbuf == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_tlsconn);
+	}
+
+	conn = isc_mem_get(mctx, sizeof(*conn));
+	if (conn == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup;
+	}
+	conn->mctx = NULL;
+	isc_mem_attach(mctx, &conn->mctx);
+
+	result = isc_mutex_init(&conn->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_conn;
+
+	conn->timer = NULL;
+	result = isc_timer_create(manager->timermgr, isc_timertype_inactive,
+				  NULL, NULL, task, tcpconn_timeout, conn,
+				  &conn->timer);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+
+	conn->manager = manager;
+	conn->interface = NULL;
+	ns_interface_attach(client->interface, &conn->interface);
+	conn->task = task;
+	task = NULL;
+	conn->sock = *sockp;
+	*sockp = NULL;
+	conn->tcpquota = quota;
+	quota = NULL;
+	conn->peeraddr = client->peeraddr;
+	conn->ordered = ordered;
+	conn->node = node;
+	dns_tcpmsg_init(conn->mctx, conn->sock, &conn->tcpmsg);
+	ISC_EVENT_INIT(&conn->ctlevent, sizeof(conn->ctlevent), 0, NULL,
+		       NS_EVENT_CLIENTCONTROL, tcpconn_shutdown, conn, conn,
+		       NULL, NULL);
+	conn->references = 1;		/* The read loop. */
+	conn->nrequests = 0;
+	conn->reading = ISC_FALSE;
+	conn->timing = ISC_FALSE;
+	conn->serial = ISC_FALSE;
+	conn->closing = ISC_FALSE;
+	conn->newconn = ISC_TRUE;
+	conn->keepalive = ISC_FALSE;
+	conn->tls = tls;
+	tls = NULL;
+	conn->tlsbuf = tlsbuf;
+	tlsbuf = NULL;
+	conn->tlsready = ISC_FALSE;
+	conn->tlslenread = 0;
+	conn->tlsreq = NULL;
+	conn->tlsreqlen = 0;
+	conn->tlsreqread = 0;
+	ISC_LINK_INIT(conn, link);
+	conn->magic = TCPCONN_MAGIC;
+
+	LOCK(&manager->listlock);
+	ISC_LIST_APPEND(manager->conns, conn, link);
+	UNLOCK(&manager->listlock);
+
+	LOCK(&conn->lock);
+	tcpconn_read(conn);
+	UNLOCK(&conn->lock);
+
+	isc_mem_detach(&mctx);
+
+	return (ISC_R_SUCCESS);
+
+ cleanup_lock:
+	DESTROYLOCK(&conn->lock);
+
+ cleanup_conn:
+	isc_mem_putanddetach(&conn->mctx, conn, sizeof(*conn));
+
+ cleanup:
+	if (tlsbuf != NULL)
+		isc_mem_put(mctx, tlsbuf, TLS_RECV_BUFFER_SIZE);
+	if (tls != NULL)
+		ns_tls_destroy(&tls);
+	if (task != NULL)
+		isc_task_detach(&task);
+	if (mctx != NULL)
+		isc_mem_detach(&mctx);
+	if (quota != NULL)
+		isc_quota_detach(&quota);
+	return (result);
+}
+
+static void
+client_newconn(isc_task_t *task, isc_event_t *event) {
+	ns_client_t *client = event->ev_arg;
+	isc_socket_newconnev_t *nevent = (isc_socket_newconnev_t *)event;
+	dns_aclenv_t *env = ns_interfacemgr_getaclenv(client->interface->mgr);
+	isc_socket_t *sock = NULL;
+	isc_result_t result;
+
+	REQUIRE(event->ev_type == ISC_SOCKEVENT_NEWCONN);
+	REQUIRE(NS_CLIENT_VALID(client));
+	REQUIRE(client->task == task);
+
+	UNUSED(task);
+
+	INSIST(client->state == NS_CLIENTSTATE_READY);
+
+	INSIST(client->naccepts == 1);
+	client->naccepts--;
+
+	LOCK(&client->interface->lock);
+	INSIST(client->interface->ntcpcurrent > 0);
+	client->interface->ntcpcurrent--;
+	UNLOCK(&client->interface->lock);
+
+	if (nevent->result == ISC_R_SUCCESS) {
+		sock = nevent->newsocket;
+		isc_socket_setname(sock, "client-tcp", NULL);
+		(void)isc_socket_getpeername(sock, &client->peeraddr);
+		client->peeraddr_valid = ISC_TRUE;
+		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+			   NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
+			   "new TCP connection");
+	} else {
+		/*
+		 * XXXRTH  What should we do?  We're trying to accept but
+		 *	   it didn't work.  If we just give up, then TCP
+		 *	   service may eventually stop.
+		 *
+		 *	   For now, we just go idle.
+		 *
+		 *	   Going idle is probably the right thing if the
+		 *	   I/O was canceled.
+		 */
+		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+			      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
+			      "accept failed: %s",
+			      isc_result_totext(nevent->result));
+	}
+
+	if (exit_check(client)) {
+		if (sock != NULL)
+			isc_socket_detach(&sock);
+		goto freeevent;
+	}
+
+	if (sock != NULL) {
+		int match;
+		isc_netaddr_t netaddr;
+		isc_boolean_t ordered;
+
+		isc_netaddr_fromsockaddr(&netaddr, &client->peeraddr);
+
+		if (client->sctx->blackholeacl != NULL &&
+		    dns_acl_match(&netaddr, NULL,
+				  client->sctx->blackholeacl,
+				  env, &match, NULL) == ISC_R_SUCCESS &&
+		    match > 0)
+		{
+			ns_client_log(client, DNS_LOGCATEGORY_SECURITY,
+				      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(10),
+				      "blackholed connection attempt");
+			isc_socket_detach(&sock);
+		} else {
+			ordered = ISC_TF(client->sctx->keepresporder != NULL &&
+				dns_acl_allowed(&netaddr, NULL, NULL, 0, NULL,
+						client->sctx->keepresporder,
+						env));
+			result = tcpconn_create(client, &sock, ordered);
+			if (result != ISC_R_SUCCESS) {
+				ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+					      NS_LOGMODULE_CLIENT,
+					      ISC_LOG_WARNING,
+					      "no more TCP clients(accept): %s",
+					      isc_result_totext(result));
+				isc_socket_detach(&sock);
+			}
+		}
+		client->peeraddr_valid = ISC_FALSE;
+
+		/*
+		 * The connection is served without this client, so it
+		 * can go on accepting new ones straight away.
+		 */
+		client_accept(client);
+	}
+
+ freeevent:
+	isc_event_free(&event);
+}
+
+static void
+client_accept(ns_client_t *client) {
+	isc_result_t result;
+
+	CTRACE("accept");
+
+	result = isc_socket_accept(client->tcplistener, client->task,
+				   client_newconn, client);
+	if (result != ISC_R_SUCCESS) {
+		UNEXPECTED_ERROR(__FILE__, __LINE__,
+				 "isc_socket_accept() failed: %s",
+				 isc_result_totext(result));
+		/*
+		 * XXXRTH  What should we do?  We're trying to accept but
+		 *	   it didn't work.  If we just give up, then TCP
 		 *	   service may eventually stop.
 		 *
 		 *	   For now, we just go idle.
@@ -3343,13 +4221,8 @@ ns_client_replace(ns_client_t *client) {
 	REQUIRE(client->manager != NULL);
 
 	tcp = TCP_CLIENT(client);
-	if (tcp && client->pipelined) {
-		result = get_worker(client->manager, client->interface,
-				    client->tcpsocket);
-	} else {
-		result = get_client(client->manager, client->interface,
-				    client->dispatch, tcp);
-	}
+	result = get_client(client->manager, client->interface,
+			    client->dispatch, tcp, (int)client->node);
 	if (result != ISC_R_SUCCESS)
 		return (result);
 
@@ -3369,11 +4242,10 @@ ns_client_replace(ns_client_t *client) {
 
 static void
 clientmgr_destroy(ns_clientmgr_t *manager) {
-#if NMCTXS > 0
 	int i;
-#endif
 
 	REQUIRE(ISC_LIST_EMPTY(manager->clients));
+	REQUIRE(ISC_LIST_EMPTY(manager->conns));
 
 	MTRACE("clientmgr_destroy");
 
@@ -3384,7 +4256,15 @@ clientmgr_destroy(ns_clientmgr_t *manager) {
 	}
 #endif
 
-	ISC_QUEUE_DESTROY(manager->inactive);
+	for (i = 0; i < NCONNTASKS; i++) {
+		if (manager->conntasks[i] != NULL)
+			isc_task_detach(&manager->conntasks[i]);
+	}
+
+	for (i = 0; i < (int)manager->nnodes; i++)
+		ISC_QUEUE_DESTROY(manager->inactive[i]);
+	isc_mem_put(manager->mctx, manager->inactive,
+		    manager->nnodes * sizeof(manager->inactive[0]));
 
 	DESTROYLOCK(&manager->lock);
 	DESTROYLOCK(&manager->listlock);
@@ -3405,9 +4285,7 @@ ns_clientmgr_create(isc_mem_t *mctx, ns_server_t *sctx, isc_taskmgr_t *taskmgr,
 {
 	ns_clientmgr_t *manager;
 	isc_result_t result;
-#if NMCTXS > 0
 	int i;
-#endif
 
 	manager = isc_mem_get(mctx, sizeof(*manager));
 	if (manager == NULL)
@@ -3425,10 +4303,21 @@ ns_clientmgr_create(isc_mem_t *mctx, ns_server_t *sctx, isc_taskmgr_t *taskmgr,
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_listlock;
 
+	manager->nnodes = 1;
+#if NMCTXS > 0
+	manager->nnodes = ISC_MIN(isc_taskmgr_nqueues(taskmgr), NMCTXS);
+#endif
+	manager->inactive = isc_mem_get(mctx, manager->nnodes *
+					      sizeof(manager->inactive[0]));
+	if (manager->inactive == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_reclock;
+	}
+
 	manager->excl = NULL;
 	result = isc_taskmgr_excltask(taskmgr, &manager->excl);
 	if (result != ISC_R_SUCCESS) {
-		goto cleanup_reclock;
+		goto cleanup_inactive;
 	}
 
 	manager->mctx = mctx;
@@ -3440,13 +4329,18 @@ ns_clientmgr_create(isc_mem_t *mctx, ns_server_t *sctx, isc_taskmgr_t *taskmgr,
 	ns_server_attach(sctx, &manager->sctx);
 
 	ISC_LIST_INIT(manager->clients);
+	ISC_LIST_INIT(manager->conns);
 	ISC_LIST_INIT(manager->recursing);
-	ISC_QUEUE_INIT(manager->inactive, ilink);
+	for (i = 0; i < (int)manager->nnodes; i++)
+		ISC_QUEUE_INIT(manager->inactive[i], ilink);
 #if NMCTXS > 0
 	manager->nextmctx = 0;
 	for (i = 0; i < NMCTXS; i++)
 		manager->mctxpool[i] = NULL; /* will be created on-demand */
 #endif
+	manager->nextconntask = 0;
+	for (i = 0; i < NCONNTASKS; i++)
+		manager->conntasks[i] = NULL; /* will be created on-demand */
 	manager->magic = MANAGER_MAGIC;
 
 	MTRACE("create");
@@ -3455,6 +4349,10 @@ ns_clientmgr_create(isc_mem_t *mctx, ns_server_t *sctx, isc_taskmgr_t *taskmgr,
 
 	return (ISC_R_SUCCESS);
 
+ cleanup_inactive:
+	isc_mem_put(mctx, manager->inactive,
+		    manager->nnodes * sizeof(manager->inactive[0]));
+
  cleanup_reclock:
 	(void) isc_mutex_destroy(&manager->reclock);
 
@@ -3475,6 +4373,7 @@ ns_clientmgr_destroy(ns_clientmgr_t **managerp) {
 	isc_result_t result;
 	ns_clientmgr_t *manager;
 	ns_client_t *client;
+	ns_tcpconn_t *conn;
 	isc_boolean_t need_destroy = ISC_FALSE, unlock = ISC_FALSE;
 
 	REQUIRE(managerp != NULL);
@@ -3499,7 +4398,17 @@ ns_clientmgr_destroy(ns_clientmgr_t **managerp) {
 	     client = ISC_LIST_NEXT(client, link))
 		isc_task_shutdown(client->task);
 
-	if (ISC_LIST_EMPTY(manager->clients))
+	for (conn = ISC_LIST_HEAD(manager->conns);
+	     conn != NULL;
+	     conn = ISC_LIST_NEXT(conn, link))
+	{
+		LOCK(&conn->lock);
+		tcpconn_close(conn);
+		UNLOCK(&conn->lock);
+	}
+
+	if (ISC_LIST_EMPTY(manager->clients) &&
+	    ISC_LIST_EMPTY(manager->conns))
 		need_destroy = ISC_TRUE;
 
 	if (unlock)
@@ -3511,9 +4420,28 @@ ns_clientmgr_destroy(ns_clientmgr_t **managerp) {
 	*managerp = NULL;
 }
 
+/*%
+ * Take a client off the inactive queues, by preference one whose task
+ * and memory belong to NUMA node 'node', or to the node the caller is
+ * running on if 'node' is negative.
+ */
+static ns_client_t *
+pop_inactive(ns_clientmgr_t *manager, int node) {
+	ns_client_t *client = NULL;
+	unsigned int i, first;
+
+	if (node < 0)
+		node = (int)isc_os_currentnode();
+	first = (unsigned int)node % manager->nnodes;
+	for (i = 0; i < manager->nnodes && client == NULL; i++)
+		ISC_QUEUE_POP(manager->inactive[(first + i) % manager->nnodes],
+			      ilink, client);
+	return (client);
+}
+
 static isc_result_t
 get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
-	   dns_dispatch_t *disp, isc_boolean_t tcp)
+	   dns_dispatch_t *disp, isc_boolean_t tcp, int node)
 {
 	isc_result_t result = ISC_R_SUCCESS;
 	isc_event_t *ev;
@@ -3531,7 +4459,7 @@ get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 	 */
 	client = NULL;
 	if ((manager->sctx->options & NS_SERVER_CLIENTTEST) == 0)
-		ISC_QUEUE_POP(manager->inactive, ilink, client);
+		client = pop_inactive(manager, node);
 
 	if (client != NULL)
 		MTRACE("recycle");
@@ -3539,7 +4467,7 @@ get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 		MTRACE("create new");
 
 		LOCK(&manager->lock);
-		result = client_create(manager, &client);
+		result = client_create(manager, node, &client);
 		UNLOCK(&manager->lock);
 		if (result != ISC_R_SUCCESS)
 			return (result);
@@ -3577,8 +4505,12 @@ get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 	return (ISC_R_SUCCESS);
 }
 
+/*%
+ * Hand the request in 'r', read from 'conn', over to a client.  The
+ * caller has accounted for the client's reference to the connection.
+ */
 static isc_result_t
-get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock) {
+get_worker(ns_clientmgr_t *manager, ns_tcpconn_t *conn, isc_region_t *r) {
 	isc_result_t result = ISC_R_SUCCESS;
 	isc_event_t *ev;
 	ns_client_t *client;
@@ -3595,7 +4527,7 @@ get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock) {
 	 */
 	client = NULL;
 	if ((manager->sctx->options & NS_SERVER_CLIENTTEST) == 0)
-		ISC_QUEUE_POP(manager->inactive, ilink, client);
+		client = pop_inactive(manager, (int)conn->node);
 
 	if (client != NULL)
 		MTRACE("recycle");
@@ -3603,7 +4535,7 @@ get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock) {
 		MTRACE("create new");
 
 		LOCK(&manager->lock);
-		result = client_create(manager, &client);
+		result = client_create(manager, (int)conn->node, &client);
 		UNLOCK(&manager->lock);
 		if (result != ISC_R_SUCCESS)
 			return (result);
@@ -3614,28 +4546,36 @@ get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock) {
 	}
 
 	client->manager = manager;
-	ns_interface_attach(ifp, &client->interface);
-	client->newstate = client->state = NS_CLIENTSTATE_WORKING;
+	ns_interface_attach(conn->interface, &client->interface);
+	client->state = NS_CLIENTSTATE_READY;
 	INSIST(client->recursionquota == NULL);
 	client->sctx = manager->sctx;
-	client->tcpquota = &client->sctx->tcpquota;
 
-	client->dscp = ifp->dscp;
+	client->dscp = conn->interface->dscp;
 
 	client->attributes |= NS_CLIENTATTR_TCP;
-	client->pipelined = ISC_TRUE;
 	client->mortal = ISC_TRUE;
 	client->sendcb = NULL;
 
-	isc_socket_attach(ifp->tcpsocket, &client->tcplistener);
-	isc_socket_attach(sock, &client->tcpsocket);
-	isc_socket_setname(client->tcpsocket, "worker-tcp", NULL);
-	(void)isc_socket_getpeername(client->tcpsocket, &client->peeraddr);
+	isc_socket_attach(conn->sock, &client->tcpsocket);
+	client->peeraddr = conn->peeraddr;
 	client->peeraddr_valid = ISC_TRUE;
+	client->tcpconn = conn;
 
-	INSIST(client->tcpmsg_valid == ISC_FALSE);
-	dns_tcpmsg_init(client->mctx, client->tcpsocket, &client->tcpmsg);
-	client->tcpmsg_valid = ISC_TRUE;
+	/*
+	 * The connection goes on reading while the request is being
+	 * processed, so the client needs its own copy.  If that cannot
+	 * be made the client closes the connection.
+	 */
+	INSIST(client->tcpreq == NULL);
+	if (r->length <= RECV_BUFFER_SIZE)
+		client->tcpreq = client->recvbuf;
+	else
+		client->tcpreq = isc_mem_get(client->mctx, r->length);
+	if (client->tcpreq != NULL) {
+		memmove(client->tcpreq, r->base, r->length);
+		client->tcpreqlen = r->length;
+	}
 
 	INSIST(client->nctls == 0);
 	client->nctls++;
@@ -3659,15 +4599,14 @@ ns__clientmgr_getclient(ns_clientmgr_t *manager, ns_interface_t *ifp,
 	if (manager->exiting)
 		return (ISC_R_SHUTTINGDOWN);
 
-	client = NULL;
-	ISC_QUEUE_POP(manager->inactive, ilink, client);
+	client = pop_inactive(manager, -1);
 	if (client != NULL)
 		MTRACE("getclient (recycle)");
 	else {
 		MTRACE("getclient (create)");
 
 		LOCK(&manager->lock);
-		result = client_create(manager, &client);
+		result = client_create(manager, -1, &client);
 		UNLOCK(&manager->lock);
 		if (result != ISC_R_SUCCESS)
 			return (result);
@@ -3694,6 +4633,86 @@ ns__clientmgr_getclient(ns_clientmgr_t *manager, ns_interface_t *ifp,
 	return (ISC_R_SUCCESS);
 }
 
+/*%
+ * Tell the injector of the client's request how it ended: with the
+ * response in 'r', or without one if 'r' is NULL.
+ */
+static void
+client_injectdone(ns_client_t *client, isc_region_t *r) {
+	void (*cb)(void *, isc_region_t *) = client->injectcb;
+
+	if (cb == NULL)
+		return;
+
+	client->injectcb = NULL;
+	(cb)(client->injectarg, r);
+}
+
+isc_result_t
+ns__client_inject(ns_clientmgr_t *manager, ns_interface_t *ifp,
+		  const isc_sockaddr_t *peeraddr, const isc_region_t *r,
+		  void (*cb)(void *arg, isc_region_t *r), void *arg)
+{
+	isc_result_t result;
+	isc_event_t *ev;
+	ns_client_t *client;
+	MTRACE("inject");
+
+	REQUIRE(VALID_MANAGER(manager));
+	REQUIRE(ifp != NULL);
+	REQUIRE(peeraddr != NULL);
+	REQUIRE(r != NULL);
+	REQUIRE(cb != NULL);
+
+	if (r->length > RECV_BUFFER_SIZE)
+		return (ISC_R_RANGE);
+
+	if (manager->exiting)
+		return (ISC_R_SHUTTINGDOWN);
+
+	client = pop_inactive(manager, -1);
+	if (client == NULL) {
+		LOCK(&manager->lock);
+		result = client_create(manager, -1, &client);
+		UNLOCK(&manager->lock);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+
+		LOCK(&manager->listlock);
+		ISC_LIST_APPEND(manager->clients, client, link);
+		UNLOCK(&manager->listlock);
+	}
+
+	client->manager = manager;
+	ns_interface_attach(ifp, &client->interface);
+	client->state = NS_CLIENTSTATE_READY;
+	INSIST(client->recursionquota == NULL);
+	client->sctx = manager->sctx;
+	client->dscp = ifp->dscp;
+	client->mortal = ISC_TRUE;
+	client->injectcb = cb;
+	client->injectarg = arg;
+
+	/*
+	 * Deliver the request the way client_udprecv() would have
+	 * received it.
+	 */
+	memmove(client->recvbuf, r->base, r->length);
+	client->recvevent->result = ISC_R_SUCCESS;
+	client->recvevent->region.base = client->recvbuf;
+	client->recvevent->region.length = RECV_BUFFER_SIZE;
+	client->recvevent->n = r->length;
+	client->recvevent->address = *peeraddr;
+	client->recvevent->attributes = 0;
+
+	INSIST(client->nrecvs == 0);
+	client->nrecvs++;
+	ev = (isc_event_t *)client->recvevent;
+	isc_task_send(client->task, &ev);
+
+	return (ISC_R_SUCCESS);
+}
+
 isc_result_t
 ns_clientmgr_createclients(ns_clientmgr_t *manager, unsigned int n,
 			   ns_interface_t *ifp, isc_boolean_t tcp)
@@ -3706,8 +4725,12 @@ ns_clientmgr_createclients(ns_clientmgr_t *manager, unsigned int n,
 
 	MTRACE("createclients");
 
+	/*
+	 * Spread the listeners across the NUMA nodes in use.
+	 */
 	for (disp = 0; disp < n; disp++) {
-		result = get_client(manager, ifp, ifp->udpdispatch[disp], tcp);
+		result = get_client(manager, ifp, ifp->udpdispatch[disp], tcp,
+				    (int)(disp % manager->nnodes));
 		if (result != ISC_R_SUCCESS)
 			break;
 	}
@@ -3725,6 +4748,13 @@ ns_client_getdestaddr(ns_client_t *client) {
 	return (&client->destsockaddr);
 }
 
+isc_taskmgr_t *
+ns_client_gettaskmgr(ns_client_t *client) {
+	REQUIRE(NS_CLIENT_VALID(client));
+
+	return (client->manager->taskmgr);
+}
+
 isc_result_t
 ns_client_checkaclsilent(ns_client_t *client, isc_netaddr_t *netaddr,
 			 dns_acl_t *acl, isc_boolean_t default_allow)
@@ -67,7 +67,6 @@
 #include <dns/name.h>
 #include <dns/rdataclass.h>
 #include <dns/rdatatype.h>
-#include <dns/tcpmsg.h>
 #include <dns/types.h>
 
 #include <ns/query.h>
@@ -83,10 +82,10 @@ struct ns_client {
 	isc_mem_t *		mctx;
 	ns_server_t *		sctx;
 	ns_clientmgr_t *	manager;
+	unsigned int		node;		/*%< NUMA node of mctx */
 	int			state;
 	int			newstate;
 	int			naccepts;
-	int			nreads;
 	int			nsends;
 	int			nrecvs;
 	int			nupdates;
@@ -106,9 +105,12 @@ struct ns_client {
 	isc_socket_t *		udpsocket;
 	isc_socket_t *		tcplistener;
 	isc_socket_t *		tcpsocket;
+	ns_tcpconn_t *		tcpconn;	/*%< Connection being served */
 	unsigned char *		tcpbuf;
-	dns_tcpmsg_t		tcpmsg;
-	isc_boolean_t		tcpmsg_valid;
+	unsigned char *		tlsbuf;		/*%< Encrypted response */
+	unsigned int		tlsbuflen;
+	unsigned char *		tcpreq;		/*%< Request read by tcpconn */
+	unsigned int		tcpreqlen;
 	isc_timer_t *		timer;
 	isc_timer_t *		delaytimer;
 	isc_boolean_t 		timerset;
@@ -130,8 +132,6 @@ struct ns_client {
 	dns_name_t		signername;   /*%< [T]SIG key name */
 	dns_name_t *		signer;	      /*%< NULL if not valid sig */
 	isc_boolean_t		mortal;	      /*%< Die after handling request */
-	isc_boolean_t		pipelined;   /*%< TCP queries not in sequence */
-	isc_quota_t		*tcpquota;
 	isc_quota_t		*recursionquota;
 	ns_interface_t		*interface;
 
@@ -161,6 +161,10 @@ struct ns_client {
 	/*% Callback function to send a response when unit testing */
 	void			(*sendcb)(isc_buffer_t *buf);
 
+	/*% Callback function to take the response to an injected request */
+	void			(*injectcb)(void *arg, isc_region_t *r);
+	void			*injectarg;
+
 	ISC_LINK(ns_client_t)	link;
 	ISC_LINK(ns_client_t)	rlink;
 	ISC_QLINK(ns_client_t)	ilink;
@@ -230,6 +234,27 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *msg);
  * send msg as a response using client->message->id for the id.
  */
 
+isc_result_t
+ns_client_sendstream(ns_client_t *client, isc_mem_t *mctx,
+		     isc_region_t *region, isc_taskaction_t action, void *arg,
+		     isc_boolean_t *copiedp);
+/*%<
+ * Send 'region', which holds one or more length-prefixed messages, on
+ * the TCP connection of 'client' without finishing the request, as zone
+ * transfers do.  'action' is called with 'arg' on the client's task when
+ * the send completes.
+ *
+ * On a DNS-over-TLS connection the data is encrypted into a buffer
+ * allocated from 'mctx' and '*copiedp' is set to ISC_TRUE: 'region' may
+ * then be released at once, and 'action' must free the buffer described
+ * by the region of its send event.  Otherwise '*copiedp' is set to
+ * ISC_FALSE and 'region' itself is sent.
+ *
+ * Requires:
+ *\li	'client' is a valid TCP client.
+ *\li	'copiedp' is not NULL.
+ */
+
 void
 ns_client_error(ns_client_t *client, isc_result_t result);
 /*%<
@@ -314,6 +339,13 @@ ns_client_getdestaddr(ns_client_t *client);
  * currently being processed.
  */
 
+isc_taskmgr_t *
+ns_client_gettaskmgr(ns_client_t *client);
+/*%<
+ * Get the task manager of the client manager that 'client' belongs to,
+ * for creating tasks that do work on the client's behalf.
+ */
+
 isc_result_t
 ns_client_checkaclsilent(ns_client_t *client, isc_netaddr_t *netaddr,
 			 dns_acl_t *acl, isc_boolean_t default_allow);
@@ -424,4 +456,19 @@ ns__client_request(isc_task_t *task, isc_event_t *event);
  * Handle client requests.
  * (Not intended for use outside this module and associated tests.)
  */
+
+isc_result_t
+ns__client_inject(ns_clientmgr_t *manager, ns_interface_t *ifp,
+		  const isc_sockaddr_t *peeraddr, const isc_region_t *r,
+		  void (*cb)(void *arg, isc_region_t *r), void *arg);
+/*
+ * Have a client process the request in 'r' as if it had been received
+ * over UDP on 'ifp' from 'peeraddr', without using the interface's
+ * socket.  When the request has been processed, 'cb' is called from the
+ * client's task with 'arg' and the wire-format response, which is only
+ * valid during the call, or NULL if no response was sent.  'r' must
+ * not hold a response.
+ * (Not intended for use outside this module, associated tests and
+ * benchmarks.)
+ */
 #endif /* NS_CLIENT_H */
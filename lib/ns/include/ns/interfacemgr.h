@@ -73,6 +73,9 @@ struct ns_interface {
 	dns_dispatch_t *	udpdispatch[MAX_UDP_DISPATCH];
 						/*%< UDP dispatchers. */
 	isc_socket_t *		tcpsocket;	/*%< TCP socket. */
+	ns_tlsctx_t *		tlsctx;		/*%< DNS-over-TLS context,
+						     locked; NULL for plain
+						     DNS */
 	isc_dscp_t		dscp;		/*%< "listen-on" DSCP value */
 	int			ntcptarget;	/*%< Desired number of concurrent
 						     TCP accepts */
@@ -28,6 +28,8 @@
 
 #include <dns/types.h>
 
+#include <ns/types.h>
+
 /***
  *** Types
  ***/
@@ -40,6 +42,7 @@ struct ns_listenelt {
 	in_port_t			port;
 	isc_dscp_t			dscp;  /* -1 = not set, 0..63 */
 	dns_acl_t *	       		acl;
+	ns_tlsctx_t *			tlsctx; /* NULL = plain DNS */
 	ISC_LINK(ns_listenelt_t)	link;
 };
 
@@ -57,7 +60,8 @@ isc_result_t
 ns_listenelt_create(isc_mem_t *mctx, in_port_t port, isc_dscp_t dscp,
 		    dns_acl_t *acl, ns_listenelt_t **target);
 /*%<
- * Create a listen-on list element.
+ * Create a listen-on list element.  It serves plain DNS until a TLS
+ * context is attached to its 'tlsctx'.
  */
 
 void
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef NS_QUERYLOG_H
+#define NS_QUERYLOG_H 1
+
+/*! \file
+ * \brief
+ * Asynchronous query logging.
+ *
+ * Threads that log queries copy a compact record of each query into a
+ * ring buffer of their own; no lock is taken and nothing is formatted
+ * on the query path.  A dedicated writer thread drains the rings,
+ * formats the records and either hands them to the "queries" logging
+ * category or appends them, in batches, to a file of its own.
+ *
+ * When a ring is full the record is dropped and counted rather than
+ * making the query thread wait for the writer.  The writer logs a
+ * warning with the number of records dropped, at most once every
+ * ten seconds.
+ */
+
+#include <isc/lang.h>
+#include <isc/netaddr.h>
+#include <isc/sockaddr.h>
+#include <isc/types.h>
+
+#include <dns/ecs.h>
+#include <dns/types.h>
+
+#include <ns/types.h>
+
+/*%
+ * Query flags, as shown in the query log.
+ */
+#define NS_QUERYLOG_RECURSE	0x0001	/*%< recursion desired ('+') */
+#define NS_QUERYLOG_SIGNED	0x0002	/*%< signed request ('S') */
+#define NS_QUERYLOG_TCP		0x0004	/*%< received over TCP ('T') */
+#define NS_QUERYLOG_DO		0x0008	/*%< DO bit set ('D') */
+#define NS_QUERYLOG_CD		0x0010	/*%< CD bit set ('C') */
+#define NS_QUERYLOG_COOKIE	0x0020	/*%< valid server cookie ('V') */
+#define NS_QUERYLOG_WANTCOOKIE	0x0040	/*%< client cookie only ('K') */
+
+typedef enum {
+	ns_querylogformat_text,		/*%< same text as synchronous logging */
+	ns_querylogformat_compact	/*%< one short line per query */
+} ns_querylogformat_t;
+
+/*%
+ * What is recorded about a query.  Everything is copied by
+ * ns_querylog_write(); the caller keeps ownership.
+ */
+typedef struct ns_querylogentry {
+	const void *		client;	/*%< only printed, never used */
+	const isc_sockaddr_t *	peer;	/*%< NULL if unknown */
+	const isc_netaddr_t *	dest;
+	const dns_name_t *	qname;
+	const dns_name_t *	signer;	/*%< NULL if not signed */
+	const char *		view;	/*%< NULL to omit */
+	const dns_ecs_t *	ecs;	/*%< NULL if no ECS option */
+	dns_rdatatype_t		qtype;
+	dns_rdataclass_t	qclass;
+	int			ednsversion;	/*%< -1 if no EDNS */
+	unsigned int		flags;	/*%< NS_QUERYLOG_* */
+} ns_querylogentry_t;
+
+ISC_LANG_BEGINDECLS
+
+isc_result_t
+ns_querylog_create(isc_mem_t *mctx, const char *file,
+		   ns_querylogformat_t format, size_t bufsize,
+		   ns_querylog_t **qlp);
+/*%<
+ * Create an asynchronous query logger and start its writer thread.
+ *
+ * If 'file' is NULL, queries are logged to the "queries" category at
+ * level info; otherwise they are appended to 'file', each line
+ * prefixed with the time the query was received.  Each thread that
+ * logs queries gets a ring buffer of 'bufsize' bytes, rounded up to a
+ * power of two.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	'qlp' is not NULL and '*qlp' is NULL.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_NOTIMPLEMENTED	no threads or atomic operations
+ *\li	file open errors
+ */
+
+void
+ns_querylog_destroy(ns_querylog_t **qlp);
+/*%<
+ * Write out everything that has been logged, stop the writer thread
+ * and free '*qlp'.  No thread may be calling ns_querylog_write() on
+ * it at the same time.
+ */
+
+void
+ns_querylog_write(ns_querylog_t *ql, const ns_querylogentry_t *entry);
+/*%<
+ * Queue 'entry' for the writer thread, or drop and count it if the
+ * calling thread's ring buffer is full.
+ */
+
+void
+ns_querylog_getcounters(ns_querylog_t *ql, isc_uint64_t *writtenp,
+			isc_uint64_t *droppedp);
+/*%<
+ * Return the number of entries written and dropped so far.  Entries
+ * that are still queued are in neither count.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* NS_QUERYLOG_H */
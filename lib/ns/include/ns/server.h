@@ -17,6 +17,7 @@
 #include <isc/log.h>
 #include <isc/fuzz.h>
 #include <isc/magic.h>
+#include <isc/mutex.h>
 #include <isc/quota.h>
 #include <isc/random.h>
 #include <isc/sockaddr.h>
@@ -28,6 +29,9 @@
 #include <ns/types.h>
 
 #define NS_EVENT_CLIENTCONTROL	(ISC_EVENTCLASS_NS + 0)
+#define NS_EVENT_XFRCACHEFILL	(ISC_EVENTCLASS_NS + 1)
+#define NS_EVENT_XFRCACHERENDER	(ISC_EVENTCLASS_NS + 2)
+#define NS_EVENT_XFRCACHEREADY	(ISC_EVENTCLASS_NS + 3)
 
 #define NS_SERVER_LOGQUERIES	0x00000001U	/*%< log queries */
 #define NS_SERVER_NOAA		0x00000002U	/*%< -T noaa */
@@ -94,6 +98,8 @@ struct ns_server {
 	dns_acl_t		*keepresporder;
 	isc_uint16_t		udpsize;
 	isc_uint16_t		transfer_tcp_message_size;
+	unsigned int		transfer_render_threads;
+	isc_uint64_t		transfer_render_maxsize;
 	isc_boolean_t		interface_auto;
 	dns_tkeyctx_t *		tkeyctx;
 	isc_rng_t *		rngctx;
@@ -124,6 +130,13 @@ struct ns_server {
 	isc_stats_t *		tcpoutstats4;
 	isc_stats_t *		tcpinstats6;
 	isc_stats_t *		tcpoutstats6;
+
+	/*% Asynchronous query logger, if configured */
+	ns_querylog_t *		querylog;
+
+	/*% Rendered AXFR streams shared by concurrent transfers */
+	isc_mutex_t		xfrcachelock;
+	ns_xfrcachelist_t	xfrcaches;
 };
 
 struct ns_altsecret {
@@ -102,7 +102,18 @@ enum {
 	ns_statscounter_prefetch = 63,
 	ns_statscounter_keytagopt = 64,
 
-	ns_statscounter_max = 65
+	ns_statscounter_nsec3synth = 65,
+
+	ns_statscounter_tlsconn = 66,
+	ns_statscounter_tlshandshake = 67,
+	ns_statscounter_tlsresumed = 68,
+	ns_statscounter_tlshandshakefail = 69,
+	ns_statscounter_tlsrequest = 70,
+	ns_statscounter_tlsresponse = 71,
+
+	ns_statscounter_remotenode = 72,
+
+	ns_statscounter_max = 73
 };
 
 void
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef NS_TLS_H
+#define NS_TLS_H 1
+
+/*! \file
+ * \brief
+ * Server side of DNS-over-TLS (RFC 7858).
+ *
+ * A TLS context holds the server's key and certificate and the state
+ * used for session resumption, and is shared by every connection
+ * accepted on the listeners it is configured for.
+ *
+ * A TLS session does no I/O of its own.  The connection that owns it
+ * feeds it the bytes read from the socket with ns_tls_input(), takes
+ * the decrypted stream out with ns_tls_read(), and sends whatever the
+ * session has to transmit -- handshake messages, session tickets and
+ * encrypted responses -- after collecting it with ns_tls_output().
+ * A session is not locked; the caller serializes access to it.
+ *
+ * If BIND was built without OpenSSL's TLS library, ns_tlsctx_create()
+ * fails with #ISC_R_NOTIMPLEMENTED and no session can be created.
+ */
+
+#include <isc/lang.h>
+#include <isc/region.h>
+#include <isc/types.h>
+
+#include <ns/types.h>
+
+ISC_LANG_BEGINDECLS
+
+isc_result_t
+ns_tlsctx_create(isc_mem_t *mctx, const char *keyfile, const char *certfile,
+		 isc_boolean_t tickets, ns_tlsctx_t **ctxp);
+/*%<
+ * Create a server TLS context using the PEM private key in 'keyfile'
+ * and the PEM certificate chain in 'certfile'.  TLS 1.2 and later are
+ * accepted.  Sessions can be resumed from the server's session cache
+ * and, if 'tickets' is true, with stateless session tickets.
+ *
+ * Requires:
+ *\li	'keyfile' and 'certfile' are not NULL.
+ *\li	'ctxp' is not NULL and '*ctxp' is NULL.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_FAILURE		the key or the certificate could not be
+ *				loaded, or they do not match; the reason
+ *				is logged
+ *\li	#ISC_R_NOTIMPLEMENTED
+ */
+
+void
+ns_tlsctx_attach(ns_tlsctx_t *source, ns_tlsctx_t **targetp);
+
+void
+ns_tlsctx_detach(ns_tlsctx_t **ctxp);
+/*%<
+ * Attach to and detach from a TLS context.  Sessions hold their own
+ * reference, so a context can be detached while they are in use.
+ */
+
+isc_result_t
+ns_tls_create(isc_mem_t *mctx, ns_tlsctx_t *ctx, ns_tls_t **tlsp);
+/*%<
+ * Create a session for a newly accepted connection.  It waits for the
+ * client to start the handshake.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+void
+ns_tls_destroy(ns_tls_t **tlsp);
+
+isc_result_t
+ns_tls_input(ns_tls_t *tls, const isc_region_t *r);
+/*%<
+ * Queue the bytes in 'r', as read from the connection, for decryption.
+ */
+
+isc_result_t
+ns_tls_read(ns_tls_t *tls, unsigned char *buf, unsigned int len,
+	    unsigned int *nreadp);
+/*%<
+ * Advance the handshake if it has not completed, then decrypt up to
+ * 'len' bytes of the client's stream into 'buf'.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS		'*nreadp' bytes, at least one, were read
+ *\li	#ISC_R_WOULDBLOCK	more input is needed
+ *\li	#ISC_R_EOF		the client closed the session
+ *\li	#ISC_R_FAILURE		protocol error; see ns_tls_error()
+ */
+
+isc_result_t
+ns_tls_write(ns_tls_t *tls, const isc_region_t *r);
+/*%<
+ * Encrypt the bytes in 'r'.  The result is collected with
+ * ns_tls_output().
+ *
+ * Requires:
+ *\li	The handshake has completed.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_FAILURE
+ */
+
+unsigned int
+ns_tls_pending(ns_tls_t *tls);
+/*%<
+ * Return the number of bytes waiting to be sent to the client.
+ */
+
+unsigned int
+ns_tls_output(ns_tls_t *tls, unsigned char *buf, unsigned int len);
+/*%<
+ * Move up to 'len' of the bytes waiting to be sent into 'buf', and
+ * return how many were moved.
+ */
+
+isc_boolean_t
+ns_tls_handshakedone(ns_tls_t *tls);
+/*%<
+ * Return true once the handshake has completed.
+ */
+
+isc_boolean_t
+ns_tls_resumed(ns_tls_t *tls);
+/*%<
+ * Return true if the handshake resumed an earlier session.
+ */
+
+const char *
+ns_tls_error(ns_tls_t *tls);
+/*%<
+ * Return a description of the error that made the last call fail.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* NS_TLS_H */
@@ -21,8 +21,14 @@ typedef struct ns_clientmgr		ns_clientmgr_t;
 typedef struct ns_interface 		ns_interface_t;
 typedef struct ns_interfacemgr		ns_interfacemgr_t;
 typedef struct ns_query			ns_query_t;
+typedef struct ns_querylog		ns_querylog_t;
 typedef struct ns_server		ns_server_t;
 typedef struct ns_stats			ns_stats_t;
+typedef struct ns_tcpconn		ns_tcpconn_t;
+typedef struct ns_tls			ns_tls_t;
+typedef struct ns_tlsctx		ns_tlsctx_t;
+typedef struct ns_xfrcache		ns_xfrcache_t;
+typedef ISC_LIST(ns_xfrcache_t)		ns_xfrcachelist_t;
 
 typedef enum {
 	ns_cookiealg_aes,
@@ -27,6 +27,7 @@
 #include <ns/log.h>
 #include <ns/interfacemgr.h>
 #include <ns/server.h>
+#include <ns/tls.h>
 
 #ifdef HAVE_NET_ROUTE_H
 #include <net/route.h>
@@ -420,6 +421,7 @@ ns_interface_create(ns_interfacemgr_t *mgr, isc_sockaddr_t *addr,
 		ifp->udpdispatch[disp] = NULL;
 
 	ifp->tcpsocket = NULL;
+	ifp->tlsctx = NULL;
 
 	/*
 	 * Create a single TCP client object.  It will replace itself
@@ -586,12 +588,13 @@ static isc_result_t
 ns_interface_setup(ns_interfacemgr_t *mgr, isc_sockaddr_t *addr,
 		   const char *name, ns_interface_t **ifpret,
 		   isc_boolean_t accept_tcp, isc_dscp_t dscp,
-		   isc_boolean_t *addr_in_use)
+		   ns_tlsctx_t *tlsctx, isc_boolean_t *addr_in_use)
 {
 	isc_result_t result;
 	ns_interface_t *ifp = NULL;
 	REQUIRE(ifpret != NULL && *ifpret == NULL);
 	REQUIRE(addr_in_use == NULL || *addr_in_use == ISC_FALSE);
+	REQUIRE(tlsctx == NULL || accept_tcp);
 
 	result = ns_interface_create(mgr, addr, name, &ifp);
 	if (result != ISC_R_SUCCESS)
@@ -599,6 +602,23 @@ ns_interface_setup(ns_interfacemgr_t *mgr, isc_sockaddr_t *addr,
 
 	ifp->dscp = dscp;
 
+	/*
+	 * A DNS-over-TLS listener only accepts TCP connections, and
+	 * is useless if it cannot.
+	 */
+	if (tlsctx != NULL) {
+		ns_tlsctx_attach(tlsctx, &ifp->tlsctx);
+		result = ns_interface_accepttcp(ifp);
+		if (result != ISC_R_SUCCESS) {
+			if ((result == ISC_R_ADDRINUSE) &&
+			    (addr_in_use != NULL))
+				*addr_in_use = ISC_TRUE;
+			goto cleanup_interface;
+		}
+		*ifpret = ifp;
+		return (ISC_R_SUCCESS);
+	}
+
 	result = ns_interface_listenudp(ifp);
 	if (result != ISC_R_SUCCESS) {
 		if ((result == ISC_R_ADDRINUSE) && (addr_in_use != NULL))
@@ -658,6 +678,9 @@ ns_interface_destroy(ns_interface_t *ifp) {
 	if (ifp->tcpsocket != NULL)
 		isc_socket_detach(&ifp->tcpsocket);
 
+	if (ifp->tlsctx != NULL)
+		ns_tlsctx_detach(&ifp->tlsctx);
+
 	DESTROYLOCK(&ifp->lock);
 
 	ns_interfacemgr_detach(&ifp->mgr);
@@ -834,6 +857,33 @@ clearlistenon(ns_interfacemgr_t *mgr) {
 	}
 }
 
+/*%
+ * Apply the TLS setting of a listen-on element to an interface that
+ * already exists.  A changed TLS context, e.g. after the certificate
+ * has been renewed, is used for new connections; switching between
+ * plain DNS and DNS-over-TLS needs a new socket and is not done.
+ */
+static void
+settls(ns_interface_t *ifp, ns_listenelt_t *le, isc_sockaddr_t *addr) {
+	char sabuf[ISC_SOCKADDR_FORMATSIZE];
+
+	if ((ifp->tlsctx == NULL) != (le->tlsctx == NULL)) {
+		isc_sockaddr_format(addr, sabuf, sizeof(sabuf));
+		isc_log_write(IFMGR_COMMON_LOGARGS, ISC_LOG_WARNING,
+			      "%s: conflicting TLS settings, still %s",
+			      sabuf, ifp->tlsctx != NULL ? "using TLS" :
+			      "not using TLS");
+		return;
+	}
+
+	if (le->tlsctx != NULL && le->tlsctx != ifp->tlsctx) {
+		LOCK(&ifp->lock);
+		ns_tlsctx_detach(&ifp->tlsctx);
+		ns_tlsctx_attach(le->tlsctx, &ifp->tlsctx);
+		UNLOCK(&ifp->lock);
+	}
+}
+
 static isc_result_t
 do_scan(ns_interfacemgr_t *mgr, ns_listenlist_t *ext_listen,
 	isc_boolean_t verbose)
@@ -921,16 +971,20 @@ do_scan(ns_interfacemgr_t *mgr, ns_listenlist_t *ext_listen,
 						      "values, using %d",
 						      sabuf, ifp->dscp);
 				}
+				settls(ifp, le, &listen_addr);
 			} else {
 				isc_log_write(IFMGR_COMMON_LOGARGS,
 					      ISC_LOG_INFO,
 					      "listening on IPv6 "
-					      "interfaces, port %u",
-					      le->port);
+					      "interfaces, port %u%s",
+					      le->port,
+					      le->tlsctx != NULL ?
+					      " (TLS)" : "");
 				result = ns_interface_setup(mgr, &listen_addr,
 							    "<any>", &ifp,
 							    ISC_TRUE,
 							    le->dscp,
+							    le->tlsctx,
 							    NULL);
 				if (result == ISC_R_SUCCESS)
 					ifp->flags |= NS_INTERFACEFLAG_ANYADDR;
@@ -1110,9 +1164,17 @@ do_scan(ns_interfacemgr_t *mgr, ns_listenlist_t *ext_listen,
 						      "values, using %d",
 						      sabuf, ifp->dscp);
 				}
+				settls(ifp, le, &listen_sockaddr);
 			} else {
 				isc_boolean_t addr_in_use = ISC_FALSE;
 
+				/*
+				 * The extra addresses are only needed
+				 * for UDP.
+				 */
+				if (adjusting == ISC_TRUE && le->tlsctx != NULL)
+					continue;
+
 				if (adjusting == ISC_FALSE &&
 				    ipv6_wildcard == ISC_TRUE)
 					continue;
@@ -1134,12 +1196,14 @@ do_scan(ns_interfacemgr_t *mgr, ns_listenlist_t *ext_listen,
 					      ISC_LOG_INFO,
 					      "%s"
 					      "listening on %s interface "
-					      "%s, %s",
+					      "%s, %s%s",
 					      (adjusting == ISC_TRUE) ?
 					      "additionally " : "",
 					      (family == AF_INET) ?
 					      "IPv4" : "IPv6",
-					      interface.name, sabuf);
+					      interface.name, sabuf,
+					      le->tlsctx != NULL ?
+					      " (TLS)" : "");
 
 				result = ns_interface_setup(mgr,
 						    &listen_sockaddr,
@@ -1148,6 +1212,7 @@ do_scan(ns_interfacemgr_t *mgr, ns_listenlist_t *ext_listen,
 						    (adjusting == ISC_TRUE) ?
 						    ISC_FALSE : ISC_TRUE,
 						    le->dscp,
+						    le->tlsctx,
 						    &addr_in_use);
 
 				tried_listening = ISC_TRUE;
@@ -19,6 +19,7 @@
 #include <dns/acl.h>
 
 #include <ns/listenlist.h>
+#include <ns/tls.h>
 
 static void
 destroy(ns_listenlist_t *list);
@@ -37,6 +38,7 @@ ns_listenelt_create(isc_mem_t *mctx, in_port_t port, isc_dscp_t dscp,
 	elt->port = port;
 	elt->dscp = dscp;
 	elt->acl = acl;
+	elt->tlsctx = NULL;
 	*target = elt;
 	return (ISC_R_SUCCESS);
 }
@@ -45,6 +47,8 @@ void
 ns_listenelt_destroy(ns_listenelt_t *elt) {
 	if (elt->acl != NULL)
 		dns_acl_detach(&elt->acl);
+	if (elt->tlsctx != NULL)
+		ns_tlsctx_detach(&elt->tlsctx);
 	isc_mem_put(elt->mctx, elt, sizeof(*elt));
 }
 
@@ -36,6 +36,7 @@
 #include <dns/dnsrps.h>
 #include <dns/dnssec.h>
 #include <dns/events.h>
+#include <dns/hotcache.h>
 #include <dns/message.h>
 #include <dns/ncache.h>
 #include <dns/nsec.h>
@@ -60,6 +61,7 @@
 #include <ns/client.h>
 #include <ns/interfacemgr.h>
 #include <ns/log.h>
+#include <ns/querylog.h>
 #include <ns/server.h>
 #include <ns/sortlist.h>
 #include <ns/stats.h>
@@ -414,6 +416,9 @@ query_ncache(query_ctx_t *qctx, isc_result_t result);
 static isc_result_t
 query_coveringnsec(query_ctx_t *qctx);
 
+static isc_result_t
+query_coveringnsec3(query_ctx_t *qctx);
+
 static isc_result_t
 query_cname(query_ctx_t *qctx);
 
@@ -2420,6 +2425,17 @@ query_prefetch(ns_client_t *client, dns_name_t *qname,
 	ns_client_t *dummy = NULL;
 	unsigned int options;
 
+	/*
+	 * Let the hotcache know about this answer, so that popular
+	 * names are refreshed even when no query arrives within the
+	 * prefetch trigger.
+	 */
+	if (client->view->hotcache != NULL && rdataset->type != 0 &&
+	    (rdataset->attributes & DNS_RDATASETATTR_PREFETCH) != 0)
+		dns_hotcache_hit(client->view->hotcache, qname,
+				 rdataset->type, rdataset->ttl,
+				 client->now);
+
 	if (client->query.prefetch != NULL ||
 	    client->view->prefetch_trigger == 0U ||
 	    rdataset->ttl > client->view->prefetch_trigger ||
@@ -5560,8 +5576,9 @@ query_recurse(ns_client_t *client, dns_rdatatype_t qtype, dns_name_t *qname,
 	 * connection was accepted (if allowed by the TCP quota).
 	 */
 	if (client->recursionquota == NULL) {
-		result = isc_quota_attach(&client->sctx->recursionquota,
-					  &client->recursionquota);
+		isc_quota_t *quota = &client->sctx->recursionquota;
+
+		result = isc_quota_attach(quota, &client->recursionquota);
 
 		ns_stats_increment(client->sctx->nsstats,
 				   ns_statscounter_recursclients);
@@ -5578,9 +5595,9 @@ query_recurse(ns_client_t *client, dns_rdatatype_t qtype, dns_name_t *qname,
 					      "recursive-clients soft limit "
 					      "exceeded (%d/%d/%d), "
 					      "aborting oldest query",
-					      client->recursionquota->used,
-					      client->recursionquota->soft,
-					      client->recursionquota->max);
+					      isc_quota_getused(quota),
+					      isc_quota_getsoft(quota),
+					      isc_quota_getmax(quota));
 			}
 			ns_client_killoldestquery(client);
 			result = ISC_R_SUCCESS;
@@ -5595,9 +5612,9 @@ query_recurse(ns_client_t *client, dns_rdatatype_t qtype, dns_name_t *qname,
 					      ISC_LOG_WARNING,
 					      "no more recursive clients "
 					      "(%d/%d/%d): %s",
-					      client->sctx->recursionquota.used,
-					      client->sctx->recursionquota.soft,
-					      client->sctx->recursionquota.max,
+					      isc_quota_getused(quota),
+					      isc_quota_getsoft(quota),
+					      isc_quota_getmax(quota),
 					      isc_result_totext(result));
 			}
 			ns_client_killoldestquery(client);
@@ -6390,6 +6407,11 @@ query_gotanswer(query_ctx_t *qctx, isc_result_t result) {
 		return (query_notfound(qctx));
 
 	case DNS_R_DELEGATION:
+		if (!qctx->is_zone && qctx->findcoveringnsec) {
+			result = query_coveringnsec3(qctx);
+			if (result != ISC_R_COMPLETE)
+				return (result);
+		}
 		return (query_delegation(qctx));
 
 	case DNS_R_EMPTYNAME:
@@ -9078,6 +9100,219 @@ query_coveringnsec(query_ctx_t *qctx) {
 	return (query_done(qctx));
 }
 
+/*%
+ * Handle a delegation found in the cache when synth-from-dnssec is
+ * enabled.
+ *
+ * Signed zones using NSEC3 leave no covering NSEC records in the
+ * cache, so query_coveringnsec() is never reached for them.  Instead,
+ * look for secure NSEC3 records cached for the zone at the delegation
+ * point that prove QNAME does not exist, or that it has no data of the
+ * requested type, and if found synthesize a NXDOMAIN or NODATA response
+ * from them and the zone's SOA record rather than recursing.
+ *
+ * Returns ISC_R_COMPLETE if no response was synthesized, in which case
+ * the delegation should be followed as usual.
+ */
+static isc_result_t
+query_coveringnsec3(query_ctx_t *qctx) {
+	ns_client_t *client = qctx->client;
+	dns_clientinfo_t ci;
+	dns_clientinfomethods_t cm;
+	dns_dbnode_t *node = NULL;
+	dns_fixedname_t fixed, fzone;
+	dns_name_t *fname, *zone, *name = NULL;
+	dns_nsec3proof_t proof;
+	dns_rdataset_t *soardataset = NULL, *sigsoardataset = NULL;
+	dns_rdataset_t *clone = NULL, *sigclone = NULL;
+	dns_ttl_t ttl;
+	isc_buffer_t *dbuf, b;
+	isc_result_t result;
+	int i;
+
+	/*
+	 * We don't yet have code to handle synthesis and type ANY,
+	 * AAAA filtering or dns64 processing, nor NXDOMAIN redirection.
+	 * Types that live at the parent side of a zone cut can't be
+	 * proven absent from the child zone's records.
+	 */
+	if (qctx->type == dns_rdatatype_any ||
+	    dns_rdatatype_atparent(qctx->qtype) ||
+	    qctx->zdb != NULL ||
+	    client->view->redirect != NULL ||
+	    client->view->redirectzone != NULL)
+	{
+		return (ISC_R_COMPLETE);
+	}
+	if ((client->filter_aaaa != dns_aaaa_ok ||
+	     !ISC_LIST_EMPTY(client->view->dns64)) &&
+	    (qctx->type == dns_rdatatype_a ||
+	     qctx->type == dns_rdatatype_aaaa))
+	{
+		return (ISC_R_COMPLETE);
+	}
+	if (qctx->type == dns_rdatatype_null &&
+	    dns_name_istat(client->query.qname))
+	{
+		return (ISC_R_COMPLETE);
+	}
+
+	dns_fixedname_init(&fzone);
+	zone = dns_fixedname_name(&fzone);
+	dns_name_copy(qctx->fname, zone, NULL);
+	dns_fixedname_init(&fixed);
+	fname = dns_fixedname_name(&fixed);
+
+	dns_nsec3proof_init(&proof);
+	result = dns_nsec3_findproof(qctx->db, zone, client->query.qname,
+				     qctx->qtype, client->now, &proof,
+				     log_noexistnodata, qctx);
+	if (result != ISC_R_SUCCESS) {
+		return (ISC_R_COMPLETE);
+	}
+
+	soardataset = query_newrdataset(client);
+	sigsoardataset = query_newrdataset(client);
+	if (soardataset == NULL || sigsoardataset == NULL) {
+		result = ISC_R_COMPLETE;
+		goto cleanup;
+	}
+
+	/*
+	 * Look for the zone's SOA record to construct the response.
+	 */
+	dns_clientinfomethods_init(&cm, ns_client_sourceip);
+	dns_clientinfo_init(&ci, client, NULL);
+	result = dns_db_findext(qctx->db, zone, NULL, dns_rdatatype_soa,
+				client->query.dboptions, client->now, &node,
+				fname, &cm, &ci, soardataset, sigsoardataset);
+	if (node != NULL) {
+		dns_db_detachnode(qctx->db, &node);
+	}
+	if (result != ISC_R_SUCCESS ||
+	    soardataset->trust != dns_trust_secure ||
+	    !dns_rdataset_isassociated(sigsoardataset))
+	{
+		result = ISC_R_COMPLETE;
+		goto cleanup;
+	}
+
+	/*
+	 * Determine the correct TTL to use for the SOA and RRSIG.
+	 */
+	ttl = query_synthttl(soardataset, sigsoardataset,
+			     &proof.rdatasets[DNS_NSEC3PROOF_CLOSEST],
+			     &proof.sigrdatasets[DNS_NSEC3PROOF_CLOSEST],
+			     NULL, NULL);
+	for (i = DNS_NSEC3PROOF_NEXTCLOSER; i < DNS_NSEC3PROOF_MAX; i++) {
+		if (dns_rdataset_isassociated(&proof.rdatasets[i])) {
+			ttl = ISC_MIN(ttl, proof.rdatasets[i].ttl);
+			ttl = ISC_MIN(ttl, proof.sigrdatasets[i].ttl);
+		}
+	}
+	soardataset->ttl = sigsoardataset->ttl = ttl;
+
+	/*
+	 * We're answering now; the delegation's owner name is no
+	 * longer needed and its buffer can be reused.
+	 */
+	query_releasename(client, &qctx->fname);
+
+	dbuf = query_getnamebuf(client);
+	if (dbuf == NULL) {
+		result = DNS_R_SERVFAIL;
+		goto cleanup;
+	}
+	name = query_newname(client, dbuf, &b);
+	if (name == NULL) {
+		result = DNS_R_SERVFAIL;
+		goto cleanup;
+	}
+	dns_name_copy(zone, name, NULL);
+
+	/*
+	 * Add SOA record. Omit the RRSIG if DNSSEC was not requested.
+	 */
+	query_addrrset(client, &name, &soardataset,
+		       WANTDNSSEC(client) ? &sigsoardataset : NULL,
+		       dbuf, DNS_SECTION_AUTHORITY);
+	if (name != NULL) {
+		query_releasename(client, &name);
+	}
+
+	/*
+	 * Add the NSEC3 proofs.
+	 */
+	for (i = 0; WANTDNSSEC(client) && i < DNS_NSEC3PROOF_MAX; i++) {
+		if (!dns_rdataset_isassociated(&proof.rdatasets[i])) {
+			continue;
+		}
+
+		dbuf = query_getnamebuf(client);
+		if (dbuf == NULL) {
+			result = DNS_R_SERVFAIL;
+			goto cleanup;
+		}
+		name = query_newname(client, dbuf, &b);
+		clone = query_newrdataset(client);
+		sigclone = query_newrdataset(client);
+		if (name == NULL || clone == NULL || sigclone == NULL) {
+			result = DNS_R_SERVFAIL;
+			goto cleanup;
+		}
+		dns_name_copy(dns_fixedname_name(&proof.names[i]), name, NULL);
+		dns_rdataset_clone(&proof.rdatasets[i], clone);
+		dns_rdataset_clone(&proof.sigrdatasets[i], sigclone);
+
+		query_addrrset(client, &name, &clone, &sigclone,
+			       dbuf, DNS_SECTION_AUTHORITY);
+		if (name != NULL) {
+			query_releasename(client, &name);
+		}
+		if (clone != NULL) {
+			query_putrdataset(client, &clone);
+		}
+		if (sigclone != NULL) {
+			query_putrdataset(client, &sigclone);
+		}
+	}
+
+	if (proof.exists) {
+		inc_stats(client, ns_statscounter_nodatasynth);
+	} else {
+		client->message->rcode = dns_rcode_nxdomain;
+		inc_stats(client, ns_statscounter_nxdomainsynth);
+	}
+	inc_stats(client, ns_statscounter_nsec3synth);
+	result = ISC_R_SUCCESS;
+
+ cleanup:
+	dns_nsec3proof_invalidate(&proof);
+	if (name != NULL) {
+		query_releasename(client, &name);
+	}
+	if (clone != NULL) {
+		query_putrdataset(client, &clone);
+	}
+	if (sigclone != NULL) {
+		query_putrdataset(client, &sigclone);
+	}
+	if (soardataset != NULL) {
+		query_putrdataset(client, &soardataset);
+	}
+	if (sigsoardataset != NULL) {
+		query_putrdataset(client, &sigsoardataset);
+	}
+
+	if (result == ISC_R_COMPLETE) {
+		return (result);
+	}
+	if (result != ISC_R_SUCCESS) {
+		QUERY_ERROR(qctx, result);
+	}
+	return (query_done(qctx));
+}
+
 /*%
  * Handle negative cache responses, DNS_R_NCACHENXRRSET or
  * DNS_R_NCACHENXDOMAIN. (Note: may also be called with result
@@ -10588,6 +10823,56 @@ log_tat(ns_client_t *client) {
 	}
 }
 
+/*
+ * Hand the query to the asynchronous query logger, which formats
+ * it in its own thread.
+ */
+static inline void
+log_query_async(ns_client_t *client, unsigned int flags,
+		unsigned int extflags)
+{
+	ns_querylogentry_t entry;
+	dns_rdataset_t *rdataset;
+
+	rdataset = ISC_LIST_HEAD(client->query.qname->list);
+	INSIST(rdataset != NULL);
+
+	entry.client = client;
+	entry.peer = client->peeraddr_valid ? &client->peeraddr : NULL;
+	entry.dest = &client->destaddr;
+	entry.qname = client->query.qname;
+	entry.signer = client->signer;
+	entry.view = NULL;
+	if (client->view != NULL &&
+	    strcmp(client->view->name, "_bind") != 0 &&
+	    strcmp(client->view->name, "_default") != 0)
+	{
+		entry.view = client->view->name;
+	}
+	entry.ecs = HAVEECS(client) ? &client->ecs : NULL;
+	entry.qtype = rdataset->type;
+	entry.qclass = rdataset->rdclass;
+	entry.ednsversion = client->ednsversion;
+
+	entry.flags = 0;
+	if (WANTRECURSION(client))
+		entry.flags |= NS_QUERYLOG_RECURSE;
+	if (client->signer != NULL)
+		entry.flags |= NS_QUERYLOG_SIGNED;
+	if (TCP(client))
+		entry.flags |= NS_QUERYLOG_TCP;
+	if ((extflags & DNS_MESSAGEEXTFLAG_DO) != 0)
+		entry.flags |= NS_QUERYLOG_DO;
+	if ((flags & DNS_MESSAGEFLAG_CD) != 0)
+		entry.flags |= NS_QUERYLOG_CD;
+	if (HAVECOOKIE(client))
+		entry.flags |= NS_QUERYLOG_COOKIE;
+	else if (WANTCOOKIE(client))
+		entry.flags |= NS_QUERYLOG_WANTCOOKIE;
+
+	ns_querylog_write(client->sctx->querylog, &entry);
+}
+
 static inline void
 log_query(ns_client_t *client, unsigned int flags, unsigned int extflags) {
 	char namebuf[DNS_NAME_FORMATSIZE];
@@ -10790,8 +11075,12 @@ ns_query_start(ns_client_t *client) {
 		return;
 	}
 
-	if ((client->sctx->options & NS_SERVER_LOGQUERIES) != 0)
-		log_query(client, saved_flags, saved_extflags);
+	if ((client->sctx->options & NS_SERVER_LOGQUERIES) != 0) {
+		if (client->sctx->querylog != NULL)
+			log_query_async(client, saved_flags, saved_extflags);
+		else
+			log_query(client, saved_flags, saved_extflags);
+	}
 
 	/*
 	 * Check for meta-queries like IXFR and AXFR.
@@ -0,0 +1,832 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <isc/atomic.h>
+#include <isc/condition.h>
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/once.h>
+#include <isc/platform.h>
+#include <isc/print.h>
+#include <isc/stdio.h>
+#include <isc/stdtime.h>
+#include <isc/string.h>
+#include <isc/thread.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/ecs.h>
+#include <dns/name.h>
+#include <dns/rdataclass.h>
+#include <dns/rdatatype.h>
+
+#include <ns/log.h>
+#include <ns/querylog.h>
+
+#if defined(ISC_PLATFORM_HAVESTDATOMIC)
+#include <stdatomic.h>
+#endif
+
+/*
+ * The ring positions are read by one thread while another one moves
+ * them, so they need atomic loads and stores with acquire/release
+ * ordering.  Without those (or without threads) there is nothing to
+ * gain over logging synchronously, and ns_querylog_create() fails.
+ */
+#ifdef ISC_PLATFORM_USETHREADS
+#if defined(ISC_PLATFORM_HAVESTDATOMIC) && defined(ATOMIC_INT_LOCK_FREE)
+#define QL_ENABLED 1
+typedef atomic_uint_fast32_t qlpos_t;
+#define QL_INIT(p, v)	atomic_init((p), (v))
+#define QL_LOAD(p)	((isc_uint32_t)atomic_load_explicit((p), \
+						    memory_order_acquire))
+#define QL_STORE(p, v)	atomic_store_explicit((p), (v), memory_order_release)
+#elif defined(ISC_PLATFORM_HAVEXADD) && defined(ISC_PLATFORM_HAVEATOMICSTORE)
+#define QL_ENABLED 1
+typedef isc_int32_t qlpos_t;
+#define QL_INIT(p, v)	(*(p) = (v))
+#define QL_LOAD(p)	((isc_uint32_t)isc_atomic_xadd((p), 0))
+#define QL_STORE(p, v)	isc_atomic_store((p), (isc_int32_t)(v))
+#endif
+#endif /* ISC_PLATFORM_USETHREADS */
+
+#ifdef QL_ENABLED
+
+#define QUERYLOG_MAGIC		ISC_MAGIC('Q', 'L', 'o', 'g')
+#define VALID_QUERYLOG(q)	ISC_MAGIC_VALID(q, QUERYLOG_MAGIC)
+
+#define QL_MINBUFSIZE		4096
+#define QL_MAXBUFSIZE		(1U << 30)
+#define QL_CACHELINE		64
+#define QL_ALIGN(x)		(((x) + 7U) & ~7U)
+
+/*% How long the writer sleeps when there was nothing to do. */
+#define QL_POLL_NS		(20 * 1000 * 1000)
+/*% Minimum interval between warnings about dropped entries. */
+#define QL_WARN_INTERVAL	10
+/*% Output buffer used when writing to a file. */
+#define QL_OUTBUFSIZE		(64 * 1024)
+#define QL_LINESIZE		2048
+
+/*
+ * Addresses are stored in this form rather than as isc_netaddr_t,
+ * which has room for a UNIX domain socket path and would more than
+ * double the size of a record.
+ */
+typedef struct qladdr {
+	isc_uint32_t		zone;
+	isc_uint8_t		family;		/*%< 0 if absent */
+	unsigned char		addr[16];
+} qladdr_t;
+
+/*
+ * A record in a ring: this header, then the query name and the
+ * signer name in wire format, then the view name, then padding up
+ * to a multiple of 8 bytes.
+ */
+typedef struct qlrecord {
+	isc_uint16_t		length;
+	isc_uint16_t		flags;
+	isc_uint16_t		qtype;
+	isc_uint16_t		qclass;
+	isc_int16_t		ednsversion;
+	isc_uint16_t		peerport;
+	isc_uint8_t		qnamelen;
+	isc_uint8_t		signerlen;
+	isc_uint8_t		viewlen;
+	isc_uint8_t		ecssource;
+	isc_uint8_t		ecsscope;
+	isc_uint32_t		seconds;
+	isc_uint32_t		nanoseconds;
+	const void *		client;
+	qladdr_t		peer;
+	qladdr_t		dest;
+	qladdr_t		ecs;
+} qlrecord_t;
+
+#define QL_MAXDATA		(255 + 255 + 255)
+
+/*
+ * A single producer, single consumer ring buffer.  'head' is only
+ * moved by the thread that owns the ring, 'tail' only by the writer.
+ * 'dropped' is only incremented by the owner and wraps; the writer
+ * keeps track of how much of it it has already accounted for.
+ */
+typedef struct qlring qlring_t;
+struct qlring {
+	qlpos_t			head;
+	qlpos_t			dropped;
+	unsigned char		pad1[QL_CACHELINE];
+	qlpos_t			tail;
+	isc_uint32_t		reported;
+	unsigned char		pad2[QL_CACHELINE];
+	isc_uint32_t		size;
+	unsigned char *		buf;
+	ISC_LINK(qlring_t)	link;
+};
+
+struct ns_querylog {
+	unsigned int		magic;
+	isc_mem_t *		mctx;
+	unsigned int		generation;
+	ns_querylogformat_t	format;
+	isc_uint32_t		bufsize;
+	char *			file;
+	FILE *			fp;
+	char *			out;
+	size_t			outlen;
+	isc_boolean_t		writeerror;
+	isc_thread_t		thread;
+	isc_mutex_t		lock;
+	isc_condition_t		cond;
+	/* Locked by 'lock'. */
+	isc_boolean_t		exiting;
+	ISC_LIST(qlring_t)	rings;
+	isc_uint64_t		written;
+	isc_uint64_t		dropped;
+	isc_uint64_t		unreported;
+	isc_stdtime_t		lastwarn;
+};
+
+/*
+ * Each thread finds its ring for the current query logger through
+ * a thread-specific key.
+ */
+typedef struct qlthread {
+	ns_querylog_t *		ql;
+	unsigned int		generation;
+	qlring_t *		ring;
+} qlthread_t;
+
+static isc_once_t ql_once = ISC_ONCE_INIT;
+static isc_mutex_t ql_mutex;
+static isc_boolean_t ql_initialized = ISC_FALSE;
+static isc_thread_key_t ql_key;
+static unsigned int ql_generation = 0;
+
+static void
+ql_mutexinit(void) {
+	RUNTIME_CHECK(isc_mutex_init(&ql_mutex) == ISC_R_SUCCESS);
+}
+
+static void
+ql_threadfree(void *arg) {
+	free(arg);
+	isc_thread_key_setspecific(ql_key, NULL);
+}
+
+static isc_result_t
+ql_init(void) {
+	isc_result_t result;
+
+	result = isc_once_do(&ql_once, ql_mutexinit);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	LOCK(&ql_mutex);
+	if (!ql_initialized) {
+		if (isc_thread_key_create(&ql_key, ql_threadfree) == 0)
+			ql_initialized = ISC_TRUE;
+		else
+			result = ISC_R_FAILURE;
+	}
+	UNLOCK(&ql_mutex);
+
+	return (result);
+}
+
+static void
+ringput(qlring_t *ring, isc_uint32_t pos, const void *data, size_t len) {
+	size_t off = pos & (ring->size - 1);
+	size_t n = ISC_MIN(len, ring->size - off);
+
+	memmove(ring->buf + off, data, n);
+	if (n < len)
+		memmove(ring->buf, (const unsigned char *)data + n, len - n);
+}
+
+static void
+ringget(qlring_t *ring, isc_uint32_t pos, void *data, size_t len) {
+	size_t off = pos & (ring->size - 1);
+	size_t n = ISC_MIN(len, ring->size - off);
+
+	memmove(data, ring->buf + off, n);
+	if (n < len)
+		memmove((unsigned char *)data + n, ring->buf, len - n);
+}
+
+static void
+putaddr(qladdr_t *qa, const isc_netaddr_t *na) {
+	switch (na->family) {
+	case AF_INET:
+		memmove(qa->addr, &na->type.in, 4);
+		break;
+	case AF_INET6:
+		memmove(qa->addr, &na->type.in6, 16);
+		break;
+	default:
+		return;
+	}
+	qa->family = (isc_uint8_t)na->family;
+	qa->zone = na->zone;
+}
+
+static isc_boolean_t
+getaddr(const qladdr_t *qa, isc_netaddr_t *na) {
+	struct in_addr in4;
+	struct in6_addr in6;
+
+	switch (qa->family) {
+	case AF_INET:
+		memmove(&in4, qa->addr, 4);
+		isc_netaddr_fromin(na, &in4);
+		break;
+	case AF_INET6:
+		memmove(&in6, qa->addr, 16);
+		isc_netaddr_fromin6(na, &in6);
+		isc_netaddr_setzone(na, qa->zone);
+		break;
+	default:
+		return (ISC_FALSE);
+	}
+	return (ISC_TRUE);
+}
+
+static qlring_t *
+getring(ns_querylog_t *ql) {
+	qlthread_t *qt;
+	qlring_t *ring;
+
+	qt = isc_thread_key_getspecific(ql_key);
+	if (qt != NULL && qt->ql == ql && qt->generation == ql->generation)
+		return (qt->ring);
+
+	if (qt == NULL) {
+		qt = malloc(sizeof(*qt));
+		if (qt == NULL)
+			return (NULL);
+		if (isc_thread_key_setspecific(ql_key, qt) != 0) {
+			free(qt);
+			return (NULL);
+		}
+	}
+	qt->ql = NULL;
+
+	ring = isc_mem_get(ql->mctx, sizeof(*ring));
+	if (ring == NULL)
+		return (NULL);
+	memset(ring, 0, sizeof(*ring));
+	ring->size = ql->bufsize;
+	ring->buf = isc_mem_get(ql->mctx, ring->size);
+	if (ring->buf == NULL) {
+		isc_mem_put(ql->mctx, ring, sizeof(*ring));
+		return (NULL);
+	}
+	QL_INIT(&ring->head, 0);
+	QL_INIT(&ring->tail, 0);
+	QL_INIT(&ring->dropped, 0);
+	ISC_LINK_INIT(ring, link);
+
+	LOCK(&ql->lock);
+	ISC_LIST_APPEND(ql->rings, ring, link);
+	UNLOCK(&ql->lock);
+
+	qt->ql = ql;
+	qt->generation = ql->generation;
+	qt->ring = ring;
+
+	return (ring);
+}
+
+void
+ns_querylog_write(ns_querylog_t *ql, const ns_querylogentry_t *entry) {
+	qlring_t *ring;
+	qlrecord_t rec;
+	isc_region_t qname, signer;
+	isc_netaddr_t na;
+	isc_time_t now;
+	isc_uint32_t head, used, len;
+	size_t viewlen = 0;
+
+	REQUIRE(VALID_QUERYLOG(ql));
+	REQUIRE(entry != NULL && entry->qname != NULL && entry->dest != NULL);
+
+	if (ql->fp == NULL && !isc_log_wouldlog(ns_lctx, ISC_LOG_INFO))
+		return;
+
+	ring = getring(ql);
+	if (ring == NULL)
+		return;
+
+	dns_name_toregion(entry->qname, &qname);
+	signer.length = 0;
+	if (entry->signer != NULL)
+		dns_name_toregion(entry->signer, &signer);
+	if (entry->view != NULL)
+		viewlen = ISC_MIN(strlen(entry->view), 255);
+
+	len = QL_ALIGN(sizeof(rec) + qname.length + signer.length + viewlen);
+	head = QL_LOAD(&ring->head);
+	used = head - QL_LOAD(&ring->tail);
+	if (len > ring->size - used) {
+		QL_STORE(&ring->dropped, QL_LOAD(&ring->dropped) + 1);
+		return;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	TIME_NOW(&now);
+	rec.length = (isc_uint16_t)len;
+	rec.flags = (isc_uint16_t)entry->flags;
+	rec.qtype = entry->qtype;
+	rec.qclass = entry->qclass;
+	rec.ednsversion = (isc_int16_t)entry->ednsversion;
+	rec.qnamelen = (isc_uint8_t)qname.length;
+	rec.signerlen = (isc_uint8_t)signer.length;
+	rec.viewlen = (isc_uint8_t)viewlen;
+	rec.seconds = isc_time_seconds(&now);
+	rec.nanoseconds = isc_time_nanoseconds(&now);
+	rec.client = entry->client;
+	if (entry->peer != NULL) {
+		isc_netaddr_fromsockaddr(&na, entry->peer);
+		putaddr(&rec.peer, &na);
+		rec.peerport = isc_sockaddr_getport(entry->peer);
+	}
+	putaddr(&rec.dest, entry->dest);
+	if (entry->ecs != NULL) {
+		putaddr(&rec.ecs, &entry->ecs->addr);
+		rec.ecssource = entry->ecs->source;
+		rec.ecsscope = entry->ecs->scope;
+	}
+
+	ringput(ring, head, &rec, sizeof(rec));
+	head += sizeof(rec);
+	ringput(ring, head, qname.base, qname.length);
+	head += qname.length;
+	if (signer.length != 0) {
+		ringput(ring, head, signer.base, signer.length);
+		head += signer.length;
+	}
+	if (viewlen != 0) {
+		ringput(ring, head, entry->view, viewlen);
+		head += viewlen;
+	}
+	QL_STORE(&ring->head, QL_ALIGN(head));
+
+	/*
+	 * Wake the writer early rather than letting the ring fill up
+	 * while it sleeps.
+	 */
+	if (used + len > ring->size / 2)
+		(void)isc_condition_signal(&ql->cond);
+}
+
+static void
+flushout(ns_querylog_t *ql) {
+	isc_result_t result;
+
+	if (ql->outlen == 0)
+		return;
+
+	result = isc_stdio_write(ql->out, 1, ql->outlen, ql->fp, NULL);
+	if (result == ISC_R_SUCCESS)
+		result = isc_stdio_flush(ql->fp);
+	ql->outlen = 0;
+
+	if (result != ISC_R_SUCCESS && !ql->writeerror) {
+		isc_log_write(ns_lctx, NS_LOGCATEGORY_QUERIES,
+			      NS_LOGMODULE_QUERY, ISC_LOG_ERROR,
+			      "writing query log file '%s' failed: %s",
+			      ql->file, isc_result_totext(result));
+	}
+	ql->writeerror = ISC_TF(result != ISC_R_SUCCESS);
+}
+
+static void
+format_name(const unsigned char *data, unsigned int len,
+	    char *buf, size_t size)
+{
+	dns_name_t name;
+	isc_region_t r;
+
+	DE_CONST(data, r.base);
+	r.length = len;
+	dns_name_init(&name, NULL);
+	dns_name_fromregion(&name, &r);
+	dns_name_format(&name, buf, (unsigned int)size);
+}
+
+static void
+emit(ns_querylog_t *ql, const qlrecord_t *rec, const unsigned char *data) {
+	char line[QL_LINESIZE];
+	char namebuf[DNS_NAME_FORMATSIZE];
+	char signerbuf[DNS_NAME_FORMATSIZE];
+	char typename[DNS_RDATATYPE_FORMATSIZE];
+	char classname[DNS_RDATACLASS_FORMATSIZE];
+	char peerbuf[ISC_SOCKADDR_FORMATSIZE];
+	char onbuf[ISC_NETADDR_FORMATSIZE];
+	char ecsbuf[DNS_ECS_FORMATSIZE + sizeof(" [ECS ]") - 1] = { 0 };
+	char ednsbuf[sizeof("E(65535)")] = { 0 };
+	char flagbuf[sizeof("+SE(65535)TDCV")];
+	char viewbuf[256];
+	char timebuf[64];
+	const char *sep1 = "", *sep2 = "";
+	isc_sockaddr_t peer;
+	isc_netaddr_t na;
+	isc_time_t when;
+	int n;
+
+	format_name(data, rec->qnamelen, namebuf, sizeof(namebuf));
+	if (rec->signerlen != 0) {
+		format_name(data + rec->qnamelen, rec->signerlen,
+			    signerbuf, sizeof(signerbuf));
+		sep1 = "/key ";
+	} else
+		signerbuf[0] = '\0';
+	memmove(viewbuf, data + rec->qnamelen + rec->signerlen, rec->viewlen);
+	viewbuf[rec->viewlen] = '\0';
+	if (rec->viewlen != 0)
+		sep2 = ": view ";
+
+	dns_rdataclass_format(rec->qclass, classname, sizeof(classname));
+	dns_rdatatype_format(rec->qtype, typename, sizeof(typename));
+
+	if (getaddr(&rec->peer, &na)) {
+		isc_sockaddr_fromnetaddr(&peer, &na, rec->peerport);
+		isc_sockaddr_format(&peer, peerbuf, sizeof(peerbuf));
+	} else
+		snprintf(peerbuf, sizeof(peerbuf), "(no-peer)");
+
+	if (getaddr(&rec->dest, &na))
+		isc_netaddr_format(&na, onbuf, sizeof(onbuf));
+	else
+		snprintf(onbuf, sizeof(onbuf), "(unknown)");
+
+	if (getaddr(&rec->ecs, &na)) {
+		dns_ecs_t ecs;
+
+		ecs.addr = na;
+		ecs.source = rec->ecssource;
+		ecs.scope = rec->ecsscope;
+		strlcpy(ecsbuf, " [ECS ", sizeof(ecsbuf));
+		dns_ecs_format(&ecs, ecsbuf + 6, sizeof(ecsbuf) - 6);
+		strlcat(ecsbuf, "]", sizeof(ecsbuf));
+	}
+
+	if (rec->ednsversion >= 0)
+		snprintf(ednsbuf, sizeof(ednsbuf), "E(%hd)",
+			 rec->ednsversion);
+
+	snprintf(flagbuf, sizeof(flagbuf), "%s%s%s%s%s%s%s",
+		 (rec->flags & NS_QUERYLOG_RECURSE) != 0 ? "+" : "-",
+		 (rec->flags & NS_QUERYLOG_SIGNED) != 0 ? "S" : "",
+		 ednsbuf,
+		 (rec->flags & NS_QUERYLOG_TCP) != 0 ? "T" : "",
+		 (rec->flags & NS_QUERYLOG_DO) != 0 ? "D" : "",
+		 (rec->flags & NS_QUERYLOG_CD) != 0 ? "C" : "",
+		 (rec->flags & NS_QUERYLOG_COOKIE) != 0 ? "V" :
+		 (rec->flags & NS_QUERYLOG_WANTCOOKIE) != 0 ? "K" : "");
+
+	if (ql->format == ns_querylogformat_compact) {
+		n = snprintf(line, sizeof(line),
+			     "%u.%03u %s %s %s %s %s %s%s%s%s%s%s",
+			     rec->seconds, rec->nanoseconds / 1000000,
+			     peerbuf, namebuf, classname, typename,
+			     flagbuf, onbuf,
+			     rec->signerlen != 0 ? " key " : "", signerbuf,
+			     rec->viewlen != 0 ? " view " : "", viewbuf,
+			     ecsbuf);
+	} else {
+		if (ql->fp != NULL) {
+			isc_time_set(&when, rec->seconds, rec->nanoseconds);
+			isc_time_formattimestamp(&when, timebuf,
+						 sizeof(timebuf));
+			strlcat(timebuf, " ", sizeof(timebuf));
+		} else
+			timebuf[0] = '\0';
+		n = snprintf(line, sizeof(line),
+			     "%sclient @%p %s%s%s (%s)%s%s: "
+			     "query: %s %s %s %s (%s)%s",
+			     timebuf, rec->client, peerbuf, sep1, signerbuf,
+			     namebuf, sep2, viewbuf, namebuf, classname,
+			     typename, flagbuf, onbuf, ecsbuf);
+	}
+
+	if (ql->fp == NULL) {
+		isc_log_write(ns_lctx, NS_LOGCATEGORY_QUERIES,
+			      NS_LOGMODULE_QUERY, ISC_LOG_INFO, "%s", line);
+		return;
+	}
+
+	if (n < 0)
+		return;
+	if ((size_t)n >= sizeof(line) - 1)
+		n = sizeof(line) - 2;
+	line[n++] = '\n';
+	if (ql->outlen + n > QL_OUTBUFSIZE)
+		flushout(ql);
+	memmove(ql->out + ql->outlen, line, n);
+	ql->outlen += n;
+}
+
+static unsigned int
+drain(ns_querylog_t *ql, qlring_t *ring) {
+	unsigned char data[QL_MAXDATA];
+	qlrecord_t rec;
+	isc_uint32_t head, tail;
+	unsigned int n = 0;
+
+	head = QL_LOAD(&ring->head);
+	tail = QL_LOAD(&ring->tail);
+	while (tail != head) {
+		ringget(ring, tail, &rec, sizeof(rec));
+		ringget(ring, tail + sizeof(rec), data,
+			rec.qnamelen + rec.signerlen + rec.viewlen);
+		tail += rec.length;
+		/*
+		 * Hand the space back before formatting so that the
+		 * producer can reuse it as soon as possible.
+		 */
+		QL_STORE(&ring->tail, tail);
+		emit(ql, &rec, data);
+		n++;
+	}
+
+	return (n);
+}
+
+/*
+ * Account for entries dropped since the last call and warn about
+ * them, unless we did so recently.
+ */
+static void
+checkdrops(ns_querylog_t *ql, qlring_t *first, qlring_t *last,
+	   isc_boolean_t final)
+{
+	qlring_t *ring;
+	isc_uint32_t dropped;
+	isc_uint64_t total = 0;
+	isc_stdtime_t now;
+
+	for (ring = first; ring != NULL; ring = ISC_LIST_NEXT(ring, link)) {
+		dropped = QL_LOAD(&ring->dropped);
+		total += (isc_uint32_t)(dropped - ring->reported);
+		ring->reported = dropped;
+		if (ring == last)
+			break;
+	}
+
+	isc_stdtime_get(&now);
+
+	LOCK(&ql->lock);
+	ql->dropped += total;
+	ql->unreported += total;
+	if (ql->unreported != 0 &&
+	    (final || now >= ql->lastwarn + QL_WARN_INTERVAL))
+	{
+		isc_log_write(ns_lctx, NS_LOGCATEGORY_QUERIES,
+			      NS_LOGMODULE_QUERY, ISC_LOG_WARNING,
+			      "query logging fell behind: "
+			      "%" ISC_PRINT_QUADFORMAT "u entries dropped",
+			      ql->unreported);
+		ql->unreported = 0;
+		ql->lastwarn = now;
+	}
+	UNLOCK(&ql->lock);
+}
+
+static isc_threadresult_t
+writer(isc_threadarg_t arg) {
+	ns_querylog_t *ql = arg;
+	qlring_t *first, *last, *ring;
+	isc_interval_t interval;
+	isc_boolean_t exiting;
+	isc_time_t until;
+	unsigned int n;
+
+	isc_interval_set(&interval, 0, QL_POLL_NS);
+
+	for (;;) {
+		/*
+		 * Rings are only ever appended to the list, so once we
+		 * know its current ends we can walk it without the lock.
+		 */
+		LOCK(&ql->lock);
+		exiting = ql->exiting;
+		first = ISC_LIST_HEAD(ql->rings);
+		last = ISC_LIST_TAIL(ql->rings);
+		UNLOCK(&ql->lock);
+
+		n = 0;
+		for (ring = first; ring != NULL;
+		     ring = ISC_LIST_NEXT(ring, link))
+		{
+			n += drain(ql, ring);
+			if (ring == last)
+				break;
+		}
+		if (ql->fp != NULL)
+			flushout(ql);
+		checkdrops(ql, first, last, exiting);
+
+		LOCK(&ql->lock);
+		ql->written += n;
+		if (ql->exiting && !exiting) {
+			/* One more pass to pick up the last entries. */
+			UNLOCK(&ql->lock);
+			continue;
+		}
+		if (ql->exiting) {
+			UNLOCK(&ql->lock);
+			break;
+		}
+		if (n == 0) {
+			RUNTIME_CHECK(isc_time_nowplusinterval(&until,
+							       &interval)
+				      == ISC_R_SUCCESS);
+			(void)WAITUNTIL(&ql->cond, &ql->lock, &until);
+		}
+		UNLOCK(&ql->lock);
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+isc_result_t
+ns_querylog_create(isc_mem_t *mctx, const char *file,
+		   ns_querylogformat_t format, size_t bufsize,
+		   ns_querylog_t **qlp)
+{
+	ns_querylog_t *ql;
+	isc_result_t result;
+	isc_uint32_t size;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(qlp != NULL && *qlp == NULL);
+
+	result = ql_init();
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	for (size = QL_MINBUFSIZE; size < bufsize && size < QL_MAXBUFSIZE;)
+		size <<= 1;
+
+	ql = isc_mem_get(mctx, sizeof(*ql));
+	if (ql == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(ql, 0, sizeof(*ql));
+	isc_mem_attach(mctx, &ql->mctx);
+	ql->format = format;
+	ql->bufsize = size;
+	ISC_LIST_INIT(ql->rings);
+
+	result = isc_mutex_init(&ql->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_mem;
+	result = isc_condition_init(&ql->cond);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_lock;
+
+	if (file != NULL) {
+		ql->file = isc_mem_strdup(mctx, file);
+		ql->out = isc_mem_get(mctx, QL_OUTBUFSIZE);
+		if (ql->file == NULL || ql->out == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup_file;
+		}
+		result = isc_stdio_open(file, "a", &ql->fp);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup_file;
+	}
+
+	LOCK(&ql_mutex);
+	ql->generation = ++ql_generation;
+	UNLOCK(&ql_mutex);
+
+	ql->magic = QUERYLOG_MAGIC;
+	if (isc_thread_create(writer, ql, &ql->thread) != ISC_R_SUCCESS) {
+		ql->magic = 0;
+		result = ISC_R_UNEXPECTED;
+		goto cleanup_fp;
+	}
+
+	*qlp = ql;
+	return (ISC_R_SUCCESS);
+
+ cleanup_fp:
+	if (ql->fp != NULL)
+		(void)isc_stdio_close(ql->fp);
+ cleanup_file:
+	if (ql->out != NULL)
+		isc_mem_put(mctx, ql->out, QL_OUTBUFSIZE);
+	if (ql->file != NULL)
+		isc_mem_free(mctx, ql->file);
+	(void)isc_condition_destroy(&ql->cond);
+ cleanup_lock:
+	DESTROYLOCK(&ql->lock);
+ cleanup_mem:
+	isc_mem_putanddetach(&ql->mctx, ql, sizeof(*ql));
+	return (result);
+}
+
+void
+ns_querylog_destroy(ns_querylog_t **qlp) {
+	ns_querylog_t *ql;
+	qlring_t *ring;
+
+	REQUIRE(qlp != NULL && VALID_QUERYLOG(*qlp));
+
+	ql = *qlp;
+	*qlp = NULL;
+
+	LOCK(&ql->lock);
+	ql->exiting = ISC_TRUE;
+	SIGNAL(&ql->cond);
+	UNLOCK(&ql->lock);
+	RUNTIME_CHECK(isc_thread_join(ql->thread, NULL) == ISC_R_SUCCESS);
+
+	ql->magic = 0;
+	while ((ring = ISC_LIST_HEAD(ql->rings)) != NULL) {
+		ISC_LIST_UNLINK(ql->rings, ring, link);
+		isc_mem_put(ql->mctx, ring->buf, ring->size);
+		isc_mem_put(ql->mctx, ring, sizeof(*ring));
+	}
+	if (ql->fp != NULL)
+		(void)isc_stdio_close(ql->fp);
+	if (ql->out != NULL)
+		isc_mem_put(ql->mctx, ql->out, QL_OUTBUFSIZE);
+	if (ql->file != NULL)
+		isc_mem_free(ql->mctx, ql->file);
+	(void)isc_condition_destroy(&ql->cond);
+	DESTROYLOCK(&ql->lock);
+	isc_mem_putanddetach(&ql->mctx, ql, sizeof(*ql));
+}
+
+void
+ns_querylog_getcounters(ns_querylog_t *ql, isc_uint64_t *writtenp,
+			isc_uint64_t *droppedp)
+{
+	REQUIRE(VALID_QUERYLOG(ql));
+
+	LOCK(&ql->lock);
+	if (writtenp != NULL)
+		*writtenp = ql->written;
+	if (droppedp != NULL)
+		*droppedp = ql->dropped;
+	UNLOCK(&ql->lock);
+}
+
+#else /* QL_ENABLED */
+
+isc_result_t
+ns_querylog_create(isc_mem_t *mctx, const char *file,
+		   ns_querylogformat_t format, size_t bufsize,
+		   ns_querylog_t **qlp)
+{
+	REQUIRE(mctx != NULL);
+	REQUIRE(qlp != NULL && *qlp == NULL);
+
+	UNUSED(file);
+	UNUSED(format);
+	UNUSED(bufsize);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+void
+ns_querylog_destroy(ns_querylog_t **qlp) {
+	REQUIRE(qlp != NULL && *qlp == NULL);
+}
+
+void
+ns_querylog_write(ns_querylog_t *ql, const ns_querylogentry_t *entry) {
+	UNUSED(entry);
+
+	REQUIRE(ql != NULL);
+}
+
+void
+ns_querylog_getcounters(ns_querylog_t *ql, isc_uint64_t *writtenp,
+			isc_uint64_t *droppedp)
+{
+	UNUSED(writtenp);
+	UNUSED(droppedp);
+
+	REQUIRE(ql != NULL);
+}
+
+#endif /* QL_ENABLED */
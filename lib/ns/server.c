@@ -20,6 +20,7 @@
 #include <dns/tkey.h>
 #include <dns/stats.h>
 
+#include <ns/querylog.h>
 #include <ns/server.h>
 #include <ns/stats.h>
 
@@ -52,6 +53,9 @@ ns_server_create(isc_mem_t *mctx, isc_entropy_t *entropy,
 	if (result != ISC_R_SUCCESS)
 		goto cleanup;
 
+	CHECKFATAL(isc_mutex_init(&sctx->xfrcachelock));
+	ISC_LIST_INIT(sctx->xfrcaches);
+
 	CHECKFATAL(isc_quota_init(&sctx->xfroutquota, 10));
 	CHECKFATAL(isc_quota_init(&sctx->tcpquota, 10));
 	CHECKFATAL(isc_quota_init(&sctx->recursionquota, 100));
@@ -98,6 +102,8 @@ ns_server_create(isc_mem_t *mctx, isc_entropy_t *entropy,
 
 	sctx->udpsize = 4096;
 	sctx->transfer_tcp_message_size = 20480;
+	sctx->transfer_render_threads = 0;
+	sctx->transfer_render_maxsize = ISC_UINT64_MAX;
 
 	sctx->fuzztype = isc_fuzz_none;
 	sctx->fuzznotify = NULL;
@@ -148,6 +154,9 @@ ns_server_detach(ns_server_t **sctxp) {
 			isc_mem_put(sctx->mctx, altsecret, sizeof(*altsecret));
 		}
 
+		INSIST(ISC_LIST_EMPTY(sctx->xfrcaches));
+		DESTROYLOCK(&sctx->xfrcachelock);
+
 		isc_quota_destroy(&sctx->recursionquota);
 		isc_quota_destroy(&sctx->tcpquota);
 		isc_quota_destroy(&sctx->xfroutquota);
@@ -155,6 +164,9 @@ ns_server_detach(ns_server_t **sctxp) {
 		if (sctx->server_id != NULL)
 			isc_mem_free(sctx->mctx, sctx->server_id);
 
+		if (sctx->querylog != NULL)
+			ns_querylog_destroy(&sctx->querylog);
+
 		if (sctx->blackholeacl != NULL)
 			dns_acl_detach(&sctx->blackholeacl);
 		if (sctx->keepresporder != NULL)
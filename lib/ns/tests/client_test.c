@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <isc/print.h>
+#include <isc/sockaddr.h>
+#include <isc/util.h>
+
+#include <dns/rcode.h>
+
+#include <ns/client.h>
+#include <ns/interfacemgr.h>
+
+#include "nstest.h"
+
+/* "www.example. IN A" with ID 0x1234 */
+static unsigned char query[] = {
+	0x12, 0x34, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x03, 'w', 'w', 'w',
+	0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+	0x00, 0x00, 0x01, 0x00, 0x01
+};
+
+static volatile isc_boolean_t done;
+static unsigned char response[512];
+static unsigned int responselen;
+
+static void
+injectdone(void *arg, isc_region_t *r) {
+	UNUSED(arg);
+
+	if (r != NULL && r->length <= sizeof(response)) {
+		memmove(response, r->base, r->length);
+		responselen = r->length;
+	}
+	done = ISC_TRUE;
+}
+
+static ns_interface_t *
+getif(void) {
+	ns_interface_t *ifp;
+
+	ifp = ns__interfacemgr_getif(interfacemgr);
+	ATF_REQUIRE(ifp != NULL);
+	ATF_REQUIRE(ifp->clientmgr != NULL);
+	return (ifp);
+}
+
+ATF_TC(inject);
+ATF_TC_HEAD(inject, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "an injected request gets its response");
+}
+ATF_TC_BODY(inject, tc) {
+	isc_result_t result;
+	ns_interface_t *ifp;
+	isc_sockaddr_t peer;
+	struct in_addr in;
+	isc_region_t r;
+	int i;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ifp = getif();
+	in.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&peer, &in, 53000);
+	r.base = query;
+	r.length = sizeof(query);
+
+	done = ISC_FALSE;
+	responselen = 0;
+	result = ns__client_inject(ifp->clientmgr, ifp, &peer, &r,
+				   injectdone, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 50 && !done; i++)
+		ns_test_nap(100000);
+	ATF_REQUIRE(done);
+
+	/*
+	 * The test server matches no view, so the query is refused.
+	 */
+	ATF_REQUIRE(responselen >= 12);
+	ATF_CHECK_EQ(response[0], 0x12);
+	ATF_CHECK_EQ(response[1], 0x34);
+	ATF_CHECK((response[2] & 0x80) != 0);
+	ATF_CHECK_EQ(response[3] & 0x0f, dns_rcode_refused);
+
+	ns_test_end();
+}
+
+ATF_TC(inject_toobig);
+ATF_TC_HEAD(inject_toobig, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "a request too big for UDP is not injected");
+}
+ATF_TC_BODY(inject_toobig, tc) {
+	static unsigned char big[8192];
+	isc_result_t result;
+	ns_interface_t *ifp;
+	isc_sockaddr_t peer;
+	struct in_addr in;
+	isc_region_t r;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ifp = getif();
+	in.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&peer, &in, 53000);
+	memmove(big, query, sizeof(query));
+	r.base = big;
+	r.length = sizeof(big);
+
+	done = ISC_FALSE;
+	result = ns__client_inject(ifp->clientmgr, ifp, &peer, &r,
+				   injectdone, NULL);
+	ATF_CHECK_EQ(result, ISC_R_RANGE);
+	ATF_CHECK(!done);
+
+	ns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, inject);
+	ATF_TP_ADD_TC(tp, inject_toobig);
+	return (atf_no_error());
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <isc/netaddr.h>
+#include <isc/print.h>
+#include <isc/sockaddr.h>
+#include <isc/util.h>
+
+#include <dns/ecs.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+
+#include <ns/querylog.h>
+
+#include "nstest.h"
+
+#define LOGFILE "querylog.out"
+
+static int client;		/* only its address is logged */
+
+static void
+setup_entry(ns_querylogentry_t *entry, isc_sockaddr_t *peer,
+	    isc_netaddr_t *dest, dns_name_t *qname)
+{
+	struct in_addr in4;
+	isc_result_t result;
+
+	in4.s_addr = htonl(0xc0000201);		/* 192.0.2.1 */
+	isc_sockaddr_fromin(peer, &in4, 5300);
+	in4.s_addr = htonl(0xc0000235);		/* 192.0.2.53 */
+	isc_netaddr_fromin(dest, &in4);
+	result = dns_name_fromstring(qname, "www.example.", 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	memset(entry, 0, sizeof(*entry));
+	entry->client = &client;
+	entry->peer = peer;
+	entry->dest = dest;
+	entry->qname = qname;
+	entry->qtype = dns_rdatatype_a;
+	entry->qclass = dns_rdataclass_in;
+	entry->ednsversion = -1;
+}
+
+/*
+ * Read the next line of the log file into 'buf', without the newline.
+ */
+static isc_boolean_t
+readline(FILE *fp, char *buf, size_t size) {
+	size_t len;
+
+	if (fgets(buf, (int)size, fp) == NULL)
+		return (ISC_FALSE);
+	len = strlen(buf);
+	if (len > 0 && buf[len - 1] == '\n')
+		buf[len - 1] = '\0';
+	return (ISC_TRUE);
+}
+
+ATF_TC(text);
+ATF_TC_HEAD(text, tc) {
+	atf_tc_set_md_var(tc, "descr", "entries are written in the same "
+				       "format as synchronous query logging");
+}
+ATF_TC_BODY(text, tc) {
+	ns_querylog_t *ql = NULL;
+	ns_querylogentry_t entry;
+	isc_sockaddr_t peer;
+	isc_netaddr_t dest;
+	dns_fixedname_t fqname, fsigner;
+	dns_name_t *qname, *signer;
+	dns_ecs_t ecs;
+	isc_uint64_t written, dropped;
+	isc_result_t result;
+	char line[1024], expect[1024];
+	const char *p;
+	FILE *fp;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	(void)unlink(LOGFILE);
+	result = ns_querylog_create(mctx, LOGFILE, ns_querylogformat_text,
+				    0, &ql);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		ns_test_end();
+		atf_tc_skip("asynchronous query logging not supported");
+	}
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_fixedname_init(&fqname);
+	qname = dns_fixedname_name(&fqname);
+	dns_fixedname_init(&fsigner);
+	signer = dns_fixedname_name(&fsigner);
+	setup_entry(&entry, &peer, &dest, qname);
+	entry.flags = NS_QUERYLOG_RECURSE;
+	ns_querylog_write(ql, &entry);
+
+	result = dns_name_fromstring(signer, "key.example.", 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_ecs_init(&ecs);
+	isc_netaddr_fromin(&ecs.addr, &dest.type.in);
+	ecs.source = 24;
+	entry.peer = NULL;
+	entry.signer = signer;
+	entry.view = "internal";
+	entry.ecs = &ecs;
+	entry.qtype = dns_rdatatype_aaaa;
+	entry.ednsversion = 0;
+	entry.flags = NS_QUERYLOG_SIGNED | NS_QUERYLOG_TCP |
+		      NS_QUERYLOG_DO | NS_QUERYLOG_CD | NS_QUERYLOG_COOKIE;
+	ns_querylog_write(ql, &entry);
+
+	ns_querylog_getcounters(ql, &written, &dropped);
+	ATF_CHECK(written <= 2);
+	ns_querylog_destroy(&ql);
+	ATF_CHECK_EQ(ql, NULL);
+
+	fp = fopen(LOGFILE, "r");
+	ATF_REQUIRE(fp != NULL);
+
+	/* Each line starts with a time stamp; skip it. */
+	ATF_REQUIRE(readline(fp, line, sizeof(line)));
+	p = strstr(line, " client @");
+	ATF_REQUIRE(p != NULL);
+	snprintf(expect, sizeof(expect), " client @%p 192.0.2.1#5300 "
+		 "(www.example): query: www.example IN A + (192.0.2.53)",
+		 &client);
+	ATF_CHECK_STREQ(p, expect);
+
+	ATF_REQUIRE(readline(fp, line, sizeof(line)));
+	p = strstr(line, " client @");
+	ATF_REQUIRE(p != NULL);
+	snprintf(expect, sizeof(expect), " client @%p (no-peer)/key "
+		 "key.example (www.example): view internal: query: "
+		 "www.example IN AAAA -SE(0)TDCV (192.0.2.53) "
+		 "[ECS 192.0.2.53/24/0]", &client);
+	ATF_CHECK_STREQ(p, expect);
+
+	ATF_CHECK(!readline(fp, line, sizeof(line)));
+	fclose(fp);
+	(void)unlink(LOGFILE);
+
+	ns_test_end();
+}
+
+ATF_TC(compact);
+ATF_TC_HEAD(compact, tc) {
+	atf_tc_set_md_var(tc, "descr", "entries are written in the "
+				       "compact format");
+}
+ATF_TC_BODY(compact, tc) {
+	ns_querylog_t *ql = NULL;
+	ns_querylogentry_t entry;
+	isc_sockaddr_t peer;
+	isc_netaddr_t dest;
+	dns_fixedname_t fqname;
+	dns_name_t *qname;
+	isc_result_t result;
+	unsigned int seconds, msecs;
+	char line[1024], rest[1024];
+	FILE *fp;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	(void)unlink(LOGFILE);
+	result = ns_querylog_create(mctx, LOGFILE, ns_querylogformat_compact,
+				    0, &ql);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		ns_test_end();
+		atf_tc_skip("asynchronous query logging not supported");
+	}
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_fixedname_init(&fqname);
+	qname = dns_fixedname_name(&fqname);
+	setup_entry(&entry, &peer, &dest, qname);
+	entry.view = "external";
+	entry.ednsversion = 0;
+	entry.flags = NS_QUERYLOG_RECURSE | NS_QUERYLOG_WANTCOOKIE;
+	ns_querylog_write(ql, &entry);
+	ns_querylog_destroy(&ql);
+
+	fp = fopen(LOGFILE, "r");
+	ATF_REQUIRE(fp != NULL);
+	ATF_REQUIRE(readline(fp, line, sizeof(line)));
+	ATF_REQUIRE_EQ(sscanf(line, "%u.%u %1023[^\n]",
+			      &seconds, &msecs, rest), 3);
+	ATF_CHECK(seconds > 0);
+	ATF_CHECK(msecs < 1000);
+	ATF_CHECK_STREQ(rest, "192.0.2.1#5300 www.example IN A +E(0)K "
+			      "192.0.2.53 view external");
+	ATF_CHECK(!readline(fp, line, sizeof(line)));
+	fclose(fp);
+	(void)unlink(LOGFILE);
+
+	ns_test_end();
+}
+
+ATF_TC(dropped);
+ATF_TC_HEAD(dropped, tc) {
+	atf_tc_set_md_var(tc, "descr", "entries that do not fit in the "
+				       "buffer are counted, not waited for");
+}
+ATF_TC_BODY(dropped, tc) {
+	ns_querylog_t *ql = NULL;
+	ns_querylogentry_t entry;
+	isc_sockaddr_t peer;
+	isc_netaddr_t dest;
+	dns_fixedname_t fqname;
+	dns_name_t *qname;
+	isc_uint64_t written, dropped;
+	isc_result_t result;
+	unsigned int i, lines = 0;
+	char line[1024];
+	FILE *fp;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	(void)unlink(LOGFILE);
+	result = ns_querylog_create(mctx, LOGFILE, ns_querylogformat_compact,
+				    1, &ql);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		ns_test_end();
+		atf_tc_skip("asynchronous query logging not supported");
+	}
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/*
+	 * A 1 byte buffer is rounded up to the minimum, which is far
+	 * too small to hold this many entries at once.  Whatever does
+	 * not fit is dropped, and every entry is accounted for once
+	 * the writer has caught up.
+	 */
+	dns_fixedname_init(&fqname);
+	qname = dns_fixedname_name(&fqname);
+	setup_entry(&entry, &peer, &dest, qname);
+	for (i = 0; i < 10000; i++)
+		ns_querylog_write(ql, &entry);
+	do {
+		ns_test_nap(10000);
+		ns_querylog_getcounters(ql, &written, &dropped);
+	} while (written + dropped < 10000);
+	ATF_CHECK_EQ(written + dropped, 10000);
+	ns_querylog_destroy(&ql);
+
+	fp = fopen(LOGFILE, "r");
+	ATF_REQUIRE(fp != NULL);
+	while (readline(fp, line, sizeof(line)))
+		lines++;
+	fclose(fp);
+	(void)unlink(LOGFILE);
+
+	ATF_CHECK(lines > 0);
+	ATF_CHECK_EQ(lines, written);
+
+	ns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, text);
+	ATF_TP_ADD_TC(tp, compact);
+	ATF_TP_ADD_TC(tp, dropped);
+
+	return (atf_no_error());
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <isc/region.h>
+#include <isc/util.h>
+
+#include <ns/tls.h>
+
+#include "nstest.h"
+
+#define KEYFILE		"testdata/tls/key.pem"
+#define CERTFILE	"testdata/tls/cert.pem"
+
+#ifdef HAVE_OPENSSL_SSL
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+/*
+ * A client talking to a server session through memory, as the socket
+ * code would carry the bytes between them.
+ */
+typedef struct {
+	SSL *		ssl;
+	BIO *		rbio;		/* to the client */
+	BIO *		wbio;		/* from the client */
+	ns_tls_t *	tls;
+	unsigned char	srvbuf[1024];	/* decrypted by the server */
+	unsigned int	srvlen;
+	isc_result_t	srvresult;	/* of the last ns_tls_read() */
+	unsigned char	clibuf[1024];	/* decrypted by the client */
+	unsigned int	clilen;
+} conn_t;
+
+static void
+conn_init(conn_t *conn, SSL_CTX *clictx, ns_tlsctx_t *tlsctx,
+	  SSL_SESSION *session)
+{
+	isc_result_t result;
+
+	memset(conn, 0, sizeof(*conn));
+	conn->ssl = SSL_new(clictx);
+	ATF_REQUIRE(conn->ssl != NULL);
+	conn->rbio = BIO_new(BIO_s_mem());
+	conn->wbio = BIO_new(BIO_s_mem());
+	ATF_REQUIRE(conn->rbio != NULL && conn->wbio != NULL);
+	SSL_set_bio(conn->ssl, conn->rbio, conn->wbio);
+	SSL_set_connect_state(conn->ssl);
+	if (session != NULL)
+		ATF_REQUIRE_EQ(SSL_set_session(conn->ssl, session), 1);
+
+	result = ns_tls_create(mctx, tlsctx, &conn->tls);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	conn->srvresult = ISC_R_WOULDBLOCK;
+}
+
+static void
+conn_free(conn_t *conn) {
+	ns_tls_destroy(&conn->tls);
+	SSL_free(conn->ssl);
+}
+
+/*
+ * Carry bytes back and forth until neither side has more to say,
+ * collecting what each side decrypts.
+ */
+static void
+conn_pump(conn_t *conn) {
+	unsigned char buf[4096];
+	isc_region_t r;
+	unsigned int n;
+	int i, len;
+
+	for (i = 0; i < 8; i++) {
+		if (!SSL_is_init_finished(conn->ssl))
+			(void)SSL_do_handshake(conn->ssl);
+
+		while ((len = BIO_read(conn->wbio, buf, sizeof(buf))) > 0) {
+			r.base = buf;
+			r.length = len;
+			ATF_REQUIRE_EQ(ns_tls_input(conn->tls, &r),
+				       ISC_R_SUCCESS);
+		}
+
+		while (conn->srvlen < sizeof(conn->srvbuf)) {
+			conn->srvresult =
+				ns_tls_read(conn->tls,
+					    conn->srvbuf + conn->srvlen,
+					    sizeof(conn->srvbuf) -
+					    conn->srvlen, &n);
+			if (conn->srvresult != ISC_R_SUCCESS)
+				break;
+			conn->srvlen += n;
+		}
+
+		while ((n = ns_tls_output(conn->tls, buf, sizeof(buf))) > 0)
+			ATF_REQUIRE_EQ(BIO_write(conn->rbio, buf, n), (int)n);
+
+		while (conn->clilen < sizeof(conn->clibuf)) {
+			len = SSL_read(conn->ssl, conn->clibuf + conn->clilen,
+				       sizeof(conn->clibuf) - conn->clilen);
+			if (len <= 0)
+				break;
+			conn->clilen += len;
+		}
+		ERR_clear_error();
+	}
+}
+
+static SSL_CTX *
+client_ctx(void) {
+	SSL_CTX *ctx;
+
+	ctx = SSL_CTX_new(TLS_client_method());
+	ATF_REQUIRE(ctx != NULL);
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+	return (ctx);
+}
+
+/*
+ * Two pipelined messages, as DNS over TCP frames them.
+ */
+static const unsigned char queries[] = {
+	0, 3, 'o', 'n', 'e',
+	0, 5, 't', 'h', 'r', 'e', 'e'
+};
+static const unsigned char response[] = { 0, 2, 'o', 'k' };
+
+/*
+ * Run one exchange of 'queries' and 'response' on 'conn'.
+ */
+static void
+exchange(conn_t *conn) {
+	isc_region_t r;
+
+	conn_pump(conn);
+	ATF_REQUIRE(SSL_is_init_finished(conn->ssl));
+	ATF_REQUIRE(ns_tls_handshakedone(conn->tls));
+	ATF_CHECK_EQ(conn->srvresult, ISC_R_WOULDBLOCK);
+
+	ATF_REQUIRE_EQ(SSL_write(conn->ssl, queries, sizeof(queries)),
+		       (int)sizeof(queries));
+	conn_pump(conn);
+	ATF_REQUIRE_EQ(conn->srvlen, sizeof(queries));
+	ATF_CHECK(memcmp(conn->srvbuf, queries, sizeof(queries)) == 0);
+
+	DE_CONST(response, r.base);
+	r.length = sizeof(response);
+	ATF_REQUIRE_EQ(ns_tls_write(conn->tls, &r), ISC_R_SUCCESS);
+	ATF_CHECK(ns_tls_pending(conn->tls) > sizeof(response));
+	conn_pump(conn);
+	ATF_REQUIRE_EQ(conn->clilen, sizeof(response));
+	ATF_CHECK(memcmp(conn->clibuf, response, sizeof(response)) == 0);
+}
+
+ATF_TC(badfiles);
+ATF_TC_HEAD(badfiles, tc) {
+	atf_tc_set_md_var(tc, "descr", "a missing or mismatched key "
+			  "or certificate is rejected");
+}
+ATF_TC_BODY(badfiles, tc) {
+	ns_tlsctx_t *tlsctx = NULL;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = ns_tlsctx_create(mctx, KEYFILE, "testdata/tls/missing.pem",
+				  ISC_TRUE, &tlsctx);
+	ATF_CHECK_EQ(result, ISC_R_FAILURE);
+	ATF_CHECK(tlsctx == NULL);
+
+	result = ns_tlsctx_create(mctx, "testdata/tls/missing.pem", CERTFILE,
+				  ISC_TRUE, &tlsctx);
+	ATF_CHECK_EQ(result, ISC_R_FAILURE);
+	ATF_CHECK(tlsctx == NULL);
+
+	/* A certificate is not a key. */
+	result = ns_tlsctx_create(mctx, CERTFILE, CERTFILE, ISC_TRUE, &tlsctx);
+	ATF_CHECK_EQ(result, ISC_R_FAILURE);
+	ATF_CHECK(tlsctx == NULL);
+
+	ns_test_end();
+}
+
+ATF_TC(pipelined);
+ATF_TC_HEAD(pipelined, tc) {
+	atf_tc_set_md_var(tc, "descr", "pipelined messages are decrypted "
+			  "in order and a response reaches the client");
+}
+ATF_TC_BODY(pipelined, tc) {
+	ns_tlsctx_t *tlsctx = NULL;
+	SSL_CTX *clictx;
+	conn_t conn;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = ns_tlsctx_create(mctx, KEYFILE, CERTFILE, ISC_TRUE, &tlsctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	clictx = client_ctx();
+
+	conn_init(&conn, clictx, tlsctx, NULL);
+	/* The session keeps its own reference to the context. */
+	ns_tlsctx_detach(&tlsctx);
+
+	exchange(&conn);
+	ATF_CHECK(!ns_tls_resumed(conn.tls));
+
+	/* The client closes the session. */
+	ATF_REQUIRE(SSL_shutdown(conn.ssl) >= 0);
+	conn_pump(&conn);
+	ATF_CHECK_EQ(conn.srvresult, ISC_R_EOF);
+
+	conn_free(&conn);
+	SSL_CTX_free(clictx);
+	ns_test_end();
+}
+
+ATF_TC(garbage);
+ATF_TC_HEAD(garbage, tc) {
+	atf_tc_set_md_var(tc, "descr", "a client that does not speak TLS "
+			  "fails the handshake");
+}
+ATF_TC_BODY(garbage, tc) {
+	ns_tlsctx_t *tlsctx = NULL;
+	ns_tls_t *tls = NULL;
+	unsigned char buf[64];
+	unsigned int n;
+	isc_region_t r;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = ns_tlsctx_create(mctx, KEYFILE, CERTFILE, ISC_TRUE, &tlsctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = ns_tls_create(mctx, tlsctx, &tls);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* A plain DNS query sent to the TLS port. */
+	DE_CONST(queries, r.base);
+	r.length = sizeof(queries);
+	ATF_REQUIRE_EQ(ns_tls_input(tls, &r), ISC_R_SUCCESS);
+	result = ns_tls_read(tls, buf, sizeof(buf), &n);
+	ATF_CHECK_EQ(result, ISC_R_FAILURE);
+	ATF_CHECK(!ns_tls_handshakedone(tls));
+	ATF_CHECK(strcmp(ns_tls_error(tls), "unknown error") != 0);
+
+	ns_tls_destroy(&tls);
+	ns_tlsctx_detach(&tlsctx);
+	ns_test_end();
+}
+
+/*
+ * Connect, get a session from the server, and connect again with it.
+ */
+static void
+resume(isc_boolean_t tickets) {
+	ns_tlsctx_t *tlsctx = NULL;
+	SSL_CTX *clictx;
+	SSL_SESSION *session;
+	conn_t conn;
+	isc_result_t result;
+
+	result = ns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = ns_tlsctx_create(mctx, KEYFILE, CERTFILE, tickets, &tlsctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	clictx = client_ctx();
+
+	conn_init(&conn, clictx, tlsctx, NULL);
+	exchange(&conn);
+	ATF_CHECK(!ns_tls_resumed(conn.tls));
+	session = SSL_get1_session(conn.ssl);
+	ATF_REQUIRE(session != NULL);
+	/*
+	 * The client closes the session, but the server only sees the
+	 * connection go away.
+	 */
+	ATF_REQUIRE(SSL_shutdown(conn.ssl) >= 0);
+	conn_free(&conn);
+
+	conn_init(&conn, clictx, tlsctx, session);
+	exchange(&conn);
+	ATF_CHECK(ns_tls_resumed(conn.tls));
+	ATF_CHECK(SSL_session_reused(conn.ssl));
+	conn_free(&conn);
+
+	SSL_SESSION_free(session);
+	SSL_CTX_free(clictx);
+	ns_tlsctx_detach(&tlsctx);
+	ns_test_end();
+}
+
+ATF_TC(resume_tickets);
+ATF_TC_HEAD(resume_tickets, tc) {
+	atf_tc_set_md_var(tc, "descr", "a session is resumed with a ticket");
+}
+ATF_TC_BODY(resume_tickets, tc) {
+	UNUSED(tc);
+
+	resume(ISC_TRUE);
+}
+
+ATF_TC(resume_cache);
+ATF_TC_HEAD(resume_cache, tc) {
+	atf_tc_set_md_var(tc, "descr", "a session is resumed from the "
+			  "server's cache when tickets are disabled");
+}
+ATF_TC_BODY(resume_cache, tc) {
+	UNUSED(tc);
+
+	resume(ISC_FALSE);
+}
+
+#else /* HAVE_OPENSSL_SSL */
+
+ATF_TC(notimplemented);
+ATF_TC_HEAD(notimplemented, tc) {
+	atf_tc_set_md_var(tc, "descr", "TLS contexts cannot be created "
+			  "without OpenSSL's TLS library");
+}
+ATF_TC_BODY(notimplemented, tc) {
+	ns_tlsctx_t *tlsctx = NULL;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = ns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = ns_tlsctx_create(mctx, KEYFILE, CERTFILE, ISC_TRUE, &tlsctx);
+	ATF_CHECK_EQ(result, ISC_R_NOTIMPLEMENTED);
+	ATF_CHECK(tlsctx == NULL);
+
+	ns_test_end();
+}
+
+#endif /* HAVE_OPENSSL_SSL */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+#ifdef HAVE_OPENSSL_SSL
+	ATF_TP_ADD_TC(tp, badfiles);
+	ATF_TP_ADD_TC(tp, pipelined);
+	ATF_TP_ADD_TC(tp, garbage);
+	ATF_TP_ADD_TC(tp, resume_tickets);
+	ATF_TP_ADD_TC(tp, resume_cache);
+#else
+	ATF_TP_ADD_TC(tp, notimplemented);
+#endif
+	return (atf_no_error());
+}
@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/refcount.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <ns/log.h>
+#include <ns/tls.h>
+
+#ifdef HAVE_OPENSSL_SSL
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#define TLSCTX_MAGIC		ISC_MAGIC('N', 'S', 'T', 'c')
+#define VALID_TLSCTX(c)		ISC_MAGIC_VALID(c, TLSCTX_MAGIC)
+
+#define TLS_MAGIC		ISC_MAGIC('N', 'S', 'T', 's')
+#define VALID_TLS(t)		ISC_MAGIC_VALID(t, TLS_MAGIC)
+
+struct ns_tlsctx {
+	unsigned int		magic;
+	isc_mem_t *		mctx;
+	isc_refcount_t		references;
+	SSL_CTX *		ctx;
+};
+
+/*
+ * The session reads from and writes to memory BIOs: 'rbio' holds what
+ * has been received and not yet decrypted, 'wbio' what OpenSSL has
+ * produced and the connection has not yet sent.
+ */
+struct ns_tls {
+	unsigned int		magic;
+	isc_mem_t *		mctx;
+	SSL *			ssl;
+	BIO *			rbio;
+	BIO *			wbio;
+	unsigned long		error;	/*%< Last OpenSSL error */
+};
+
+/*% Identifies our sessions in the server's session cache. */
+static const unsigned char sid_ctx[] = "named";
+
+static void
+log_sslerror(const char *what, const char *file) {
+	char buf[256];
+	unsigned long err;
+
+	err = ERR_get_error();
+	if (err != 0)
+		ERR_error_string_n(err, buf, sizeof(buf));
+	else
+		strlcpy(buf, "unknown error", sizeof(buf));
+	ERR_clear_error();
+
+	isc_log_write(ns_lctx, NS_LOGCATEGORY_NETWORK,
+		      NS_LOGMODULE_INTERFACEMGR, ISC_LOG_ERROR,
+		      "TLS: %s '%s': %s", what, file, buf);
+}
+
+isc_result_t
+ns_tlsctx_create(isc_mem_t *mctx, const char *keyfile, const char *certfile,
+		 isc_boolean_t tickets, ns_tlsctx_t **ctxp)
+{
+	ns_tlsctx_t *tlsctx;
+	SSL_CTX *ctx;
+	long options;
+	isc_result_t result;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(keyfile != NULL && certfile != NULL);
+	REQUIRE(ctxp != NULL && *ctxp == NULL);
+
+	ERR_clear_error();
+
+	ctx = SSL_CTX_new(TLS_server_method());
+	if (ctx == NULL) {
+		ERR_clear_error();
+		return (ISC_R_NOMEMORY);
+	}
+
+	/*
+	 * RFC 8310 requires TLS 1.2 or later.  Renegotiation and
+	 * compression have no use here and have a history of problems.
+	 */
+	(void)SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+	options = SSL_OP_NO_COMPRESSION | SSL_OP_CIPHER_SERVER_PREFERENCE;
+#ifdef SSL_OP_NO_RENEGOTIATION
+	options |= SSL_OP_NO_RENEGOTIATION;
+#endif
+	if (!tickets)
+		options |= SSL_OP_NO_TICKET;
+	(void)SSL_CTX_set_options(ctx, options);
+
+	/*
+	 * Let idle connections give their read and write buffers back.
+	 */
+	(void)SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+	/*
+	 * Keep sessions in the server's cache so that clients can resume
+	 * them, and, unless disabled above, also issue tickets that let
+	 * them resume without the cache.  One TLS 1.3 ticket per
+	 * handshake is enough for a client that keeps its connection
+	 * open.
+	 */
+	(void)SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	(void)SSL_CTX_set_session_id_context(ctx, sid_ctx,
+					     sizeof(sid_ctx) - 1);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	(void)SSL_CTX_set_num_tickets(ctx, 1);
+#endif
+
+	if (SSL_CTX_use_certificate_chain_file(ctx, certfile) != 1) {
+		log_sslerror("loading certificate", certfile);
+		result = ISC_R_FAILURE;
+		goto cleanup;
+	}
+	if (SSL_CTX_use_PrivateKey_file(ctx, keyfile, SSL_FILETYPE_PEM) != 1) {
+		log_sslerror("loading key", keyfile);
+		result = ISC_R_FAILURE;
+		goto cleanup;
+	}
+	if (SSL_CTX_check_private_key(ctx) != 1) {
+		log_sslerror("checking key", keyfile);
+		result = ISC_R_FAILURE;
+		goto cleanup;
+	}
+
+	tlsctx = isc_mem_get(mctx, sizeof(*tlsctx));
+	if (tlsctx == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup;
+	}
+	result = isc_refcount_init(&tlsctx->references, 1);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(mctx, tlsctx, sizeof(*tlsctx));
+		goto cleanup;
+	}
+	tlsctx->mctx = NULL;
+	isc_mem_attach(mctx, &tlsctx->mctx);
+	tlsctx->ctx = ctx;
+	tlsctx->magic = TLSCTX_MAGIC;
+
+	*ctxp = tlsctx;
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	SSL_CTX_free(ctx);
+	return (result);
+}
+
+void
+ns_tlsctx_attach(ns_tlsctx_t *source, ns_tlsctx_t **targetp) {
+	REQUIRE(VALID_TLSCTX(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&source->references, NULL);
+
+	*targetp = source;
+}
+
+void
+ns_tlsctx_detach(ns_tlsctx_t **ctxp) {
+	ns_tlsctx_t *tlsctx;
+	unsigned int refs;
+
+	REQUIRE(ctxp != NULL);
+	tlsctx = *ctxp;
+	REQUIRE(VALID_TLSCTX(tlsctx));
+
+	*ctxp = NULL;
+
+	isc_refcount_decrement(&tlsctx->references, &refs);
+	if (refs > 0)
+		return;
+
+	tlsctx->magic = 0;
+	isc_refcount_destroy(&tlsctx->references);
+	SSL_CTX_free(tlsctx->ctx);
+	isc_mem_putanddetach(&tlsctx->mctx, tlsctx, sizeof(*tlsctx));
+}
+
+isc_result_t
+ns_tls_create(isc_mem_t *mctx, ns_tlsctx_t *ctx, ns_tls_t **tlsp) {
+	ns_tls_t *tls;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(VALID_TLSCTX(ctx));
+	REQUIRE(tlsp != NULL && *tlsp == NULL);
+
+	tls = isc_mem_get(mctx, sizeof(*tls));
+	if (tls == NULL)
+		return (ISC_R_NOMEMORY);
+
+	tls->ssl = SSL_new(ctx->ctx);
+	tls->rbio = BIO_new(BIO_s_mem());
+	tls->wbio = BIO_new(BIO_s_mem());
+	if (tls->ssl == NULL || tls->rbio == NULL || tls->wbio == NULL) {
+		if (tls->ssl != NULL)
+			SSL_free(tls->ssl);
+		if (tls->rbio != NULL)
+			BIO_free(tls->rbio);
+		if (tls->wbio != NULL)
+			BIO_free(tls->wbio);
+		ERR_clear_error();
+		isc_mem_put(mctx, tls, sizeof(*tls));
+		return (ISC_R_NOMEMORY);
+	}
+
+	/* The session owns the BIOs from now on. */
+	SSL_set_bio(tls->ssl, tls->rbio, tls->wbio);
+	SSL_set_accept_state(tls->ssl);
+
+	tls->mctx = NULL;
+	isc_mem_attach(mctx, &tls->mctx);
+	tls->error = 0;
+	tls->magic = TLS_MAGIC;
+
+	*tlsp = tls;
+	return (ISC_R_SUCCESS);
+}
+
+void
+ns_tls_destroy(ns_tls_t **tlsp) {
+	ns_tls_t *tls;
+
+	REQUIRE(tlsp != NULL && VALID_TLS(*tlsp));
+
+	tls = *tlsp;
+	*tlsp = NULL;
+
+	/*
+	 * Clients that are done usually just close the connection.
+	 * Unless the session failed, keep it resumable rather than
+	 * letting OpenSSL drop it from the cache as a broken one.
+	 */
+	if (tls->error == 0)
+		SSL_set_shutdown(tls->ssl, SSL_SENT_SHUTDOWN);
+
+	tls->magic = 0;
+	SSL_free(tls->ssl);
+	isc_mem_putanddetach(&tls->mctx, tls, sizeof(*tls));
+}
+
+isc_result_t
+ns_tls_input(ns_tls_t *tls, const isc_region_t *r) {
+	REQUIRE(VALID_TLS(tls));
+	REQUIRE(r != NULL && r->length > 0);
+
+	if (BIO_write(tls->rbio, r->base, (int)r->length) != (int)r->length) {
+		ERR_clear_error();
+		return (ISC_R_NOMEMORY);
+	}
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Translate the outcome of an SSL_read() or SSL_write() that
+ * returned 'n' <= 0.
+ */
+static isc_result_t
+sslresult(ns_tls_t *tls, int n) {
+	switch (SSL_get_error(tls->ssl, n)) {
+	case SSL_ERROR_WANT_READ:
+		return (ISC_R_WOULDBLOCK);
+	case SSL_ERROR_ZERO_RETURN:
+		return (ISC_R_EOF);
+	default:
+		tls->error = ERR_get_error();
+		ERR_clear_error();
+		return (ISC_R_FAILURE);
+	}
+}
+
+isc_result_t
+ns_tls_read(ns_tls_t *tls, unsigned char *buf, unsigned int len,
+	    unsigned int *nreadp)
+{
+	int n;
+
+	REQUIRE(VALID_TLS(tls));
+	REQUIRE(buf != NULL && len > 0);
+	REQUIRE(nreadp != NULL);
+
+	ERR_clear_error();
+	n = SSL_read(tls->ssl, buf, (int)len);
+	if (n <= 0)
+		return (sslresult(tls, n));
+
+	*nreadp = (unsigned int)n;
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+ns_tls_write(ns_tls_t *tls, const isc_region_t *r) {
+	int n;
+
+	REQUIRE(VALID_TLS(tls));
+	REQUIRE(r != NULL && r->length > 0);
+	REQUIRE(SSL_is_init_finished(tls->ssl));
+
+	/*
+	 * Writing to a memory BIO never has to wait, so the whole
+	 * region is taken or the session has failed.
+	 */
+	ERR_clear_error();
+	n = SSL_write(tls->ssl, r->base, (int)r->length);
+	if (n <= 0) {
+		(void)sslresult(tls, n);
+		return (ISC_R_FAILURE);
+	}
+
+	INSIST((unsigned int)n == r->length);
+	return (ISC_R_SUCCESS);
+}
+
+unsigned int
+ns_tls_pending(ns_tls_t *tls) {
+	REQUIRE(VALID_TLS(tls));
+
+	return ((unsigned int)BIO_ctrl_pending(tls->wbio));
+}
+
+unsigned int
+ns_tls_output(ns_tls_t *tls, unsigned char *buf, unsigned int len) {
+	int n;
+
+	REQUIRE(VALID_TLS(tls));
+	REQUIRE(buf != NULL && len > 0);
+
+	n = BIO_read(tls->wbio, buf, (int)len);
+	return (n > 0 ? (unsigned int)n : 0);
+}
+
+isc_boolean_t
+ns_tls_handshakedone(ns_tls_t *tls) {
+	REQUIRE(VALID_TLS(tls));
+
+	return (ISC_TF(SSL_is_init_finished(tls->ssl)));
+}
+
+isc_boolean_t
+ns_tls_resumed(ns_tls_t *tls) {
+	REQUIRE(VALID_TLS(tls));
+
+	return (ISC_TF(SSL_session_reused(tls->ssl)));
+}
+
+const char *
+ns_tls_error(ns_tls_t *tls) {
+	const char *reason = NULL;
+
+	REQUIRE(VALID_TLS(tls));
+
+	if (tls->error != 0)
+		reason = ERR_reason_error_string(tls->error);
+	return (reason != NULL ? reason : "unknown error");
+}
+
+#else /* HAVE_OPENSSL_SSL */
+
+isc_result_t
+ns_tlsctx_create(isc_mem_t *mctx, const char *keyfile, const char *certfile,
+		 isc_boolean_t tickets, ns_tlsctx_t **ctxp)
+{
+	REQUIRE(mctx != NULL);
+	REQUIRE(keyfile != NULL && certfile != NULL);
+	REQUIRE(ctxp != NULL && *ctxp == NULL);
+
+	UNUSED(tickets);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+void
+ns_tlsctx_attach(ns_tlsctx_t *source, ns_tlsctx_t **targetp) {
+	UNUSED(targetp);
+
+	REQUIRE(source != NULL);
+}
+
+void
+ns_tlsctx_detach(ns_tlsctx_t **ctxp) {
+	REQUIRE(ctxp != NULL && *ctxp != NULL);
+}
+
+isc_result_t
+ns_tls_create(isc_mem_t *mctx, ns_tlsctx_t *ctx, ns_tls_t **tlsp) {
+	UNUSED(mctx);
+	UNUSED(tlsp);
+
+	REQUIRE(ctx != NULL);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+void
+ns_tls_destroy(ns_tls_t **tlsp) {
+	REQUIRE(tlsp != NULL && *tlsp != NULL);
+}
+
+isc_result_t
+ns_tls_input(ns_tls_t *tls, const isc_region_t *r) {
+	UNUSED(r);
+
+	REQUIRE(tls != NULL);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+isc_result_t
+ns_tls_read(ns_tls_t *tls, unsigned char *buf, unsigned int len,
+	    unsigned int *nreadp)
+{
+	UNUSED(buf);
+	UNUSED(len);
+	UNUSED(nreadp);
+
+	REQUIRE(tls != NULL);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+isc_result_t
+ns_tls_write(ns_tls_t *tls, const isc_region_t *r) {
+	UNUSED(r);
+
+	REQUIRE(tls != NULL);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+unsigned int
+ns_tls_pending(ns_tls_t *tls) {
+	REQUIRE(tls != NULL);
+
+	return (0);
+}
+
+unsigned int
+ns_tls_output(ns_tls_t *tls, unsigned char *buf, unsigned int len) {
+	UNUSED(buf);
+	UNUSED(len);
+
+	REQUIRE(tls != NULL);
+
+	return (0);
+}
+
+isc_boolean_t
+ns_tls_handshakedone(ns_tls_t *tls) {
+	REQUIRE(tls != NULL);
+
+	return (ISC_FALSE);
+}
+
+isc_boolean_t
+ns_tls_resumed(ns_tls_t *tls) {
+	REQUIRE(tls != NULL);
+
+	return (ISC_FALSE);
+}
+
+const char *
+ns_tls_error(ns_tls_t *tls) {
+	REQUIRE(tls != NULL);
+
+	return ("not implemented");
+}
+
+#endif /* HAVE_OPENSSL_SSL */
@@ -209,6 +209,17 @@ struct rr {
 	dns_rdata_t		rdata;
 };
 
+/*%
+ * The most updates to one zone that are committed together.
+ */
+#define UPDATE_GROUP_MAX	64
+
+/*%
+ * Tag of the events that carry updates to be applied, so that
+ * update_action() can tell them from forwarded updates.
+ */
+static int update_tag;
+
 typedef struct update_event update_event_t;
 
 struct update_event {
@@ -450,6 +461,9 @@ do_one_tuple(dns_difftuple_t **tuple, dns_db_t *db, dns_dbversion_t *ver,
  *
  * Ensures:
  * \li	'updates' is empty.
+ *
+ * On failure, 'diff' still logs the updates that were performed, so
+ * that they can be backed out.
  */
 static isc_result_t
 do_diff(dns_diff_t *updates, dns_db_t *db, dns_dbversion_t *ver,
@@ -464,7 +478,6 @@ do_diff(dns_diff_t *updates, dns_db_t *db, dns_dbversion_t *ver,
 	return (ISC_R_SUCCESS);
 
  failure:
-	dns_diff_clear(diff);
 	return (result);
 }
 
@@ -1519,6 +1532,13 @@ send_update_event(ns_client_t *client, dns_zone_t *zone) {
 	isc_task_t *zonetask = NULL;
 	ns_client_t *evclient;
 
+	/*
+	 * Replace this client so that further updates can be received,
+	 * and committed along with this one, while it waits.
+	 */
+	if (!client->mortal && (client->attributes & NS_CLIENTATTR_TCP) == 0)
+		CHECK(ns_client_replace(client));
+
 	event = (update_event_t *)
 		isc_event_allocate(client->mctx, client, DNS_EVENT_UPDATE,
 				   update_action, NULL, sizeof(*event));
@@ -1526,6 +1546,7 @@ send_update_event(ns_client_t *client, dns_zone_t *zone) {
 		FAIL(ISC_R_NOMEMORY);
 	event->zone = zone;
 	event->result = ISC_R_SUCCESS;
+	event->ev_tag = &update_tag;
 
 	evclient = NULL;
 	ns_client_attach(client, &evclient);
@@ -2483,16 +2504,24 @@ isdnssec(dns_db_t *db, dns_dbversion_t *ver, dns_rdatatype_t privatetype) {
 	return (build_nsec || build_nsec3);
 }
 
-static void
-update_action(isc_task_t *task, isc_event_t *event) {
-	update_event_t *uev = (update_event_t *) event;
-	dns_zone_t *zone = uev->zone;
-	ns_client_t *client = (ns_client_t *)event->ev_arg;
+/*%
+ * Check the prerequisites of the update request of 'client' against
+ * 'ver' of 'db' and apply its update section to 'ver', recording the
+ * changes in 'diff'.  'oldver' is the version 'ver' was opened from.
+ *
+ * If 'grouped' is true, 'ver' is shared with the other updates of a
+ * group (see update_action()) and the SOA serial is left alone, as the
+ * group increments it once.  Only updates to unsigned zones that do not
+ * touch DNSSEC records are grouped, so that 'oldver' is as good as the
+ * version before this update for the DNSSEC checks.  On failure the
+ * caller backs out whatever is in 'diff'.
+ */
+static isc_result_t
+update_one(ns_client_t *client, dns_zone_t *zone, dns_db_t *db,
+	   dns_dbversion_t *oldver, dns_dbversion_t *ver, dns_diff_t *diff,
+	   isc_boolean_t grouped)
+{
 	isc_result_t result;
-	dns_db_t *db = NULL;
-	dns_dbversion_t *oldver = NULL;
-	dns_dbversion_t *ver = NULL;
-	dns_diff_t diff;	/* Pending updates. */
 	dns_diff_t temp;	/* Pending RR existence assertions. */
 	isc_boolean_t soa_serial_changed = ISC_FALSE;
 	isc_mem_t *mctx = client->mctx;
@@ -2504,8 +2533,6 @@ update_action(isc_task_t *task, isc_event_t *event) {
 	dns_fixedname_t tmpnamefixed;
 	dns_name_t *tmpname = NULL;
 	unsigned int options, options2;
-	dns_difftuple_t *tuple;
-	dns_rdata_dnskey_t dnskey;
 	isc_boolean_t had_dnskey;
 	dns_rdatatype_t privatetype = dns_zone_getprivatetype(zone);
 	dns_ttl_t maxttl = 0;
@@ -2513,12 +2540,8 @@ update_action(isc_task_t *task, isc_event_t *event) {
 	isc_uint64_t records;
 	dns_aclenv_t *env = ns_interfacemgr_getaclenv(client->interface->mgr);
 
-	INSIST(event->ev_type == DNS_EVENT_UPDATE);
-
-	dns_diff_init(mctx, &diff);
 	dns_diff_init(mctx, &temp);
 
-	CHECK(dns_zone_getdb(zone, &db));
 	zonename = dns_db_origin(db);
 	zoneclass = dns_db_class(db);
 	dns_zone_getssutable(zone, &ssutable);
@@ -2531,12 +2554,6 @@ update_action(isc_task_t *task, isc_event_t *event) {
 	CHECK(checkqueryacl(client, dns_zone_getqueryacl(zone), zonename,
 			    dns_zone_getupdateacl(zone), ssutable));
 
-	/*
-	 * Get old and new versions now that queryacl has been checked.
-	 */
-	dns_db_currentversion(db, &oldver);
-	CHECK(dns_db_newversion(db, &ver));
-
 	/*
 	 * Check prerequisites.
 	 */
@@ -2957,7 +2974,7 @@ update_action(isc_task_t *task, isc_event_t *event) {
 				add_rr_prepare_ctx_t ctx;
 				ctx.db = db;
 				ctx.ver = ver;
-				ctx.diff = &diff;
+				ctx.diff = diff;
 				ctx.name = name;
 				ctx.oldname = name;
 				ctx.update_rr = &rdata;
@@ -2974,18 +2991,18 @@ update_action(isc_task_t *task, isc_event_t *event) {
 					dns_diff_clear(&ctx.add_diff);
 				} else {
 					result = do_diff(&ctx.del_diff, db, ver,
-							 &diff);
+							 diff);
 					if (result == ISC_R_SUCCESS) {
 						result = do_diff(&ctx.add_diff,
 								 db, ver,
-								 &diff);
+								 diff);
 					}
 					if (result != ISC_R_SUCCESS) {
 						dns_diff_clear(&ctx.del_diff);
 						dns_diff_clear(&ctx.add_diff);
 						goto failure;
 					}
-					CHECK(update_one_rr(db, ver, &diff,
+					CHECK(update_one_rr(db, ver, diff,
 							    DNS_DIFFOP_ADD,
 							    name, ttl, &rdata));
 				}
@@ -3007,12 +3024,12 @@ update_action(isc_task_t *task, isc_event_t *event) {
 					CHECK(delete_if(type_not_soa_nor_ns_p,
 							db, ver, name,
 							dns_rdatatype_any, 0,
-							&rdata, &diff));
+							&rdata, diff));
 				} else {
 					CHECK(delete_if(type_not_dnssec,
 							db, ver, name,
 							dns_rdatatype_any, 0,
-							&rdata, &diff));
+							&rdata, diff));
 				}
 			} else if (dns_name_equal(name, zonename) &&
 				   (rdata.type == dns_rdatatype_soa ||
@@ -3039,7 +3056,7 @@ update_action(isc_task_t *task, isc_event_t *event) {
 				}
 				CHECK(delete_if(true_p, db, ver, name,
 						rdata.type, covers, &rdata,
-						&diff));
+						diff));
 			}
 		} else if (update_class == dns_rdataclass_none) {
 			char namestr[DNS_NAME_FORMATSIZE];
@@ -3078,7 +3095,7 @@ update_action(isc_task_t *task, isc_event_t *event) {
 			update_log(client, zone, LOGLEVEL_PROTOCOL,
 				   "deleting an RR at %s %s", namestr, typestr);
 			CHECK(delete_if(rr_equal_p, db, ver, name, rdata.type,
-					covers, &rdata, &diff));
+					covers, &rdata, diff));
 		}
 	}
 	if (result != ISC_R_NOMORE)
@@ -3089,10 +3106,10 @@ update_action(isc_task_t *task, isc_event_t *event) {
 	 * If they don't then back out all changes to DNSKEY/NSEC3PARAM
 	 * records.
 	 */
-	if (! ISC_LIST_EMPTY(diff.tuples))
-		CHECK(check_dnssec(client, zone, db, ver, &diff));
+	if (! ISC_LIST_EMPTY(diff->tuples))
+		CHECK(check_dnssec(client, zone, db, ver, diff));
 
-	if (! ISC_LIST_EMPTY(diff.tuples)) {
+	if (! ISC_LIST_EMPTY(diff->tuples)) {
 		unsigned int errors = 0;
 		CHECK(dns_zone_nscheck(zone, db, ver, &errors));
 		if (errors != 0) {
@@ -3103,7 +3120,7 @@ update_action(isc_task_t *task, isc_event_t *event) {
 			goto failure;
 		}
 	}
-	if (! ISC_LIST_EMPTY(diff.tuples)) {
+	if (! ISC_LIST_EMPTY(diff->tuples)) {
 		result = dns_zone_cdscheck(zone, db, ver);
 		if (result == DNS_R_BADCDS || result == DNS_R_BADCDNSKEY) {
 			update_log(client, zone, LOGLEVEL_PROTOCOL,
@@ -3122,23 +3139,22 @@ update_action(isc_task_t *task, isc_event_t *event) {
 	 * update RRSIGs and NSECs (if zone is secure), and write the update
 	 * to the journal.
 	 */
-	if (! ISC_LIST_EMPTY(diff.tuples)) {
-		char *journalfile;
-		dns_journal_t *journal;
+	if (! ISC_LIST_EMPTY(diff->tuples)) {
 		isc_boolean_t has_dnskey;
 
 		/*
 		 * Increment the SOA serial, but only if it was not
-		 * changed as a result of an update operation.
+		 * changed as a result of an update operation.  A group
+		 * of updates increments it once, when it is committed.
 		 */
-		if (! soa_serial_changed) {
-			CHECK(update_soa_serial(db, ver, &diff, mctx,
+		if (! soa_serial_changed && ! grouped) {
+			CHECK(update_soa_serial(db, ver, diff, mctx,
 				       dns_zone_getserialupdatemethod(zone)));
 		}
 
-		CHECK(check_mx(client, zone, db, ver, &diff));
+		CHECK(check_mx(client, zone, db, ver, diff));
 
-		CHECK(remove_orphaned_ds(db, ver, &diff));
+		CHECK(remove_orphaned_ds(db, ver, diff));
 
 		CHECK(rrset_exists(db, ver, zonename, dns_rdatatype_dnskey,
 				   0, &has_dnskey));
@@ -3160,11 +3176,11 @@ update_action(isc_task_t *task, isc_event_t *event) {
 			}
 		}
 
-		CHECK(rollback_private(db, privatetype, ver, &diff));
+		CHECK(rollback_private(db, privatetype, ver, diff));
 
-		CHECK(add_signing_records(db, privatetype, ver, &diff));
+		CHECK(add_signing_records(db, privatetype, ver, diff));
 
-		CHECK(add_nsec3param_records(client, zone, db, ver, &diff));
+		CHECK(add_nsec3param_records(client, zone, db, ver, diff));
 
 		if (had_dnskey && !has_dnskey) {
 			/*
@@ -3174,7 +3190,7 @@ update_action(isc_task_t *task, isc_event_t *event) {
 			 * remove any NSEC chain present will also be removed.
 			 */
 			 CHECK(dns_nsec3param_deletechains(db, ver, zone,
-							   ISC_TRUE, &diff));
+							   ISC_TRUE, diff));
 		} else if (has_dnskey && isdnssec(db, ver, privatetype)) {
 			isc_uint32_t interval;
 			dns_update_log_t log;
@@ -3183,7 +3199,7 @@ update_action(isc_task_t *task, isc_event_t *event) {
 			log.func = update_log_cb;
 			log.arg = client;
 			result = dns_update_signatures(&log, zone, db, oldver,
-						       ver, &diff, interval);
+						       ver, diff, interval);
 
 			if (result != ISC_R_SUCCESS) {
 				update_log(client, zone,
@@ -3207,133 +3223,375 @@ update_action(isc_task_t *task, isc_event_t *event) {
 				goto failure;
 			}
 		}
+	} else {
+		update_log(client, zone, LOGLEVEL_DEBUG, "redundant request");
+	}
+	result = ISC_R_SUCCESS;
 
-		journalfile = dns_zone_getjournal(zone);
-		if (journalfile != NULL) {
-			update_log(client, zone, LOGLEVEL_DEBUG,
-				   "writing journal %s", journalfile);
+ failure:
+	/*
+	 * The reason for failure should have been logged at this point.
+	 */
+	dns_diff_clear(&temp);
 
-			journal = NULL;
-			result = dns_journal_open(mctx, journalfile,
-						  DNS_JOURNAL_CREATE, &journal);
-			if (result != ISC_R_SUCCESS)
-				FAILS(result, "journal open failed");
+	if (ssutable != NULL)
+		dns_ssutable_detach(&ssutable);
 
-			result = dns_journal_write_transaction(journal, &diff);
-			if (result != ISC_R_SUCCESS) {
-				dns_journal_destroy(&journal);
-				FAILS(result, "journal write failed");
-			}
+	return (result);
+}
 
+/*%
+ * Write 'diff', the changes made to '*verp' by one or more updates, to
+ * the journal of 'zone' as a single transaction and commit '*verp'.
+ * 'client' sent the first of the updates and is used for logging.
+ */
+static isc_result_t
+update_commit(ns_client_t *client, dns_zone_t *zone, dns_db_t *db,
+	      dns_dbversion_t **verp, dns_diff_t *diff)
+{
+	isc_result_t result;
+	char *journalfile;
+	dns_journal_t *journal;
+	dns_difftuple_t *tuple;
+	dns_rdata_dnskey_t dnskey;
+	dns_rdatatype_t privatetype = dns_zone_getprivatetype(zone);
+
+	journalfile = dns_zone_getjournal(zone);
+	if (journalfile != NULL) {
+		update_log(client, zone, LOGLEVEL_DEBUG,
+			   "writing journal %s", journalfile);
+
+		journal = NULL;
+		result = dns_journal_open(diff->mctx, journalfile,
+					  DNS_JOURNAL_CREATE, &journal);
+		if (result != ISC_R_SUCCESS)
+			FAILS(result, "journal open failed");
+
+		result = dns_journal_write_transaction(journal, diff);
+		if (result != ISC_R_SUCCESS) {
 			dns_journal_destroy(&journal);
+			FAILS(result, "journal write failed");
 		}
 
-		/*
-		 * XXXRTH  Just a note that this committing code will have
-		 *	   to change to handle databases that need two-phase
-		 *	   commit, but this isn't a priority.
-		 */
-		update_log(client, zone, LOGLEVEL_DEBUG,
-			   "committing update transaction");
+		dns_journal_destroy(&journal);
+	}
 
-		dns_db_closeversion(db, &ver, ISC_TRUE);
+	/*
+	 * XXXRTH  Just a note that this committing code will have
+	 *	   to change to handle databases that need two-phase
+	 *	   commit, but this isn't a priority.
+	 */
+	update_log(client, zone, LOGLEVEL_DEBUG,
+		   "committing update transaction");
 
-		/*
-		 * Mark the zone as dirty so that it will be written to disk.
-		 */
-		dns_zone_markdirty(zone);
+	dns_db_closeversion(db, verp, ISC_TRUE);
 
-		/*
-		 * Notify slaves of the change we just made.
-		 */
-		dns_zone_notify(zone);
+	/*
+	 * Mark the zone as dirty so that it will be written to disk.
+	 */
+	dns_zone_markdirty(zone);
 
-		/*
-		 * Cause the zone to be signed with the key that we
-		 * have just added or have the corresponding signatures
-		 * deleted.
-		 *
-		 * Note: we are already committed to this course of action.
-		 */
-		for (tuple = ISC_LIST_HEAD(diff.tuples);
-		     tuple != NULL;
-		     tuple = ISC_LIST_NEXT(tuple, link)) {
-			isc_region_t r;
-			dns_secalg_t algorithm;
-			isc_uint16_t keyid;
-
-			if (tuple->rdata.type != dns_rdatatype_dnskey)
-				continue;
+	/*
+	 * Notify slaves of the change we just made.
+	 */
+	dns_zone_notify(zone);
 
-			dns_rdata_tostruct(&tuple->rdata, &dnskey, NULL);
-			if ((dnskey.flags &
-			     (DNS_KEYFLAG_OWNERMASK|DNS_KEYTYPE_NOAUTH))
-				 != DNS_KEYOWNER_ZONE)
-				continue;
+	/*
+	 * Cause the zone to be signed with the key that we
+	 * have just added or have the corresponding signatures
+	 * deleted.
+	 *
+	 * Note: we are already committed to this course of action.
+	 */
+	for (tuple = ISC_LIST_HEAD(diff->tuples);
+	     tuple != NULL;
+	     tuple = ISC_LIST_NEXT(tuple, link)) {
+		isc_region_t r;
+		dns_secalg_t algorithm;
+		isc_uint16_t keyid;
+
+		if (tuple->rdata.type != dns_rdatatype_dnskey)
+			continue;
 
-			dns_rdata_toregion(&tuple->rdata, &r);
-			algorithm = dnskey.algorithm;
-			keyid = dst_region_computeid(&r, algorithm);
+		dns_rdata_tostruct(&tuple->rdata, &dnskey, NULL);
+		if ((dnskey.flags &
+		     (DNS_KEYFLAG_OWNERMASK|DNS_KEYTYPE_NOAUTH))
+			 != DNS_KEYOWNER_ZONE)
+			continue;
 
-			result = dns_zone_signwithkey(zone, algorithm, keyid,
-					ISC_TF(tuple->op == DNS_DIFFOP_DEL));
-			if (result != ISC_R_SUCCESS) {
-				update_log(client, zone, ISC_LOG_ERROR,
-					   "dns_zone_signwithkey failed: %s",
-					   dns_result_totext(result));
+		dns_rdata_toregion(&tuple->rdata, &r);
+		algorithm = dnskey.algorithm;
+		keyid = dst_region_computeid(&r, algorithm);
+
+		result = dns_zone_signwithkey(zone, algorithm, keyid,
+				ISC_TF(tuple->op == DNS_DIFFOP_DEL));
+		if (result != ISC_R_SUCCESS) {
+			update_log(client, zone, ISC_LOG_ERROR,
+				   "dns_zone_signwithkey failed: %s",
+				   dns_result_totext(result));
+		}
+	}
+
+	/*
+	 * Cause the zone to add/delete NSEC3 chains for the
+	 * deferred NSEC3PARAM changes.
+	 *
+	 * Note: we are already committed to this course of action.
+	 */
+	for (tuple = ISC_LIST_HEAD(diff->tuples);
+	     tuple != NULL;
+	     tuple = ISC_LIST_NEXT(tuple, link)) {
+		unsigned char buf[DNS_NSEC3PARAM_BUFFERSIZE];
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+		dns_rdata_nsec3param_t nsec3param;
+
+		if (tuple->rdata.type != privatetype ||
+		    tuple->op != DNS_DIFFOP_ADD)
+			continue;
+
+		if (!dns_nsec3param_fromprivate(&tuple->rdata, &rdata,
+					   buf, sizeof(buf)))
+			continue;
+		dns_rdata_tostruct(&rdata, &nsec3param, NULL);
+		if (nsec3param.flags == 0)
+			continue;
+
+		result = dns_zone_addnsec3chain(zone, &nsec3param);
+		if (result != ISC_R_SUCCESS) {
+			update_log(client, zone, ISC_LOG_ERROR,
+				   "dns_zone_addnsec3chain failed: %s",
+				   dns_result_totext(result));
+		}
+	}
+	return (ISC_R_SUCCESS);
+
+ failure:
+	return (result);
+}
+
+/*%
+ * Back out the changes recorded in 'diff' from 'ver', newest first.
+ */
+static isc_result_t
+undo_diff(dns_db_t *db, dns_dbversion_t *ver, dns_diff_t *diff) {
+	isc_result_t result;
+	dns_difftuple_t *tuple, *undo;
+	dns_diff_t temp;
+
+	for (tuple = ISC_LIST_TAIL(diff->tuples);
+	     tuple != NULL;
+	     tuple = ISC_LIST_PREV(tuple, link))
+	{
+		undo = NULL;
+		CHECK(dns_difftuple_copy(tuple, &undo));
+		INSIST(tuple->op == DNS_DIFFOP_ADD ||
+		       tuple->op == DNS_DIFFOP_DEL);
+		undo->op = (tuple->op == DNS_DIFFOP_ADD) ? DNS_DIFFOP_DEL
+							 : DNS_DIFFOP_ADD;
+		dns_diff_init(diff->mctx, &temp);
+		ISC_LIST_APPEND(temp.tuples, undo, link);
+		result = dns_diff_apply(&temp, db, ver);
+		dns_diff_clear(&temp);
+		CHECK(result);
+	}
+	result = ISC_R_SUCCESS;
+
+ failure:
+	return (result);
+}
+
+/*%
+ * Return ISC_TRUE if the update section of 'request' has no records of
+ * a type that needs DNSSEC maintenance, so that the update can share a
+ * database version with others.
+ */
+static isc_boolean_t
+update_groupable(dns_message_t *request, dns_rdatatype_t privatetype) {
+	dns_name_t *name;
+	dns_rdataset_t *rdataset;
+
+	for (name = ISC_LIST_HEAD(request->sections[DNS_SECTION_UPDATE]);
+	     name != NULL;
+	     name = ISC_LIST_NEXT(name, link))
+	{
+		for (rdataset = ISC_LIST_HEAD(name->list);
+		     rdataset != NULL;
+		     rdataset = ISC_LIST_NEXT(rdataset, link))
+		{
+			switch (rdataset->type) {
+			case dns_rdatatype_dnskey:
+			case dns_rdatatype_cdnskey:
+			case dns_rdatatype_cds:
+			case dns_rdatatype_nsec3param:
+			case dns_rdatatype_nsec:
+			case dns_rdatatype_nsec3:
+			case dns_rdatatype_rrsig:
+				return (ISC_FALSE);
+			default:
+				if (rdataset->type == privatetype)
+					return (ISC_FALSE);
+				break;
 			}
 		}
+	}
+	return (ISC_TRUE);
+}
 
-		/*
-		 * Cause the zone to add/delete NSEC3 chains for the
-		 * deferred NSEC3PARAM changes.
-		 *
-		 * Note: we are already committed to this course of action.
-		 */
-		for (tuple = ISC_LIST_HEAD(diff.tuples);
-		     tuple != NULL;
-		     tuple = ISC_LIST_NEXT(tuple, link)) {
-			unsigned char buf[DNS_NSEC3PARAM_BUFFERSIZE];
-			dns_rdata_t rdata = DNS_RDATA_INIT;
-			dns_rdata_nsec3param_t nsec3param;
-
-			if (tuple->rdata.type != privatetype ||
-			    tuple->op != DNS_DIFFOP_ADD)
-				continue;
+/*%
+ * Return ISC_TRUE if 'ver' of 'db' has a DNSKEY RRset at the apex or
+ * is being signed.
+ */
+static isc_boolean_t
+zone_issigned(dns_db_t *db, dns_dbversion_t *ver,
+	      dns_rdatatype_t privatetype)
+{
+	isc_result_t result;
+	isc_boolean_t has_dnskey;
 
-			if (!dns_nsec3param_fromprivate(&tuple->rdata, &rdata,
-						   buf, sizeof(buf)))
-				continue;
-			dns_rdata_tostruct(&rdata, &nsec3param, NULL);
-			if (nsec3param.flags == 0)
-				continue;
+	result = rrset_exists(db, ver, dns_db_origin(db),
+			      dns_rdatatype_dnskey, 0, &has_dnskey);
+	if (result != ISC_R_SUCCESS || has_dnskey)
+		return (ISC_TRUE);
+	return (isdnssec(db, ver, privatetype));
+}
+
+/*%
+ * Commit the update at the head of 'events' for 'zone', together with
+ * those of the following updates for 'zone' that can share a database
+ * version with it, and send each client its response.  The updates
+ * that are committed are removed from 'events'.
+ */
+static void
+update_group(dns_zone_t *zone, isc_eventlist_t *events) {
+	isc_result_t result;
+	isc_eventlist_t group;
+	isc_event_t *event, *next;
+	update_event_t *uev;
+	ns_client_t *client, *first = NULL;
+	isc_mem_t *mctx = dns_zone_getmctx(zone);
+	dns_db_t *db = NULL;
+	dns_dbversion_t *oldver = NULL;
+	dns_dbversion_t *ver = NULL;
+	dns_diff_t diff;	/* Pending updates of the group. */
+	dns_diff_t one;		/* Pending updates of one request. */
+	dns_difftuple_t *tuple;
+	dns_rdatatype_t privatetype = dns_zone_getprivatetype(zone);
+	isc_boolean_t grouped, soa_serial_changed = ISC_FALSE;
+	unsigned int count, failed = 0;
+
+	dns_diff_init(mctx, &diff);
+	ISC_LIST_INIT(group);
+
+	event = ISC_LIST_HEAD(*events);
+	ISC_LIST_UNLINK(*events, event, ev_link);
+	ISC_LIST_APPEND(group, event, ev_link);
+	client = (ns_client_t *)event->ev_arg;
+
+	CHECK(dns_zone_getdb(zone, &db));
+	dns_db_currentversion(db, &oldver);
 
-			result = dns_zone_addnsec3chain(zone, &nsec3param);
+	/*
+	 * Signing works out what to re-sign from the difference between
+	 * the versions before and after each update, so updates that
+	 * need it are committed one at a time.
+	 */
+	grouped = ISC_TF(!zone_issigned(db, oldver, privatetype) &&
+			 update_groupable(client->message, privatetype));
+	for (event = ISC_LIST_HEAD(*events), count = 1;
+	     grouped && event != NULL && count < UPDATE_GROUP_MAX;
+	     event = next)
+	{
+		next = ISC_LIST_NEXT(event, ev_link);
+		uev = (update_event_t *)event;
+		if (uev->zone != zone)
+			continue;
+		client = (ns_client_t *)event->ev_arg;
+		if (!update_groupable(client->message, privatetype))
+			break;
+		ISC_LIST_UNLINK(*events, event, ev_link);
+		ISC_LIST_APPEND(group, event, ev_link);
+		count++;
+	}
+
+	CHECK(dns_db_newversion(db, &ver));
+
+	for (event = ISC_LIST_HEAD(group);
+	     event != NULL;
+	     event = ISC_LIST_NEXT(event, ev_link))
+	{
+		uev = (update_event_t *)event;
+		client = (ns_client_t *)event->ev_arg;
+
+		dns_diff_init(client->mctx, &one);
+		uev->result = update_one(client, zone, db, oldver, ver, &one,
+					 grouped);
+		if (uev->result != ISC_R_SUCCESS) {
+			update_log(client, zone, LOGLEVEL_DEBUG,
+				   "rolling back");
+			result = ISC_R_SUCCESS;
+			if (grouped)
+				result = undo_diff(db, ver, &one);
+			dns_diff_clear(&one);
+			failed++;
 			if (result != ISC_R_SUCCESS) {
 				update_log(client, zone, ISC_LOG_ERROR,
-					   "dns_zone_addnsec3chain failed: %s",
-					   dns_result_totext(result));
+					   "could not roll back update: %s",
+					   isc_result_totext(result));
+				goto failure;
 			}
+			continue;
+		}
+		if (first == NULL)
+			first = client;
+		while ((tuple = ISC_LIST_HEAD(one.tuples)) != NULL) {
+			ISC_LIST_UNLINK(one.tuples, tuple, link);
+			if (tuple->rdata.type == dns_rdatatype_soa)
+				soa_serial_changed = ISC_TRUE;
+			dns_diff_appendminimal(&diff, &tuple);
 		}
-	} else {
-		update_log(client, zone, LOGLEVEL_DEBUG, "redundant request");
-		dns_db_closeversion(db, &ver, ISC_TRUE);
 	}
-	result = ISC_R_SUCCESS;
-	goto common;
+
+	if (count > 1) {
+		client = (ns_client_t *)ISC_LIST_HEAD(group)->ev_arg;
+		update_log(client, zone, LOGLEVEL_DEBUG,
+			   "committing a group of %u updates, %u failed",
+			   count, failed);
+	}
+
+	if (ISC_LIST_EMPTY(diff.tuples)) {
+		dns_db_closeversion(db, &ver,
+				    ISC_TF(first != NULL && !grouped));
+		result = ISC_R_SUCCESS;
+		goto respond;
+	}
+
+	/*
+	 * Increment the SOA serial once for the whole group, but only if
+	 * it was not changed as a result of an update operation.
+	 */
+	if (grouped && !soa_serial_changed)
+		CHECK(update_soa_serial(db, ver, &diff, mctx,
+					dns_zone_getserialupdatemethod(zone)));
+
+	CHECK(update_commit(first, zone, db, &ver, &diff));
+	goto respond;
 
  failure:
 	/*
-	 * The reason for failure should have been logged at this point.
+	 * Fail the updates that had not already failed by themselves.
 	 */
-	if (ver != NULL) {
-		update_log(client, zone, LOGLEVEL_DEBUG,
-			   "rolling back");
-		dns_db_closeversion(db, &ver, ISC_FALSE);
+	for (event = ISC_LIST_HEAD(group);
+	     event != NULL;
+	     event = ISC_LIST_NEXT(event, ev_link))
+	{
+		uev = (update_event_t *)event;
+		if (ver == NULL || uev->result == ISC_R_SUCCESS)
+			uev->result = result;
 	}
+	if (ver != NULL)
+		dns_db_closeversion(db, &ver, ISC_FALSE);
 
- common:
-	dns_diff_clear(&temp);
+ respond:
 	dns_diff_clear(&diff);
 
 	if (oldver != NULL)
@@ -3342,19 +3600,57 @@ update_action(isc_task_t *task, isc_event_t *event) {
 	if (db != NULL)
 		dns_db_detach(&db);
 
-	if (ssutable != NULL)
-		dns_ssutable_detach(&ssutable);
-
-	isc_task_detach(&task);
-	uev->result = result;
-	if (zone != NULL)
+	while ((event = ISC_LIST_HEAD(group)) != NULL) {
+		ISC_LIST_UNLINK(group, event, ev_link);
+		uev = (update_event_t *)event;
+		client = (ns_client_t *)event->ev_arg;
 		INSIST(uev->zone == zone); /* we use this later */
-	uev->ev_type = DNS_EVENT_UPDATEDONE;
-	uev->ev_action = updatedone_action;
-	isc_task_send(client->task, &event);
+		uev->ev_type = DNS_EVENT_UPDATEDONE;
+		uev->ev_action = updatedone_action;
+		isc_task_send(client->task, &event);
+	}
 
 	INSIST(ver == NULL);
-	INSIST(event == NULL);
+}
+
+/*%
+ * Process the update in 'event' and any other updates that are already
+ * waiting on the zone task.  The waiting updates for a zone are applied
+ * to one new database version and written to the journal as a single
+ * transaction, so that a burst of updates costs one commit and one
+ * fsync of the journal rather than one each.  Each update still has its
+ * prerequisites checked, and its changes backed out if it fails, on its
+ * own, and each client gets its own response.
+ */
+static void
+update_action(isc_task_t *task, isc_event_t *event) {
+	isc_eventlist_t events;
+	isc_task_t *evtask;
+	unsigned int n;
+
+	INSIST(event->ev_type == DNS_EVENT_UPDATE);
+
+	/*
+	 * The task may be shared with other zones; update_group() commits
+	 * the updates one zone at a time, in the order they arrived.
+	 */
+	ISC_LIST_INIT(events);
+	ISC_LIST_APPEND(events, event, ev_link);
+	n = isc_task_unsend(task, NULL, DNS_EVENT_UPDATE, &update_tag,
+			    &events);
+	while (!ISC_LIST_EMPTY(events)) {
+		update_event_t *uev = (update_event_t *)ISC_LIST_HEAD(events);
+		update_group(uev->zone, &events);
+	}
+
+	/*
+	 * Each event held a reference to the task.
+	 */
+	while (n-- > 0) {
+		evtask = task;
+		isc_task_detach(&evtask);
+	}
+	isc_task_detach(&task);
 }
 
 static void
@@ -16,6 +16,7 @@
 #include <isc/timer.h>
 #include <isc/print.h>
 #include <isc/stats.h>
+#include <isc/task.h>
 #include <isc/util.h>
 
 #include <dns/db.h>
@@ -245,7 +246,8 @@ ixfr_rrstream_create(isc_mem_t *mctx,
 	s->journal = NULL;
 
 	CHECK(dns_journal_open(mctx, journal_filename,
-			       DNS_JOURNAL_READ, &s->journal));
+			       DNS_JOURNAL_READ | DNS_JOURNAL_MAP,
+			       &s->journal));
 	CHECK(dns_journal_iter_init(s->journal, begin_serial, end_serial));
 
 	*sp = (rrstream_t *) s;
@@ -641,13 +643,185 @@ static rrstream_methods_t compound_rrstream_methods = {
 	compound_rrstream_destroy
 };
 
+/**************************************************************************/
+/*
+ * Add RRs from 'stream' to the answer section of 'msg', storing their
+ * owner names and rdata uncompressed in 'buf'.  Stop before an RR that
+ * would not fit in 'buf', after the first RR unless 'many_answers' is
+ * set, or once at least 'limit' bytes of 'buf' are in use.  '*eos' is
+ * set when the stream runs out.  If the first RR does not fit on its
+ * own, its size is stored in '*sizep' and ISC_R_NOSPACE is returned.
+ */
+static isc_result_t
+addrrs(rrstream_t *stream, dns_message_t *msg, isc_buffer_t *buf,
+       isc_boolean_t many_answers, unsigned int limit,
+       isc_boolean_t *eos, unsigned int *sizep)
+{
+	isc_result_t result;
+	dns_name_t *msgname = NULL;
+	dns_rdata_t *msgrdata = NULL;
+	dns_rdatalist_t *msgrdl = NULL;
+	dns_rdataset_t *msgrds = NULL;
+	int n_rrs;
+
+	for (n_rrs = 0; ; n_rrs++) {
+		dns_name_t *name = NULL;
+		isc_uint32_t ttl;
+		dns_rdata_t *rdata = NULL;
+
+		unsigned int size;
+		isc_region_t r;
+
+		msgname = NULL;
+		msgrdata = NULL;
+		msgrdl = NULL;
+		msgrds = NULL;
+
+		stream->methods->current(stream, &name, &ttl, &rdata);
+		size = name->length + 10 + rdata->length;
+		isc_buffer_availableregion(buf, &r);
+		if (size >= r.length) {
+			/*
+			 * RR would not fit.  If there are other RRs in the
+			 * buffer, send them now and leave this RR to the
+			 * next message.  If this RR overflows the buffer
+			 * all by itself, fail.
+			 *
+			 * In theory some RRs might fit in a TCP message
+			 * when compressed even if they do not fit when
+			 * uncompressed, but surely we don't want
+			 * to send such monstrosities to an unsuspecting
+			 * slave.
+			 */
+			if (n_rrs == 0) {
+				*sizep = size;
+				/* XXX DNS_R_RRTOOLARGE? */
+				result = ISC_R_NOSPACE;
+				goto failure;
+			}
+			break;
+		}
+
+		if (isc_log_wouldlog(ns_lctx, XFROUT_RR_LOGLEVEL))
+			log_rr(name, rdata, ttl); /* XXX */
+
+		result = dns_message_gettempname(msg, &msgname);
+		if (result != ISC_R_SUCCESS)
+			goto failure;
+		dns_name_init(msgname, NULL);
+		isc_buffer_availableregion(buf, &r);
+		INSIST(r.length >= name->length);
+		r.length = name->length;
+		isc_buffer_putmem(buf, name->ndata, name->length);
+		dns_name_fromregion(msgname, &r);
+
+		/* Reserve space for RR header. */
+		isc_buffer_add(buf, 10);
+
+		result = dns_message_gettemprdata(msg, &msgrdata);
+		if (result != ISC_R_SUCCESS)
+			goto failure;
+		isc_buffer_availableregion(buf, &r);
+		r.length = rdata->length;
+		isc_buffer_putmem(buf, rdata->data, rdata->length);
+		dns_rdata_init(msgrdata);
+		dns_rdata_fromregion(msgrdata,
+				     rdata->rdclass, rdata->type, &r);
+
+		result = dns_message_gettemprdatalist(msg, &msgrdl);
+		if (result != ISC_R_SUCCESS)
+			goto failure;
+		msgrdl->type = rdata->type;
+		msgrdl->rdclass = rdata->rdclass;
+		msgrdl->ttl = ttl;
+		if (rdata->type == dns_rdatatype_sig ||
+		    rdata->type == dns_rdatatype_rrsig)
+			msgrdl->covers = dns_rdata_covers(rdata);
+		else
+			msgrdl->covers = dns_rdatatype_none;
+		ISC_LIST_APPEND(msgrdl->rdata, msgrdata, link);
+
+		result = dns_message_gettemprdataset(msg, &msgrds);
+		if (result != ISC_R_SUCCESS)
+			goto failure;
+		result = dns_rdatalist_tordataset(msgrdl, msgrds);
+		INSIST(result == ISC_R_SUCCESS);
+
+		ISC_LIST_APPEND(msgname->list, msgrds, link);
+
+		dns_message_addname(msg, msgname, DNS_SECTION_ANSWER);
+		msgname = NULL;
+
+		result = stream->methods->next(stream);
+		if (result == ISC_R_NOMORE) {
+			*eos = ISC_TRUE;
+			break;
+		}
+		CHECK(result);
+
+		if (! many_answers)
+			break;
+		/*
+		 * At this stage, at least 1 RR has been rendered into
+		 * the message. Check if we want to clamp this message
+		 * here.
+		 */
+		if (isc_buffer_usedlength(buf) >= limit)
+			break;
+	}
+
+	result = ISC_R_SUCCESS;
+
+ failure:
+	if (msgname != NULL) {
+		if (msgrds != NULL) {
+			if (dns_rdataset_isassociated(msgrds))
+				dns_rdataset_disassociate(msgrds);
+			dns_message_puttemprdataset(msg, &msgrds);
+		}
+		if (msgrdl != NULL) {
+			ISC_LIST_UNLINK(msgrdl->rdata, msgrdata, link);
+			dns_message_puttemprdatalist(msg, &msgrdl);
+		}
+		if (msgrdata != NULL)
+			dns_message_puttemprdata(msg, &msgrdata);
+		dns_message_puttempname(msg, &msgname);
+	}
+	return (result);
+}
+
 /**************************************************************************/
 /*
  * An 'xfrout_ctx_t' contains the state of an outgoing AXFR or IXFR
  * in progress.
  */
 
-typedef struct {
+/*%
+ * How a transfer using a shared rendered stream ('cache') gets on: the
+ * first message carrying the question and the leading SOA is built
+ * for the transfer itself, then the shared messages follow, and the
+ * trailing SOA is again the transfer's own.
+ */
+typedef enum {
+	xfrout_uncached = 0,
+	xfrout_head,
+	xfrout_body,
+	xfrout_tail
+} xfrout_phase_t;
+
+/*%
+ * Number of shared messages a transfer keeps queued on its socket.
+ */
+#define XFROUT_PIPELINE		4
+
+/*%
+ * Room left in every shared message for the per-transfer OPT record.
+ */
+#define XFROUT_OPTSPACE		512
+
+typedef struct xfrout_ctx xfrout_ctx_t;
+
+struct xfrout_ctx {
 	isc_mem_t 		*mctx;
 	ns_client_t		*client;
 	unsigned int 		id;		/* ID of request */
@@ -674,7 +848,15 @@ typedef struct {
 	int			sends;		/* Send in progress */
 	isc_boolean_t		shuttingdown;
 	const char		*mnemonic;	/* Style of transfer */
-} xfrout_ctx_t;
+	ns_xfrcache_t		*cache;		/* Shared rendered stream */
+	xfrout_phase_t		phase;
+	unsigned int		cachepos;	/* Next shared message */
+	isc_boolean_t		waiting;	/* On the cache's waiters */
+	isc_event_t		readyevent;
+	ISC_LINK(xfrout_ctx_t)	link;
+	unsigned char		opt[XFROUT_OPTSPACE];
+	unsigned int		optlen;
+};
 
 static isc_result_t
 xfrout_ctx_create(isc_mem_t *mctx, ns_client_t *client,
@@ -716,6 +898,565 @@ static void
 xfrout_log(xfrout_ctx_t *xfr, int level, const char *fmt, ...)
 	   ISC_FORMAT_PRINTF(3, 4);
 
+static void
+sendcached(xfrout_ctx_t *xfr);
+
+static void
+xfrout_startcached(xfrout_ctx_t *xfr);
+
+static void
+xfrout_cacheready(isc_task_t *task, isc_event_t *event);
+
+/**************************************************************************/
+/*
+ * An 'ns_xfrcache_t' holds the AXFR stream of one zone version rendered
+ * into TCP continuation messages, so that the transfers of that version
+ * running at the same time share a single rendering.  A fill task walks
+ * the database once, packing RRs into batches of one message each, and
+ * hands the batches round robin to the render tasks, which compress
+ * them in parallel.  The rendered messages are kept in stream order;
+ * the first 'nready' of them are complete and may be sent.
+ *
+ * The cache is found through the server's 'xfrcaches' list and lives
+ * until the last transfer detaches and the last of its events is done.
+ */
+
+#define XFRCACHE_MAGIC		ISC_MAGIC('X', 'f', 'r', 'C')
+#define XFRCACHE_VALID(c)	ISC_MAGIC_VALID(c, XFRCACHE_MAGIC)
+
+/*%
+ * Largest message in the cache, leaving room for an OPT record.
+ */
+#define XFRCACHE_MSGSIZE	(65535 - XFROUT_OPTSPACE)
+
+struct ns_xfrcache {
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	ns_server_t		*sctx;
+	isc_mutex_t		lock;
+	ISC_LINK(ns_xfrcache_t)	link;		/* sctx->xfrcaches */
+	unsigned int		references;	/* Transfers using it */
+	unsigned int		events;		/* Fill and render events */
+	dns_db_t		*db;
+	dns_dbversion_t		*ver;
+	unsigned int		limit;		/* transfer-message-size */
+	rrstream_t		*stream;	/* Used by the fill task */
+	isc_task_t		*filltask;
+	isc_task_t		**tasks;	/* Render tasks */
+	unsigned int		ntasks;
+	isc_boolean_t		filling;	/* Fill event queued */
+	isc_boolean_t		eos;		/* Last batch made */
+	isc_boolean_t		done;		/* Rendered, or failed */
+	isc_result_t		result;
+	unsigned int		rendering;	/* Batches not yet rendered */
+	isc_region_t		*msgs;
+	unsigned int		nmsgs;		/* Batches made */
+	unsigned int		nready;
+	unsigned int		size;		/* Entries in 'msgs' */
+	ISC_LIST(xfrout_ctx_t)	waiters;
+};
+
+typedef struct {
+	ISC_EVENT_COMMON(void);
+	unsigned int		seq;
+	dns_message_t		*msg;
+	isc_buffer_t		buf;		/* Owner names and rdata */
+} xfrcache_batch_t;
+
+static void
+xfrcache_makebatches(isc_task_t *task, isc_event_t *event);
+
+static void
+xfrcache_render(isc_task_t *task, isc_event_t *event);
+
+static void
+xfrcache_destroy(ns_xfrcache_t **cachep) {
+	ns_xfrcache_t *cache = *cachep;
+	ns_server_t *sctx = NULL;
+	unsigned int i;
+
+	*cachep = NULL;
+
+	INSIST(cache->references == 0 && cache->events == 0);
+	INSIST(ISC_LIST_EMPTY(cache->waiters));
+	cache->magic = 0;
+
+	if (cache->filltask != NULL)
+		isc_task_detach(&cache->filltask);
+	if (cache->tasks != NULL) {
+		for (i = 0; i < cache->ntasks; i++)
+			if (cache->tasks[i] != NULL)
+				isc_task_detach(&cache->tasks[i]);
+		isc_mem_put(cache->mctx, cache->tasks,
+			    cache->ntasks * sizeof(cache->tasks[0]));
+	}
+	if (cache->msgs != NULL) {
+		for (i = 0; i < cache->nmsgs; i++)
+			if (cache->msgs[i].base != NULL)
+				isc_mem_put(cache->mctx, cache->msgs[i].base,
+					    cache->msgs[i].length);
+		isc_mem_put(cache->mctx, cache->msgs,
+			    cache->size * sizeof(cache->msgs[0]));
+	}
+	if (cache->stream != NULL)
+		cache->stream->methods->destroy(&cache->stream);
+	if (cache->ver != NULL)
+		dns_db_closeversion(cache->db, &cache->ver, ISC_FALSE);
+	if (cache->db != NULL)
+		dns_db_detach(&cache->db);
+	DESTROYLOCK(&cache->lock);
+
+	/* The server may go with the cache's reference. */
+	sctx = cache->sctx;
+	cache->sctx = NULL;
+	isc_mem_putanddetach(&cache->mctx, cache, sizeof(*cache));
+	if (sctx != NULL)
+		ns_server_detach(&sctx);
+}
+
+/*
+ * Tell the waiting transfers that there is more to send, or that the
+ * cache is done.  Called with the cache locked.
+ */
+static void
+xfrcache_wake(ns_xfrcache_t *cache) {
+	xfrout_ctx_t *xfr;
+	isc_event_t *event;
+
+	while ((xfr = ISC_LIST_HEAD(cache->waiters)) != NULL) {
+		ISC_LIST_UNLINK(cache->waiters, xfr, link);
+		event = &xfr->readyevent;
+		ISC_EVENT_INIT(event, sizeof(*event), 0, NULL,
+			       NS_EVENT_XFRCACHEREADY, xfrout_cacheready,
+			       xfr, cache, NULL, NULL);
+		isc_task_send(xfr->client->task, &event);
+	}
+}
+
+/*
+ * Record the end of rendering.  Called with the cache locked.
+ */
+static void
+xfrcache_finish(ns_xfrcache_t *cache, isc_result_t result) {
+	if (cache->done)
+		return;
+	cache->done = ISC_TRUE;
+	cache->result = result;
+	if (result != ISC_R_SUCCESS) {
+		char namebuf[DNS_NAME_FORMATSIZE];
+
+		dns_name_format(dns_db_origin(cache->db),
+				namebuf, sizeof(namebuf));
+		isc_log_write(XFROUT_COMMON_LOGARGS, ISC_LOG_ERROR,
+			      "rendering zone '%s' for transfer: %s",
+			      namebuf, isc_result_totext(result));
+	}
+	xfrcache_wake(cache);
+}
+
+/*
+ * Pack the RRs of the next message into a render event for batch 'seq'.
+ */
+static isc_result_t
+xfrcache_makebatch(ns_xfrcache_t *cache, unsigned int seq,
+		   xfrcache_batch_t **batchp, isc_boolean_t *eos)
+{
+	xfrcache_batch_t *batch;
+	isc_result_t result;
+	unsigned int size = 0;
+	void *mem;
+
+	batch = (xfrcache_batch_t *)
+		isc_event_allocate(cache->mctx, cache,
+				   NS_EVENT_XFRCACHERENDER,
+				   xfrcache_render, cache, sizeof(*batch));
+	if (batch == NULL)
+		return (ISC_R_NOMEMORY);
+	batch->seq = seq;
+	batch->msg = NULL;
+	mem = isc_mem_get(cache->mctx, XFRCACHE_MSGSIZE);
+	if (mem == NULL) {
+		isc_event_free(ISC_EVENT_PTR(&batch));
+		return (ISC_R_NOMEMORY);
+	}
+	isc_buffer_init(&batch->buf, mem, XFRCACHE_MSGSIZE);
+
+	CHECK(dns_message_create(cache->mctx, DNS_MESSAGE_INTENTRENDER,
+				 &batch->msg));
+	batch->msg->id = 0;
+	batch->msg->rcode = dns_rcode_noerror;
+	batch->msg->flags = DNS_MESSAGEFLAG_QR | DNS_MESSAGEFLAG_AA;
+	batch->msg->tcp_continuation = 1;
+
+	/*
+	 * Reserve space for the 12-byte message header.
+	 */
+	isc_buffer_add(&batch->buf, 12);
+	result = addrrs(cache->stream, batch->msg, &batch->buf, ISC_TRUE,
+			cache->limit, eos, &size);
+	if (result == ISC_R_NOSPACE) {
+		char namebuf[DNS_NAME_FORMATSIZE];
+
+		dns_name_format(dns_db_origin(cache->db),
+				namebuf, sizeof(namebuf));
+		isc_log_write(XFROUT_COMMON_LOGARGS, ISC_LOG_WARNING,
+			      "transfer of '%s': RR too large for zone "
+			      "transfer (%d bytes)", namebuf, size);
+	}
+	CHECK(result);
+
+	*batchp = batch;
+	return (ISC_R_SUCCESS);
+
+ failure:
+	if (batch->msg != NULL)
+		dns_message_destroy(&batch->msg);
+	isc_mem_put(cache->mctx, batch->buf.base, batch->buf.length);
+	isc_event_free(ISC_EVENT_PTR(&batch));
+	return (result);
+}
+
+/*
+ * Queue a fill event unless one is queued already, or there is nothing
+ * to fill.  Called with the cache locked.
+ */
+static void
+xfrcache_fill(ns_xfrcache_t *cache) {
+	isc_event_t *event;
+
+	if (cache->filling || cache->eos || cache->done ||
+	    cache->references == 0 || cache->rendering >= 2 * cache->ntasks)
+		return;
+
+	event = isc_event_allocate(cache->mctx, cache, NS_EVENT_XFRCACHEFILL,
+				   xfrcache_makebatches, cache, sizeof(*event));
+	if (event == NULL) {
+		xfrcache_finish(cache, ISC_R_NOMEMORY);
+		return;
+	}
+	cache->filling = ISC_TRUE;
+	cache->events++;
+	isc_task_send(cache->filltask, &event);
+}
+
+/*
+ * Make batches for the render tasks, keeping at most two per task
+ * waiting to be rendered.  Runs on the fill task, which is the only
+ * user of the database iterator.
+ */
+static void
+xfrcache_makebatches(isc_task_t *task, isc_event_t *event) {
+	ns_xfrcache_t *cache = event->ev_arg;
+	xfrcache_batch_t *batch;
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_boolean_t eos, destroy;
+	isc_region_t *msgs;
+	unsigned int seq, size;
+
+	UNUSED(task);
+
+	REQUIRE(XFRCACHE_VALID(cache));
+
+	isc_event_free(&event);
+
+	LOCK(&cache->lock);
+	while (!cache->eos && !cache->done && cache->references > 0 &&
+	       cache->rendering < 2 * cache->ntasks)
+	{
+		if (cache->nmsgs == cache->size) {
+			size = cache->size * 2;
+			msgs = isc_mem_get(cache->mctx, size * sizeof(*msgs));
+			if (msgs == NULL) {
+				result = ISC_R_NOMEMORY;
+				break;
+			}
+			memset(msgs, 0, size * sizeof(*msgs));
+			memmove(msgs, cache->msgs,
+				cache->size * sizeof(*msgs));
+			isc_mem_put(cache->mctx, cache->msgs,
+				    cache->size * sizeof(*msgs));
+			cache->msgs = msgs;
+			cache->size = size;
+		}
+		seq = cache->nmsgs;
+		UNLOCK(&cache->lock);
+
+		batch = NULL;
+		eos = ISC_FALSE;
+		result = xfrcache_makebatch(cache, seq, &batch, &eos);
+
+		LOCK(&cache->lock);
+		if (result != ISC_R_SUCCESS)
+			break;
+		cache->nmsgs++;
+		cache->eos = eos;
+		cache->rendering++;
+		cache->events++;
+		isc_task_send(cache->tasks[seq % cache->ntasks],
+			      ISC_EVENT_PTR(&batch));
+	}
+	/*
+	 * Make sure to release any locks held by the database
+	 * iterator before returning from the event handler.
+	 */
+	cache->stream->methods->pause(cache->stream);
+
+	if (result != ISC_R_SUCCESS)
+		xfrcache_finish(cache, result);
+	else if (cache->eos && cache->rendering == 0)
+		xfrcache_finish(cache, ISC_R_SUCCESS);
+	cache->filling = ISC_FALSE;
+	cache->events--;
+	destroy = ISC_TF(cache->references == 0 && cache->events == 0);
+	UNLOCK(&cache->lock);
+
+	if (destroy)
+		xfrcache_destroy(&cache);
+}
+
+/*
+ * Compress one batch into its place in the stream.  Runs on one of the
+ * render tasks.
+ */
+static void
+xfrcache_render(isc_task_t *task, isc_event_t *event) {
+	xfrcache_batch_t *batch = (xfrcache_batch_t *)event;
+	ns_xfrcache_t *cache = event->ev_arg;
+	isc_result_t result;
+	isc_buffer_t target;
+	isc_region_t used, r;
+	dns_compress_t cctx;
+	isc_boolean_t cleanup_cctx = ISC_FALSE;
+	isc_boolean_t destroy, more = ISC_FALSE;
+	void *mem = NULL;
+
+	UNUSED(task);
+
+	REQUIRE(XFRCACHE_VALID(cache));
+
+	r.base = NULL;
+	r.length = 0;
+
+	mem = isc_mem_get(cache->mctx, XFRCACHE_MSGSIZE);
+	if (mem == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto failure;
+	}
+	isc_buffer_init(&target, mem, XFRCACHE_MSGSIZE);
+
+	CHECK(dns_compress_init(&cctx, -1, cache->mctx));
+	dns_compress_setsensitive(&cctx, ISC_TRUE);
+	cleanup_cctx = ISC_TRUE;
+	CHECK(dns_message_renderbegin(batch->msg, &cctx, &target));
+	CHECK(dns_message_rendersection(batch->msg, DNS_SECTION_ANSWER, 0));
+	CHECK(dns_message_renderend(batch->msg));
+	dns_compress_invalidate(&cctx);
+	cleanup_cctx = ISC_FALSE;
+
+	isc_buffer_usedregion(&target, &used);
+	r.base = isc_mem_get(cache->mctx, used.length);
+	if (r.base == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto failure;
+	}
+	r.length = used.length;
+	memmove(r.base, used.base, used.length);
+
+ failure:
+	if (cleanup_cctx)
+		dns_compress_invalidate(&cctx);
+	if (mem != NULL)
+		isc_mem_put(cache->mctx, mem, XFRCACHE_MSGSIZE);
+
+	LOCK(&cache->lock);
+	INSIST(cache->rendering > 0);
+	cache->rendering--;
+	if (result == ISC_R_SUCCESS) {
+		cache->msgs[batch->seq] = r;
+		while (cache->nready < cache->nmsgs &&
+		       cache->msgs[cache->nready].base != NULL)
+		{
+			cache->nready++;
+			more = ISC_TRUE;
+		}
+		if (cache->eos && cache->rendering == 0)
+			xfrcache_finish(cache, ISC_R_SUCCESS);
+		else if (more)
+			xfrcache_wake(cache);
+		xfrcache_fill(cache);
+	} else
+		xfrcache_finish(cache, result);
+	cache->events--;
+	destroy = ISC_TF(cache->references == 0 && cache->events == 0);
+	UNLOCK(&cache->lock);
+
+	dns_message_destroy(&batch->msg);
+	isc_mem_put(cache->mctx, batch->buf.base, batch->buf.length);
+	isc_event_free(&event);
+
+	if (destroy)
+		xfrcache_destroy(&cache);
+}
+
+static isc_result_t
+xfrcache_create(ns_client_t *client, dns_db_t *db, dns_dbversion_t *ver,
+		ns_xfrcache_t **cachep)
+{
+	ns_server_t *sctx = client->sctx;
+	ns_xfrcache_t *cache;
+	isc_taskmgr_t *taskmgr = ns_client_gettaskmgr(client);
+	isc_event_t *event = NULL;
+	isc_result_t result;
+	unsigned int i;
+
+	cache = isc_mem_get(sctx->mctx, sizeof(*cache));
+	if (cache == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(cache, 0, sizeof(*cache));
+	result = isc_mutex_init(&cache->lock);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(sctx->mctx, cache, sizeof(*cache));
+		return (result);
+	}
+	isc_mem_attach(sctx->mctx, &cache->mctx);
+	ISC_LINK_INIT(cache, link);
+	ISC_LIST_INIT(cache->waiters);
+	cache->references = 1;
+	cache->limit = sctx->transfer_tcp_message_size;
+	cache->result = ISC_R_SUCCESS;
+	cache->magic = XFRCACHE_MAGIC;
+	dns_db_attach(db, &cache->db);
+	dns_db_attachversion(db, ver, &cache->ver);
+
+	cache->size = 64;
+	cache->msgs = isc_mem_get(cache->mctx,
+				  cache->size * sizeof(cache->msgs[0]));
+	if (cache->msgs == NULL) {
+		cache->size = 0;
+		CHECK(ISC_R_NOMEMORY);
+	}
+	memset(cache->msgs, 0, cache->size * sizeof(cache->msgs[0]));
+
+	CHECK(axfr_rrstream_create(cache->mctx, db, ver, &cache->stream));
+	result = cache->stream->methods->first(cache->stream);
+	if (result == ISC_R_NOMORE)
+		cache->eos = ISC_TRUE;
+	else
+		CHECK(result);
+	cache->stream->methods->pause(cache->stream);
+
+	cache->ntasks = sctx->transfer_render_threads;
+	INSIST(cache->ntasks > 0);
+	cache->tasks = isc_mem_get(cache->mctx,
+				   cache->ntasks * sizeof(cache->tasks[0]));
+	if (cache->tasks == NULL) {
+		cache->ntasks = 0;
+		CHECK(ISC_R_NOMEMORY);
+	}
+	memset(cache->tasks, 0, cache->ntasks * sizeof(cache->tasks[0]));
+	CHECK(isc_task_create(taskmgr, 0, &cache->filltask));
+	isc_task_setname(cache->filltask, "xfrcachefill", cache);
+	for (i = 0; i < cache->ntasks; i++) {
+		CHECK(isc_task_create(taskmgr, 0, &cache->tasks[i]));
+		isc_task_setname(cache->tasks[i], "xfrcacherender", cache);
+	}
+
+	event = isc_event_allocate(cache->mctx, cache, NS_EVENT_XFRCACHEFILL,
+				   xfrcache_makebatches, cache, sizeof(*event));
+	if (event == NULL)
+		CHECK(ISC_R_NOMEMORY);
+	ns_server_attach(sctx, &cache->sctx);
+	cache->filling = ISC_TRUE;
+	cache->events = 1;
+	isc_task_send(cache->filltask, &event);
+
+	*cachep = cache;
+	return (ISC_R_SUCCESS);
+
+ failure:
+	cache->references = 0;
+	xfrcache_destroy(&cache);
+	return (result);
+}
+
+/*
+ * Find the shared stream for 'db' and 'ver', or start rendering one.
+ * Returns ISC_R_NOSPACE if the version is larger than
+ * 'transfer-render-max-size', or its size is not known: the whole
+ * rendered copy stays in memory until the last transfer using it ends.
+ */
+static isc_result_t
+xfrcache_attach(ns_client_t *client, dns_db_t *db, dns_dbversion_t *ver,
+		ns_xfrcache_t **cachep)
+{
+	ns_server_t *sctx = client->sctx;
+	ns_xfrcache_t *cache;
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_boolean_t found = ISC_FALSE;
+	isc_uint64_t bytes = 0;
+
+	REQUIRE(cachep != NULL && *cachep == NULL);
+
+	if (sctx->transfer_render_maxsize != ISC_UINT64_MAX) {
+		result = dns_db_getsize(db, ver, NULL, &bytes);
+		if (result != ISC_R_SUCCESS ||
+		    bytes > sctx->transfer_render_maxsize)
+			return (ISC_R_NOSPACE);
+	}
+
+	LOCK(&sctx->xfrcachelock);
+	for (cache = ISC_LIST_HEAD(sctx->xfrcaches);
+	     cache != NULL;
+	     cache = ISC_LIST_NEXT(cache, link))
+	{
+		if (cache->db != db || cache->ver != ver ||
+		    cache->limit != sctx->transfer_tcp_message_size)
+			continue;
+		LOCK(&cache->lock);
+		if (!cache->done || cache->result == ISC_R_SUCCESS) {
+			cache->references++;
+			found = ISC_TRUE;
+		}
+		UNLOCK(&cache->lock);
+		if (found)
+			break;
+	}
+	if (cache == NULL) {
+		result = xfrcache_create(client, db, ver, &cache);
+		if (result == ISC_R_SUCCESS)
+			ISC_LIST_APPEND(sctx->xfrcaches, cache, link);
+	}
+	UNLOCK(&sctx->xfrcachelock);
+
+	if (result == ISC_R_SUCCESS)
+		*cachep = cache;
+	return (result);
+}
+
+static void
+xfrcache_detach(ns_server_t *sctx, ns_xfrcache_t **cachep) {
+	ns_xfrcache_t *cache;
+	isc_boolean_t destroy = ISC_FALSE;
+
+	REQUIRE(cachep != NULL && XFRCACHE_VALID(*cachep));
+
+	cache = *cachep;
+	*cachep = NULL;
+
+	LOCK(&sctx->xfrcachelock);
+	LOCK(&cache->lock);
+	INSIST(cache->references > 0);
+	if (--cache->references == 0) {
+		ISC_LIST_UNLINK(sctx->xfrcaches, cache, link);
+		destroy = ISC_TF(cache->events == 0);
+	}
+	UNLOCK(&cache->lock);
+	UNLOCK(&sctx->xfrcachelock);
+
+	if (destroy)
+		xfrcache_destroy(&cache);
+}
+
 /**************************************************************************/
 
 void
@@ -751,6 +1492,7 @@ ns_xfr_start(ns_client_t *client, dns_rdatatype_t reqtype) {
 	isc_boolean_t is_dlz = ISC_FALSE;
 	isc_boolean_t is_ixfr = ISC_FALSE;
 	isc_uint32_t begin_serial = 0, current_serial;
+	ns_xfrcache_t *cache = NULL;
 
 	switch (reqtype) {
 	case dns_rdatatype_axfr:
@@ -1008,6 +1750,29 @@ ns_xfr_start(ns_client_t *client, dns_rdatatype_t reqtype) {
 		is_ixfr = ISC_TRUE;
 	} else {
 	axfr_fallback:
+		/*
+		 * Send the zone data from the shared rendered stream
+		 * if the messages need nothing specific to this
+		 * transfer but an ID, flags and an OPT record.
+		 */
+		if (client->sctx->transfer_render_threads > 0 && !is_dlz &&
+		    (client->attributes & NS_CLIENTATTR_TCP) != 0 &&
+		    format == dns_many_answers &&
+		    dns_message_gettsigkey(request) == NULL)
+		{
+			result = xfrcache_attach(client, db, ver, &cache);
+			if (result == ISC_R_SUCCESS) {
+				CHECK(soa_rrstream_create(mctx, db, ver,
+							  &stream));
+				goto have_stream;
+			}
+			if (result == ISC_R_NOSPACE)
+				xfrout_log1(client, question_name,
+					    question_class, ISC_LOG_DEBUG(4),
+					    "zone larger than "
+					    "transfer-render-max-size, "
+					    "rendering separately");
+		}
 		CHECK(axfr_rrstream_create(mctx, db, ver, &data_stream));
 	}
 
@@ -1057,6 +1822,11 @@ ns_xfr_start(ns_client_t *client, dns_rdatatype_t reqtype) {
 	xfr->mnemonic = mnemonic;
 	stream = NULL;
 	quota = NULL;
+	if (cache != NULL) {
+		xfr->cache = cache;
+		xfr->phase = xfrout_head;
+		cache = NULL;
+	}
 
 	CHECK(xfr->stream->methods->first(xfr->stream));
 
@@ -1113,6 +1883,8 @@ ns_xfr_start(ns_client_t *client, dns_rdatatype_t reqtype) {
 		inc_stats(client, zone, ns_statscounter_xfrrej);
 	if (quota != NULL)
 		isc_quota_detach(&quota);
+	if (cache != NULL)
+		xfrcache_detach(client->sctx, &cache);
 	if (current_soa_tuple != NULL)
 		dns_difftuple_free(&current_soa_tuple);
 	if (stream != NULL)
@@ -1187,6 +1959,12 @@ xfrout_ctx_create(isc_mem_t *mctx, ns_client_t *client, unsigned int id,
 	xfr->txmemlen = 0;
 	xfr->stream = NULL;
 	xfr->quota = NULL;
+	xfr->cache = NULL;
+	xfr->phase = xfrout_uncached;
+	xfr->cachepos = 0;
+	xfr->waiting = ISC_FALSE;
+	ISC_LINK_INIT(xfr, link);
+	xfr->optlen = 0;
 
 	/*
 	 * Allocate a temporary buffer for the uncompressed response
@@ -1263,15 +2041,10 @@ sendstream(xfrout_ctx_t *xfr) {
 	isc_region_t used;
 	isc_region_t region;
 	dns_rdataset_t *qrdataset;
-	dns_name_t *msgname = NULL;
-	dns_rdata_t *msgrdata = NULL;
-	dns_rdatalist_t *msgrdl = NULL;
-	dns_rdataset_t *msgrds = NULL;
 	dns_compress_t cctx;
 	isc_boolean_t cleanup_cctx = ISC_FALSE;
-	isc_boolean_t is_tcp;
-
-	int n_rrs;
+	isc_boolean_t is_tcp, copied;
+	unsigned int size = 0;
 
 	isc_buffer_clear(&xfr->buf);
 	isc_buffer_clear(&xfr->txlenbuf);
@@ -1381,115 +2154,14 @@ sendstream(xfrout_ctx_t *xfr) {
 	 * Try to fit in as many RRs as possible, unless "one-answer"
 	 * format has been requested.
 	 */
-	for (n_rrs = 0; ; n_rrs++) {
-		dns_name_t *name = NULL;
-		isc_uint32_t ttl;
-		dns_rdata_t *rdata = NULL;
-
-		unsigned int size;
-		isc_region_t r;
-
-		msgname = NULL;
-		msgrdata = NULL;
-		msgrdl = NULL;
-		msgrds = NULL;
-
-		xfr->stream->methods->current(xfr->stream,
-					      &name, &ttl, &rdata);
-		size = name->length + 10 + rdata->length;
-		isc_buffer_availableregion(&xfr->buf, &r);
-		if (size >= r.length) {
-			/*
-			 * RR would not fit.  If there are other RRs in the
-			 * buffer, send them now and leave this RR to the
-			 * next message.  If this RR overflows the buffer
-			 * all by itself, fail.
-			 *
-			 * In theory some RRs might fit in a TCP message
-			 * when compressed even if they do not fit when
-			 * uncompressed, but surely we don't want
-			 * to send such monstrosities to an unsuspecting
-			 * slave.
-			 */
-			if (n_rrs == 0) {
-				xfrout_log(xfr, ISC_LOG_WARNING,
-					   "RR too large for zone transfer "
-					   "(%d bytes)", size);
-				/* XXX DNS_R_RRTOOLARGE? */
-				result = ISC_R_NOSPACE;
-				goto failure;
-			}
-			break;
-		}
-
-		if (isc_log_wouldlog(ns_lctx, XFROUT_RR_LOGLEVEL))
-			log_rr(name, rdata, ttl); /* XXX */
-
-		result = dns_message_gettempname(msg, &msgname);
-		if (result != ISC_R_SUCCESS)
-			goto failure;
-		dns_name_init(msgname, NULL);
-		isc_buffer_availableregion(&xfr->buf, &r);
-		INSIST(r.length >= name->length);
-		r.length = name->length;
-		isc_buffer_putmem(&xfr->buf, name->ndata, name->length);
-		dns_name_fromregion(msgname, &r);
-
-		/* Reserve space for RR header. */
-		isc_buffer_add(&xfr->buf, 10);
-
-		result = dns_message_gettemprdata(msg, &msgrdata);
-		if (result != ISC_R_SUCCESS)
-			goto failure;
-		isc_buffer_availableregion(&xfr->buf, &r);
-		r.length = rdata->length;
-		isc_buffer_putmem(&xfr->buf, rdata->data, rdata->length);
-		dns_rdata_init(msgrdata);
-		dns_rdata_fromregion(msgrdata,
-				     rdata->rdclass, rdata->type, &r);
-
-		result = dns_message_gettemprdatalist(msg, &msgrdl);
-		if (result != ISC_R_SUCCESS)
-			goto failure;
-		msgrdl->type = rdata->type;
-		msgrdl->rdclass = rdata->rdclass;
-		msgrdl->ttl = ttl;
-		if (rdata->type == dns_rdatatype_sig ||
-		    rdata->type == dns_rdatatype_rrsig)
-			msgrdl->covers = dns_rdata_covers(rdata);
-		else
-			msgrdl->covers = dns_rdatatype_none;
-		ISC_LIST_APPEND(msgrdl->rdata, msgrdata, link);
-
-		result = dns_message_gettemprdataset(msg, &msgrds);
-		if (result != ISC_R_SUCCESS)
-			goto failure;
-		result = dns_rdatalist_tordataset(msgrdl, msgrds);
-		INSIST(result == ISC_R_SUCCESS);
-
-		ISC_LIST_APPEND(msgname->list, msgrds, link);
-
-		dns_message_addname(msg, msgname, DNS_SECTION_ANSWER);
-		msgname = NULL;
-
-		result = xfr->stream->methods->next(xfr->stream);
-		if (result == ISC_R_NOMORE) {
-			xfr->end_of_stream = ISC_TRUE;
-			break;
-		}
-		CHECK(result);
-
-		if (! xfr->many_answers)
-			break;
-		/*
-		 * At this stage, at least 1 RR has been rendered into
-		 * the message. Check if we want to clamp this message
-		 * here (TCP only).
-		 */
-		if ((isc_buffer_usedlength(&xfr->buf) >=
-		     xfr->client->sctx->transfer_tcp_message_size) && is_tcp)
-			break;
-	}
+	result = addrrs(xfr->stream, msg, &xfr->buf, xfr->many_answers,
+			is_tcp ? xfr->client->sctx->transfer_tcp_message_size :
+				 ISC_UINT32_MAX,
+			&xfr->end_of_stream, &size);
+	if (result == ISC_R_NOSPACE)
+		xfrout_log(xfr, ISC_LOG_WARNING,
+			   "RR too large for zone transfer (%d bytes)", size);
+	CHECK(result);
 
 	if (is_tcp) {
 		CHECK(dns_compress_init(&cctx, -1, xfr->mctx));
@@ -1510,10 +2182,8 @@ sendstream(xfrout_ctx_t *xfr) {
 		xfrout_log(xfr, ISC_LOG_DEBUG(8),
 			   "sending TCP message of %d bytes",
 			   used.length);
-		CHECK(isc_socket_send(xfr->client->tcpsocket, /* XXX */
-				      &region, xfr->client->task,
-				      xfrout_senddone,
-				      xfr));
+		CHECK(ns_client_sendstream(xfr->client, xfr->mctx, &region,
+					   xfrout_senddone, xfr, &copied));
 		xfr->sends++;
 	} else {
 		xfrout_log(xfr, ISC_LOG_DEBUG(8), "sending IXFR UDP response");
@@ -1529,21 +2199,6 @@ sendstream(xfrout_ctx_t *xfr) {
 	xfr->nmsg++;
 
  failure:
-	if (msgname != NULL) {
-		if (msgrds != NULL) {
-			if (dns_rdataset_isassociated(msgrds))
-				dns_rdataset_disassociate(msgrds);
-			dns_message_puttemprdataset(msg, &msgrds);
-		}
-		if (msgrdl != NULL) {
-			ISC_LIST_UNLINK(msgrdl->rdata, msgrdata, link);
-			dns_message_puttemprdatalist(msg, &msgrdl);
-		}
-		if (msgrdata != NULL)
-			dns_message_puttemprdata(msg, &msgrdata);
-		dns_message_puttempname(msg, &msgname);
-	}
-
 	if (tcpmsg != NULL)
 		dns_message_destroy(&tcpmsg);
 
@@ -1567,10 +2222,13 @@ xfrout_ctx_destroy(xfrout_ctx_t **xfrp) {
 	ns_client_t *client = NULL;
 
 	INSIST(xfr->sends == 0);
+	INSIST(!xfr->waiting);
 
 	xfr->client->shutdown = NULL;
 	xfr->client->shutdown_arg = NULL;
 
+	if (xfr->cache != NULL)
+		xfrcache_detach(xfr->client->sctx, &xfr->cache);
 	if (xfr->stream != NULL)
 		xfr->stream->methods->destroy(&xfr->stream);
 	if (xfr->buf.base != NULL)
@@ -1610,17 +2268,31 @@ xfrout_senddone(isc_task_t *task, isc_event_t *event) {
 
 	INSIST(event->ev_type == ISC_SOCKEVENT_SENDDONE);
 
+	/*
+	 * Shared messages, and all messages encrypted for DNS-over-TLS,
+	 * are sent from copies of their own.
+	 */
+	if ((void *)sev->region.base != xfr->txmem)
+		isc_mem_put(xfr->mctx, sev->region.base, sev->region.length);
 	isc_event_free(&event);
 	xfr->sends--;
-	INSIST(xfr->sends == 0);
+	INSIST(xfr->sends == 0 ||
+	       (xfr->cache != NULL && xfr->sends > 0));
 
 	(void)isc_timer_touch(xfr->client->timer);
 	if (xfr->shuttingdown == ISC_TRUE) {
 		xfrout_maybe_destroy(xfr);
 	} else if (evresult != ISC_R_SUCCESS) {
 		xfrout_fail(xfr, evresult, "send");
+	} else if (xfr->phase == xfrout_body) {
+		if (!xfr->waiting)
+			sendcached(xfr);
 	} else if (xfr->end_of_stream == ISC_FALSE) {
 		sendstream(xfr);
+	} else if (xfr->phase == xfrout_head) {
+		xfrout_startcached(xfr);
+	} else if (xfr->sends > 0) {
+		/* Wait for the shared messages still being sent. */
 	} else {
 		/* End of zone transfer stream. */
 		inc_stats(xfr->client, xfr->zone, ns_statscounter_xfrdone);
@@ -1630,6 +2302,155 @@ xfrout_senddone(isc_task_t *task, isc_event_t *event) {
 	}
 }
 
+/*
+ * Render the OPT record to append to the shared messages sent by 'xfr',
+ * if the client asked for one.  The first message has been sent, so
+ * this leaves out the options that belong in the first message only.
+ */
+static isc_result_t
+xfrout_renderopt(xfrout_ctx_t *xfr) {
+	dns_message_t *msg = NULL;
+	dns_rdataset_t *opt = NULL;
+	dns_compress_t cctx;
+	isc_boolean_t cleanup_cctx = ISC_FALSE;
+	isc_result_t result;
+	isc_buffer_t b;
+	isc_region_t used;
+	unsigned char wire[12 + XFROUT_OPTSPACE];
+
+	xfr->optlen = 0;
+	if ((xfr->client->attributes & NS_CLIENTATTR_WANTOPT) == 0)
+		return (ISC_R_SUCCESS);
+
+	CHECK(dns_message_create(xfr->mctx, DNS_MESSAGE_INTENTRENDER, &msg));
+	CHECK(ns_client_addopt(xfr->client, msg, &opt));
+	CHECK(dns_message_setopt(msg, opt));
+
+	isc_buffer_init(&b, wire, sizeof(wire));
+	CHECK(dns_compress_init(&cctx, -1, xfr->mctx));
+	cleanup_cctx = ISC_TRUE;
+	CHECK(dns_message_renderbegin(msg, &cctx, &b));
+	CHECK(dns_message_renderend(msg));
+
+	isc_buffer_usedregion(&b, &used);
+	INSIST(used.length > 12 && used.length - 12 <= sizeof(xfr->opt));
+	xfr->optlen = used.length - 12;
+	memmove(xfr->opt, used.base + 12, xfr->optlen);
+
+ failure:
+	if (cleanup_cctx)
+		dns_compress_invalidate(&cctx);
+	if (msg != NULL)
+		dns_message_destroy(&msg);
+	return (result);
+}
+
+/*
+ * The first message is out; go on with the shared messages.
+ */
+static void
+xfrout_startcached(xfrout_ctx_t *xfr) {
+	isc_result_t result;
+
+	result = xfrout_renderopt(xfr);
+	if (result != ISC_R_SUCCESS) {
+		xfrout_fail(xfr, result, "sending zone data");
+		return;
+	}
+	xfrout_log(xfr, ISC_LOG_DEBUG(4), "sending shared zone data");
+	xfr->phase = xfrout_body;
+	sendcached(xfr);
+}
+
+/*
+ * Queue as many of the shared messages as are ready, up to
+ * XFROUT_PIPELINE at a time, each with the request's ID, our RA flag
+ * and our OPT record.  Wait on the cache if we have caught up with the
+ * rendering; once the whole stream is queued, end with the SOA.
+ */
+static void
+sendcached(xfrout_ctx_t *xfr) {
+	ns_xfrcache_t *cache = xfr->cache;
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_boolean_t done = ISC_FALSE, copied;
+	isc_region_t msg = { NULL, 0 }, region;
+	unsigned char *p;
+
+	INSIST(xfr->phase == xfrout_body && !xfr->waiting);
+
+	while (xfr->sends < XFROUT_PIPELINE) {
+		LOCK(&cache->lock);
+		if (xfr->cachepos < cache->nready) {
+			msg = cache->msgs[xfr->cachepos++];
+		} else if (cache->done) {
+			result = cache->result;
+			done = ISC_TRUE;
+		} else {
+			ISC_LIST_APPEND(cache->waiters, xfr, link);
+			xfr->waiting = ISC_TRUE;
+		}
+		UNLOCK(&cache->lock);
+		if (done || xfr->waiting)
+			break;
+
+		region.length = 2 + msg.length + xfr->optlen;
+		region.base = isc_mem_get(xfr->mctx, region.length);
+		if (region.base == NULL) {
+			result = ISC_R_NOMEMORY;
+			break;
+		}
+		p = region.base;
+		p[0] = (msg.length + xfr->optlen) >> 8;
+		p[1] = (msg.length + xfr->optlen) & 0xff;
+		memmove(p + 2, msg.base, msg.length);
+		p[2] = xfr->id >> 8;
+		p[3] = xfr->id & 0xff;
+		if ((xfr->client->attributes & NS_CLIENTATTR_RA) != 0)
+			p[5] |= (DNS_MESSAGEFLAG_RA & 0xff);
+		if (xfr->optlen != 0) {
+			memmove(p + 2 + msg.length, xfr->opt, xfr->optlen);
+			p[12] = 0;
+			p[13] = 1;	/* ARCOUNT */
+		}
+		result = ns_client_sendstream(xfr->client, xfr->mctx,
+					      &region, xfrout_senddone, xfr,
+					      &copied);
+		if (result != ISC_R_SUCCESS || copied)
+			isc_mem_put(xfr->mctx, region.base, region.length);
+		if (result != ISC_R_SUCCESS)
+			break;
+		xfr->sends++;
+		xfr->nmsg++;
+	}
+
+	if (result == ISC_R_SUCCESS && done) {
+		xfr->phase = xfrout_tail;
+		result = xfr->stream->methods->first(xfr->stream);
+		if (result == ISC_R_SUCCESS) {
+			sendstream(xfr);
+			return;
+		}
+	}
+	if (result != ISC_R_SUCCESS)
+		xfrout_fail(xfr, result, "sending zone data");
+}
+
+static void
+xfrout_cacheready(isc_task_t *task, isc_event_t *event) {
+	xfrout_ctx_t *xfr = (xfrout_ctx_t *)event->ev_arg;
+
+	UNUSED(task);
+
+	INSIST(event->ev_type == NS_EVENT_XFRCACHEREADY);
+	INSIST(xfr->waiting);
+
+	xfr->waiting = ISC_FALSE;
+	if (xfr->shuttingdown == ISC_TRUE)
+		xfrout_maybe_destroy(xfr);
+	else
+		sendcached(xfr);
+}
+
 static void
 xfrout_fail(xfrout_ctx_t *xfr, isc_result_t result, const char *msg) {
 	xfr->shuttingdown = ISC_TRUE;
@@ -1641,6 +2462,19 @@ xfrout_fail(xfrout_ctx_t *xfr, isc_result_t result, const char *msg) {
 static void
 xfrout_maybe_destroy(xfrout_ctx_t *xfr) {
 	INSIST(xfr->shuttingdown == ISC_TRUE);
+	if (xfr->waiting) {
+		/*
+		 * Stop waiting for the shared stream, unless we have
+		 * been woken already; then xfrout_cacheready() will
+		 * call us again.
+		 */
+		LOCK(&xfr->cache->lock);
+		if (ISC_LINK_LINKED(xfr, link)) {
+			ISC_LIST_UNLINK(xfr->cache->waiters, xfr, link);
+			xfr->waiting = ISC_FALSE;
+		}
+		UNLOCK(&xfr->cache->lock);
+	}
 	if (xfr->sends > 0) {
 		/*
 		 * If we are currently sending, cancel it and wait for
@@ -1648,7 +2482,7 @@ xfrout_maybe_destroy(xfrout_ctx_t *xfr) {
 		 */
 		isc_socket_cancel(xfr->client->tcpsocket, xfr->client->task,
 				  ISC_SOCKCANCEL_SEND);
-	} else {
+	} else if (!xfr->waiting) {
 		ns_client_next(xfr->client, ISC_R_CANCELED);
 		xfrout_ctx_destroy(&xfr);
 	}